@@ -5,60 +5,666 @@ use warnings;
 use FindBin qw($Bin);
 use Cwd;
 use Cwd 'abs_path';
+use File::Temp qw(tempdir);
+use JSON::PP;
+use Time::HiRes;
+use lib "$Bin/script";
+use Stages;
+use lib "$Bin/lib/perl";
+use File::Copy;
+use File::Path qw(make_path);
+use Parallel::ForkManager;
+
+# the project that runs, for the subs below
+my (%params, @trees, $threads, $shared_res, $report_log, $main_pid, $start, $status, $profile_dir);
+
+# several projects on one host, sharing its CPUs, memory and disks
+if (@ARGV && $ARGV[0] eq "-batch") {
+	shift(@ARGV);
+	exit(run_batch(@ARGV));
+}
 
 # check the number of argument
 if ($#ARGV+1 != 1) {
 	print STDERR "Usage: ./DESCHRAMBLER.pl <parameter file>\n";
+	print STDERR "       ./DESCHRAMBLER.pl -batch [-cpus n] [-mem MB] [-io n] [-threads n] [-noscan] <parameter file>...\n";
+	print STDERR "       ./DESCHRAMBLER.pl -batch -inproc [-jobs n] [-threads n] <parameter file>...\n";
 	exit(1);
 }
 
-my $params_f = $ARGV[0];
-
-# parse parameter file
-my %params = ();
-open(F,"$params_f");
-while(<F>) {
-	chomp;
-	my $line = trim($_);
-	if ($line =~ /^#/ || $line eq "") { next; }
-	my ($name, $value) = split(/=/);
-	$name = trim($name);
-	$value = trim($value);
-	if (-f $value || -d $value) {
-		$params{$name} = abs_path($value);
+run_project($ARGV[0]);
+
+# the report of a failed run too, up to where it stopped
+END {
+	if (defined($main_pid) && $$ == $main_pid) {
+		if (defined($profile_dir)) { system("$Bin/script/profile_stacks.pl", $profile_dir); }
+		write_report();
+	}
+}
+
+###############################################################
+# the whole run of a parameter file; dies if a stage fails
+sub run_project {
+	my $params_f = shift;
+
+	# parse parameter file
+	%params = %{read_params($params_f)};
+
+	check_parameters(\%params);
+
+	# TREEFILES: the target ancestors, each named after its tree file
+	@trees = ();
+	if (defined($params{"TREEFILES"})) {
+		my %seen = ();
+		foreach my $f (split(/\s*,\s*/, $params{"TREEFILES"})) {
+			if (!(-f $f)) { die "File doesn't exist: $f\n"; }
+			my $name = $f;
+			$name =~ s:.*/::;
+			$name =~ s:\.[^.]*$::;
+			if ($seen{$name}++) { die "two of TREEFILES are named $name\n"; }
+			push(@trees, [$name, abs_path($f)]);
+		}
+	}
+
+	make_path($params{"OUTPUTDIR"});
+	# the same paths whether or not the directory was there, for the stage manifests
+	$params{"OUTPUTDIR"} = abs_path($params{"OUTPUTDIR"});
+	$threads = defined($params{"NUMTHREADS"}) ? $params{"NUMTHREADS"} : "";
+	# SHAREBLOCKS: the resolution whose building blocks the others merge
+	$shared_res = "";
+	# the segments of the species pairs, shared with the other projects
+	if (defined($params{"SEGCACHE"})) {
+		make_path($params{"SEGCACHE"});
+		$ENV{"DESCHRAMBLER_SEGCACHE"} = abs_path($params{"SEGCACHE"});
+	}
+	# the net and chain directories listed once, for the tools not to read them
+	if (defined($params{"MANIFEST"})) {
+		if (!(-e $params{"MANIFEST"})) {
+			`$Bin/code/makeBlocks/listInputs $params{"CONFIGSFSFILE"} $params{"MANIFEST"}`;
+			if ($?) { die "cannot list the inputs in $params{\"MANIFEST\"}\n"; }
+		}
+		$ENV{"DESCHRAMBLER_MANIFEST"} = abs_path($params{"MANIFEST"});
+	}
+	if (defined($params{"MAPINDEX"})) { $ENV{"DESCHRAMBLER_MAPINDEX"} = $params{"MAPINDEX"}; }
+	if (defined($params{"OUTPUT_SPECIES"})) { $ENV{"DESCHRAMBLER_OUTPUTSPECIES"} = $params{"OUTPUT_SPECIES"}; }
+	if (defined($params{"PRUNEADJS"})) { $ENV{"DESCHRAMBLER_PRUNEADJS"} = $params{"PRUNEADJS"}; }
+	if (defined($params{"PREFETCH"})) { $ENV{"DESCHRAMBLER_PREFETCH"} = $params{"PREFETCH"}; }
+	if (defined($params{"JOIN_TIME_BUDGET"})) { $ENV{"DESCHRAMBLER_JOINBUDGET"} = $params{"JOIN_TIME_BUDGET"}; }
+	# the intermediate APCFs on a local disk: SCRATCH, or with "yes" SCRATCHDIR
+	# or TMPDIR of the environment
+	if (defined($params{"SCRATCH"}) && $params{"SCRATCH"} ne "no") {
+		my $dir = $params{"SCRATCH"};
+		if ($dir eq "yes") { $dir = $ENV{"SCRATCHDIR"} || $ENV{"TMPDIR"} || "/tmp"; }
+		$ENV{"DESCHRAMBLER_SCRATCH"} = $dir;
+	}
+	# the stages and the long tools keep their live metrics in METRICS, for
+	# the textfile collector of node_exporter
+	if (defined($params{"METRICS"})) {
+		make_path($params{"METRICS"});
+		$ENV{"DESCHRAMBLER_METRICS"} = abs_path($params{"METRICS"});
+	}
+	# PROFILE: the compiled tools sample their stacks (code/makeBlocks/profile.h)
+	# into OUTPUTDIR/profiles, folded for flamegraph.pl when the run ends
+	if (defined($params{"PROFILE"}) && $params{"PROFILE"} ne "no" && $params{"PROFILE"} ne "0") {
+		$profile_dir = $params{"OUTPUTDIR"}."/profiles";
+		make_path($profile_dir);
+		unlink(glob("$profile_dir/*.stacks"), glob("$profile_dir/*.folded"));
+		$ENV{"DESCHRAMBLER_PROFILE"} = $profile_dir;
+	}
+	# the stages append what they took to the log, made into run_report.json at the end
+	$report_log = $params{"OUTPUTDIR"}."/.run_report.jsonl";
+	$main_pid = $$;
+	$start = Time::HiRes::time();
+	$status = "failed";
+	unlink($report_log);
+	$ENV{"DESCHRAMBLER_REPORT"} = $report_log;
+	delete $ENV{"DESCHRAMBLER_REPORT_LEVEL"};
+
+	if (defined($params{"RESOLUTIONS"})) {
+		# the nets are read once, keeping what the finest resolution uses; each
+		# resolution is then made from them in OUTPUTDIR/<resolution>, all at
+		# once unless COARSEPRUNE
+		my @resolutions = sort { $a <=> $b } split(/\s*,\s*/, $params{"RESOLUTIONS"});
+		if (defined($params{"SHAREBLOCKS"}) && $params{"SHAREBLOCKS"} eq "yes") {
+			$shared_res = $resolutions[0];
+		}
+		my $net_dir = $params{"OUTPUTDIR"}."/nets";
+		my $net_config_f = $params{"OUTPUTDIR"}."/config.nets";
+		print STDERR "\n## Reading nets for resolution $resolutions[0] ##\n";
+		fill_template($params{"CONFIGSFSFILE"}, $net_config_f, "<resolutionwillbechanged>" => $resolutions[0]);
+		add_subset($net_config_f);
+		# a multiple alignment (>maf) has no nets to prune: each resolution reads it
+		my ($input, $chain_dir) = config_dirs($net_config_f);
+		if (defined($input) && -f $input) {
+			$net_dir = "";
+		} else {
+			# the chains, which the SFs read after the pruned nets, read ahead
+			run_stage($params{"OUTPUTDIR"}."/.stage.nets", "$Bin/code/makeBlocks/pruneNets $net_config_f $net_dir",
+				inputs => [$net_config_f, $input],
+				tools => ["$Bin/code/makeBlocks/pruneNets"], outputs => [$net_dir],
+				cost => {tool => "pruneNets", threads => $threads, io => 1}, next => [$chain_dir]);
+		}
+		# with SHAREBLOCKS the finest partitions the genomes before the others
+		# merge its blocks; its own run skips the stage then
+		if ($shared_res ne "") {
+			write_sf_config($shared_res, $params{"OUTPUTDIR"}."/$shared_res/SFs", $net_dir);
+			make_sfs($shared_res, $params{"OUTPUTDIR"}."/$shared_res", $net_dir);
+		}
+
+		if (defined($params{"COARSEPRUNE"})) {
+			# coarse to fine, each one pruning the candidates of the next finer
+			# one with its adjacencies, so one at a time with all the threads
+			$ENV{"DESCHRAMBLER_COARSEPRUNE"} = $params{"COARSEPRUNE"};
+			foreach my $res (reverse(@resolutions)) {
+				run_resolution($res, $params{"OUTPUTDIR"}."/$res", $net_dir);
+				$ENV{"DESCHRAMBLER_COARSE"} = $params{"OUTPUTDIR"}."/$res/SFs";
+			}
+		} else {
+			run_all("at some of the resolutions",
+				sub { my $res = shift; run_resolution($res, $params{"OUTPUTDIR"}."/$res", $net_dir); },
+				@resolutions);
+		}
 	} else {
-		$params{$name} = $value;
+		run_resolution($params{"RESOLUTION"}, $params{"OUTPUTDIR"}, "");
 	}
+	$status = "done";
 }
-close(F);
 
-check_parameters(\%params);
+# the whole reconstruction at one resolution, from the nets of net_dir if given
+sub run_resolution {
+	my ($res, $out_dir, $net_dir) = @_;
+	my $sf_dir = "$out_dir/SFs";
 
-my $sf_dir = $params{"OUTPUTDIR"}."/SFs";
-`mkdir -p $params{"OUTPUTDIR"}`;
+	# the breakpoint distances need the config file and the nets only, so
+	# they are estimated while the syntenic fragments are made
+	write_sf_config($res, $sf_dir, $net_dir);
+	my $bpdist = start_bpdist($sf_dir);
+	make_sfs($res, $out_dir, $net_dir);
+	wait_bpdist($bpdist, $sf_dir);
+	if (@trees) {
+		run_ancestors($res, $out_dir, $sf_dir);
+		return;
+	}
+	run_script("$Bin/script/create_blocklist.pl", $params{"REFSPC"}, $sf_dir);
 
-# make blocks
-print STDERR "\n## Constructing syntenic fragments ##\n"; 
-my $cwd = getcwd();
-`mkdir -p $sf_dir`;
-`sed -e 's:<resolutionwillbechanged>:$params{"RESOLUTION"}:' $params{"CONFIGSFSFILE"} > $sf_dir/config.file`;
-`sed -e 's:<willbechanged>:$Bin/code/makeBlocks:;s:<treewillbechanged>:$params{"TREEFILE"}:' $params{"MAKESFSFILE"} > $sf_dir/Makefile`;
-#}
-chdir($sf_dir);
-`make all`;
+	# reconstruct APCFs
+	run_script("$Bin/script/wrap_recon_apcf.pl", $params{"TREEFILE"}, $res, $params{"REFSPC"}, $params{"MINADJSCR"}, $sf_dir, $out_dir, $threads);
+}
 
-chdir($cwd);
-`$Bin/script/create_blocklist.pl $params{"REFSPC"} $sf_dir`; 
+# the config file and Makefile of the syntenic fragments at a resolution
+# in sf_dir, reading the nets of net_dir if given
+sub write_sf_config {
+	my ($res, $sf_dir, $net_dir) = @_;
 
-# reconstruct APCFs
-`$Bin/script/wrap_recon_apcf.pl $params{"TREEFILE"} $params{"RESOLUTION"} $params{"REFSPC"} $params{"MINADJSCR"} $sf_dir $params{"OUTPUTDIR"}`; 
+	make_path($sf_dir);
+	fill_template($params{"CONFIGSFSFILE"}, "$sf_dir/config.file", "<resolutionwillbechanged>" => $res);
+	add_subset("$sf_dir/config.file");
+	if ($net_dir ne "") { set_netdir("$sf_dir/config.file", $net_dir); }
+	my $tree_f = @trees ? "" : $params{"TREEFILE"};
+	fill_template($params{"MAKESFSFILE"}, "$sf_dir/Makefile",
+		"<willbechanged>" => "$Bin/code/makeBlocks", "<treewillbechanged>" => $tree_f);
+}
+
+# estimateBpDist on the config file of sf_dir in a process of its own;
+# returns its pid for wait_bpdist()
+sub start_bpdist {
+	my $sf_dir = shift;
+	my $pid = fork();
+	if (!defined($pid)) { die "cannot fork: $!\n"; }
+	if ($pid == 0) {
+		eval {
+			run_stage("$sf_dir/.stage.bpdist", "$Bin/code/makeBlocks/estimateBpDist config.file $threads > bpdist.txt",
+				dir => $sf_dir, key => "estimateBpDist config.file",
+				inputs => ["$sf_dir/config.file", config_dirs("$sf_dir/config.file")],
+				tools => ["$Bin/code/makeBlocks/estimateBpDist"], outputs => ["$sf_dir/bpdist.txt"],
+				cost => {tool => "estimateBpDist", threads => $threads, io => 1});
+		};
+		if ($@ ne "") { print STDERR $@; exit(1); }
+		exit(0);
+	}
+	return $pid;
+}
+
+# waits for start_bpdist() and has the reconstructions take its bpdist.txt
+sub wait_bpdist {
+	my ($pid, $sf_dir) = @_;
+	waitpid($pid, 0);
+	if ($? != 0) { die "failed to estimate the breakpoint distances in $sf_dir\n"; }
+	$ENV{"DESCHRAMBLER_BPDIST"} = "$sf_dir/bpdist.txt";
+}
+
+# the syntenic fragments at a resolution in out_dir/SFs (its config file
+# written by write_sf_config()), up to _Conserved.Segments with TREEFILES,
+# from the nets of net_dir if given
+sub make_sfs {
+	my ($res, $out_dir, $net_dir) = @_;
+	my $sf_dir = "$out_dir/SFs";
+
+	# make blocks
+	print STDERR "\n## Constructing syntenic fragments ##\n"; 
+
+	# SHAREBLOCKS: the finest resolution keeps its building blocks, and
+	# the others start from them
+	# APPROXLIFT: the breaks of the segments interpolated, without the chains
+	my $lift = (!defined($params{"APPROXLIFT"}) || $params{"APPROXLIFT"} eq "no") ? ""
+		: $params{"APPROXLIFT"} eq "check" ? "-approxCheck " : "-approx ";
+	my ($flags, @from, @blocks) = ($lift eq "" ? "" : " MBFLAGS=\"$lift\"");
+	if ($shared_res ne "" && $res == $shared_res) {
+		$flags = " MBFLAGS=\"$lift-blocks\"";
+		@blocks = ("$sf_dir/Building.Blocks");
+	} elsif ($shared_res ne "") {
+		@from = ($params{"OUTPUTDIR"}."/$shared_res/SFs/Building.Blocks");
+		$flags = " MBFLAGS=\"$lift-from $from[0]\"";
+	}
+	# the blocks of the descendents alone are kept in Descendent.Blocks:
+	# where the descendents and their nets are those it was made of, only
+	# the outgroups are partitioned again, onto those blocks. The blocks
+	# come out the same, so the manifest does not tell the two apart
+	my ($desc_f, $desc_key, $opts) = ("$sf_dir/Descendent.Blocks", "", @from ? "$lift-from $from[0]" : "");
+	if (!@from) {
+		$desc_key = descendent_key("$sf_dir/config.file");
+		if ($lift ne "") { $desc_key .= "lift\t$lift\n"; }
+		my $mode = (-f $desc_f && read_key("$desc_f.key") eq $desc_key) ? "-outgroups" : "-descendents";
+		if ($mode eq "-descendents") { unlink("$desc_f.key"); }
+		$opts = $lift.(@blocks ? "-blocks " : "")."$mode $desc_f";
+	}
+	if (@trees) {
+		run_stage("$sf_dir/.stage.common", sf_make("common", $opts), dir => $sf_dir, key => "make common$flags",
+			inputs => ["$sf_dir/config.file", "$sf_dir/Makefile", config_dirs("$sf_dir/config.file"), @from],
+			tools => ["$Bin/code/makeBlocks/makeBlocks"], outputs => ["$sf_dir/_Conserved.Segments", @blocks],
+			cost => {tool => "partitionGenomes", threads => $threads, io => 1});
+	} else {
+		run_stage("$sf_dir/.stage.SFs", sf_make("all", $opts), dir => $sf_dir, key => "make all$flags",
+			inputs => ["$sf_dir/config.file", "$sf_dir/Makefile", $params{"TREEFILE"}, config_dirs("$sf_dir/config.file"), @from],
+			tools => ["$Bin/code/makeBlocks/makeBlocks", "$Bin/code/makeBlocks/makeTargetCS"],
+			outputs => ["$sf_dir/Conserved.Segments", "$sf_dir/Genomes.Order", "$sf_dir/Genomes.db", "$sf_dir/Joins.db", @blocks],
+			cost => {tool => "partitionGenomes", threads => $threads, io => 1});
+	}
+	if ($desc_key ne "" && -f $desc_f) {
+		open(my $fh, ">", "$desc_f.key");
+		print $fh $desc_key;
+		close($fh);
+	}
+}
+
+# the command of a target of MAKESFSFILE, run in the SFs directory, with
+# the options of makeBlocks (MBFLAGS); with DESCHRAMBLER_INPROC the tools
+# that target of examples/Makefile.SFs runs, without make in between
+sub sf_make {
+	my ($target, $opts, $tree_f) = @_;
+	if (!$ENV{"DESCHRAMBLER_INPROC"}) {
+		return ($target eq "ancestor") ? "make ancestor" : "make $target THREADS=$threads".($opts eq "" ? "" : " MBFLAGS=\"$opts\"");
+	}
+	my $d = "$Bin/code/makeBlocks";
+	$opts =~ s/\s+$//;
+	if ($target eq "ancestor") {
+		return "$d/makeTargetCS config.file $tree_f _Conserved.Segments > Conserved.Segments".
+			" && $d/createGenomeFile config.file Conserved.Segments > Genomes.Order";
+	}
+	my @args = ($target eq "common") ? ("-common") : ();
+	if ($opts ne "") { push(@args, $opts); }
+	push(@args, "config.file");
+	if ($target eq "all") { push(@args, $params{"TREEFILE"}); }
+	if ($threads ne "") { push(@args, $threads); }
+	return join(" ", "$d/makeBlocks", @args);
+}
+
+# what the blocks of the descendents of a config file are made of: the
+# config without the outgroups, and the nets and chains of the
+# descendents. The chromosomes are those of the nets of the species
+# after the reference, which is kept whatever its tag
+sub descendent_key {
+	my $config_f = shift;
+	my ($key, $sect, $n, $ref, @desc) = ("", "", 0, "");
+	open(my $fh, "<", $config_f);
+	while(<$fh>) {
+		if ($_ =~ /^>(\S+)/) { $sect = $1; }
+		elsif ($sect eq "species" && $_ =~ /^(\S+)\s+(\d+)/) {
+			my ($spc, $tag, $i) = ($1, $2, $n++);
+			if ($tag == 0) { $ref = $spc; }
+			elsif ($tag == 1 || $i == 1) { push(@desc, $spc); }
+			else { next; }
+		}
+		$key .= $_;
+	}
+	close($fh);
+	foreach my $dir (config_dirs($config_f)) {
+		# a multiple alignment holds all the species
+		if (-f $dir) {
+			$key .= "$dir\t".Stages::digest($dir)."\n";
+			next;
+		}
+		foreach my $spc (@desc) {
+			$key .= "$dir/$ref/$spc\t".Stages::digest("$dir/$ref/$spc")."\n";
+		}
+	}
+	return $key;
+}
+
+sub read_key {
+	my $f = shift;
+	open(my $fh, "<", $f) or return "";
+	local $/;
+	my $key = <$fh>;
+	close($fh);
+	return defined($key) ? $key : "";
+}
+
+# the reconstruction of every tree of TREEFILES in out_dir/<name>, from the
+# _Conserved.Segments made in sf_dir, and the breakpoint distances, made
+# once there; the tail from makeTargetCS on runs for all the trees at once
+sub run_ancestors {
+	my ($res, $out_dir, $sf_dir) = @_;
+
+	run_all("some of the ancestors", sub {
+		my ($name, $tree_f) = @{$_[0]};
+		my $anc_dir = "$out_dir/$name";
+		my $anc_sf_dir = "$anc_dir/SFs";
+		print STDERR "\n## Constructing syntenic fragments of $name ##\n";
+		make_path($anc_sf_dir);
+		copy("$sf_dir/config.file", "$anc_sf_dir/config.file") or die "cannot copy $sf_dir/config.file\n";
+		unlink("$anc_sf_dir/_Conserved.Segments");
+		symlink("$sf_dir/_Conserved.Segments", "$anc_sf_dir/_Conserved.Segments");
+		fill_template($params{"MAKESFSFILE"}, "$anc_sf_dir/Makefile",
+			"<willbechanged>" => "$Bin/code/makeBlocks", "<treewillbechanged>" => $tree_f);
+		run_stage("$anc_sf_dir/.stage.SFs", sf_make("ancestor", "", $tree_f), dir => $anc_sf_dir, key => "make ancestor",
+			inputs => ["$anc_sf_dir/config.file", "$anc_sf_dir/Makefile", $tree_f, "$sf_dir/_Conserved.Segments"],
+			tools => ["$Bin/code/makeBlocks/makeTargetCS", "$Bin/code/makeBlocks/createGenomeFile"],
+			outputs => ["$anc_sf_dir/Conserved.Segments", "$anc_sf_dir/Genomes.Order", "$anc_sf_dir/Genomes.db", "$anc_sf_dir/Joins.db"],
+			cost => {tool => "makeTargetCS", threads => $threads});
+
+		run_script("$Bin/script/create_blocklist.pl", $params{"REFSPC"}, $anc_sf_dir);
+		run_script("$Bin/script/wrap_recon_apcf.pl", $tree_f, $res, $params{"REFSPC"}, $params{"MINADJSCR"}, $anc_sf_dir, $anc_dir, $threads);
+	}, @trees);
+}
+
+# runs each of items through run at the same time, in processes of their
+# own sharing the threads; a tool not given a number takes DESCHRAMBLER_THREADS
+sub run_all {
+	my ($what, $run, @items) = @_;
+	my $pm = new Parallel::ForkManager(scalar(@items));
+	my $failed = 0;
+	$pm->run_on_finish(sub { my ($pid, $code) = @_; if ($code != 0) { $failed = 1; } });
+	my $total = ($threads ne "") ? $threads : ($ENV{"DESCHRAMBLER_THREADS"} || `nproc`);
+	chomp($total);
+	my $per_item = int($total / scalar(@items));
+	if ($per_item < 1) { $per_item = 1; }
+	foreach my $item (@items) {
+		$pm->start and next;
+		$ENV{"DESCHRAMBLER_THREADS"} = $per_item;
+		if ($threads ne "") { $threads = $per_item; }
+		$run->($item);
+		$pm->finish;
+	}
+	$pm->wait_all_children;
+	if ($failed) { die "failed to reconstruct $what\n"; }
+}
+
+# OUTPUTDIR/run_report.json: the stages in the order they started, with
+# the totals of the top-level ones (those of a level > 0 ran inside one)
+sub write_report {
+	my @stages = ();
+	if (open(my $fh, "<", $report_log)) {
+		while (<$fh>) {
+			my $r = eval { decode_json($_) };
+			if (defined($r)) { push(@stages, $r); }
+		}
+		close($fh);
+	}
+	@stages = sort { $a->{start} <=> $b->{start} || $a->{level} <=> $b->{level} } @stages;
+	my %total = (user => 0, sys => 0, read => 0, written => 0, maxrss_kb => 0);
+	foreach my $r (grep { $_->{level} == 0 && !$_->{skipped} } @stages) {
+		foreach my $k ("user", "sys", "read", "written") {
+			if (defined($r->{$k}) && $r->{$k} > 0) { $total{$k} += $r->{$k}; }
+		}
+		if (defined($r->{maxrss_kb}) && $r->{maxrss_kb} > $total{maxrss_kb}) { $total{maxrss_kb} = $r->{maxrss_kb}; }
+	}
+	$total{wall} = sprintf("%.3f", Time::HiRes::time() - $start) + 0;
+	my %report = (outputdir => $params{"OUTPUTDIR"}, params => \%params,
+		start => sprintf("%.3f", $start) + 0, status => $status, total => \%total, stages => \@stages);
+	open(my $out, ">", $params{"OUTPUTDIR"}."/run_report.json") or return;
+	print $out JSON::PP->new->canonical->pretty->encode(\%report);
+	close($out);
+	unlink($report_log);
+}
+
+# points the >netdir of a config file to dir
+sub set_netdir {
+	my ($config_f, $dir) = @_;
+	open(F,"$config_f");
+	my @lines = <F>;
+	close(F);
+	open(O,">$config_f");
+	for (my $i = 0; $i <= $#lines; $i++) {
+		print O $lines[$i];
+		if ($lines[$i] =~ /^>netdir/ && $i < $#lines) {
+			print O "$dir\n";
+			$i++;
+		}
+	}
+	close(O);
+}
+
+# restricts the tools of a config file to the reference chromosomes of
+# SUBSET, a list of them or a fraction, and with SKIPSHORT to those not
+# shorter than the resolution
+sub add_subset {
+	my $config_f = shift;
+	if (!defined($params{"SUBSET"}) && !defined($params{"SKIPSHORT"})) { return; }
+	open(O,">>$config_f");
+	if (defined($params{"SUBSET"})) {
+		print O "\n# reference chromosomes to use: a list, or a fraction of them\n>subset\n$params{\"SUBSET\"}\n";
+	}
+	if (defined($params{"SKIPSHORT"})) {
+		print O "\n# skip the reference chromosomes shorter than the resolution: yes, or a chrom.sizes\n>skipshort\n$params{\"SKIPSHORT\"}\n";
+	}
+	close(O);
+}
+
+# writes a copy of a template with the first of each string of subs on a
+# line (from => to, ...) changed, as sed 's:from:to:' does
+sub fill_template {
+	my ($in_f, $out_f, @subs) = @_;
+	open(my $in, "<", $in_f) or die "cannot read $in_f\n";
+	open(my $out, ">", $out_f) or die "cannot write $out_f\n";
+	while (my $line = <$in>) {
+		for (my $i = 0; $i < $#subs; $i += 2) { $line =~ s/\Q$subs[$i]\E/$subs[$i + 1]/; }
+		print $out $line;
+	}
+	close($in);
+	close($out);
+}
+
+# the parameters of a parameter file, the files and directories among
+# them as absolute paths
+sub read_params {
+	my $f = shift;
+	my %p = ();
+	open(F,"$f") or die "cannot read $f\n";
+	while(<F>) {
+		chomp;
+		my $line = trim($_);
+		if ($line =~ /^#/ || $line eq "") { next; }
+		my ($name, $value) = split(/=/);
+		$name = trim($name);
+		$value = trim($value);
+		if (-f $value || -d $value) {
+			$p{$name} = abs_path($value);
+		} else {
+			$p{$name} = $value;
+		}
+	}
+	close(F);
+	return \%p;
+}
+
+# -batch: runs the projects of the parameter files together, each as a
+# DESCHRAMBLER.pl of its own writing batch.log to its OUTPUTDIR, their
+# stages holding the threads, the memory (as scanInputs predicts it) and
+# the I/O slots of one budget (script/Stages.pm), so that a project
+# reading its nets and another inferring adjacencies run side by side.
+# Each stage runs on -threads (half the CPUs unless NUMTHREADS is set),
+# the projects expected to take longest starting first. With -inproc the
+# projects are small ones, run by run_inproc() instead. Returns the exit
+# status
+sub run_batch {
+	my @args = @_;
+	my %budget = (cpus => stage_threads(`nproc`), mem => mem_total(), io => 2);
+	my $stage_threads = "";
+	my $scan = 1;
+	my ($inproc, $jobs) = (0, "");
+	while (@args && $args[0] =~ /^-/) {
+		my $opt = shift(@args);
+		if ($opt eq "-noscan") { $scan = 0; next; }
+		if ($opt eq "-inproc") { $inproc = 1; next; }
+		my $v = shift(@args);
+		if (!defined($v) || $v !~ /^\d+$/ || $v < 1) { die "$opt takes a positive number\n"; }
+		if ($opt eq "-cpus") { $budget{cpus} = $v; }
+		elsif ($opt eq "-mem") { $budget{mem} = $v; }
+		elsif ($opt eq "-io") { $budget{io} = $v; }
+		elsif ($opt eq "-threads") { $stage_threads = $v; }
+		elsif ($opt eq "-jobs") { $jobs = $v; }
+		else { die "unknown option $opt\n"; }
+	}
+	if (!@args) { die "Usage: ./DESCHRAMBLER.pl -batch [options] <parameter file>...\n"; }
+	if ($inproc) {
+		if ($jobs eq "") { $jobs = $budget{cpus}; }
+		if ($stage_threads eq "") { $stage_threads = int($budget{cpus} / $jobs) || 1; }
+		$scan = 0;
+	}
+	if ($stage_threads eq "") { $stage_threads = int($budget{cpus} / 2) || 1; }
+
+	my @projects = ();
+	my %outdirs = ();
+	foreach my $f (@args) {
+		my $p = read_params($f);
+		check_parameters($p);
+		make_path($p->{"OUTPUTDIR"});
+		my $out = abs_path($p->{"OUTPUTDIR"});
+		if ($outdirs{$out}++) { die "two of the projects write to $out\n"; }
+		my ($costs, $sec) = $scan ? scan_costs($p, $out, $budget{cpus}) : ("", 0);
+		push(@projects, { params_f => abs_path($f), out => $out, costs => $costs, sec => $sec });
+	}
+	if ($inproc) { return run_inproc($jobs, $stage_threads, @projects); }
+
+	my $ledger = tempdir("deschrambler-batch.XXXXXX", TMPDIR => 1, CLEANUP => 1)."/ledger";
+	open(my $fh, ">", $ledger) or die "cannot write $ledger\n";
+	print $fh "budget $budget{cpus} $budget{mem} $budget{io}\n";
+	close($fh);
+	print STDERR "Batch of ".scalar(@projects)." projects: $budget{cpus} CPUs, $budget{mem} MB, ".
+		"$budget{io} I/O slots, $stage_threads threads a stage\n";
+
+	my %running = ();
+	foreach my $p (sort { $b->{sec} <=> $a->{sec} } @projects) {
+		my $pid = fork();
+		if (!defined($pid)) { die "cannot fork: $!\n"; }
+		if ($pid == 0) {
+			$ENV{"DESCHRAMBLER_BUDGET"} = $ledger;
+			$ENV{"DESCHRAMBLER_COSTS"} = $p->{costs};
+			$ENV{"DESCHRAMBLER_THREADS"} = $stage_threads;
+			open(STDOUT, ">", "$p->{out}/batch.log") or die "cannot write $p->{out}/batch.log\n";
+			open(STDERR, ">&", \*STDOUT);
+			exec($^X, "$Bin/DESCHRAMBLER.pl", $p->{params_f});
+			exit(127);
+		}
+		$running{$pid} = $p;
+	}
+	my $failed = 0;
+	while (%running) {
+		my $pid = waitpid(-1, 0);
+		my $p = delete $running{$pid};
+		if (!defined($p)) { next; }
+		if ($? != 0) { $failed = 1; }
+		print STDERR (($? == 0) ? "done" : "FAILED")."\t$p->{params_f}\t(see $p->{out}/batch.log)\n";
+	}
+	return $failed;
+}
+
+# -batch -inproc: the projects, jobs of them at once, each in a fork of
+# this process writing batch.log to its OUTPUTDIR, its stages on
+# stage_threads. A project with little in it spends most of its time
+# starting perl, make and the scripts rather than in the tools, so here
+# the driver and the scripts are loaded once: each project is run_project()
+# in its fork, its Perl scripts run in forks of that (DESCHRAMBLER_INPROC,
+# script/Stages.pm), and makeBlocks runs without make. There is no budget
+# of memory and I/O between them. Returns the exit status
+sub run_inproc {
+	my ($jobs, $stage_threads, @projects) = @_;
+	print STDERR "Batch of ".scalar(@projects)." projects in this process: $jobs at once, ".
+		"$stage_threads threads a stage\n";
+	my $pm = new Parallel::ForkManager($jobs);
+	my $failed = 0;
+	$pm->run_on_finish(sub {
+		my ($pid, $code, $p) = @_;
+		if ($code != 0) { $failed = 1; }
+		print STDERR (($code == 0) ? "done" : "FAILED")."\t$p->{params_f}\t(see $p->{out}/batch.log)\n";
+	});
+	foreach my $p (@projects) {
+		$pm->start($p) and next;
+		$ENV{"DESCHRAMBLER_INPROC"} = 1;
+		$ENV{"DESCHRAMBLER_THREADS"} = $stage_threads;
+		open(STDOUT, ">", "$p->{out}/batch.log") or die "cannot write $p->{out}/batch.log\n";
+		open(STDERR, ">&", \*STDOUT);
+		my $ok = eval { run_project($p->{params_f}); 1; };
+		if (!$ok) { print STDERR $@; }
+		$pm->finish($ok ? 0 : 1);
+	}
+	$pm->wait_all_children;
+	return $failed;
+}
+
+# the memory of the tools as scanInputs predicts it for a project, the
+# most of its resolutions, as DESCHRAMBLER_COSTS ("tool=MB,..."), and the
+# seconds they should take. The report is kept in OUTPUTDIR/scan.txt and
+# made again when the config file is newer
+sub scan_costs {
+	my ($p, $out, $threads) = @_;
+	my $scan_f = "$out/scan.txt";
+	my $config_f = $p->{"CONFIGSFSFILE"};
+	my @res = split(/\s*,\s*/, defined($p->{"RESOLUTIONS"}) ? $p->{"RESOLUTIONS"} : $p->{"RESOLUTION"});
+	if (!(-f $scan_f) || -M $scan_f > -M $config_f) {
+		print STDERR "Scanning the inputs of $out\n";
+		fill_template($config_f, "$out/.scan.config", "<resolutionwillbechanged>" => $res[0]);
+		my $cmd = "$Bin/code/makeBlocks/scanInputs -res ".join(",", @res)." $out/.scan.config $threads";
+		if (system("$cmd > $scan_f.tmp") != 0) {
+			unlink("$scan_f.tmp");
+			print STDERR "cannot scan the inputs of $out, running it without estimates\n";
+			return ("", 0);
+		}
+		rename("$scan_f.tmp", $scan_f);
+	}
+	my %mem = ();
+	my $sec = 0;
+	open(my $fh, "<", $scan_f) or return ("", 0);
+	while (<$fh>) {
+		if ($_ =~ /^\s+(\S+)\s+([\d.]+) MB\s+([\d.]+) s$/) {
+			my $mb = int($2) + 1;
+			if (!defined($mem{$1}) || $mb > $mem{$1}) { $mem{$1} = $mb; }
+			$sec += $3;
+		}
+	}
+	close($fh);
+	return (join(",", map { "$_=$mem{$_}" } sort keys %mem), $sec);
+}
+
+# the memory of the host in MB
+sub mem_total {
+	if (open(my $fh, "<", "/proc/meminfo")) {
+		while (<$fh>) {
+			if ($_ =~ /^MemTotal:\s+(\d+) kB/) { close($fh); return int($1 / 1024); }
+		}
+		close($fh);
+	}
+	return 1 << 20;
+}
 
-###############################################################
 sub check_parameters {
 	my $rparams = shift;
 	my $flag = 0;
 	my $out = "";
-	my @parnames = ("REFSPC","OUTPUTDIR","RESOLUTION","TREEFILE","CONFIGSFSFILE","MAKESFSFILE","MINADJSCR"); 
+	my @parnames = ("REFSPC","OUTPUTDIR","CONFIGSFSFILE","MAKESFSFILE","MINADJSCR"); 
+	if (!defined($$rparams{"RESOLUTIONS"})) { push(@parnames, "RESOLUTION"); }
+	if (!defined($$rparams{"TREEFILES"})) { push(@parnames, "TREEFILE"); }
 
 	foreach my $pname (@parnames) {
 		if (!defined($$rparams{$pname})) {
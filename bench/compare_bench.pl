@@ -0,0 +1,60 @@
+#!/usr/bin/perl
+
+# compare_bench.pl - compares two run_bench.pl (or run_blocks_bench.pl)
+# results. For every dataset and step it prints the old and new wall time
+# and peak RSS and their ratio, and exits with 1 if any of them grew by
+# more than -tolerance (default 0.2).
+
+use strict;
+use warnings;
+use Getopt::Long;
+use JSON::PP;
+
+my $tolerance = 0.2;
+GetOptions("tolerance=f" => \$tolerance)
+	or die "usage: compare_bench.pl [-tolerance F] old.json new.json\n";
+die "usage: compare_bench.pl [-tolerance F] old.json new.json\n" if (@ARGV != 2);
+
+my ($old, $new) = map { read_json($_) } @ARGV;
+printf "old %s (%s), new %s (%s)\n", $old->{commit}, $old->{label}, $new->{commit}, $new->{label};
+
+my %old_runs = map { (run_key($_) => $_) } @{$old->{runs}};
+my $worse = 0;
+printf "%-12s %-16s %10s %10s %7s %10s %10s %7s\n",
+	"blocks/lvs", "step", "old s", "new s", "ratio", "old MB", "new MB", "ratio";
+foreach my $run (@{$new->{runs}}) {
+	my $key = run_key($run);
+	my $o = $old_runs{$key};
+	next unless (defined($o));
+	# every timed step: the values with a wall time
+	foreach my $step (sort grep { ref($run->{$_}) eq "HASH" && defined($run->{$_}{wall}) } keys %$run) {
+		next unless (defined($o->{$step}));
+		my ($ot, $nt) = ($o->{$step}{wall}, $run->{$step}{wall});
+		my ($om, $nm) = ($o->{$step}{maxrss_kb} / 1024, $run->{$step}{maxrss_kb} / 1024);
+		my $rt = $ot > 0 ? $nt / $ot : 1;
+		my $rm = $om > 0 ? $nm / $om : 1;
+		my $flag = "";
+		if ($rt > 1 + $tolerance || $rm > 1 + $tolerance) {
+			$flag = "  <-- worse";
+			$worse = 1;
+		}
+		printf "%-12s %-16s %10.3f %10.3f %7.2f %10.1f %10.1f %7.2f%s\n",
+			$key, $step, $ot, $nt, $rt, $om, $nm, $rm, $flag;
+	}
+}
+exit($worse);
+
+# a dataset: blocks and leaves, or of run_blocks_bench.pl genome size and leaves
+sub run_key {
+	my $run = shift;
+	return defined($run->{size}) ? "$run->{size}M/$run->{leaves}" : "$run->{blocks}/$run->{leaves}";
+}
+
+sub read_json {
+	my $f = shift;
+	open(J, "$f") or die "Unable to open $f\n";
+	local $/;
+	my $text = <J>;
+	close(J);
+	return decode_json($text);
+}
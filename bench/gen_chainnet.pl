@@ -0,0 +1,398 @@
+#!/usr/bin/perl
+
+# gen_chainnet.pl - simulates genomes down a newick tree, as segments of
+# the root genome moved by inversions, translocations and fissions, and
+# writes what makeBlocks reads of them: the chains and nets of the
+# reference against every other species in the <ref>/<spc>/chain and
+# <ref>/<spc>/net directories readNets expects (one <chr>.chain and
+# <chr>.net per reference chromosome), with config.SFs and tree.txt.
+# A segment is aligned as gap-free blocks of about -blocklen bases
+# between short gaps, and a run of segments in the same order and
+# orientation in both genomes is one chain (one top-level fill of the
+# net), so the files grow with the genome as real ones do; -size
+# 3000000000 makes them of a mammal genome.
+
+use strict;
+use warnings;
+use Getopt::Long;
+
+my $out_dir = "";
+my $tree_f = "";
+my $numleaves = 3;
+my $numout = 1;
+my $size = 100000000;
+my $numchroms = 10;
+my $seglen = 500000;
+my $inv = 0.5;
+my $trans = 0.1;
+my $fission = 0.02;
+my $loss = 0.01;
+my $blocklen = 300;
+my $gap = 60;
+my $spacer = 20000;
+my $res = 100000;
+my $seed = 1;
+
+GetOptions(
+	"out=s" => \$out_dir,
+	"tree=s" => \$tree_f,
+	"leaves=i" => \$numleaves,
+	"outgroups=i" => \$numout,
+	"size=f" => \$size,
+	"chroms=i" => \$numchroms,
+	"seglen=i" => \$seglen,
+	"inv=f" => \$inv,
+	"trans=f" => \$trans,
+	"fission=f" => \$fission,
+	"loss=f" => \$loss,
+	"blocklen=i" => \$blocklen,
+	"gap=i" => \$gap,
+	"spacer=i" => \$spacer,
+	"res=i" => \$res,
+	"seed=i" => \$seed,
+) or usage();
+usage() if (length($out_dir) == 0 || $size < $seglen || $numchroms < 1);
+
+sub usage {
+	die "usage: gen_chainnet.pl -out dir [options]\n" .
+		"  -tree file     newick tree with the target ancestor marked by '\@'\n" .
+		"                 (default: a caterpillar of -leaves species plus -outgroups)\n" .
+		"  -leaves N      ingroup species when no tree is given (default 3)\n" .
+		"  -outgroups N   outgroup species when no tree is given (default 1)\n" .
+		"  -size N        bases of the root genome (default 100000000)\n" .
+		"  -chroms N      chromosomes of the root genome (default 10)\n" .
+		"  -seglen N      mean length of the segments rearranged (default 500000)\n" .
+		"  -inv R         inversions per segment per unit branch length (default 0.5)\n" .
+		"  -trans R       reciprocal translocations, the same way (default 0.1)\n" .
+		"  -fission R     chromosome fissions, the same way (default 0.02)\n" .
+		"  -loss F        chance that a species other than the reference misses a\n" .
+		"                 segment (default 0.01)\n" .
+		"  -blocklen N    mean length of the gap-free blocks of a chain (default 300)\n" .
+		"  -gap N         mean length of the gaps between them (default 60)\n" .
+		"  -spacer N      most unaligned bases between two segments (default 20000)\n" .
+		"  -res N         resolution written to config.SFs (default 100000)\n" .
+		"  -seed N        random seed (default 1)\n";
+}
+
+srand($seed);
+
+#################################################################
+# tree
+
+my $newick = "";
+if (length($tree_f) > 0) {
+	open(F, "$tree_f") or die "Unable to open $tree_f\n";
+	while(<F>) { chomp; $newick .= $_; }
+	close(F);
+} else {
+	$newick = caterpillar($numleaves, $numout);
+}
+$newick =~ s/\s+//g;
+my $pos = 0;
+my $root = parse_node(\$newick);
+
+my @leaves = ();
+my $target;
+walk($root, 0);
+die "No target ancestor ('\@') in the tree\n" unless (defined($target));
+my @ingroup = grep { !$_->{outgroup} } @leaves;
+die "No ingroup species below '\@'\n" if (@ingroup == 0);
+my $ref = $ingroup[0];
+my @others = grep { $_ != $ref } @leaves;
+die "The tree needs a species besides the reference\n" if (@others == 0);
+
+#################################################################
+# simulation: the root genome is numseg segments of random length on
+# numchroms chromosomes; a genome is a list of chromosomes of signed
+# segment ids
+
+my $numseg = int($size / $seglen + 0.5);
+$numseg = $numchroms if ($numseg < $numchroms);
+my @len = (0);
+for (my $k = 1; $k <= $numseg; $k++) { push(@len, int($seglen / 2 + rand($seglen))); }
+
+my @chroms = ();
+my $per = $numseg / $numchroms;
+for (my $c = 0; $c < $numchroms; $c++) {
+	push(@chroms, [int($c * $per) + 1 .. int(($c+1) * $per)]);
+}
+simulate($root, \@chroms);
+
+#################################################################
+# layouts: where each segment lies in each species; the reference's
+# segments are their root lengths, those of another species the query
+# side of its alignment with them
+
+my $refl = layout($ref, sub { return $len[$_[0]]; });
+my @pairs = ();
+for (my $s = 0; $s < @others; $s++) {
+	my $sp = $others[$s];
+	my (%lq, %ali);
+	foreach my $c (@{$sp->{genome}}) {
+		foreach my $id (@$c) {
+			my $k = abs($id);
+			my ($q, $a) = (0, 0);
+			align($s, $k, sub { $q += $_[0] + $_[2]; $a += $_[0]; });
+			$lq{$k} = $q;
+			$ali{$k} = $a;
+		}
+	}
+	push(@pairs, { spc => $sp, idx => $s, ali => \%ali,
+		layout => layout($sp, sub { return $lq{$_[0]}; }) });
+}
+
+`mkdir -p $out_dir`;
+my $cn_dir = "$out_dir/chainNet";
+my $nline = 0;
+foreach my $p (@pairs) {
+	my $dir = "$cn_dir/$ref->{name}/$p->{spc}{name}";
+	`mkdir -p $dir/chain $dir/net`;
+	my $cid = 0;
+	for (my $c = 0; $c < @{$ref->{genome}}; $c++) {
+		my $chr = "chr" . ($c+1);
+		open(my $cf, ">", "$dir/chain/$chr.chain") or die "Unable to write $dir/chain/$chr.chain\n";
+		open(my $nf, ">", "$dir/net/$chr.net") or die "Unable to write $dir/net/$chr.net\n";
+		print $nf "net $chr $refl->{size}[$c]\n";
+		foreach my $run (collinear_runs($p, $ref->{genome}[$c])) {
+			write_chain($cf, $nf, $p, $chr, $c, $run, ++$cid);
+		}
+		close($cf);
+		close($nf);
+	}
+}
+
+open(O, ">$out_dir/tree.txt") or die "Unable to write $out_dir/tree.txt\n";
+print O write_node($root), ";\n";
+close(O);
+
+open(O, ">$out_dir/config.SFs") or die "Unable to write $out_dir/config.SFs\n";
+print O "# synthetic, by gen_chainnet.pl -size $size -seglen $seglen -seed $seed\n";
+print O ">netdir\n$cn_dir\n\n>chaindir\n$cn_dir\n\n>species\n";
+foreach my $leaf ($ref, @others) {
+	printf O "%s %d 1\n", $leaf->{name}, $leaf == $ref ? 0 : ($leaf->{outgroup} ? 2 : 1);
+}
+print O "\n>resolution\n$res\n";
+close(O);
+
+print STDERR "Wrote $out_dir: $numseg segments of ", scalar(@{$ref->{genome}}),
+	" reference chromosomes, ", scalar(@others), " species against $ref->{name}, ",
+	"$nline chain lines\n";
+
+#################################################################
+
+# calls f(size, tgap, qgap) for the gap-free blocks of segment k in
+# species s, the last with gaps of 0; the same blocks every time
+sub align {
+	my ($s, $k, $f) = @_;
+	my $state = int(rand(2**31));
+	srand($seed * 1000003 + $s * 100003 + $k);
+	my ($t, $l) = (0, $len[$k]);
+	for (;;) {
+		my $b = 1 + int(rand(2 * $blocklen));
+		my $dt = rand() < 0.3 ? 0 : int(rand(2 * $gap));
+		my $dq = rand() < 0.3 ? 0 : int(rand(2 * $gap));
+		$dt = 1 if ($dt == 0 && $dq == 0);
+		if ($t + $b + $dt >= $l) {
+			$f->($l - $t, 0, 0);
+			last;
+		}
+		$f->($b, $dt, $dq);
+		$t += $b + $dt;
+	}
+	srand($state);
+}
+
+# the start of every segment of a species in its chromosomes, with the
+# chromosome, index and sign, and the chromosome sizes
+sub layout {
+	my ($sp, $seglen_f) = @_;
+	my %l = (size => [], at => {});
+	for (my $c = 0; $c < @{$sp->{genome}}; $c++) {
+		my $pos = 10000 + int(rand($spacer));
+		my $g = $sp->{genome}[$c];
+		for (my $i = 0; $i < @$g; $i++) {
+			my $k = abs($g->[$i]);
+			$l{at}{$k} = [$c, $i, $g->[$i] > 0 ? 1 : -1, $pos, $pos + $seglen_f->($k)];
+			$pos += $seglen_f->($k) + 1000 + int(rand($spacer));
+		}
+		push(@{$l{size}}, $pos + 10000);
+	}
+	return \%l;
+}
+
+# the runs of reference segments that are in the same order and
+# orientation in the other species, as [strand, ids...]
+sub collinear_runs {
+	my ($p, $g) = @_;
+	my @runs = ();
+	my $prev;
+	foreach my $id (@$g) {
+		my $at = $p->{layout}{at}{abs($id)};
+		if (!defined($at)) { $prev = undef; next; }
+		my $o = ($id > 0 ? 1 : -1) * $at->[2];
+		if (defined($prev) && $prev->[0] == $at->[0] && $o == $runs[-1][0]
+				&& $at->[1] == $prev->[1] + $o) {
+			push(@{$runs[-1]}, abs($id));
+		} else {
+			push(@runs, [$o, abs($id)]);
+		}
+		$prev = $at;
+	}
+	return @runs;
+}
+
+# a run as a chain and a top-level fill with the gaps of the chain
+sub write_chain {
+	my ($cf, $nf, $p, $chr, $c, $run, $id) = @_;
+	my ($o, @ks) = @$run;
+	my ($ra, $qa) = ($refl->{at}, $p->{layout}{at});
+	my $qchr = "chr" . ($qa->{$ks[0]}[0] + 1);
+	my $qsize = $p->{layout}{size}[$qa->{$ks[0]}[0]];
+	my ($tb, $te) = ($ra->{$ks[0]}[3], $ra->{$ks[-1]}[4]);
+	# the query side on the chain's strand, and forward for the net
+	my ($qb, $qe) = $o > 0 ? ($qa->{$ks[0]}[3], $qa->{$ks[-1]}[4])
+		: ($qsize - $qa->{$ks[0]}[4], $qsize - $qa->{$ks[-1]}[3]);
+	my $ali = 0;
+	$ali += $p->{ali}{$_} foreach (@ks);
+	my $score = $ali * 90;
+	my $strand = $o > 0 ? "+" : "-";
+	print $cf "chain $score $chr $refl->{size}[$c] + $tb $te $qchr $qsize $strand $qb $qe $id\n";
+	printf $nf " fill %d %d %s %s %d %d id %d score %d ali %d qDup 0 type top\n",
+		$tb, $te - $tb, $qchr, $strand, $o > 0 ? $qb : $qsize - $qe, $qe - $qb, $id, $score, $ali;
+	my ($t, $q) = ($tb, $qb);
+	for (my $j = 0; $j < @ks; $j++) {
+		my $last = ($j == $#ks);
+		my (@b, $n);
+		align($p->{idx}, $ks[$j], sub { push(@b, [@_]); });
+		$n = scalar(@b);
+		if (!$last) {
+			# the unaligned bases up to the next segment
+			$b[-1][1] = $ra->{$ks[$j+1]}[3] - $ra->{$ks[$j]}[4];
+			$b[-1][2] = $o > 0 ? $qa->{$ks[$j+1]}[3] - $qa->{$ks[$j]}[4]
+				: $qa->{$ks[$j]}[3] - $qa->{$ks[$j+1]}[4];
+		}
+		for (my $i = 0; $i < $n; $i++) {
+			my ($sz, $dt, $dq) = @{$b[$i]};
+			$t += $sz;
+			$q += $sz;
+			if ($last && $i == $n - 1) {
+				print $cf "$sz\n\n";
+			} else {
+				print $cf "$sz\t$dt\t$dq\n";
+				printf $nf "  gap %d %d %s %s %d %d\n", $t, $dt, $qchr, $strand,
+					$o > 0 ? $q : $qsize - $q - $dq, $dq;
+			}
+			$t += $dt;
+			$q += $dq;
+			$nline++;
+		}
+	}
+}
+
+sub caterpillar {
+	my ($nin, $nout) = @_;
+	my @names = map { "spc$_" } (1..$nin+$nout);
+	my $t = sprintf("%s:%.3f", $names[0], 0.01 + rand(0.07));
+	for (my $i = 1; $i < $nin; $i++) {
+		$t = sprintf("(%s,%s:%.3f)", $t, $names[$i], 0.01 + rand(0.07));
+		$t .= sprintf(":%.3f", 0.01 + rand(0.07)) if ($i < $nin-1);
+	}
+	$t .= sprintf("\@:%.3f", 0.01 + rand(0.07));
+	for (my $i = $nin; $i < $nin+$nout; $i++) {
+		$t = sprintf("(%s,%s:%.3f)", $t, $names[$i], 0.01 + rand(0.07));
+		$t .= sprintf(":%.3f", 0.01 + rand(0.07)) if ($i < $nin+$nout-1);
+	}
+	return $t;
+}
+
+sub parse_node {
+	my $s = shift;
+	my $node = { name => "", len => 0, children => [] };
+	if (substr($$s, $pos, 1) eq "(") {
+		do {
+			$pos++;
+			push(@{$node->{children}}, parse_node($s));
+		} while (substr($$s, $pos, 1) eq ",");
+		die "Bad newick tree near position $pos\n" if (substr($$s, $pos, 1) ne ")");
+		$pos++;
+	}
+	if (substr($$s, $pos) =~ /^([^:,();]*)/) {
+		$node->{name} = $1;
+		$pos += length($1);
+	}
+	if (substr($$s, $pos, 1) eq ":") {
+		substr($$s, $pos+1) =~ /^([-+0-9.eE]+)/ or die "Bad branch length near position $pos\n";
+		$node->{len} = $1;
+		$pos += 1 + length($1);
+	}
+	return $node;
+}
+
+sub write_node {
+	my $node = shift;
+	my $s = "";
+	if (@{$node->{children}}) {
+		$s = "(" . join(",", map { write_node($_) } @{$node->{children}}) . ")";
+	}
+	$s .= $node->{name};
+	$s .= ":$node->{len}" if ($node != $root);
+	return $s;
+}
+
+# marks the leaves below '@' as ingroup
+sub walk {
+	my ($node, $below) = @_;
+	if ($node->{name} eq "\@") {
+		$target = $node;
+		$below = 1;
+	}
+	if (@{$node->{children}} == 0) {
+		$node->{outgroup} = !$below;
+		push(@leaves, $node);
+	}
+	foreach my $c (@{$node->{children}}) { walk($c, $below); }
+}
+
+sub events {
+	my ($rate, $node) = @_;
+	return int($rate * $node->{len} * $numseg + rand());
+}
+
+sub simulate {
+	my ($node, $genome) = @_;
+	my @g = map { [@$_] } @$genome;
+	for (my $k = events($inv, $node); $k > 0; $k--) {
+		# inversion of a few neighbouring segments
+		my $c = int(rand(@g));
+		my $n = scalar(@{$g[$c]});
+		my $s = int(rand($n));
+		my $l = 1 + int(rand(4));
+		$l = $n - $s if ($s + $l > $n);
+		splice(@{$g[$c]}, $s, $l, map { -$_ } reverse(@{$g[$c]}[$s..$s+$l-1]));
+	}
+	for (my $k = events($trans, $node); $k > 0 && @g > 1; $k--) {
+		# reciprocal translocation of two chromosome tails
+		my $c1 = int(rand(@g));
+		my $c2 = int(rand(@g-1));
+		$c2++ if ($c2 >= $c1);
+		my @t1 = splice(@{$g[$c1]}, 1 + int(rand(@{$g[$c1]})));
+		my @t2 = splice(@{$g[$c2]}, 1 + int(rand(@{$g[$c2]})));
+		push(@{$g[$c1]}, @t2);
+		push(@{$g[$c2]}, @t1);
+	}
+	for (my $k = events($fission, $node); $k > 0; $k--) {
+		my $c = int(rand(@g));
+		next if (@{$g[$c]} < 2);
+		push(@g, [splice(@{$g[$c]}, 1 + int(rand(@{$g[$c]} - 1)))]);
+	}
+	$node->{genome} = \@g;
+	if (@{$node->{children}} == 0 && $node != $ref) {
+		my @leafg = ();
+		foreach my $c (@g) {
+			my @c = grep { rand() >= $loss } @$c;
+			push(@leafg, \@c) if (@c > 0);
+		}
+		$node->{genome} = \@leafg;
+	}
+	foreach my $c (@{$node->{children}}) { simulate($c, \@g); }
+}
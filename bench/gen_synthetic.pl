@@ -0,0 +1,289 @@
+#!/usr/bin/perl
+
+# gen_synthetic.pl - simulates block orders down a newick tree and writes the
+# inputs of the reconstruction core: tree.txt, Genomes.Order, <species>.joins
+# and block_consscores.txt, plus ancestor.truth (the simulated '@' ancestor).
+
+use strict;
+use warnings;
+use Getopt::Long;
+
+my $out_dir = "";
+my $tree_f = "";
+my $numblocks = 1000;
+my $numleaves = 6;
+my $numout = 2;
+my $numchroms = 0;
+my $rate = 1.0;
+my $trans = 0.1;
+my $loss = 0.01;
+my $scaffold = 0;
+my $noise = 0.05;
+my $seed = 1;
+
+GetOptions(
+	"out=s" => \$out_dir,
+	"tree=s" => \$tree_f,
+	"blocks=i" => \$numblocks,
+	"leaves=i" => \$numleaves,
+	"outgroups=i" => \$numout,
+	"chroms=i" => \$numchroms,
+	"rate=f" => \$rate,
+	"trans=f" => \$trans,
+	"loss=f" => \$loss,
+	"scaffold=i" => \$scaffold,
+	"noise=f" => \$noise,
+	"seed=i" => \$seed,
+) or usage();
+usage() if (length($out_dir) == 0 || $numblocks < 2);
+
+sub usage {
+	die "usage: gen_synthetic.pl -out dir [options]\n" .
+		"  -tree file     newick tree with the target ancestor marked by '\@'\n" .
+		"                 (default: a caterpillar of -leaves species plus -outgroups)\n" .
+		"  -blocks N      number of blocks (default 1000)\n" .
+		"  -leaves N      ingroup species when no tree is given (default 6)\n" .
+		"  -outgroups N   outgroup species when no tree is given (default 2)\n" .
+		"  -chroms N      chromosomes of the root genome (default blocks/200)\n" .
+		"  -rate R        rearrangements per block per unit branch length (default 1)\n" .
+		"  -trans F       fraction of rearrangements that are translocations (default 0.1)\n" .
+		"  -loss F        chance that a leaf misses a block (default 0.01)\n" .
+		"  -scaffold N    cut leaf chromosomes into scaffolds of about N blocks (default 0, off)\n" .
+		"                 (neither applies to the reference, the first ingroup species)\n" .
+		"  -noise F       false adjacencies per block in outgroup joins and scores (default 0.05)\n" .
+		"  -seed N        random seed (default 1)\n";
+}
+
+srand($seed);
+$numchroms = int($numblocks / 200) if ($numchroms <= 0);
+$numchroms = 1 if ($numchroms < 1);
+
+#################################################################
+# tree
+
+my $newick = "";
+if (length($tree_f) > 0) {
+	open(F, "$tree_f") or die "Unable to open $tree_f\n";
+	while(<F>) { chomp; $newick .= $_; }
+	close(F);
+} else {
+	$newick = caterpillar($numleaves, $numout);
+}
+$newick =~ s/\s+//g;
+my $pos = 0;
+my $root = parse_node(\$newick);
+
+my @leaves = ();
+my $target;
+walk($root, 0);
+die "No target ancestor ('\@') in the tree\n" unless (defined($target));
+# the first ingroup species is the reference; it keeps every block, as
+# blocks are defined on the reference
+my @ingroup = grep { !$_->{outgroup} } @leaves;
+die "No ingroup species below '\@'\n" if (@ingroup == 0);
+my $ref = $ingroup[0];
+
+#################################################################
+# simulation
+
+my @chroms = ();
+my $per = $numblocks / $numchroms;
+for (my $c = 0; $c < $numchroms; $c++) {
+	my $s = int($c * $per) + 1;
+	my $e = int(($c+1) * $per);
+	push(@chroms, [$s..$e]);
+}
+simulate($root, \@chroms);
+
+`mkdir -p $out_dir`;
+
+open(O, ">$out_dir/tree.txt") or die "Unable to write $out_dir/tree.txt\n";
+print O write_node($root), ";\n";
+close(O);
+
+open(O, ">$out_dir/Genomes.Order");
+foreach my $leaf (@leaves) {
+	if ($leaf->{outgroup}) {
+		print O ">$leaf->{name} 0\n# in .joins file\n\n";
+		next;
+	}
+	my @g = @{$leaf->{genome}};
+	printf O ">%s\t%d\n", $leaf->{name}, scalar(@g);
+	for (my $c = 0; $c < @g; $c++) {
+		printf O "# chr%d\n%s \$\n", $c+1, join(" ", @{$g[$c]});
+	}
+	print O "\n";
+}
+close(O);
+
+foreach my $leaf (@leaves) {
+	open(O, ">$out_dir/$leaf->{name}.joins");
+	print O "#$numblocks\n";
+	foreach my $c (@{$leaf->{genome}}) {
+		my @c = @$c;
+		printf O "%5d\t%5d\n", 0, $c[0] unless ($leaf->{outgroup});
+		for (my $i = 1; $i < @c; $i++) { printf O "%5d\t%5d\n", $c[$i-1], $c[$i]; }
+		printf O "%5d\t%5d\n", $c[-1], 0 unless ($leaf->{outgroup});
+	}
+	if ($leaf->{outgroup}) {
+		for (my $i = 0; $i < int($noise * $numblocks); $i++) {
+			my ($x, $y) = (random_block(), random_block());
+			printf O "%5d\t%5d\n", $x, $y if (abs($x) != abs($y));
+		}
+	}
+	close(O);
+}
+
+# scores as refine_adjprob.pl writes them: true ancestral adjacencies score
+# high, some false ones low
+my %scores = ();
+foreach my $c (@{$target->{genome}}) {
+	my @c = (0, @$c, 0);
+	for (my $i = 1; $i < @c; $i++) { add_score($c[$i-1], $c[$i], 0.5 + rand(0.5)); }
+}
+for (my $i = 0; $i < int($noise * $numblocks); $i++) {
+	my ($x, $y) = (random_block(), random_block());
+	add_score($x, $y, rand(0.5)) if (abs($x) != abs($y));
+}
+open(O, ">$out_dir/block_consscores.txt");
+foreach my $k (sort { $scores{$a}{order} <=> $scores{$b}{order} } keys %scores) {
+	printf O "%s\t%e\n", $k, $scores{$k}{score};
+}
+close(O);
+
+open(O, ">$out_dir/ancestor.truth");
+print O ">$target->{name}\t", scalar(@{$target->{genome}}), "\n";
+for (my $c = 0; $c < @{$target->{genome}}; $c++) {
+	printf O "# APCF %d\n%s \$\n", $c+1, join(" ", @{$target->{genome}[$c]});
+}
+close(O);
+
+print STDERR "Wrote $out_dir: $numblocks blocks, ", scalar(@ingroup), " ingroup and ",
+	scalar(@leaves) - scalar(@ingroup), " outgroup species, reference $ref->{name}\n";
+
+#################################################################
+
+sub random_block {
+	my $n = int(rand($numblocks)) + 1;
+	return rand() < 0.5 ? -$n : $n;
+}
+
+sub add_score {
+	my ($x, $y, $s) = @_;
+	($x, $y) = (-$y, -$x) if (abs($x) > abs($y));
+	my $k = "$x\t$y";
+	return if (defined($scores{$k}));
+	$scores{$k} = { score => $s, order => scalar(keys %scores) };
+}
+
+sub caterpillar {
+	my ($nin, $nout) = @_;
+	my @names = map { "spc$_" } (1..$nin+$nout);
+	my $t = sprintf("%s:%.3f", $names[0], 0.01 + rand(0.07));
+	for (my $i = 1; $i < $nin; $i++) {
+		$t = sprintf("(%s,%s:%.3f)", $t, $names[$i], 0.01 + rand(0.07));
+		$t .= sprintf(":%.3f", 0.01 + rand(0.07)) if ($i < $nin-1);
+	}
+	$t .= sprintf("\@:%.3f", 0.01 + rand(0.07));
+	for (my $i = $nin; $i < $nin+$nout; $i++) {
+		$t = sprintf("(%s,%s:%.3f)", $t, $names[$i], 0.01 + rand(0.07));
+		$t .= sprintf(":%.3f", 0.01 + rand(0.07)) if ($i < $nin+$nout-1);
+	}
+	return $t;
+}
+
+sub parse_node {
+	my $s = shift;
+	my $node = { name => "", len => 0, children => [] };
+	if (substr($$s, $pos, 1) eq "(") {
+		do {
+			$pos++;
+			push(@{$node->{children}}, parse_node($s));
+		} while (substr($$s, $pos, 1) eq ",");
+		die "Bad newick tree near position $pos\n" if (substr($$s, $pos, 1) ne ")");
+		$pos++;
+	}
+	if (substr($$s, $pos) =~ /^([^:,();]*)/) {
+		$node->{name} = $1;
+		$pos += length($1);
+	}
+	if (substr($$s, $pos, 1) eq ":") {
+		substr($$s, $pos+1) =~ /^([-+0-9.eE]+)/ or die "Bad branch length near position $pos\n";
+		$node->{len} = $1;
+		$pos += 1 + length($1);
+	}
+	return $node;
+}
+
+sub write_node {
+	my $node = shift;
+	my $s = "";
+	if (@{$node->{children}}) {
+		$s = "(" . join(",", map { write_node($_) } @{$node->{children}}) . ")";
+	}
+	$s .= $node->{name};
+	$s .= ":$node->{len}" if ($node != $root);
+	return $s;
+}
+
+# marks the leaves below '@' as ingroup
+sub walk {
+	my ($node, $below) = @_;
+	if ($node->{name} eq "\@") {
+		$target = $node;
+		$below = 1;
+	}
+	if (@{$node->{children}} == 0) {
+		$node->{outgroup} = !$below;
+		push(@leaves, $node);
+	}
+	foreach my $c (@{$node->{children}}) { walk($c, $below); }
+}
+
+sub simulate {
+	my ($node, $genome) = @_;
+	my @g = map { [@$_] } @$genome;
+	my $events = int($rate * $node->{len} * $numblocks + 0.5);
+	for (my $k = 0; $k < $events; $k++) {
+		if (@g > 1 && rand() < $trans) {
+			# reciprocal translocation of two chromosome tails
+			my $c1 = int(rand(@g));
+			my $c2 = int(rand(@g-1));
+			$c2++ if ($c2 >= $c1);
+			my $p1 = int(rand(@{$g[$c1]}));
+			my $p2 = int(rand(@{$g[$c2]}));
+			my @t1 = splice(@{$g[$c1]}, $p1);
+			my @t2 = splice(@{$g[$c2]}, $p2);
+			push(@{$g[$c1]}, @t2);
+			push(@{$g[$c2]}, @t1);
+			@g = grep { @$_ > 0 } @g;
+		} else {
+			# inversion of a short segment
+			my $c = int(rand(@g));
+			my $n = scalar(@{$g[$c]});
+			my $s = int(rand($n));
+			my $l = 1 + int(rand(8));
+			$l = $n - $s if ($s + $l > $n);
+			my @seg = map { -$_ } reverse(@{$g[$c]}[$s..$s+$l-1]);
+			splice(@{$g[$c]}, $s, $l, @seg);
+		}
+	}
+	$node->{genome} = \@g;
+	if (@{$node->{children}} == 0 && $node != $ref) {
+		my @leafg = ();
+		foreach my $c (@g) {
+			my @c = grep { rand() >= $loss } @$c;
+			next if (@c == 0);
+			if ($scaffold > 0) {
+				while (@c > 0) {
+					my $l = 1 + int(rand(2 * $scaffold));
+					push(@leafg, [splice(@c, 0, $l)]);
+				}
+			} else {
+				push(@leafg, \@c);
+			}
+		}
+		$node->{genome} = \@leafg;
+	}
+	foreach my $c (@{$node->{children}}) { simulate($c, \@g); }
+}
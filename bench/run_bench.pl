@@ -0,0 +1,128 @@
+#!/usr/bin/perl
+
+# run_bench.pl - generates synthetic datasets with gen_synthetic.pl, times
+# inferAdjProb (with the refined scores) and deschrambler on each, and writes the
+# wall/CPU time and peak RSS of every step (and inferAdjProb's own per-phase
+# -stats) as one JSON document.
+
+use strict;
+use warnings;
+use FindBin qw($Bin);
+use Getopt::Long;
+use JSON::PP;
+
+my $sizes = "1000,10000";
+my $leaves = "6";
+my $rate = 1.0;
+my $alpha = 0.9;
+my $threads = 1;
+my $max_infer = 100000;
+my $work_dir = "$Bin/work";
+my $out_f = "";
+my $seed = 1;
+my $label = "";
+
+GetOptions(
+	"sizes=s" => \$sizes,
+	"leaves=s" => \$leaves,
+	"rate=f" => \$rate,
+	"alpha=f" => \$alpha,
+	"threads=i" => \$threads,
+	"max-infer=i" => \$max_infer,
+	"work=s" => \$work_dir,
+	"out=s" => \$out_f,
+	"seed=i" => \$seed,
+	"label=s" => \$label,
+) or die "usage: run_bench.pl [-sizes 1000,10000] [-leaves 6,12] [-rate R] [-alpha A]\n" .
+	"         [-threads N] [-max-infer N] [-work dir] [-out file.json] [-seed N] [-label text]\n" .
+	"  inferAdjProb is skipped above -max-infer blocks\n" .
+	"  (default 100000); deschrambler always runs on the generated scores\n";
+
+my $code = "$Bin/../code";
+my $runtime = "$Bin/runtime";
+foreach my $bin ("$code/inferAdjProb", "$code/deschrambler", $runtime) {
+	die "Missing $bin; run make (and make -C bench) first\n" unless (-x $bin);
+}
+
+my $commit = `git -C $Bin/.. rev-parse --short HEAD 2>/dev/null`;
+chomp($commit);
+my $host = `uname -n`;
+chomp($host);
+my $ncpu = `nproc 2>/dev/null`;
+chomp($ncpu);
+
+my @runs = ();
+foreach my $n (split(/,/, $sizes)) {
+	foreach my $l (split(/,/, $leaves)) {
+		my $dir = "$work_dir/n$n.l$l";
+		`mkdir -p $dir`;
+		system("perl", "$Bin/gen_synthetic.pl", "-out", $dir, "-blocks", $n, "-leaves", $l,
+			"-rate", $rate, "-seed", $seed) == 0 or die "gen_synthetic.pl failed for $dir\n";
+
+		my %run = (blocks => $n + 0, leaves => $l + 0, rate => $rate, threads => $threads);
+		if ($n <= $max_infer) {
+			unlink("$dir/adjacencies.prob");
+			$run{inferAdjProb} = timed($dir, "inferAdjProb", "$dir/inferAdjProb.log",
+				"$code/inferAdjProb", "-threads=$threads", "-stats=$dir/inferAdjProb.stats.json",
+				"-scores=$dir/refined_consscores.txt",
+				"spc1", $alpha, "tree.txt", "Genomes.Order");
+			$run{inferAdjProb}{phases} = read_json("$dir/inferAdjProb.stats.json")->{phases}
+				if (-e "$dir/inferAdjProb.stats.json");
+		}
+		$run{deschrambler} = timed($dir, "deschrambler", "$dir/deschrambler.log",
+			"$code/deschrambler", "0", "$dir/block_consscores.txt", "$dir/Ancestor.APCF.partial",
+			"$dir/Ancestor.ADJS", $threads);
+
+		print STDERR "n=$n leaves=$l:";
+		foreach my $step ("inferAdjProb", "deschrambler") {
+			next unless (defined($run{$step}));
+			printf STDERR " %s %.3fs %dMB", $step, $run{$step}{wall}, $run{$step}{maxrss_kb} / 1024;
+		}
+		print STDERR "\n";
+		push(@runs, \%run);
+	}
+}
+
+my %doc = (
+	commit => $commit,
+	label => $label,
+	host => $host,
+	cpus => $ncpu + 0,
+	date => scalar(localtime()),
+	runs => \@runs,
+);
+my $json = JSON::PP->new->canonical->pretty->encode(\%doc);
+if (length($out_f) > 0) {
+	open(O, ">$out_f") or die "Unable to write $out_f\n";
+	print O $json;
+	close(O);
+} else {
+	print $json;
+}
+
+# runs a command in dir under runtime, stdout going to out_f, and returns
+# its timings
+sub timed {
+	my ($dir, $name, $out_f, @cmd) = @_;
+	my $stat_f = "$dir/$name.time.json";
+	my $pid = fork();
+	die "fork failed\n" unless (defined($pid));
+	if ($pid == 0) {
+		chdir($dir) or die "Unable to enter $dir\n";
+		open(STDOUT, ">$out_f") or die "Unable to write $out_f\n";
+		open(STDERR, ">$dir/$name.err") or die "Unable to write $dir/$name.err\n";
+		exec($runtime, "-o", $stat_f, @cmd) or die "Unable to run $runtime\n";
+	}
+	waitpid($pid, 0);
+	die "$name failed in $dir (see $dir/$name.err)\n" if ($? != 0);
+	return read_json($stat_f);
+}
+
+sub read_json {
+	my $f = shift;
+	open(J, "$f") or die "Unable to open $f\n";
+	local $/;
+	my $text = <J>;
+	close(J);
+	return decode_json($text);
+}
@@ -0,0 +1,178 @@
+#!/usr/bin/perl
+
+# run_blocks_bench.pl - generates chain/net datasets with gen_chainnet.pl
+# and times the makeBlocks steps on each, the tools one at a time as
+# "make steps" runs them (readNets to createGenomeFile) and then
+# makeBlocks running them all in one process. It writes the wall/CPU
+# time, peak RSS and I/O of every tool, and makeBlocks' own per-step
+# records, as one JSON document that compare_bench.pl reads. The chain
+# stores are built by the first tool that maps positions
+# (partitionGenomes), as in a first run on new nets.
+
+use strict;
+use warnings;
+use FindBin qw($Bin);
+use Getopt::Long;
+use JSON::PP;
+
+my $sizes = "20,100";
+my $leaves = "3";
+my $threads = 1;
+my $seglen = 500000;
+my $res = 100000;
+my $work_dir = "$Bin/work";
+my $out_f = "";
+my $seed = 1;
+my $label = "";
+
+GetOptions(
+	"sizes=s" => \$sizes,
+	"leaves=s" => \$leaves,
+	"threads=i" => \$threads,
+	"seglen=i" => \$seglen,
+	"res=i" => \$res,
+	"work=s" => \$work_dir,
+	"out=s" => \$out_f,
+	"seed=i" => \$seed,
+	"label=s" => \$label,
+) or die "usage: run_blocks_bench.pl [-sizes 20,100,3000] [-leaves 3,6] [-threads N]\n" .
+	"         [-seglen N] [-res N] [-work dir] [-out file.json] [-seed N] [-label text]\n" .
+	"  -sizes are of the root genome in Mb; -seglen and -res are passed to\n" .
+	"  gen_chainnet.pl (defaults 500000 and 100000)\n";
+
+my $code = "$Bin/../code/makeBlocks";
+my $runtime = "$Bin/runtime";
+foreach my $bin ("$code/makeBlocks", "$code/readNets", "$code/createGenomeFile", $runtime) {
+	die "Missing $bin; run make (and make -C bench) first\n" unless (-x $bin);
+}
+
+my $commit = `git -C $Bin/.. rev-parse --short HEAD 2>/dev/null`;
+chomp($commit);
+my $host = `uname -n`;
+chomp($host);
+my $ncpu = `nproc 2>/dev/null`;
+chomp($ncpu);
+
+# the steps of Makefile.SFs, as [name, stdout file or "", arguments]
+my @steps = (
+	["readNets", "", "config.file", $threads],
+	["getSegments", "", "config.file", $threads],
+	["partitionGenomes", "Building.Blocks", "-bin", "config.file", $threads],
+	["makeOrthologyBlocks", "_orthology.blocks.bin", "-bin", "config.file", "Building.Blocks"],
+	["orthoBlocksToOrders", "_order.DS", "config.file", "_orthology.blocks.bin"],
+	["makeConservedSegments", "_conserved.segments.bin", "-bin", "config.file",
+		"_orthology.blocks.bin", "_order.DS"],
+	["outgroupSegsToOrders", "_order.OG", "config.file", "_conserved.segments.bin"],
+	["cleanOutgroupSegs", "_conserved.segments.bin2", "-bin", "config.file",
+		"_conserved.segments.bin", "_order.OG"],
+	["dumpBlocks", "_dump", "config.file", "_conserved.segments.bin2"],
+	["makeTargetCS", "Conserved.Segments", "config.file", "../tree.txt", "_Conserved.Segments"],
+	["createGenomeFile", "Genomes.Order", "config.file", "Conserved.Segments"],
+);
+
+my @runs = ();
+foreach my $mb (split(/,/, $sizes)) {
+	foreach my $l (split(/,/, $leaves)) {
+		my $dir = "$work_dir/blocks.${mb}M.l$l";
+		`rm -rf $dir`;
+		`mkdir -p $dir`;
+		system("perl", "$Bin/gen_chainnet.pl", "-out", $dir, "-size", $mb * 1000000,
+			"-leaves", $l, "-seglen", $seglen, "-res", $res, "-seed", $seed) == 0
+			or die "gen_chainnet.pl failed for $dir\n";
+
+		my %run = (size => $mb + 0, leaves => $l + 0, threads => $threads,
+			chain_bytes => dir_bytes("$dir/chainNet", "chain"),
+			net_bytes => dir_bytes("$dir/chainNet", "net"));
+		`mkdir -p $dir/steps $dir/all`;
+		`cp $dir/config.SFs $dir/steps/config.file`;
+		`cp $dir/config.SFs $dir/all/config.file`;
+		foreach my $s (@steps) {
+			my ($name, $out, @args) = @$s;
+			$run{$name} = timed("$dir/steps", $name, $out, "$code/$name", @args);
+			if ($name eq "dumpBlocks") {
+				# the awk of Makefile.SFs
+				open(I, "$dir/steps/_dump") or die "Unable to open $dir/steps/_dump\n";
+				open(O, ">$dir/steps/_Conserved.Segments");
+				while (<I>) {
+					my @f = split;
+					print O (@f > 2 ? "$f[0] $f[1]\n" : $_);
+				}
+				close(I);
+				close(O);
+			}
+		}
+		$ENV{"DESCHRAMBLER_STEPS"} = "$dir/all/steps.jsonl";
+		$run{makeBlocks} = timed("$dir/all", "makeBlocks", "", "$code/makeBlocks",
+			"config.file", "../tree.txt", $threads);
+		delete $ENV{"DESCHRAMBLER_STEPS"};
+		$run{makeBlocks}{steps} = read_lines("$dir/all/steps.jsonl");
+
+		my $wall = 0;
+		$wall += $run{$_->[0]}{wall} foreach (@steps);
+		printf STDERR "%dMb leaves=%d: steps %.3fs, makeBlocks %.3fs %dMB\n", $mb, $l,
+			$wall, $run{makeBlocks}{wall}, $run{makeBlocks}{maxrss_kb} / 1024;
+		push(@runs, \%run);
+	}
+}
+
+my %doc = (
+	commit => $commit,
+	label => $label,
+	host => $host,
+	cpus => $ncpu + 0,
+	date => scalar(localtime()),
+	runs => \@runs,
+);
+my $json = JSON::PP->new->canonical->pretty->encode(\%doc);
+if (length($out_f) > 0) {
+	open(O, ">$out_f") or die "Unable to write $out_f\n";
+	print O $json;
+	close(O);
+} else {
+	print $json;
+}
+
+# runs a command in dir under runtime, stdout going to out_f (or the
+# log), and returns its timings
+sub timed {
+	my ($dir, $name, $out_f, @cmd) = @_;
+	my $stat_f = "$dir/$name.time.json";
+	my $pid = fork();
+	die "fork failed\n" unless (defined($pid));
+	if ($pid == 0) {
+		chdir($dir) or die "Unable to enter $dir\n";
+		$out_f = "$name.log" if ($out_f eq "");
+		open(STDOUT, ">$out_f") or die "Unable to write $out_f\n";
+		open(STDERR, ">$dir/$name.err") or die "Unable to write $dir/$name.err\n";
+		exec($runtime, "-o", $stat_f, @cmd) or die "Unable to run $runtime\n";
+	}
+	waitpid($pid, 0);
+	die "$name failed in $dir (see $dir/$name.err)\n" if ($? != 0);
+	return read_json($stat_f);
+}
+
+# the bytes of the <spc>/<kind> directories of a chainNet directory
+sub dir_bytes {
+	my ($dir, $kind) = @_;
+	my $n = 0;
+	foreach my $f (glob("$dir/*/*/$kind/*.$kind")) { $n += -s $f; }
+	return $n;
+}
+
+sub read_json {
+	my $f = shift;
+	open(J, "$f") or die "Unable to open $f\n";
+	local $/;
+	my $text = <J>;
+	close(J);
+	return decode_json($text);
+}
+
+sub read_lines {
+	my $f = shift;
+	my @recs = ();
+	open(J, "$f") or return \@recs;
+	while (<J>) { push(@recs, decode_json($_)); }
+	close(J);
+	return \@recs;
+}
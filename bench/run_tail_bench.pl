@@ -0,0 +1,245 @@
+#!/usr/bin/perl
+
+# run_tail_bench.pl - times the tail of wrap_recon_apcf.pl, from adding the
+# missing blocks to the APCF sizes, step by step. The inputs of each data
+# set (Ancestor.APCF.partial and .ADJS, and the SFs directory with its
+# Conserved.Segments, .joins and block_consscores.txt) are made once by a
+# whole run of DESCHRAMBLER.pl on the chains and nets of gen_chainnet.pl;
+# every step is then run on them alone, in the form the pipeline runs now
+# ("native") and in the perl script it replaced ("perl"), each form on the
+# outputs of its own steps before. It writes the wall/CPU time, peak RSS
+# and I/O of every step as one JSON document (each step of a data set as
+# <step>.<form>, which compare_bench.pl reads), and prints how the time of
+# each step grows with the number of blocks over the data sets.
+
+use strict;
+use warnings;
+use FindBin qw($Bin);
+use Getopt::Long;
+use JSON::PP;
+
+my $sizes = "20,100";
+my $leaves = "3";
+my $threads = 1;
+my $seglen = 500000;
+my $res = 100000;
+my $min_adj = 0.0001;
+my $forms = "native,perl";
+my $work_dir = "$Bin/work";
+my $out_f = "";
+my $seed = 1;
+my $label = "";
+
+GetOptions(
+	"sizes=s" => \$sizes,
+	"leaves=s" => \$leaves,
+	"threads=i" => \$threads,
+	"seglen=i" => \$seglen,
+	"res=i" => \$res,
+	"minadj=f" => \$min_adj,
+	"forms=s" => \$forms,
+	"work=s" => \$work_dir,
+	"out=s" => \$out_f,
+	"seed=i" => \$seed,
+	"label=s" => \$label,
+) or die "usage: run_tail_bench.pl [-sizes 20,100,3000] [-leaves 3,6] [-threads N]\n" .
+	"         [-seglen N] [-res N] [-minadj X] [-forms native,perl] [-work dir]\n" .
+	"         [-out file.json] [-seed N] [-label text]\n" .
+	"  -sizes are of the root genome in Mb; -seglen is passed to gen_chainnet.pl,\n" .
+	"  -res is the resolution of the run (default 100000) and -minadj its MINADJSCR\n";
+
+my $code = "$Bin/../code";
+my $script = "$Bin/../script";
+my $runtime = "$Bin/runtime";
+foreach my $bin ("$code/makeBlocks/makeBlocks", "$code/makeBlocks/finishApcfs", "$code/joinSplits", $runtime) {
+	die "Missing $bin; run make (and make -C bench) first\n" unless (-x $bin);
+}
+my %form = map { $_ => 1 } split(/,/, $forms);
+
+my $commit = `git -C $Bin/.. rev-parse --short HEAD 2>/dev/null`;
+chomp($commit);
+my $host = `uname -n`;
+chomp($host);
+my $ncpu = `nproc 2>/dev/null`;
+chomp($ncpu);
+
+# the steps of the tail in order, each in the forms it has, as [stdout file
+# or "", command]; S is the SFs directory, T the tree, and the relative
+# names are those of the directory of the form
+sub tail_steps {
+	my ($S, $T) = @_;
+	my $fa = "$code/makeBlocks/finishApcfs";
+	return (
+		{ name => "add_missing",
+		  native => ["Ancestor.APCF.tmp1", $fa, "-missing", "$S/config.file", "$S/Conserved.Segments", "Ancestor.APCF.partial"],
+		  perl => ["Ancestor.APCF.tmp1", "perl", "$script/add_missing_blocks.pl", "$S/block_list.txt", "Ancestor.APCF.partial"] },
+		{ name => "split_weak",
+		  native => ["", $fa, "-split", "$S/config.file", $S, "Ancestor.APCF.tmp1", "Ancestor.APCF.tmp2", "Ancestor.splits", $threads],
+		  perl => ["", "perl", "$script/split_weak_joins.pl", "Ancestor.APCF.tmp1", $S, "Ancestor.APCF.tmp2", "Ancestor.splits"] },
+		{ name => "join_splits",
+		  native => ["Ancestor.APCF.unordered", "$code/joinSplits", $min_adj, $T, "Ancestor.APCF.tmp2", $S, "Ancestor.splits"],
+		  perl => ["Ancestor.APCF.unordered", "perl", "$script/join_splits.pl", $min_adj, $T, "Ancestor.APCF.tmp2", $S, "Ancestor.splits"] },
+		# finishApcfs writes Ancestor.joins as it sorts
+		{ name => "sort_apcfs",
+		  native => ["Ancestor.APCF", $fa, "$S/config.file", "$S/Conserved.Segments", $S, "Ancestor.APCF.unordered", "Ancestor.joins"],
+		  perl => ["Ancestor.APCF", "perl", "$script/sort_apcfs.pl", "spc1", "Ancestor.APCF.unordered", "$S/Conserved.Segments"] },
+		{ name => "ext_join_info",
+		  perl => ["Ancestor.joins", "perl", "$script/ext_join_info.pl", "Ancestor.APCF", "$S/"] },
+		{ name => "car_file",
+		  native => ["APCFs", "$code/makeBlocks/createCarFile", "$S/config.file", "Ancestor.APCF", "$S/Conserved.Segments"] },
+		{ name => "mapfile",
+		  native => ["", "$code/makeBlocks/createMapFiles", "$S/config.file", "$S/Conserved.Segments", "Ancestor.APCF", "./"],
+		  perl => ["", "perl", "$script/create_mapfile.pl", "$S/config.file", "$S/Conserved.Segments",
+			"$S/block_consscores.txt", "Ancestor.APCF", "Ancestor.ADJS", "./"] },
+		# merge_pos3ex*.pl, which merge_blocks.wogaps.pl runs, and
+		# compute_size.pl have no native form yet
+		{ name => "merge_blocks",
+		  perl => ["", "perl", "$script/merge_blocks.wogaps.pl", $res, "APCF", "$S/config.file", "./", $threads] },
+		{ name => "size",
+		  perl => ["APCF_size.txt", "perl", "$script/compute_size.pl", "APCF", "APCF_spc1.merged.map"] },
+	);
+}
+
+my @runs = ();
+foreach my $mb (split(/,/, $sizes)) {
+	foreach my $l (split(/,/, $leaves)) {
+		my $dir = "$work_dir/tail.${mb}M.l$l";
+		`rm -rf $dir`;
+		`mkdir -p $dir`;
+		system("perl", "$Bin/gen_chainnet.pl", "-out", $dir, "-size", $mb * 1000000,
+			"-leaves", $l, "-seglen", $seglen, "-res", $res, "-seed", $seed) == 0
+			or die "gen_chainnet.pl failed for $dir\n";
+		make_inputs($dir);
+
+		my $S = "$dir/out/SFs";
+		my %run = (size => $mb + 0, leaves => $l + 0, threads => $threads, res => $res,
+			blocks => count_blocks("$S/Conserved.Segments"));
+		foreach my $f (sort keys %form) {
+			`rm -rf $dir/$f`;
+			`mkdir -p $dir/$f`;
+			`cp $dir/out/Ancestor.APCF.partial $dir/out/Ancestor.ADJS $dir/$f/`;
+		}
+		my %wall = ();
+		foreach my $s (tail_steps($S, "$dir/tree.txt")) {
+			foreach my $f (sort keys %form) {
+				next unless (defined($s->{$f}));
+				my ($out, @cmd) = @{$s->{$f}};
+				$run{"$s->{name}.$f"} = timed("$dir/$f", $s->{name}, $out, @cmd);
+				$wall{$f} += $run{"$s->{name}.$f"}{wall};
+			}
+		}
+		printf STDERR "%dMb leaves=%d: %d blocks,%s\n", $mb, $l, $run{blocks},
+			join(",", map { sprintf(" %s %.3fs", $_, $wall{$_}) } sort keys %wall);
+		push(@runs, \%run);
+	}
+}
+report_scaling(\@runs);
+
+my %doc = (
+	commit => $commit,
+	label => $label,
+	host => $host,
+	cpus => $ncpu + 0,
+	date => scalar(localtime()),
+	runs => \@runs,
+);
+my $json = JSON::PP->new->canonical->pretty->encode(\%doc);
+if (length($out_f) > 0) {
+	open(O, ">$out_f") or die "Unable to write $out_f\n";
+	print O $json;
+	close(O);
+} else {
+	print $json;
+}
+
+# the inputs of the tail: a whole run of DESCHRAMBLER.pl in dir/out, on
+# the chains and nets of gen_chainnet.pl at the resolution of the run
+sub make_inputs {
+	my $dir = shift;
+	open(I, "$dir/config.SFs") or die "Unable to open $dir/config.SFs\n";
+	open(O, ">$dir/config.run") or die "Unable to write $dir/config.run\n";
+	my $in_res = 0;
+	while (<I>) {
+		if ($in_res && /^\d+/) { $_ = "<resolutionwillbechanged>\n"; }
+		$in_res = /^>resolution/;
+		print O $_;
+	}
+	close(I);
+	close(O);
+	open(O, ">$dir/params.txt") or die "Unable to write $dir/params.txt\n";
+	print O "REFSPC=spc1\nOUTPUTDIR=$dir/out\nRESOLUTION=$res\nTREEFILE=$dir/tree.txt\n" .
+		"MINADJSCR=$min_adj\nCONFIGSFSFILE=$dir/config.run\nMAKESFSFILE=$Bin/../examples/Makefile.SFs\n";
+	close(O);
+	local $ENV{"DESCHRAMBLER_THREADS"} = $threads;
+	system("cd $dir && perl $Bin/../DESCHRAMBLER.pl params.txt > run.log 2>&1") == 0
+		or die "DESCHRAMBLER.pl failed in $dir (see $dir/run.log)\n";
+}
+
+# the blocks of a Conserved.Segments file
+sub count_blocks {
+	my $f = shift;
+	my $n = 0;
+	open(I, "$f") or die "Unable to open $f\n";
+	while (<I>) { $n++ if (/^>/); }
+	close(I);
+	return $n;
+}
+
+# the wall time of every step and form against the blocks of the data sets
+# of the same number of leaves, with the exponent of its growth from the
+# set before (2 for a time growing with the square of the blocks)
+sub report_scaling {
+	my $runs = shift;
+	my %by_leaves = ();
+	push(@{$by_leaves{$_->{leaves}}}, $_) foreach (@$runs);
+	foreach my $l (sort { $a <=> $b } keys %by_leaves) {
+		my @sets = sort { $a->{blocks} <=> $b->{blocks} } @{$by_leaves{$l}};
+		next if (@sets < 2);
+		printf STDERR "\nleaves=%d, wall seconds (growth exponent) by blocks\n%-24s", $l, "step";
+		printf STDERR " %16d", $_->{blocks} foreach (@sets);
+		print STDERR "\n";
+		foreach my $step (map { $_->{name} } tail_steps("", "")) {
+			foreach my $f (sort keys %form) {
+				next unless (defined($sets[0]{"$step.$f"}));
+				printf STDERR "%-24s", "$step ($f)";
+				my ($n0, $t0);
+				foreach my $s (@sets) {
+					my ($n, $t) = ($s->{blocks}, $s->{"$step.$f"}{wall});
+					my $e = (defined($t0) && $t0 > 0 && $t > 0 && $n > $n0)
+						? sprintf("(%.2f)", log($t / $t0) / log($n / $n0)) : "";
+					printf STDERR " %9.3f %6s", $t, $e;
+					($n0, $t0) = ($n, $t);
+				}
+				print STDERR "\n";
+			}
+		}
+	}
+}
+
+# runs a command in dir under runtime, stdout going to out_f (or the
+# log), and returns its timings
+sub timed {
+	my ($dir, $name, $out_f, @cmd) = @_;
+	my $stat_f = "$dir/$name.time.json";
+	my $pid = fork();
+	die "fork failed\n" unless (defined($pid));
+	if ($pid == 0) {
+		chdir($dir) or die "Unable to enter $dir\n";
+		$out_f = "$name.log" if ($out_f eq "");
+		open(STDOUT, ">$out_f") or die "Unable to write $out_f\n";
+		open(STDERR, ">$dir/$name.err") or die "Unable to write $dir/$name.err\n";
+		exec($runtime, "-o", $stat_f, @cmd) or die "Unable to run $runtime\n";
+	}
+	waitpid($pid, 0);
+	die "$name failed in $dir (see $dir/$name.err)\n" if ($? != 0);
+	return read_json($stat_f);
+}
+
+sub read_json {
+	my $f = shift;
+	open(J, "$f") or die "Unable to open $f\n";
+	local $/;
+	my $text = <J>;
+	close(J);
+	return decode_json($text);
+}
@@ -0,0 +1,276 @@
+/* runtime - runs a command and prints its wall-clock time, CPU time,
+ * peak resident set size and I/O as a JSON object on stderr (or to -o
+ * file).
+ *   usage: runtime [-o file] command [args...]
+ * The exit status is the command's. The I/O is that of the command and
+ * of all the processes it waited for, from /proc/<pid>/io read before
+ * the command is reaped: the bytes it read and wrote, and of those the
+ * bytes that went to or came from the disk rather than the page cache.
+ * They are -1 where /proc has no io files. DESCHRAMBLER.pl runs every
+ * stage under it for the run report.
+ *
+ * With DESCHRAMBLER_METRICS naming a directory, the command is measured
+ * while it runs as well: every DESCHRAMBLER_METRICS_INTERVAL seconds
+ * (15 unless set) the resident memory, CPU time and I/O of it and of
+ * the processes under it are written there as an OpenMetrics text file,
+ * deschrambler.<pid>.prom, for the textfile collector of node_exporter,
+ * labelled with the stage (DESCHRAMBLER_STAGE, else the command) and
+ * the directory it runs in. The file goes when the command is done. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <dirent.h>
+#include <time.h>
+
+struct io {
+	long long rchar, wchar, read_bytes, write_bytes;
+};
+
+/* the I/O of a process (and of the children it reaped), which may have
+ * exited but is not reaped yet */
+static void read_io(pid_t pid, struct io *io) {
+	char path[64], key[32];
+	long long v;
+	FILE *fp;
+
+	io->rchar = io->wchar = io->read_bytes = io->write_bytes = -1;
+	snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+	if ((fp = fopen(path, "r")) == NULL)
+		return;
+	while (fscanf(fp, "%31[^:]: %lld\n", key, &v) == 2) {
+		if (strcmp(key, "rchar") == 0)
+			io->rchar = v;
+		else if (strcmp(key, "wchar") == 0)
+			io->wchar = v;
+		else if (strcmp(key, "read_bytes") == 0)
+			io->read_bytes = v;
+		else if (strcmp(key, "write_bytes") == 0)
+			io->write_bytes = v;
+	}
+	fclose(fp);
+}
+
+static double seconds(struct timeval *tv) {
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/* a process of /proc: its parent, CPU time (with its reaped children's)
+ * in clock ticks and resident pages */
+struct proc {
+	int pid, ppid, under;
+	long long ticks, rss;
+};
+
+static int read_proc(int pid, struct proc *p) {
+	char path[64], buf[1024], *s;
+	long long ut, st, cut, cst, rss;
+	int ppid;
+	size_t n;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	if ((fp = fopen(path, "r")) == NULL)
+		return 0;
+	n = fread(buf, 1, sizeof(buf) - 1, fp);
+	fclose(fp);
+	buf[n] = '\0';
+	// the name in parentheses may hold anything
+	if ((s = strrchr(buf, ')')) == NULL || sscanf(s + 2, "%*c %d %*s %*s %*s %*s %*s %*s %*s %*s %*s "
+			"%lld %lld %lld %lld %*s %*s %*s %*s %*s %*s %lld", &ppid, &ut, &st, &cut, &cst, &rss) != 6)
+		return 0;
+	p->pid = pid;
+	p->ppid = ppid;
+	p->under = 0;
+	p->ticks = ut + st + cut + cst;
+	p->rss = rss;
+	return 1;
+}
+
+// v with what OpenMetrics escapes in a label escaped
+static char *label(const char *v, char *buf, int n) {
+	int k = 0;
+
+	for (; *v != '\0' && k < n - 3; v++) {
+		if (*v == '"' || *v == '\\' || *v == '\n')
+			buf[k++] = '\\';
+		buf[k++] = *v == '\n' ? 'n' : *v;
+	}
+	buf[k] = '\0';
+	return buf;
+}
+
+/* the memory, CPU time and I/O of the command and the processes under
+ * it as they are now, to file */
+static void write_metrics(const char *file, pid_t top, const char *stage, double start) {
+	static struct proc *procs = NULL;
+	static int maxprocs = 0;
+	char tmpfile[1100], dir[1000], st[300], wd[2100];
+	long long ticks = 0, rss = 0;
+	struct io io, sum = {0, 0, 0, 0};
+	struct dirent *ent;
+	struct timeval now;
+	int n = 0, j, k, more, nunder = 0;
+	DIR *dp;
+	FILE *fp;
+
+	if ((dp = opendir("/proc")) == NULL)
+		return;
+	while ((ent = readdir(dp)) != NULL) {
+		if (ent->d_name[0] < '0' || ent->d_name[0] > '9')
+			continue;
+		if (n == maxprocs) {
+			maxprocs = maxprocs ? 2 * maxprocs : 1024;
+			if ((procs = realloc(procs, maxprocs * sizeof(struct proc))) == NULL) {
+				closedir(dp);
+				maxprocs = 0;
+				return;
+			}
+		}
+		n += read_proc(atoi(ent->d_name), &procs[n]);
+	}
+	closedir(dp);
+	// the command and, pass by pass, the processes whose parent is under it
+	for (k = 0; k < n; k++)
+		procs[k].under = procs[k].pid == top;
+	do {
+		more = 0;
+		for (k = 0; k < n; k++)
+			for (j = 0; !procs[k].under && j < n; j++)
+				if (procs[j].under && procs[j].pid == procs[k].ppid)
+					procs[k].under = more = 1;
+	} while (more);
+	for (k = 0; k < n; k++) {
+		if (!procs[k].under)
+			continue;
+		nunder++;
+		ticks += procs[k].ticks;
+		rss += procs[k].rss;
+		read_io(procs[k].pid, &io);
+		if (io.rchar >= 0) {
+			sum.rchar += io.rchar;
+			sum.wchar += io.wchar;
+			sum.read_bytes += io.read_bytes;
+			sum.write_bytes += io.write_bytes;
+		}
+	}
+
+	snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", file);
+	if ((fp = fopen(tmpfile, "w")) == NULL)
+		return;
+	label(stage, st, sizeof(st));
+	label(getcwd(dir, sizeof(dir)) != NULL ? dir : "", wd, sizeof(wd));
+	gettimeofday(&now, NULL);
+	fprintf(fp, "# TYPE deschrambler_stage_start_time_seconds gauge\n"
+		"# HELP deschrambler_stage_start_time_seconds When the stage started.\n"
+		"deschrambler_stage_start_time_seconds{stage=\"%s\",dir=\"%s\"} %.3f\n", st, wd, start);
+	fprintf(fp, "# TYPE deschrambler_stage_processes gauge\n"
+		"deschrambler_stage_processes{stage=\"%s\",dir=\"%s\"} %d\n", st, wd, nunder);
+	fprintf(fp, "# TYPE deschrambler_stage_resident_memory_bytes gauge\n"
+		"deschrambler_stage_resident_memory_bytes{stage=\"%s\",dir=\"%s\"} %lld\n",
+		st, wd, rss * sysconf(_SC_PAGESIZE));
+	fprintf(fp, "# TYPE deschrambler_stage_cpu_seconds counter\n"
+		"deschrambler_stage_cpu_seconds_total{stage=\"%s\",dir=\"%s\"} %.2f\n",
+		st, wd, (double)ticks / sysconf(_SC_CLK_TCK));
+	fprintf(fp, "# TYPE deschrambler_stage_read_bytes counter\n"
+		"deschrambler_stage_read_bytes_total{stage=\"%s\",dir=\"%s\"} %lld\n"
+		"# TYPE deschrambler_stage_written_bytes counter\n"
+		"deschrambler_stage_written_bytes_total{stage=\"%s\",dir=\"%s\"} %lld\n"
+		"# TYPE deschrambler_stage_disk_read_bytes counter\n"
+		"deschrambler_stage_disk_read_bytes_total{stage=\"%s\",dir=\"%s\"} %lld\n"
+		"# TYPE deschrambler_stage_disk_written_bytes counter\n"
+		"deschrambler_stage_disk_written_bytes_total{stage=\"%s\",dir=\"%s\"} %lld\n",
+		st, wd, sum.rchar, st, wd, sum.wchar, st, wd, sum.read_bytes, st, wd, sum.write_bytes);
+	fprintf(fp, "# EOF\n");
+	if (fclose(fp) != 0 || rename(tmpfile, file) != 0)
+		unlink(tmpfile);
+}
+
+int main(int argc, char *argv[]) {
+	struct timeval t0, t1;
+	struct rusage ru;
+	struct io io;
+	siginfo_t info;
+	FILE *out = stderr;
+	int argi = 1, status;
+	pid_t pid;
+	const char *metrics = getenv("DESCHRAMBLER_METRICS"), *s, *stage;
+	char file[1100];
+	struct timespec tick;
+	sigset_t chld, old;
+
+	if (argc > 2 && strcmp(argv[1], "-o") == 0) {
+		if ((out = fopen(argv[2], "w")) == NULL) {
+			perror(argv[2]);
+			return 1;
+		}
+		argi = 3;
+	}
+	if (argi >= argc) {
+		fprintf(stderr, "usage: runtime [-o file] command [args...]\n");
+		return 1;
+	}
+
+	if (metrics != NULL && *metrics == '\0')
+		metrics = NULL;
+	// the command's end wakes the wait between the measures
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	if (metrics != NULL)
+		sigprocmask(SIG_BLOCK, &chld, &old);
+
+	gettimeofday(&t0, NULL);
+	if ((pid = fork()) < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (pid == 0) {
+		if (metrics != NULL)
+			sigprocmask(SIG_SETMASK, &old, NULL);
+		execvp(argv[argi], argv + argi);
+		perror(argv[argi]);
+		_exit(127);
+	}
+	if (metrics != NULL) {
+		snprintf(file, sizeof(file), "%s/deschrambler.%d.prom", metrics, (int)getpid());
+		stage = getenv("DESCHRAMBLER_STAGE");
+		if (stage == NULL || *stage == '\0')
+			stage = (s = strrchr(argv[argi], '/')) != NULL ? s + 1 : argv[argi];
+		s = getenv("DESCHRAMBLER_METRICS_INTERVAL");
+		tick.tv_sec = (s != NULL && atoi(s) > 0) ? atoi(s) : 15;
+		tick.tv_nsec = 0;
+		for (;;) {
+			write_metrics(file, pid, stage, seconds(&t0));
+			info.si_pid = 0;
+			if (waitid(P_PID, pid, &info, WEXITED | WNOWAIT | WNOHANG) != 0 || info.si_pid == pid)
+				break;
+			sigtimedwait(&chld, NULL, &tick);
+		}
+		unlink(file);
+	}
+	// the I/O counts go with the process once it is reaped
+	if (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) == 0)
+		read_io(pid, &io);
+	else
+		read_io(-1, &io);
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		perror("wait4");
+		return 1;
+	}
+	gettimeofday(&t1, NULL);
+
+	fprintf(out, "{\"wall\": %.3f, \"user\": %.3f, \"sys\": %.3f, \"maxrss_kb\": %ld, "
+		"\"read\": %lld, \"written\": %lld, \"disk_read\": %lld, \"disk_written\": %lld, "
+		"\"status\": %d}\n",
+		seconds(&t1) - seconds(&t0), seconds(&ru.ru_utime), seconds(&ru.ru_stime),
+		ru.ru_maxrss, io.rchar, io.wchar, io.read_bytes, io.write_bytes,
+		WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+	if (out != stderr)
+		fclose(out);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
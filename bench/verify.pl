@@ -0,0 +1,220 @@
+#!/usr/bin/perl
+
+# verify.pl - runs a tool of this tree and the same tool of another tree
+# (a build of the legacy code, say a git worktree of an older commit) on
+# the same input and compares what they write. Each runs in its own copy
+# of the files of the current directory; the files a run writes or
+# changes there, and its standard output, are its outputs. Outputs named
+# *prob* (adjacencies.prob and its tagged forms, in text or binary) must
+# agree within -tolerance, every other output (the APCFs, the block lists
+# and the rest) byte for byte. Prints the time of both runs and the first
+# divergence of each output that differs, and exits with 1 if any does.
+#
+# With -threads instead of -legacy, the tool of this tree runs once for
+# each of the thread counts, given as DESCHRAMBLER_THREADS and in place
+# of every %t of the arguments, and every output, the .prob files too,
+# must come out byte for byte the same as with the first count.
+#
+#   verify.pl -legacy /tmp/old inferAdjProb -threads 4 config.file ...
+#   verify.pl -legacy /tmp/old makeBlocks config.file tree.txt
+#   verify.pl -threads 1,2,8 inferAdjProb -threads=%t spc1 0.5 tree.txt Genomes.Order
+
+use strict;
+use warnings;
+use FindBin qw($Bin);
+use File::Basename;
+use File::Temp qw(tempdir);
+use Getopt::Long;
+use Time::HiRes qw(time);
+
+my $legacy = "";
+my $new = "$Bin/..";
+my $tolerance = 1e-9;
+my $keep = 0;
+my $threads = "";
+
+Getopt::Long::Configure("require_order");
+GetOptions(
+	"legacy=s" => \$legacy,
+	"new=s" => \$new,
+	"tolerance=f" => \$tolerance,
+	"keep" => \$keep,
+	"threads=s" => \$threads,
+) or usage();
+usage() if (($legacy eq "") == ($threads eq "") || @ARGV == 0);
+
+my ($tool, @args) = @ARGV;
+my %before = snapshot(".");
+my %run;
+# the runs to compare, each against the first: [name, tree, threads]
+my @sides = (["legacy", $legacy, ""], ["new", $new, ""]);
+if ($threads ne "") {
+	@sides = map { ["t$_", $new, $_] } split(/,/, $threads);
+	usage() if (@sides < 2 || grep { $_->[2] !~ /^\d+$/ || $_->[2] < 1 } @sides);
+	$tolerance = 0;
+}
+foreach my $side (@sides) {
+	my ($name, $tree, $nt) = @$side;
+	my $exe = tool_path($tree, $tool);
+	my $dir = tempdir("verify-$name-XXXXXX", TMPDIR => 1, CLEANUP => !$keep);
+	foreach my $f (keys %before) {
+		system("cp", "-p", $f, "$dir/$f") == 0 or die "cannot copy $f to $dir\n";
+	}
+	my $start = time();
+	my $pid = fork();
+	die "cannot fork: $!\n" unless (defined($pid));
+	if ($pid == 0) {
+		chdir($dir) or die "cannot enter $dir\n";
+		open(STDOUT, ">", "stdout") or die "cannot write $dir/stdout\n";
+		if ($nt ne "") {
+			$ENV{"DESCHRAMBLER_THREADS"} = $nt;
+			@args = map { my $a = $_; $a =~ s/%t/$nt/g; $a } @args;
+		}
+		exec($exe, @args) or die "cannot run $exe\n";
+	}
+	waitpid($pid, 0);
+	my $status = $?;
+	$run{$name} = { dir => $dir, wall => time() - $start, status => $status >> 8 };
+	printf "%-7s %8.3f s  exit %d  %s\n", $name, $run{$name}{wall}, $run{$name}{status}, $exe;
+	print "        kept in $dir\n" if ($keep);
+}
+
+my $diverged = 0;
+my %outputs;
+foreach my $name (keys %run) {
+	my %after = snapshot($run{$name}{dir});
+	foreach my $f (keys %after) {
+		$outputs{$f} = 1 if (!defined($before{$f}) || $before{$f} ne $after{$f});
+	}
+}
+my $first = $sides[0][0];
+foreach my $side (@sides[1..$#sides]) {
+	my $other = $side->[0];
+	my $vs = (@sides > 2) ? " ($other)" : "";
+	if ($run{$first}{status} != $run{$other}{status}) {
+		print "exit status differs$vs\n";
+		$diverged = 1;
+	}
+	foreach my $f (sort keys %outputs) {
+		my ($a, $b) = map { "$run{$_}{dir}/$f" } ($first, $other);
+		my $why;
+		if (!-e $a || !-e $b) {
+			$why = "written by " . (-e $a ? $first : $other) . " only";
+		} elsif (basename($f) =~ /prob/ && $tolerance > 0) {
+			$why = compare_prob($a, $b);
+		} else {
+			$why = compare_exact($a, $b, $first, $other);
+		}
+		if (defined($why)) {
+			printf "%-30s DIFFERS%s: %s\n", $f, $vs, $why;
+			$diverged = 1;
+		} else {
+			printf "%-30s same%s\n", $f, $vs;
+		}
+	}
+}
+exit($diverged ? 1 : 0);
+
+sub usage {
+	die "usage: verify.pl -legacy tree [-new tree] [-tolerance T] [-keep] tool [args...]\n" .
+		"       verify.pl -threads n1,n2,... [-new tree] [-keep] tool [args with %t...]\n" .
+		"  tool is a program of code/ or code/makeBlocks/ of each tree\n";
+}
+
+sub tool_path {
+	my ($tree, $tool) = @_;
+	foreach my $p ("$tree/code/$tool", "$tree/code/makeBlocks/$tool") {
+		return $p if (-f $p && -x $p);
+	}
+	die "no $tool in $tree/code or $tree/code/makeBlocks\n";
+}
+
+# the regular files of a directory (not its subdirectories), each with
+# its size and modification time
+sub snapshot {
+	my $dir = shift;
+	my %files;
+	opendir(my $dh, $dir) or die "cannot read $dir\n";
+	foreach my $f (readdir($dh)) {
+		next unless (-f "$dir/$f");
+		my @st = stat("$dir/$f");
+		$files{$f} = "$st[7] $st[9]";
+	}
+	closedir($dh);
+	return %files;
+}
+
+# the line (or for a binary file the byte) where two files first differ
+sub compare_exact {
+	my ($a, $b, $na, $nb) = @_;
+	($na, $nb) = ("legacy", "new") if (!defined($na));
+	return undef if (system("cmp", "-s", $a, $b) == 0);
+	my ($la, $lb) = (read_lines($a), read_lines($b));
+	for (my $i = 0; $i < @$la || $i < @$lb; $i++) {
+		my ($x, $y) = ($la->[$i], $lb->[$i]);
+		next if (defined($x) && defined($y) && $x eq $y);
+		return "line " . ($i + 1) . " (has no text)" if (binary_line($x) || binary_line($y));
+		return sprintf("line %d: %s \"%s\", %s \"%s\"", $i + 1, $na, show($x), $nb, show($y));
+	}
+	return "byte layout";
+}
+
+# the adjacencies of two .prob files, the same pairs in the same order
+# with probabilities within the tolerance
+sub compare_prob {
+	my ($a, $b) = @_;
+	my ($ra, $rb) = (read_prob($a), read_prob($b));
+	for (my $i = 0; $i < @$ra || $i < @$rb; $i++) {
+		my ($x, $y) = ($ra->[$i], $rb->[$i]);
+		return sprintf("adjacency %d: legacy %s, new %s", $i + 1, show_prob($x), show_prob($y))
+			if (!defined($x) || !defined($y) || $x->[0] != $y->[0] || $x->[1] != $y->[1]
+				|| abs($x->[2] - $y->[2]) > $tolerance * (1 + abs($x->[2])));
+	}
+	return undef;
+}
+
+# the adjacencies of a .prob file, text "b1 b2 prob" lines or the binary
+# form of inferAdjProb -binary
+sub read_prob {
+	my $f = shift;
+	my @rec;
+	open(my $fh, "<:raw", $f) or die "cannot read $f\n";
+	local $/;
+	my $data = <$fh>;
+	close($fh);
+	if (substr($data, 0, 8) eq "ADJPROB\0") {
+		for (my $off = 16; $off + 16 <= length($data); $off += 16) {
+			push(@rec, [unpack("l l d", substr($data, $off, 16))]);
+		}
+	} else {
+		foreach my $line (split(/\n/, $data)) {
+			my @t = split(/\s+/, $line);
+			push(@rec, [@t[0..2]]) if (@t >= 3);
+		}
+	}
+	return \@rec;
+}
+
+sub read_lines {
+	my $f = shift;
+	open(my $fh, "<:raw", $f) or die "cannot read $f\n";
+	my @lines = <$fh>;
+	close($fh);
+	chomp(@lines);
+	return \@lines;
+}
+
+sub binary_line {
+	my $s = shift;
+	return defined($s) && $s =~ /[\x00-\x08\x0e-\x1f]/;
+}
+
+sub show {
+	my $s = shift;
+	return defined($s) ? $s : "(end of file)";
+}
+
+sub show_prob {
+	my $r = shift;
+	return defined($r) ? "$r->[0] $r->[1] $r->[2]" : "(end of file)";
+}
@@ -0,0 +1,68 @@
+/* **************************************************************
+ * libadjprob: the likelihood engine of inferAdjProb as a library, for a
+ * long-lived process that sweeps alphas, ancestors or jackknife runs
+ * over data it loaded once. A handle holds a tree and the genomes of its
+ * leaves, from memory or from the files inferAdjProb reads; each
+ * adjprob_compute() evaluates the posteriors at one alpha, which the
+ * results of the handle then hold until the next.
+ *
+ *   struct adjprob_input in = {"hg19", tree_text, genomes_text};
+ *   struct adjprob *ap = adjprob_open(&in);
+ *   adjprob_compute(ap, 1.0);
+ *   n = adjprob_posteriors(ap, 0, &adjs);
+ *   ...
+ *   free(adjs);
+ *   adjprob_close(ap);
+ *
+ * The outgroup leaves are read from <leaf>.joins in joins_dir. Calls may
+ * come from any thread, but run one at a time, each on the threads of
+ * its handle; errors end the process through the errAbort() of the kent
+ * library, which the caller links (jkweb.a, -lm -lpthread).
+ * **************************************************************/
+
+#ifndef _ADJPROB_H_
+#define _ADJPROB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct adjprob;
+
+struct adjprob_input {
+	const char *ref_spc;	// the species whose blocks are counted
+	const char *tree;	// newick text; '@' marks the ancestor
+	const char *genomes;	// the text of a Genomes.Order, or NULL
+	const char *genome_file;	// else a Genomes.Order or Genomes.db
+	const char *ancestors;	// as -ancestors, or NULL for the '@' one
+	const char *joins_dir;	// of the .joins files, NULL for the working directory
+	int jackknife;		// also the posteriors without each leaf
+	int threads;		// 0 for as many as inferAdjProb takes
+};
+
+// one candidate adjacency, as a line of adjacencies.prob
+struct adjprob_adj {
+	int b1, b2;
+	double prob;
+};
+
+struct adjprob *adjprob_open(const struct adjprob_input *in);
+void adjprob_compute(struct adjprob *ap, double alpha);
+
+/* the results of the last adjprob_compute(): the '@' ancestor and then,
+ * with jackknife, the tree without each leaf; or each of the ancestors.
+ * A name is that of the adjacencies.<name>.prob file inferAdjProb writes,
+ * NULL for the '@' ancestor, valid until the next call */
+int adjprob_results(struct adjprob *ap);
+const char *adjprob_result_name(struct adjprob *ap, int r);
+
+// the posteriors of result r, in an array the caller frees
+int adjprob_posteriors(struct adjprob *ap, int r, struct adjprob_adj **adjs);
+
+void adjprob_close(struct adjprob *ap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
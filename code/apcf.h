@@ -0,0 +1,1085 @@
+// apcf.h - the greedy APCF assembler behind deschrambler, header-only.
+//
+// Scores for adjacencies between signed blocks (block 0 is the telomere)
+// go in through Assembler::add(); assemble() then builds the APCFs for one
+// or more minimum weights, and forEachApcf() hands each APCF back as a list
+// of edges, in the order deschrambler writes them. Id is the block id type
+// and Score the score type.
+//
+//	apcf::Assembler<> a;
+//	a.add(1, 2, 0.9); a.add(-2, 3, 0.7);
+//	a.assemble(std::vector<double>(1, 0.0));
+//	a.forEachApcf(0, [](const std::list<apcf::Assembler<>::Edge>& le) { ... });
+//
+// With saveState() and loadState() a run keeps the APCFs of each connected
+// component under a digest of its edges and their weights, in order; the
+// next assemble() carries over those of every component whose edges came
+// out the same, and only assembles the components that changed.
+//
+// StreamAssembler makes the same APCFs from scores that come sorted by
+// weight, heaviest first, without keeping them.
+
+#ifndef APCF_H
+#define APCF_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <list>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "makeBlocks/trace.h"
+
+namespace apcf {
+
+enum {SUCCESS, FAIL, CYCLE};
+
+template <class Id = int, class Score = double>
+class Edge {
+public:
+	Id bid1, bid2;
+	int dir1, dir2;
+	Score score1, score2, weight;
+
+	Edge(Id _bid1, int _dir1, Id _bid2, int _dir2)
+			:bid1(_bid1), bid2(_bid2), dir1(_dir1), dir2(_dir2),
+			score1(0), score2(0), weight(0) {}
+
+	bool operator<(const Edge& p) const {
+		if (bid1 == p.bid1 && dir1 == p.dir1 && bid2 == p.bid2) return dir2 < p.dir2;
+		if (bid1 == p.bid1 && dir1 == p.dir1) return bid2 < p.bid2;
+		if (bid1 == p.bid1) return dir1 < p.dir1;
+		return bid1 < p.bid1;
+	}
+
+	void reverse() {
+		Id tmp = bid1;
+		bid1 = bid2;
+		bid2 = tmp;
+
+		int dtmp = dir1;
+		dir1 = dir2;
+		dir2 = dtmp;
+		if (dir1 == 1) dir1 = -1;
+		else dir1 = 1;
+		if (dir2 == 1) dir2 = -1;
+		else dir2 = 1;
+	}
+
+	std::string toString(std::map<Id, std::string>& map2name) {
+		std::string bname1 = map2name[bid1];
+		std::string bname2 = map2name[bid2];
+		std::string strdir1 = "+";
+		if (dir1 == -1) { strdir1 = "-"; }
+		std::string strdir2 = "+";
+		if (dir2 == -1) { strdir2 = "-"; }
+		std::stringstream ss;
+		ss << bname1 << " " << strdir1 << "\t" << bname2 << " " << strdir2 << "\t";
+		ss << std::fixed << std::setprecision(6) << weight << "\t" << score1 << "\t" << score2;
+		return ss.str();
+	}
+};
+
+// an APCF: its edges plus an orientation flag. A flipped chain reads its
+// edges back to front, each one reversed, so a chain can be turned around
+// in O(1) and two chains are joined with a splice
+template <class E>
+class Chain {
+public:
+	std::list<E> edges;
+	bool flipped;
+
+	Chain() : flipped(false) {}
+	Chain(const E& e) : edges(1, e), flipped(false) {}
+
+	static E reversed(E e) { e.reverse(); return e; }
+
+	E front() const { return flipped ? reversed(edges.back()) : edges.front(); }
+	E back() const { return flipped ? reversed(edges.front()) : edges.back(); }
+	size_t size() const { return edges.size(); }
+
+	void push_front(const E& e) {
+		if (flipped) edges.push_back(reversed(e));
+		else edges.push_front(e);
+	}
+	void push_back(const E& e) {
+		if (flipped) edges.push_front(reversed(e));
+		else edges.push_back(e);
+	}
+
+	void flip() { flipped = !flipped; }
+
+	// rewrites the stored edges so that the flag becomes f; the chain
+	// itself reads the same afterwards
+	void orient(bool f) {
+		if (flipped == f) return;
+		edges.reverse();
+		for (typename std::list<E>::iterator it = edges.begin(); it != edges.end(); it++) it->reverse();
+		flipped = f;
+	}
+
+	// moves all of o in front of (or behind) this chain; if the two are
+	// stored in opposite orientations the shorter one is rewritten first
+	void join(Chain& o, bool atBack) {
+		if (o.flipped != flipped) {
+			if (o.size() <= size()) o.orient(flipped);
+			else orient(o.flipped);
+		}
+		if (atBack != flipped) edges.splice(edges.end(), o.edges);
+		else edges.splice(edges.begin(), o.edges);
+	}
+};
+
+// marks on signed block ids -numblocks..numblocks, standing for the block
+// ends that are already joined to something
+template <class Id>
+class UsedEnds {
+public:
+	std::vector<char> used;
+	Id off;
+
+	UsedEnds(Id numblocks) : used(2*(size_t)numblocks+1, 0), off(numblocks) {}
+
+	char& operator[](Id sbid) { return used[sbid + off]; }
+
+	// makes room for the blocks up to numblocks, keeping the marks
+	void grow(Id numblocks) {
+		if (numblocks <= off) return;
+		std::vector<char> g(2*(size_t)numblocks+1, 0);
+		std::copy(used.begin(), used.end(), g.begin() + (numblocks - off));
+		used.swap(g);
+		off = numblocks;
+	}
+};
+
+// class ids of the chains whose first edge starts, or whose last edge ends,
+// with a given signed block; the greedy loop only has to try these chains
+template <class Id>
+class EndIndex {
+public:
+	std::vector<std::set<size_t> > front, back;
+
+	EndIndex(Id numblocks) : front(2*((size_t)numblocks+1)), back(2*((size_t)numblocks+1)) {}
+
+	void grow(Id numblocks) {
+		if (2*((size_t)numblocks+1) <= front.size()) return;
+		front.resize(2*((size_t)numblocks+1));
+		back.resize(2*((size_t)numblocks+1));
+	}
+
+	static size_t key(Id bid, int dir) { return 2*(size_t)bid + (dir == 1 ? 1 : 0); }
+
+	template <class C>
+	void add(size_t id, const C& le) {
+		front[key(le.front().bid1, le.front().dir1)].insert(id);
+		back[key(le.back().bid2, le.back().dir2)].insert(id);
+	}
+
+	template <class C>
+	void remove(size_t id, const C& le) {
+		front[key(le.front().bid1, le.front().dir1)].erase(id);
+		back[key(le.back().bid2, le.back().dir2)].erase(id);
+	}
+};
+
+// smallest id above cur in any of the sets, skipping skip; 0 if none
+inline size_t nextCandidate(std::set<size_t>* sets[], int nsets, size_t cur, size_t skip)
+{
+	size_t best = 0;
+	for (int i = 0; i < nsets; i++) {
+		std::set<size_t>::iterator it = sets[i]->upper_bound(cur);
+		if (it != sets[i]->end() && *it == skip) it++;
+		if (it != sets[i]->end() && (best == 0 || *it < best)) best = *it;
+	}
+	return best;
+}
+
+template <class E, class Id>
+int insertEdge(Chain<E>& le, E& e, UsedEnds<Id>& mapUsed)
+{
+	E fe = le.front();
+	E be = le.back();
+
+	if (fe.bid1 == e.bid1 && fe.dir1 != e.dir1) {
+		// check for a cycle
+		if (be.bid2 == e.bid2 && be.dir2 != e.dir2) {
+			return CYCLE;
+		}
+
+		// e precedes fe with an opposite direction
+		e.reverse();
+		le.push_front(e);
+		mapUsed[fe.bid1] = 1;
+		mapUsed[-fe.bid1] = 1;
+		if (e.dir1 == 1) mapUsed[-e.bid1] = 1;
+		else mapUsed[e.bid1] = 1;
+		return SUCCESS;
+	}
+	if (fe.bid1 == e.bid2 && fe.dir1 == e.dir2) {
+		if (fe.bid1 == 0) return FAIL;
+
+		// check for a cycle
+		if (be.bid2 == e.bid1 && be.dir2 == e.dir1) return CYCLE;
+
+		// e precedes fe with the same direction
+		le.push_front(e);
+		mapUsed[fe.bid1] = 1;
+		mapUsed[-fe.bid1] = 1;
+		if (e.dir1 == 1) mapUsed[-e.bid1] = 1;
+		else mapUsed[e.bid1] = 1;
+		return SUCCESS;
+	}
+
+	if (be.bid2 == e.bid1 && be.dir2 == e.dir1) {
+		if (be.bid2 == 0) return FAIL;
+
+		// check for a cycle
+		if (fe.bid1 == e.bid2 && fe.dir1 == e.dir2) return CYCLE;
+
+		// be precedes e with the same direction
+		le.push_back(e);
+		mapUsed[be.bid2] = 1;
+		mapUsed[-be.bid2] = 1;
+		if (e.dir2 == 1) mapUsed[e.bid2] = 1;
+		else mapUsed[-e.bid2] = 1;
+		return SUCCESS;
+	}
+	if (be.bid2 == e.bid2 && be.dir2 != e.dir2) {
+		// check for a cycle
+		if (fe.bid1 == e.bid1 && fe.dir1 != e.dir1) return CYCLE;
+
+		// be precedes e with an opposite direction
+		e.reverse();
+		le.push_back(e);
+		mapUsed[be.bid2] = 1;
+		mapUsed[-be.bid2] = 1;
+		if (e.dir2 == 1) mapUsed[e.bid2] = 1;
+		else mapUsed[-e.bid2] = 1;
+		return SUCCESS;
+	}
+	return FAIL;
+}
+
+// classes are visited in increasing id, as a scan over 1..clscnt would, but
+// only those with an end that matches one of le's ends
+template <class E, class Id>
+void mergeLists(size_t clsid, Chain<E>& le1, std::map<size_t, Chain<E> > &mapClasses, EndIndex<Id>& idx)
+{
+	typename std::map<size_t, Chain<E> >::iterator citer;
+
+	for (size_t j = 0; ; ) {
+		E e1front = le1.front();
+		E e1back = le1.back();
+		std::set<size_t>* sets[4] = {
+			&idx.front[EndIndex<Id>::key(e1front.bid1, -e1front.dir1)],
+			&idx.back[EndIndex<Id>::key(e1front.bid1, e1front.dir1)],
+			&idx.front[EndIndex<Id>::key(e1back.bid2, e1back.dir2)],
+			&idx.back[EndIndex<Id>::key(e1back.bid2, -e1back.dir2)] };
+		if ((j = nextCandidate(sets, 4, j, clsid)) == 0) break;
+
+		citer = mapClasses.find(j);
+		Chain<E>& le2 = citer->second;
+
+		E e2front = le2.front();
+		E e2back = le2.back();
+
+		// reversed le2 goes in front of, le2 in front of, le2 behind or
+		// reversed le2 behind le1
+		bool flip2, atBack;
+		if(e1front.bid1 == e2front.bid1 && e1front.dir1 != e2front.dir1) {
+			// check cycle
+			if (!(e1back.bid2 == 0 || e2back.bid2 == 0 || e1back.bid2 != e2back.bid2)) continue;
+			flip2 = true; atBack = false;
+		} else if(e1front.bid1 == e2back.bid2 && e1front.dir1 == e2back.dir2) {
+			// check cycle
+			if (!(e1front.bid1 != 0 &&
+				(e1back.bid2 == 0 || e2front.bid1 == 0 || e1back.bid2 != e2front.bid1))) continue;
+			flip2 = false; atBack = false;
+		} else if(e1back.bid2 == e2front.bid1 && e1back.dir2 == e2front.dir1) {
+			// check cycle
+			if (!(e1back.bid2 != 0 &&
+				(e1front.bid1 == 0 || e2back.bid2 == 0 || e1front.bid1 != e2back.bid2))) continue;
+			flip2 = false; atBack = true;
+		} else if(e1back.bid2 == e2back.bid2 && e1back.dir2 != e2back.dir2) {
+			// check cycle
+			if (!(e1front.bid1 == 0 || e2front.bid1 == 0 || e1front.bid1 != e2front.bid1)) continue;
+			flip2 = true; atBack = true;
+		} else continue;
+
+		idx.remove(clsid, le1);
+		idx.remove(j, le2);
+		if (flip2) le2.flip();
+		le1.join(le2, atBack);
+		idx.add(clsid, le1);
+		COUNT(list_merges, 1);
+		mapClasses.erase(j);
+	} // end of for j
+}
+
+// the chains of a greedy pass and the tables it keeps about their ends;
+// take() offers it the edges one at a time, heaviest first, each with its
+// rank in the pass, which becomes the id of a chain it starts
+template <class E, class Id>
+class Greedy {
+public:
+	UsedEnds<Id> mapUsed;
+	std::map<size_t, Chain<E> > mapClasses;
+	EndIndex<Id> idx;
+
+	Greedy(Id numblocks) : mapUsed(numblocks), idx(numblocks) {}
+
+	// makes room for the blocks up to numblocks
+	void grow(Id numblocks) {
+		mapUsed.grow(numblocks);
+		idx.grow(numblocks);
+	}
+
+	void take(size_t id, E e) {
+		typename std::map<size_t, Chain<E> >::iterator citer;
+
+		if (e.bid1 != 0) {
+			if (e.dir1 == 1 ? mapUsed[-e.bid1] : mapUsed[e.bid1]) { COUNT(edges_used, 1); return; }
+		}
+
+		if (e.bid2 != 0) {
+			if (e.dir2 == 1 ? mapUsed[e.bid2] : mapUsed[-e.bid2]) { COUNT(edges_used, 1); return; }
+		}
+
+		// only a chain with an end on one of e's blocks can take e;
+		// try them in class order, as a scan over all classes would
+		std::set<size_t>* sets[4] = {
+			&idx.front[EndIndex<Id>::key(e.bid1, -e.dir1)],
+			&idx.front[EndIndex<Id>::key(e.bid2, e.dir2)],
+			&idx.back[EndIndex<Id>::key(e.bid1, e.dir1)],
+			&idx.back[EndIndex<Id>::key(e.bid2, -e.dir2)] };
+		for (size_t c = 0; (c = nextCandidate(sets, 4, c, 0)) != 0; ) {
+			citer = mapClasses.find(c);
+			Chain<E>& le = citer->second;
+			idx.remove(c, le);
+			int res = insertEdge(le, e, mapUsed);
+			idx.add(c, le);
+			COUNT(edges_tried, 1);
+			TRACE_POINT2(insert_edge, e.bid1, res);
+			if (res == CYCLE) COUNT(edges_cycle, 1);
+			if (res == SUCCESS || res == CYCLE) {
+				if (res == SUCCESS) mergeLists(c, le, mapClasses, idx);
+				return;
+			}
+		}
+
+		COUNT(edges_new, 1);
+		mapClasses[id] = Chain<E>(e);
+		idx.add(id, mapClasses[id]);
+
+		if (e.bid1 != 0) {
+			if (e.dir1 == 1) mapUsed[-e.bid1] = 1;
+			else mapUsed[e.bid1] = 1;
+		}
+		if (e.bid2 != 0) {
+			if (e.dir2 == 1) mapUsed[e.bid2] = 1;
+			else mapUsed[-e.bid2] = 1;
+		}
+	}
+};
+
+// a sort record for an edge: its weight as bits that order as unsigned
+// integers the opposite way the weights do (heaviest first), and its
+// index in a table of edges sorted by their signed ends, which breaks ties
+struct EdgeKey {
+	uint64_t w;
+	uint64_t id;
+};
+
+inline uint64_t weightKey(double d)
+{
+	uint64_t u;
+	if (d == 0) d = 0;	// -0 and 0 are one weight
+	std::memcpy(&u, &d, sizeof(u));
+	u = (u >> 63) ? ~u : (u | ((uint64_t)1 << 63));
+	return ~u;
+}
+
+// stable LSD radix sort of keys on w, a byte per pass, on up to nthreads
+// threads; a byte that is the same in every key costs no pass. Each
+// thread counts the bytes of its own slice, and then moves that slice to
+// the places the counts of the slices before it leave free
+inline void radixSortKeys(std::vector<EdgeKey>& keys, int nthreads)
+{
+	size_t n = keys.size();
+	if (n < 2) return;
+	if (nthreads < 1 || n < 65536) nthreads = 1;
+	std::vector<EdgeKey> tmp(n);
+	std::vector<size_t> count((size_t)nthreads * 256);
+	EdgeKey *from = &keys[0], *to = &tmp[0];
+
+	uint64_t same = ~(uint64_t)0;
+	for (size_t i = 1; i < n; i++) same &= ~(keys[i].w ^ keys[0].w);
+	for (int shift = 0; shift < 64; shift += 8) {
+		if (((same >> shift) & 0xff) == 0xff) continue;
+		std::fill(count.begin(), count.end(), 0);
+		auto slice = [&](int t, bool scatter) {
+			size_t lo = n * t / nthreads, hi = n * (t+1) / nthreads;
+			size_t* c = &count[(size_t)t * 256];
+			for (size_t i = lo; i < hi; i++) {
+				int b = (from[i].w >> shift) & 0xff;
+				if (scatter) to[c[b]++] = from[i];
+				else c[b]++;
+			}
+		};
+		for (int pass = 0; pass < 2; pass++) {
+			if (pass == 1) {
+				size_t sum = 0;
+				for (int b = 0; b < 256; b++)
+					for (int t = 0; t < nthreads; t++) {
+						size_t c = count[(size_t)t * 256 + b];
+						count[(size_t)t * 256 + b] = sum;
+						sum += c;
+					}
+			}
+			std::vector<std::thread> pool;
+			for (int t = 1; t < nthreads; t++) pool.push_back(std::thread(slice, t, pass == 1));
+			slice(0, pass == 1);
+			for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+		}
+		std::swap(from, to);
+	}
+	if (from != &keys[0]) keys.swap(tmp);
+}
+
+// the digest of a component's edges (two 64-bit FNV-1a hashes of the
+// same bytes, from different seeds)
+struct Digest {
+	uint64_t a, b;
+
+	Digest() : a(14695981039346656037ULL), b(0x6a09e667f3bcc908ULL) {}
+
+	void add(const void* p, size_t n) {
+		const unsigned char* c = (const unsigned char*)p;
+		for (; n > 0; n--, c++) {
+			a = (a ^ *c) * 1099511628211ULL;
+			b = (b ^ *c) * 0x100000001b3ULL + (b >> 29);
+		}
+	}
+	bool operator<(const Digest& d) const { return a != d.a ? a < d.a : b < d.b; }
+};
+
+const char STATE_MAGIC[8] = "DSCHAS1";
+
+template <class Id = int, class Score = double>
+class Assembler {
+public:
+	typedef apcf::Edge<Id, Score> Edge;
+	typedef apcf::Chain<Edge> Chain;
+	typedef std::pair<Edge, Score> Scored;
+
+	Assembler() : numblocks(0), ncomps(0), nreused(0), saving(false) {}
+
+	// the score of the adjacency sbid1 -> sbid2 between signed blocks; a
+	// pair given twice keeps its last score
+	void add(Id sbid1, Id sbid2, Score adjscore) {
+		Id bindex1 = std::abs(sbid1);
+		Id bindex2 = std::abs(sbid2);
+		int intdir1 = 1;
+		if (sbid1 < 0) intdir1 = -1;
+		int intdir2 = 1;
+		if (sbid2 < 0) intdir2 = -1;
+		Edge bpf(bindex1, intdir1, bindex2, intdir2);
+		Edge bpr(bindex2, -intdir2, bindex1, -intdir1);
+		vecScores.push_back(std::make_pair(bpf, adjscore));
+		vecScores.push_back(std::make_pair(bpr, adjscore));
+
+		if (bindex1 > numblocks) numblocks = bindex1;
+		if (bindex2 > numblocks) numblocks = bindex2;
+	}
+
+	// the same for a range of records with bid1, bid2 and score members
+	template <class It>
+	void add(It begin, It end) {
+		for (; begin != end; ++begin) add(begin->bid1, begin->bid2, begin->score);
+	}
+
+	Id numBlocks() const { return numblocks; }
+	size_t numComponents() const { return ncomps; }
+	// the components of the last assemble() carried over from the loaded state
+	size_t numReused() const { return nreused; }
+
+	// the APCFs of a previous run, for assemble() to carry over; false if
+	// the file cannot be read as a state
+	bool loadState(const char* file) {
+		std::ifstream in(file, std::ios::in | std::ios::binary);
+		char magic[8];
+		uint64_t n, nk, nchain, m, nedge;
+		if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, STATE_MAGIC, sizeof(magic)) != 0
+				|| !readOne(in, nk)) return false;
+		prevThresholds.assign(nk, 0);
+		for (uint64_t k = 0; k < nk; k++) if (!readOne(in, prevThresholds[k])) return false;
+		if (!readOne(in, n)) return false;
+		for (uint64_t c = 0; c < n; c++) {
+			Saved sv;
+			if (!readOne(in, sv.digest.a) || !readOne(in, sv.digest.b)) return false;
+			sv.snapshots.assign(nk, std::vector<std::pair<size_t, Chain> >());
+			for (uint64_t k = 0; k < nk; k++) {
+				if (!readOne(in, nchain)) return false;
+				for (uint64_t j = 0; j < nchain; j++) {
+					if (!readOne(in, m) || !readOne(in, nedge)) return false;
+					sv.snapshots[k].push_back(std::make_pair((size_t)m, Chain()));
+					for (uint64_t x = 0; x < nedge; x++) {
+						StateEdge r;
+						if (!readOne(in, r)) return false;
+						Edge e(r.bid1, r.dir1, r.bid2, r.dir2);
+						e.weight = r.weight;
+						e.score1 = r.score1;
+						e.score2 = r.score2;
+						sv.snapshots[k].back().second.edges.push_back(e);
+					}
+				}
+			}
+			prevIndex[sv.digest] = prev.size();
+			prev.push_back(sv);
+		}
+		return true;
+	}
+
+	// makes the next assemble() keep what saveState() writes
+	void keepState() { saving = true; }
+
+	// the APCFs of the last assemble() by component; false if the file
+	// cannot be written
+	bool saveState(const char* file) const {
+		std::ofstream out(file, std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write(STATE_MAGIC, sizeof(STATE_MAGIC));
+		writeOne(out, (uint64_t)lastThresholds.size());
+		for (size_t k = 0; k < lastThresholds.size(); k++) writeOne(out, (double)lastThresholds[k]);
+		writeOne(out, (uint64_t)state.size());
+		for (size_t c = 0; c < state.size(); c++) {
+			writeOne(out, state[c].digest.a);
+			writeOne(out, state[c].digest.b);
+			for (size_t k = 0; k < lastThresholds.size(); k++) {
+				const std::vector<std::pair<size_t, Chain> >& snap = state[c].snapshots[k];
+				writeOne(out, (uint64_t)snap.size());
+				for (size_t j = 0; j < snap.size(); j++) {
+					writeOne(out, (uint64_t)snap[j].first);
+					writeOne(out, (uint64_t)snap[j].second.edges.size());
+					typename std::list<Edge>::const_iterator it;
+					for (it = snap[j].second.edges.begin(); it != snap[j].second.edges.end(); it++) {
+						StateEdge r = { (int64_t)it->bid1, (int64_t)it->bid2, it->dir1, it->dir2,
+							(double)it->weight, (double)it->score1, (double)it->score2 };
+						writeOne(out, r);
+					}
+				}
+			}
+		}
+		out.close();
+		return !out.fail();
+	}
+
+	// builds the APCFs for every minimum weight in minWeights, using up to
+	// nthreads threads; the scores added so far are used up
+	void assemble(const std::vector<Score>& minWeights, int nthreads = 1) {
+		std::vector<Scored> vecEdges;
+		prepareEdges(vecEdges, nthreads);
+
+		// the greedy pass stops taking edges once their weight drops below
+		// the threshold; taking the thresholds from the highest down, each
+		// set is a snapshot of the one pass just before the first lighter
+		// edge
+		std::vector<size_t> korder(minWeights.size());
+		for (size_t k = 0; k < korder.size(); k++) korder[k] = k;
+		std::stable_sort(korder.begin(), korder.end(),
+			[&](size_t k1, size_t k2) { return minWeights[k1] > minWeights[k2]; });
+		std::vector<Score> thresholds;
+		for (size_t k = 0; k < korder.size(); k++) thresholds.push_back(minWeights[korder[k]]);
+		Score minw = thresholds.empty() ? 0 : thresholds.back();
+
+		// edges never touch a chain outside their connected component, so
+		// the components are assembled independently, and in parallel
+		std::vector<std::vector<size_t> > comps;
+		bool oddTelomere = findComponents(vecEdges, minw, comps);
+		ncomps = comps.size();
+		std::vector<Assembly> work(comps.size(), Assembly(vecEdges, thresholds));
+		for (size_t c = 0; c < comps.size(); c++) {
+			work[c].edges.swap(comps[c]);
+			work[c].plain = !oddTelomere;
+		}
+		reuseState(work, vecEdges, thresholds);
+		runAssemblies(work, nthreads);
+		if (saving) {
+			// a chain is kept by the rank in its component of the edge that
+			// started it, as the ids of the edges change from run to run
+			state.assign(work.size(), Saved());
+			for (size_t c = 0; c < work.size(); c++) {
+				state[c].digest = work[c].digest;
+				state[c].snapshots = work[c].snapshots;
+				for (size_t k = 0; k < thresholds.size(); k++)
+					for (size_t j = 0; j < state[c].snapshots[k].size(); j++) {
+						size_t& id = state[c].snapshots[k][j].first;
+						id = std::lower_bound(work[c].edges.begin(), work[c].edges.end(), id - 1)
+							- work[c].edges.begin();
+					}
+			}
+			lastThresholds = thresholds;
+		}
+
+		results.assign(minWeights.size(), std::map<size_t, Chain>());
+		for (size_t k = 0; k < thresholds.size(); k++) {
+			std::map<size_t, Chain>& mapClasses = results[korder[k]];
+			for (size_t c = 0; c < work.size(); c++) {
+				std::vector<std::pair<size_t, Chain> >& snap = work[c].snapshots[k];
+				for (size_t m = 0; m < snap.size(); m++) mapClasses[snap[m].first].edges.swap(snap[m].second.edges);
+			}
+		}
+	}
+
+	// calls f(const std::list<Edge>&) on each APCF built for minWeights[k],
+	// in output order
+	template <class F>
+	void forEachApcf(size_t k, F f) const {
+		typename std::map<size_t, Chain>::const_iterator citer;
+		for (citer = results[k].begin(); citer != results[k].end(); citer++) f(citer->second.edges);
+	}
+
+private:
+	std::vector<Scored> vecScores;
+	Id numblocks;
+	size_t ncomps, nreused;
+	std::vector<std::map<size_t, Chain> > results;
+
+	// the APCFs of a component for each threshold, each by the rank of
+	// the edge that started it
+	struct Saved {
+		Digest digest;
+		std::vector<std::vector<std::pair<size_t, Chain> > > snapshots;
+	};
+	struct StateEdge {
+		int64_t bid1, bid2;
+		int32_t dir1, dir2;
+		double weight, score1, score2;
+	};
+	std::vector<Saved> prev, state;
+	std::map<Digest, size_t> prevIndex;
+	std::vector<Score> prevThresholds, lastThresholds;
+	bool saving;
+
+	template <class T>
+	static bool readOne(std::ifstream& in, T& x) { return (bool)in.read((char*)&x, sizeof(x)); }
+	template <class T>
+	static void writeOne(std::ofstream& out, const T& x) { out.write((const char*)&x, sizeof(x)); }
+
+	// edge weights are the scores themselves: keep every scored edge that
+	// joins two different blocks, heaviest first and, for one weight, in
+	// the order of their signed ends. An edge listed more than once keeps
+	// its last score
+	void prepareEdges(std::vector<Scored>& vecEdges, int nthreads) {
+		std::stable_sort(vecScores.begin(), vecScores.end(),
+			[](const Scored& p1, const Scored& p2) { return p1.first < p2.first; });
+		vecEdges.reserve(vecScores.size());
+		for (size_t k = 0; k < vecScores.size(); k++) {
+			if (k+1 < vecScores.size() && !(vecScores[k].first < vecScores[k+1].first)) continue;
+			const Edge& e = vecScores[k].first;
+			if (e.bid1 == e.bid2 || vecScores[k].second <= 0) continue;
+			vecEdges.push_back(vecScores[k]);
+		}
+		std::vector<Scored>().swap(vecScores);
+
+		// greedy search based on edge weights; the sort moves 16-byte
+		// keys, and the edges once at the end
+		std::vector<EdgeKey> keys(vecEdges.size());
+		for (size_t k = 0; k < keys.size(); k++) {
+			keys[k].w = weightKey((double)vecEdges[k].second);
+			keys[k].id = k;
+		}
+		radixSortKeys(keys, nthreads);
+		std::vector<Scored> sorted;
+		sorted.reserve(vecEdges.size());
+		for (size_t k = 0; k < keys.size(); k++) sorted.push_back(vecEdges[keys[k].id]);
+		vecEdges.swap(sorted);
+	}
+
+	// the greedy assembly of one connected component. Its blocks are
+	// renumbered 1..n so the per-block tables stay small, and each chain
+	// keeps as its id the (global) index of the edge that started it, so
+	// chains sort in the order a single pass over all edges would have
+	// created them
+	class Assembly {
+	public:
+		const std::vector<Scored>* all;
+		const std::vector<Score>* thresholds;
+		std::vector<size_t> edges;	// indices into *all, heaviest first
+		std::vector<std::vector<std::pair<size_t, Chain> > > snapshots;	// per threshold
+		Digest digest;		// of the edges and their weights
+		bool reused;		// the snapshots come from a loaded state
+		bool plain;			// the telomere has its usual orientations
+
+		Assembly(const std::vector<Scored>& _all, const std::vector<Score>& _thresholds)
+			: all(&_all), thresholds(&_thresholds), reused(false), plain(true) {}
+
+		void snapshot(size_t k, std::map<size_t, Chain>& mapClasses, std::vector<Id>& loc2glob) {
+			typename std::map<size_t, Chain>::iterator citer;
+			for (citer = mapClasses.begin(); citer != mapClasses.end(); citer++) {
+				snapshots[k].push_back(std::make_pair(citer->first, citer->second));
+				Chain& c = snapshots[k].back().second;
+				c.orient(false);
+				typename std::list<Edge>::iterator liter;
+				for (liter = c.edges.begin(); liter != c.edges.end(); liter++) {
+					liter->bid1 = loc2glob[liter->bid1];
+					liter->bid2 = loc2glob[liter->bid2];
+				}
+			}
+		}
+
+		void run(std::vector<Id>& glob2loc) {
+			std::vector<Id> loc2glob(1, 0);
+			for (size_t m = 0; m < edges.size(); m++) {
+				const Edge& e = (*all)[edges[m]].first;
+				Id bids[2] = { e.bid1, e.bid2 };
+				for (int b = 0; b < 2; b++) {
+					if (bids[b] == 0 || glob2loc[bids[b]] != 0) continue;
+					glob2loc[bids[b]] = loc2glob.size();
+					loc2glob.push_back(bids[b]);
+				}
+			}
+			Id numblocks = loc2glob.size() - 1;
+
+			snapshots.assign(thresholds->size(), std::vector<std::pair<size_t, Chain> >());
+			if (plain && runForced(glob2loc, loc2glob.size())) {
+				COUNT(forced_components, 1);
+				COUNT(forced_edges, edges.size());
+				return;
+			}
+			Greedy<Edge, Id> g(numblocks);
+			size_t next = 0;
+			for (size_t m = 0; m < edges.size(); m++) {
+				size_t i = edges[m];
+				Scored p = (*all)[i];
+				Edge& e = p.first;
+				e.weight = p.second;
+
+				e.score1 = e.weight;
+
+				for (; next < thresholds->size() && e.weight < (*thresholds)[next]; next++)
+					snapshot(next, g.mapClasses, loc2glob);
+				if (next == thresholds->size()) break;
+
+				e.bid1 = glob2loc[e.bid1];
+				e.bid2 = glob2loc[e.bid2];
+				g.take(i+1, e);
+			}
+			for (; next < thresholds->size(); next++) snapshot(next, g.mapClasses, loc2glob);
+		}
+
+		/* a component in which every block end has one partner end at
+		 * most, as most have: no two of its adjacencies compete for an end,
+		 * so the greedy pass takes them all but the last one to close a
+		 * circle, and the chains by each threshold are the paths of the
+		 * adjacencies taken by then. Those are laid out here in one walk,
+		 * without the tables of the pass, as the pass leaves them: a chain
+		 * has the id of its heaviest edge and reads that edge as it comes.
+		 * false, and nothing done, for any other component */
+		bool runForced(const std::vector<Id>& glob2loc, size_t nb) {
+			const long NONE = -1, TEL = -2;
+			// the end joined to each end of a block (2*local id, +1 for its
+			// right end), and the rank in edges of the first copy of that
+			// adjacency; the greedy pass takes the first, drops the other
+			std::vector<long> other(2*nb, NONE);
+			std::vector<size_t> at(2*nb);
+			std::vector<size_t> firsts;
+			for (size_t m = 0; m < edges.size(); m++) {
+				const Edge& e = (*all)[edges[m]].first;
+				long x = endOf(e.bid1, e.dir1 == 1, glob2loc), y = endOf(e.bid2, e.dir2 != 1, glob2loc);
+				bool seen = false;
+				if (x != TEL) {
+					if (other[x] != NONE && other[x] != y) return false;
+					seen = other[x] == y;
+				}
+				if (y != TEL) {
+					if (other[y] != NONE && other[y] != x) return false;
+					seen = seen || other[y] == x;
+				}
+				if (seen) continue;
+				if (x != TEL) { other[x] = y; at[x] = m; }
+				if (y != TEL) { other[y] = x; at[y] = m; }
+				firsts.push_back(m);
+			}
+
+			std::vector<char> placed(edges.size()), dropped(edges.size());
+			for (size_t k = 0, cut = 0; k < thresholds->size(); k++) {
+				for (; cut < edges.size() && !((*all)[edges[cut]].second < (*thresholds)[k]); cut++)
+					;
+				std::fill(placed.begin(), placed.end(), 0);
+				// the partner of end x by the snapshot, NONE if there is none yet
+				auto joined = [&](long x) -> long {
+					return (other[x] == NONE || at[x] >= cut || dropped[at[x]]) ? NONE : other[x];
+				};
+				for (size_t f = 0; f < firsts.size() && firsts[f] < cut; f++) {
+					size_t m0 = firsts[f];
+					if (placed[m0] || dropped[m0]) continue;
+					const Edge& e0 = (*all)[edges[m0]].first;
+					long x0 = endOf(e0.bid1, e0.dir1 == 1, glob2loc), y0 = endOf(e0.bid2, e0.dir2 != 1, glob2loc);
+					// a circle, once its last adjacency is in, loses that one
+					if (x0 != TEL && y0 != TEL) {
+						size_t last = m0;
+						long y = y0;
+						for (long z; (z = joined(y ^ 1)) != NONE && z != TEL; y = z) {
+							last = std::max(last, at[y ^ 1]);
+							if (z == (x0 ^ 1)) { dropped[last] = 1; break; }
+						}
+					}
+					Chain c(weighed(m0));
+					placed[m0] = 1;
+					for (long y = y0, z; y != TEL && (z = joined(y ^ 1)) != NONE; y = z) {
+						size_t m = at[y ^ 1];
+						Edge e = weighed(m);
+						if (endOf(e.bid1, e.dir1 == 1, glob2loc) != (y ^ 1)) e.reverse();
+						c.edges.push_back(e);
+						placed[m] = 1;
+						if (z == TEL) break;
+					}
+					for (long x = x0, z; x != TEL && (z = joined(x ^ 1)) != NONE; x = z) {
+						size_t m = at[x ^ 1];
+						Edge e = weighed(m);
+						if (endOf(e.bid2, e.dir2 != 1, glob2loc) != (x ^ 1)) e.reverse();
+						c.edges.push_front(e);
+						placed[m] = 1;
+						if (z == TEL) break;
+					}
+					snapshots[k].push_back(std::make_pair(edges[m0] + 1, c));
+				}
+			}
+			return true;
+		}
+
+		// end right (or left) of block bid in the tables of runForced()
+		static long endOf(Id bid, bool right, const std::vector<Id>& glob2loc) {
+			return bid == 0 ? -2 : 2*(long)glob2loc[bid] + (right ? 1 : 0);
+		}
+
+		// the edge of rank m with its weight, as the greedy pass takes it
+		Edge weighed(size_t m) const {
+			Edge e = (*all)[edges[m]].first;
+			e.weight = e.score1 = (*all)[edges[m]].second;
+			return e;
+		}
+	};
+
+	/* the digest of each component; one found in the loaded state, for
+	 * the same thresholds, has its APCFs from there under the ids of its
+	 * edges in this run, and is not assembled again */
+	void reuseState(std::vector<Assembly>& work, const std::vector<Scored>& vecEdges,
+			const std::vector<Score>& thresholds) {
+		nreused = 0;
+		if (prev.empty() && !saving) return;
+		for (size_t c = 0; c < work.size(); c++) {
+			Digest& d = work[c].digest;
+			for (size_t m = 0; m < work[c].edges.size(); m++) {
+				const Scored& p = vecEdges[work[c].edges[m]];
+				int64_t f[4] = { (int64_t)p.first.bid1, p.first.dir1, (int64_t)p.first.bid2, p.first.dir2 };
+				double w = (double)p.second;
+				d.add(f, sizeof(f));
+				d.add(&w, sizeof(w));
+			}
+		}
+		if (prev.empty() || prevThresholds.size() != thresholds.size()
+				|| !std::equal(thresholds.begin(), thresholds.end(), prevThresholds.begin()))
+			return;
+		for (size_t c = 0; c < work.size(); c++) {
+			typename std::map<Digest, size_t>::iterator it = prevIndex.find(work[c].digest);
+			if (it == prevIndex.end()) continue;
+			work[c].snapshots = prev[it->second].snapshots;
+			for (size_t k = 0; k < thresholds.size(); k++)
+				for (size_t j = 0; j < work[c].snapshots[k].size(); j++) {
+					size_t& id = work[c].snapshots[k][j].first;
+					id = work[c].edges[id] + 1;
+				}
+			work[c].reused = true;
+			nreused++;
+		}
+		std::vector<Saved>().swap(prev);
+		prevIndex.clear();
+	}
+
+	static Id findRoot(std::vector<Id>& parent, Id x) {
+		while (parent[x] != x) x = parent[x] = parent[parent[x]];
+		return x;
+	}
+
+	// splits the edges of weight >= minw by the connected component of
+	// their blocks, keeping each component's edges in order. The telomere
+	// (block 0) only links two chains when it shows up with both
+	// orientations on the same side of an edge, which oriented score files
+	// never have; if it does, every telomere edge goes into one component,
+	// and true is returned
+	bool findComponents(const std::vector<Scored>& vecEdges, Score minw, std::vector<std::vector<size_t> >& comps) {
+		bool oddTelomere = false;
+		for (size_t i = 0; i < vecEdges.size(); i++) {
+			const Edge& e = vecEdges[i].first;
+			if ((e.bid1 == 0 && e.dir1 != 1) || (e.bid2 == 0 && e.dir2 != -1)) oddTelomere = true;
+		}
+
+		std::vector<Id> parent((size_t)numblocks+1);
+		for (Id b = 0; b <= numblocks; b++) parent[b] = b;
+		for (size_t i = 0; i < vecEdges.size() && vecEdges[i].second >= minw; i++) {
+			const Edge& e = vecEdges[i].first;
+			if ((e.bid1 == 0 || e.bid2 == 0) && !oddTelomere) continue;
+			parent[findRoot(parent, e.bid1)] = findRoot(parent, e.bid2);
+		}
+
+		std::vector<long> compid((size_t)numblocks+1, -1);
+		for (size_t i = 0; i < vecEdges.size() && vecEdges[i].second >= minw; i++) {
+			const Edge& e = vecEdges[i].first;
+			Id r = findRoot(parent, e.bid1 != 0 ? e.bid1 : e.bid2);
+			if (compid[r] < 0) {
+				compid[r] = comps.size();
+				comps.push_back(std::vector<size_t>());
+			}
+			comps[compid[r]].push_back(i);
+		}
+		return oddTelomere;
+	}
+
+	// assembles the components on nthreads threads, largest first. Every
+	// block belongs to one component, so the threads share glob2loc
+	// without locking
+	void runAssemblies(std::vector<Assembly>& work, int nthreads) {
+		std::vector<Id> glob2loc((size_t)numblocks+1, 0);
+		std::vector<Assembly*> order;
+		for (size_t c = 0; c < work.size(); c++) if (!work[c].reused) order.push_back(&work[c]);
+		std::stable_sort(order.begin(), order.end(),
+			[](const Assembly* a1, const Assembly* a2) { return a1->edges.size() > a2->edges.size(); });
+
+		std::atomic<size_t> nextComp(0);
+		std::vector<std::thread> pool;
+		int mem = MEM_CURRENT();	// the memory category of trace.h, for the threads
+		if (nthreads < 1) nthreads = 1;
+		for (int t = 0; t < nthreads; t++) {
+			pool.push_back(std::thread([&]() {
+				(void)MEM_SWITCH(mem);
+				for (size_t c; (c = nextComp++) < order.size(); ) order[c]->run(glob2loc);
+			}));
+		}
+		for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+	}
+};
+
+// the same greedy pass over a stream of scores that comes heaviest first,
+// for score files larger than memory: it keeps the chains and the tables
+// of their ends, which grow with the blocks, but not the edges. Scores of
+// one weight may come in any order; they are taken in the order of their
+// edges, as assemble() takes them. Each adjacency is to come once, as
+// assemble() keeps only the last score of one given twice but a stream
+// cannot tell. The APCFs for a threshold are made once the stream drops
+// below it.
+//
+//	apcf::StreamAssembler<> s(std::vector<double>(1, 0.5));
+//	while (... next record ...) if (!s.add(b1, b2, w)) ... not sorted ...
+//	s.finish();
+//	s.forEachApcf(0, [](const std::list<apcf::StreamAssembler<>::Edge>& le) { ... });
+template <class Id = int, class Score = double>
+class StreamAssembler {
+public:
+	typedef apcf::Edge<Id, Score> Edge;
+	typedef apcf::Chain<Edge> Chain;
+	typedef std::pair<Edge, Score> Scored;
+
+	StreamAssembler(const std::vector<Score>& minWeights)
+			: numblocks(0), room(0), nedges(0), next(0), grouped(false), g(0),
+			results(minWeights.size()) {
+		for (size_t k = 0; k < minWeights.size(); k++) korder.push_back(k);
+		std::stable_sort(korder.begin(), korder.end(),
+			[&](size_t k1, size_t k2) { return minWeights[k1] > minWeights[k2]; });
+		for (size_t k = 0; k < korder.size(); k++) thresholds.push_back(minWeights[korder[k]]);
+	}
+
+	// the next score of the stream; false if it is heavier than the one
+	// before. Once every threshold has its APCFs a score only counts for
+	// numBlocks()
+	bool add(Id sbid1, Id sbid2, Score adjscore) {
+		Id bindex1 = std::abs(sbid1), bindex2 = std::abs(sbid2);
+		if (bindex1 > numblocks) numblocks = bindex1;
+		if (bindex2 > numblocks) numblocks = bindex2;
+		if (grouped && adjscore > weight) return false;
+		if (done()) return true;
+		if (grouped && adjscore < weight) flush();
+		grouped = true;
+		weight = adjscore;
+
+		int intdir1 = (sbid1 < 0) ? -1 : 1;
+		int intdir2 = (sbid2 < 0) ? -1 : 1;
+		group.push_back(std::make_pair(Edge(bindex1, intdir1, bindex2, intdir2), adjscore));
+		group.push_back(std::make_pair(Edge(bindex2, -intdir2, bindex1, -intdir1), adjscore));
+		return true;
+	}
+
+	// the end of the stream
+	void finish() {
+		if (grouped) flush();
+		grouped = false;
+		for (; next < thresholds.size(); next++) snapshot(next);
+	}
+
+	// whether the stream can be left: the APCFs of every threshold are made
+	bool done() const { return next == thresholds.size(); }
+
+	Id numBlocks() const { return numblocks; }
+	// the edges taken by the greedy pass
+	size_t numEdges() const { return nedges; }
+
+	template <class F>
+	void forEachApcf(size_t k, F f) const {
+		typename std::map<size_t, Chain>::const_iterator citer;
+		for (citer = results[k].begin(); citer != results[k].end(); citer++) f(citer->second.edges);
+	}
+
+private:
+	std::vector<Score> thresholds;
+	std::vector<size_t> korder;
+	std::vector<Scored> group;	// the scores of the weight being read
+	Id numblocks, room;
+	size_t nedges, next;
+	bool grouped;
+	Score weight;
+	Greedy<Edge, Id> g;
+	std::vector<std::map<size_t, Chain> > results;
+
+	void snapshot(size_t k) {
+		std::map<size_t, Chain>& snap = results[korder[k]];
+		typename std::map<size_t, Chain>::iterator citer;
+		for (citer = g.mapClasses.begin(); citer != g.mapClasses.end(); citer++) {
+			Chain& c = snap[citer->first];
+			c = citer->second;
+			c.orient(false);
+		}
+	}
+
+	// the edges of one weight in the order of their signed ends, each
+	// once, into the greedy pass
+	void flush() {
+		std::stable_sort(group.begin(), group.end(),
+			[](const Scored& p1, const Scored& p2) { return p1.first < p2.first; });
+		for (size_t k = 0; k < group.size() && !done(); k++) {
+			if (k+1 < group.size() && !(group[k].first < group[k+1].first)) continue;
+			Edge e = group[k].first;
+			if (e.bid1 == e.bid2 || group[k].second <= 0) continue;
+			e.weight = e.score1 = group[k].second;
+			for (; next < thresholds.size() && e.weight < thresholds[next]; next++) snapshot(next);
+			if (done()) break;
+			if (numblocks > room) {
+				room = std::max(numblocks, 2*room);
+				g.grow(room);
+			}
+			g.take(++nedges, e);
+		}
+		group.clear();
+	}
+};
+
+} // namespace apcf
+
+#endif /* APCF_H */
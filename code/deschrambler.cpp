@@ -4,80 +4,35 @@
 #include <string>
 #include <vector>
 #include <sstream>
-#include <map>
-#include <algorithm>
 #include <list>
-#include <iomanip>
-#include <cmath>
+#include <new>
+#include <charconv>
+#include "apcf.h"
+#include "scoreparse.h"
+#include "makeBlocks/workpool.h"
+#include "makeBlocks/numfmt.h"
 
 using namespace std;
 
-enum {SUCCESS, FAIL, CYCLE}; 
-const double gMaxScore = 1.0;
-const double gMinScore = 0.0000001;
-const double gDiffScore = gMaxScore - gMinScore;
-double gAlpha = 0.5;
-int gMinPEReads = 100;	
-double gMinRelCov = 0.5;
-bool gUseCov = false;
-double gMIN_WEIGHT = 0.0;
-
-class Edge {
-public:
-	int bid1, bid2;
-	int dir1, dir2;
-	double score1, score2, weight;
-
-	Edge(int _bid1, int _dir1, int _bid2, int _dir2)
-			:bid1(_bid1), dir1(_dir1), bid2(_bid2), dir2(_dir2), 
-			score1(0.0), score2(0.0), weight(0.0) {}
-	
-	bool operator<(const Edge& p) const {
-		if (bid1 == p.bid1 && dir1 == p.dir1 && bid2 == p.bid2) return dir2 < p.dir2;
-		if (bid1 == p.bid1 && dir1 == p.dir1) return bid2 < p.bid2;
-		if (bid1 == p.bid1) return dir1 < p.dir1;
-		return bid1 < p.bid1;
-	}
-
-	void reverse() {
-		int tmp = bid1;
-		bid1 = bid2;
-		bid2 = tmp;
-
-		tmp = dir1;
-		dir1 = dir2;
-		dir2 = tmp;
-		if (dir1 == 1) dir1 = -1;
-		else dir1 = 1;
-		if (dir2 == 1) dir2 = -1;
-		else dir2 = 1;
-	}
-
-	string toString(map<int, string>& map2name) {
-		string bname1 = map2name[bid1];
-		string bname2 = map2name[bid2];
-		string strdir1 = "+";
-		if (dir1 == -1) { strdir1 = "-"; }
-		string strdir2 = "+";
-		if (dir2 == -1) { strdir2 = "-"; }
-		stringstream ss;
-		ss << bname1 << " " << strdir1 << "\t" << bname2 << " " << strdir2 << "\t";
-		ss << fixed << setprecision(6) << weight << "\t" << score1 << "\t" << score2;
-		return ss.str(); 
-	}
-};
-
-double compute_weight(int bid1, int dir1, int bid2, int dir2, map<Edge,double>& mapscore1) 
+#ifdef DESCHRAMBLER_TRACE
+// the allocations of the containers, counted by the category of trace.h
+void* operator new(size_t size)
 {
-	double adjscore = 0.0;
-	map<Edge, double>::iterator bpiter1, bpiter2;
-	map<Edge, int>::iterator iter;
+	void* p = malloc(size ? size : 1);
+	if (p == NULL) throw bad_alloc();
+	MEM_COUNT(size);
+	return p;
+}
 
-	bpiter1 = mapscore1.find(Edge(bid1, dir1, bid2, dir2));
-    if (bpiter1 != mapscore1.end()) adjscore = bpiter1->second;
-	
-	return adjscore;
+void* operator new[](size_t size)
+{
+	return operator new(size);
 }
+#endif
+
+typedef apcf::Assembler<int, double> Assembler;
+typedef apcf::StreamAssembler<int, double> StreamAssembler;
+typedef Assembler::Edge Edge;
 
 void error (string msg, string file="") 
 {
@@ -85,305 +40,250 @@ void error (string msg, string file="")
 	exit(1);
 }
 
-bool cmp(const pair<Edge,double> &p1, const pair<Edge,double> &p2) 
-{
-	return p1.second > p2.second;
-}
-
-int insertEdge(list<Edge>& le, Edge& e, map<int,int>& mapUsed)
-{
-	Edge& fe = le.front();
-	Edge& be = le.back();
-	
-	if (fe.bid1 == e.bid1 && fe.dir1 != e.dir1) {
-		// check for a cycle
-		if (be.bid2 == e.bid2 && be.dir2 != e.dir2) {
-			return CYCLE; 
-		}
-		
-		// e precedes fe with an opposite direction
-		e.reverse();
-		le.push_front(e);
-		mapUsed[fe.bid1] = 1;
-		mapUsed[-fe.bid1] = 1;
-		if (e.dir1 == 1) mapUsed[-e.bid1] = 1;
-		else mapUsed[e.bid1] = 1;
-		return SUCCESS;	
-	}
-	if (fe.bid1 == e.bid2 && fe.dir1 == e.dir2) {
-		if (fe.bid1 == 0) return FAIL;
-
-		// check for a cycle
-		if (be.bid2 == e.bid1 && be.dir2 == e.dir1) return CYCLE; 
-
-		// e precedes fe with the same direction
-		le.push_front(e);
-		mapUsed[fe.bid1] = 1;
-		mapUsed[-fe.bid1] = 1;
-		if (e.dir1 == 1) mapUsed[-e.bid1] = 1;
-		else mapUsed[e.bid1] = 1;
-		return SUCCESS;
-	}
-
-	if (be.bid2 == e.bid1 && be.dir2 == e.dir1) {
-		if (be.bid2 == 0) return FAIL;
+// a minimum weight as given on the command line, with the names its
+// output files get
+struct Threshold {
+	string text;
+	double weight;
+	string anc_f, join_f;
+};
 
-		// check for a cycle
-		if (fe.bid1 == e.bid2 && fe.dir1 == e.dir2) return CYCLE; 
-		
-		// be precedes e with the same direction
-		le.push_back(e);
-		mapUsed[be.bid2] = 1;
-		mapUsed[-be.bid2] = 1;
-		if (e.dir2 == 1) mapUsed[e.bid2] = 1;
-		else mapUsed[-e.bid2] = 1;
-		return SUCCESS;
-	}
-	if (be.bid2 == e.bid2 && be.dir2 != e.dir2) {
-		// check for a cycle
-		if (fe.bid1 == e.bid1 && fe.dir1 != e.dir1) return CYCLE; 
-		
-		// be precedes e with an opposite direction
-		e.reverse();
-		le.push_back(e);
-		mapUsed[be.bid2] = 1;
-		mapUsed[-be.bid2] = 1;
-		if (e.dir2 == 1) mapUsed[e.bid2] = 1;
-		else mapUsed[-e.bid2] = 1;
-		return SUCCESS;	
-	}
-	return FAIL;
-}
-	
-void printLists(int numblocks, map<int, list<Edge> >& mapClasses, char* anc_f, char* join_f)
+template <class A>
+void printLists(const A& asmb, size_t k, const char* anc_f, const char* join_f)
 {
-	map<int, list<Edge> >::iterator citer;
-
-	ofstream outf_anc;
-	outf_anc.open(anc_f);
-	ofstream outf_join;
-	outf_join.open(join_f);
-
-	outf_anc << ">ANCESTOR\t" << numblocks << endl;
+	// through text_bufs, as an ofstream << endl flushed every line
+	FILE* anc_fp = fopen(anc_f, "w");
+	FILE* join_fp = fopen(join_f, "w");
+	if (anc_fp == NULL) error("Cannot write ", anc_f);
+	if (join_fp == NULL) error("Cannot write ", join_f);
+	struct text_buf anc, join;
+	text_begin(&anc, anc_fp);
+	text_begin(&join, join_fp);
+
+	text_str(&anc, ">ANCESTOR\t");
+	text_int(&anc, asmb.numBlocks());
+	text_char(&anc, '\n');
 	int clsnum = 1;	
-	for(citer = mapClasses.begin(); citer != mapClasses.end(); citer++) {
-		list<Edge>& le = citer->second;
+	asmb.forEachApcf(k, [&](const list<Edge>& le) {
 		int listsize = le.size();
-		outf_anc << "# APCF " << clsnum << endl;
+		text_str(&anc, "# APCF ");
+		text_int(&anc, clsnum);
+		text_char(&anc, '\n');
 		clsnum++;
 	
-		list<Edge>::iterator liter;
+		list<Edge>::const_iterator liter;
 		int cnt = 0;
 		for (liter = le.begin(); liter != le.end(); liter++) {
-			Edge& e = *liter;
-			if (cnt < listsize-1) { 
-				if (e.bid1 != 0) outf_anc << e.bid1*e.dir1 << " ";
-			} else { 
-				if (e.bid1 != 0) outf_anc << e.bid1*e.dir1 << " ";
-				if (e.bid2 != 0) outf_anc << e.bid2*e.dir2 << " $";
-				else outf_anc << " $";
+			const Edge& e = *liter;
+			if (e.bid1 != 0) {
+				text_int(&anc, e.bid1*e.dir1);
+				text_char(&anc, ' ');
+			}
+			if (cnt == listsize-1) { 
+				if (e.bid2 != 0) text_int(&anc, e.bid2*e.dir2);
+				text_str(&anc, " $");
 			}
 			cnt++;
 
-			outf_join << e.bid1*e.dir1 << "\t" << e.bid2*e.dir2 << "\t" << e.weight << endl; 
+			// the weight as << prints it, "%g"
+			text_int(&join, e.bid1*e.dir1);
+			text_char(&join, '\t');
+			text_int(&join, e.bid2*e.dir2);
+			text_char(&join, '\t');
+			char* p = text_room(&join, 32);
+			join.p = to_chars(p, p + 32, e.weight, chars_format::general, 6).ptr;
+			text_char(&join, '\n');
 		}	
-		outf_anc << endl;
-
-	} // end of for
-	outf_anc.close();	
-	outf_join.close();
+		text_char(&anc, '\n');
+	});
+	text_flush(&anc);
+	text_flush(&join);
+	if (fclose(anc_fp) != 0) error("Cannot write ", anc_f);
+	if (fclose(join_fp) != 0) error("Cannot write ", join_f);
 }
 
-double computeAvg(map<Edge,double>& mapScores)
+// scores come either as text "bid1 bid2 score" lines or as the binary
+// adjacencies.prob written by inferAdjProb -binary; text files are read
+// with readScoreFile() (scoreparse.h)
+const char ADJPROB_MAGIC[] = "ADJPROB";
+const int ADJPROB_VERSION = 1;
+
+bool readScore(istream& infile, bool binary, int& bid1, int& bid2, double& adjscore)
 {
-	map<Edge,double>::iterator iter;
-	double sum = 0.0;
-	int cnt = mapScores.size();
-	for (iter = mapScores.begin(); iter != mapScores.end(); iter++) {
-		sum += iter->second;
+	if (!binary) return (bool)(infile >> bid1 >> bid2 >> adjscore);
+
+	struct { int b1, b2; double prob; } rec;
+	if (!infile.read((char*)&rec, sizeof(rec))) return false;
+	// orient the pair as refine_adjprob.pl does so that both ends of a
+	// telomere adjacency land on the same edge
+	if (abs(rec.b1) > abs(rec.b2)) {
+		bid1 = -rec.b2;
+		bid2 = -rec.b1;
+	} else {
+		bid1 = rec.b1;
+		bid2 = rec.b2;
 	}
-	return (sum/cnt);
-} 
+	adjscore = rec.prob;
+	return true;
+}
 
-void mergeLists(int clscnt, int clsid, list<Edge>& le, map<int, list<Edge> > &mapClasses) 
+// -stream: the scores come sorted by descending score, from a file or
+// from standard input ("-"), and are assembled as they are read; only the
+// chains and the tables of their ends are kept. The pass stops taking
+// edges below the lowest threshold but reads on for the number of blocks
+void streamScores(const char* fcons, vector<Threshold>& thresholds)
 {
-	map<int, list<Edge> >::iterator citer;
-	list<Edge>::iterator liter;
-	list<Edge>::reverse_iterator rliter;
-	list<Edge>& le1 = le;
-		
-	for (int j = 1; j <= clscnt; j++) {
-		if (j == clsid) continue;
-
-		citer = mapClasses.find(j);
-		if (citer == mapClasses.end()) continue;
-		list<Edge>& le2 = citer->second;
-			
-		Edge& e1front = le1.front();
-		Edge& e1back = le1.back();
-		
-		Edge& e2front = le2.front();
-		Edge& e2back = le2.back();
+	ifstream infile;
+	istream* in = &cin;
+	if (string(fcons) != "-") {
+		infile.open(fcons, ios::in | ios::binary);
+		if (!infile) error ("\n[ERROR] Unable to open file: ", fcons); 
+		in = &infile;
+	}
+	char magic[8] = {0};
+	bool binary = in->peek() == ADJPROB_MAGIC[0] && in->read(magic, sizeof(magic))
+		&& string(magic, sizeof(magic)) == string(ADJPROB_MAGIC, sizeof(magic));
+	if (binary) {
+		int hdr[2];
+		if (!in->read((char*)hdr, sizeof(hdr)) || hdr[0] != ADJPROB_VERSION) 
+			error ("\n[ERROR] Unsupported adjacency file: ", fcons);
+	} else if (in->gcount() > 0) error ("\n[ERROR] Unsupported adjacency file: ", fcons);
+
+	vector<double> weights;
+	for (size_t k = 0; k < thresholds.size(); k++) weights.push_back(thresholds[k].weight);
+	StreamAssembler asmb(weights);
+	ScoreRec rec;
+	string line;
+	size_t n = 0;
+	for (;;) {
+		if (binary) {
+			if (!readScore(*in, true, rec.bid1, rec.bid2, rec.score)) break;
+		} else {
+			// parsed as readScoreFile() does, stopping at the first line
+			// that is not a record
+			if (!getline(*in, line)) break;
+			const char* p = line.data();
+			const char* end = p + line.size();
+			while (p < end && scoreSpace(*p)) p++;
+			if (p == end) continue;
+			if (!scoreToken(p, end, rec.bid1) || !scoreToken(p, end, rec.bid2) ||
+				!scoreToken(p, end, rec.score)) break;
+		}
+		n++;
+		if (!asmb.add(rec.bid1, rec.bid2, rec.score)) {
+			stringstream ss;
+			ss << "\n[ERROR] Scores not sorted by descending score at record " << n << " of ";
+			error (ss.str(), fcons);
+		}
+	}
+	asmb.finish();
+	cerr << "Edges taken = " << asmb.numEdges() << endl;
 
-		if(e1front.bid1 == e2front.bid1 && e1front.dir1 != e2front.dir1) {
-			// check cycle
-			if (e1back.bid2 == 0 || e2back.bid2 == 0 || e1back.bid2 != e2back.bid2) {	
-				for (liter = le2.begin(); liter != le2.end(); liter++) {
-					Edge e2 = *liter;
-					e2.reverse();
-					le1.push_front(e2);
-				} // end of for
-				mapClasses.erase(j);
-			}
-		} else if(e1front.bid1 == e2back.bid2 && e1front.dir1 == e2back.dir2) {
-			// check cycle
-			if (e1front.bid1 != 0 && 
-				(e1back.bid2 == 0 || e2front.bid1 == 0 || e1back.bid2 != e2front.bid1)) {
-				for (rliter = le2.rbegin(); rliter != le2.rend(); rliter++) {
-					Edge e2 = *rliter;
-					le1.push_front(e2);
-				} // end of for
-				mapClasses.erase(j);	
-			}	
-		} else if(e1back.bid2 == e2front.bid1 && e1back.dir2 == e2front.dir1) {
-			// check cycle
-			if (e1back.bid2 != 0 && 
-				(e1front.bid1 == 0 || e2back.bid2 == 0 || e1front.bid1 != e2back.bid2)) {
-				for (liter = le2.begin(); liter != le2.end(); liter++) {
-					Edge e2 = *liter;
-					le1.push_back(e2);
-				} // end of for
-				mapClasses.erase(j);	
-			}	
-		} else if(e1back.bid2 == e2back.bid2 && e1back.dir2 != e2back.dir2) {
-			// check cycle
-			if (e1front.bid1 == 0 || e2front.bid1 == 0 || e1front.bid1 != e2front.bid1) {
-				for (rliter = le2.rbegin(); rliter != le2.rend(); rliter++) {
-					Edge e2 = *rliter;
-					e2.reverse();
-					le1.push_back(e2);
-				} // end of for
-				mapClasses.erase(j);	
-			}
-		}	
-	} // end of for j
+	for (size_t k = 0; k < thresholds.size(); k++) 
+		printLists(asmb, k, thresholds[k].anc_f.c_str(), thresholds[k].join_f.c_str());
 }
 
 int main(int argc, char* argv[]) 
 {
-	gMIN_WEIGHT = atof(argv[1]);
+	// -counters prints the trace counters at exit (built with make TRACE=1);
+	// -state keeps the APCFs of each component in a file, and a later run
+	// given the same file only assembles the components whose edges changed;
+	// -stream assembles scores sorted by descending score as they are read
+	bool counters = false, stream = false;
+	const char* state_f = NULL;
+	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+		if (string(argv[1]) == "-counters") counters = true;
+		else if (string(argv[1]) == "-stream") stream = true;
+		else if (string(argv[1]) == "-state" && argc > 2) { state_f = argv[2]; argc--; argv++; }
+		else break;
+	}
+	if (argc < 5) error ("usage: deschrambler [-counters] [-state file | -stream] <min weight[,weight...]> <score file> <ancestor file> <join file> [threads]");
 	char* fcons = argv[2];
 	char* outfanc = argv[3];
 	char* outfjoin = argv[4];
-	map<Edge, double>::iterator bpiter;
+	int nthreads = thread_arg(argc > 5 ? argv[5] : NULL);
+
+	// a comma-separated list of minimum weights gives one APCF set per
+	// weight, written to <ancestor file>.<weight> and <join file>.<weight>
+	vector<Threshold> thresholds;
+	stringstream ssw(argv[1]);
+	string tok;
+	while (getline(ssw, tok, ',')) {
+		Threshold t;
+		t.text = tok;
+		t.weight = atof(tok.c_str());
+		t.anc_f = outfanc;
+		t.join_f = outfjoin;
+		thresholds.push_back(t);
+	}
+	if (thresholds.empty()) error ("\n[ERROR] No minimum weight given");
+	if (thresholds.size() > 1) {
+		for (size_t k = 0; k < thresholds.size(); k++) {
+			thresholds[k].anc_f += "." + thresholds[k].text;
+			thresholds[k].join_f += "." + thresholds[k].text;
+		}
+	}
 
-	cerr << "Minimum weight = " << gMIN_WEIGHT << endl;
+	for (size_t k = 0; k < thresholds.size(); k++) 
+		cerr << "Minimum weight = " << thresholds[k].weight << endl;
 	cerr << "Conservation score file = " << fcons << endl;
 
+	if (stream) {
+		if (state_f != NULL) error ("\n[ERROR] -state cannot be used with -stream");
+		(void)MEM_ENTER(apcf);
+		streamScores(fcons, thresholds);
+		trace_memory_report("assembled");
+		if (counters) { trace_counters(stderr); trace_memory(stderr, "at exit"); }
+		return 0;
+	}
+
 	// read adjacency scores
-	int numblocks = 0;
-	map<Edge, double> mapAdjScores;
+	int mem = MEM_ENTER(scores);
 	ifstream infile;
-	infile.open(fcons);
+	infile.open(fcons, ios::in | ios::binary);
 	if (!infile) error ("\n[ERROR] Unable to open file: ", fcons); 
-	int bid1, bid2;
-	double adjscore;
-	while (infile >> bid1 >> bid2 >> adjscore) {
-		int bindex1 = abs(bid1); 
-		int bindex2 = abs(bid2); 
-		int intdir1 = 1;
-		if (bid1 < 0) intdir1 = -1; 
-		int intdir2 = 1;
-		if (bid2 < 0) intdir2 = -1; 
-		Edge bpf(bindex1, intdir1, bindex2, intdir2);
-		Edge bpr(bindex2, -intdir2, bindex1, -intdir1);
-		mapAdjScores[bpf] = adjscore;
-		mapAdjScores[bpr] = adjscore;
-		
-		if (abs(bid1) > numblocks) numblocks = abs(bid1);
-		if (abs(bid2) > numblocks) numblocks = abs(bid2);
+	char magic[8] = {0};
+	infile.read(magic, sizeof(magic));
+	bool binary = (infile.gcount() == sizeof(magic) && string(magic, sizeof(magic)) == string(ADJPROB_MAGIC, sizeof(magic)));
+	if (binary) {
+		int hdr[2];
+		if (!infile.read((char*)hdr, sizeof(hdr)) || hdr[0] != ADJPROB_VERSION) 
+			error ("\n[ERROR] Unsupported adjacency file: ", fcons);
+	}
+	vector<ScoreRec> recs;
+	if (binary) {
+		ScoreRec rec;
+		while (readScore(infile, binary, rec.bid1, rec.bid2, rec.score)) recs.push_back(rec);
+		infile.close();	
+	} else {
+		infile.close();	
+		if (!readScoreFile(fcons, recs, nthreads)) error ("\n[ERROR] Unable to open file: ", fcons); 
+	}
+	trace_memory_report("scores read");
+	MEM_LEAVE(mem);
+	(void)MEM_ENTER(apcf);
+	Assembler asmb;
+	asmb.add(recs.begin(), recs.end());
+	vector<ScoreRec>().swap(recs);
+	if (state_f != NULL) {
+		ifstream prev(state_f);
+		if (prev.good() && !asmb.loadState(state_f)) cerr << "Ignoring unreadable state " << state_f << endl;
+		asmb.keepState();
 	}
-	infile.close();	
-
-	// compute edge weights
-	map<Edge, double> mapWeights;
-	double weight = 0.0;
-	for (int i = 0; i <= numblocks; i++) {	
-		for (int j = 0; j <= numblocks; j++) { 
-			if (i == j) continue;
-
-			weight = compute_weight(i,1,j,1,mapAdjScores);
-			if (weight > 0.0) mapWeights[Edge(i,1,j,1)] = weight; 
-			weight = compute_weight(i,1,j,-1,mapAdjScores);
-			if (weight > 0.0) mapWeights[Edge(i,1,j,-1)] = weight; 
-			weight = compute_weight(i,-1,j,1,mapAdjScores);
-			if (weight > 0.0) mapWeights[Edge(i,-1,j,1)] = weight; 
-			weight = compute_weight(i,-1,j,-1,mapAdjScores);
-			if (weight > 0.0) mapWeights[Edge(i,-1,j,-1)] = weight; 
-		} // end of j
-	} // end of for
-
-	// greedy search based on edge weights
-	vector<pair<Edge,double> > vecEdges(mapWeights.begin(), mapWeights.end()); 
-	sort (vecEdges.begin(), vecEdges.end(), cmp);
-
-	map<int, int> mapUsed;	
-	map<int, int>::iterator uiter, uiterex;
-	map<int, list<Edge> > mapClasses;
-	map<int, list<Edge> >::iterator citer;
-	map<Edge, int>::iterator niter;
-	map<Edge, double>::iterator biter;
-	int clscnt = 0;
-	for (int i = 0; i < vecEdges.size(); i++) {
-		pair<Edge,double> p = vecEdges.at(i);
-		Edge& e = p.first;
-		e.weight = p.second;
-
-		bpiter = mapAdjScores.find(e);
-		if (bpiter != mapAdjScores.end()) e.score1 = mapAdjScores[e];
-	
-		if (e.weight < gMIN_WEIGHT) continue;
-
-		if (e.bid1 != 0) {
-			if (e.dir1 == 1) uiter = mapUsed.find(-e.bid1); 
-			else uiter = mapUsed.find(e.bid1);  
-			if (uiter != mapUsed.end()) continue; 
-		}	
-		
-		if (e.bid2 != 0) {
-			if (e.dir2 == 1) uiter = mapUsed.find(e.bid2);
-			else uiter = mapUsed.find(-e.bid2); 
-			if (uiter != mapUsed.end()) continue;
-		}		
 
-		bool found = false;
-		for (citer = mapClasses.begin(); citer != mapClasses.end(); citer++) {
-			list<Edge>& le = citer->second;
-			int res = insertEdge(le, e, mapUsed);
-			if (res == SUCCESS || res == CYCLE) { 
-				if (res == SUCCESS) mergeLists(clscnt, citer->first, le, mapClasses);
-				found = true;
-				break;
-			} // end of if	
-		} // end of for 
-	
-		if (found == false) {
-			list<Edge> le;
-			le.push_back(e);
-			mapClasses[++clscnt] = le;
-		
-			if (e.bid1 != 0) {	
-				if (e.dir1 == 1) mapUsed[-e.bid1] = 1; 
-				else mapUsed[e.bid1] = 1; 
-			}
-			if (e.bid2 != 0) {
-				if (e.dir2 == 1) mapUsed[e.bid2] = 1; 
-				else mapUsed[-e.bid2] = 1; 
-			}
-		}	
+	vector<double> weights;
+	for (size_t k = 0; k < thresholds.size(); k++) weights.push_back(thresholds[k].weight);
+	asmb.assemble(weights, nthreads);
+	cerr << "Components = " << asmb.numComponents() << endl;
+	trace_memory_report("assembled");
+	if (state_f != NULL) {
+		cerr << "Components carried over = " << asmb.numReused() << endl;
+		if (!asmb.saveState(state_f)) error ("\n[ERROR] Unable to write file: ", state_f);
 	}
 
-	printLists(numblocks, mapClasses, outfanc, outfjoin);
+	for (size_t k = 0; k < thresholds.size(); k++) 
+		printLists(asmb, k, thresholds[k].anc_f.c_str(), thresholds[k].join_f.c_str());
 
+	if (counters) { trace_counters(stderr); trace_memory(stderr, "at exit"); }
 	return 0;
 }
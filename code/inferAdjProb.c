@@ -1,26 +1,48 @@
 #include "common.h"
 #include "errabort.h"
 #include "linefile.h"
+#include "localmem.h"
+#include "hash.h"
+#include "dystring.h"
 #include "options.h"
-#include "uthash.h"
+#include "memalloc.h"
+#include "pthreadWrap.h"
+#include "makeBlocks/newick.h"
+#include "makeBlocks/workpool.h"
+#include "makeBlocks/progress.h"
+#include "makeBlocks/trace.h"
+#include "makeBlocks/genomedb.h"
+#include "makeBlocks/numfmt.h"
+#include "adjprob.h"
 #include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sched.h>
 
 #define LEFT 0
 #define RIGHT 1
 #define YES	0x01
 #define NO	0x00
-#define HI	0xFF
 #define D		sizeof(double)
-#define STACKSZ	50000
 #define DESC 0.35
 
 #define CHR 0
 #define NONCHR 1
 
+// a leaf below the ancestor contributes its genome, a leaf outside it its
+// outgroup joins; in single-ancestor mode both views are the same entry
+#define VIEW_IN 0
+#define VIEW_OUT 1
+
 struct chromList {
 	struct chromList *next;
 	int eleNum;
-	int *eleOrder;
+	const int *eleOrder;	// in GenomeMem, or in the mapped Genomes.db
 	int type;	// CHR or NONCHR	
 };
 
@@ -29,78 +51,394 @@ struct phyloTree {
 	struct phyloTree *parent, *child[2];
 	int chromNum;
 	boolean outgroup;
-	double distalpha;
+	double dist;		// branch length as read from the tree
+	double distalpha;	// dist scaled by the current alpha
+	double psame, pdiff;	// transition probabilities along the branch above
+	int id;			// dense index, 0 .. NodeNum-1
+	boolean onPath;		// a target ancestor or one of its ancestors
+	struct nodeList *data[2];	// leaf adjacencies seen from VIEW_IN/VIEW_OUT
 	char *name;
 	struct chromList *genome;
 };
 
+struct adjList {
+	struct adjList *next;
+	int i;
+};
+
+/* the adjacencies of a leaf, read through leafPred(), leafExtra() and
+ * leafThere(). The predecessors are dense, pred[j] for every column (-1 if
+ * none), unless the leaf has them at fewer than LEAF_SPARSE of the columns:
+ * then they are the npred columns predCol[] (sorted) has and pred[] holds
+ * their predecessors. The extremities the leaf has are a bitset. A leaf
+ * with the same sets as an earlier one (strains or assemblies of one
+ * species) points at that one's instead of keeping its own */
 struct nodeList {
 	struct nodeList *next;
 	struct phyloTree *addr;
-	unsigned char *P, *S, *there;
+	boolean outgroup;	// adjacencies come from the .joins file
+	int *pred;
+	int *predCol, npred;	// sparse only; predCol is NULL if dense
+	struct adjList **extra;	// further predecessors (outgroup multi-joins), NULL if none
+	uint64_t *there;
+	struct nodeList *same;	// the entry whose sets these are, NULL if its own
 };
 
+// sparse matrix over the candidate adjacencies: the entries of each major
+// index (a column for P-type, a row for S-type matrices) are the sorted
+// minor indices idx[start[m]] .. idx[start[m+1]-1], with values in val
 struct matrix {
-	struct matrix *next;
-	int x;
-	double val;
+	int *start, *idx;
+	double *val;
 };
 
-struct edgeList {
-	struct edgeList *next;
+struct weightedEdge {
 	int i, j;
 	double wei;
 };
 
-struct hash_key {
-    struct phyloTree* node;
-    int i;
-    int j;
+// storage type of the likelihood rows; build with -DLL_FLOAT to halve the
+// memory traffic of the column kernel when single precision is enough
+#ifdef LL_FLOAT
+typedef float llReal;
+#else
+typedef double llReal;
+#endif
+// the density of predecessors below which a leaf keeps them sparse; 0
+// compiles in the dense leaves alone
+#ifndef LEAF_SPARSE
+#define LEAF_SPARSE 0.25
+#endif
+#ifndef LL_TINY
+#ifdef LL_FLOAT
+#define LL_TINY 1e-20
+#else
+#define LL_TINY 1e-150
+#endif
+#endif
+
+// per-thread state of the likelihood recursion. Every column is evaluated
+// independently, so each node keeps one row holding LL(node, s, j) for all
+// candidates s of the column j it last worked on.
+struct llContext {
+	int *memoCol;		// per node: column held in its row
+	int *slot;		// per node: which row of memo it owns
+	boolean lazy;		// fill child rows on demand rather than by Plan
+	llReal *memo;		// rows of stride slots
+	int stride;		// MaxCol, or in a cache tile the candidates of the column
+	double *colSum;		// per node: sum of its row
+	double *logScale;	// per node: the row is LL(node, ., j) / exp(logScale)
+	int view;		// which leaf data the recursion reads
+	struct matrix *cand;	// the candidate index leafKernel() looks in, PLH's or a -numa copy
+	struct nodeList **leaves;	// -numa: per node id, the thread's copy of the leaf data
+	double *outside;	// multi-ancestor mode: NodeNum rows of MaxCol slots
+	double *outScale;	// per node: log scale of its outside row
+	double *down;
+	llReal *jackRow;	// -jackknife: two rows for the path of a dropped leaf
+	int *leafSlot;		// leafKernel(): the adjacencies of a leaf in a column
+	llReal *leafVal;
+	llReal *tileMemo;	// -cacheTile: the rows of the columns of a tile,
+	double *tileSum, *tileScale;	// and their sums and scales, column by column
+	int *skipLen, *skipK;	// -epsilon: per slot, the skipped candidates with
+	llReal *skipVal;	// a leaf below, MaxSkip slots each, and their values;
+	double *skipBase, *skipSum;	// per node: the value of those with none, and the sum of all
+	int *skipLeaf;		// the ones of two leaves, for skippedRow()
+	long memoHits, memoMisses;
+};
+
+// -stats: wall and CPU seconds and peak RSS growth of each phase, summed
+// over repeated calls (alpha sweeps, several targets)
+enum {PH_TREE, PH_GENOMES, PH_SETS, PH_PRED, PH_NORM, PH_POST, PH_NUM};
+
+struct phaseStat {
+	double wall, cpu;
+	long rssKb;
+	int calls;
 };
 
-struct hash_entry {
-    struct hash_key key;
-    double value;
-    UT_hash_handle hh;
+struct phaseClock {
+	double wall, cpu;
+	long rssKb;
 };
 
 static boolean oj = TRUE;
 static struct phyloTree *Phylo = NULL, *Ances = NULL;
 static struct nodeList *Leaf = NULL;
-static int X = 8 * sizeof(unsigned char);
 static int A = 0, T = 0, N = 0, Z = 0; 
-static unsigned char *DPPI, *DSPI, *G;
-static struct matrix *PLH, *SLH, *PPP, *SPP;
-static struct edgeList *Edgelist = NULL;
+static int *PredStart, *PredIdx;	// candidate predecessors of each column
+static int *SuccStart, *SuccIdx;	// candidate successors of each row
+static int *SuccPos;		// position of each Succ entry in the Pred index
+// the adjacency i -> j is map(j) -> map(i) read the other way, so the
+// likelihood of the Succ entry (i, j) is the PLH value of (map(j), map(i)),
+// at SuccMirror; SLH holds no values of its own
+static int *SuccMirror;
+static struct matrix PLH, SLH;
+// the posteriors are read off PLH: PPP divides a column by ColSum, SPP a row
+// of SLH by RowSum (in log space around RowMax once rows were rescaled)
+static double *ColSum = NULL, *RowSum = NULL, *RowMax = NULL;
 static double alpha = 0.0;
 
-static struct hash_entry *lp_cache = NULL;
-static struct hash_entry *ll_cache = NULL;
+static int NodeNum = 0;
+static struct lm *GenomeMem = NULL;
+static struct genome_db *GenomeDb = NULL;
+static int MaxCol = 0;	// longest candidate list of an evaluated column
+static int Threads = 1;
+static int NextCol = 0;
+static struct progress *Progress = NULL;	// of the columns, in getPredecessor()
+static struct phyloTree **Targets = NULL;	// multi-ancestor mode
+static int TargetNum = 0;
+static double **TargetPLH = NULL;
+// rows sinking below LL_TINY are rescaled by their maximum; ColScale[j] is
+// the log factor column j of PLH was divided by, and so that of the SLH
+// row map(j)
+static double *ColScale = NULL;
+static double **TargetScale = NULL;
+// single-ancestor mode evaluates each column bottom-up over this post-order
+// schedule. Rows are recycled once the parent has consumed them, so only
+// PlanRows of them are live at any time instead of one per node.
+static struct phyloTree **Plan = NULL;
+static int PlanLen = 0, PlanRows = 0;
+static int *PlanSlot = NULL;
+static boolean Rescaled = FALSE;
+static char *CheckpointFile = NULL;	// -checkpoint
+static int CheckpointSec = 600;
+static char *MergeFiles = NULL;	// -merge
+static boolean Resume = FALSE;	// -resume
+static unsigned char *ColDone = NULL;	// columns whose PLH is final
+// -part=k/n: the columns PartLo .. PartHi-1 this run evaluates, the k-th of
+// n ranges holding about the same number of candidates
+static int PartK = 0, PartN = 0, PartLo = 0, PartHi = 0;
+static char *LLCacheDir = NULL;	// -llcache
+static char *CoarseFile = NULL;	// -coarse
+static int Pruned = 0;		// candidates it dropped
+static double Epsilon = 0;	// -epsilon
+static int Bounded = 0;		// candidates it skipped
+// the candidates -epsilon skipped, by column as Pred, MaxSkip at most in
+// one. Their leaf adjacencies stay in the leaf sets, and their likelihoods
+// are still taken for the normalisers (see skippedRow()): SkipSum[j] is
+// the sum of those of column j at the ancestor, scaled as PLH
+static int *SkipStart = NULL, *SkipIdx = NULL;
+static int MaxSkip = 0;
+static double *SkipSum = NULL;
+// -jackknife: the leaves dropped one at a time, the parent of every node
+// in the evaluated tree, and the PLH and column scales without each leaf
+static struct phyloTree **JackLeaf = NULL, **JackParent = NULL;
+static int JackNum = 0;
+static double **JackPLH = NULL, **JackScale = NULL;
+static time_t LastCheckpoint = 0;
+static pthread_mutex_t CheckpointMutex = PTHREAD_MUTEX_INITIALIZER;
+static char *PhaseName[PH_NUM] = {"readTree", "readGenomes", "initSets",
+	"getPredecessor", "normalize", "calculatePostProb"};
+static struct phaseStat Stats[PH_NUM];
+static long MemoHits = 0, MemoMisses = 0;
+static long NonzeroPLH = 0, NonzeroSLH = 0, Outputs = 0;
+// -memLimit: the budget in bytes; once the likelihoods do not fit they are
+// spilled, and TileBytes of them are evaluated at a time
+static double MemLimit = 0, TileBytes = 0;
+static boolean Spill = FALSE;
+static int TileHi = 0;	// end of the tile of columns being evaluated
+static double CacheTile = 0;	// -cacheTile, -1 for half the L2 cache
+static double CacheTileBytes = 0;	// the rows of a cache tile, 0 for a column at a time
+static int CacheTileCols = 0;	// the most columns a cache tile has
+static boolean Numa = FALSE;	// -numa
+static char *JoinsDir = NULL;	// of the .joins files, the working directory if NULL
+// the result PLH and ColScale hold (see selectResult()), -1 for the '@'
+// ancestor, whose are kept in MainPLH and MainScale meanwhile
+static int Selected = -1;
+static double *MainPLH = NULL, *MainScale = NULL;
+// -minProb and -topK: the Succ entries the .prob and -scores files keep,
+// NULL while they keep every one
+static double MinProb = 0;
+static int TopK = 0;
+static unsigned char *Keep = NULL;
+// the super-blocks (see findSuperBlocks()): the blocks of super-block s,
+// read forward, are SuperPath[SuperStart[s]] .. SuperPath[SuperStart[s+1]-1],
+// and SuperOf[b] is the one block b is in, negative where b is read
+// backward; all NULL while every block is evaluated on its own. BlockNum
+// is the T of the input, which the transition probabilities keep
+static boolean Collapse = TRUE;	// not with -noSuperBlocks
+static int BlockNum = 0;
+static int *SuperStart = NULL, *SuperPath = NULL, *SuperOf = NULL;
+// -blocks: the blocks of the input whose adjacencies are written, and the
+// columns evaluated for them; both NULL while every one is
+static unsigned char *Wanted = NULL, *Needed = NULL;
+// -pseudoLeaves: the subtrees below the ancestor whose branches add up to
+// less than PseudoLen are evaluated as one leaf each (see pseudoLeaves()),
+// PseudoNum of them. -pseudoCheck evaluates the whole tree first and keeps
+// the deviation of the posteriors from it, PseudoMax < 0 until then
+static double PseudoLen = 0;
+static int PseudoNum = 0;
+static double PseudoMax = -1, PseudoMean = 0;
 
+#ifndef NO_MAIN
 void usage() {
 	errAbort(
 		"inferAdjProb - inferring the posterior probability of block adjacency\n"
         "  usage: inferAdjProb refspc parameter-alpha tree-file genome-file\n"
+        "    a parameter-alpha of - is read from the standard input once the genomes\n"
+        "    are read and the candidates indexed, so that it can be estimated (by\n"
+        "    newickTool jc) while they are; with -epsilon it is read before\n"
+        "  options:\n"
+        "    -threads=N  number of threads computing the likelihood columns (default\n"
+        "                $DESCHRAMBLER_THREADS, or all the processors)\n"
+        "    -numa       pin the threads to the NUMA nodes of the processors they may\n"
+        "                use, give each node a copy of the candidate index and the\n"
+        "                leaf adjacencies and a share of every tile of columns\n"
+        "    -binary     write adjacencies.prob as binary records instead of text\n"
+        "    -ancestors=a,b,...  reconstruct the named internal nodes (or 'all') in one\n"
+        "                run, writing adjacencies.<name>.prob for each; the '@' mark\n"
+        "                is ignored and every leaf outside a target needs a .joins file\n"
+        "    -alphas=x,y,...  run once per listed alpha instead of parameter-alpha,\n"
+        "                adding .alpha_<x> before .prob in every output name\n"
+        "    -scores=file  also write the adjacencies as refine_adjprob.pl refines\n"
+        "                them (block_consscores.txt) to file; with -ancestors or\n"
+        "                -alphas the tags of the .prob names go before its extension\n"
+        "    -cars       also write greedy CARs built from the posteriors to a .cars\n"
+        "                file next to each .prob file\n"
+        "    -checkpoint=file  save the finished likelihood columns to file every\n"
+        "                -checkpointSec=N seconds (default 600)\n"
+        "    -resume     reload the columns saved in the -checkpoint file and skip them\n"
+        "    -part=k/n   evaluate only the k-th of n column ranges (1 <= k <= n) into\n"
+        "                the -checkpoint file and stop; the parts may run on other\n"
+        "                machines, with the same arguments otherwise\n"
+        "    -merge=f1,f2,...  load the columns of the -part checkpoints, compute any\n"
+        "                still missing and write the outputs as a whole run does\n"
+        "    -llcache=dir  keep the likelihood table of every internal node in dir,\n"
+        "                named by a hash of its subtree (topology, branch lengths,\n"
+        "                alpha, leaf adjacencies and the candidate lists); a later run\n"
+        "                takes the tables of unchanged subtrees from there and only\n"
+        "                evaluates the nodes above them (not with -ancestors)\n"
+        "    -jackknife  also write adjacencies.drop_<leaf>.prob (and the -scores and\n"
+        "                -cars files) for every leaf, as if its data were left out:\n"
+        "                only the path from the leaf to the ancestor is evaluated\n"
+        "                again; the candidates stay those of all the leaves\n"
+        "    -stats=file write per-phase timings, memory and counters to file as JSON\n"
+        "    -memLimit=size  estimate the memory the run needs (size in bytes, or with\n"
+        "                K, M, G or T) and stop at once if it cannot fit; likelihoods\n"
+        "                that do not fit go to scratch files in $TMPDIR (or the current\n"
+        "                directory) and are evaluated a tile of columns at a time\n"
+        "    -counters   print the trace counters at exit (built with make TRACE=1)\n"
+        "    -coarse=file  drop the candidates joining two ends at the boundaries of\n"
+        "                coarser blocks that a coarser run joins otherwise; file, from\n"
+        "                script/coarse_adjs.pl, lists those ends ('x') and the joins\n"
+        "                of the coarser run as block ends ('x y', 0 a chromosome end)\n"
+        "    -epsilon=x  skip the candidates whose posterior an upper bound from the\n"
+        "                leaves that have them puts below x: their likelihoods are\n"
+        "                taken only above those leaves, for the normalisers (not with\n"
+        "                -alphas, -ancestors, -jackknife or -llcache)\n"
+        "    -minProb=x  leave out of the .prob and -scores files the adjacencies\n"
+        "                whose posterior is below x in both readings\n"
+        "    -topK=k     keep there only the adjacencies among the k most probable\n"
+        "                of either block end they join (any number at a chromosome\n"
+        "                end); -cars still reads them all\n"
+        "    -dropped=file  write the posterior and the number of the adjacencies\n"
+        "                -minProb and -topK left out of each block end to file,\n"
+        "                tagged as -scores\n"
+        "    -noSuperBlocks  evaluate every block on its own; by default a run of blocks\n"
+        "                every leaf joins in the same order, and none joins otherwise,\n"
+        "                is evaluated as one block and its adjacencies written with\n"
+        "                posterior 1, which they have\n"
+        "    -cacheTile=size  evaluate the likelihood columns node by node in tiles\n"
+        "                whose rows take at most size (bytes, or with K or M; 'L2'\n"
+        "                for half the L2 cache) rather than one column at a time\n"
+        "    -blocks=b,b1-b2,...  write only the adjacencies of the listed blocks (or\n"
+        "                ranges of them: the blocks are numbered along the reference, so\n"
+        "                a range is a region of it), evaluating only the columns they\n"
+        "                read; their posteriors are those of a whole run (not with\n"
+        "                -cars, -topK, -dropped, -checkpoint, -merge or -llcache)\n"
+        "    -pseudoLeaves=x  evaluate every largest subtree below the ancestor whose\n"
+        "                branches add up to less than x as a single leaf, with the\n"
+        "                adjacencies and the extremities any of its leaves has: an\n"
+        "                approximation for many close leaves (not with -ancestors or\n"
+        "                -jackknife)\n"
+        "    -pseudoCheck  evaluate the whole tree first and report how far the\n"
+        "                posteriors of -pseudoLeaves are from its own (on stderr and\n"
+        "                in -stats; not with -alphas, -checkpoint, -merge or -llcache)\n"
 	);
 }
 
 static struct optionSpec options[] = {
 	{"oj", OPTION_BOOLEAN},
+	{"threads", OPTION_INT},
+	{"numa", OPTION_BOOLEAN},
+	{"binary", OPTION_BOOLEAN},
+	{"ancestors", OPTION_STRING},
+	{"alphas", OPTION_STRING},
+	{"scores", OPTION_STRING},
+	{"cars", OPTION_BOOLEAN},
+	{"checkpoint", OPTION_STRING},
+	{"checkpointSec", OPTION_INT},
+	{"resume", OPTION_BOOLEAN},
+	{"part", OPTION_STRING},
+	{"merge", OPTION_STRING},
+	{"llcache", OPTION_STRING},
+	{"jackknife", OPTION_BOOLEAN},
+	{"stats", OPTION_STRING},
+	{"memLimit", OPTION_STRING},
+	{"counters", OPTION_BOOLEAN},
+	{"coarse", OPTION_STRING},
+	{"epsilon", OPTION_DOUBLE},
+	{"minProb", OPTION_DOUBLE},
+	{"topK", OPTION_INT},
+	{"dropped", OPTION_STRING},
+	{"noSuperBlocks", OPTION_BOOLEAN},
+	{"cacheTile", OPTION_STRING},
+	{"blocks", OPTION_STRING},
+	{"pseudoLeaves", OPTION_DOUBLE},
+	{"pseudoCheck", OPTION_BOOLEAN},
 	{NULL, 0},
 };
+#endif
 
-static boolean isSepSymbol(char ch) {
-	if (ch == ',' || ch == '(' || ch == ')' || ch == ';' || ch == ':')
-		return TRUE;
-	return FALSE;
+static void phaseBegin(struct phaseClock *c) {
+	struct timeval tv;
+	struct rusage ru;
+	gettimeofday(&tv, NULL);
+	getrusage(RUSAGE_SELF, &ru);
+	c->wall = tv.tv_sec + tv.tv_usec / 1e6;
+	c->cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+		+ ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+	c->rssKb = ru.ru_maxrss;
+}
+
+static void phaseEnd(int phase, struct phaseClock *start) {
+	struct phaseClock now;
+	phaseBegin(&now);
+	Stats[phase].wall += now.wall - start->wall;
+	Stats[phase].cpu += now.cpu - start->cpu;
+	Stats[phase].rssKb += now.rssKb - start->rssKb;
+	Stats[phase].calls++;
+	trace_memory_report(PhaseName[phase]);
+}
+
+#if defined(DESCHRAMBLER_TRACE) && !defined(NO_MAIN)
+// the kent allocations (needMem, AllocVar, ...), counted by the category
+// of trace.h of the thread
+static void *countedAlloc(size_t size) {
+	void *p = malloc(size);
+	if (p != NULL)
+		MEM_COUNT(size);
+	return p;
+}
+
+static void *countedRealloc(void *vpt, size_t size) {
+	size_t old = vpt != NULL ? malloc_usable_size(vpt) : 0;
+	void *p = realloc(vpt, size);
+	if (p != NULL)
+		MEM_COUNT(size > old ? size - old : 0);
+	return p;
 }
 
+static struct memHandler CountedMem = {NULL, countedAlloc, free, countedRealloc};
+#endif
+
 static void allocTreeNode(struct phyloTree **node, struct phyloTree **last) {
 	struct phyloTree *p;
 	AllocVar(*node);
 	p = *node;
 	p->child[LEFT] = p->child[RIGHT] = p->parent = p->next = NULL;
 	p->chromNum = 0;
+	p->id = NodeNum++;
 	p->name = NULL;
 	p->genome = NULL;
 	if (last) {
@@ -138,108 +476,135 @@ static boolean isLeaf(struct phyloTree *node) {
 	return FALSE;
 }
 
-static struct phyloTree *readTreeString(char *treeString) {
-	struct phyloTree *last = NULL, *p = NULL, *q;
-	struct phyloTree *stack[STACKSZ];
-	char buf[500];
-	char *pt;
-	int i, top = 0, count = 0;
-	double dcap = 0;
-	
-  eraseWhiteSpace(treeString);
-	pt = treeString;
-	while (*pt != '\0' && *pt != ';') {
-		if (!isSepSymbol(*pt)) {
-			allocTreeNode(&p, &last);
-			for (i = 0; !isSepSymbol(*pt); pt++)
-				buf[i++] = *pt;
-			buf[i] = 0;
-			if (i == 0) 
-				sprintf(buf, "IN%d", ++count);
-			p->name = cloneString(buf);
-		}
-		switch (*pt) {
-			case ':': {
-				pt++;
-				if (sscanf(pt, "%lf", &dcap) != 1)
-					errAbort("# cannot parse %s", pt);
-				while (!isSepSymbol(*pt))
-					pt++;
-				break;
-			}
-			case '(': {
-				allocTreeNode(&p, &last);
-				if (top + 1 > STACKSZ)
-					errAbort("# stack overflow %d", STACKSZ);
-				stack[top++] = p;
-				pt++;
-				break;
-			}
-			case ',': {
-				q = stack[top-1];
-				q->child[LEFT] = p;
-				p->parent = q;
-				p->distalpha = dcap*alpha;
-				pt++;
-				break;
-			}
-			case ')': {
-				q = stack[--top];
-				q->child[RIGHT] = p;
-				p->parent = q;
-				p->distalpha = dcap*alpha;
-				pt++;	
-				if (*pt == '@') {
-					Ances = q;
-					++pt;
-				}
-				for (i = 0; !isSepSymbol(*pt); pt++) 
-					buf[i++] = *pt;
-				buf[i] = 0;
-				if (i == 0) 
-					sprintf(buf, "IN%d", ++count);
-				q->name = cloneString(buf); 
-				p = q;
-				break;
-			}
-			case ';':
-				break;
-			default:
-				errAbort("# illegal symbol %c : %s", *pt, treeString );
+// the tree of the newick parser (makeBlocks/newick.h), node for node in
+// the same ids; the '@' node, or the root, is the ancestor
+static struct phyloTree *convertTree(struct newick_tree *t) {
+	struct phyloTree **node, *p;
+	struct newick_node *n;
+	int i;
+
+	AllocArray(node, t->nnode);
+	for (i = 0; i < t->nnode; i++) {
+		n = t->node[i];
+		if (n->nchild != 0 && n->nchild != 2)
+			errAbort("# node %s has %d children; the tree must be binary", n->name, n->nchild);
+		allocTreeNode(&node[i], NULL);
+		p = node[i];
+		p->name = cloneString(n->name);
+		p->dist = n->dist;
+		p->distalpha = n->dist*alpha;
+		if (n->parent) {
+			p->parent = node[n->parent->id];
+			p->parent->child[n == n->parent->child[0] ? LEFT : RIGHT] = p;
 		}
 	}
-	if (Ances == NULL)
-		Ances = p;
-	if (top != 0)
-		errAbort("# unbalanced tree %s", treeString);
+	p = node[t->root->id];
+	Ances = node[t->marked ? t->marked->id : t->root->id];
+	freeMem(node);
 	adjustNextInTree(p);
 	return p;
 }
 
-static struct phyloTree *readTreeFile(char *treeFile) {
-	struct phyloTree *root = NULL;
-  struct lineFile *lf = lineFileOpen(treeFile, TRUE);
-	char *str;
-	int len;
-	if (lineFileNext(lf, &str, &len) && len > 0)
-		root = readTreeString(str);
-	lineFileClose(&lf);
+// the tree of treeFile, or of the newick text treeText if that is not NULL
+static struct phyloTree *readTree(char *treeFile, const char *treeText) {
+	struct newick_tree *t;
+	struct phyloTree *root;
+	char err[512];
+
+	if (treeText != NULL)
+		t = newick_parse(treeText, err, sizeof(err));
+	else
+		t = newick_read(treeFile, err, sizeof(err));
+	if (t == NULL)
+		errAbort("# %s: %s", treeText ? "tree" : treeFile, err);
+	root = convertTree(t);
+	newick_free(t);
 	return root;
 }
 
-static void initLeafList(struct phyloTree *tree) {
+static struct nodeList *newLeafEntry(struct phyloTree *tr, boolean outgroup) {
 	struct nodeList *nl;
+	AllocVar(nl);
+	nl->addr = tr;
+	nl->outgroup = outgroup;
+	slAddHead(&Leaf, nl);
+	return nl;
+}
+
+static boolean isBelow(struct phyloTree *node, struct phyloTree *anc) {
+	for (; node; node = node->parent)
+		if (node == anc)
+			return TRUE;
+	return FALSE;
+}
+
+// one entry per leaf, or in multi-ancestor mode one per view the targets
+// need: a leaf below some target uses its genome, a leaf outside some
+// target its joins, and a leaf that is both gets two entries
+static void initLeafList(struct phyloTree *tree) {
 	struct phyloTree *tr;
+	boolean below, outside;
+	int t;
 	for (tr = tree; tr; tr = tr->next) {
-		if (isLeaf(tr)) {
-			AllocVar(nl);
-			nl->addr = tr;
-			slAddHead(&Leaf, nl);
+		if (!isLeaf(tr))
+			continue;
+		if (TargetNum == 0) {
+			tr->data[VIEW_IN] = tr->data[VIEW_OUT] = newLeafEntry(tr, tr->outgroup);
+			continue;
+		}
+		below = outside = FALSE;
+		for (t = 0; t < TargetNum; t++) {
+			if (isBelow(tr, Targets[t]))
+				below = TRUE;
+			else
+				outside = TRUE;
 		}
+		tr->outgroup = !below;
+		if (below)
+			tr->data[VIEW_IN] = newLeafEntry(tr, FALSE);
+		if (outside)
+			tr->data[VIEW_OUT] = newLeafEntry(tr, TRUE);
 	}
 	slReverse(&Leaf);
 }
 
+static void addTarget(struct phyloTree *tr) {
+	if (tr->onPath)
+		return;
+	Targets[TargetNum++] = tr;
+	tr->onPath = TRUE;
+}
+
+// parse the -ancestors list; 'all' selects every internal node
+static void findTargets(char *list) {
+	struct phyloTree *tr;
+	char *names = cloneString(list), *name, *pt;
+	int t;
+
+	AllocArray(Targets, NodeNum);
+	for (name = names; name; name = pt) {
+		if ((pt = strchr(name, ',')) != NULL)
+			*pt++ = '\0';
+		for (tr = Phylo; tr; tr = tr->next) {
+			if (isLeaf(tr))
+				continue;
+			if (sameString(name, "all"))
+				addTarget(tr);
+			else if (sameString(name, tr->name))
+				break;
+		}
+		if (!sameString(name, "all")) {
+			if (tr == NULL)
+				errAbort("# no internal node %s in the tree", name);
+			addTarget(tr);
+		}
+	}
+	freeMem(names);
+	for (t = 0; t < TargetNum; t++)
+		for (tr = Targets[t]->parent; tr; tr = tr->parent)
+			tr->onPath = TRUE;
+}
+
 static void identifyOutgroup(struct phyloTree *tree) {
 	struct phyloTree *tr, *tt;
 	for (tr = tree; tr; tr = tr->next) {
@@ -259,90 +624,120 @@ static void identifyOutgroup(struct phyloTree *tree) {
 	}
 }
 
+// number of blocks on a chromosome line, up to the closing '$'
 static int countAtomInChromString(char *chromString) {
-  int i = 0;
-	char *tt, *pt, *orgStr;
-	pt = orgStr = cloneString(chromString);
-	while ((tt = nextWord(&pt)) && *tt != '$')
-		++i;
-	freeMem(orgStr);
-	return i;
+	int n = 0;
+	char *pt = chromString;
+	for (;;) {
+		while (isspace(*pt))
+			++pt;
+		if (*pt == '\0' || *pt == '$')
+			break;
+		++n;
+		while (*pt != '\0' && !isspace(*pt))
+			++pt;
+	}
+	return n;
 }
 
-static struct chromList *readChromString(char *chromString) {
-	char *pt, *tt;
-	int elementNum, i;
-	struct chromList *chrom = NULL;
-	
-	elementNum = countAtomInChromString(chromString);
-	if (elementNum == 0)
+static struct chromList *readChromString(struct lm *lm, char *chromString, int type) {
+	struct chromList *chrom;
+	char *pt = chromString;
+	int i, n, *order;
+
+	if ((n = countAtomInChromString(chromString)) == 0)
 		return NULL;
-	AllocVar(chrom);
-	chrom->eleNum = elementNum;
-	AllocArray(chrom->eleOrder, chrom->eleNum);
-	i = 0;
-	pt = chromString;
-	while ((tt = nextWord(&pt))) {
-		if (*tt == '$') 
-			break;
-		chrom->eleOrder[i] = atoi(tt);
-		++i;
-	}
+	lmAllocVar(lm, chrom);
+	chrom->eleNum = n;
+	chrom->type = type;
+	lmAllocArray(lm, order, n);
+	for (i = 0; i < n; i++)
+		order[i] = strtol(pt, &pt, 10);
+	chrom->eleOrder = order;
 	return chrom;
 }
 
-static struct chromList *readLeafGenomes(char *fileName, char *genomeName) {
-  struct chromList *genome = NULL, *chrom;
-	struct lineFile *fp;
-	char *str;
-	char buf[500];
-	int chromNum = 0, i;
-	boolean found = FALSE;
-	int gtype = CHR;
-fprintf(stderr, "readLeafGenomes: %s\n", genomeName);	
-	fp = lineFileOpen(fileName, TRUE);
-	while (lineFileNext(fp, &str, NULL)) {
-		if (str[0] == '>') {
-			if (sscanf(str, ">%s %d", buf, &(chromNum)) != 2)
-				errAbort("# cannot parse %s", str);
-			if (sameString(buf, genomeName)) {
-				found = TRUE;
-				for (i = 0; i < chromNum; i++) {
-					if (!(lineFileNext(fp, &str, NULL)))
-						errAbort("# bad file %s", fileName);
-					if (str[0] == '#') {
-						if (sscanf(str, "# chr%s", buf) != 1)
-							gtype = NONCHR;
-						else 						
-							gtype = CHR;
-						if (!(lineFileNext(fp, &str, NULL)))
-							errAbort("# bad file %s", fileName);
-					}
-					chrom = readChromString(str);
-					chrom->type = gtype;
-					slAddHead(&genome, chrom);
-				}
-			}
+// the genomes of Genomes.db, the orders left where the file is mapped; a
+// chromosome is one (CHR) if its name is chr and more
+static void readGenomeDb(struct genome_db *db, struct hash *leafHash) {
+	struct phyloTree *cur;
+	struct chromList *chrom;
+	const char *name;
+	int g, c;
+
+	for (g = 0; g < db->ngenome; g++) {
+		if ((cur = hashRemove(leafHash, (char *)db->name[g])) == NULL)
+			continue;
+		fprintf(stderr, "readGenomes: %s\n", cur->name);
+		for (c = db->gfirst[g]; c < db->gfirst[g+1]; c++) {
+			if (db->cfirst[c] == db->cfirst[c+1])
+				continue;
+			name = db->chrom[c];
+			lmAllocVar(GenomeMem, chrom);
+			chrom->eleNum = db->cfirst[c+1] - db->cfirst[c];
+			chrom->eleOrder = (const int *)db->order + db->cfirst[c];
+			chrom->type = (startsWith("chr", name) && name[3] != '\0') ? CHR : NONCHR;
+			slAddHead(&(cur->genome), chrom);
 		}
-		if (found)
-			break;
 	}
-	if (!found)
-		errAbort("# no genome for %s", genomeName);
-	lineFileClose(&fp);
-	slReverse(&genome);
-	return genome; 
 }
 
-static void readGenomes(char *genomeFile) {
-	struct phyloTree *tr;
+// read every genome section of the file in one pass, attaching each to the
+// leaf of the same name; all orders are carved out of the GenomeMem pool.
+// The file may also be a Genomes.db, and genomeText, if not NULL, the text
+// of a Genomes.Order read instead
+static void readGenomes(char *genomeFile, const char *genomeText) {
+	struct hash *leafHash = hashNew(8);
+	struct phyloTree *tr, *cur = NULL;
+	struct chromList *chrom;
+	struct lineFile *lf;
+	char *str, buf[500];
+	int chromNum = 0, gtype = CHR;
+
 	for (tr = Phylo; tr; tr = tr->next) {
 		if (isLeaf(tr)) {
 			if (tr->outgroup == TRUE && oj == TRUE) 
 				continue;
-			tr->genome = readLeafGenomes(genomeFile, tr->name);
+			hashAdd(leafHash, tr->name, tr);
+		}
+	}
+	GenomeMem = lmInit(0);
+	if (genomeText != NULL)
+		lf = lineFileOnString("genomes", TRUE, cloneString(genomeText));
+	else if ((GenomeDb = open_genome_db(genomeFile)) != NULL) {
+		readGenomeDb(GenomeDb, leafHash);
+		lf = NULL;
+	}
+	else
+		lf = lineFileOpen(genomeFile, TRUE);
+	while (lf != NULL && lineFileNext(lf, &str, NULL)) {
+		if (str[0] == '>') {
+			if (sscanf(str, ">%s %d", buf, &chromNum) != 2)
+				errAbort("# cannot parse %s", str);
+			if ((cur = hashRemove(leafHash, buf)) != NULL)
+				fprintf(stderr, "readGenomes: %s\n", cur->name);
+			gtype = CHR;
+			continue;
+		}
+		if (cur == NULL || chromNum == 0 || str[0] == '\0')
+			continue;
+		if (str[0] == '#') {
+			if (sscanf(str, "# chr%s", buf) != 1)
+				gtype = NONCHR;
+			else 						
+				gtype = CHR;
+			continue;
 		}
+		if ((chrom = readChromString(GenomeMem, str, gtype)) != NULL)
+			slAddHead(&(cur->genome), chrom);
+		--chromNum;
 	}
+	lineFileClose(&lf);
+	if (leafHash->elCount > 0)
+		errAbort("# no genome for %s", hashElListHash(leafHash)->name);
+	freeHash(&leafHash);
+	for (tr = Phylo; tr; tr = tr->next)
+		slReverse(&(tr->genome));
 }
 
 static int map(int i) {
@@ -359,431 +754,2693 @@ static int pam(int i) {
 	return (i <= T) ? i : -(i - T);
 }
 
-static unsigned char Val(unsigned char *H, int i, int j) {
-	int pos = i * N + j;
-	int a = pos / X;
-	int b = pos % X;
-	unsigned char *v = H + a;
-	return (*v >> b) & 0x1;
+// the row of a block end read as the first of an adjacency, and the
+// column of one read as the second
+static int rowOf(int x) {
+	return (x == 0) ? A : (x > 0) ? x : map(-x);
+}
+
+static int colOf(int y) {
+	return (y == 0) ? Z : (y > 0) ? y : map(-y);
+}
+
+static int findSlot(struct matrix *H, int major, int minor) {
+	int lo = H->start[major], hi = H->start[major+1] - 1, mid;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (H->idx[mid] == minor)
+			return mid;
+		if (H->idx[mid] < minor)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return -1;
+}
+
+static int leafPred(const struct nodeList *b, int j) {
+	int lo, hi, mid;
+
+	if (LEAF_SPARSE == 0 || b->predCol == NULL)
+		return b->pred[j];
+	for (lo = 0, hi = b->npred - 1; lo <= hi; ) {
+		mid = (lo + hi) / 2;
+		if (b->predCol[mid] == j)
+			return b->pred[mid];
+		if (b->predCol[mid] < j)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return -1;
+}
+
+static struct adjList *leafExtra(const struct nodeList *b, int j) {
+	return (b->extra != NULL) ? b->extra[j] : NULL;
+}
+
+static unsigned char leafThere(const struct nodeList *b, int j) {
+	return ((b->there[j >> 6] >> (j & 63)) & 1) ? YES : NO;
+}
+
+static void setThere(struct nodeList *b, int j) {
+	b->there[j >> 6] |= (uint64_t)1 << (j & 63);
 }
 
-static void Set(unsigned char *H, int i, int j, unsigned char value) {
-	unsigned char g;
-	unsigned char *v;
-	int pos, a, b;
+// a leaf genome has at most one predecessor per extremity except for
+// the extra joins of an outgroup, which go to the overflow lists. The
+// sets are built dense, and packed by packLeaf() once read
+static void addPred(struct nodeList *b, int i, int j) {
+	struct adjList *e;
+
+	if (b->pred[j] == -1)
+		b->pred[j] = i;
+	else if (b->pred[j] != i) {
+		if (b->extra == NULL)
+			AllocArray(b->extra, N);
+		for (e = b->extra[j]; e; e = e->next)
+			if (e->i == i)
+				return;
+		AllocVar(e);
+		e->i = i;
+		slAddHead(&(b->extra[j]), e);
+	}
+}
 
+// the adjacency of the signed ends i and j, as the extremities they read
+static void leafSet(struct nodeList *b, int i, int j) {
 	if (i < 0)
 		i = map(-i);
 	if (j < 0)
 		j = map(-j);
 	if (j == A)
 		j = Z;
+	addPred(b, i, j);
+}
 
-	pos = i * N + j;
-	a = pos / X;
-	b = pos % X;
-	v = H + a;
-	if (value == 1) {
-		g = 0x01 << b;
-		*v = (*v | g);
-	}
+static unsigned char leafVal(struct nodeList *b, int i, int j) {
+	struct adjList *e;
+
+	if (leafPred(b, j) == i)
+		return YES;
+	for (e = leafExtra(b, j); e; e = e->next)
+		if (e->i == i)
+			return YES;
+	return NO;
+}
+
+static void updatePS(struct nodeList *b, int i, int j) {
+	if (j < 0)
+		j = map(-j);
+	if (i < 0)
+		i = map(-i);
+	if (i == A) 
+		setThere(b, j);
+	else if (j == Z) 
+		setThere(b, map(i));
 	else {
-		g = 0x01 << b;
-		g = HI - g;
-		*v = (*v & g);
+		setThere(b, j);
+		setThere(b, map(i));
 	}
 }
 
-static double PVal(struct matrix *H, int i, int j) {
-	struct matrix *pt;
-	
-	for (pt = H+j; pt; pt = pt->next)
-		if (pt->x == i)
-			break;
-	if (pt)
-		return pt->val;
-	else 
-		return 0;
+static void newLeafSets(struct nodeList *b) {
+	int i;
+
+	AllocArray(b->pred, N);
+	for (i = 0; i < N; i++)
+		b->pred[i] = -1;
+	AllocArray(b->there, (N + 63) / 64);
 }
 
-static void PSet(struct matrix *H, int i, int j, double value) {
-	struct matrix *pt, *lst;
-	
-	if (i < 0)
-		i = map(-i);
-	if (j < 0)
-		j = map(-j);
-	if (j == A)
-		j = Z;
+// keep the predecessors of a leaf that has few sparse
+static void packLeaf(struct nodeList *b) {
+	int j, n = 0;
 
-	for (pt = lst = H+j; pt; ) {
-		if (pt->x == i)
-			break;
-		else {
-			lst = pt;
-			pt = pt->next;
+	for (j = 0; j < N; j++)
+		n += (b->pred[j] != -1);
+	if (LEAF_SPARSE == 0 || n >= LEAF_SPARSE * N)
+		return;
+	b->npred = n;
+	AllocArray(b->predCol, n + 1);
+	for (n = j = 0; j < N; j++)
+		if (b->pred[j] != -1) {
+			b->predCol[n] = j;
+			b->pred[n++] = b->pred[j];
 		}
+	b->pred = needMoreMem(b->pred, N * sizeof(int), (n + 1) * sizeof(int));
+}
+
+// the bytes the adjacencies of a leaf take
+static double leafBytes(struct nodeList *b) {
+	double n = (b->predCol != NULL) ? 2.0 * (b->npred + 1) * sizeof(int) : (double)N * sizeof(int);
+
+	if (b->extra != NULL)
+		n += (double)N * sizeof(struct adjList *);
+	return n + (N + 63) / 64 * sizeof(uint64_t);
+}
+
+static void freeLeafSets(struct nodeList *b) {
+	int i;
+
+	freeMem(b->pred);
+	freeMem(b->predCol);
+	for (i = 0; i < N && b->extra != NULL; i++)
+		slFreeList(&(b->extra[i]));
+	freeMem(b->extra);
+	freeMem(b->there);
+}
+
+static boolean sameExtra(const struct nodeList *a, const struct nodeList *b) {
+	struct adjList *e, *f;
+	int j;
+
+	if (a->extra == NULL || b->extra == NULL)
+		return a->extra == b->extra;
+	for (j = 0; j < N; j++) {
+		for (e = a->extra[j], f = b->extra[j]; e && f && e->i == f->i; e = e->next, f = f->next)
+			;
+		if (e != NULL || f != NULL)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static boolean sameSets(const struct nodeList *a, const struct nodeList *b) {
+	int np = (a->predCol != NULL) ? a->npred : N;
+
+	return (a->predCol == NULL) == (b->predCol == NULL) && a->npred == b->npred
+		&& memcmp(a->there, b->there, (N + 63) / 64 * sizeof(uint64_t)) == 0
+		&& memcmp(a->pred, b->pred, np * sizeof(int)) == 0
+		&& (a->predCol == NULL || memcmp(a->predCol, b->predCol, np * sizeof(int)) == 0)
+		&& sameExtra(a, b);
+}
+
+// a leaf with the sets of an earlier one drops its own for that one's
+static void shareLeaf(struct nodeList *leaves, struct nodeList *b) {
+	struct nodeList *c;
+
+	for (c = leaves; c != b; c = c->next) {
+		if (c->same != NULL || c->pred == NULL || !sameSets(c, b))
+			continue;
+		fprintf(stderr, "%s has the adjacencies of %s\n", b->addr->name, c->addr->name);
+		freeLeafSets(b);
+		b->pred = c->pred;
+		b->predCol = c->predCol;
+		b->extra = c->extra;
+		b->there = c->there;
+		b->same = c;
+		return;
 	}
-	if (pt == NULL) {
-		AllocVar(pt);
-		pt->next = NULL;
-		lst->next = pt;
-		pt->x = i;
-		pt->val = value;
+}
+
+// the adjacency x y of a leaf, 0 a chromosome end, in both readings
+static void leafAdj(struct nodeList *b, int x, int y) {
+	if (x == 0 && y != 0) {
+		leafSet(b, A, y);
+		leafSet(b, -y, Z);
+		updatePS(b, A, y);
+	} else if (x != 0 && y == 0) {
+		leafSet(b, x, Z);
+		leafSet(b, A, -x);
+		updatePS(b, x, Z);
+	} else if (x != 0 && y != 0) {
+		leafSet(b, x, y);
+		leafSet(b, -y, -x);
+		updatePS(b, x, y);
 	}
-	else 
-		pt->val = value;
 }
 
-static double SVal(struct matrix *H, int i, int j) {
-	struct matrix *pt;
-	
-  for (pt = H+i; pt; pt = pt->next)
-		if (pt->x == j)
-			break;
-	if (pt)
-		return pt->val;
+static FILE *openJoins(struct phyloTree *node) {
+	char tmp[PATH_LEN];
+
+	if (JoinsDir != NULL)
+		safef(tmp, sizeof(tmp), "%s/%s.joins", JoinsDir, node->name);
 	else
-		return 0;
+		safef(tmp, sizeof(tmp), "%s.joins", node->name);
+	return mustOpen(tmp, "r");
 }
 
-static void SSet(struct matrix *H, int i, int j, double value) {
-	struct matrix *pt, *lst;
+// the next line x y of a .joins file, FALSE at its end
+static boolean nextJoin(FILE *fp, int *x, int *y) {
+	char buf[500];
 
-	if (i < 0)
-		i = map(-i);
-	if (j < 0)
-		j = map(-j);
-	if (j == A)
-		j = Z;
-	
-	for (pt = lst = H+i; pt; ) {
-		if (pt->x == j)
-			break;
-		else {
-			lst = pt;
-			pt = pt->next;
-		}
+	while (fgets(buf, 500, fp)) {
+		if (buf[0] == '#')
+			continue;
+		if (sscanf(buf, "%d %d\n", x, y) != 2)
+			errAbort("# bad join file: %s", buf);
+		return TRUE;
 	}
-	if (pt == NULL) {
-		AllocVar(pt);
-		pt->next = NULL;
-		lst->next = pt;
-		pt->x = j;
-		pt->val = value;
+	return FALSE;
+}
+
+/* Super-blocks. An adjacency that every leaf has, and that no leaf
+ * contradicts with another at either of its block ends, is the one
+ * candidate of its column and of its row: its posterior is 1 in both
+ * readings, and the columns of the other ends do not see it. So each run
+ * of blocks such adjacencies join is evaluated as one block, which leaves
+ * 2T+2 and all that grows with it smaller where most neighbouring blocks
+ * are conserved, and the run is written back with its adjacencies at
+ * posterior 1. The super-blocks are numbered in the order of their
+ * smallest block, read forward there; as the blocks of a run follow each
+ * other on the reference, whose order numbers them, the candidates of
+ * every column keep their order and the posteriors come out the same to
+ * the bit. A run that closes a circle keeps the adjacency that closes it
+ * as a candidate. */
+struct endTally {
+	int *partner;	// of each end: the end joined to it, -1 none yet, -2 several
+	int *leaves;	// how many leaves join it
+	int *last;	// the last of those
+};
+
+static void tallyEnd(struct endTally *t, int e, int f, int leaf) {
+	if (e == Z)
+		return;
+	if (t->partner[e] == -1)
+		t->partner[e] = f;
+	else if (t->partner[e] != f)
+		t->partner[e] = -2;
+	if (t->last[e] != leaf) {
+		t->last[e] = leaf;
+		t->leaves[e]++;
 	}
-	else 
-		pt->val = value;
 }
 
-static void updatePS(struct nodeList *b, int i, int j) {
-	if (j < 0)
-		j = map(-j);
-	if (i < 0)
-		i = map(-i);
-	if (i == A) 
-		b->there[j] = YES;
-	else if (j == Z) 
-		b->there[map(i)] = YES;
-	else 
-		b->there[j] = b->there[map(i)] = YES;
+static void tallyAdj(struct endTally *t, int x, int y, int leaf) {
+	if (x == 0 && y == 0)
+		return;
+	tallyEnd(t, colOf(-x), colOf(y), leaf);
+	tallyEnd(t, colOf(y), colOf(-x), leaf);
+}
+
+// the end all n leaves join to end e, and nothing else to either; -1 if none
+static int fixedPartner(struct endTally *t, int e, int n) {
+	int f = t->partner[e];
+
+	if (f < 0 || f == Z || f == e || t->leaves[e] != n || t->partner[f] != e || t->leaves[f] != n)
+		return -1;
+	return f;
 }
-																												
+
+// the end of the blocks walked from x's left or right end, x if none
+static int runNext(int *fixed, int x, boolean right) {
+	int f = fixed[right ? colOf(-x) : colOf(x)];
+
+	if (f == -1)
+		return x;
+	return right ? pam(f) : -pam(f);
+}
+
+/* signed block x as the super-block it is in, read the same way, if x is
+ * the one it starts with (or ends with, if last) in that reading; 0 if
+ * that end of x is inside it */
+static int collapsedEnd(int x, boolean last) {
+	int s, sign, first, end;
+
+	if (SuperOf == NULL || x == 0)
+		return x;
+	s = SuperOf[abs(x)];
+	sign = ((x > 0) == (s > 0)) ? 1 : -1;
+	s = abs(s);
+	first = SuperPath[SuperStart[s]];
+	end = SuperPath[SuperStart[s+1] - 1];
+	return (sign * x == ((last == (sign > 0)) ? end : first)) ? sign * s : 0;
+}
+
+// the block of the input that starts (or ends, if last) super-block s
+static int blockEnd(int s, boolean last) {
+	int first, end;
+
+	if (SuperPath == NULL || s == 0)
+		return s;
+	first = SuperPath[SuperStart[abs(s)]];
+	end = SuperPath[SuperStart[abs(s)+1] - 1];
+	if (s > 0)
+		return last ? end : first;
+	return -(last ? first : end);
+}
+
+// the chromosomes of every genome as super-blocks
+static void collapseGenomes() {
+	struct phyloTree *tr;
+	struct chromList *ch;
+	int i, n, s, *order;
+
+	for (tr = Phylo; tr; tr = tr->next)
+		for (ch = tr->genome; ch; ch = ch->next) {
+			lmAllocArray(GenomeMem, order, ch->eleNum);
+			for (n = i = 0; i < ch->eleNum; i++)
+				if ((s = collapsedEnd(ch->eleOrder[i], FALSE)) != 0)
+					order[n++] = s;
+			ch->eleOrder = order;
+			ch->eleNum = n;
+		}
+}
+
+// the super-blocks of the leaves, T their number from now on
+static void findSuperBlocks(struct nodeList *leaves) {
+	struct endTally t;
+	struct nodeList *b;
+	struct chromList *ch;
+	FILE *fp;
+	int *fixed, e, i, n = 0, s, x, y, first;
+
+	Z = 2 * T + 1;
+	N = Z + 1;
+	AllocArray(t.partner, N);
+	AllocArray(t.leaves, N);
+	AllocArray(t.last, N);
+	for (e = 0; e < N; e++)
+		t.partner[e] = -1;
+	for (b = leaves; b; b = b->next) {
+		n++;
+		if (b->outgroup && oj) {
+			fp = openJoins(b->addr);
+			while (nextJoin(fp, &x, &y))
+				tallyAdj(&t, x, y, n);
+			fclose(fp);
+			continue;
+		}
+		for (ch = b->addr->genome; ch; ch = ch->next) {
+			tallyAdj(&t, 0, ch->eleOrder[0], n);
+			for (i = 1; i < ch->eleNum; i++)
+				tallyAdj(&t, ch->eleOrder[i-1], ch->eleOrder[i], n);
+			tallyAdj(&t, ch->eleOrder[ch->eleNum-1], 0, n);
+		}
+	}
+	AllocArray(fixed, N);
+	for (e = 0; e < N; e++)
+		fixed[e] = (e == A || e == Z) ? -1 : fixedPartner(&t, e, n);
+	freeMem(t.partner);
+	freeMem(t.leaves);
+	freeMem(t.last);
+
+	AllocArray(SuperOf, T+1);
+	AllocArray(SuperPath, T+1);
+	AllocArray(SuperStart, T+2);
+	for (n = s = 0, x = 1; x <= T; x++) {
+		if (SuperOf[x] != 0)
+			continue;
+		// back to the start of the run, or once round a circle
+		for (first = x; (y = runNext(fixed, first, FALSE)) != first && abs(y) != x; first = y)
+			;
+		SuperStart[++s] = n;
+		for (y = first; ; y = e) {
+			SuperPath[n++] = y;
+			SuperOf[abs(y)] = (y > 0) ? s : -s;
+			if ((e = runNext(fixed, y, TRUE)) == y || abs(e) == abs(first))
+				break;
+		}
+	}
+	SuperStart[s+1] = n;
+	freeMem(fixed);
+	if (s == T) {
+		freez(&SuperOf);
+		freez(&SuperPath);
+		freez(&SuperStart);
+		return;
+	}
+	fprintf(stderr, "Evaluating %d blocks as %d super-blocks\n", T, s);
+	collapseGenomes();
+	T = s;
+}
+
 static void initSets(struct nodeList *leaves) {
 	struct nodeList *b;
 	struct phyloTree *node;
 	int i, x, y;
 	struct chromList *ch;
-	char tmp[50], buf[500];
 	FILE *fp;
 	
 	Z = 2 * T + 1;
 	N = Z + 1;
 	
-	AllocArray(DPPI, N*N/X+1);
-	AllocArray(DSPI, N*N/X+1);
-  for (b = leaves; b; b = b->next) {
-		AllocArray(b->P, N*N/X+1);
-		AllocArray(b->S, N*N/X+1);
-		AllocArray(b->there, N);
-	}
-	
-	AllocArray(G, N*N/X+1);
-	AllocArray(PLH, N);
-	AllocArray(SLH, N);
-	AllocArray(PPP, N);
-	AllocArray(SPP, N);
-	
 	for (b = leaves; b; b = b->next) {
 		node = b->addr;
-		if (node->outgroup && oj)
+		if (b->outgroup && oj)
 			continue;
-		ch = node->genome;
+		newLeafSets(b);
 		fprintf(stderr, "Initializing %s (ingroup)\n", node->name);
 		for (ch = node->genome; ch; ch = ch->next) {
-			i = 0;
-			Set(b->P, A, ch->eleOrder[i], YES);
-			Set(b->P, -ch->eleOrder[i], Z, YES);
-			Set(DPPI, A, ch->eleOrder[i], YES);
-			Set(DPPI, -ch->eleOrder[i], Z, YES);
-			updatePS(b, A, ch->eleOrder[i]);
-			for (++i; i < ch->eleNum; ++i) {
-				Set(b->P, ch->eleOrder[i-1], ch->eleOrder[i], YES);
-				Set(b->P, -ch->eleOrder[i], -ch->eleOrder[i-1], YES);
-				Set(DPPI, ch->eleOrder[i-1], ch->eleOrder[i], YES);
-				Set(DPPI, -ch->eleOrder[i], -ch->eleOrder[i-1], YES);
-				updatePS(b, ch->eleOrder[i-1], ch->eleOrder[i]);
-			}
-			Set(b->P, ch->eleOrder[i-1], Z, YES);
-			Set(b->P, A, -ch->eleOrder[i-1], YES);
-			Set(DPPI, ch->eleOrder[i-1], Z, YES);
-			Set(DPPI, A, -ch->eleOrder[i-1], YES);
-			updatePS(b, ch->eleOrder[i-1], Z);
+			leafAdj(b, 0, ch->eleOrder[0]);
+			for (i = 1; i < ch->eleNum; ++i)
+				leafAdj(b, ch->eleOrder[i-1], ch->eleOrder[i]);
+			leafAdj(b, ch->eleOrder[i-1], 0);
 		}
+		packLeaf(b);
+		shareLeaf(leaves, b);
 	}
 
 	if (oj) {
 		for (b = leaves; b; b = b->next) {
 			node = b->addr;
-			ch = node->genome;
-			if (!node->outgroup)
+			if (!b->outgroup)
 				continue;
 			fprintf(stderr, "Initializing %s (outgroup)\n", node->name);
-			sprintf(tmp, "%s.joins", node->name);
-			fp = mustOpen(tmp, "r");
-			while(fgets(buf, 500, fp)) {
-				if (buf[0] == '#')
+			newLeafSets(b);
+			fp = openJoins(node);
+			while (nextJoin(fp, &x, &y)) {
+				// a join inside a super-block is one of its own
+				if ((x != 0 && (x = collapsedEnd(x, TRUE)) == 0)
+						|| (y != 0 && (y = collapsedEnd(y, FALSE)) == 0))
 					continue;
-				if (sscanf(buf, "%d %d\n", &x, &y) != 2)
-					errAbort("# bad join file: %s", buf);
-				if (x == 0 && y != 0) {
-					Set(b->P, A, y, YES);
-					Set(b->P, -y, Z, YES);
-					Set(DPPI, A, y, YES);
-					Set(DPPI, -y, Z, YES);
-					updatePS(b, A, y);
-				} else if (x != 0 && y == 0) {
-					Set(b->P, x, Z, YES);
-					Set(b->P, A, -x, YES);
-					Set(DPPI, x, Z, YES);
-					Set(DPPI, A, -x, YES);
-					updatePS(b, x, Z);
-				} else if (x != 0 && y != 0) {
-					Set(b->P, x, y, YES);
-					Set(b->P, -y, -x, YES);
-					Set(DPPI, x, y, YES);
-					Set(DPPI, -y, -x, YES);
-					updatePS(b, x, y);
-				}
+				leafAdj(b, x, y);
 			}
 			fclose(fp);
+			packLeaf(b);
+			shareLeaf(leaves, b);
 		} 
 	} 
 }
 
-static void freeSets(struct nodeList *leaves) {
-	struct nodeList *b;
-	freeMem(DPPI);
-	freeMem(DSPI);
-  for (b = leaves; b; b = b->next) {
-		freeMem(b->P);
-		freeMem(b->S);
-		freeMem(b->there);
+static int cmpInt(const void *va, const void *vb) {
+	const int *a = va, *b = vb;
+	return *a - *b;
+}
+
+static boolean isCandidate(int i, int j);
+static double prob(struct phyloTree *son, int i, int s);
+static int leafAdjs(struct nodeList *lf, int j);
+
+// removes the candidates marked in drop from the Pred index and returns
+// how many are left
+static int dropCandidates(unsigned char *drop) {
+	int j, k, n;
+
+	for (n = j = 0; j < N; j++) {
+		k = PredStart[j];
+		PredStart[j] = n;
+		for (; k < PredStart[j+1]; k++)
+			if (!drop[k])
+				PredIdx[n++] = PredIdx[k];
 	}
-	
-	freeMem(G);
-	freeMem(PLH);
-	freeMem(SLH);
-	freeMem(PPP);
-	freeMem(SPP);
+	PredStart[N] = n;
+	return n;
 }
 
-static double prob(struct phyloTree *son, int i, int s) {
-	double pb, ttaa;
-	double n = (double)T;
-	ttaa = son->distalpha;
-	
-	if (i == s) {
-		pb = (1/(2*n-1) + (2*n-2)/(2*n-1) * exp(-(2*n-1) * ttaa)); 
-	} else {
-		pb = (1/(2*n-1) - 1/(2*n-1) * exp(-(2*n-1) * ttaa));
-	}	
+static void setCoarse(struct lineFile *lf, int *fixed, int i, int j) {
+	if (fixed[i] != -1 && fixed[i] != j)
+		errAbort("# %s line %d: %d joined twice", lf->fileName, lf->lineIx, blockEnd(pam(i), TRUE));
+	fixed[i] = j;
+}
 
-	return pb;
+// row i goes on with another column than c in the coarser run, one the
+// finer run has as a candidate
+static boolean coarseConflict(int *fixed, int i, int c) {
+	return fixed[i] != -1 && fixed[i] != c && isCandidate(i, fixed[i]);
 }
 
-static struct nodeList *findTreeNode(char *name) {
-	struct nodeList *lf;
-	for (lf = Leaf; lf; lf = lf->next) {
-		if (sameString(lf->addr->name, name))
-			break;
-	}
-	if (lf == NULL)
-		errAbort("# no leaf %s", name);
-	return lf;
-}
-
-static double getLP(struct phyloTree* node, int i, int j) {
-    struct hash_key hkey;
-    struct hash_entry *hentry, *newentry;
-    double val;
-    
-    memset(&hkey, 0, sizeof(struct hash_key));
-    hkey.node = node;
-    hkey.i = i; 
-    hkey.j = j;
-    HASH_FIND(hh, lp_cache, &hkey, sizeof(struct hash_key), hentry);
-    if (hentry != NULL) {                                                 
-        val = hentry->value;                                              
-    } else {                                                              
-        val = prob(node, i, j);                                           
-        newentry = (struct hash_entry*)malloc(sizeof(struct hash_entry)); 
-        newentry->key.node = node;                                        
-        newentry->key.i = i;                                              
-        newentry->key.j = j;                                              
-        newentry->value = val;                                            
-        HASH_ADD(hh, lp_cache, key, sizeof(struct hash_key), newentry);     
-    }                                                                     
-                                                                          
-    return val;                                                           
-}                       
-
-static double preLikelihood(struct phyloTree *anc, int i, int j);         
-                                                                          
-static double getLL(struct phyloTree *node, int i, int j) {               
-    struct hash_key hkey;                                                 
-    struct hash_entry *hentry, *newentry;                                 
-    double val;                                                           
-                                                                          
-    memset(&hkey, 0, sizeof(struct hash_key));                            
-    hkey.node = node;                                                     
-    hkey.i = i;                                                           
-    hkey.j = j;                                                           
-    HASH_FIND(hh, ll_cache, &hkey, sizeof(struct hash_key), hentry);        
-    if (hentry != NULL) {                                                 
-        val = hentry->value;                                              
-    } else {                                                              
-        val = preLikelihood(node, i, j);                                  
-        newentry = (struct hash_entry*)malloc(sizeof(struct hash_entry));   
-        newentry->key.node = node;                                        
-        newentry->key.i = i;                                              
-        newentry->key.j = j;                                              
-        newentry->value = val;                                            
-        HASH_ADD(hh, ll_cache, key, sizeof(struct hash_key), newentry);     
-    }                                                                     
-                                                                          
-    return val;                                                           
-}                       
-
-static double preLikelihood(struct phyloTree *anc, int i, int j) {
-	int s;
-	double left, right;
-	struct nodeList *lf;
-	double val;
-    struct phyloTree *node;
-	struct chromList *ch;
+/* -coarse: the adjacencies of the coarser run fix which ends at the
+ * boundaries of its blocks go together, so a candidate between two such
+ * ends that gives either of them another partner is dropped (with its
+ * mirror), unless that would leave a column with none. Returns the
+ * candidates left. */
+static int pruneCandidates(char *fileName) {
+	struct lineFile *lf = lineFileOpen(fileName, TRUE);
+	struct matrix H = {PredStart, PredIdx, NULL};
+	char *words[2];
+	unsigned char *bound, *drop;
+	int *fixed, i, j, k, m, n, x, y, wc, total = PredStart[N];
+
+	AllocArray(fixed, N);
+	for (i = 0; i < N; i++)
+		fixed[i] = -1;
+	AllocArray(bound, N);
+	bound[A] = TRUE;
+	while ((wc = lineFileChopNext(lf, words, 2)) > 0) {
+		x = lineFileNeedNum(lf, words, 0);
+		y = (wc > 1) ? lineFileNeedNum(lf, words, 1) : 0;
+		if (x < -BlockNum || x > BlockNum || y < -BlockNum || y > BlockNum)
+			errAbort("# %s line %d: no block %d", fileName, lf->lineIx,
+				(x < -BlockNum || x > BlockNum) ? x : y);
+		// an end inside a super-block has no other candidate to drop
+		if ((x != 0 && (x = collapsedEnd(x, TRUE)) == 0)
+				|| (y != 0 && (y = collapsedEnd(y, FALSE)) == 0))
+			continue;
+		i = rowOf(x);
+		bound[i] = TRUE;
+		if (wc == 1)
+			continue;
+		j = colOf(y);
+		bound[map(j)] = TRUE;
+		// a chromosome end goes with many
+		if (i != A)
+			setCoarse(lf, fixed, i, j);
+		if (j != Z)
+			setCoarse(lf, fixed, map(j), map(i));
+	}
+	lineFileClose(&lf);
+
+	AllocArray(drop, total+1);
+	for (j = 0; j < N; j++)
+		for (k = PredStart[j]; k < PredStart[j+1]; k++) {
+			i = PredIdx[k];
+			drop[k] = bound[i] && bound[map(j)]
+				&& (coarseConflict(fixed, i, j) || coarseConflict(fixed, map(j), map(i)));
+		}
+	for (j = 0; j < N; j++) {
+		for (m = 0, k = PredStart[j]; k < PredStart[j+1]; k++)
+			m += drop[k];
+		if (m == 0 || m < PredStart[j+1] - PredStart[j])
+			continue;
+		for (k = PredStart[j]; k < PredStart[j+1]; k++)
+			drop[k] = drop[findSlot(&H, map(PredIdx[k]), map(j))] = FALSE;
+	}
+	n = dropCandidates(drop);
+	Pruned = total - n;
+	fprintf(stderr, "Dropped %d of %d candidates against %s\n", Pruned, total, fileName);
+	freeMem(drop);
+	freeMem(bound);
+	freeMem(fixed);
+	return n;
+}
+
+// the leaf adjacencies -coarse dropped are no data on their columns, as
+// the likelihoods take every leaf adjacency for a candidate. A leaf sharing
+// the sets of another is pruned with it; a packed one keeps its slots, at
+// -1 where nothing is left
+static void pruneLeaves(struct nodeList *leaves) {
+	struct nodeList *b;
+	struct adjList *e, *next, *kept;
+	int j, k, np, *pred;
+
+	for (b = leaves; b; b = b->next) {
+		if (b->same != NULL || b->pred == NULL)
+			continue;
+		np = (b->predCol != NULL) ? b->npred : N;
+		for (k = 0; k < np; k++) {
+			j = (b->predCol != NULL) ? b->predCol[k] : k;
+			pred = &b->pred[k];
+			if (*pred == -1)
+				continue;
+			if (!isCandidate(*pred, j))
+				*pred = -1;
+			for (kept = NULL, e = leafExtra(b, j); e; e = next) {
+				next = e->next;
+				if (!isCandidate(e->i, j))
+					freeMem(e);
+				else if (*pred == -1) {
+					*pred = e->i;
+					freeMem(e);
+				} else
+					slAddHead(&kept, e);
+			}
+			slReverse(&kept);
+			if (b->extra != NULL)
+				b->extra[j] = kept;
+			if (*pred == -1)
+				b->there[j >> 6] &= ~((uint64_t)1 << (j & 63));
+		}
+	}
+}
+
+/* -epsilon: an upper bound on the PPP of every candidate, cheaper than
+ * the likelihoods. The rows are taken normalised, a(v, s) = LL(v, s, j) /
+ * sum over s' of LL(v, s', j), so that a(Ances, s) is the PPP, and
+ *   a(v, s) = prod over children c of (p_c + d_c a(c, s)) / D(v)
+ * with p_c = pdiff, d_c = psame - pdiff of the branch above c and D(v)
+ * the same product summed over the n candidates. For one child D(v) is
+ * n p + d; for two it is n p1 p2 + p1 d2 + p2 d1 + d1 d2 X with X the sum
+ * over s' of a(c1, s') a(c2, s'), which lies between a(c1, t) a(c2, t)
+ * for any t and 1. Lower bounds of a(., t) for the candidate t most leaves
+ * have (X = 1) bound X from below, and with that an upper bound of every
+ * a(., s) follows up the tree. A leaf has a = 1/m at each of its m
+ * adjacencies and 0 at the others, or 1/n without the extremity; the
+ * bound of a candidate differs from the one no leaf has only above the
+ * leaves that have it, so only those nodes are evaluated for it. est gets
+ * the bound of every Pred entry. */
+static struct phyloTree **BoundOrder = NULL;	// the nodes, children first
+static int *BoundPos = NULL;	// of each node in BoundOrder
+static int *BoundUp = NULL;	// id of the parent of each, -1 for Ances
+static int BoundLen = 0;
+
+// a rerooted tree keeps the old parents, so they are taken from the children
+static void boundOrder(struct phyloTree *node, int up) {
+	int side;
+
+	for (side = LEFT; side <= RIGHT; side++)
+		if (node->child[side] != NULL)
+			boundOrder(node->child[side], node->id);
+	BoundUp[node->id] = up;
+	BoundPos[node->id] = BoundLen;
+	BoundOrder[BoundLen++] = node;
+}
+
+// a(v, .) from the values of the children; lower bounds with x = 1
+static double boundNode(struct phyloTree *v, const double *val, double x, double n) {
+	struct phyloTree *c1 = v->child[LEFT], *c2 = v->child[RIGHT];
+	double p1, d1, p2, d2;
+
+	if (c1 == NULL || c2 == NULL) {
+		if (c1 == NULL)
+			c1 = c2;
+		p1 = c1->pdiff;
+		d1 = c1->psame - c1->pdiff;
+		return min(1, (p1 + d1 * val[c1->id]) / (n * p1 + d1));
+	}
+	p1 = c1->pdiff;
+	d1 = c1->psame - c1->pdiff;
+	p2 = c2->pdiff;
+	d2 = c2->psame - c2->pdiff;
+	return min(1, (p1 + d1 * val[c1->id]) * (p2 + d2 * val[c2->id])
+		/ (n * p1 * p2 + p1 * d2 + p2 * d1 + d1 * d2 * x));
+}
+
+static void setTransitionProbs(struct phyloTree *tree);
+
+static void estimatePosteriors(struct nodeList *leaves, double *est) {
+	struct matrix H = {PredStart, PredIdx, NULL};
+	struct phyloTree *v, *c;
+	struct nodeList *b, *lf;
+	struct adjList *e;
+	double *lo, *hi0, *hi, *xlo, n;
+	int *supStart, *supLeaf, *stamp, *path;
+	int i, j, k, p, s, t, np, len, maxLen = 0, mark = 0, total = PredStart[N];
+
+	setTransitionProbs(Phylo);
+	AllocArray(BoundOrder, NodeNum);
+	AllocArray(BoundPos, NodeNum);
+	AllocArray(BoundUp, NodeNum);
+	BoundLen = 0;
+	boundOrder(Ances, -1);
+	for (j = 0; j < N; j++)
+		maxLen = max(maxLen, PredStart[j+1] - PredStart[j]);
+	AllocArray(lo, NodeNum);
+	AllocArray(hi0, NodeNum);
+	AllocArray(hi, NodeNum);
+	AllocArray(xlo, NodeNum);
+	AllocArray(stamp, NodeNum);
+	AllocArray(path, NodeNum);
+	AllocArray(supStart, maxLen + 2);
+	AllocArray(supLeaf, slCount(leaves) * (size_t)maxLen + 1);
+	for (k = 0; k < total; k++)
+		est[k] = 1;
+	for (j = A+1; j < Z; j++) {
+		len = PredStart[j+1] - PredStart[j];
+		if (len < 2)
+			continue;
+		n = len;
+		// the leaves that have each candidate, by slot
+		memset(supStart, 0, (len + 2) * sizeof(int));
+		for (b = leaves; b; b = b->next) {
+			if ((p = leafPred(b, j)) == -1)
+				continue;
+			if ((s = findSlot(&H, j, p)) >= 0)
+				supStart[s - PredStart[j] + 2]++;
+			for (e = leafExtra(b, j); e; e = e->next)
+				if ((s = findSlot(&H, j, e->i)) >= 0)
+					supStart[s - PredStart[j] + 2]++;
+		}
+		for (s = 0; s < len; s++)
+			supStart[s+2] += supStart[s+1];
+		for (b = leaves; b; b = b->next) {
+			if ((p = leafPred(b, j)) == -1)
+				continue;
+			if ((s = findSlot(&H, j, p)) >= 0)
+				supLeaf[supStart[s - PredStart[j] + 1]++] = b->addr->id;
+			for (e = leafExtra(b, j); e; e = e->next)
+				if ((s = findSlot(&H, j, e->i)) >= 0)
+					supLeaf[supStart[s - PredStart[j] + 1]++] = b->addr->id;
+		}
+		for (t = 0, s = 1; s < len; s++)
+			if (supStart[s+1] - supStart[s] > supStart[t+1] - supStart[t])
+				t = s;
+
+		// lower bounds for t, and the bound of a candidate no leaf has
+		mark++;
+		for (k = supStart[t]; k < supStart[t+1]; k++)
+			stamp[supLeaf[k]] = mark;
+		for (i = 0; i < BoundLen; i++) {
+			v = BoundOrder[i];
+			if (isLeaf(v)) {
+				lf = v->data[VIEW_IN];
+				hi0[v->id] = lo[v->id] = (leafThere(lf, j) == YES) ? 0 : 1 / n;
+				if (stamp[v->id] == mark)
+					lo[v->id] = 1.0 / leafAdjs(lf, j);
+				continue;
+			}
+			lo[v->id] = boundNode(v, lo, 1, n);
+			xlo[v->id] = (v->child[LEFT] != NULL && v->child[RIGHT] != NULL)
+				? lo[v->child[LEFT]->id] * lo[v->child[RIGHT]->id] : 1;
+			hi0[v->id] = boundNode(v, hi0, xlo[v->id], n);
+		}
+
+		// each candidate over the paths from its leaves up
+		for (s = 0; s < len; s++) {
+			mark++;
+			for (np = 0, k = supStart[s]; k < supStart[s+1]; k++)
+				for (i = supLeaf[k]; i >= 0 && stamp[i] != mark; i = BoundUp[i]) {
+					stamp[i] = mark;
+					path[np++] = BoundPos[i];
+				}
+			qsort(path, np, sizeof(int), cmpInt);
+			for (i = 0; i < np; i++) {
+				v = BoundOrder[path[i]];
+				if (isLeaf(v)) {
+					hi[v->id] = 1.0 / leafAdjs(v->data[VIEW_IN], j);
+					continue;
+				}
+				// the children off the paths keep the bound of no leaf
+				for (k = LEFT; k <= RIGHT; k++)
+					if ((c = v->child[k]) != NULL && stamp[c->id] != mark)
+						hi[c->id] = hi0[c->id];
+				hi[v->id] = boundNode(v, hi, xlo[v->id], n);
+			}
+			est[PredStart[j] + s] = (np > 0) ? hi[Ances->id] : hi0[Ances->id];
+		}
+	}
+	freeMem(lo);
+	freeMem(hi0);
+	freeMem(hi);
+	freeMem(xlo);
+	freeMem(stamp);
+	freeMem(path);
+	freeMem(supStart);
+	freeMem(supLeaf);
+	freeMem(BoundOrder);
+	freeMem(BoundPos);
+	freeMem(BoundUp);
+}
+
+/* -epsilon: skips a candidate whose posterior, the product of its PPP and
+ * SPP as adjProb() takes it, is estimated below epsilon from the estimates
+ * of its column and, as its mirror, of its row (a telomere side has none
+ * and counts as the other), unless it is the best of either. The estimate
+ * is an upper bound, so nothing above epsilon is skipped. The skipped
+ * candidates go to the Skip index: a skipped candidate may hold little at
+ * the ancestor but much at the nodes above its leaves, so its likelihoods
+ * still count in the normalisers. Returns the candidates left. */
+static int boundCandidates(struct nodeList *leaves, double epsilon) {
+	struct matrix H = {PredStart, PredIdx, NULL};
+	unsigned char *drop, *best;
+	double *est, m, pe, se;
+	int i, j, k, mk, mirror, n, total = PredStart[N];
+
+	AllocArray(est, total+1);
+	estimatePosteriors(leaves, est);
+	AllocArray(best, total+1);
+	for (j = 0; j < N; j++) {
+		for (mk = -1, m = -1, k = PredStart[j]; k < PredStart[j+1]; k++)
+			if (est[k] > m) {
+				m = est[k];
+				mk = k;
+			}
+		if (mk >= 0)
+			best[mk] = TRUE;
+	}
+	AllocArray(drop, total+1);
+	for (j = 0; j < N; j++)
+		for (k = PredStart[j]; k < PredStart[j+1]; k++) {
+			i = PredIdx[k];
+			if (i == A && j == Z)
+				continue;
+			mirror = findSlot(&H, map(i), map(j));
+			pe = (j == Z) ? est[mirror] : est[k];
+			se = (i == A) ? est[k] : est[mirror];
+			drop[k] = pe * se < epsilon && !(j != Z && best[k]) && !(i != A && best[mirror]);
+		}
+	AllocArray(SkipStart, N+1);
+	AllocArray(SkipIdx, total+1);
+	for (n = j = 0; j < N; j++) {
+		SkipStart[j] = n;
+		for (k = PredStart[j]; k < PredStart[j+1]; k++)
+			if (drop[k])
+				SkipIdx[n++] = PredIdx[k];
+		MaxSkip = max(MaxSkip, n - SkipStart[j]);
+	}
+	SkipStart[N] = n;
+	n = dropCandidates(drop);
+	Bounded = total - n;
+	fprintf(stderr, "Skipped %d of %d candidates estimated below %g\n", Bounded, total, epsilon);
+	freeMem(drop);
+	freeMem(best);
+	freeMem(est);
+	return n;
+}
+
+/* index the union of all leaf adjacencies by column (Pred) and by row (Succ),
+ * each list sorted and free of duplicates. The blocks keep the ids of the
+ * reference order: a column reads only its own stretch of PLH, and the
+ * candidates of an extremity are mostly its neighbours on the reference, so
+ * the rows of SLH and of the outputs read nearby columns already. Renumbered
+ * in reverse Cuthill-McKee order of the genome adjacencies, a 200k-block run
+ * took as long in every phase, and the sums over the candidates of a column,
+ * taken in another order, moved the posteriors in their last bits. */
+static void buildCandidates(struct nodeList *leaves) {
+	struct nodeList *b;
+	struct adjList *e;
+	int i, j, k, n, end, *fill;
+
+	AllocArray(PredStart, N+1);
+	for (b = leaves; b; b = b->next) {
+		for (j = 0; j < N; j++) {
+			if (leafPred(b, j) != -1)
+				PredStart[j+1]++;
+			for (e = leafExtra(b, j); e; e = e->next)
+				PredStart[j+1]++;
+		}
+	}
+	for (j = 0; j < N; j++)
+		PredStart[j+1] += PredStart[j];
+	AllocArray(PredIdx, PredStart[N]+1);
+	AllocArray(fill, N);
+	for (b = leaves; b; b = b->next) {
+		for (j = 0; j < N; j++) {
+			if ((i = leafPred(b, j)) != -1)
+				PredIdx[PredStart[j] + fill[j]++] = i;
+			for (e = leafExtra(b, j); e; e = e->next)
+				PredIdx[PredStart[j] + fill[j]++] = e->i;
+		}
+	}
+	for (n = j = 0; j < N; j++) {
+		k = PredStart[j];
+		end = k + fill[j];
+		qsort(PredIdx+k, fill[j], sizeof(int), cmpInt);
+		PredStart[j] = n;
+		for (; k < end; k++)
+			if (n == PredStart[j] || PredIdx[k] != PredIdx[n-1])
+				PredIdx[n++] = PredIdx[k];
+	}
+	PredStart[N] = n;
+	if (CoarseFile != NULL) {
+		n = pruneCandidates(CoarseFile);
+		pruneLeaves(leaves);
+	}
+	if (Epsilon > 0)
+		n = boundCandidates(leaves, Epsilon);
+
+	AllocArray(SuccStart, N+1);
+	for (k = 0; k < n; k++)
+		SuccStart[PredIdx[k]+1]++;
+	for (i = 0; i < N; i++)
+		SuccStart[i+1] += SuccStart[i];
+	AllocArray(SuccIdx, n+1);
+	AllocArray(SuccPos, n+1);
+	memset(fill, 0, N * sizeof(int));
+	for (j = 0; j < N; j++) {
+		for (k = PredStart[j]; k < PredStart[j+1]; k++) {
+			i = PredIdx[k];
+			SuccPos[SuccStart[i] + fill[i]] = k;
+			SuccIdx[SuccStart[i] + fill[i]++] = j;
+		}
+	}
+	freeMem(fill);
+}
+
+// PLH and SLH share the candidate pattern; only PLH holds values, those of
+// SLH are read through SuccMirror
+static void initMatrices() {
+	int n = PredStart[N], i, k;
+	PLH.start = PredStart;
+	PLH.idx = PredIdx;
+	AllocArray(PLH.val, n+1);
+	SLH.start = SuccStart;
+	SLH.idx = SuccIdx;
+	SLH.val = NULL;
+	AllocArray(ColScale, N);
+	if (SkipStart != NULL)
+		AllocArray(SkipSum, N);
+	AllocArray(ColSum, N);
+	AllocArray(RowSum, N);
+	AllocArray(RowMax, N);
+	// the leaf sets hold both readings of every adjacency, so the mirror
+	// is a candidate too
+	AllocArray(SuccMirror, n+1);
+	for (i = A; i <= Z; i++)
+		for (k = SuccStart[i]; k < SuccStart[i+1]; k++)
+			if ((SuccMirror[k] = findSlot(&PLH, map(i), map(SuccIdx[k]))) < 0)
+				errAbort("# no candidate adjacency %d %d", map(SuccIdx[k]), map(i));
+}
+
+// the likelihood of the Succ entry k, of row i, and its log scale
+static double succVal(int k) {
+	return PLH.val[SuccMirror[k]];
+}
+
+static double succScale(int i) {
+	return ColScale[map(i)];
+}
+
+static boolean isCandidate(int i, int j) {
+	int lo = PredStart[j], hi = PredStart[j+1] - 1, mid;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (PredIdx[mid] == i)
+			return TRUE;
+		if (PredIdx[mid] < i)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return FALSE;
+}
+
+// the sets of likelihoods a run holds: PLH, and the PLH of every target or
+// of the tree without every leaf
+static int valueSets() {
+	return 1 + TargetNum + JackNum;
+}
+
+static size_t valuesSize() {
+	return ((size_t)PredStart[N] + 1) * sizeof(double);
+}
+
+/* -memLimit: what a run needs besides the likelihoods, from T, the leaf
+ * count, the candidate index and the rows of the threads, and the
+ * likelihoods themselves */
+static void estimateMemory(double *fixed, double *values) {
+	double n = PredStart[N] + 1, leaves = 0, rows, ctx;
+	struct nodeList *b;
+
+	rows = (TargetNum > 0 || JackNum > 0) ? NodeNum : PlanRows;
+	ctx = NodeNum * (2 * sizeof(int) + 2 * D) + rows * MaxCol * sizeof(llReal);
+	if (TargetNum > 0)
+		ctx = 2 * ctx + NodeNum * (MaxCol + 1) * D;
+	if (JackNum > 0)
+		ctx += 2 * MaxCol * sizeof(llReal);
+	for (b = Leaf; b; b = b->next)
+		if (b->same == NULL)
+			leaves += leafBytes(b);
+	*fixed = leaves
+		+ slCount(Leaf) * T * sizeof(int)
+		+ (2.0 * (N + 1) + 4 * n) * sizeof(int)
+		+ (4.0 + TargetNum + JackNum) * N * D + N
+		+ Threads * ctx
+		+ n * (sizeof(struct weightedEdge) + D);	// the records of the outputs
+	*values = valueSets() * n * D;
+}
+
+// a set of likelihoods, in a scratch file mapped shared once they do not
+// fit, so that the kernel can write finished columns out and drop them
+static double *allocValues() {
+	char name[PATH_LEN], *dir = getenv("TMPDIR");
+	double *val;
+	void *map;
+	int fd;
+
+	if (!Spill) {
+		int mem = MEM_ENTER(matrix);
+		AllocArray(val, PredStart[N] + 1);
+		MEM_LEAVE(mem);
+		return val;
+	}
+	safef(name, sizeof(name), "%s/inferAdjProb.XXXXXX", (dir && *dir) ? dir : ".");
+	if ((fd = mkstemp(name)) < 0)
+		errnoAbort("# cannot create a scratch file %s", name);
+	unlink(name);
+	if (ftruncate(fd, valuesSize()) != 0
+		|| (map = mmap(NULL, valuesSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		errnoAbort("# cannot map a scratch file of %lld bytes", (long long)valuesSize());
+	close(fd);
+	return map;
+}
+
+static void freeValues(double **val) {
+	if (*val == NULL)
+		return;
+	if (Spill)
+		munmap(*val, valuesSize());
+	else
+		freeMem(*val);
+	*val = NULL;
+}
+
+// write the columns lo .. hi-1 of a set out to its scratch file and drop
+// them from memory; they are read back when next touched
+static void releaseColumns(double *val, int lo, int hi) {
+	uintptr_t page = sysconf(_SC_PAGESIZE), beg, end;
+
+	if (val == NULL)
+		return;
+	beg = (uintptr_t)(val + PredStart[lo]) & ~(page - 1);
+	end = (uintptr_t)(val + PredStart[hi]);
+	if (end <= beg)
+		return;
+	if (msync((void *)beg, end - beg, MS_SYNC) != 0
+		|| madvise((void *)beg, end - beg, MADV_DONTNEED) != 0)
+		errnoAbort("# cannot write out a scratch file");
+}
+
+static void releaseValues(int lo, int hi) {
+	int t;
+
+	if (!Spill)
+		return;
+	releaseColumns(PLH.val, lo, hi);
+	for (t = 0; t < TargetNum && TargetPLH != NULL; t++)
+		releaseColumns(TargetPLH[t], lo, hi);
+	for (t = 0; t < JackNum && JackPLH != NULL; t++)
+		releaseColumns(JackPLH[t], lo, hi);
+}
+
+// the end of the tile of columns starting at lo: all those left unless
+// the likelihoods are spilled, else as many as the budget holds, one at least
+static int nextTile(int lo, int hi) {
+	int j = lo + 1;
+
+	if (!Spill)
+		return hi;
+	while (j < hi && (double)(PredStart[j+1] - PredStart[lo]) * valueSets() * D <= TileBytes)
+		j++;
+	return j;
+}
+
+/* size the run against -memLimit: a run that cannot fit stops now rather
+ * than hours in, one whose likelihoods do not fit keeps them in scratch
+ * files and evaluates and normalizes them a tile of columns at a time */
+static void planMemory() {
+	double fixed, values;
+	int j;
+
+	for (j = A+1; j < Z; j++)
+		MaxCol = max(MaxCol, PredStart[j+1] - PredStart[j]);
+	if (MemLimit == 0)
+		return;
+	estimateMemory(&fixed, &values);
+	fprintf(stderr, "Memory estimate: %.1f MB, and %.1f MB for %d sets of likelihoods\n",
+		fixed / (1 << 20), values / (1 << 20), valueSets());
+	if (fixed + values <= MemLimit)
+		return;
+	if ((TileBytes = MemLimit - fixed) < (double)MaxCol * valueSets() * D)
+		errAbort("# -memLimit is too small: %.1f MB are needed besides the likelihoods",
+			(fixed + (double)MaxCol * valueSets() * D) / (1 << 20));
+	Spill = TRUE;
+	freeMem(PLH.val);
+	PLH.val = allocValues();
+	fprintf(stderr, "Likelihoods kept in scratch files, in tiles of %.1f MB\n", TileBytes / (1 << 20));
+}
+
+// a size in bytes, with an optional K, M, G or T
+static double parseSize(char *s) {
+	char *end, *units = "KMGT", *u;
+	double v = strtod(s, &end);
+
+	// 1024 once for K, and once more for each unit after it
+	if (*end != '\0' && (u = strchr(units, toupper(*end))) != NULL) {
+		for (; u >= units; u--)
+			v *= 1024;
+		end++;
+	}
+	if (toupper(*end) == 'B')
+		end++;
+	if (end == s || *end != '\0' || v <= 0)
+		errAbort("# bad size %s", s);
+	return v;
+}
+
+static void freeSets(struct nodeList *leaves) {
+	struct nodeList *b;
+	freeValues(&PLH.val);	// sized by PredStart
+	freeMem(PredStart);
+	freeMem(PredIdx);
+	freeMem(SuccStart);
+	freeMem(SuccIdx);
+	freeMem(SuccPos);
+	freeMem(SuccMirror);
+  for (b = leaves; b; b = b->next)
+		if (b->same == NULL)
+			freeLeafSets(b);
 	
-	left = right = 0;
+	freeMem(ColScale);
+	freez(&SkipSum);
+	freez(&SkipStart);
+	freez(&SkipIdx);
+	MaxSkip = 0;
+	freeMem(ColSum);
+	freeMem(RowSum);
+	freeMem(RowMax);
+}
+
+static double prob(struct phyloTree *son, int i, int s) {
+	double pb, ttaa;
+	double n = (double)BlockNum;
+	ttaa = son->distalpha;
 	
-	if (isLeaf(anc)) {
-		lf = findTreeNode(anc->name);
-		node = lf->addr;
-		ch = node->genome;
-		if (lf->there[j] == YES) {
-			return Val(lf->P, i, j);
+	if (i == s) {
+		pb = (1/(2*n-1) + (2*n-2)/(2*n-1) * exp(-(2*n-1) * ttaa)); 
+	} else {
+		pb = (1/(2*n-1) - 1/(2*n-1) * exp(-(2*n-1) * ttaa));
+	}	
+
+	return pb;
+}
+
+static void initContext(struct llContext *ctx, int view) {
+	int i, mem = MEM_ENTER(ll_memo);
+	ctx->view = view;
+	ctx->cand = &PLH;
+	ctx->lazy = (Plan == NULL);
+	ctx->stride = MaxCol;
+	AllocArray(ctx->memoCol, NodeNum);
+	AllocArray(ctx->slot, NodeNum);
+	AllocArray(ctx->colSum, NodeNum);
+	AllocArray(ctx->logScale, NodeNum);
+	// -jackknife reads the rows of every node once the column is done
+	for (i = 0; i < NodeNum; i++) {
+		ctx->memoCol[i] = -1;
+		ctx->slot[i] = (ctx->lazy || JackNum > 0) ? i : PlanSlot[i];
+	}
+	AllocArray(ctx->memo, ((ctx->lazy || JackNum > 0) ? NodeNum : PlanRows) * MaxCol + 1);
+	if (JackNum > 0)
+		AllocArray(ctx->jackRow, 2 * MaxCol + 1);
+	AllocArray(ctx->leafSlot, MaxCol + 1);
+	AllocArray(ctx->leafVal, MaxCol + 1);
+	if (SkipStart != NULL) {
+		AllocArray(ctx->skipLen, (ctx->lazy ? NodeNum : PlanRows) + 1);
+		AllocArray(ctx->skipK, (ctx->lazy ? NodeNum : PlanRows) * MaxSkip + 1);
+		AllocArray(ctx->skipVal, (ctx->lazy ? NodeNum : PlanRows) * MaxSkip + 1);
+		AllocArray(ctx->skipBase, NodeNum);
+		AllocArray(ctx->skipSum, NodeNum);
+		AllocArray(ctx->skipLeaf, 2 * MaxSkip + 1);
+	}
+	if (CacheTileBytes > 0) {
+		AllocArray(ctx->tileMemo, max(CacheTileBytes / sizeof(llReal), PlanRows * MaxCol) + 1);
+		AllocArray(ctx->tileSum, CacheTileCols * NodeNum);
+		AllocArray(ctx->tileScale, CacheTileCols * NodeNum);
+	}
+	MEM_LEAVE(mem);
+}
+
+// post-order schedule; a node takes a free row before releasing those of
+// its children, which it reads while being filled. The leaves below the
+// root have no row: their parents read them with leafKernel()
+static void planNode(struct phyloTree *node, int *freeRow, int *nFree, boolean root) {
+	int side;
+	struct phyloTree *c;
+
+	if (isLeaf(node) && !root)
+		return;
+	for (side = LEFT; side <= RIGHT; side++)
+		if ((c = node->child[side]) != NULL)
+			planNode(c, freeRow, nFree, FALSE);
+	PlanSlot[node->id] = (*nFree > 0) ? freeRow[--(*nFree)] : PlanRows++;
+	for (side = LEFT; side <= RIGHT; side++)
+		if ((c = node->child[side]) != NULL && !isLeaf(c))
+			freeRow[(*nFree)++] = PlanSlot[c->id];
+	Plan[PlanLen++] = node;
+}
+
+static void compilePlan(struct phyloTree *root) {
+	int *freeRow, nFree = 0;
+
+	AllocArray(Plan, NodeNum);
+	AllocArray(PlanSlot, NodeNum);
+	AllocArray(freeRow, NodeNum);
+	planNode(root, freeRow, &nFree, TRUE);
+	freeMem(freeRow);
+	fprintf(stderr, "%d tree nodes evaluated in %d rows\n", PlanLen, PlanRows);
+}
+
+static double subtreeLen(struct phyloTree *node) {
+	double len = 0;
+	int side;
+
+	for (side = LEFT; side <= RIGHT; side++)
+		if (node->child[side] != NULL)
+			len += node->child[side]->dist + subtreeLen(node->child[side]);
+	return len;
+}
+
+static int subtreeLeaves(struct phyloTree *node) {
+	int n = 0, side;
+
+	if (isLeaf(node))
+		return 1;
+	for (side = LEFT; side <= RIGHT; side++)
+		if (node->child[side] != NULL)
+			n += subtreeLeaves(node->child[side]);
+	return n;
+}
+
+// add the sets of the leaves below node to those of p, and their names to names
+static void mergeLeaves(struct nodeList *p, struct phyloTree *node, struct dyString *names) {
+	struct nodeList *b;
+	struct adjList *e;
+	int j, side;
+
+	if (!isLeaf(node)) {
+		for (side = LEFT; side <= RIGHT; side++)
+			if (node->child[side] != NULL)
+				mergeLeaves(p, node->child[side], names);
+		return;
+	}
+	b = node->data[VIEW_IN];
+	p->outgroup = b->outgroup;
+	for (j = 0; j < N; j++) {
+		if (leafPred(b, j) != -1)
+			addPred(p, leafPred(b, j), j);
+		for (e = leafExtra(b, j); e; e = e->next)
+			addPred(p, e->i, j);
+	}
+	for (j = 0; j < (N + 63) / 64; j++)
+		p->there[j] |= b->there[j];
+	dyStringPrintf(names, "%s%s", (names->stringSize > 0) ? "," : "", node->name);
+}
+
+/* node becomes a leaf with the adjacencies any leaf below it has, and the
+ * extremities any has; all of them are on one side of the ancestor. The
+ * entries of the leaves stay in Leaf, out of the tree */
+static void collapseNode(struct phyloTree *node, double len) {
+	struct dyString *names = newDyString(256);
+	struct nodeList *p;
+
+	AllocVar(p);
+	p->addr = node;
+	newLeafSets(p);
+	mergeLeaves(p, node, names);
+	packLeaf(p);
+	slAddTail(&Leaf, p);
+	node->child[LEFT] = node->child[RIGHT] = NULL;
+	node->outgroup = p->outgroup;
+	node->data[VIEW_IN] = node->data[VIEW_OUT] = p;
+	if (node->name == NULL || node->name[0] == '\0') {
+		freeMem(node->name);
+		node->name = cloneString(names->string);
+	}
+	fprintf(stderr, "%s evaluated as one leaf (branch length %g)\n", names->string, len);
+	shareLeaf(Leaf, p);
+	freeDyString(&names);
+	PseudoNum++;
+}
+
+static void collapseShort(struct phyloTree *node) {
+	struct phyloTree *c;
+	double len;
+	int side;
+
+	for (side = LEFT; side <= RIGHT; side++) {
+		// a node above a single leaf has nothing to merge
+		if ((c = node->child[side]) == NULL || subtreeLeaves(c) < 2)
+			continue;
+		if ((len = subtreeLen(c)) < PseudoLen)
+			collapseNode(c, len);
+		else
+			collapseShort(c);
+	}
+}
+
+/* -pseudoLeaves: an approximation for trees with many close leaves. The
+ * largest subtrees below the ancestor whose branches add up to less than
+ * PseudoLen are read as a single leaf each, a consensus of their leaves,
+ * and the plan of the evaluation made again without them. The candidates,
+ * already those of every leaf, do not change */
+static void pseudoLeaves() {
+	collapseShort(Ances);
+	if (PseudoNum == 0)
+		return;
+	freez(&Plan);
+	freez(&PlanSlot);
+	PlanLen = PlanRows = 0;
+	compilePlan(Ances);
+}
+
+static void freeContext(struct llContext *ctx) {
+	MemoHits += ctx->memoHits;
+	MemoMisses += ctx->memoMisses;
+	freeMem(ctx->memoCol);
+	freeMem(ctx->slot);
+	freeMem(ctx->memo);
+	freeMem(ctx->colSum);
+	freeMem(ctx->logScale);
+	freeMem(ctx->outScale);
+	freeMem(ctx->outside);
+	freeMem(ctx->down);
+	freeMem(ctx->jackRow);
+	freeMem(ctx->leafSlot);
+	freeMem(ctx->leafVal);
+	freeMem(ctx->tileMemo);
+	freeMem(ctx->tileSum);
+	freeMem(ctx->tileScale);
+	freeMem(ctx->skipLen);
+	freeMem(ctx->skipK);
+	freeMem(ctx->skipVal);
+	freeMem(ctx->skipBase);
+	freeMem(ctx->skipSum);
+	freeMem(ctx->skipLeaf);
+}
+
+static void setTransitionProbs(struct phyloTree *tree) {
+	struct phyloTree *tr;
+	for (tr = tree; tr; tr = tr->next) {
+		tr->distalpha = tr->dist * alpha;
+		tr->psame = prob(tr, 0, 0);
+		tr->pdiff = prob(tr, 0, 1);
+	}
+}
+
+// row[k] *= pdiff * sum + (psame - pdiff) * childRow[k]: the sum over s of
+// prob(child, i, s) * LL(child, s, j), since prob() takes only two values
+// per branch. Kept a plain loop over restrict pointers so the compiler can
+// vectorise it for whatever -march the build targets.
+static void childKernel(llReal *restrict row, const llReal *restrict childRow,
+	int n, double a, double b) {
+	int k;
+	for (k = 0; k < n; k++)
+		row[k] *= a + b * childRow[k];
+}
+
+static llReal *getRow(struct llContext *ctx, struct phyloTree *node, int j);
+
+// divide a row whose entries all fell below LL_TINY by its maximum, so deep
+// trees and long branches do not underflow; returns the log of the factor
+static double rescaleRow(llReal *row, int n) {
+	double m = 0;
+	int k;
+	for (k = 0; k < n; k++)
+		m = max(m, row[k]);
+	if (m == 0 || m >= LL_TINY)
+		return 0;
+	for (k = 0; k < n; k++)
+		row[k] /= m;
+	Rescaled = TRUE;
+	return log(m);
+}
+
+// the adjacencies a leaf has at column j
+static int leafAdjs(struct nodeList *lf, int j) {
+	return (leafPred(lf, j) != -1) + slCount(leafExtra(lf, j));
+}
+
+// the candidates of column j -epsilon skipped
+static int skipped(int j) {
+	return (SkipStart != NULL) ? SkipStart[j+1] - SkipStart[j] : 0;
+}
+
+// the data of a leaf as the thread of ctx reads it
+static struct nodeList *ctxLeaf(struct llContext *ctx, struct phyloTree *leaf) {
+	return (ctx->leaves != NULL) ? ctx->leaves[leaf->id] : leaf->data[ctx->view];
+}
+
+// row[k] *= a, times times over (1 or 2), rounded as often as that does
+static void scaleRow(llReal *restrict row, int n, double a, int times) {
+	int k;
+	if (times == 2)
+		for (k = 0; k < n; k++)
+			row[k] = (llReal)(row[k] * a) * a;
+	else
+		for (k = 0; k < n; k++)
+			row[k] *= a;
+}
+
+/* childKernel() over the branch of a leaf without making its row, which is
+ * all 1 where the leaf does not have extremity j and otherwise YES at the
+ * leaf's adjacencies and NO elsewhere: the row is multiplied by the NO
+ * factor, and the few YES entries by the other one instead. The products
+ * are those childKernel() takes, so the values come out the same. With
+ * times 2 it is that of both of twin leaves in one pass. */
+static void leafKernel(struct llContext *ctx, llReal *row, struct phyloTree *leaf, int j, int n, int times) {
+	struct nodeList *lf = ctxLeaf(ctx, leaf);
+	int *start = ctx->cand->start;
+	struct adjList *e;
+	double a;
+	int k, m = 0, s, i;
+
+	COUNT(ll_leaf_rows, 1);
+	if (leafThere(lf, j) != YES) {
+		a = leaf->pdiff * (n + skipped(j)) + (leaf->psame - leaf->pdiff);
+		scaleRow(row, n, a, times);
+		return;
+	}
+	if ((s = findSlot(ctx->cand, j, leafPred(lf, j))) >= 0)
+		ctx->leafSlot[m++] = s - start[j];
+	for (e = leafExtra(lf, j); e; e = e->next) {
+		if ((s = findSlot(ctx->cand, j, e->i)) < 0)
+			continue;
+		s -= start[j];
+		for (i = 0; i < m && ctx->leafSlot[i] != s; i++)
+			;
+		if (i == m)
+			ctx->leafSlot[m++] = s;
+	}
+	for (i = 0; i < m; i++)
+		ctx->leafVal[i] = row[ctx->leafSlot[i]];
+	a = leaf->pdiff * leafAdjs(lf, j);
+	scaleRow(row, n, a + (leaf->psame - leaf->pdiff) * NO, times);
+	for (i = 0; i < m; i++)
+		row[ctx->leafSlot[i]] = ctx->leafVal[i];
+	for (i = 0; i < m; i++)
+		scaleRow(row + ctx->leafSlot[i], 1, a + (leaf->psame - leaf->pdiff) * YES, times);
+}
+
+// the children of node are leaves with the same sets on branches of the
+// same length, whose leafKernel() passes are then one
+static boolean twinLeaves(struct llContext *ctx, struct phyloTree *node) {
+	struct phyloTree *l = node->child[LEFT], *r = node->child[RIGHT];
+	struct nodeList *a, *b;
+
+	if (l == NULL || r == NULL || !isLeaf(l) || !isLeaf(r)
+		|| l->psame != r->psame || l->pdiff != r->pdiff)
+		return FALSE;
+	a = ctxLeaf(ctx, l);
+	b = ctxLeaf(ctx, r);
+	return (a->same ? a->same : a) == (b->same ? b->same : b);
+}
+
+// returns the log of the factor the row was rescaled by at the end
+static double fillRow(struct llContext *ctx, struct phyloTree *node, int j, llReal *row) {
+	struct phyloTree *c;
+	struct nodeList *lf;
+	struct adjList *e;
+	int *start = ctx->cand->start;
+	int k, n = start[j+1] - start[j], side;
+	double scale;
+
+	if (isLeaf(node)) {
+		lf = ctxLeaf(ctx, node);
+		if (leafThere(lf, j) != YES) {
+			for (k = 0; k < n; k++)
+				row[k] = 1;
+			return 0;
+		}
+		for (k = 0; k < n; k++)
+			row[k] = NO;
+		if ((k = findSlot(ctx->cand, j, leafPred(lf, j))) >= 0)
+			row[k - start[j]] = YES;
+		for (e = leafExtra(lf, j); e; e = e->next)
+			if ((k = findSlot(ctx->cand, j, e->i)) >= 0)
+				row[k - start[j]] = YES;
+		return 0;
+	}
+	for (k = 0; k < n; k++)
+		row[k] = 1;
+	if (twinLeaves(ctx, node)) {
+		leafKernel(ctx, row, node->child[LEFT], j, n, 2);
+		scale = rescaleRow(row, n);
+		ctx->logScale[node->id] += scale;
+		return scale;
+	}
+	for (side = LEFT; side <= RIGHT; side++) {
+		if ((c = node->child[side]) == NULL)
+			continue;
+		if (isLeaf(c)) {
+			leafKernel(ctx, row, c, j, n, 1);
+			continue;
+		}
+		if (ctx->lazy)
+			getRow(ctx, c, j);
+		childKernel(row, ctx->memo + ctx->slot[c->id] * ctx->stride, n,
+			c->pdiff * ctx->colSum[c->id], c->psame - c->pdiff);
+		ctx->logScale[node->id] += ctx->logScale[c->id];
+	}
+	scale = rescaleRow(row, n);
+	ctx->logScale[node->id] += scale;
+	return scale;
+}
+
+// the skipped candidates of column j leaf lf has, by their index in the
+// column and in order, into k; returns how many
+static int leafSkipped(struct nodeList *lf, int j, int *k) {
+	struct matrix S = {SkipStart, SkipIdx, NULL};
+	struct adjList *e;
+	int i, m, s;
+
+	m = ((s = findSlot(&S, j, leafPred(lf, j))) >= 0);
+	if (m)
+		k[0] = s - SkipStart[j];
+	// the extra joins of an outgroup are few, so they are put in order by hand
+	for (e = leafExtra(lf, j); e; e = e->next) {
+		if ((s = findSlot(&S, j, e->i)) < 0)
+			continue;
+		for (s -= SkipStart[j], i = m; i > 0 && k[i-1] > s; i--)
+			k[i] = k[i-1];
+		k[i] = s;
+		m++;
+	}
+	return m;
+}
+
+/* -epsilon: the values at node of the candidates of column j it skipped,
+ * for the normalisers alone. One that no leaf below node has takes the
+ * value skipBase; the slot of node holds the others, skipLen of them by
+ * their index in the column. Each comes from the values of the children
+ * by the kernels of fillRow(), and is divided by the factor e^scale that
+ * fillRow() rescaled the row by. Only the nodes above the leaves of a
+ * skipped candidate take it up, not every node as a row would. Returns
+ * the sum over all the skipped candidates of the column */
+static double skippedRow(struct llContext *ctx, struct phyloTree *node, int j, double scale) {
+	struct phyloTree *c;
+	struct nodeList *lf;
+	int slot = ctx->slot[node->id], *k = ctx->skipK + slot * MaxSkip, *ck[2];
+	llReal *v = ctx->skipVal + slot * MaxSkip, *cv[2];
+	double a[2], b[2], base[2], x, f = exp(-scale), sum = 0;
+	int i, m = 0, nc = 0, side, s, len[2], at[2], d = skipped(j);
+	int n = ctx->cand->start[j+1] - ctx->cand->start[j];
+
+	// a column with none skipped has nothing the parent reads
+	if (d == 0)
+		return ctx->skipSum[node->id] = 0;
+	if (isLeaf(node)) {
+		lf = ctxLeaf(ctx, node);
+		if (leafThere(lf, j) == YES)
+			m = leafSkipped(lf, j, k);
+		for (i = 0; i < m; i++)
+			v[i] = YES;
+		ctx->skipLen[slot] = m;
+		x = ctx->skipBase[node->id] = (leafThere(lf, j) == YES) ? NO : 1;
+		return ctx->skipSum[node->id] = m * YES + (d - m) * x;
+	}
+	for (side = LEFT; side <= RIGHT; side++) {
+		if ((c = node->child[side]) == NULL)
+			continue;
+		if (isLeaf(c)) {
+			// a leaf has no slot: its values are YES at its own, as leafKernel() reads them
+			lf = ctxLeaf(ctx, c);
+			ck[nc] = ctx->skipLeaf + nc * MaxSkip;
+			cv[nc] = NULL;
+			len[nc] = (leafThere(lf, j) == YES) ? leafSkipped(lf, j, ck[nc]) : 0;
+			base[nc] = (leafThere(lf, j) == YES) ? NO : 1;
+			a[nc] = c->pdiff * ((leafThere(lf, j) == YES) ? leafAdjs(lf, j) : n + d);
+		} else {
+			ck[nc] = ctx->skipK + ctx->slot[c->id] * MaxSkip;
+			cv[nc] = ctx->skipVal + ctx->slot[c->id] * MaxSkip;
+			len[nc] = ctx->skipLen[ctx->slot[c->id]];
+			base[nc] = ctx->skipBase[c->id];
+			a[nc] = c->pdiff * ctx->colSum[c->id];
+		}
+		b[nc] = c->psame - c->pdiff;
+		at[nc++] = 0;
+	}
+	// the children's lists merged, each in order
+	for (;;) {
+		for (s = d, i = 0; i < nc; i++)
+			if (at[i] < len[i])
+				s = min(s, ck[i][at[i]]);
+		if (s == d)
+			break;
+		for (x = f, i = 0; i < nc; i++)
+			if (at[i] < len[i] && ck[i][at[i]] == s) {
+				x *= a[i] + b[i] * ((cv[i] != NULL) ? cv[i][at[i]] : YES);
+				at[i]++;
+			} else
+				x *= a[i] + b[i] * base[i];
+		k[m] = s;
+		v[m++] = x;
+		sum += x;
+	}
+	for (x = f, i = 0; i < nc; i++)
+		x *= a[i] + b[i] * base[i];
+	ctx->skipLen[slot] = m;
+	ctx->skipBase[node->id] = x;
+	return ctx->skipSum[node->id] = sum + (d - m) * x;
+}
+
+static void computeRow(struct llContext *ctx, struct phyloTree *node, int j) {
+	llReal *row = ctx->memo + ctx->slot[node->id] * ctx->stride;
+	double sum = 0, scale;
+	int k, n = ctx->cand->start[j+1] - ctx->cand->start[j];
+
+	COUNT(ll_rows, 1);
+	TRACE_POINT2(ll_row, node->id, j);
+	ctx->logScale[node->id] = 0;
+	scale = fillRow(ctx, node, j, row);
+	for (k = 0; k < n; k++)
+		sum += row[k];
+	// the skipped candidates are in the sum the parent's kernel takes
+	if (SkipStart != NULL)
+		sum += skippedRow(ctx, node, j, scale);
+	ctx->colSum[node->id] = sum;
+	ctx->memoCol[node->id] = j;
+}
+
+// the row LL(node, ., j), computed once per column along with its sum
+static llReal *getRow(struct llContext *ctx, struct phyloTree *node, int j) {
+	if (ctx->memoCol[node->id] != j) {
+		computeRow(ctx, node, j);
+		ctx->memoMisses++;
+	} else {
+		ctx->memoHits++;
+		COUNT(ll_memo_hits, 1);
+	}
+	return ctx->memo + ctx->slot[node->id] * ctx->stride;
+}
+
+// the likelihood -epsilon skipped in column j, scaled as its PLH; it is
+// that of the SLH row map(j) too, which reads the mirrors of the column
+static double skippedSum(int j) {
+	return (SkipSum != NULL) ? SkipSum[j] : 0;
+}
+
+// a rescaled row of SLH is normalized in log space around its largest entry
+static void normalizeScaledRow(int i) {
+	double m = 0, ssum = 0, v, scale = succScale(i), skip = skippedSum(map(i));
+	int k, first = TRUE;
+	for (k = SLH.start[i]; k < SLH.start[i+1]; k++) {
+		if (succVal(k) <= 0)
+			continue;
+		v = log(succVal(k)) + scale;
+		if (first || v > m)
+			m = v;
+		first = FALSE;
+	}
+	if (skip > 0 && (first || log(skip) + scale > m))
+		m = log(skip) + scale;
+	for (k = SLH.start[i]; k < SLH.start[i+1]; k++)
+		if (succVal(k) > 0)
+			ssum += exp(log(succVal(k)) + scale - m);
+	if (skip > 0)
+		ssum += exp(log(skip) + scale - m);
+	RowMax[i] = m;
+	RowSum[i] = ssum;
+}
+
+/* the normalisers of the PLH columns and SLH rows of the inner extremities.
+ * The SLH row map(j) is read from column j of PLH, so both come a tile of
+ * columns at a time */
+static void normalize() {
+	int i, j, k, lo, hi;
+	double psum, ssum;
+	for (lo = A+1; lo < Z; lo = hi) {
+		hi = nextTile(lo, Z);
+		for (j = lo; j < hi; j++) {
+			psum = 0;
+			for (k = PLH.start[j]; k < PLH.start[j+1]; k++)
+				psum += PLH.val[k];
+			ColSum[j] = psum + skippedSum(j);
+			i = map(j);
+			if (Rescaled) {
+				normalizeScaledRow(i);
+				continue;
+			}
+			ssum = 0;
+			for (k = SLH.start[i]; k < SLH.start[i+1]; k++)
+				ssum += succVal(k);
+			RowSum[i] = ssum + skippedSum(j);
+		}
+		releaseValues(lo, hi);
+	}
+}
+
+// the SPP value of the Succ entry k of the inner row i
+static double sppVal(int i, int k) {
+	if (!Rescaled)
+		return succVal(k)/RowSum[i];
+	return (succVal(k) > 0) ? exp(log(succVal(k)) + succScale(i) - RowMax[i]) / RowSum[i] : 0;
+}
+
+/* the posterior PPP * SPP of the adjacency i -> j at the Succ entry k. A
+ * telomere column or row has no normaliser of its own: SPP(A, j) is
+ * PPP(A, j) and PPP(i, Z) is SPP(i, Z) */
+static double adjProb(int i, int k) {
+	int j = SuccIdx[k], p = SuccPos[k];
+	boolean innerI = (i > A && i < Z), innerJ = (j > A && j < Z);
+	double ppp = 0, spp = 0;
+
+	if (innerJ)
+		ppp = PLH.val[p]/ColSum[j];
+	else if (j == Z && innerI)
+		ppp = sppVal(i, k);
+	if (innerI)
+		spp = sppVal(i, k);
+	else if (i == A && innerJ)
+		spp = PLH.val[p]/ColSum[j];
+	return ppp * spp;
+}
+
+/* -llcache: a node's table holds its row LL(node, ., j) of every column,
+ * laid out as PLH, then the sum and the log scale of each column:
+ *   magic "ADJLLC1", uint64 key, int32 n, N, sizeof(llReal), 0,
+ *   llReal rows[n], float64 sums[N], float64 scales[N]
+ * A table depends on the subtree only through the leaf adjacencies below
+ * it and the transition probabilities of its branches, given the candidate
+ * lists, so that is what the key hashes. */
+#define LLC_MAGIC "ADJLLC1"
+
+struct llcHeader {
+	char magic[8];
+	uint64_t key;
+	int n, N, realSize, pad;
+};
+
+struct llTable {
+	struct llcHeader *map;
+	size_t size;
+	llReal *row;
+	double *sum, *scale;
+	char name[PATH_LEN];
+};
+
+static struct llTable **LLCacheIn = NULL, **LLCacheOut = NULL;
+static boolean *LLCacheBelow = NULL;	// under a node whose table was found
+
+static uint64_t hashMix(uint64_t h, uint64_t v) {
+	h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+	return h * 0xff51afd7ed558ccdULL;
+}
+
+static uint64_t hashDouble(uint64_t h, double d) {
+	uint64_t v;
+	memcpy(&v, &d, sizeof(v));
+	return hashMix(h, v);
+}
+
+// the candidate lists and everything else every table depends on
+static uint64_t candidateKey() {
+	uint64_t h = hashMix(0, T);
+	int k;
+
+	h = hashMix(h, N);
+	h = hashMix(h, sizeof(llReal));
+	h = hashDouble(h, LL_TINY);
+	for (k = 0; k <= N; k++)
+		h = hashMix(h, PredStart[k]);
+	for (k = 0; k < PredStart[N]; k++)
+		h = hashMix(h, PredIdx[k]);
+	return h;
+}
+
+// a leaf's adjacencies, its extra ones in any order; for a node those of
+// its children and their branches
+static uint64_t subtreeKey(struct phyloTree *node, uint64_t base, uint64_t *key) {
+	struct nodeList *lf;
+	struct adjList *e;
+	struct phyloTree *c;
+	uint64_t h = base, x;
+	int j, side;
+
+	if (isLeaf(node)) {
+		lf = node->data[VIEW_IN];
+		h = hashMix(h, 1);
+		for (j = 0; j < N; j++) {
+			h = hashMix(h, leafThere(lf, j));
+			h = hashMix(h, leafPred(lf, j));
+			for (x = 0, e = leafExtra(lf, j); e; e = e->next)
+				x += hashMix(j, e->i);
+			h = hashMix(h, x);
+		}
+	} else
+		for (side = LEFT; side <= RIGHT; side++) {
+			h = hashMix(h, 2 + side);
+			if ((c = node->child[side]) == NULL)
+				continue;
+			h = hashMix(h, subtreeKey(c, base, key));
+			h = hashDouble(h, c->psame);
+			h = hashDouble(h, c->pdiff);
+		}
+	return key[node->id] = h;
+}
+
+static size_t llTableSize() {
+	return sizeof(struct llcHeader) + PredStart[N] * sizeof(llReal) + 2 * N * sizeof(double);
+}
+
+static void llTableLayout(struct llTable *t) {
+	t->row = (llReal *)(t->map + 1);
+	t->sum = (double *)(t->row + PredStart[N]);
+	t->scale = t->sum + N;
+}
+
+// the table of a key if the cache has one of this problem, NULL otherwise
+static struct llTable *openLLTable(uint64_t key) {
+	struct llTable *t;
+	struct stat st;
+	char name[PATH_LEN];
+	void *map;
+	int fd;
+
+	safef(name, sizeof(name), "%s/%016llx.ll", LLCacheDir, (unsigned long long)key);
+	if ((fd = open(name, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size != llTableSize()
+		|| (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	AllocVar(t);
+	t->map = map;
+	t->size = st.st_size;
+	if (memcmp(t->map->magic, LLC_MAGIC, sizeof(LLC_MAGIC)) != 0 || t->map->key != key
+		|| t->map->n != PredStart[N] || t->map->N != N || t->map->realSize != (int)sizeof(llReal)) {
+		munmap(map, t->size);
+		freeMem(t);
+		return NULL;
+	}
+	llTableLayout(t);
+	return t;
+}
+
+// a table to fill, written next to its name and renamed when complete
+static struct llTable *createLLTable(uint64_t key) {
+	struct llTable *t;
+	char tmp[PATH_LEN];
+	void *map;
+	int fd;
+
+	AllocVar(t);
+	safef(t->name, sizeof(t->name), "%s/%016llx.ll", LLCacheDir, (unsigned long long)key);
+	safef(tmp, sizeof(tmp), "%s.tmp", t->name);
+	t->size = llTableSize();
+	if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+		errnoAbort("# cannot create %s", tmp);
+	if (ftruncate(fd, t->size) != 0
+		|| (map = mmap(NULL, t->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		errnoAbort("# cannot map %s", tmp);
+	close(fd);
+	t->map = map;
+	memcpy(t->map->magic, LLC_MAGIC, sizeof(LLC_MAGIC));
+	t->map->key = key;
+	t->map->n = PredStart[N];
+	t->map->N = N;
+	t->map->realSize = sizeof(llReal);
+	llTableLayout(t);
+	return t;
+}
+
+static void closeLLTable(struct llTable *t, boolean keep) {
+	char tmp[PATH_LEN];
+
+	if (t == NULL)
+		return;
+	if (t->name[0] != '\0') {
+		safef(tmp, sizeof(tmp), "%s.tmp", t->name);
+		if (msync(t->map, t->size, MS_SYNC) != 0)
+			errnoAbort("# cannot write %s", tmp);
+		if (keep && rename(tmp, t->name) != 0)
+			errnoAbort("# cannot rename %s to %s", tmp, t->name);
+		if (!keep)
+			remove(tmp);
+	}
+	munmap(t->map, t->size);
+	freeMem(t);
+}
+
+/* top down from node: the table of an unchanged subtree, found or, when
+ * write is set, one to be made; below a found one nothing is evaluated.
+ * Goes by the children, as the parents of a rerooted tree are the old ones. */
+static void findLLTables(struct phyloTree *node, uint64_t *key, boolean below,
+	boolean write, int *found, int *made) {
+	int side, j;
+
+	LLCacheBelow[node->id] = below;
+	if (!below && !isLeaf(node)) {
+		if ((LLCacheIn[node->id] = openLLTable(key[node->id])) != NULL) {
+			(*found)++;
+			for (j = A+1; j < Z; j++)
+				if (LLCacheIn[node->id]->scale[j] != 0)
+					Rescaled = TRUE;
+		} else if (write) {
+			LLCacheOut[node->id] = createLLTable(key[node->id]);
+			(*made)++;
+		}
+	}
+	for (side = LEFT; side <= RIGHT; side++)
+		if (node->child[side] != NULL)
+			findLLTables(node->child[side], key, below || LLCacheIn[node->id] != NULL,
+				write, found, made);
+}
+
+/* find the tables of the unchanged subtrees, and unless only some columns
+ * are evaluated (-part, -resume, -merge) make those of the others */
+static void openLLCache(boolean write) {
+	uint64_t *key;
+	int found = 0, made = 0;
+
+	AllocArray(key, NodeNum);
+	AllocArray(LLCacheIn, NodeNum);
+	AllocArray(LLCacheOut, NodeNum);
+	AllocArray(LLCacheBelow, NodeNum);
+	if (mkdir(LLCacheDir, 0755) != 0 && errno != EEXIST)
+		errnoAbort("# cannot make %s", LLCacheDir);
+	subtreeKey(Ances, candidateKey(), key);
+	findLLTables(Ances, key, FALSE, write, &found, &made);
+	fprintf(stderr, "%s: %d subtree tables reused, %d to write\n", LLCacheDir, found, made);
+	freeMem(key);
+}
+
+static void closeLLCache(boolean keep) {
+	int k;
+
+	for (k = 0; k < NodeNum; k++) {
+		closeLLTable(LLCacheIn[k], FALSE);
+		closeLLTable(LLCacheOut[k], keep);
+	}
+	freez(&LLCacheIn);
+	freez(&LLCacheOut);
+	freez(&LLCacheBelow);
+}
+
+// a row of a node whose table was found
+static void loadRow(struct llContext *ctx, struct phyloTree *node, int j) {
+	struct llTable *t = LLCacheIn[node->id];
+	llReal *row = ctx->memo + ctx->slot[node->id] * ctx->stride;
+	int k;
+
+	for (k = PredStart[j]; k < PredStart[j+1]; k++)
+		row[k - PredStart[j]] = t->row[k];
+	ctx->colSum[node->id] = t->sum[j];
+	ctx->logScale[node->id] = t->scale[j];
+	ctx->memoCol[node->id] = j;
+}
+
+static void storeRow(struct llContext *ctx, struct phyloTree *node, int j) {
+	struct llTable *t = LLCacheOut[node->id];
+	llReal *row = ctx->memo + ctx->slot[node->id] * ctx->stride;
+	int k;
+
+	for (k = PredStart[j]; k < PredStart[j+1]; k++)
+		t->row[k] = row[k - PredStart[j]];
+	t->sum[j] = ctx->colSum[node->id];
+	t->scale[j] = ctx->logScale[node->id];
+}
+
+/* the column without each leaf in turn: the leaf's parent takes only its
+ * other children, and every node above it up to the ancestor is filled
+ * again from the new row and the rows of its other children, as fillRow()
+ * does */
+static void jackknifeColumn(struct llContext *ctx, int j) {
+	struct phyloTree *cur, *p, *c;
+	llReal *row, *prev = NULL;
+	const llReal *crow;
+	double sum = 0, scale = 0, csum, cscale;
+	int t, k, side, flip, n = PredStart[j+1] - PredStart[j];
+
+	for (t = 0; t < JackNum; t++) {
+		prev = NULL;
+		for (cur = JackLeaf[t], flip = 0; cur != Ances; cur = p, flip ^= 1) {
+			p = JackParent[cur->id];
+			row = ctx->jackRow + flip * MaxCol;
+			for (k = 0; k < n; k++)
+				row[k] = 1;
+			cscale = 0;
+			for (side = LEFT; side <= RIGHT; side++) {
+				if ((c = p->child[side]) == NULL || (c == cur && prev == NULL))
+					continue;
+				if (c == cur) {
+					crow = prev;
+					csum = sum;
+					cscale += scale;
+				} else if (isLeaf(c)) {
+					leafKernel(ctx, row, c, j, n, 1);
+					continue;
+				} else {
+					crow = ctx->memo + ctx->slot[c->id] * ctx->stride;
+					csum = ctx->colSum[c->id];
+					cscale += ctx->logScale[c->id];
+				}
+				childKernel(row, crow, n, c->pdiff * csum, c->psame - c->pdiff);
+			}
+			scale = cscale + rescaleRow(row, n);
+			for (sum = 0, k = 0; k < n; k++)
+				sum += row[k];
+			prev = row;
+		}
+		for (k = 0; k < n; k++)
+			JackPLH[t][PredStart[j] + k] = prev[k];
+		JackScale[t][j] = scale;
+	}
+}
+
+// the parent of each node below node, by the children (a rerooted tree
+// keeps the old parents), and its leaves in tree order
+static void planJackknife(struct phyloTree *node) {
+	int side;
+
+	if (isLeaf(node))
+		JackLeaf[JackNum++] = node;
+	for (side = LEFT; side <= RIGHT; side++)
+		if (node->child[side] != NULL) {
+			JackParent[node->child[side]->id] = node;
+			planJackknife(node->child[side]);
+		}
+}
+
+static void predecessorColumn(struct llContext *ctx, int j) {
+	struct phyloTree *node;
+	llReal *row;
+	int k;
+
+	for (k = 0; k < PlanLen; k++) {
+		node = Plan[k];
+		if (LLCacheIn == NULL)
+			computeRow(ctx, node, j);
+		else if (LLCacheIn[node->id] != NULL)
+			loadRow(ctx, node, j);
+		else if (!LLCacheBelow[node->id]) {
+			computeRow(ctx, node, j);
+			if (LLCacheOut[node->id] != NULL)
+				storeRow(ctx, node, j);
+		}
+	}
+	ctx->memoMisses += PlanLen;
+	row = ctx->memo + ctx->slot[Ances->id] * ctx->stride;
+	for (k = PredStart[j]; k < PredStart[j+1]; k++)
+		PLH.val[k] = row[k - PredStart[j]];
+	ColScale[j] = ctx->logScale[Ances->id];
+	if (SkipSum != NULL)
+		SkipSum[j] = ctx->skipSum[Ances->id];
+	if (JackNum > 0)
+		jackknifeColumn(ctx, j);
+}
+
+// the rows of column j of the cache tile from lo, c-th of it: each node's
+// row as long as the column's candidates, one after the other
+static void tileFrame(struct llContext *ctx, int lo, int j, int c) {
+	ctx->memo = ctx->tileMemo + (size_t)PlanRows * (PredStart[j] - PredStart[lo]);
+	ctx->stride = PredStart[j+1] - PredStart[j];
+	ctx->colSum = ctx->tileSum + c * NodeNum;
+	ctx->logScale = ctx->tileScale + c * NodeNum;
+}
+
+/* predecessorColumn() over the columns lo .. hi-1 (those not done) node by
+ * node rather than column by column: a node reads the rows its children
+ * wrote for the tile while they are still in L2, and the leaf data of the
+ * consecutive columns once. Each column is worked out by the same steps as
+ * on its own, so its values are the same */
+static void predecessorTile(struct llContext *ctx, int lo, int hi) {
+	llReal *memo = ctx->memo, *row;
+	double *colSum = ctx->colSum, *logScale = ctx->logScale;
+	int j, k, c;
+
+	for (k = 0; k < PlanLen; k++)
+		for (j = lo, c = 0; j < hi; j++, c++)
+			if (!ColDone[j]) {
+				tileFrame(ctx, lo, j, c);
+				computeRow(ctx, Plan[k], j);
+			}
+	for (j = lo, c = 0; j < hi; j++, c++) {
+		if (ColDone[j])
+			continue;
+		tileFrame(ctx, lo, j, c);
+		ctx->memoMisses += PlanLen;
+		row = ctx->memo + ctx->slot[Ances->id] * ctx->stride;
+		for (k = PredStart[j]; k < PredStart[j+1]; k++)
+			PLH.val[k] = row[k - PredStart[j]];
+		ColScale[j] = ctx->logScale[Ances->id];
+	}
+	ctx->memo = memo;
+	ctx->stride = MaxCol;
+	ctx->colSum = colSum;
+	ctx->logScale = logScale;
+}
+
+static double rescaleOutside(double *row, int n) {
+	double m = 0;
+	int k;
+	for (k = 0; k < n; k++)
+		m = max(m, row[k]);
+	if (m == 0 || m >= LL_TINY)
+		return 0;
+	for (k = 0; k < n; k++)
+		row[k] /= m;
+	Rescaled = TRUE;
+	return log(m);
+}
+
+// likelihood of everything outside each on-path node given its state, top
+// down from the root: the parent's outside value times the sibling subtree,
+// carried across the node's own branch
+static void outsideColumn(struct llContext *out, int j) {
+	struct phyloTree *tr, *p, *sib;
+	int k, n = PredStart[j+1] - PredStart[j];
+	double *g = out->down, *o, *po, sum, a, b;
+	llReal *srow = NULL;
+
+	for (tr = Phylo; tr; tr = tr->next) {
+		if (!tr->onPath)
+			continue;
+		o = out->outside + tr->id * MaxCol;
+		if ((p = tr->parent) == NULL) {
+			for (k = 0; k < n; k++)
+				o[k] = 1;
+			out->outScale[tr->id] = 0;
+			continue;
+		}
+		out->outScale[tr->id] = out->outScale[p->id];
+		po = out->outside + p->id * MaxCol;
+		sib = (p->child[LEFT] == tr) ? p->child[RIGHT] : p->child[LEFT];
+		a = 1;
+		b = 0;
+		if (sib) {
+			srow = getRow(out, sib, j);
+			a = sib->pdiff * out->colSum[sib->id];
+			b = sib->psame - sib->pdiff;
+			out->outScale[tr->id] += out->logScale[sib->id];
+		}
+		sum = 0;
+		for (k = 0; k < n; k++) {
+			g[k] = po[k];
+			if (sib)
+				g[k] *= a + b * srow[k];
+			sum += g[k];
+		}
+		for (k = 0; k < n; k++)
+			o[k] = tr->pdiff * sum + (tr->psame - tr->pdiff) * g[k];
+		out->outScale[tr->id] += rescaleOutside(o, n);
+	}
+}
+
+// every target's column is its inside likelihood (leaves below it read
+// their genomes) times its outside likelihood (leaves outside read joins)
+static void targetColumn(struct llContext *ctx, int j) {
+	struct llContext *in = ctx, *out = ctx + 1;
+	struct phyloTree *v;
+	llReal *row;
+	int k, t, n = PredStart[j+1] - PredStart[j];
+
+	outsideColumn(out, j);
+	for (t = 0; t < TargetNum; t++) {
+		v = Targets[t];
+		row = getRow(in, v, j);
+		for (k = 0; k < n; k++)
+			TargetPLH[t][PredStart[j] + k] = row[k]
+				* out->outside[v->id * MaxCol + k];
+		TargetScale[t][j] = in->logScale[v->id] + out->outScale[v->id];
+	}
+}
+
+/* Checkpoint file: an 8-byte magic, int32 version, T, candidate count n,
+ * number of value sets, rescaled flag and the candidates -epsilon skipped,
+ * float64 alpha, then one done byte per column and for each set (the PLH
+ * of the single ancestor or of each target) n float64 likelihoods followed
+ * by N float64 column log scales, and with skipped candidates the N
+ * float64 SkipSum. The skipped count took the padding before alpha, which
+ * older files hold 0 in. The layout is fixed, so the file can be mapped as
+ * well as read. */
+#define CKPT_MAGIC "ADJCKPT"
+#define CKPT_VERSION 1
+
+struct ckptHeader {
+	char magic[8];
+	int version, T, n, sets, rescaled, skipped;
+	double alpha;
+};
+
+static int ckptSets() {
+	return (TargetNum > 0) ? TargetNum : 1;
+}
+
+static double *ckptValues(int set) {
+	return (TargetNum > 0) ? TargetPLH[set] : PLH.val;
+}
+
+static double *ckptScales(int set) {
+	return (TargetNum > 0) ? TargetScale[set] : ColScale;
+}
+
+static void ckptFillHeader(struct ckptHeader *h) {
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, CKPT_MAGIC, sizeof(CKPT_MAGIC));
+	h->version = CKPT_VERSION;
+	h->T = T;
+	h->n = PredStart[N];
+	h->sets = ckptSets();
+	h->rescaled = Rescaled;
+	h->skipped = (SkipStart != NULL) ? SkipStart[N] : 0;
+	h->alpha = alpha;
+}
+
+// written next to the target and renamed over it, so a pre-emption in the
+// middle leaves the previous checkpoint intact. Columns finished while the
+// done bytes are being written are simply not claimed yet.
+static void writeCheckpoint() {
+	struct ckptHeader h;
+	char tmp[PATH_LEN];
+	FILE *fp;
+	int set;
+
+	safef(tmp, sizeof(tmp), "%s.tmp", CheckpointFile);
+	ckptFillHeader(&h);
+	fp = mustOpen(tmp, "wb");
+	writeOne(fp, h);
+	mustWrite(fp, ColDone, N);
+	for (set = 0; set < h.sets; set++) {
+		mustWrite(fp, ckptValues(set), h.n * sizeof(double));
+		mustWrite(fp, ckptScales(set), N * sizeof(double));
+	}
+	if (h.skipped > 0)
+		mustWrite(fp, SkipSum, N * sizeof(double));
+	carefulClose(&fp);
+	if (rename(tmp, CheckpointFile) != 0)
+		errnoAbort("# cannot rename %s to %s", tmp, CheckpointFile);
+}
+
+/* add the columns a checkpoint of the same problem has done to those
+ * loaded so far; another problem's is ignored when resuming, an error when
+ * merging parts. Returns the number of columns it had. */
+static int loadCheckpoint(char *file, boolean strict) {
+	struct ckptHeader h, want;
+	unsigned char *done;
+	double *val, *scale;
+	FILE *fp;
+	int j, k, set, cnt = 0;
+
+	if ((fp = fopen(file, "rb")) == NULL) {
+		if (strict)
+			errnoAbort("# cannot open %s", file);
+		fprintf(stderr, "No checkpoint %s, starting afresh\n", file);
+		return 0;
+	}
+	ckptFillHeader(&want);
+	mustReadOne(fp, h);
+	if (memcmp(h.magic, want.magic, sizeof(h.magic)) != 0 || h.version != want.version
+		|| h.T != want.T || h.n != want.n || h.sets != want.sets || h.skipped != want.skipped
+		|| h.alpha != want.alpha) {
+		if (strict)
+			errAbort("# checkpoint %s is for another run", file);
+		warn("# checkpoint %s is for another run, ignored", file);
+		carefulClose(&fp);
+		return 0;
+	}
+	AllocArray(done, N);
+	AllocArray(val, h.n + 1);
+	AllocArray(scale, N);
+	mustRead(fp, done, N);
+	for (set = 0; set < h.sets; set++) {
+		mustRead(fp, val, h.n * sizeof(double));
+		mustRead(fp, scale, N * sizeof(double));
+		for (j = A+1; j < Z; j++) {
+			if (!done[j])
+				continue;
+			for (k = PredStart[j]; k < PredStart[j+1]; k++)
+				ckptValues(set)[k] = val[k];
+			ckptScales(set)[j] = scale[j];
+		}
+	}
+	if (h.skipped > 0) {
+		mustRead(fp, scale, N * sizeof(double));
+		for (j = A+1; j < Z; j++)
+			if (done[j])
+				SkipSum[j] = scale[j];
+	}
+	carefulClose(&fp);
+	for (j = A+1; j < Z; j++) {
+		cnt += done[j];
+		ColDone[j] |= done[j];
+	}
+	Rescaled |= h.rescaled;
+	freeMem(done);
+	freeMem(val);
+	freeMem(scale);
+	return cnt;
+}
+
+static void loadCheckpoints() {
+	struct slName *files, *f;
+	int j, cnt = 0;
+
+	if (MergeFiles != NULL) {
+		files = slNameListFromComma(MergeFiles);
+		for (f = files; f; f = f->next)
+			fprintf(stderr, "%s: %d columns\n", f->name, loadCheckpoint(f->name, TRUE));
+		slFreeList(&files);
+	}
+	if (CheckpointFile && Resume && loadCheckpoint(CheckpointFile, FALSE) > 0) {
+		for (j = PartLo; j < PartHi; j++)
+			cnt += ColDone[j];
+		fprintf(stderr, "Resuming from %s: %d of %d columns done\n", CheckpointFile, cnt, PartHi-PartLo);
+	}
+}
+
+// the k-th of n ranges of columns, cut where the candidates before them
+// reach (k-1)/n of all
+static void partRange() {
+	long total = PredStart[Z] - PredStart[A+1];
+	int j;
+
+	PartLo = A+1;
+	PartHi = Z;
+	if (PartN == 0)
+		return;
+	for (j = A+1; j < Z && (PredStart[j] - PredStart[A+1]) * PartN < total * (PartK-1); j++)
+		;
+	PartLo = j;
+	for (; j < Z && (PredStart[j] - PredStart[A+1]) * PartN < total * PartK; j++)
+		;
+	PartHi = (PartK == PartN) ? Z : j;
+}
+
+// whichever thread notices the interval has passed writes the checkpoint;
+// the others carry on rather than queue up behind it
+static void maybeCheckpoint() {
+	if (CheckpointFile == NULL || time(NULL) - LastCheckpoint < CheckpointSec)
+		return;
+	if (pthread_mutex_trylock(&CheckpointMutex) != 0)
+		return;
+	if (time(NULL) - LastCheckpoint >= CheckpointSec) {
+		writeCheckpoint();
+		LastCheckpoint = time(NULL);
+	}
+	pthreadMutexUnlock(&CheckpointMutex);
+}
+
+/* -numa: the NUMA nodes of the processors the process may use, from
+ * /sys/devices/system/node, and per node its copy of what every column
+ * reads: the candidate index and the leaf pred/predCol/there arrays (the
+ * overflow lists of outgroup multi-joins are shared). Thread t works on
+ * node t * NumaUsed / Threads, pinned to its processors, and takes the
+ * columns of the node's share of each tile first, so the stretches of
+ * PLH.val its columns write are first touched, and stay, on that node;
+ * once the share is done it goes on with those of the other nodes. The
+ * columns are the same whoever evaluates them, so are the outputs. */
+#define NUMA_MAX 64
+
+struct numaNode {
+	cpu_set_t cpus;
+	struct matrix cand;		// copies of PredStart and PredIdx
+	struct nodeList **leaves[2];	// per view and node id
+	struct nodeList *copies;	// of the entries of Leaf
+	int lo, next, hi;		// its share of the tile
+};
+
+static struct numaNode *NumaNode = NULL;
+static int NumaNum = 0;		// nodes with a processor the process may use
+static int NumaUsed = 0;	// nodes with threads on them, 0 without -numa
+
+static boolean readCpuList(char *fname, cpu_set_t *set) {
+	FILE *fp = fopen(fname, "r");
+	int a, b, c;
+
+	CPU_ZERO(set);
+	if (fp == NULL)
+		return FALSE;
+	while (fscanf(fp, "%d", &a) == 1) {
+		b = a;
+		if ((c = fgetc(fp)) == '-') {
+			if (fscanf(fp, "%d", &b) != 1)
+				break;
+			c = fgetc(fp);
+		}
+		for (; a <= b && a < CPU_SETSIZE; a++)
+			CPU_SET(a, set);
+		if (c != ',')
+			break;
+	}
+	fclose(fp);
+	return TRUE;
+}
+
+// the nodes once per process; without the sysfs files, one of every processor
+static void readNumaNodes() {
+	cpu_set_t allowed;
+	char fname[PATH_LEN];
+	int n;
+
+	if (NumaNode != NULL)
+		return;
+	AllocArray(NumaNode, NUMA_MAX);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+		errnoAbort("# cannot read the processors the process may use");
+	for (n = 0; n < NUMA_MAX; n++) {
+		safef(fname, sizeof(fname), "/sys/devices/system/node/node%d/cpulist", n);
+		if (!readCpuList(fname, &NumaNode[NumaNum].cpus))
+			continue;
+		CPU_AND(&NumaNode[NumaNum].cpus, &NumaNode[NumaNum].cpus, &allowed);
+		if (CPU_COUNT(&NumaNode[NumaNum].cpus) > 0)
+			NumaNum++;
+	}
+	if (NumaNum == 0)
+		NumaNode[NumaNum++].cpus = allowed;
+}
+
+static int numaNodeOf(int t) {
+	return t * NumaUsed / Threads;
+}
+
+static void pinToNode(int n) {
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &NumaNode[n].cpus) != 0)
+		errAbort("# cannot pin a thread to NUMA node %d", n);
+}
+
+// the copies of node n, made by a thread on it so that their pages are there
+static void numaCopyJob(int n, void *arg) {
+	struct numaNode *nn = NumaNode + n;
+	struct nodeList *b, *c, *s;
+	cpu_set_t old;
+	int v, np;
+
+	(void)arg;
+	pthread_getaffinity_np(pthread_self(), sizeof(old), &old);
+	pinToNode(n);
+	nn->cand.start = cloneMem(PredStart, (N + 1) * sizeof(int));
+	nn->cand.idx = cloneMem(PredIdx, (PredStart[N] + 1) * sizeof(int));
+	nn->cand.val = NULL;
+	for (v = VIEW_IN; v <= VIEW_OUT; v++)
+		AllocArray(nn->leaves[v], NodeNum);
+	for (b = Leaf; b; b = b->next) {
+		c = cloneMem(b, sizeof(*b));
+		if (b->same != NULL) {
+			// the copy of the entry it shares, made before it
+			for (s = nn->copies; s->addr != b->same->addr || s->outgroup != b->same->outgroup; s = s->next)
+				;
+			c->pred = s->pred;
+			c->predCol = s->predCol;
+			c->there = s->there;
+			c->same = s;
 		} else {
-			return 1;
+			np = (b->predCol != NULL) ? b->npred + 1 : N;
+			c->pred = cloneMem(b->pred, np * sizeof(int));
+			if (b->predCol != NULL)
+				c->predCol = cloneMem(b->predCol, (b->npred + 1) * sizeof(int));
+			c->there = cloneMem(b->there, (N + 63) / 64 * sizeof(uint64_t));
 		}
+		for (v = VIEW_IN; v <= VIEW_OUT; v++)
+			if (b->addr->data[v] == b)
+				nn->leaves[v][b->addr->id] = c;
+		c->next = nn->copies;
+		nn->copies = c;
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(old), &old);
+}
+
+static void numaBegin(struct llContext *ctx, int per) {
+	int n, t;
+
+	NumaUsed = 0;
+	if (!Numa)
+		return;
+	readNumaNodes();
+	NumaUsed = min(NumaNum, Threads);
+	if (NumaUsed < 2)
+		return;
+	run_jobs(NumaUsed, NumaUsed, numaCopyJob, NULL);
+	for (t = 0; t < Threads * per; t++) {
+		n = numaNodeOf(t / per);
+		ctx[t].cand = &NumaNode[n].cand;
+		ctx[t].leaves = NumaNode[n].leaves[ctx[t].view];
 	}
-	
-	if (anc->child[LEFT] == NULL)
-		left = 1;
-	else {
-		for (s = A; s < Z; s++) {
-			if (Val(DPPI, s, j) == YES) {
-				left += getLP(anc->child[LEFT], i, s) * getLL(anc->child[LEFT], s, j);
+}
+
+static void numaEnd() {
+	struct nodeList *c;
+	int n, v;
+
+	for (n = 0; n < NumaUsed && NumaUsed >= 2; n++) {
+		freez(&NumaNode[n].cand.start);
+		freez(&NumaNode[n].cand.idx);
+		for (v = VIEW_IN; v <= VIEW_OUT; v++)
+			freez(&NumaNode[n].leaves[v]);
+		while ((c = NumaNode[n].copies) != NULL) {
+			NumaNode[n].copies = c->next;
+			if (c->same == NULL) {
+				freeMem(c->pred);
+				freeMem(c->predCol);
+				freeMem(c->there);
 			}
+			freeMem(c);
 		}
 	}
-	
-	if (anc->child[RIGHT] == NULL)
-		right = 1;
-	else {
-		for (s = A; s < Z; s++) {
-			if (Val(DPPI, s, j) == YES) {
-	
-				right += getLP(anc->child[RIGHT], i, s) * getLL(anc->child[RIGHT], s, j);
-			}
-		}
+	NumaUsed = 0;
+}
+
+// the shares of the tile lo .. TileHi-1, of about the same number of candidates
+static void numaShares(int lo) {
+	int n, j = lo;
+	double total = PredStart[TileHi] - PredStart[lo];
+
+	for (n = 0; n < NumaUsed; n++) {
+		NumaNode[n].lo = NumaNode[n].next = j;
+		for (; j < TileHi && (PredStart[j] - PredStart[lo]) * NumaUsed < total * (n+1); j++)
+			;
+		NumaNode[n].hi = (n == NumaUsed - 1) ? TileHi : j;
 	}
-	
-	val = log(left) + log(right);
-	val = exp(val);
-	return (left * right);
 }
 
-static void normalize() {
-	int i;
-	double psum, ssum;
-	struct matrix *pt;
-	for (i = A+1; i < Z; i++) {
-		psum = 0;
-		for (pt = PLH+i; pt; pt = pt->next)
-			psum += pt->val;
-		for (pt = PLH+i; pt; pt = pt->next) {
-			PSet(PPP, pt->x, i, pt->val/psum);
-		}
+// the next column for a thread of node home, -1 once the tile is done
+// the end of the cache tile from lo: the columns whose rows take at most
+// CacheTileBytes, fewer where their candidate lists are long, one at least
+static int cacheTileEnd(int lo, int hi) {
+	int j = lo + 1;
+
+	while (j < hi && j - lo < CacheTileCols
+		&& (double)(PredStart[j+1] - PredStart[lo]) * PlanRows * sizeof(llReal) <= CacheTileBytes)
+		j++;
+	return j;
+}
+
+// the next columns of *next .. end-1, a cache tile of them or one
+static int drawRange(int *next, int end, int *hi) {
+	int j;
+
+	if (CacheTileBytes == 0) {
+		*hi = (j = __sync_fetch_and_add(next, 1)) + 1;
+		return (j < end) ? j : -1;
 	}
-	for (i = A+1; i < Z; i++) {
-		ssum = 0;
-		for (pt = SLH+i; pt; pt = pt->next)
-			ssum += pt->val;
-		for (pt = SLH+i; pt; pt = pt->next) {
-			SSet(SPP, i, pt->x, pt->val/ssum);
-		}
+	do {
+		if ((j = *next) >= end)
+			return -1;
+		*hi = cacheTileEnd(j, end);
+	} while (!__sync_bool_compare_and_swap(next, j, *hi));
+	return j;
+}
+
+static int drawColumn(int home, int *hi) {
+	int j, k, n;
+
+	if (NumaUsed == 0)
+		return drawRange(&NextCol, TileHi, hi);
+	for (k = 0; k < NumaUsed; k++) {
+		n = (home + k) % NumaUsed;
+		if (NumaNode[n].next < NumaNode[n].hi
+			&& (j = drawRange(&NumaNode[n].next, NumaNode[n].hi, hi)) >= 0)
+			return j;
 	}
-	for (i = A+1; i < Z; i++) {
-		if (Val(DPPI, A, i) == YES)
-			SSet(SPP, A, i, PVal(PPP, A, i));
+	return -1;
+}
+
+// columns are handed out one at a time from a shared counter (with -numa
+// one per node), so threads that draw cheap columns simply take more of
+// them; with -cacheTile a tile of them at a time. That pays where the rows
+// of a column outgrow L1 (large trees and candidate lists); with them in
+// L1 a column at a time came out faster. A column reads only the
+// candidate index, the leaf pred/extra/there arrays and the branch
+// probabilities, and writes only its stretch PLH.val[PredStart[j] ..
+// PredStart[j+1]) and ColScale[j]; this is the boundary another backend
+// (a device one taking blocks of consecutive columns) would replace.
+static void predecessorWorker(int t, void *arg) {
+	struct llContext *ctx = (struct llContext *)arg + t * ((TargetNum > 0) ? 2 : 1);
+	int j, hi, home = 0;
+	long cand;
+	cpu_set_t old;
+
+	if (NumaUsed > 0) {
+		home = numaNodeOf(t);
+		pthread_getaffinity_np(pthread_self(), sizeof(old), &old);
+		pinToNode(home);
 	}
-	for (i = A+1; i < Z; i++) {
-		if (Val(DPPI, i, Z) == YES)
-			PSet(PPP, i, Z, SVal(SPP, i, Z));
+	while ((j = drawColumn(home, &hi)) >= 0) {
+		if (CacheTileBytes > 0) {
+			predecessorTile(ctx, j, hi);
+			__sync_synchronize();
+			for (cand = 0; j < hi; j++)
+				if (!ColDone[j]) {
+					ColDone[j] = 1;
+					progress_add(Progress, 1, 0);
+					cand += PredStart[j+1] - PredStart[j];
+				}
+			progress_add(Progress, 0, cand);
+			maybeCheckpoint();
+			continue;
+		}
+		if (ColDone[j])
+			continue;
+		if (TargetNum > 0)
+			targetColumn(ctx, j);
+		else
+			predecessorColumn(ctx, j);
+		__sync_synchronize();
+		ColDone[j] = 1;
+		progress_add(Progress, 1, PredStart[j+1] - PredStart[j]);
+		maybeCheckpoint();
 	}
+	if (NumaUsed > 0)
+		pthread_setaffinity_np(pthread_self(), sizeof(old), &old);
+}
+
+/* the columns are evaluated in cache tiles where a column is the plan of
+ * predecessorColumn() alone: not with -ancestors, -jackknife or -llcache,
+ * nor with the skipped candidates of -epsilon in a slot of each node */
+static void planCacheTiles() {
+	long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+
+	CacheTileBytes = CacheTile;
+	// an L2 of 1 MB where the system does not tell
+	if (CacheTileBytes < 0)
+		CacheTileBytes = (l2 > 0 ? l2 : 1 << 20) / 2;
+	if (TargetNum > 0 || JackNum > 0 || LLCacheDir != NULL || Plan == NULL || SkipStart != NULL)
+		CacheTileBytes = 0;
+	// a column takes one row of each slot, and its sums and scales
+	CacheTileCols = CacheTileBytes / (2.0 * NodeNum * D) + 1;
+	if (CacheTileBytes > 0)
+		fprintf(stderr, "Columns evaluated node by node in tiles of %.0f KB\n",
+			CacheTileBytes / 1024);
 }
 
+// in multi-ancestor mode each thread owns an inside and an outside context
 static void getPredecessor() {
-	int i, j;
-	double val;
-	for (j = A+1; j < Z; j++) {
-		for (i = A; i < Z; i++) {
-			if (Val(DPPI, i, j) == NO) {
-				continue;
-			} else {
-				val = preLikelihood(Ances, i, j);
-				PSet(PLH, i, j, val);
-			}
+	struct llContext *ctx;
+	int j, t, lo, n, per = (TargetNum > 0) ? 2 : 1;
+	long cand;
+
+	planCacheTiles();
+	AllocArray(ctx, Threads * per);
+	for (t = 0; t < Threads * per; t++)
+		initContext(ctx+t, t % per);
+	if (TargetNum > 0) {
+		for (t = 1; t < Threads * per; t += per) {
+			AllocArray(ctx[t].outside, NodeNum * MaxCol + 1);
+			AllocArray(ctx[t].outScale, NodeNum);
+			AllocArray(ctx[t].down, MaxCol + 1);
+		}
+		AllocArray(TargetPLH, TargetNum);
+		AllocArray(TargetScale, TargetNum);
+		for (t = 0; t < TargetNum; t++) {
+			TargetPLH[t] = allocValues();
+			AllocArray(TargetScale[t], N);
 		}
 	}
-}
-
-static void getSuccessor() {
-	int i, j;
-	double v;
-	struct matrix *pt;
-	for (j = A; j <= Z; j++) {
-		v = PVal(PLH, A, map(j));
-		if (v > 0) {
-			SSet(SLH, j, Z, v);
+	if (JackNum > 0) {
+		AllocArray(JackPLH, JackNum);
+		AllocArray(JackScale, JackNum);
+		for (t = 0; t < JackNum; t++) {
+			JackPLH[t] = allocValues();
+			AllocArray(JackScale[t], N);
 		}
 	}
-	for (i = A+1; i < Z; i++) {
-		for (pt = PLH+i; pt; pt = pt->next) {
-			if (pt->val > 0) { 
-				SSet(SLH, map(i), map(pt->x), pt->val);
-			}
+	partRange();
+	Rescaled = FALSE;
+	AllocArray(ColDone, N);
+	loadCheckpoints();
+	// -blocks: the columns not needed are left out, as if done
+	for (j = A+1; j < Z && Needed != NULL; j++)
+		ColDone[j] |= !Needed[j];
+	if (LLCacheDir != NULL && TargetNum == 0) {
+		for (j = A+1; j < Z && !ColDone[j]; j++)
+			;
+		openLLCache(PartN == 0 && j == Z);
+	}
+	LastCheckpoint = time(NULL);
+	// the columns still to do, weighed by their candidates for the time left
+	for (n = 0, cand = 0, j = PartLo; j < PartHi; j++)
+		if (!ColDone[j]) {
+			n++;
+			cand += PredStart[j+1] - PredStart[j];
 		}
+	Progress = progress_start("inferAdjProb", "columns", n, "candidates", cand);
+	numaBegin(ctx, per);
+	for (lo = PartLo; lo < PartHi; lo = TileHi) {
+		TileHi = nextTile(lo, PartHi);
+		NextCol = lo;
+		if (NumaUsed > 0)
+			numaShares(lo);
+		run_jobs(Threads, Threads, predecessorWorker, ctx);
+		releaseValues(lo, TileHi);
 	}
+	numaEnd();
+	progress_end(Progress);
+	Progress = NULL;
+	for (t = 0; t < Threads * per; t++)
+		freeContext(ctx+t);
+	freeMem(ctx);
+	if (LLCacheIn != NULL)
+		closeLLCache(TRUE);
+	if (PartN > 0) {
+		writeCheckpoint();
+		fprintf(stderr, "Part %d of %d: columns %d to %d in %s\n",
+			PartK, PartN, PartLo, PartHi-1, CheckpointFile);
+	} else if (CheckpointFile)
+		remove(CheckpointFile);
+	freez(&ColDone);
 }
 
 static int calculateTotalEle(char* refspc, struct phyloTree *tree) {
@@ -827,6 +3484,7 @@ static void modifyBranchLen(struct phyloTree *node, struct phyloTree *child) {
 	if (node == NULL)
 		return;
 	modifyBranchLen(node->parent, node);
+	node->dist = child->dist;
 	node->distalpha = child->distalpha;
 }
 
@@ -834,10 +3492,11 @@ static void modifyTree() {
 	struct phyloTree *anc, *nr;
 	AllocVar(anc);
 	anc->parent = NULL;
-	anc->distalpha = 0;
+	anc->dist = anc->distalpha = 0;
+	anc->id = NodeNum++;
 	anc->name = cloneString("NEWROOT");
 	modifyBranchLen(Ances->parent, Ances);
-	Ances->distalpha = 0;
+	Ances->dist = Ances->distalpha = 0;
 	nr = Ances->parent;
 	if (Ances == nr->child[RIGHT]) {
 		anc->child[LEFT] = NULL;
@@ -861,104 +3520,131 @@ static void modifyTree() {
 	Phylo = Ances;
 }
 
-static void sortWeightedEdges() {
-	struct edgeList *q, *p;
-	int i, j;
-	double val;
+// heaviest first, ties broken by position so the CARs are reproducible
+static int cmpWeightedEdge(const void *va, const void *vb) {
+	const struct weightedEdge *a = va, *b = vb;
+	if (a->wei != b->wei)
+		return (a->wei > b->wei) ? -1 : 1;
+	if (a->i != b->i)
+		return a->i - b->i;
+	return a->j - b->j;
+}
+
+static int findSet(int *parent, int x) {
+	while (parent[x] != x)
+		x = parent[x] = parent[parent[x]];
+	return x;
+}
+
+// block s of the evaluation as the blocks of the input it stands for
+static void printBlocks(FILE *fp, int s) {
+	int k;
+
+	if (SuperPath == NULL)
+		fprintf(fp, "%d ", s);
+	else if (s > 0)
+		for (k = SuperStart[s]; k < SuperStart[s+1]; k++)
+			fprintf(fp, "%d ", SuperPath[k]);
+	else
+		for (k = SuperStart[-s+1] - 1; k >= SuperStart[-s]; k--)
+			fprintf(fp, "%d ", -SuperPath[k]);
+}
+
+// greedy CARs straight from the posteriors: take adjacencies by decreasing
+// probability, skipping one whose extremities are already joined or which
+// would close a cycle. Extremity x is the right end of index x, so i -> j
+// occupies i and map(j); the telomeres A and Z may be used any number of
+// times.
+static void writeCars(char *fileName) {
+	struct weightedEdge *edge;
+	int *partner, *parent, *sz;
+	unsigned char *seen;
+	int i, j, k, n = 0, x, y, b, cur, car = 0;
+	FILE *fp;
+
+	AllocArray(edge, SuccStart[Z+1] + 1);
 	for (i = A; i < Z; i++) {
-		for (j = A; j < Z; j++) {
-			if (Val(DPPI, i, j) == NO)
+		for (k = SuccStart[i]; k < SuccStart[i+1]; k++) {
+			j = SuccIdx[k];
+			// i -> j and map(j) -> map(i) are the same adjacency
+			if ((pam(i) == 0 && pam(j) == 0) || i >= map(j))
 				continue;
-			if ((val = PVal(PPP, i, j)) > 0) {
-				AllocVar(p);
-				p->i = i;
-				p->j = j;
-				p->wei = val;
-				if (Edgelist == NULL)
-					Edgelist = p;
-				else if (p->wei > Edgelist->wei) {
-					p->next = Edgelist;
-					Edgelist = p;
-				}
-				else {
-					for (q = Edgelist; q->next; q = q->next) {
-						if (p->wei > q->next->wei 
-							|| (q->i == map(p->j) && q->j == map(p->i)))
-							break;
-					}
-					p->next = q->next;
-					q->next = p;
-				}
-			}
-		}				
+			if ((edge[n].wei = adjProb(i, k)) <= 0)
+				continue;
+			edge[n].i = i;
+			edge[n].j = j;
+			n++;
+		}
 	}
-}
+	qsort(edge, n, sizeof(*edge), cmpWeightedEdge);
 
-static void modifyAuxGraph() {
-	int i;
-	struct edgeList *p;
-	int start[N], end[N];
-	for (i = A; i < N; i++)
-		start[i] = end[i] = 0;
-	for (p = Edgelist; p; p = p->next) {
-		if (start[p->i] == 0 && end[p->j] == 0) {
-			Set(G, p->i, p->j, YES);
-			Set(G, map(p->j), map(p->i), YES);
-			if (p->i != A) 
-				start[p->i] = end[map(p->i)] = 1;
-			if (p->j != Z) 
-				end[p->j] = start[map(p->j)] = 1;
+	AllocArray(partner, N);
+	AllocArray(parent, T+1);
+	AllocArray(sz, T+1);
+	for (x = 0; x < N; x++)
+		partner[x] = -1;
+	for (b = 1; b <= T; b++) {
+		parent[b] = b;
+		sz[b] = 1;
+	}
+	for (k = 0; k < n; k++) {
+		x = edge[k].i;
+		y = map(edge[k].j);
+		if ((x != A && partner[x] != -1) || (y != A && partner[y] != -1))
+			continue;
+		if (x != A && y != A) {
+			i = findSet(parent, abs(pam(x)));
+			j = findSet(parent, abs(pam(y)));
+			if (i == j)
+				continue;
+			if (sz[i] < sz[j]) {
+				parent[i] = j;
+				sz[j] += sz[i];
+			} else {
+				parent[j] = i;
+				sz[i] += sz[j];
+			}
 		}
+		if (x != A)
+			partner[x] = y;
+		if (y != A)
+			partner[y] = x;
 	}
-}
 
-static void removeCycles() {
-	int i, j, s, starti, total;
-	int mini, minj;
-	double minwei = 2.0;
-	int used[N], buf[N];
-	mini = minj = 0;
-	for (i = A; i < N; i++)
-		used[i] = 0;
-	for (;;) {
-		for (i = A+1; i < Z; i++)
-			if (used[i] == 0)
-				break;
-		if (i == Z)
-			break;
-		starti = i;
-		total = 0;
+	// walk each chain from the block end with no neighbour
+	AllocArray(seen, T+1);
+	fp = mustOpen(fileName, "w");
+	fprintf(fp, ">ANCESTOR\t%d\n", BlockNum);
+	for (b = 1; b <= T; b++) {
+		if (seen[b])
+			continue;
+		if (partner[map(b)] == -1 || partner[map(b)] == A)
+			cur = b;
+		else if (partner[b] == -1 || partner[b] == A)
+			cur = map(b);
+		else
+			continue;
+		fprintf(fp, "# CAR %d\n", ++car);
 		for (;;) {
-			buf[total++] = i;
-			used[i] = 1;
-			for (j = A+1; j < Z; j++)
-				if (Val(G, i, j) && used[j] == 0)
-					break;
-			if (j == Z) {
-				if (Val(G, i, starti)) {
-					for (s = 0; s < total; s++) {
-						if (PVal(PPP, buf[s], buf[(s+1)%total]) < minwei) {
-							mini = buf[s];
-							minj = buf[(s+1)%total];
-							minwei = PVal(PPP, buf[s], buf[(s+1)%total]);
-						}
-					}
-					Set(G, mini, minj, NO);
-					mini = minj = 0;
-					minwei = 2.0;
-				}					
+			seen[abs(pam(cur))] = 1;
+			printBlocks(fp, pam(cur));
+			if (partner[cur] == -1 || partner[cur] == A)
 				break;
-			}
-			else 
-				i = j;
+			cur = map(partner[cur]);
 		}
+		fprintf(fp, "$\n");
 	}
+	carefulClose(&fp);
+	freeMem(seen);
+	freeMem(partner);
+	freeMem(parent);
+	freeMem(sz);
+	freeMem(edge);
 }
 
 static void freeTreeNode(struct phyloTree **node) {
 	struct phyloTree *p = *node;
 	freeMem(p->name);
-	slFreeList(&(p->genome));
 	freez(node);
 }
 
@@ -1002,74 +3688,847 @@ static void printTree(struct phyloTree *node) {
 }
 
 
-static void calculatePostProb() {
-    int i, j;
-    double pprob, pprob2, pmin, pmax, val;
-    FILE *joinprobfile;
+/* Binary adjacencies.prob: an 8-byte magic, int32 version, int32 T, then
+ * one record per candidate adjacency (struct adjprob_adj: int32 block,
+ * int32 block, float64 probability) in host byte order. */
+#define ADJPROB_MAGIC "ADJPROB"
+#define ADJPROB_VERSION 1
+
+// the records collectPostProb() may fill
+static int postProbMax() {
+	return SuccStart[Z+1] + 2 * (BlockNum - T) + 1;
+}
+
+// an adjacency in the order of the files, by the row and the column of its
+// ends among the blocks of the input
+static int postProbCmp(const void *va, const void *vb) {
+	const struct adjprob_adj *a = va, *b = vb;
+	int ra = (a->b1 >= 0) ? a->b1 : BlockNum - a->b1, rb = (b->b1 >= 0) ? b->b1 : BlockNum - b->b1;
+	int ca = (a->b2 == 0) ? 2 * BlockNum + 1 : (a->b2 > 0) ? a->b2 : BlockNum - a->b2;
+	int cb = (b->b2 == 0) ? 2 * BlockNum + 1 : (b->b2 > 0) ? b->b2 : BlockNum - b->b2;
+
+	if (ra != rb)
+		return ra - rb;
+	return ca - cb;
+}
+
+// an adjacency of the input blocks b1 and b2 is written: -blocks lists one
+static boolean wantedAdj(int b1, int b2) {
+	return Wanted == NULL || Wanted[abs(b1)] || Wanted[abs(b2)];
+}
+
+// the posteriors of every candidate adjacency, in the order of the files,
+// with those inside the super-blocks
+static int collectPostProb(struct adjprob_adj *rec) {
+	int i, j, k, n = 0, s;
 
-    joinprobfile = mustOpen("adjacencies.prob", "w");
-    fprintf(joinprobfile, "#%d\n", T);
-   
-	pmin = pmax = 1; 
 	for (i = A; i <= Z; i++) {
-        for (j = A; j <= Z; j++) {
-            if (pam(i) == 0 || pam(j) == 0) continue;
-            if (Val(DPPI, i, j) == 0)
-                continue;
-            
-			val = log(PVal(PLH, i, j)) + log(SVal(SLH, i, j));
-			if (pmin == 1) pmin = val;
-			else {
-				if (val < pmin) pmin = val;
-			}
-			
-			if (pmax == 1) pmax = val;
-			else {
-				if (val > pmax) pmax = val;
+		for (k = SuccStart[i]; k < SuccStart[i+1]; k++) {
+			j = SuccIdx[k];
+			if ((pam(i) == 0 && pam(j) == 0) || (Keep && !Keep[k])) continue;
+			rec[n].b1 = blockEnd(pam(i), TRUE);
+			rec[n].b2 = blockEnd(pam(j), FALSE);
+			if (!wantedAdj(rec[n].b1, rec[n].b2)) continue;
+			rec[n].prob = adjProb(i, k);
+			n++;
+		}
+	}
+	if (SuperPath == NULL)
+		return n;
+	for (s = 1; s <= T; s++)
+		for (k = SuperStart[s]; k + 1 < SuperStart[s+1]; k++) {
+			if (!wantedAdj(SuperPath[k], SuperPath[k+1])) continue;
+			rec[n].b1 = SuperPath[k];
+			rec[n].b2 = SuperPath[k+1];
+			rec[n++].prob = 1;
+			rec[n].b1 = -SuperPath[k+1];
+			rec[n].b2 = -SuperPath[k];
+			rec[n++].prob = 1;
+		}
+	qsort(rec, n, sizeof(*rec), postProbCmp);
+	return n;
+}
+
+// "%d<sep>%d\t%e\n", the line of an adjacency in the text outputs
+static void textAdj(struct text_buf *t, int b1, char sep, int b2, double prob) {
+	text_int(t, b1);
+	text_char(t, sep);
+	text_int(t, b2);
+	text_char(t, '\t');
+	text_exp(t, prob);
+	text_char(t, '\n');
+}
+
+static void calculatePostProb(char *fileName, boolean binary) {
+	int i, k, n;
+	struct adjprob_adj *rec;
+	struct text_buf t;
+	FILE *joinprobfile;
+
+	joinprobfile = mustOpen(fileName, binary ? "wb" : "w");
+	AllocArray(rec, postProbMax());
+	n = collectPostProb(rec);
+	if (!binary) {
+		fprintf(joinprobfile, "#%d\n", BlockNum);
+		text_begin(&t, joinprobfile);
+		for (k = 0; k < n; k++)
+			textAdj(&t, rec[k].b1, ' ', rec[k].b2, rec[k].prob);
+		text_flush(&t);
+	} else {
+		mustWrite(joinprobfile, ADJPROB_MAGIC, sizeof(ADJPROB_MAGIC));
+		i = ADJPROB_VERSION;
+		writeOne(joinprobfile, i);
+		writeOne(joinprobfile, BlockNum);
+		mustWrite(joinprobfile, rec, n * sizeof(*rec));
+	}
+	carefulClose(&joinprobfile);
+	freeMem(rec);
+}
+
+/* The scores of block_consscores.txt, as script/refine_adjprob.pl made
+ * them from adjacencies.prob: every adjacency printed with |b1| <= |b2|,
+ * as -b2 -b1 otherwise, once (the last of the same kept), sorted by |b1|
+ * and then b1, |b2| and b2. The probabilities are printed as in the .prob
+ * file, or as perl prints a double for a binary one. */
+struct scoreRecord {
+	int b1, b2, seq;
+	double prob;
+};
+
+static int scoreCmp(const void *va, const void *vb) {
+	const struct scoreRecord *a = va, *b = vb;
+
+	if (abs(a->b1) != abs(b->b1))
+		return abs(a->b1) < abs(b->b1) ? -1 : 1;
+	if (a->b1 != b->b1)
+		return a->b1 < b->b1 ? -1 : 1;
+	if (abs(a->b2) != abs(b->b2))
+		return abs(a->b2) < abs(b->b2) ? -1 : 1;
+	if (a->b2 != b->b2)
+		return a->b2 < b->b2 ? -1 : 1;
+	return a->seq - b->seq;
+}
+
+static void writeScores(char *fileName, boolean binary) {
+	int k, n, b1, b2;
+	struct adjprob_adj *adj;
+	struct scoreRecord *rec;
+	struct text_buf t;
+	FILE *fp;
+
+	AllocArray(adj, postProbMax());
+	n = collectPostProb(adj);
+	AllocArray(rec, n + 1);
+	for (k = 0; k < n; k++) {
+		b1 = adj[k].b1;
+		b2 = adj[k].b2;
+		if (abs(b1) > abs(b2)) {
+			rec[k].b1 = -b2;
+			rec[k].b2 = -b1;
+		} else {
+			rec[k].b1 = b1;
+			rec[k].b2 = b2;
+		}
+		rec[k].seq = k;
+		rec[k].prob = adj[k].prob;
+	}
+	freeMem(adj);
+	qsort(rec, n, sizeof(*rec), scoreCmp);
+
+	fp = mustOpen(fileName, "w");
+	text_begin(&t, fp);
+	for (k = 0; k < n; k++) {
+		if (k + 1 < n && rec[k+1].b1 == rec[k].b1 && rec[k+1].b2 == rec[k].b2)
+			continue;
+		if (binary)
+			fprintf(fp, "%d\t%d\t%.15g\n", rec[k].b1, rec[k].b2, rec[k].prob);
+		else
+			textAdj(&t, rec[k].b1, '\t', rec[k].b2, rec[k].prob);
+	}
+	text_flush(&t);
+	carefulClose(&fp);
+	freeMem(rec);
+}
+
+// the -scores (or -dropped) file of an ancestor (NULL for the '@' one)
+// and alpha tag
+static void taggedName(char *buf, int size, char *base, char *ancestor, char *tag) {
+	char *dot = strrchr(base, '.');
+	int stem = (dot != NULL && strchr(dot, '/') == NULL) ? dot - base : (int)strlen(base);
+
+	safef(buf, size, "%.*s%s%s%s%s", stem, base, ancestor ? "." : "",
+		ancestor ? ancestor : "", tag, base + stem);
+}
+
+// adjacencies....prob -> adjacencies....cars, in place
+static char *carsName(char *fileName) {
+	strcpy(fileName + strlen(fileName) - strlen("prob"), "cars");
+	return fileName;
+}
+
+static int keepCmp(const void *va, const void *vb) {
+	const double *a = *(const double **)va, *b = *(const double **)vb;
+
+	if (*a != *b)
+		return *a > *b ? -1 : 1;
+	return a < b ? -1 : 1;
+}
+
+/* -minProb and -topK: Keep the adjacencies, in both readings, of at least
+ * MinProb in either reading that are among the TopK most probable of the
+ * row of either reading. The telomere rows rank none, so that a chromosome
+ * end keeps any number. -dropped writes, for every row that lost some, the
+ * posterior and the number of its readings left out */
+static void selectOutputs(char *droppedFile) {
+	int i, j, k, m, len, n = SuccStart[Z+1], lost = 0, *cnt;
+	unsigned char *top = NULL;
+	double *p, **ord, *mass;
+	FILE *fp;
+
+	AllocArray(p, n + 1);
+	AllocArray(Keep, n + 1);
+	for (i = A; i <= Z; i++)
+		for (k = SuccStart[i]; k < SuccStart[i+1]; k++)
+			p[k] = adjProb(i, k);
+	if (TopK > 0) {
+		AllocArray(top, n + 1);
+		AllocArray(ord, n + 1);
+		for (i = A+1; i < Z; i++) {
+			len = SuccStart[i+1] - SuccStart[i];
+			for (k = 0; k < len; k++)
+				ord[k] = &p[SuccStart[i] + k];
+			if (len > TopK)
+				qsort(ord, len, sizeof(*ord), keepCmp);
+			for (k = 0; k < len && k < TopK; k++)
+				top[ord[k] - p] = 1;
+		}
+		freeMem(ord);
+	}
+	for (i = A; i <= Z; i++) {
+		for (k = SuccStart[i]; k < SuccStart[i+1]; k++) {
+			j = SuccIdx[k];
+			if (pam(i) == 0 && pam(j) == 0)
+				continue;
+			m = findSlot(&SLH, map(j), map(i));
+			Keep[k] = (p[k] >= MinProb || p[m] >= MinProb);
+			if (Keep[k] && top != NULL)
+				Keep[k] = top[k] || top[m];
+		}
+	}
+	if (droppedFile != NULL) {
+		AllocArray(mass, Z + 1);
+		AllocArray(cnt, Z + 1);
+		for (i = A; i <= Z; i++) {
+			for (k = SuccStart[i]; k < SuccStart[i+1]; k++) {
+				j = SuccIdx[k];
+				if ((pam(i) == 0 && pam(j) == 0) || Keep[k])
+					continue;
+				mass[i] += p[k];
+				cnt[i]++;
+				lost++;
 			}
 		}
+		fp = mustOpen(droppedFile, "w");
+		fprintf(fp, "#%d\t%d\n", lost, n + 2 * (BlockNum - T));
+		for (i = A; i <= Z; i++)
+			if (cnt[i] > 0)
+				fprintf(fp, "%d\t%e\t%d\n", blockEnd(pam(i), TRUE), mass[i], cnt[i]);
+		carefulClose(&fp);
+		freeMem(mass);
+		freeMem(cnt);
 	}
+	freeMem(top);
+	freeMem(p);
+}
 
-    for (i = A; i <= Z; i++) {
-        for (j = A; j <= Z; j++) {
-            if (pam(i) == 0 && pam(j) == 0) continue;
+// normalize the likelihoods in PLH and write them out
+static void finishAncestor(char *fileName, char *scoresFile, char *droppedFile,
+		boolean binary) {
+	struct phaseClock c;
+	int k, n = PredStart[N];
 
-            if (Val(DPPI, i, j) == 0)
-                continue;
-            pprob2 = PVal(PLH, i, j)*SVal(SLH, i, j);
-            pprob = PVal(PPP, i, j) * SVal(SPP, i, j);
-            fprintf(joinprobfile, "%d %d\t%e\n", pam(i), pam(j), pprob);
-        }
-    }
+	for (k = 0; k < n; k++) {
+		NonzeroPLH += (PLH.val[k] != 0);
+		NonzeroSLH += (succVal(k) != 0);
+	}
+	Outputs++;
+	phaseBegin(&c);
+	normalize();
+	phaseEnd(PH_NORM, &c);
+	phaseBegin(&c);
+	if (MinProb > 0 || TopK > 0)
+		selectOutputs(droppedFile);
+	calculatePostProb(fileName, binary);
+	if (scoresFile != NULL)
+		writeScores(scoresFile, binary);
+	freez(&Keep);
+	if (optionExists("cars"))
+		writeCars(carsName(fileName));
+	phaseEnd(PH_POST, &c);
+}
 
-    fclose(joinprobfile);
+/* the sets of posteriors a run of getPredecessor() leaves: that of the '@'
+ * ancestor and those of -jackknife, or those of the -ancestors. The name of
+ * one, in the file names, is NULL for the '@' ancestor */
+static int resultNum() {
+	if (TargetNum > 0)
+		return TargetPLH ? TargetNum : 0;
+	return 1 + (JackPLH ? JackNum : 0);
 }
 
-int main(int argc, char *argv[]) {
-	optionInit(&argc, argv, options);
-	if (argc != 5)
-		usage();
-	alpha = atof(argv[2]);
-	printf("alpha=%f\n", alpha);
-	Phylo = readTreeFile(argv[3]);
-	identifyOutgroup(Phylo);
-	if (Ances != Phylo)
-		modifyTree();
-	assert(Ances == Phylo);
+static char *resultName(int r, char *buf, int size) {
+	if (TargetNum > 0)
+		return Targets[r]->name;
+	if (r == 0)
+		return NULL;
+	safef(buf, size, "drop_%s", JackLeaf[r-1]->name);
+	return buf;
+}
+
+// point PLH and ColScale at the likelihoods of the result r
+static void selectResult(int r) {
+	if (Selected < 0) {
+		MainPLH = PLH.val;
+		MainScale = ColScale;
+	}
+	if (TargetNum > 0) {
+		PLH.val = TargetPLH[r];
+		ColScale = TargetScale[r];
+	} else if (r > 0) {
+		PLH.val = JackPLH[r-1];
+		ColScale = JackScale[r-1];
+	} else {
+		PLH.val = MainPLH;
+		ColScale = MainScale;
+		r = -1;
+	}
+	Selected = r;
+}
+
+// drop the results of the other ancestors, back to the '@' one
+static void freeResults() {
+	int t;
+
+	if (Selected >= 0) {
+		PLH.val = MainPLH;
+		ColScale = MainScale;
+		Selected = -1;
+	}
+	for (t = 0; t < TargetNum && TargetPLH != NULL; t++) {
+		freeValues(&TargetPLH[t]);
+		freeMem(TargetScale[t]);
+	}
+	freez(&TargetPLH);
+	freez(&TargetScale);
+	for (t = 0; t < JackNum && JackPLH != NULL; t++) {
+		freeValues(&JackPLH[t]);
+		freeMem(JackScale[t]);
+	}
+	freez(&JackPLH);
+	freez(&JackScale);
+}
+
+// the posterior of every Succ entry the outputs read, once normalize() is done
+static double *allPosteriors() {
+	double *post;
+	int i, k;
+
+	AllocArray(post, PredStart[N] + 1);
+	for (i = A; i <= Z; i++)
+		for (k = SuccStart[i]; k < SuccStart[i+1]; k++)
+			if ((pam(i) != 0 || pam(SuccIdx[k]) != 0)
+					&& wantedAdj(blockEnd(pam(i), TRUE), blockEnd(pam(SuccIdx[k]), FALSE)))
+				post[k] = adjProb(i, k);
+	return post;
+}
+
+// -pseudoCheck: the posteriors of the whole tree, before pseudoLeaves()
+static double *wholeTreePosteriors() {
+	struct phaseClock c;
+
+	setTransitionProbs(Phylo);
+	fprintf(stderr, "Computing posterior probabilities on the whole tree ...\n");
+	phaseBegin(&c);
+	getPredecessor();
+	phaseEnd(PH_PRED, &c);
+	normalize();
+	return allPosteriors();
+}
+
+// the deviation of the posteriors of the pseudo-leaves from exact
+static void pseudoDeviation(double *exact) {
+	double *post, d, sum = 0;
+	int k, n = PredStart[N], over = 0;
+
+	normalize();
+	post = allPosteriors();
+	PseudoMax = 0;
+	for (k = 0; k < n; k++) {
+		d = fabs(post[k] - exact[k]);
+		PseudoMax = max(PseudoMax, d);
+		sum += d;
+		over += (d > 0.01);
+	}
+	PseudoMean = (n > 0) ? sum / n : 0;
+	fprintf(stderr, "Posteriors of the %d pseudo-leaves off those of the whole tree by at most %g, "
+		"%g on average; %d of %d candidates by more than 0.01\n",
+		PseudoNum, PseudoMax, PseudoMean, over, n);
+	freeMem(post);
+}
+
+// normalize the likelihoods of the current alpha and write one file per
+// ancestor; alphaTag is NULL unless several alphas are swept
+static void writePosteriors(char *alphaTag, boolean binary) {
+	char fileName[PATH_LEN], tag[PATH_LEN], scores[PATH_LEN], drop[PATH_LEN];
+	char dropped[PATH_LEN];
+	char *scoresFile = optionExists("scores") ? scores : NULL, *name;
+	char *droppedFile = optionExists("dropped") ? dropped : NULL;
+	int r;
+
+	tag[0] = '\0';
+	if (alphaTag)
+		safef(tag, sizeof(tag), ".alpha_%s", alphaTag);
+	for (r = 0; r < resultNum(); r++) {
+		selectResult(r);
+		if ((name = resultName(r, drop, sizeof(drop))) == NULL)
+			safef(fileName, sizeof(fileName), "adjacencies%s.prob", tag);
+		else
+			safef(fileName, sizeof(fileName), "adjacencies.%s%s.prob", name, tag);
+		if (scoresFile)
+			taggedName(scores, sizeof(scores), optionVal("scores", NULL), name, tag);
+		if (droppedFile)
+			taggedName(dropped, sizeof(dropped), optionVal("dropped", NULL), name, tag);
+		if (name != NULL)
+			fprintf(stderr, "Writing %s\n", fileName);
+		finishAncestor(fileName, scoresFile, droppedFile, binary);
+	}
+	freeResults();
+}
+
+static void writeStats(char *fileName) {
+	FILE *fp = mustOpen(fileName, "w");
+	int i, j, len, maxLen = 0, *hist;
+
+	for (j = A+1; j < Z; j++)
+		maxLen = max(maxLen, PredStart[j+1] - PredStart[j]);
+	AllocArray(hist, maxLen+1);
+	for (j = A+1; j < Z; j++)
+		hist[PredStart[j+1] - PredStart[j]]++;
+	fprintf(fp, "{\n  \"T\": %d,\n  \"blocks\": %d,\n  \"nodes\": %d,\n  \"threads\": %d,\n",
+		T, BlockNum, NodeNum, Threads);
+	fprintf(fp, "  \"phases\": {\n");
+	for (i = 0; i < PH_NUM; i++)
+		fprintf(fp, "    \"%s\": {\"calls\": %d, \"wall\": %.6f, \"cpu\": %.6f, \"rssGrowthKb\": %ld}%s\n",
+			PhaseName[i], Stats[i].calls, Stats[i].wall, Stats[i].cpu, Stats[i].rssKb,
+			(i+1 < PH_NUM) ? "," : "");
+	fprintf(fp, "  },\n");
+	fprintf(fp, "  \"memo\": {\"hits\": %ld, \"misses\": %ld},\n", MemoHits, MemoMisses);
+	fprintf(fp, "  \"candidates\": {\"columns\": %d, \"total\": %d, \"pruned\": %d, \"skipped\": %d, \"max\": %d, \"histogram\": [",
+		Z-A-1, PredStart[N], Pruned, Bounded, maxLen);
+	for (len = 0; len <= maxLen; len++)
+		fprintf(fp, "%s%d", len ? ", " : "", hist[len]);
+	fprintf(fp, "]},\n");
+	if (PseudoMax >= 0)
+		fprintf(fp, "  \"pseudoLeaves\": {\"subtrees\": %d, \"maxDeviation\": %g, \"meanDeviation\": %g},\n",
+			PseudoNum, PseudoMax, PseudoMean);
+	else if (PseudoLen > 0)
+		fprintf(fp, "  \"pseudoLeaves\": {\"subtrees\": %d},\n", PseudoNum);
+	fprintf(fp, "  \"nonzero\": {\"outputs\": %ld, \"PLH\": %ld, \"SLH\": %ld}\n}\n",
+		Outputs, NonzeroPLH, NonzeroSLH);
+	carefulClose(&fp);
+	freeMem(hist);
+}
+
+/* the phases as lines of JSON in the DESCHRAMBLER_STEPS file, for the run
+ * report of DESCHRAMBLER.pl (see makeBlocks.c) */
+static void appendSteps(char *fileName) {
+	FILE *fp = fopen(fileName, "a");
+	int i;
+
+	if (fp == NULL)
+		return;
+	for (i = 0; i < PH_NUM; i++)
+		if (Stats[i].calls > 0)
+			fprintf(fp, "{\"step\": \"%s\", \"calls\": %d, \"wall\": %.3f, \"cpu\": %.3f, "
+				"\"rssGrowthKb\": %ld}\n", PhaseName[i], Stats[i].calls, Stats[i].wall,
+				Stats[i].cpu, Stats[i].rssKb);
+	fclose(fp);
+}
+
+/* -blocks: the input blocks listed, one by one or as ranges b1-b2, and
+ * the columns their adjacencies read. An adjacency i -> j is divided by
+ * the sum of column j and by that of the SLH row i, which is column map(i)
+ * of PLH; the columns are independent, so those alone give the posteriors
+ * the whole matrix does. Both readings of an adjacency read the same two */
+static void selectBlocks(char *list) {
+	struct slName *items = slNameListFromComma(list), *it;
+	int b, lo, hi, x, e, k, j, cols = 0;
+
+	AllocArray(Wanted, BlockNum + 1);
+	AllocArray(Needed, N);
+	for (it = items; it; it = it->next) {
+		if (sscanf(it->name, "%d-%d", &lo, &hi) == 1)
+			hi = lo;
+		if (lo < 1 || hi < lo || hi > BlockNum)
+			errAbort("# -blocks: no blocks %s of %d", it->name, BlockNum);
+		for (b = lo; b <= hi; b++)
+			Wanted[b] = 1;
+	}
+	slFreeList(&items);
+	for (b = 1; b <= BlockNum; b++) {
+		if (!Wanted[b])
+			continue;
+		x = (SuperOf != NULL) ? abs(SuperOf[b]) : b;
+		for (e = 0; e < 2; e++, x = map(x)) {
+			Needed[x] = Needed[map(x)] = 1;
+			for (k = SuccStart[x]; k < SuccStart[x+1]; k++)
+				Needed[SuccIdx[k]] = 1;
+			for (k = PredStart[x]; k < PredStart[x+1]; k++)
+				Needed[map(PredIdx[k])] = 1;
+		}
+	}
+	for (j = A+1; j < Z; j++)
+		cols += Needed[j];
+	fprintf(stderr, "-blocks: %d of %d columns\n", cols, Z-A-1);
+}
+
+// read the tree and choose the ancestors evaluated: the ancestors list,
+// else the '@' node, the tree rerooted at it
+static void setupTree(char *treeFile, const char *treeText, char *ancestors) {
+	struct phaseClock c;
+
+	phaseBegin(&c);
+	Phylo = readTree(treeFile, treeText);
+	if (ancestors != NULL)
+		findTargets(ancestors);
+	else {
+		identifyOutgroup(Phylo);
+		if (Ances != Phylo)
+			modifyTree();
+		assert(Ances == Phylo);
+	}
 	initLeafList(Phylo);
-	readGenomes(argv[4]);
-	T = calculateTotalEle(argv[1], Phylo);
+	phaseEnd(PH_TREE, &c);
+}
+
+// read the genomes and build the leaf sets, the candidates and the plan
+// of the evaluation
+static void setupSets(char *refSpc, char *genomeFile, const char *genomeText, boolean jackknife) {
+	struct phaseClock c;
+	int mem;
+
+	phaseBegin(&c);
+	mem = MEM_ENTER(genomes);
+	readGenomes(genomeFile, genomeText);
+	MEM_LEAVE(mem);
+	phaseEnd(PH_GENOMES, &c);
+	T = calculateTotalEle(refSpc, Phylo);
 	fprintf(stderr, "T=%d\n", T);
+	phaseBegin(&c);
+	BlockNum = T;
+	if (Collapse)
+		findSuperBlocks(Leaf);
+	mem = MEM_ENTER(leaf_sets);
 	initSets(Leaf);
-	fprintf(stderr, "Computing posterior probabilities ...\n");
-	getPredecessor();
-	getSuccessor();
-	normalize();
-	calculatePostProb();
+	(void)MEM_ENTER(matrix);
+	buildCandidates(Leaf);
+	initMatrices();
+	if (TargetNum == 0)
+		compilePlan(Ances);
+	if (jackknife) {
+		AllocArray(JackLeaf, NodeNum);
+		AllocArray(JackParent, NodeNum);
+		planJackknife(Ances);
+	}
+	planMemory();
+	MEM_LEAVE(mem);
+	phaseEnd(PH_SETS, &c);
+}
+
+static void freeEngine() {
+	freeResults();
+	freeMem(Targets);
+	freeMem(JackLeaf);
+	freeMem(JackParent);
+	freeMem(Plan);
+	freeMem(PlanSlot);
 	freeTreeSpace(&Phylo);
+	lmCleanup(&GenomeMem);
+	if (GenomeDb != NULL)
+		close_genome_db(GenomeDb);
 	freeSets(Leaf);
 	slFreeList(&Leaf);
-	slFreeList(&Edgelist);
-	return 0;
+	freez(&SuperStart);
+	freez(&SuperPath);
+	freez(&SuperOf);
+	freez(&Wanted);
+	freez(&Needed);
+}
+
+/* libadjprob (adjprob.h): the engine behind a handle. A handle holds its
+ * own copy of every static the engine keeps state in, loaded into them
+ * for the length of a call and saved back after; EngineLock keeps to one
+ * call at a time, over all the handles */
+#define ENGINE_STATE(X) X(oj) X(Phylo) X(Ances) X(Leaf) X(A) X(T) X(N) X(Z) \
+	X(PredStart) X(PredIdx) X(SuccStart) X(SuccIdx) X(SuccPos) X(SuccMirror) \
+	X(PLH) X(SLH) X(ColSum) X(RowSum) X(RowMax) X(alpha) X(NodeNum) \
+	X(GenomeMem) X(GenomeDb) X(MaxCol) X(Threads) X(Numa) X(NextCol) X(Targets) \
+	X(TargetNum) X(TargetPLH) X(ColScale) X(TargetScale) X(Plan) X(PlanLen) \
+	X(PlanRows) X(PlanSlot) X(Rescaled) X(CheckpointFile) X(CheckpointSec) \
+	X(MergeFiles) X(Resume) X(ColDone) X(PartK) X(PartN) X(PartLo) X(PartHi) \
+	X(LLCacheDir) X(CoarseFile) X(Pruned) X(Epsilon) X(Bounded) X(SkipStart) \
+	X(SkipIdx) X(MaxSkip) X(SkipSum) X(JackLeaf) X(JackParent) X(JackNum) \
+	X(JackPLH) X(JackScale) X(LastCheckpoint) X(Stats) X(MemoHits) X(MemoMisses) \
+	X(NonzeroPLH) X(NonzeroSLH) X(Outputs) X(MemLimit) X(TileBytes) X(Spill) X(TileHi) \
+	X(CacheTile) X(CacheTileBytes) X(CacheTileCols) \
+	X(JoinsDir) X(Selected) X(MainPLH) X(MainScale) X(BoundOrder) \
+	X(BoundPos) X(BoundUp) X(BoundLen) X(LLCacheIn) X(LLCacheOut) X(LLCacheBelow) \
+	X(Collapse) X(BlockNum) X(SuperStart) X(SuperPath) X(SuperOf) X(Progress) \
+	X(Wanted) X(Needed) X(PseudoLen) X(PseudoNum) X(PseudoMax) X(PseudoMean)
+
+#define STATE_FIELD(v) __typeof__(v) v;
+#define STATE_SAVE(v) memcpy(&ap->v, &v, sizeof(v));
+#define STATE_LOAD(v) memcpy(&v, &ap->v, sizeof(v));
+
+struct adjprob {
+	ENGINE_STATE(STATE_FIELD)
+	boolean computed;
+	char name[PATH_LEN];	// of the last adjprob_result_name()
+};
+
+static pthread_mutex_t EngineLock = PTHREAD_MUTEX_INITIALIZER;
+static struct adjprob *Pristine = NULL;	// the statics before any handle
+
+static void saveState(struct adjprob *ap) {
+	ENGINE_STATE(STATE_SAVE)
+}
+
+static void loadState(struct adjprob *ap) {
+	ENGINE_STATE(STATE_LOAD)
+}
+
+static void enterEngine(struct adjprob *ap) {
+	pthreadMutexLock(&EngineLock);
+	loadState(ap);
+}
+
+static void leaveEngine(struct adjprob *ap) {
+	saveState(ap);
+	pthreadMutexUnlock(&EngineLock);
+}
+
+struct adjprob *adjprob_open(const struct adjprob_input *in) {
+	struct adjprob *ap;
+
+	if (in->tree == NULL || in->ref_spc == NULL || (in->genomes == NULL && in->genome_file == NULL))
+		errAbort("# adjprob_open: a tree, a reference and genomes are needed");
+	AllocVar(ap);
+	pthreadMutexLock(&EngineLock);
+	if (Pristine == NULL) {
+		AllocVar(Pristine);
+		saveState(Pristine);
+	}
+	*ap = *Pristine;
+	loadState(ap);
+	Threads = (in->threads > 0) ? in->threads : default_threads();
+	JoinsDir = cloneString(in->joins_dir);
+	setupTree(NULL, in->tree, (char *)in->ancestors);
+	if (in->jackknife && TargetNum > 0)
+		errAbort("# adjprob_open: jackknife goes with no ancestors");
+	setupSets((char *)in->ref_spc, (char *)in->genome_file, in->genomes, in->jackknife);
+	leaveEngine(ap);
+	return ap;
+}
+
+void adjprob_compute(struct adjprob *ap, double a) {
+	struct phaseClock c;
+
+	enterEngine(ap);
+	freeResults();
+	alpha = a;
+	setTransitionProbs(Phylo);
+	phaseBegin(&c);
+	getPredecessor();
+	phaseEnd(PH_PRED, &c);
+	ap->computed = TRUE;
+	leaveEngine(ap);
+}
+
+int adjprob_results(struct adjprob *ap) {
+	int n;
+
+	enterEngine(ap);
+	n = ap->computed ? resultNum() : 0;
+	leaveEngine(ap);
+	return n;
+}
+
+const char *adjprob_result_name(struct adjprob *ap, int r) {
+	char *name;
+
+	enterEngine(ap);
+	if (!ap->computed || r < 0 || r >= resultNum())
+		errAbort("# adjprob_result_name: no result %d", r);
+	name = resultName(r, ap->name, sizeof(ap->name));
+	leaveEngine(ap);
+	return name;
+}
+
+int adjprob_posteriors(struct adjprob *ap, int r, struct adjprob_adj **adjs) {
+	struct phaseClock c;
+	int n;
+
+	enterEngine(ap);
+	if (!ap->computed || r < 0 || r >= resultNum())
+		errAbort("# adjprob_posteriors: no result %d", r);
+	selectResult(r);
+	phaseBegin(&c);
+	normalize();
+	phaseEnd(PH_NORM, &c);
+	AllocArray(*adjs, postProbMax());
+	n = collectPostProb(*adjs);
+	leaveEngine(ap);
+	return n;
+}
+
+void adjprob_close(struct adjprob *ap) {
+	if (ap == NULL)
+		return;
+	enterEngine(ap);
+	freeEngine();
+	freeMem(JoinsDir);
+	pthreadMutexUnlock(&EngineLock);
+	freeMem(ap);
 }
 
+#ifndef NO_MAIN
+// the alpha of a parameter-alpha of -, as newickTool jc writes it
+static double readAlpha() {
+	double a;
+
+	if (scanf("%lf", &a) != 1)
+		errAbort("# no alpha on the standard input");
+	return a;
+}
+
+int main(int argc, char *argv[]) {
+	struct slName *alphas = NULL, *a;
+	struct phaseClock c;
+	boolean alphaIn;
+	double *exact = NULL;	// -pseudoCheck
+#ifdef DESCHRAMBLER_TRACE
+	pushMemHandler(&CountedMem);
+#endif
+	optionInit(&argc, argv, options);
+	if (argc != 5)
+		usage();
+	Threads = optionInt("threads", default_threads());
+	Numa = optionExists("numa");
+	CheckpointFile = optionVal("checkpoint", NULL);
+	CheckpointSec = optionInt("checkpointSec", CheckpointSec);
+	MergeFiles = optionVal("merge", NULL);
+	Resume = optionExists("resume");
+	LLCacheDir = optionVal("llcache", NULL);
+	CoarseFile = optionVal("coarse", NULL);
+	Epsilon = optionDouble("epsilon", 0);
+	MinProb = optionDouble("minProb", 0);
+	TopK = optionInt("topK", 0);
+	Collapse = !optionExists("noSuperBlocks");
+	if (TopK < 0)
+		errAbort("-topK must not be negative");
+	if (optionExists("dropped") && MinProb <= 0 && TopK == 0)
+		errAbort("-dropped needs -minProb or -topK");
+	if (Epsilon < 0 || Epsilon >= 1)
+		errAbort("# -epsilon must be at least 0 and below 1");
+	if (Epsilon > 0 && (optionExists("alphas") || optionExists("ancestors")
+		|| optionExists("jackknife") || LLCacheDir))
+		errAbort("# -epsilon goes with none of -alphas, -ancestors, -jackknife and -llcache");
+	if (optionExists("blocks") && (optionExists("cars") || TopK > 0 || optionExists("dropped")
+		|| CheckpointFile || MergeFiles || LLCacheDir))
+		errAbort("# -blocks goes with none of -cars, -topK, -dropped, -checkpoint, -merge and -llcache");
+	PseudoLen = optionDouble("pseudoLeaves", 0);
+	if (PseudoLen < 0)
+		errAbort("# -pseudoLeaves must not be negative");
+	if (PseudoLen > 0 && (optionExists("ancestors") || optionExists("jackknife")))
+		errAbort("# -pseudoLeaves goes with neither -ancestors nor -jackknife");
+	if (optionExists("pseudoCheck") && (PseudoLen == 0 || optionExists("alphas")
+		|| CheckpointFile || MergeFiles || LLCacheDir))
+		errAbort("# -pseudoCheck needs -pseudoLeaves, and goes with none of -alphas, -checkpoint, -merge and -llcache");
+	if (optionExists("memLimit"))
+		MemLimit = parseSize(optionVal("memLimit", NULL));
+	if (optionExists("cacheTile"))
+		CacheTile = sameString(optionVal("cacheTile", NULL), "L2") ? -1
+			: parseSize(optionVal("cacheTile", NULL));
+	if (Threads < 1)
+		errAbort("# -threads must be at least 1");
+	if (optionExists("part")) {
+		if (sscanf(optionVal("part", NULL), "%d/%d", &PartK, &PartN) != 2
+			|| PartN < 1 || PartK < 1 || PartK > PartN)
+			errAbort("# -part takes k/n with 1 <= k <= n");
+		if (CheckpointFile == NULL || optionExists("alphas") || MergeFiles)
+			errAbort("# -part needs -checkpoint, and goes with neither -alphas nor -merge");
+	}
+	alphaIn = sameString(argv[2], "-");
+	if (alphaIn && optionExists("alphas"))
+		errAbort("# an alpha of - does not go with -alphas");
+	alpha = alphaIn ? 0 : atof(argv[2]);
+	if (optionExists("alphas")) {
+		alphas = slNameListFromComma(optionVal("alphas", NULL));
+		alpha = atof(alphas->name);
+	}
+	// the candidate bound of -epsilon is the only setup that needs alpha
+	if (alphaIn && Epsilon > 0) {
+		alpha = readAlpha();
+		alphaIn = FALSE;
+	}
+	if (!alphaIn)
+		printf("alpha=%f\n", alpha);
+	setupTree(argv[3], NULL, optionVal("ancestors", NULL));
+	if (optionExists("jackknife")
+		&& (TargetNum > 0 || CheckpointFile || LLCacheDir || MergeFiles))
+		errAbort("# -jackknife goes with none of -ancestors, -checkpoint, -merge and -llcache");
+	setupSets(argv[1], argv[4], NULL, optionExists("jackknife"));
+	if (optionExists("blocks"))
+		selectBlocks(optionVal("blocks", NULL));
+	if (alphaIn) {
+		alpha = readAlpha();
+		printf("alpha=%f\n", alpha);
+	}
+	if (optionExists("pseudoCheck"))
+		exact = wholeTreePosteriors();
+	if (PseudoLen > 0)
+		pseudoLeaves();
+	if (alphas == NULL) {
+		setTransitionProbs(Phylo);
+		fprintf(stderr, "Computing posterior probabilities ...\n");
+		phaseBegin(&c);
+		getPredecessor();
+		phaseEnd(PH_PRED, &c);
+		if (exact != NULL)
+			pseudoDeviation(exact);
+		if (PartN == 0)
+			writePosteriors(NULL, optionExists("binary"));
+	}
+	for (a = alphas; a; a = a->next) {
+		alpha = atof(a->name);
+		setTransitionProbs(Phylo);
+		fprintf(stderr, "Computing posterior probabilities (alpha=%s) ...\n", a->name);
+		phaseBegin(&c);
+		getPredecessor();
+		phaseEnd(PH_PRED, &c);
+		writePosteriors(a->name, optionExists("binary"));
+	}
+	if (optionExists("stats"))
+		writeStats(optionVal("stats", NULL));
+	if (getenv("DESCHRAMBLER_STEPS") != NULL && *getenv("DESCHRAMBLER_STEPS") != '\0')
+		appendSteps(getenv("DESCHRAMBLER_STEPS"));
+	if (optionExists("counters")) {
+		trace_counters(stderr);
+		trace_memory(stderr, "at exit");
+	}
+	slFreeList(&alphas);
+	freeMem(exact);
+	freeEngine();
+	return 0;
+}
+#endif
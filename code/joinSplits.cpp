@@ -0,0 +1,470 @@
+// joinSplits - joins APCFs at the adjacencies split_weak_joins.pl left out,
+// as script/join_splits.pl does: of all the pairs of APCFs, taken in the
+// order of their ids, the first one whose ends can be joined (in the best of
+// its four orientations) is merged into the lower id, until none is left.
+//
+// An adjacency x y of two extremities can be joined if its score is at
+// least the minimum, it was not split before, some ingroup genome has it,
+// and the small parsimony over the tree (parsimony.h, 64 adjacencies at a
+// time) puts it in the '@' ancestor whichever state the root takes. Its
+// score only depends on x and y, so it is worked out once; the pairs that
+// can be joined are kept in a queue ordered as the scan of join_splits.pl
+// meets them, and a merge only brings in the pairs of the merged APCF.
+//
+// What each genome has is looked up in the Joins.db of the SFs
+// (makeBlocks/joindb.h). A genome with several joins at one extremity has
+// all of them, where join_splits.pl kept the last one of its .joins file.
+//
+// With -budget, the seconds the run may take, the pairs are merged best
+// score first instead, and once the time is out the APCFs as they are are
+// written, with the number of joinable pairs left on stderr: a bounded run
+// of a project of many fragments keeps the merges that matter most.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+#include "scoreparse.h"
+#include "parsimony.h"
+#include "makeBlocks/joindb.h"
+#include "makeBlocks/genomedb.h"
+#include "makeBlocks/numfmt.h"
+
+using namespace std;
+
+void error (string msg, string file="")
+{
+	cerr << msg << file << endl;
+	exit(1);
+}
+
+static inline uint64_t pairKey(int a, int b)
+{
+	return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+}
+
+// a species as check_join sees it: its bit in the join database and, for an
+// ingroup, the adjacencies of its genome (from Genomes.Order)
+struct Species {
+	string name;
+	bool ingroup, nonchr;
+	uint64_t bit;
+	unordered_map<int, int> order;
+};
+
+class Joiner {
+public:
+	double min_score;
+	vector<Species> spcs;
+	parsimony::Tree tree;
+	vector<int> leaf_spc;	// per node: the species of a leaf
+	const join_db* db;		// the joins of every genome
+	unordered_map<uint64_t, double> scores;
+	unordered_set<uint64_t> splits;
+	unordered_map<int, vector<int> > succ;	// the y of the scored adjacencies x y
+	unordered_map<uint64_t, double> memo;
+
+	// works out the adjacencies (of pairKey()) not seen before, putting the
+	// ones that get to the tree through it 64 at a time
+	void scoreJoins(const vector<uint64_t>& keys)
+	{
+		vector<uint64_t> batch;
+		vector<double> batch_score;
+		for (size_t k = 0; k < keys.size(); k++) {
+			if (memo.count(keys[k])) continue;
+			double s = prefilter((int)(keys[k] >> 32), (int)(uint32_t)keys[k]);
+			memo[keys[k]] = 0.0;
+			if (s == 0.0) continue;
+			batch.push_back(keys[k]);
+			batch_score.push_back(s);
+			if (batch.size() == 64) {
+				scoreBatch(batch, batch_score);
+				batch.clear();
+				batch_score.clear();
+			}
+		}
+		if (!batch.empty()) scoreBatch(batch, batch_score);
+	}
+
+private:
+	vector<parsimony::Lanes> lanes;
+
+	// the score of x y if it passes the checks before the tree, else 0
+	double prefilter(int bid1, int bid2)
+	{
+		unordered_map<uint64_t, double>::iterator sc = scores.find(pairKey(bid1, bid2));
+		if (sc == scores.end() || sc->second < min_score || splits.count(pairKey(bid1, bid2)))
+			return 0.0;
+
+		// at least one ingroup species should have the join
+		for (size_t k = 0; k < spcs.size(); k++) {
+			if (!spcs[k].ingroup) continue;
+			unordered_map<int, int>::iterator o = spcs[k].order.find(bid1);
+			if (o != spcs[k].order.end() && o->second == bid2) return sc->second;
+		}
+		return 0.0;
+	}
+
+	void scoreBatch(const vector<uint64_t>& batch, const vector<double>& batch_score)
+	{
+		lanes.resize(tree.size());
+		for (size_t l = 0; l < tree.leaves.size(); l++) {
+			int n = tree.leaves[l];
+			parsimony::Lanes& ln = lanes[n];
+			ln.can0 = ln.can1 = 0;
+			for (size_t k = 0; k < batch.size(); k++) {
+				int flag = leafFlag(spcs[leaf_spc[n]], (int)(batch[k] >> 32), (int)(uint32_t)batch[k]);
+				if (flag != 1) ln.can0 |= (uint64_t)1 << k;
+				if (flag != 0) ln.can1 |= (uint64_t)1 << k;
+			}
+		}
+		uint64_t there = parsimony::ancestorHas(tree, lanes);
+		for (size_t k = 0; k < batch.size(); k++)
+			if (there >> k & 1) memo[batch[k]] = batch_score[k];
+	}
+
+	// 1 if the species has the join, 0 if not, 2 if it cannot tell
+	int leafFlag(const Species& sp, int bid1, int bid2)
+	{
+		if (!((end_mask(db, bid1) | end_mask(db, -bid1)) & sp.bit)
+			|| !((end_mask(db, bid2) | end_mask(db, -bid2)) & sp.bit)) return 2;
+		if (join_mask(db, bid1, bid2) & sp.bit) return 1;
+		if (!sp.nonchr) return 0;
+		// joined to another block on either side
+		if ((end_mask(db, bid1) | end_mask(db, -bid2)) & sp.bit) return 0;
+		return 2;
+	}
+};
+
+static vector<string> readLines(const string& f)
+{
+	vector<string> lines;
+	ifstream in(f.c_str());
+	if (!in) error("cannot open ", f);
+	string line;
+	while (getline(in, line)) lines.push_back(line);
+	return lines;
+}
+
+static vector<int> readInts(const string& line)
+{
+	vector<int> ar;
+	istringstream ss(line);
+	string tok;
+	while (ss >> tok) ar.push_back(atoi(tok.c_str()));
+	return ar;
+}
+
+static void readSpecies(Joiner& jn, const string& sf_dir)
+{
+	unordered_map<string, int> idx;
+	const char* group_f[2] = {"/ingroup.txt", "/outgroup.txt"};
+	for (int g = 0; g < 2; g++) {
+		vector<string> lines = readLines(sf_dir + group_f[g]);
+		for (size_t i = 0; i < lines.size(); i++) {
+			if (lines[i].empty() || idx.count(lines[i])) continue;
+			idx[lines[i]] = jn.spcs.size();
+			jn.spcs.push_back(Species());
+			jn.spcs.back().name = lines[i];
+			jn.spcs.back().ingroup = (g == 0);
+			jn.spcs.back().nonchr = false;
+		}
+	}
+
+	// assemblies that are not chromosomes
+	vector<string> lines = readLines(sf_dir + "/config.file");
+	regex assm("(\\S+)\\s+(\\d+)\\s(\\d+)");
+	for (size_t i = 0; i < lines.size(); i++) {
+		smatch m;
+		if (regex_search(lines[i], m, assm) && atoi(m[3].str().c_str()) == 0 && idx.count(m[1].str()))
+			jn.spcs[idx[m[1].str()]].nonchr = true;
+	}
+
+	// the adjacencies of the ingroup genomes, from Genomes.db if there is one
+	genome_db* gdb = open_genome_db((sf_dir + "/" + GENOMEDB_FILE).c_str());
+	if (gdb != NULL) {
+		for (int g = 0; g < gdb->ngenome; g++) {
+			string name = gdb->name[g];
+			if (!idx.count(name) || !jn.spcs[idx[name]].ingroup) continue;
+			Species* sp = &jn.spcs[idx[name]];
+			for (int c = gdb->gfirst[g]; c < gdb->gfirst[g+1]; c++)
+				for (int k = gdb->cfirst[c]; k + 1 < gdb->cfirst[c+1]; k++) {
+					sp->order[gdb->order[k]] = gdb->order[k+1];
+					sp->order[-gdb->order[k+1]] = -gdb->order[k];
+				}
+		}
+		close_genome_db(gdb);
+	}
+	else
+		lines = readLines(sf_dir + "/Genomes.Order");
+	Species* sp = NULL;
+	for (size_t i = 0; gdb == NULL && i < lines.size(); i++) {
+		if (lines[i].empty() || lines[i][0] == '#') continue;
+		if (lines[i][0] == '>') {
+			string name = lines[i].substr(1, lines[i].find_first_of(" \t") - 1);
+			sp = (idx.count(name) && jn.spcs[idx[name]].ingroup) ? &jn.spcs[idx[name]] : NULL;
+			continue;
+		}
+		if (sp == NULL) continue;
+		vector<int> ar = readInts(lines[i]);
+		for (int k = 0; k + 1 < (int)ar.size(); k++) {
+			sp->order[ar[k]] = ar[k+1];
+			sp->order[-ar[k+1]] = -ar[k];
+		}
+	}
+
+	// the joins of every genome
+	jn.db = open_join_db((sf_dir + "/" + JOINDB_FILE).c_str());
+	for (size_t k = 0; k < jn.spcs.size(); k++) {
+		int b = join_db_spe(jn.db, jn.spcs[k].name.c_str());
+		if (b < 0) error("no joins for ", jn.spcs[k].name);
+		jn.spcs[k].bit = (uint64_t)1 << b;
+	}
+
+	jn.leaf_spc.assign(jn.tree.size(), -1);
+	for (size_t l = 0; l < jn.tree.leaves.size(); l++) {
+		int n = jn.tree.leaves[l];
+		if (!idx.count(jn.tree.name[n])) error("no species for the leaf ", jn.tree.name[n]);
+		jn.leaf_spc[n] = idx[jn.tree.name[n]];
+	}
+}
+
+// an APCF and the version of its ends
+struct Apcf {
+	long id;
+	vector<int> bids;
+	int ver;
+	bool alive;
+};
+
+// a pair i < j of APCFs that can be joined, in the orientation
+// (1: i j, 2: i -j, 3: -i j, 4: -i -j) join_splits.pl would take
+struct Cand {
+	int i, j, veri, verj, kind;
+	double score;
+	bool operator>(const Cand& c) const { return i != c.i ? i > c.i : j > c.j; }
+};
+
+// the pair on top of the queue: the first of the scan, or with -budget
+// the best score (the first of the scan among equals)
+struct CandOrder {
+	bool by_score;
+	bool operator()(const Cand& a, const Cand& b) const
+	{
+		if (by_score && a.score != b.score) return a.score < b.score;
+		return a > b;
+	}
+};
+
+static vector<int> reversed(const vector<int>& ar)
+{
+	vector<int> r;
+	for (int k = ar.size() - 1; k >= 0; k--) r.push_back(-ar[k]);
+	return r;
+}
+
+int main(int argc, char* argv[])
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	double budget = 0;
+	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+		if (string(argv[1]) == "-budget" && argc > 2) { budget = atof(argv[2]); argc--; argv++; }
+		else error("unknown option ", argv[1]);
+	}
+	if (argc != 6) error ("usage: joinSplits [-budget seconds] <min score> <tree file> <join file> <SF dir> <splits file>");
+	auto timeOut = [&]() {
+		return budget > 0 && chrono::duration<double>(chrono::steady_clock::now() - start).count() >= budget;
+	};
+	Joiner jn;
+	jn.min_score = atof(argv[1]);
+	string sf_dir = argv[4];
+
+	string err;
+	if (!jn.tree.read(argv[2], err)) error(err);
+	readSpecies(jn, sf_dir);
+
+	// previously split points
+	vector<string> lines = readLines(argv[5]);
+	for (size_t i = 0; i < lines.size(); i++) {
+		if (lines[i].empty() || lines[i][0] == '#') continue;
+		vector<int> ar = readInts(lines[i]);
+		if (ar.size() < 2) continue;
+		jn.splits.insert(pairKey(ar[0], ar[1]));
+		jn.splits.insert(pairKey(-ar[1], -ar[0]));
+	}
+
+	vector<ScoreRec> recs;
+	string score_f = sf_dir + "/block_consscores.txt";
+	if (!readScoreFile(score_f.c_str(), recs)) error("cannot open ", score_f);
+	for (size_t i = 0; i < recs.size(); i++) {
+		jn.scores[pairKey(recs[i].bid1, recs[i].bid2)] = recs[i].score;
+		jn.scores[pairKey(-recs[i].bid2, -recs[i].bid1)] = recs[i].score;
+		jn.succ[recs[i].bid1].push_back(recs[i].bid2);
+		jn.succ[-recs[i].bid2].push_back(-recs[i].bid1);
+	}
+
+	// the APCFs, by id
+	lines = readLines(argv[3]);
+	if (lines.empty()) error("empty join file ", argv[3]);
+	string header = lines[0];
+	map<long, vector<int> > joins;
+	bool inapcf = false;
+	long id = 0;
+	for (size_t i = 1; i < lines.size(); i++) {
+		if (lines[i].compare(0, 7, "# APCF ") == 0) {
+			id = atol(lines[i].c_str() + 7);
+			inapcf = true;
+		} else if (inapcf) {
+			vector<int> ar = readInts(lines[i]);
+			if (!ar.empty()) ar.pop_back();	// the '$'
+			joins[id] = ar;
+		}
+	}
+	vector<Apcf> apcfs;
+	for (map<long, vector<int> >::iterator it = joins.begin(); it != joins.end(); it++) {
+		Apcf a = {it->first, it->second, 0, true};
+		apcfs.push_back(a);
+	}
+
+	// the APCFs by the extremities a join enters them at: the first block
+	// and the reversed last one
+	unordered_map<int, vector<int> > entered;
+	for (size_t i = 0; i < apcfs.size(); i++) {
+		if (apcfs[i].bids.empty()) continue;
+		entered[apcfs[i].bids.front()].push_back(i);
+		entered[-apcfs[i].bids.back()].push_back(i);
+	}
+
+	CandOrder order = {budget > 0};
+	priority_queue<Cand, vector<Cand>, CandOrder> queue(order);
+	vector<int> seen(apcfs.size(), 0);
+	int stamp = 0;
+	// the joinable pairs of i with the other APCFs, or only with those after it
+	auto addPairs = [&](int i, bool before) {
+		const vector<int>& bi_ar = apcfs[i].bids;
+		int outs[2] = {bi_ar.back(), -bi_ar.front()};
+		int ins[2] = {bi_ar.front(), -bi_ar.back()};
+		vector<int> others;
+		stamp++;
+		for (int e = 0; e < 2; e++) {
+			// pairs i j: out of i into j
+			unordered_map<int, vector<int> >::iterator s = jn.succ.find(outs[e]);
+			if (s != jn.succ.end()) {
+				for (size_t k = 0; k < s->second.size(); k++) {
+					unordered_map<int, vector<int> >::iterator en = entered.find(s->second[k]);
+					if (en != entered.end()) others.insert(others.end(), en->second.begin(), en->second.end());
+				}
+			}
+			// pairs j i: out of j into i
+			if (!before) continue;
+			s = jn.succ.find(-ins[e]);
+			if (s != jn.succ.end()) {
+				for (size_t k = 0; k < s->second.size(); k++) {
+					unordered_map<int, vector<int> >::iterator en = entered.find(s->second[k]);
+					if (en != entered.end()) others.insert(others.end(), en->second.begin(), en->second.end());
+				}
+			}
+		}
+		// the pairs, with the adjacencies of their four orientations
+		vector<Cand> pairs;
+		vector<uint64_t> keys;
+		for (size_t k = 0; k < others.size(); k++) {
+			int j = others[k];
+			if (j == i || !apcfs[j].alive || seen[j] == stamp || (!before && j < i)) continue;
+			seen[j] = stamp;
+			Cand c;
+			c.i = min(i, j);
+			c.j = max(i, j);
+			pairs.push_back(c);
+			const vector<int>& ari = apcfs[c.i].bids;
+			const vector<int>& arj = apcfs[c.j].bids;
+			int fi = ari.front(), bi = ari.back(), fj = arj.front(), bj = arj.back();
+			keys.push_back(pairKey(bi, fj));
+			keys.push_back(pairKey(bi, -bj));
+			keys.push_back(pairKey(-fi, fj));
+			keys.push_back(pairKey(-fi, -bj));
+		}
+		jn.scoreJoins(keys);
+		for (size_t k = 0; k < pairs.size(); k++) {
+			Cand& c = pairs[k];
+			double s[4];
+			for (int o = 0; o < 4; o++) s[o] = jn.memo[keys[4*k + o]];
+			double smax = max(max(s[0], s[1]), max(s[2], s[3]));
+			for (c.kind = 0; c.kind < 4; c.kind++)
+				if (s[c.kind] > 0.0 && s[c.kind] == smax) break;
+			if (c.kind == 4) continue;
+			c.score = smax;
+			c.veri = apcfs[c.i].ver;
+			c.verj = apcfs[c.j].ver;
+			queue.push(c);
+		}
+	};
+	size_t scanned = 0;
+	bool late = false;
+	for (; scanned < apcfs.size() && !(late = timeOut()); scanned++)
+		if (!apcfs[scanned].bids.empty()) addPairs(scanned, false);
+
+	int merges = 0;
+	while (!late && !queue.empty()) {
+		if ((late = timeOut())) break;
+		Cand c = queue.top();
+		queue.pop();
+		Apcf& ai = apcfs[c.i];
+		Apcf& aj = apcfs[c.j];
+		if (!ai.alive || !aj.alive || ai.ver != c.veri || aj.ver != c.verj) continue;
+
+		vector<int> left = (c.kind < 2) ? ai.bids : reversed(ai.bids);
+		vector<int> right = (c.kind % 2 == 0) ? aj.bids : reversed(aj.bids);
+		left.insert(left.end(), right.begin(), right.end());
+		ai.bids.swap(left);
+		ai.ver++;
+		aj.alive = false;
+		entered[ai.bids.front()].push_back(c.i);
+		entered[-ai.bids.back()].push_back(c.i);
+		addPairs(c.i, true);
+		merges++;
+	}
+	if (late) {
+		long left = 0;
+		for (; !queue.empty(); queue.pop()) {
+			const Cand& c = queue.top();
+			left += apcfs[c.i].alive && apcfs[c.j].alive
+				&& apcfs[c.i].ver == c.veri && apcfs[c.j].ver == c.verj;
+		}
+		cerr << "joinSplits: the budget of " << budget << " s ran out after " << merges << " merges, "
+			<< left << " joinable pairs left unevaluated";
+		if (scanned < apcfs.size())
+			cerr << " and the pairs of " << apcfs.size() - scanned << " APCFs not looked for";
+		cerr << endl;
+	}
+
+	struct text_buf out;
+	text_begin(&out, stdout);
+	text_str(&out, header.c_str());
+	text_char(&out, '\n');
+	int new_id = 1;
+	for (size_t i = 0; i < apcfs.size(); i++) {
+		if (!apcfs[i].alive) continue;
+		text_str(&out, "# APCF ");
+		text_int(&out, new_id++);
+		text_char(&out, '\n');
+		for (size_t k = 0; k < apcfs[i].bids.size(); k++) {
+			if (k > 0) text_char(&out, ' ');
+			text_int(&out, apcfs[i].bids[k]);
+		}
+		text_str(&out, " $\n");
+	}
+	text_flush(&out);
+	return 0;
+}
@@ -1,179 +1,409 @@
+#define _GNU_SOURCE
+#include <pthread.h>
 #include "util.h"
 #include "species.h"
 #include "base.h"
+#include "chainstore.h"
+#include "trace.h"
+#include "workpool.h"
 
-struct gf_list {
-	int size, fgap, sgap;
-	struct gf_list *next;
-};
-
-struct chain_list {
-	int cid;
-	char fchr[50], schr[50];
-	int fbeg, fend, sbeg, send, slen;
-	char forient, sorient;
-	struct gf_list *gf;
-	struct chain_list *next;
-};
+void free_chain_space(int ss) {
+	close_chain_store(Spe->chains[ss]);
+	Spe->chains[ss] = NULL;
+}
 
-static struct chain_list *chainlist[MAXSPE] = {NULL};
-static char refchr[MAXSPE][MAXCHR] = {"\0"};
+/* the reference offset where the gap after block i ends */
+static int reach(const struct chain_gf *gf, int i) {
+	return gf[i].roff + gf[i].size + gf[i].fgap;
+}
 
-static struct chain_list *read_chain(char *chainfile) {
-	FILE *fp;
-	char buf[500];
-	struct chain_list *chainlist, *clast, *cp;
-	struct gf_list *gflast, *gp;
+/* finds the block of a chain holding reference offset ref, or the gap
+ * after it: the first block from `from` on whose following gap reaches
+ * ref. Blocks only move forward, so this gallops from `from` and then
+ * bisects; sorted offsets are lifted in one sweep that way */
+static int find_block(const struct chain_gf *gf, int n, int from, int ref) {
+	int lo = from, hi = from, step = 1, mid;
 
-	fp = ckopen(chainfile, "r");
-	chainlist = clast = NULL;
-	while(fgets(buf, 500, fp)) {
-		if (buf[0] == '\n' || buf[0] == '#')
-			continue;
-		if (buf[0] == 'c') {
-			cp = (struct chain_list *)ckalloc(sizeof(struct chain_list));
-			cp->next = NULL;	
-			cp->gf = NULL;
-			if (sscanf(buf, "chain %*d %s %*d %c %d %d %s %d %c %d %d %d",
-											cp->fchr, &(cp->forient), &(cp->fbeg), &(cp->fend),
-											cp->schr, &(cp->slen), &(cp->sorient), &(cp->sbeg), &(cp->send), 
-											&(cp->cid)) != 10)
-				fatalf("cannot parse: %s", buf);
-			if (chainlist == NULL)
-				chainlist = clast = cp;
-			else {
-				clast->next = cp;
-				clast = cp;
-			}
-		}
-		else {
-			gp = (struct gf_list *)ckalloc(sizeof(struct gf_list));
-			gp->next = NULL;
-			gp->fgap = gp->sgap = 0;
-			if (sscanf(buf, "%d %d %d", &(gp->size), &(gp->fgap), &(gp->sgap)) == 3
-				|| sscanf(buf, "%d", &(gp->size)) == 1) {
-				if (cp->gf == NULL) 
-					cp->gf = gflast = gp;
-				else {
-					gflast->next = gp;
-					gflast = gp;
-				}
-			}
-			else
-				fatalf("cannot parse: %s", buf);
-		}
+	while (hi < n && reach(gf, hi) < ref) {
+		lo = hi + 1;
+		hi += step;
+		step *= 2;
 	}
-	fclose(fp);
-	return chainlist;
-}
-
-static void free_gf_list(struct gf_list *gflist) {
-	struct gf_list *p, *q;
-	p = gflist;
-	for (;;) {
-		q = p->next;
-		free(p);
-		if (q == NULL)
-			break;
+	hi = MIN(hi, n);
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (reach(gf, mid) >= ref)
+			hi = mid;
 		else
-			p = q;
+			lo = mid + 1;
 	}
+	return lo;
 }
 
-static void free_chain_list(struct chain_list *chainlist) {
-	struct chain_list *p, *q;
-	p = chainlist;
-	for (;;) {
-		q = p->next;
-		free_gf_list(p->gf);
-		free(p);
-		if (q == NULL)
-			break;
-		else
-			p = q;
+static void lift_offset(const struct chain_gf *gf, int n, int i, int ref, bool right,
+						int *roff, int *soff) {
+	if (i == n) {
+		// past the last block
+		*roff = n > 0 ? reach(gf, n-1) : 0;
+		*soff = n > 0 ? gf[n-1].soff + gf[n-1].size + gf[n-1].sgap : 0;
+		*soff += ref - *roff;
+		*roff = ref;
+	}
+	else if (gf[i].roff + gf[i].size > ref) {
+		*roff = ref;
+		*soff = gf[i].soff + (ref - gf[i].roff);
+	}
+	else {
+		// in the gap after block i
+		*roff = gf[i].roff + gf[i].size;
+		*soff = gf[i].soff + gf[i].size;
+		if (right) {
+			*roff += gf[i].fgap;
+			*soff += gf[i].sgap;
+		}
 	}
 }
 
-void free_chain_space(int ss) {
-	if (refchr[ss][0] != '\0')
-		free_chain_list(chainlist[ss]);
+struct query_order {
+	int rpos, i;
+};
+
+static int cmp_query(const void *a, const void *b) {
+	const struct query_order *x = a, *y = b;
+	if (x->rpos != y->rpos)
+		return (x->rpos > y->rpos) - (x->rpos < y->rpos);
+	return x->i - y->i;
 }
 
-void mapbase(int cid, char *rspe, char *rchr, int rpos, 
-						 char *sspe, char *schr, char orient, char *side,
-						 int *spos, int *newrpos) {
-	char chainfile[200];
-	struct chain_list *chain;
-	struct gf_list *gfa;
-	int rs, ss, ingap, roff, soff, ref, i;
+static pthread_mutex_t ChainLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* each species pair has a store of its own, opened once by whichever
+ * thread needs it first; the others wait for it */
+void load_chain_space(int rs, int ss) {
+	char chaindir[200];
+
+	if (__atomic_load_n(&Spe->chains[ss], __ATOMIC_ACQUIRE) != NULL)
+		return;
+	pthread_mutex_lock(&ChainLock);
+	if (Spe->chains[ss] == NULL) {
+		pair_dir(chaindir, sizeof(chaindir), Spe->chaindir, Spe->spename[rs], Spe->spename[ss], "chain");
+		__atomic_store_n(&Spe->chains[ss], open_chain_store(chaindir), __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&ChainLock);
+}
+
+void mapbase_many(int cid, const char *rspe, const char *rchr, const char *sspe, const char *schr, char orient,
+						 struct map_query *q, int n) {
+	const struct chain_rec *chain;
+	const struct chain_gf *gf;
+	struct query_order *order;
+	int rs, ss, roff, soff, i, k, blk, sorted;
 
 	rs = spe_idx(rspe);
 	ss = spe_idx(sspe);
-	sprintf(chainfile, "%s/%s/%s/chain/%s.chain", 
-					Chaindir, Spename[rs], Spename[ss], rchr);
-	
-	if (Spetag[ss] == 2) {
-		for (i = 0; i < Spesz; i++) {
-			if (i == rs || i == ss)
-				continue;
-			if (refchr[i][0] != '\0') {
-				free_chain_list(chainlist[i]);
-				refchr[i][0] = '\0';
-			}
-		}
+	COUNT(mapbase_calls, 1);
+	COUNT(mapbase_queries, n);
+	if (Spe->chains[ss] == NULL) {
+		COUNT(mapbase_reloads, 1);
+		TRACE_POINT1(mapbase_reload, ss);
 	}
+	load_chain_space(rs, ss);
+	if (n <= 0)
+		return;
 	
-	if (!same_string(refchr[ss], rchr)) {
-		if (refchr[ss][0] != '\0')
-			free_chain_list(chainlist[ss]);
-		strcpy(refchr[ss], rchr);
-		chainlist[ss] = read_chain(chainfile);
-	}
-	
-	for (chain = chainlist[ss]; chain != NULL; chain = chain->next)
-		if (chain->cid == cid)
-			break;
-	
+	chain = find_chain(Spe->chains[ss], rchr, cid);
 	if (chain == NULL)
-		fatalf("chain not exist: %d %s %s %d %s %s %c", cid, rspe, rchr, rpos, sspe, schr, orient);
-	if (rpos < chain->fbeg || rpos > chain->fend)
-    fatalf("wrong ref position: %d %s %s %d %s %s %c", cid, rspe, rchr, rpos, sspe, schr, orient);
+		fatalf("chain not exist: %d %s %s %d %s %s %c", cid, rspe, rchr, q[0].rpos, sspe, schr, orient);
+	gf = chain_blocks(Spe->chains[ss], chain);
 	
-	roff = soff = ingap = 0;	
-	ref = rpos - chain->fbeg; //offset of ref
-	
-	for (gfa = chain->gf; gfa != NULL; gfa = gfa->next) {
-		if (roff + gfa->size > ref) 
-			break;
-		else {	
-			roff += gfa->size;
-			soff += gfa->size;
-		}
-		if (roff + gfa->fgap >= ref) {
-			ingap = 1;
-			break;
-		}
-		else {
-			roff += gfa->fgap;
-			soff += gfa->sgap;
-		}
+	// lift in order of position, sweeping along the blocks once
+	order = ckalloc(n * sizeof(struct query_order));
+	for (i = 0, sorted = 1; i < n; i++) {
+		order[i].rpos = q[i].rpos;
+		order[i].i = i;
+		if (i > 0 && q[i].rpos < q[i-1].rpos)
+			sorted = 0;
+	}
+	if (!sorted)
+		qsort(order, n, sizeof(struct query_order), cmp_query);
+	for (k = 0, blk = 0; k < n; k++) {
+		i = order[k].i;
+		q[i].ok = q[i].rpos >= chain->fbeg && q[i].rpos <= chain->fend;
+		if (!q[i].ok)
+			continue;
+		blk = find_block(gf, chain->ngf, blk, q[i].rpos - chain->fbeg);
+		lift_offset(gf, chain->ngf, blk, q[i].rpos - chain->fbeg, q[i].right, &roff, &soff);
+		if (orient == '+')
+			q[i].spos = chain->sbeg + soff;
+		else
+			q[i].spos = chain->slen - (chain->sbeg + soff); //rev_comp coordinate
+		q[i].newrpos = chain->fbeg + roff;
+	}
+	free(order);
+}
+
+void mapbase(int cid, const char *rspe, const char *rchr, int rpos, 
+						 const char *sspe, const char *schr, char orient, const char *side,
+						 int *spos, int *newrpos) {
+	struct map_query q;
+
+	q.rpos = rpos;
+	q.right = same_string(side, "right");
+	mapbase_many(cid, rspe, rchr, sspe, schr, orient, &q, 1);
+	if (!q.ok)
+		fatalf("wrong ref position: %d %s %s %d %s %s %c", cid, rspe, rchr, rpos, sspe, schr, orient);
+	*spos = q.spos;
+	*newrpos = q.newrpos;
+}
+
+// a chain of a chromosome by its reference span
+struct chain_entry {
+	int lo, hi;
+	int maxhi;		// largest hi in the subtree rooted here
+	int k;			// of the chain in file order
+};
+
+/* the entries are sorted by lo; the middle entry of any range [l, r) is
+ * the root of the implicit search tree over that range */
+struct chain_index {
+	const struct chain_store *cs;
+	const struct chain_rec *chain;
+	struct chain_entry *e;
+	int n;
+};
+
+static int cmp_chain_entry(const void *a, const void *b) {
+	const struct chain_entry *x = a, *y = b;
+
+	if (x->lo != y->lo)
+		return (x->lo > y->lo) - (x->lo < y->lo);
+	return x->k - y->k;
+}
+
+static int set_maxhi(struct chain_entry *e, int l, int r) {
+	int m = (l + r) / 2, h, left, right;
+
+	if (l >= r)
+		return -1;
+	// MAX() takes its arguments twice
+	left = set_maxhi(e, l, m);
+	right = set_maxhi(e, m + 1, r);
+	h = MAX(e[m].hi, left);
+	return e[m].maxhi = MAX(h, right);
+}
+
+struct chain_index *index_chain_chrom(const struct chain_store *cs, const char *chrom) {
+	struct chain_index *ix;
+	int i, n;
+	const struct chain_rec *c = chrom_chains(cs, chrom, &n);
+
+	if (c == NULL)
+		return NULL;
+	ix = ckallocz(sizeof(struct chain_index));
+	ix->cs = cs;
+	ix->chain = c;
+	ix->n = n;
+	ix->e = ckalloc(n * sizeof(struct chain_entry));
+	for (i = 0; i < n; i++) {
+		ix->e[i].lo = c[i].fbeg;
+		ix->e[i].hi = c[i].fend;
+		ix->e[i].k = i;
 	}
-	if (ingap == 1) {
-		if (same_string(side, "right")) {
-			roff += gfa->fgap;
-			soff += gfa->sgap;
+	qsort(ix->e, n, sizeof(struct chain_entry), cmp_chain_entry);
+	set_maxhi(ix->e, 0, n);
+	return ix;
+}
+
+void free_chain_index(struct chain_index *ix) {
+	if (ix == NULL)
+		return;
+	free(ix->e);
+	free(ix);
+}
+
+// the chains meeting [beg, end), added to *k
+static void stab_chains(const struct chain_entry *e, int l, int r, int beg, int end,
+						int **k, int *nk, int *maxk) {
+	int m;
+
+	while (l < r) {
+		m = (l + r) / 2;
+		if (e[m].maxhi <= beg)
+			return;
+		stab_chains(e, l, m, beg, end, k, nk, maxk);
+		if (e[m].lo >= end)
+			return;
+		if (e[m].hi > beg) {
+			if (*nk == *maxk) {
+				*maxk = 2 * *maxk;
+				*k = ckrealloc(*k, *maxk * sizeof(int));
+			}
+			(*k)[(*nk)++] = e[m].k;
 		}
+		l = m + 1;
 	}
-	else {
-		soff += (ref - roff);
-		roff = ref;
+}
+
+static int cmp_int(const void *a, const void *b) {
+	return *(const int *)a - *(const int *)b;
+}
+
+/* lift_by ------------- the bases of [beg, end) chain c holds, and their span */
+static int lift_by(const struct chain_index *ix, const struct chain_rec *c, int beg, int end,
+					int *sbeg, int *send) {
+	const struct chain_gf *gf = chain_blocks(ix->cs, c);
+	int rb = MAX(beg, c->fbeg) - c->fbeg, re = MIN(end, c->fend) - c->fbeg;
+	int i, lo, hi, s0 = -1, s1 = -1, held = 0;
+
+	for (i = find_block(gf, c->ngf, 0, rb); i < (int)c->ngf && gf[i].roff < re; i++) {
+		lo = MAX(rb, gf[i].roff);
+		hi = MIN(re, gf[i].roff + gf[i].size);
+		if (hi <= lo)
+			continue;
+		if (s0 < 0)
+			s0 = gf[i].soff + (lo - gf[i].roff);
+		s1 = gf[i].soff + (hi - gf[i].roff);
+		held += hi - lo;
 	}
-	if (orient == '+') {
-		*spos = chain->sbeg + soff;
-		*newrpos = chain->fbeg + roff;
+	if (held == 0)
+		return 0;
+	if (c->sorient == '-') {
+		// rev_comp coordinates, as in mapbase_many()
+		*sbeg = c->slen - (c->sbeg + s1);
+		*send = c->slen - (c->sbeg + s0);
+	} else {
+		*sbeg = c->sbeg + s0;
+		*send = c->sbeg + s1;
 	}
-	else {
-		*spos = chain->slen - (chain->sbeg + soff); //rev_comp coordinate
-		*newrpos = chain->fbeg + roff;
+	return held;
+}
+
+bool lift_query(const struct chain_index *ix, struct lift_query *q, double min_match) {
+	const struct chain_rec *c;
+	int *k, nk = 0, maxk = 64, i, held, sbeg, send, len = q->end - q->beg;
+
+	q->schr = NULL;
+	q->matched = 0;
+	if (ix == NULL || len <= 0)
+		return 0;
+	k = ckalloc(maxk * sizeof(int));
+	stab_chains(ix->e, 0, ix->n, q->beg, q->end, &k, &nk, &maxk);
+	qsort(k, nk, sizeof(int), cmp_int);
+	for (i = 0; i < nk; i++) {
+		c = &ix->chain[k[i]];
+		if ((held = lift_by(ix, c, q->beg, q->end, &sbeg, &send)) == 0)
+			continue;
+		q->matched = MAX(q->matched, (double)held / len);
+		if (held < min_match * len)
+			continue;
+		q->schr = chain_schr(ix->cs, c);
+		q->sbeg = sbeg;
+		q->send = send;
+		q->orient = c->sorient;
+		q->cid = c->cid;
+		break;
+	}
+	free(k);
+	return q->schr != NULL;
+}
+
+// the queries of a chromosome, and of a batch of them
+struct lift_chrom {
+	long lo, hi;
+	struct chain_index *ix;
+};
+
+struct lift_batch {
+	long lo, hi;
+	int chrom;
+};
+
+struct lift_run {
+	const struct chain_store *cs;
+	struct lift_query *q;
+	long *order;
+	struct lift_chrom *chrom;
+	struct lift_batch *batch;
+	double min_match;
+	long *lifted;		// by batch
+};
+
+static int cmp_lift(const void *a, const void *b, void *arg) {
+	const struct lift_query *q = arg, *x = &q[*(const long *)a], *y = &q[*(const long *)b];
+	int c = strcmp(x->chrom, y->chrom);
+
+	if (c != 0)
+		return c;
+	if (x->beg != y->beg)
+		return (x->beg > y->beg) - (x->beg < y->beg);
+	return (*(const long *)a > *(const long *)b) - (*(const long *)a < *(const long *)b);
+}
+
+static void index_job(int job, void *arg) {
+	struct lift_run *r = arg;
+	struct lift_chrom *c = &r->chrom[job];
+
+	c->ix = index_chain_chrom(r->cs, r->q[r->order[c->lo]].chrom);
+}
+
+static void lift_job(int job, void *arg) {
+	struct lift_run *r = arg;
+	const struct lift_batch *b = &r->batch[job];
+	long i;
+
+	for (i = b->lo; i < b->hi; i++)
+		r->lifted[job] += lift_query(r->chrom[b->chrom].ix, &r->q[r->order[i]], r->min_match);
+}
+
+#define LIFT_BATCH 4096
+
+long lift_queries(const struct chain_store *cs, struct lift_query *q, long n,
+					double min_match, int nthreads) {
+	struct lift_run r;
+	long i, lo, total = 0;
+	int nchrom = 0, nbatch = 0, maxchrom = 0, maxbatch = 0, c, b;
+
+	r.cs = cs;
+	r.q = q;
+	r.min_match = min_match;
+	r.chrom = NULL;
+	r.batch = NULL;
+	// sorted by position, so that a batch looks up nearby chains
+	r.order = ckalloc((n + 1) * sizeof(long));
+	for (i = 0; i < n; i++)
+		r.order[i] = i;
+	qsort_r(r.order, n, sizeof(long), cmp_lift, q);
+	for (lo = 0; lo < n; lo = i) {
+		for (i = lo; i < n && same_string(q[r.order[i]].chrom, q[r.order[lo]].chrom); i++)
+			;
+		if (nchrom == maxchrom) {
+			maxchrom = maxchrom ? 2 * maxchrom : 64;
+			r.chrom = ckrealloc(r.chrom, maxchrom * sizeof(struct lift_chrom));
+		}
+		r.chrom[nchrom].lo = lo;
+		r.chrom[nchrom].hi = i;
+		r.chrom[nchrom++].ix = NULL;
 	}
+	for (c = 0; c < nchrom; c++)
+		for (lo = r.chrom[c].lo; lo < r.chrom[c].hi; lo += LIFT_BATCH) {
+			if (nbatch == maxbatch) {
+				maxbatch = maxbatch ? 2 * maxbatch : 64;
+				r.batch = ckrealloc(r.batch, maxbatch * sizeof(struct lift_batch));
+			}
+			r.batch[nbatch].lo = lo;
+			r.batch[nbatch].hi = MIN(lo + LIFT_BATCH, r.chrom[c].hi);
+			r.batch[nbatch++].chrom = c;
+		}
+	r.lifted = ckallocz((nbatch + 1) * sizeof(long));
+	run_jobs(nchrom, nthreads, index_job, &r);
+	run_jobs(nbatch, nthreads, lift_job, &r);
+	for (b = 0; b < nbatch; b++)
+		total += r.lifted[b];
+	for (c = 0; c < nchrom; c++)
+		free_chain_index(r.chrom[c].ix);
+	free(r.lifted);
+	free(r.batch);
+	free(r.chrom);
+	free(r.order);
+	return total;
 }
@@ -23,9 +23,64 @@
  * Output:	spos		-	position in the secondary chr
  * 					newrpos	-	adjusted position in reference chr
  * **************************************************************/
-void mapbase(int cid, char *rspe, char *rchr, int rpos, 
-					char *sspe, char *schr, char orient, char *side, 
+void mapbase(int cid, const char *rspe, const char *rchr, int rpos, 
+					const char *sspe, const char *schr, char orient, const char *side, 
 					int *spos, int *newrpos);
 
+/* **************************************************************
+ * The same for several positions on one chain, e.g. every break of
+ * a segment; the chain is looked up once and the positions are
+ * lifted in one sorted sweep along it. A position outside the
+ * chain gets ok = 0 instead of stopping the program.
+ * **************************************************************/
+struct map_query {
+	int rpos;			// position in the reference chr
+	int right;		// side is "right" rather than "left"
+	int spos, newrpos;
+	int ok;
+};
+
+void mapbase_many(int cid, const char *rspe, const char *rchr, const char *sspe, const char *schr, char orient,
+					struct map_query *q, int n);
+
+/* opens the chains of a species pair ahead of time; mapbase() does it on
+ * first use, from any thread. A store is per species, and stays open
+ * until free_chain_space() */
+void load_chain_space(int rspe_idx, int sspe_idx);
+
 void free_chain_space(int sspe_idx);
+
+/* **************************************************************
+ * Lifting of intervals by the chains of a chain store, as liftOver
+ * does: an interval of the reference goes by the first chain, in the
+ * order of the chain files (the best score first), whose gap-free
+ * blocks hold min_match of its bases, to the span from the first to
+ * the last of the bases they hold. The chains of a chromosome are
+ * indexed by position once, in a sorted array searched as an
+ * implicit tree as in segindex.c.
+ * **************************************************************/
+struct chain_store;
+struct chain_index;
+
+struct lift_query {
+	const char *chrom;	// of the reference
+	int beg, end;		// 0-based, the end exclusive
+	// set by the lifting
+	const char *schr;	// of the other species; NULL if not lifted
+	int sbeg, send;
+	char orient;		// '-' if on the other strand
+	int cid;			// of the chain lifted by
+	double matched;		// of the bases, by the best chain
+};
+
+struct chain_index *index_chain_chrom(const struct chain_store *cs, const char *chrom);
+void free_chain_index(struct chain_index *ix);
+
+// lifts q by the chains of ix (of q->chrom); 0 if none holds enough of it
+bool lift_query(const struct chain_index *ix, struct lift_query *q, double min_match);
+
+// lifts q[0..n-1], of any chromosomes in any order, sorted and in
+// batches on up to nthreads threads; returns how many were lifted
+long lift_queries(const struct chain_store *cs, struct lift_query *q, long n,
+					double min_match, int nthreads);
 #endif
@@ -0,0 +1,591 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "bigchain.h"
+#include "chrtab.h"
+#include "remote.h"
+#include "trace.h"
+
+#define BIG_MAGIC	0x8789F2EB
+#define BPT_MAGIC	0x78CA8C91
+#define CIR_MAGIC	0x2468ACE0
+#define NCACHE		8		// decoded data blocks kept per file
+
+// a data block of a bigBed, as it is once uncompressed
+struct big_block {
+	uint64_t off;
+	char *data;
+	uint32_t len;
+};
+
+// one bigBed (bbiFile.h): its header, chromosome names and R-tree
+struct bbi_file {
+	char path[1000];
+	FILE *fp;
+	uint64_t chrom_tree, index;
+	uint32_t ubuf;			// uncompressBufSize; 0 if not compressed
+	const char **name;		// by chromosome id, interned
+	uint32_t *size;
+	uint32_t nchrom;
+	struct big_block cache[NCACHE];
+	int next;
+};
+
+// a gap-free block of bigLink, of chain k of a chromosome
+struct big_link {
+	int32_t k, tbeg, tend, qbeg;
+};
+
+// a chromosome of bigChain: its chains, read as it is first looked up
+struct big_chrom {
+	const char *name;
+	uint32_t cix, lix;		// its ids in bigChain and bigLink
+	uint32_t size;
+	int loaded, linked, nchain;	// linked: the blocks of every chain read
+	struct chain_rec *chain;	// the best score first
+	double *score;
+	int *byid;			// chain indexes by cid
+	const char **schr;
+	const struct chain_gf **blk;	// NULL until read
+};
+
+struct big_chains {
+	struct bbi_file chain, link;
+	struct big_chrom *chrom;	// by name
+	int nchrom;
+	pthread_mutex_t lock;
+};
+
+static uint16_t get16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const unsigned char *p)
+{
+	return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+/* read_at ------------------------------- read size bytes at off of a file */
+static void read_at(struct bbi_file *f, uint64_t off, void *buf, size_t size)
+{
+	if (fseeko(f->fp, (off_t)off, SEEK_SET) != 0 || fread(buf, 1, size, f->fp) != size)
+		fatalf("%s: cannot read %zu bytes at %llu", f->path, size, (unsigned long long)off);
+}
+
+/* read_chroms ------------------- the chromosomes of a node of the B+ tree */
+static void read_chroms(struct bbi_file *f, uint64_t off, uint32_t keysize)
+{
+	unsigned char head[4], *item, *p;
+	char key[256];
+	uint32_t i, n, id, isize;
+
+	read_at(f, off, head, 4);
+	n = get16(head + 2);
+	isize = keysize + 8;
+	item = ckalloc(n * isize + 1);
+	read_at(f, off + 4, item, n * isize);
+	for (i = 0, p = item; i < n; i++, p += isize) {
+		if (head[0] == 0) {
+			read_chroms(f, get64(p + keysize), keysize);
+			continue;
+		}
+		if ((id = get32(p + keysize)) >= f->nchrom)
+			fatalf("%s: chromosome id %u out of range", f->path, id);
+		memcpy(key, p, keysize);
+		key[keysize] = '\0';
+		f->name[id] = intern_chr(key);
+		f->size[id] = get32(p + keysize + 4);
+	}
+	free(item);
+}
+
+/* open_bbi ------------------------------- the header and names of a bigBed */
+static bool open_bbi(struct bbi_file *f, const char *dir, const char *file)
+{
+	unsigned char h[64], t[32];
+	uint32_t keysize;
+
+	memset(f, 0, sizeof(struct bbi_file));
+	snprintf(f->path, sizeof(f->path), "%s/%s", dir, file);
+	if ((f->fp = is_url(f->path) ? open_url(f->path) : fopen(f->path, "r")) == NULL)
+		return 0;
+	read_at(f, 0, h, 64);
+	if (get32(h) != BIG_MAGIC)
+		fatalf("%s is not a bigBed file (or is of the other byte order)", f->path);
+	f->chrom_tree = get64(h + 8);
+	f->index = get64(h + 24);
+	f->ubuf = get32(h + 52);
+	read_at(f, f->chrom_tree, t, 32);
+	if (get32(t) != BPT_MAGIC)
+		fatalf("%s: bad chromosome tree", f->path);
+	if ((keysize = get32(t + 8)) >= 256 || get32(t + 12) != 8)
+		fatalf("%s: chromosome tree keys of %u bytes are not handled", f->path, keysize);
+	f->nchrom = (uint32_t)get64(t + 16);
+	f->name = ckallocz((f->nchrom + 1) * sizeof(char *));
+	f->size = ckallocz((f->nchrom + 1) * sizeof(uint32_t));
+	if (f->nchrom > 0)
+		read_chroms(f, f->chrom_tree + 32, keysize);
+	return 1;
+}
+
+static void close_bbi(struct bbi_file *f)
+{
+	int i;
+
+	if (f->fp)
+		fclose(f->fp);
+	for (i = 0; i < NCACHE; i++)
+		free(f->cache[i].data);
+	free(f->name);
+	free(f->size);
+}
+
+/* data_block ---------------------- a data block, uncompressed, from the cache */
+static const struct big_block *data_block(struct bbi_file *f, uint64_t off, uint64_t size)
+{
+	struct big_block *b;
+	unsigned char *raw;
+	uLongf len;
+	int i;
+
+	for (i = 0; i < NCACHE; i++)
+		if (f->cache[i].data != NULL && f->cache[i].off == off)
+			return &f->cache[i];
+	b = &f->cache[f->next];
+	f->next = (f->next + 1) % NCACHE;
+	free(b->data);
+	raw = ckalloc(size + 1);
+	read_at(f, off, raw, size);
+	if (f->ubuf == 0) {
+		b->data = (char *)raw;
+		b->len = size;
+	} else {
+		b->data = ckalloc(f->ubuf + 1);
+		len = f->ubuf;
+		if (uncompress((Bytef *)b->data, &len, raw, size) != Z_OK)
+			fatalf("%s: cannot uncompress the block at %llu", f->path, (unsigned long long)off);
+		b->len = len;
+		free(raw);
+	}
+	b->off = off;
+	COUNT(big_blocks_read, 1);
+	return b;
+}
+
+// does (c1, p1) come before (c2, p2)
+static int before(uint32_t c1, uint32_t p1, uint32_t c2, uint32_t p2)
+{
+	return c1 < c2 || (c1 == c2 && p1 < p2);
+}
+
+/* query_node ------------ the records of [beg, end) under a node of the R-tree */
+/* calling each(rest, start, end, arg) for each, rest being the fields after
+ * the first three */
+static void query_node(struct bbi_file *f, uint64_t off, uint32_t cix, uint32_t beg, uint32_t end,
+						void (*each)(const char *, uint32_t, uint32_t, void *), void *arg)
+{
+	unsigned char head[4], *item, *p;
+	const struct big_block *b;
+	const char *r, *e;
+	uint32_t i, n, isize, s, t;
+
+	read_at(f, off, head, 4);
+	n = get16(head + 2);
+	isize = head[0] ? 32 : 24;
+	item = ckalloc(n * isize + 1);
+	read_at(f, off + 4, item, n * isize);
+	for (i = 0, p = item; i < n; i++, p += isize) {
+		if (!before(cix, beg, get32(p + 8), get32(p + 12)) || !before(get32(p), get32(p + 4), cix, end))
+			continue;
+		if (!head[0]) {
+			query_node(f, get64(p + 16), cix, beg, end, each, arg);
+			continue;
+		}
+		b = data_block(f, get64(p + 16), get64(p + 24));
+		for (r = b->data, e = b->data + b->len; r + 12 < e; r += strlen(r) + 1) {
+			s = get32((const unsigned char *)r + 4);
+			t = get32((const unsigned char *)r + 8);
+			if (get32((const unsigned char *)r) == cix && s < end && t > beg)
+				each(r + 12, s, t, arg);
+			r += 12;
+		}
+	}
+	free(item);
+}
+
+static void query_bbi(struct bbi_file *f, uint32_t cix, uint32_t beg, uint32_t end,
+						void (*each)(const char *, uint32_t, uint32_t, void *), void *arg)
+{
+	unsigned char h[4];
+
+	read_at(f, f->index, h, 4);
+	if (get32(h) != CIR_MAGIC)
+		fatalf("%s: bad R-tree index", f->path);
+	query_node(f, f->index + 48, cix, beg, end, each, arg);
+}
+
+/* split_rest ---------------------- the tab-separated fields of a record's rest */
+static int split_rest(const char *rest, char **field, int max, char *buf, size_t size)
+{
+	int n = 0;
+	char *s;
+
+	snprintf(buf, size, "%s", rest);
+	for (s = buf; n < max; ) {
+		field[n++] = s;
+		if ((s = strchr(s, '\t')) == NULL)
+			break;
+		*s++ = '\0';
+	}
+	return n;
+}
+
+static int bbi_chrom(const struct bbi_file *f, const char *name)
+{
+	uint32_t i;
+
+	for (i = 0; i < f->nchrom; i++)
+		if (f->name[i] == name)
+			return i;
+	return -1;
+}
+
+static int cmp_chrom(const void *a, const void *b)
+{
+	return strcmp(((const struct big_chrom *)a)->name, ((const struct big_chrom *)b)->name);
+}
+
+/* open_big_chains ---------------- the bigChain and bigLink of a directory */
+struct big_chains *open_big_chains(const char *chaindir)
+{
+	struct big_chains *b = ckallocz(sizeof(struct big_chains));
+	uint32_t i;
+	int k;
+
+	if (!open_bbi(&b->chain, chaindir, "all.bigChain")) {
+		free(b);
+		return NULL;
+	}
+	if (!open_bbi(&b->link, chaindir, "all.bigLink"))
+		fatalf("%s/all.bigChain has no all.bigLink next to it", chaindir);
+	b->chrom = ckallocz((b->chain.nchrom + 1) * sizeof(struct big_chrom));
+	for (i = 0; i < b->chain.nchrom; i++) {
+		if (b->chain.name[i] == NULL)
+			continue;
+		b->chrom[b->nchrom].name = b->chain.name[i];
+		b->chrom[b->nchrom].cix = i;
+		b->chrom[b->nchrom].size = b->chain.size[i];
+		k = bbi_chrom(&b->link, b->chain.name[i]);
+		b->chrom[b->nchrom++].lix = k < 0 ? UINT32_MAX : (uint32_t)k;
+	}
+	qsort(b->chrom, b->nchrom, sizeof(struct big_chrom), cmp_chrom);
+	pthread_mutex_init(&b->lock, NULL);
+	return b;
+}
+
+void close_big_chains(struct big_chains *b)
+{
+	struct big_chrom *bc;
+	int i, k;
+
+	if (b == NULL)
+		return;
+	for (i = 0; i < b->nchrom; i++) {
+		bc = &b->chrom[i];
+		for (k = 0; bc->blk != NULL && k < bc->nchain; k++)
+			free((void *)bc->blk[k]);
+		free(bc->chain);
+		free(bc->score);
+		free(bc->byid);
+		free(bc->schr);
+		free(bc->blk);
+	}
+	free(b->chrom);
+	close_bbi(&b->chain);
+	close_bbi(&b->link);
+	pthread_mutex_destroy(&b->lock);
+	free(b);
+}
+
+// the chromosome being loaded, and how much room its arrays have
+struct chain_loader {
+	struct big_chains *b;
+	struct big_chrom *bc;
+	int max;
+};
+
+/* add_chain -------------------------------- a record of bigChain (bigChain.as) */
+/* name score strand tSize qName qSize qStart qEnd chainScore, after the
+ * chromosome, chromStart and chromEnd */
+static void add_chain(const char *rest, uint32_t beg, uint32_t end, void *arg)
+{
+	struct chain_loader *ld = arg;
+	struct big_chrom *bc = ld->bc;
+	struct chain_rec *c;
+	char buf[1000], *f[9];
+
+	if (bc->nchain == ld->max) {
+		ld->max = ld->max ? 2 * ld->max : 1024;
+		bc->chain = MEM_AS(chains, ckrealloc(bc->chain, ld->max * sizeof(struct chain_rec)));
+		bc->score = ckrealloc(bc->score, ld->max * sizeof(double));
+		bc->schr = ckrealloc(bc->schr, ld->max * sizeof(char *));
+	}
+	if (split_rest(rest, f, 9, buf, sizeof(buf)) != 9)
+		fatalf("%s: cannot parse: %s", ld->b->chain.path, rest);
+	c = &bc->chain[bc->nchain];
+	memset(c, 0, sizeof(struct chain_rec));
+	c->cid = atoi(f[0]);
+	c->fbeg = beg;
+	c->fend = end;
+	c->forient = '+';
+	c->sorient = f[2][0];
+	c->slen = atoi(f[5]);
+	c->sbeg = atoi(f[6]);
+	c->send = atoi(f[7]);
+	bc->score[bc->nchain] = atof(f[8]);
+	bc->schr[bc->nchain++] = intern_chr(f[4]);
+}
+
+// what the chains of chromosome being sorted are sorted by
+static __thread const struct big_chrom *Sorting;
+
+// the best score first, as the chain files have them
+static int cmp_score(const void *a, const void *b)
+{
+	const struct big_chrom *bc = Sorting;
+	int x = *(const int *)a, y = *(const int *)b;
+
+	if (bc->score[x] != bc->score[y])
+		return bc->score[x] > bc->score[y] ? -1 : 1;
+	return bc->chain[x].cid - bc->chain[y].cid;
+}
+
+static int cmp_id(const void *a, const void *b)
+{
+	const struct big_chrom *bc = Sorting;
+
+	return bc->chain[*(const int *)a].cid - bc->chain[*(const int *)b].cid;
+}
+
+/* load_chrom -------------------------- read the chains of a chromosome */
+static void load_chrom(struct big_chains *b, struct big_chrom *bc)
+{
+	struct chain_loader ld;
+	struct chain_rec *chain;
+	const char **schr;
+	double *score;
+	int *order, i;
+
+	ld.b = b;
+	ld.bc = bc;
+	ld.max = 0;
+	query_bbi(&b->chain, bc->cix, 0, bc->size, add_chain, &ld);
+	// in the order of the chain files, with the chromosome's index as chrom
+	// and each chain's own as gf
+	Sorting = bc;
+	order = ckalloc((bc->nchain + 1) * sizeof(int));
+	for (i = 0; i < bc->nchain; i++)
+		order[i] = i;
+	qsort(order, bc->nchain, sizeof(int), cmp_score);
+	chain = MEM_AS(chains, ckalloc((bc->nchain + 1) * sizeof(struct chain_rec)));
+	score = ckalloc((bc->nchain + 1) * sizeof(double));
+	schr = ckalloc((bc->nchain + 1) * sizeof(char *));
+	for (i = 0; i < bc->nchain; i++) {
+		chain[i] = bc->chain[order[i]];
+		chain[i].chrom = bc - b->chrom;
+		chain[i].gf = i;
+		score[i] = bc->score[order[i]];
+		schr[i] = bc->schr[order[i]];
+	}
+	free(bc->chain);
+	free(bc->score);
+	free(bc->schr);
+	bc->chain = chain;
+	bc->score = score;
+	bc->schr = schr;
+	for (i = 0; i < bc->nchain; i++)
+		order[i] = i;
+	qsort(order, bc->nchain, sizeof(int), cmp_id);
+	bc->byid = order;
+	bc->blk = ckallocz((bc->nchain + 1) * sizeof(struct chain_gf *));
+	__atomic_store_n(&bc->loaded, 1, __ATOMIC_RELEASE);
+}
+
+// the blocks of bigLink being gathered, of one chain or of all
+struct link_loader {
+	struct big_chains *b;
+	struct big_chrom *bc;
+	int only;			// a chain index, or -1 for every one
+	struct big_link *l;
+	int n, max;
+};
+
+/* add_link ------------------------------ a record of bigLink (bigLink.as) */
+/* name qStart, the name being the id of the chain */
+static void add_link(const char *rest, uint32_t beg, uint32_t end, void *arg)
+{
+	struct link_loader *ld = arg;
+	struct big_chrom *bc = ld->bc;
+	char buf[200], *f[2];
+	int lo = 0, hi = bc->nchain - 1, m, cid, k = -1;
+
+	if (split_rest(rest, f, 2, buf, sizeof(buf)) != 2)
+		fatalf("%s: cannot parse: %s", ld->b->link.path, rest);
+	cid = atoi(f[0]);
+	while (lo <= hi) {
+		m = (lo + hi) / 2;
+		if (bc->chain[bc->byid[m]].cid == cid) {
+			k = bc->byid[m];
+			break;
+		}
+		if (bc->chain[bc->byid[m]].cid < cid)
+			lo = m + 1;
+		else
+			hi = m - 1;
+	}
+	if (k < 0 || (ld->only >= 0 ? k != ld->only : bc->blk[k] != NULL))
+		return;
+	if (ld->n == ld->max) {
+		ld->max = ld->max ? 2 * ld->max : 1024;
+		ld->l = ckrealloc(ld->l, ld->max * sizeof(struct big_link));
+	}
+	ld->l[ld->n].k = k;
+	ld->l[ld->n].tbeg = beg;
+	ld->l[ld->n].tend = end;
+	ld->l[ld->n++].qbeg = atoi(f[1]);
+}
+
+static int cmp_link(const void *a, const void *b)
+{
+	const struct big_link *x = a, *y = b;
+
+	if (x->k != y->k)
+		return x->k - y->k;
+	return x->tbeg - y->tbeg;
+}
+
+/* load_links --------------- the gap-free blocks of one chain, or of them all */
+static void load_links(struct big_chains *b, struct big_chrom *bc, int only)
+{
+	struct link_loader ld;
+	struct chain_rec *c;
+	struct chain_gf *gf;
+	const struct big_link *l;
+	int i, j, k;
+
+	memset(&ld, 0, sizeof(struct link_loader));
+	ld.b = b;
+	ld.bc = bc;
+	ld.only = only;
+	if (bc->lix != UINT32_MAX) {
+		if (only >= 0)
+			query_bbi(&b->link, bc->lix, bc->chain[only].fbeg, bc->chain[only].fend, add_link, &ld);
+		else
+			query_bbi(&b->link, bc->lix, 0, bc->size, add_link, &ld);
+	}
+	qsort(ld.l, ld.n, sizeof(struct big_link), cmp_link);
+	for (i = 0; i < ld.n; i = j) {
+		k = ld.l[i].k;
+		for (j = i; j < ld.n && ld.l[j].k == k; j++)
+			;
+		c = &bc->chain[k];
+		gf = MEM_AS(chains, ckalloc((j - i) * sizeof(struct chain_gf)));
+		for (l = &ld.l[i]; l < &ld.l[j]; l++) {
+			gf[l - &ld.l[i]].size = l->tend - l->tbeg;
+			gf[l - &ld.l[i]].roff = l->tbeg - c->fbeg;
+			gf[l - &ld.l[i]].soff = l->qbeg - c->sbeg;
+			gf[l - &ld.l[i]].fgap = l + 1 < &ld.l[j] ? l[1].tbeg - l->tend : 0;
+			gf[l - &ld.l[i]].sgap = l + 1 < &ld.l[j] ? l[1].qbeg - (l->qbeg + (l->tend - l->tbeg)) : 0;
+		}
+		c->ngf = j - i;
+		__atomic_store_n(&bc->blk[k], gf, __ATOMIC_RELEASE);
+		COUNT(big_chains_linked, 1);
+	}
+	// a chain with no blocks in bigLink is left with none rather than looked for again
+	for (k = only >= 0 ? only : 0; k < bc->nchain && (only < 0 || k == only); k++)
+		if (bc->blk[k] == NULL)
+			__atomic_store_n(&bc->blk[k], ckallocz(sizeof(struct chain_gf)), __ATOMIC_RELEASE);
+	free(ld.l);
+}
+
+/* big_chrom ----------------------- a chromosome of bigChain, its chains read */
+static struct big_chrom *big_chrom(struct big_chains *b, const char *chrom)
+{
+	struct big_chrom key, *bc;
+
+	key.name = chrom;
+	if ((bc = bsearch(&key, b->chrom, b->nchrom, sizeof(struct big_chrom), cmp_chrom)) == NULL)
+		return NULL;
+	if (!__atomic_load_n(&bc->loaded, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&b->lock);
+		if (!bc->loaded)
+			load_chrom(b, bc);
+		pthread_mutex_unlock(&b->lock);
+	}
+	return bc;
+}
+
+/* big_find_chain ------------------ a chain by chromosome and id, its blocks read */
+const struct chain_rec *big_find_chain(struct big_chains *b, const char *chrom, int cid)
+{
+	struct big_chrom *bc = big_chrom(b, chrom);
+	int lo = 0, hi, m, k;
+
+	if (bc == NULL)
+		return NULL;
+	for (hi = bc->nchain - 1; lo <= hi; ) {
+		m = (lo + hi) / 2;
+		k = bc->byid[m];
+		if (bc->chain[k].cid == cid) {
+			if (__atomic_load_n(&bc->blk[k], __ATOMIC_ACQUIRE) == NULL) {
+				pthread_mutex_lock(&b->lock);
+				if (bc->blk[k] == NULL)
+					load_links(b, bc, k);
+				pthread_mutex_unlock(&b->lock);
+			}
+			return &bc->chain[k];
+		}
+		if (bc->chain[k].cid < cid)
+			lo = m + 1;
+		else
+			hi = m - 1;
+	}
+	return NULL;
+}
+
+const struct chain_gf *big_chain_blocks(const struct big_chains *b, const struct chain_rec *c)
+{
+	return __atomic_load_n(&b->chrom[c->chrom].blk[c->gf], __ATOMIC_ACQUIRE);
+}
+
+const char *big_chain_schr(const struct big_chains *b, const struct chain_rec *c)
+{
+	return b->chrom[c->chrom].schr[c->gf];
+}
+
+/* big_chrom_chains ---------------- every chain of a chromosome, with its blocks */
+const struct chain_rec *big_chrom_chains(struct big_chains *b, const char *chrom, int *n)
+{
+	struct big_chrom *bc = big_chrom(b, chrom);
+
+	*n = 0;
+	if (bc == NULL || bc->nchain == 0)
+		return NULL;
+	if (!__atomic_load_n(&bc->linked, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&b->lock);
+		if (!bc->linked) {
+			load_links(b, bc, -1);
+			__atomic_store_n(&bc->linked, 1, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&b->lock);
+	}
+	*n = bc->nchain;
+	return bc->chain;
+}
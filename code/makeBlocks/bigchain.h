@@ -0,0 +1,35 @@
+/* **************************************************************
+ * The chains of a chain directory in the indexed binary form UCSC
+ * serves them in, instead of text chain files: all.bigChain, a
+ * bigBed of one record per chain (bigChain.as), and all.bigLink, a
+ * bigBed of the gap-free blocks of the chains (bigLink.as), as
+ * bedToBigBed makes them from hgLoadChain -noBin tables. Nothing is
+ * parsed up front: the chains of a reference chromosome are read
+ * from all.bigChain as the chromosome is first looked up, and the
+ * blocks of a chain from all.bigLink, through its R-tree index, as
+ * the chain is, so that only the chains the segments use are read
+ * and only the data blocks that hold them. Either file may be a URL
+ * (remote.h), read a megabyte block at a time through the cache.
+ * chainstore.c hands its lookups over to these for such a directory;
+ * the records and blocks they return stay where they are until the
+ * store is closed, and the lookups are safe from several threads.
+ * **************************************************************/
+
+#ifndef _BIGCHAIN_H_
+#define _BIGCHAIN_H_
+
+#include "chainstore.h"
+
+struct big_chains;
+
+// the bigChain and bigLink of a chain directory; NULL if it has none
+struct big_chains *open_big_chains(const char *chaindir);
+void close_big_chains(struct big_chains *b);
+
+const struct chain_rec *big_find_chain(struct big_chains *b, const char *chrom, int cid);
+const struct chain_gf *big_chain_blocks(const struct big_chains *b, const struct chain_rec *c);
+const char *big_chain_schr(const struct big_chains *b, const struct chain_rec *c);
+// every chain of a chromosome with its blocks, the best score first
+const struct chain_rec *big_chrom_chains(struct big_chains *b, const char *chrom, int *n);
+
+#endif
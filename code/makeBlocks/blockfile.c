@@ -0,0 +1,544 @@
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "blockfile.h"
+#include "workpool.h"
+#include "numfmt.h"
+#include "trace.h"
+
+static const char Magic[8] = "DSCHBL1";
+
+int Block_threads = 0;
+
+struct blockfile_header {
+	char magic[8];
+	uint32_t style, nspe, nblock, nseg, ncid, nname, namelen;
+};
+
+struct bf_block {
+	int32_t id;
+	uint32_t seg, nseg;		// its segments are seg..seg+nseg-1
+};
+
+struct bf_seg {
+	int32_t beg, end, id, subid, chid, chnum;
+	uint32_t cid;			// first of its chnum entries in the chain id table
+	uint32_t chr;			// name index
+	uint16_t spe;			// name index, 0..nspe-1
+	char orient, state;
+};
+
+struct block_writer {
+	FILE *fp;
+	enum block_style style;
+	int binary, open;
+	struct blockfile_header h;
+	struct bf_block *blk;
+	struct bf_seg *seg;
+	int32_t *cid;
+	uint32_t *nameoff;
+	char *names;
+	uint32_t maxblk, maxseg, maxcid, maxname, maxnamelen;
+	int *chrname, nchrname;	// chromosome id -> 1 + name index
+	struct block_list *head, *last;	// the list of a writer to memory
+	struct seg_list **tail;
+};
+
+#define GROW(p, n, max, more) do { \
+		if ((n) + (more) > (max)) { \
+			(max) = MAX(2 * (max), (n) + (more) + 1024); \
+			(p) = ckrealloc((p), (max) * sizeof(*(p))); \
+		} \
+	} while (0)
+
+static uint32_t add_name(struct block_writer *w, const char *name)
+{
+	uint32_t len = strlen(name) + 1;
+
+	GROW(w->nameoff, w->h.nname, w->maxname, 1);
+	GROW(w->names, w->h.namelen, w->maxnamelen, len);
+	w->nameoff[w->h.nname] = w->h.namelen;
+	memcpy(w->names + w->h.namelen, name, len);
+	w->h.namelen += len;
+	return w->h.nname++;
+}
+
+/* the text layouts ---------------------------------------------------- */
+
+static int prints_chid(enum block_style style, int spe)
+{
+	switch (style) {
+	case BLOCKS_BUILDING:
+		return Spe->spetag[spe] != 0;
+	case BLOCKS_ORTHOLOGY:
+		return 1;
+	case BLOCKS_CONSERVED:
+		return Spe->spetag[spe] > 1;
+	default:
+		return 0;
+	}
+}
+
+static int prints_cids(enum block_style style, int spe)
+{
+	return (style == BLOCKS_CONSERVED && Spe->spetag[spe] == 1)
+		|| (style == BLOCKS_CLEANED && Spe->spetag[spe] != 0);
+}
+
+static void print_seg(FILE *fp, enum block_style style, int spe, const struct seg_list *sg)
+{
+	struct text_buf t;
+	int j;
+
+	// "%s.%s:%d-%d %c" and the rest, formatted without printf
+	text_begin(&t, fp);
+	text_str(&t, Spe->spename[spe]);
+	text_char(&t, '.');
+	text_str(&t, sg->chr);
+	text_char(&t, ':');
+	text_int(&t, sg->beg);
+	text_char(&t, '-');
+	text_int(&t, sg->end);
+	text_char(&t, ' ');
+	text_char(&t, sg->orient);
+	if (style != BLOCKS_BUILDING && style != BLOCKS_PLAIN) {
+		text_mem(&t, " [", 2);
+		text_int(&t, sg->state);
+		text_char(&t, ']');
+	}
+	if (style == BLOCKS_CLEANED) {
+		text_mem(&t, " [", 2);
+		text_int(&t, sg->id);
+		text_char(&t, '.');
+		text_int(&t, sg->subid);
+		text_char(&t, ']');
+	}
+	if (prints_cids(style, spe)) {
+		text_mem(&t, " {", 2);
+		text_int(&t, sg->chnum);
+		for (j = 0; j < sg->chnum; j++) {
+			text_char(&t, ',');
+			text_int(&t, sg->cidlist[j]);
+		}
+		text_char(&t, '}');
+	}
+	if (prints_chid(style, spe)) {
+		text_mem(&t, " (", 2);
+		text_int(&t, sg->chid);
+		text_char(&t, ')');
+	}
+	text_char(&t, '\n');
+	text_flush(&t);
+}
+
+// a text reader leaves the fields that were not printed clear
+static void clear_unprinted(enum block_style style, int spe, struct seg_list *sg)
+{
+	if (!prints_chid(style, spe))
+		sg->chid = 0;
+	if (!prints_cids(style, spe)) {
+		free(sg->cidlist);
+		sg->cidlist = NULL;
+		sg->chnum = 0;
+	}
+}
+
+void reread_block_list(struct block_list *head, enum block_style style)
+{
+	struct block_list *b;
+	struct seg_list *sg;
+	int i;
+
+	for (b = head; b != NULL; b = b->next)
+		for (i = 0; i < Spe->spesz; i++)
+			for (sg = b->speseg[i]; sg != NULL; sg = sg->next)
+				clear_unprinted(style, i, sg);
+	assign_states(head);
+	assign_orders(head);
+}
+
+/* writing ------------------------------------------------------------- */
+
+struct block_writer *open_block_writer(FILE *fp, enum block_style style, int binary)
+{
+	struct block_writer *w = ckallocz(sizeof(struct block_writer));
+	int i;
+
+	w->fp = fp;
+	w->style = style;
+	w->binary = binary;
+	if (fp == NULL) {
+		w->binary = 0;
+		w->tail = ckalloc(Spe->spesz * sizeof(struct seg_list *));
+		return w;
+	}
+	memcpy(w->h.magic, Magic, sizeof(Magic));
+	w->h.style = style;
+	if (binary) {
+		w->h.nspe = Spe->spesz;
+		for (i = 0; i < Spe->spesz; i++)
+			add_name(w, Spe->spename[i]);
+	}
+	return w;
+}
+
+void write_block(struct block_writer *w, int id)
+{
+	struct block_list *nb;
+
+	if (w->fp == NULL) {
+		nb = allocate_newblock();
+		nb->id = id;
+		if (w->head == NULL)
+			w->head = nb;
+		else
+			w->last->next = nb;
+		w->last = nb;
+		w->open = 1;
+		return;
+	}
+	if (!w->binary) {
+		if (w->open)
+			fprintf(w->fp, "\n");
+		if (w->style == BLOCKS_BUILDING)
+			fprintf(w->fp, ">\n");
+		else
+			fprintf(w->fp, ">%d\n", id);
+		w->open = 1;
+		return;
+	}
+	GROW(w->blk, w->h.nblock, w->maxblk, 1);
+	w->blk[w->h.nblock].id = id;
+	w->blk[w->h.nblock].seg = w->h.nseg;
+	w->blk[w->h.nblock].nseg = 0;
+	w->h.nblock++;
+	w->open = 1;
+}
+
+void write_seg(struct block_writer *w, int spe, const struct seg_list *sg)
+{
+	struct bf_seg *s;
+	struct seg_list *p;
+	int c;
+
+	if (!w->open)
+		fatal("write_seg: no block started");
+	if (w->fp == NULL) {
+		p = MEM_AS(seg_list, (struct seg_list *)ckalloc(sizeof(struct seg_list)));
+		*p = *sg;
+		p->next = NULL;
+		p->cidlist = NULL;
+		if (prints_cids(w->style, spe) && sg->chnum > 0) {
+			p->cidlist = (int *)ckalloc(sizeof(int) * sg->chnum);
+			memcpy(p->cidlist, sg->cidlist, sizeof(int) * sg->chnum);
+		}
+		else
+			p->chnum = 0;
+		clear_unprinted(w->style, spe, p);
+		if (w->last->speseg[spe] == NULL)
+			w->last->speseg[spe] = p;
+		else
+			w->tail[spe]->next = p;
+		w->tail[spe] = p;
+		return;
+	}
+	if (!w->binary) {
+		print_seg(w->fp, w->style, spe, sg);
+		return;
+	}
+	w->chrname = grow_chr_table(w->chrname, &w->nchrname, sizeof(int));
+	if (w->chrname[c = chr_id(sg->chr)] == 0)
+		w->chrname[c] = add_name(w, sg->chr) + 1;
+	GROW(w->seg, w->h.nseg, w->maxseg, 1);
+	s = &w->seg[w->h.nseg++];
+	s->beg = sg->beg;
+	s->end = sg->end;
+	s->id = sg->id;
+	s->subid = sg->subid;
+	s->chid = prints_chid(w->style, spe) ? sg->chid : 0;
+	s->chnum = prints_cids(w->style, spe) ? sg->chnum : 0;
+	s->cid = w->h.ncid;
+	s->chr = w->chrname[c] - 1;
+	s->spe = spe;
+	s->orient = sg->orient;
+	s->state = sg->state;
+	if (s->chnum > 0) {
+		GROW(w->cid, w->h.ncid, w->maxcid, (uint32_t)s->chnum);
+		memcpy(w->cid + w->h.ncid, sg->cidlist, s->chnum * sizeof(int32_t));
+		w->h.ncid += s->chnum;
+	}
+	w->blk[w->h.nblock-1].nseg++;
+}
+
+static void put(struct block_writer *w, const void *p, size_t size, size_t n)
+{
+	if (n > 0 && fwrite(p, size, n, w->fp) != n)
+		fatal("cannot write the block list");
+}
+
+struct block_list *close_block_writer(struct block_writer *w)
+{
+	struct block_list *head = w->head;
+
+	if (w->fp == NULL) {
+		// the segments were cleared as they came
+		assign_states(head);
+		assign_orders(head);
+		free(w->tail);
+		free(w);
+		return head;
+	}
+	if (!w->binary) {
+		if (w->open)
+			fprintf(w->fp, "\n");
+	}
+	else {
+		// the names end on a 4-byte boundary, like the other tables
+		GROW(w->names, w->h.namelen, w->maxnamelen, 4);
+		while (w->h.namelen % 4)
+			w->names[w->h.namelen++] = '\0';
+		put(w, &w->h, sizeof(w->h), 1);
+		put(w, w->blk, sizeof(struct bf_block), w->h.nblock);
+		put(w, w->seg, sizeof(struct bf_seg), w->h.nseg);
+		put(w, w->cid, sizeof(int32_t), w->h.ncid);
+		put(w, w->nameoff, sizeof(uint32_t), w->h.nname);
+		put(w, w->names, 1, w->h.namelen);
+	}
+	if (fflush(w->fp) != 0)
+		fatal("cannot write the block list");
+	free(w->blk);
+	free(w->seg);
+	free(w->cid);
+	free(w->nameoff);
+	free(w->names);
+	free(w->chrname);
+	free(w);
+	return NULL;
+}
+
+/* the text of a list is formatted FORMAT_CHUNK blocks to a job, a round
+ * of jobs at a time on the threads, and the jobs' buffers are written in
+ * order; a block prints the same whichever thread formats it */
+#define FORMAT_CHUNK	4096
+#define FORMAT_ROUND	64
+
+struct format_round {
+	struct spe_config *spe;
+	enum block_style style;
+	int rs, n;
+	struct block_list **blk;
+	struct job_output *out;
+};
+
+static void print_block(FILE *fp, const struct block_list *b, enum block_style style, int rs)
+{
+	struct seg_list *sg;
+	int i;
+
+	if (style == BLOCKS_BUILDING)
+		fprintf(fp, ">\n");
+	else
+		fprintf(fp, ">%d\n", b->id);
+	if (style == BLOCKS_BUILDING)
+		for (sg = b->speseg[rs]; sg != NULL; sg = sg->next)
+			print_seg(fp, style, rs, sg);
+	for (i = 0; i < Spe->spesz; i++) {
+		if (style == BLOCKS_BUILDING && i == rs)
+			continue;
+		for (sg = b->speseg[i]; sg != NULL; sg = sg->next)
+			print_seg(fp, style, i, sg);
+	}
+	fprintf(fp, "\n");
+}
+
+static void format_chunk(int k, void *arg)
+{
+	struct format_round *r = arg;
+	FILE *fp = job_stream(r->out, k);
+	int i;
+
+	Spe = r->spe;
+	for (i = k * FORMAT_CHUNK; i < r->n && i < (k + 1) * FORMAT_CHUNK; i++)
+		print_block(fp, r->blk[i], r->style, r->rs);
+}
+
+static void write_text_blocks(FILE *fp, struct block_list *head, enum block_style style, int nthreads)
+{
+	struct format_round r;
+	struct block_list *b = head;
+
+	r.spe = Spe;
+	r.style = style;
+	r.rs = ref_spe_idx();
+	r.blk = ckalloc(FORMAT_CHUNK * FORMAT_ROUND * sizeof(struct block_list *));
+	while (b != NULL) {
+		for (r.n = 0; b != NULL && r.n < FORMAT_CHUNK * FORMAT_ROUND; b = b->next)
+			r.blk[r.n++] = b;
+		r.out = open_job_output((r.n + FORMAT_CHUNK - 1) / FORMAT_CHUNK);
+		run_jobs((r.n + FORMAT_CHUNK - 1) / FORMAT_CHUNK, nthreads, format_chunk, &r);
+		// each buffer goes out in one write, past the buffer of fp
+		if (close_job_output(r.out, fp) != 0)
+			fatal("cannot write the block list");
+	}
+	if (fflush(fp) != 0)
+		fatal("cannot write the block list");
+	free(r.blk);
+}
+
+void write_block_list(FILE *fp, struct block_list *head, enum block_style style, int binary)
+{
+	int nthreads = (Block_threads > 0) ? Block_threads : default_threads();
+	struct block_writer *w;
+	struct block_list *b;
+	struct seg_list *sg;
+	int i, rs = ref_spe_idx();
+
+	if (fp != NULL && !binary && nthreads > 1 && head != NULL && head->next != NULL) {
+		write_text_blocks(fp, head, style, nthreads);
+		return;
+	}
+	w = open_block_writer(fp, style, binary);
+	for (b = head; b != NULL; b = b->next) {
+		write_block(w, b->id);
+		if (style == BLOCKS_BUILDING)
+			for (sg = b->speseg[rs]; sg != NULL; sg = sg->next)
+				write_seg(w, rs, sg);
+		for (i = 0; i < Spe->spesz; i++) {
+			if (style == BLOCKS_BUILDING && i == rs)
+				continue;
+			for (sg = b->speseg[i]; sg != NULL; sg = sg->next)
+				write_seg(w, i, sg);
+		}
+	}
+	close_block_writer(w);
+}
+
+/* reading ------------------------------------------------------------- */
+
+int is_block_file(const char *fname)
+{
+	char magic[sizeof(Magic)];
+	FILE *fp;
+	int yes;
+
+	if ((fp = fopen(fname, "r")) == NULL)
+		return 0;
+	yes = fread(magic, 1, sizeof(magic), fp) == sizeof(magic)
+		&& memcmp(magic, Magic, sizeof(Magic)) == 0;
+	fclose(fp);
+	return yes;
+}
+
+struct block_list *read_block_file(const char *fname, enum block_style *style)
+{
+	const struct blockfile_header *h;
+	const struct bf_block *blk;
+	const struct bf_seg *seg;
+	const int32_t *cid;
+	const uint32_t *nameoff;
+	const char *names, **name;
+	struct block_list *head = NULL, *last = NULL, *nb;
+	struct seg_list *p, **tail;
+	struct stat st;
+	uint64_t need;
+	uint32_t i, k;
+	char *image;
+	int fd, *spe;
+
+	if ((fd = open(fname, O_RDONLY)) < 0 || fstat(fd, &st) != 0)
+		fatalf("Cannot open %s.", fname);
+	if ((size_t)st.st_size < sizeof(struct blockfile_header))
+		fatalf("%s: not a block list", fname);
+	image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED)
+		fatalf("cannot map %s", fname);
+
+	h = (const struct blockfile_header *)image;
+	if (memcmp(h->magic, Magic, sizeof(Magic)) != 0)
+		fatalf("%s: not a block list, or written by another version", fname);
+	need = sizeof(*h) + (uint64_t)h->nblock * sizeof(struct bf_block)
+		+ (uint64_t)h->nseg * sizeof(struct bf_seg) + (uint64_t)h->ncid * sizeof(int32_t)
+		+ (uint64_t)h->nname * sizeof(uint32_t) + h->namelen;
+	if (need != (uint64_t)st.st_size || h->nspe > h->nname || h->namelen == 0
+		|| image[st.st_size-1] != '\0')
+		fatalf("%s: truncated or damaged block list", fname);
+	blk = (const struct bf_block *)(h + 1);
+	seg = (const struct bf_seg *)(blk + h->nblock);
+	cid = (const int32_t *)(seg + h->nseg);
+	nameoff = (const uint32_t *)(cid + h->ncid);
+	names = (const char *)(nameoff + h->nname);
+	if (style != NULL)
+		*style = h->style;
+
+	// chromosome names are interned as for a text list; species are
+	// matched to the config file by name
+	name = ckalloc((h->nname + 1) * sizeof(char *));
+	for (i = 0; i < h->nname; i++) {
+		if (nameoff[i] >= h->namelen)
+			fatalf("%s: damaged block list", fname);
+		name[i] = (i < h->nspe) ? names + nameoff[i] : intern_chr(names + nameoff[i]);
+	}
+	spe = ckalloc((h->nspe + 1) * sizeof(int));
+	for (i = 0; i < h->nspe; i++)
+		spe[i] = spe_idx(name[i]);
+	tail = ckalloc(Spe->spesz * sizeof(struct seg_list *));
+
+	for (i = 0; i < h->nblock; i++) {
+		nb = allocate_newblock();
+		nb->id = blk[i].id;
+		if (head == NULL)
+			head = last = nb;
+		else {
+			last->next = nb;
+			last = nb;
+		}
+		if ((uint64_t)blk[i].seg + blk[i].nseg > h->nseg)
+			fatalf("%s: damaged block list", fname);
+		for (k = blk[i].seg; k < blk[i].seg + blk[i].nseg; k++) {
+			if (seg[k].spe >= h->nspe || seg[k].chr < h->nspe || seg[k].chr >= h->nname
+				|| seg[k].chnum < 0 || (uint64_t)seg[k].cid + seg[k].chnum > h->ncid)
+				fatalf("%s: damaged block list", fname);
+			p = MEM_AS(seg_list, (struct seg_list *)ckalloc(sizeof(struct seg_list)));
+			p->id = seg[k].id;
+			p->beg = seg[k].beg;
+			p->end = seg[k].end;
+			p->subid = seg[k].subid;
+			p->chid = seg[k].chid;
+			p->chnum = seg[k].chnum;
+			p->cidlist = NULL;
+			if (p->chnum > 0) {
+				p->cidlist = (int *)ckalloc(sizeof(int) * p->chnum);
+				memcpy(p->cidlist, cid + seg[k].cid, sizeof(int) * p->chnum);
+			}
+			p->chr = name[seg[k].chr];
+			p->orient = seg[k].orient;
+			p->state = seg[k].state;
+			p->next = NULL;
+			if (nb->speseg[spe[seg[k].spe]] == NULL)
+				nb->speseg[spe[seg[k].spe]] = p;
+			else
+				tail[spe[seg[k].spe]]->next = p;
+			tail[spe[seg[k].spe]] = p;
+		}
+	}
+	free(tail);
+	free(spe);
+	free(name);
+	munmap(image, st.st_size);
+	return head;
+}
+
+int binary_blocks_arg(int *argc, char *argv[])
+{
+	int i;
+
+	if (*argc < 2 || !same_string(argv[1], "-bin"))
+		return 0;
+	for (i = 1; i < *argc; i++)
+		argv[i] = argv[i+1];
+	--*argc;
+	return 1;
+}
@@ -0,0 +1,70 @@
+/* **************************************************************
+ * Block lists as passed between the makeBlocks tools. A list is
+ * written either as text, in the layout of the step that made it
+ * (Building.Blocks, orthology blocks, conserved segments), or in a
+ * binary form that get_block_list() reads back without parsing:
+ *
+ *   header (magic "DSCHBL1", the text style and the table sizes)
+ *   blocks, segments, chain ids, name offsets, names
+ *
+ * Every table entry is 4-byte aligned, so the file is read through
+ * mmap. The names are the species of the config file and then the
+ * chromosomes. dumpBlocks prints a binary list as the text of its
+ * style.
+ *
+ * A writer opened on no file builds the list in memory instead, as
+ * the next step would read it back; makeBlocks hands lists from one
+ * step to the next this way.
+ * **************************************************************/
+
+#ifndef _BLOCKFILE_H_
+#define _BLOCKFILE_H_
+
+#include "species.h"
+
+// text layouts, named after the tool that writes them
+enum block_style {
+	BLOCKS_BUILDING = 0,	// partitionGenomes
+	BLOCKS_ORTHOLOGY,		// makeOrthologyBlocks
+	BLOCKS_CONSERVED,		// makeConservedSegments
+	BLOCKS_CLEANED,			// cleanOutgroupSegs
+	BLOCKS_PLAIN			// coordinates only, as in Orthology.Blocks
+};
+
+struct block_writer;
+
+// fp NULL gives a writer to memory
+struct block_writer *open_block_writer(FILE *fp, enum block_style style, int binary);
+// starts a block; its segments follow in the order they are to be printed
+void write_block(struct block_writer *w, int id);
+void write_seg(struct block_writer *w, int spe, const struct seg_list *sg);
+// returns the list a writer to memory built, NULL for a file
+struct block_list *close_block_writer(struct block_writer *w);
+
+/* a whole list, species in index order (the reference first for
+ * BLOCKS_BUILDING). The text of a long list is formatted on
+ * Block_threads threads (default_threads() while it is 0) and comes
+ * out the same as on one */
+void write_block_list(FILE *fp, struct block_list *head, enum block_style style, int binary);
+extern int Block_threads;
+
+/* leaves a list as get_block_list() reads it back once written in the
+ * style: the fields the style does not print are cleared, and states
+ * and orders are assigned again */
+void reread_block_list(struct block_list *head, enum block_style style);
+
+// whether fname holds a binary block list
+int is_block_file(const char *fname);
+
+/* **************************************************************
+ * Reads a binary block list as written, without assign_states() or
+ * assign_orders(). Returns NULL for an empty list; style, if not
+ * NULL, gets the text style it was written for.
+ * **************************************************************/
+struct block_list *read_block_file(const char *fname, enum block_style *style);
+
+/* strips a leading "-bin" option from the arguments; returns 1 if it was
+ * given, to write the output block list in binary */
+int binary_blocks_arg(int *argc, char *argv[]);
+
+#endif
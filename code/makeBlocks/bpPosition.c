@@ -1,38 +1,56 @@
 #include "util.h"
+#include "extremity.h"
 
-#define YES	0x01
-#define NO	0x00
-#define X	(sizeof(unsigned char))
+// the predicted joins by adj_key(), open addressing; an empty slot is ~0
+static uint64_t *Joins = NULL;
+static unsigned Joinsz = 0;
+static int Joinnum = 0;
 
-static int A = 0; //first
-static int T = 0; //# of ancestral elements
-static int N = 0; //# of items in the array
-static int Z = 0; //last one
+#define NO_JOIN	(~(uint64_t)0)
 
-static int map(int i) {
-	if (i == A)
-		return A;
-	if (i == Z)
-		return Z;
-	return (i <= T) ? (i + T) : (i - T);
+static unsigned find_join(uint64_t *H, unsigned sz, uint64_t key) {
+	unsigned k;
+
+	for (k = (unsigned)((key * 0x9e3779b97f4a7c15ULL) >> 32) & (sz - 1); H[k] != NO_JOIN; k = (k + 1) & (sz - 1))
+		if (H[k] == key)
+			break;
+	return k;
 }
 
-static unsigned char Val(unsigned char *H, int i, int j) {
-	if (j < 0)
-		j = map(-j);
-	if (i < 0)
-		i = map(-i);
-	return *(H + (X * (i * N + j)));
+static void grow_joins(void) {
+	uint64_t *old = Joins;
+	unsigned k, oldsz = Joinsz;
+
+	Joinsz = oldsz ? 2 * oldsz : 1024;
+	Joins = ckalloc(Joinsz * sizeof(uint64_t));
+	memset(Joins, 0xff, Joinsz * sizeof(uint64_t));
+	for (k = 0; k < oldsz; k++)
+		if (old[k] != NO_JOIN)
+			Joins[find_join(Joins, Joinsz, old[k])] = old[k];
+	free(old);
 }
 
-static void Set(unsigned char *H, int i, int j, unsigned char value) {
-	unsigned char *g;
-	if (i < 0)
-		i = map(-i);
-	if (j < 0)
-		j = map(-j);
-	g = (H + (X * (i * N + j)));
-	*g = value;
+static int Val(int i, int j) {
+	return Joins[find_join(Joins, Joinsz, adj_key(i, j))] != NO_JOIN;
+}
+
+// the join i j, 0 a chromosome end, in both readings
+static void Set(int i, int j) {
+	uint64_t key[2];
+	unsigned k;
+	int r;
+
+	key[0] = adj_key(i, j);
+	key[1] = adj_key(-j, -i);
+	for (r = 0; r < 2; r++) {
+		if (2 * ((unsigned)Joinnum + 1) > Joinsz)
+			grow_joins();
+		k = find_join(Joins, Joinsz, key[r]);
+		if (Joins[k] == NO_JOIN) {
+			Joins[k] = key[r];
+			Joinnum++;
+		}
+	}
 }
 
 int main(int argc, char *argv[]) {
@@ -41,7 +59,6 @@ int main(int argc, char *argv[]) {
 	int total;
 	int i, j;
 	int rightjoin;
-	unsigned char *R;
 	if (argc !=3 && argc != 4)
 		fatal("args: real_genome_joins_info predicted_genome_joins_info");
 	predictedgenome = ckopen(argv[2], "r");
@@ -49,26 +66,11 @@ int main(int argc, char *argv[]) {
 		fatalf("%s bad file", argv[1]);
 	if (sscanf(buf, "#%d", &total) != 1)
 		fatalf("bad file: %s", buf);
-	T = total;
-	Z = 2 * T + 1;
-	A = 0;
-	N = Z + 2;
-	R = (unsigned char *)ckalloc(N*N*X);
-	for (i = A; i < N; i++) {
-		for (j = A; j < N; j++)
-			Set(R, i, j, NO);
-	}
+	grow_joins();
 	while(fgets(buf, 500, predictedgenome)) {
 		if (sscanf(buf, "%d %d", &i, &j) != 2)
 			fatalf("bad %s", buf);
-		if (j == 0)
-			Set(R, i, Z, YES);
-		else
-			Set(R, i, j, YES);
-		if (i == 0)
-			Set(R, -j, Z, YES);
-		else
-			Set(R, -j, -i, YES);
+		Set(i, j);
 	}
 	fclose(predictedgenome);
 	
@@ -78,17 +80,11 @@ int main(int argc, char *argv[]) {
 			continue;
 		if (sscanf(buf, "%d %d", &i, &j) != 2)
 			fatalf("bad %s", buf);
-		if (j == 0) j = Z;
-		if (Val(R, i, j) || Val(R, -j, -i))
-			rightjoin = 1;
-		else 
-			rightjoin = 0;
-		if (j == Z)
-			j = 0;
+		rightjoin = Val(i, j);
 		if (rightjoin == 0)
 			printf("%d %d\n", i, j);
 	}
 	fclose(realgenome);
-	free(R);
+	free(Joins);
 	return 0;
 }
@@ -0,0 +1,713 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "species.h"
+#include "chromfile.h"
+#include "chainstore.h"
+#include "bigchain.h"
+#include "lines.h"
+#include "remote.h"
+#include "trace.h"
+#include "workpool.h"
+
+#define STORE_NAME	"chain.store"
+// a mapped chain file larger than this is parsed in pieces of about this size
+#define CHAIN_PIECE	(32 << 20)
+
+static const char Magic[8] = "DSCHST3";
+
+/* the file is the header followed by the chains, the gap-free blocks,
+ * the hash buckets and the chromosome names */
+struct store_header {
+	char magic[8];
+	uint32_t nchrom, nchain, ngf, nbucket, namelen;
+};
+
+struct chain_store {
+	char *image;
+	size_t size;
+	bool mapped;
+	const struct store_header *h;
+	const struct chain_rec *chain;
+	const struct chain_gf *gf;
+	const uint32_t *bucket;		// chain index + 1; 0 is empty
+	const char *names;
+	struct chrom_range *range;	// of a mapped store, by name
+	uint32_t nrange;
+	struct big_chains *big;		// all.bigChain and all.bigLink instead
+};
+
+// the chains of a chromosome, which the store keeps together
+struct chrom_range {
+	const char *chrom;
+	uint32_t lo, hi;
+};
+
+struct store_builder {
+	struct chain_rec *chain;
+	struct chain_gf *gf;
+	char *names;
+	uint32_t nchain, ngf, namelen, maxchain, maxgf, maxname;
+	uint32_t *sname;	// the other species' names, hashed: offset + 1; 0 is empty
+	uint32_t nsname, maxsname;
+};
+
+static uint32_t chain_hash(const char *chrom, int cid)
+{
+	uint32_t h = 2166136261u;
+
+	while (*chrom) {
+		h ^= (unsigned char)*chrom++;
+		h *= 16777619u;
+	}
+	return h ^ ((uint32_t)cid * 2654435761u);
+}
+
+static size_t image_size(const struct store_header *h)
+{
+	return sizeof(struct store_header) + (size_t)h->nchain * sizeof(struct chain_rec)
+		+ (size_t)h->ngf * sizeof(struct chain_gf) + (size_t)h->nbucket * sizeof(uint32_t)
+		+ h->namelen;
+}
+
+static void set_layout(struct chain_store *cs)
+{
+	cs->h = (const struct store_header *)cs->image;
+	cs->chain = (const struct chain_rec *)(cs->h + 1);
+	cs->gf = (const struct chain_gf *)(cs->chain + cs->h->nchain);
+	cs->bucket = (const uint32_t *)(cs->gf + cs->h->ngf);
+	cs->names = (const char *)(cs->bucket + cs->h->nbucket);
+}
+
+/* add_name_text ------------------ append a name to the names of a store */
+static uint32_t add_name_text(struct store_builder *b, const char *name, size_t len)
+{
+	uint32_t off = b->namelen;
+
+	if (b->namelen + len + 1 > b->maxname) {
+		b->maxname = MAX(2 * b->maxname, b->namelen + len + 4096);
+		b->names = ckrealloc(b->names, b->maxname);
+	}
+	memcpy(b->names + off, name, len);
+	b->names[off + len] = '\0';
+	b->namelen += len + 1;
+	return off;
+}
+
+static uint32_t name_hash(const char *name, size_t len)
+{
+	uint32_t h = 2166136261u;
+
+	while (len-- > 0) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* add_sname -------- the offset of a chromosome of the other species, kept once */
+static uint32_t add_sname(struct store_builder *b, const char *name, size_t len)
+{
+	uint32_t k, i, mask, *old = b->sname, nold = b->maxsname;
+	const char *s;
+
+	if (2 * (b->nsname + 1) > b->maxsname) {
+		b->maxsname = nold ? 2 * nold : 1024;
+		b->sname = ckallocz(b->maxsname * sizeof(uint32_t));
+		mask = b->maxsname - 1;
+		for (i = 0; i < nold; i++)
+			if (old[i] != 0) {
+				s = b->names + old[i] - 1;
+				for (k = name_hash(s, strlen(s)) & mask; b->sname[k] != 0; k = (k + 1) & mask)
+					;
+				b->sname[k] = old[i];
+			}
+		free(old);
+	}
+	mask = b->maxsname - 1;
+	for (k = name_hash(name, len) & mask; b->sname[k] != 0; k = (k + 1) & mask) {
+		s = b->names + b->sname[k] - 1;
+		if (strncmp(s, name, len) == 0 && s[len] == '\0')
+			return b->sname[k] - 1;
+	}
+	b->sname[k] = add_name_text(b, name, len) + 1;
+	b->nsname++;
+	return b->sname[k] - 1;
+}
+
+/* parse_chain_lines ------------------ add the chains of the lines of a reader */
+/* a chain line is
+ *   chain score tName tSize tStrand tStart tEnd qName qSize qStrand qStart qEnd id
+ * and the gap-free blocks after it "size dt dq", the last one "size" */
+static void parse_chain_lines(struct store_builder *b, struct line_reader *lr,
+	const char *chainfile, uint32_t chrom)
+{
+	struct chain_rec *cp;
+	struct chain_gf *gp;
+	struct field f[13];
+	const char *line;
+	size_t len;
+	int cur = -1, nf;
+
+	while ((line = next_line(lr, &len)) != NULL) {
+		if (len == 0 || line[0] == '#')
+			continue;
+		nf = split_line(line, len, f, 13);
+		if (line[0] == 'c') {
+			if (b->nchain == b->maxchain) {
+				b->maxchain = b->maxchain ? 2 * b->maxchain : 4096;
+				b->chain = MEM_AS(chains, ckrealloc(b->chain, b->maxchain * sizeof(struct chain_rec)));
+			}
+			cp = &b->chain[cur = b->nchain++];
+			memset(cp, 0, sizeof(struct chain_rec));
+			if (nf != 13 || !field_is(&f[0], "chain")
+				|| !field_int(&f[5], &cp->fbeg) || !field_int(&f[6], &cp->fend)
+				|| !field_int(&f[8], &cp->slen) || !field_int(&f[10], &cp->sbeg)
+				|| !field_int(&f[11], &cp->send) || !field_int(&f[12], &cp->cid))
+				fatalf("cannot parse: %.*s", (int)len, line);
+			cp->forient = f[4].s[0];
+			cp->sorient = f[9].s[0];
+			cp->chrom = chrom;
+			cp->schrom = add_sname(b, f[7].s, f[7].len);
+			cp->gf = b->ngf;
+		}
+		else {
+			if (cur < 0)
+				fatalf("%s: alignment data before the first chain", chainfile);
+			if (b->ngf == b->maxgf) {
+				b->maxgf = b->maxgf ? 2 * b->maxgf : 65536;
+				b->gf = MEM_AS(chains, ckrealloc(b->gf, b->maxgf * sizeof(struct chain_gf)));
+			}
+			gp = &b->gf[b->ngf];
+			if (nf == 0 || !field_int(&f[0], &gp->size))
+				fatalf("cannot parse: %.*s", (int)len, line);
+			if (nf < 3 || !field_int(&f[1], &gp->fgap) || !field_int(&f[2], &gp->sgap))
+				gp->fgap = gp->sgap = 0;
+			if (b->chain[cur].ngf == 0)
+				gp->roff = gp->soff = 0;
+			else {
+				gp->roff = gp[-1].roff + gp[-1].size + gp[-1].fgap;
+				gp->soff = gp[-1].soff + gp[-1].size + gp[-1].sgap;
+			}
+			b->ngf++;
+			b->chain[cur].ngf++;
+		}
+	}
+}
+
+/* merge_builder --------- append the chains of a piece after those of b */
+/* by the same add_sname() calls in the same order, b ends as if it had
+ * parsed the piece's lines itself */
+static void merge_builder(struct store_builder *b, struct store_builder *p)
+{
+	struct chain_rec *cp;
+	uint32_t i;
+
+	if (b->nchain + p->nchain > b->maxchain) {
+		b->maxchain = MAX(2 * b->maxchain, b->nchain + p->nchain);
+		b->chain = MEM_AS(chains, ckrealloc(b->chain, b->maxchain * sizeof(struct chain_rec)));
+	}
+	if (b->ngf + p->ngf > b->maxgf) {
+		b->maxgf = MAX(2 * b->maxgf, b->ngf + p->ngf);
+		b->gf = MEM_AS(chains, ckrealloc(b->gf, b->maxgf * sizeof(struct chain_gf)));
+	}
+	for (i = 0; i < p->nchain; i++) {
+		cp = &b->chain[b->nchain++];
+		*cp = p->chain[i];
+		cp->gf += b->ngf;
+		cp->schrom = add_sname(b, p->names + cp->schrom, strlen(p->names + cp->schrom));
+	}
+	memcpy(b->gf + b->ngf, p->gf, (size_t)p->ngf * sizeof(struct chain_gf));
+	b->ngf += p->ngf;
+	free(p->chain);
+	free(p->gf);
+	free(p->names);
+	free(p->sname);
+}
+
+// the pieces of a chain file parsed on the threads, each into its own builder
+struct chain_pieces {
+	struct store_builder *b;
+	const char *text, *name;
+	size_t *cut;
+	uint32_t chrom;
+};
+
+static void chain_piece_job(int k, void *arg)
+{
+	struct chain_pieces *cp = arg;
+	struct line_reader *lr = open_text_lines(cp->text + cp->cut[k], cp->cut[k+1] - cp->cut[k], cp->name);
+
+	parse_chain_lines(&cp->b[k], lr, cp->name, cp->chrom);
+	close_lines(lr);
+}
+
+/* parse_chains ------------------------ add the chains of one chromosome */
+/* a large file that is mapped is cut at chain lines and its pieces parsed
+ * on the threads, then appended in the order of the file */
+static void parse_chains(struct store_builder *b, FILE *fp, const char *chainfile, uint32_t chrom)
+{
+	struct line_reader *lr = open_lines(fp, chainfile), *piece;
+	struct chain_pieces cp;
+	const char *text;
+	size_t len, *cut = NULL;
+	int np, k;
+
+	if ((text = take_mapped_lines(lr, &len)) != NULL
+		&& (np = cut_lines(text, len, "chain", CHAIN_PIECE, &cut)) > 1) {
+		fprintf(stderr, "- %s in %d pieces\n", chainfile, np);
+		cp.b = ckallocz(np * sizeof(struct store_builder));
+		cp.text = text;
+		cp.name = chainfile;
+		cp.cut = cut;
+		cp.chrom = chrom;
+		run_jobs(np, MIN(np, default_threads()), chain_piece_job, &cp);
+		for (k = 0; k < np; k++)
+			merge_builder(b, &cp.b[k]);
+		free(cp.b);
+	} else if (text != NULL) {
+		piece = open_text_lines(text, len, chainfile);
+		parse_chain_lines(b, piece, chainfile, chrom);
+		close_lines(piece);
+	} else
+		parse_chain_lines(b, lr, chainfile, chrom);
+	free(cut);
+	close_lines(lr);
+}
+
+static int cmp_name(const void *a, const void *b)
+{
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+static void add_name(const char ***names, int *n, int *max, const char *chrom)
+{
+	if (*n == *max) {
+		*max = *max ? 2 * *max : 1024;
+		*names = ckrealloc(*names, *max * sizeof(char *));
+	}
+	(*names)[(*n)++] = chrom;
+}
+
+/* list_chroms ------------ reference chromosomes with chains in a directory */
+/* (split <chr>.chain files and the chromosomes of all.chain); newest is the
+ * latest modification time among the chain files. A URL cannot be listed,
+ * so only its all.chain counts */
+static int list_chroms(const char *dir, const char ***names, time_t *newest)
+{
+	char path[1000], chrom[1000];
+	const struct manifest_dir *md = NULL;
+	const char **all, *file;
+	struct dirent *ent;
+	struct stat st;
+	size_t len;
+	time_t t;
+	int n = 0, max = 0, nall, nsplit, i, k = 0;
+	DIR *dp = NULL;
+
+	*names = NULL;
+	*newest = 0;
+	if (is_url(dir)) {
+		snprintf(path, sizeof(path), "%s/all.chain", dir);
+		if (!url_stat(path, NULL, newest))
+			url_stat(strcat(path, ".gz"), NULL, newest);
+	} else if ((md = manifest_dir(dir)) == NULL && (dp = opendir(dir)) == NULL)
+		fatalf("Cannot open chain directory %s.", dir);
+	// the files of a listed directory, with their times, are the listing's
+	while (md != NULL ? k < md->nfile : dp && (ent = readdir(dp)) != NULL) {
+		file = md != NULL ? md->file[k++].name : ent->d_name;
+		len = strlen(file);
+		if (len > 6 && same_string(file + len - 6, ".chain"))
+			len -= 6;
+		else if (len > 9 && same_string(file + len - 9, ".chain.gz"))
+			len -= 9;
+		else
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, file);
+		if (md != NULL)
+			t = md->file[k-1].mtime;
+		else
+			t = stat(path, &st) == 0 ? st.st_mtime : 0;
+		if (t > *newest)
+			*newest = t;
+		if (len == 3 && starts(file, "all"))
+			continue;
+		if (len >= sizeof(chrom))
+			fatalf("chromosome name too long: %s", path);
+		memcpy(chrom, file, len);
+		chrom[len] = '\0';
+		add_name(names, &n, &max, intern_chr(chrom));
+	}
+	if (dp)
+		closedir(dp);
+
+	// a split file wins over all.chain, as in open_chrom()
+	if (n > 0)
+		qsort(*names, n, sizeof(char *), cmp_name);
+	nsplit = n;
+	if ((nall = chrom_names(dir, ".chain", &all)) >= 0) {
+		for (i = 0; i < nall; i++)
+			if (nsplit == 0 || bsearch(&all[i], *names, nsplit, sizeof(char *), cmp_name) == NULL)
+				add_name(names, &n, &max, all[i]);
+		free(all);
+	}
+	return n;
+}
+
+/* build_store ------------------- parse every chain file and hash the chains */
+static void build_store(struct chain_store *cs, const char *dir, const char **names, int n)
+{
+	struct store_builder b;
+	struct store_header h;
+	struct file_batch *batch;
+	const char **dirs;
+	char chainfile[500];
+	uint32_t i, k, mask, chrom;
+	uint32_t *bucket;
+	FILE *fp;
+	char *p;
+	int c;
+
+	memset(&b, 0, sizeof(b));
+	// a split chain file of every chromosome read ahead
+	dirs = ckalloc((n + 1) * sizeof(char *));
+	for (c = 0; c < n; c++)
+		dirs[c] = dir;
+	batch = batch_chroms(dirs, names, n, ".chain", 1);
+	for (c = 0; c < n; c++) {
+		if ((fp = open_chrom(dir, names[c], ".chain", chainfile)) == NULL)
+			fatalf("Cannot open %s.", chainfile);
+		chrom = add_name_text(&b, names[c], strlen(names[c]));
+		parse_chains(&b, fp, chainfile, chrom);
+		ckclose_in(fp);
+	}
+	close_file_batch(batch);
+	free(dirs);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, Magic, sizeof(Magic));
+	h.nchrom = n;
+	h.nchain = b.nchain;
+	h.ngf = b.ngf;
+	for (h.nbucket = 1024; h.nbucket < 2 * b.nchain; )
+		h.nbucket *= 2;
+	h.namelen = b.namelen;
+
+	// chains keep their file order, so the first chain with an id wins
+	bucket = ckallocz(h.nbucket * sizeof(uint32_t));
+	mask = h.nbucket - 1;
+	for (i = 0; i < b.nchain; i++) {
+		for (k = chain_hash(b.names + b.chain[i].chrom, b.chain[i].cid) & mask;
+				bucket[k] != 0; k = (k + 1) & mask)
+			if (b.chain[bucket[k]-1].cid == b.chain[i].cid
+				&& b.chain[bucket[k]-1].chrom == b.chain[i].chrom)
+				break;
+		if (bucket[k] == 0)
+			bucket[k] = i + 1;
+	}
+
+	cs->size = image_size(&h);
+	cs->image = p = MEM_AS(chains, ckalloc(cs->size));
+	cs->mapped = 0;
+	memcpy(p, &h, sizeof(h));
+	p += sizeof(h);
+	memcpy(p, b.chain, (size_t)b.nchain * sizeof(struct chain_rec));
+	p += (size_t)b.nchain * sizeof(struct chain_rec);
+	memcpy(p, b.gf, (size_t)b.ngf * sizeof(struct chain_gf));
+	p += (size_t)b.ngf * sizeof(struct chain_gf);
+	memcpy(p, bucket, (size_t)h.nbucket * sizeof(uint32_t));
+	p += (size_t)h.nbucket * sizeof(uint32_t);
+	memcpy(p, b.names, b.namelen);
+	set_layout(cs);
+
+	free(b.chain);
+	free(b.gf);
+	free(b.names);
+	free(b.sname);
+	free(bucket);
+}
+
+/* map_store --------------- map a saved store; 0 if it is stale or unusable */
+static bool map_store(struct chain_store *cs, const char *storefile, int nchrom)
+{
+	struct store_header h;
+	struct stat st;
+	void *p;
+	int fd;
+
+	if ((fd = open(storefile, O_RDONLY)) < 0)
+		return 0;
+	if (fstat(fd, &st) != 0 || read(fd, &h, sizeof(h)) != (ssize_t)sizeof(h)
+		|| memcmp(h.magic, Magic, sizeof(Magic)) != 0 || h.nchrom != (uint32_t)nchrom
+		|| (size_t)st.st_size != image_size(&h)) {
+		close(fd);
+		return 0;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return 0;
+	cs->image = p;
+	cs->size = st.st_size;
+	cs->mapped = 1;
+	set_layout(cs);
+	return 1;
+}
+
+static void save_store(const struct chain_store *cs, const char *storefile)
+{
+	char tmpfile[1100];
+	FILE *fp;
+
+	snprintf(tmpfile, sizeof(tmpfile), "%s.%d", storefile, (int)getpid());
+	if ((fp = fopen(tmpfile, "w")) == NULL) {
+		fprintf(stderr, "- cannot write %s; the chains are kept in memory"
+			" (DESCHRAMBLER_CHAINSTORE names a directory for the stores)\n", storefile);
+		return;
+	}
+	if (fwrite(cs->image, 1, cs->size, fp) != cs->size || fclose(fp) != 0
+		|| rename(tmpfile, storefile) != 0) {
+		fprintf(stderr, "- cannot write %s; the chains are kept in memory\n", storefile);
+		unlink(tmpfile);
+	}
+}
+
+/* store_file --------------------- where the store of a chain directory is kept */
+static void store_file(const char *chaindir, char *path, size_t size)
+{
+	char *env = getenv("DESCHRAMBLER_CHAINSTORE"), real[PATH_MAX];
+	const char *dir, *s;
+	uint64_t h = 14695981039346656037ULL;
+
+	if (env && *env) {
+		// one directory for the stores of every run, /dev/shm/... to keep
+		// them in memory; named by the chain directory wherever it is given from
+		if (mkdir(env, 0777) != 0 && errno != EEXIST)
+			fatalf("Cannot create %s: %s", env, strerror(errno));
+		dir = (!is_url(chaindir) && realpath(chaindir, real) != NULL) ? real : chaindir;
+		for (s = dir; *s; s++)
+			h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+		snprintf(path, size, "%s/%016llx.%s", env, (unsigned long long)h, STORE_NAME);
+	} else if (is_url(chaindir))
+		url_cache_file(chaindir, STORE_NAME, path, size);
+	else
+		snprintf(path, size, "%s/%s", chaindir, STORE_NAME);
+}
+
+static int cmp_range(const void *a, const void *b)
+{
+	return strcmp(((const struct chrom_range *)a)->chrom, ((const struct chrom_range *)b)->chrom);
+}
+
+/* index_ranges ------------ where the chains of each chromosome of a store are */
+static void index_ranges(struct chain_store *cs)
+{
+	uint32_t i, n = 0;
+
+	cs->range = ckalloc((cs->h->nchrom + 1) * sizeof(struct chrom_range));
+	for (i = 0; i < cs->h->nchain; i++) {
+		if (n == 0 || cs->range[n-1].chrom != cs->names + cs->chain[i].chrom) {
+			if (n == cs->h->nchrom)
+				fatal("chain store: the chains of a chromosome are not together");
+			cs->range[n].chrom = cs->names + cs->chain[i].chrom;
+			cs->range[n++].lo = i;
+		}
+		cs->range[n-1].hi = i + 1;
+	}
+	qsort(cs->range, n, sizeof(struct chrom_range), cmp_range);
+	cs->nrange = n;
+}
+
+/* open_chain_store ---------------- map the chain store of a chain directory */
+struct chain_store *open_chain_store(const char *chaindir)
+{
+	char storefile[1000], lockfile[1100];
+	const char **names;
+	struct chain_store *cs = ckallocz(sizeof(struct chain_store));
+	struct stat st;
+	time_t newest;
+	int n, lock;
+
+	if ((n = list_chroms(chaindir, &names, &newest)) == 0) {
+		// nothing is built for a bigChain, which has an index of its own
+		if ((cs->big = open_big_chains(chaindir)) == NULL)
+			fatalf("no chain files in %s", chaindir);
+		return cs;
+	}
+	store_file(chaindir, storefile, sizeof(storefile));
+	// runs started together on a store wait for the one building it, and
+	// then map what it saved rather than parse the chains each
+	snprintf(lockfile, sizeof(lockfile), "%s.lock", storefile);
+	if ((lock = open(lockfile, O_RDWR | O_CREAT, 0666)) >= 0 && flock(lock, LOCK_EX) != 0) {
+		close(lock);
+		lock = -1;
+	}
+	if (stat(storefile, &st) != 0 || st.st_mtime < newest || !map_store(cs, storefile, n)) {
+		fprintf(stderr, "- building %s\n", storefile);
+		COUNT(chain_store_builds, 1);
+		TRACE_POINT1(chain_store_build, n);
+		build_store(cs, chaindir, names, n);
+		save_store(cs, storefile);
+	} else
+		COUNT(chain_store_maps, 1);
+	index_ranges(cs);
+	if (lock >= 0)
+		close(lock);
+	free(names);
+	return cs;
+}
+
+void close_chain_store(struct chain_store *cs)
+{
+	if (cs == NULL)
+		return;
+	close_big_chains(cs->big);
+	if (cs->mapped)
+		munmap(cs->image, cs->size);
+	else
+		free(cs->image);
+	free(cs->range);
+	free(cs);
+}
+
+/* find_chain --------------------------- look a chain up by chromosome and id */
+const struct chain_rec *find_chain(const struct chain_store *cs, const char *chrom, int cid)
+{
+	uint32_t k, mask;
+	const struct chain_rec *c;
+
+	if (cs->big != NULL)
+		return big_find_chain(cs->big, chrom, cid);
+	mask = cs->h->nbucket - 1;
+	for (k = chain_hash(chrom, cid) & mask; cs->bucket[k] != 0; k = (k + 1) & mask) {
+		c = &cs->chain[cs->bucket[k]-1];
+		if (c->cid == cid && same_string(cs->names + c->chrom, chrom))
+			return c;
+	}
+	return NULL;
+}
+
+const struct chain_gf *chain_blocks(const struct chain_store *cs, const struct chain_rec *c)
+{
+	if (cs->big != NULL)
+		return big_chain_blocks(cs->big, c);
+	return cs->gf + c->gf;
+}
+
+const char *chain_schr(const struct chain_store *cs, const struct chain_rec *c)
+{
+	if (cs->big != NULL)
+		return big_chain_schr(cs->big, c);
+	return cs->names + c->schrom;
+}
+
+/* chrom_chains ------------------------- the chains of a reference chromosome */
+const struct chain_rec *chrom_chains(const struct chain_store *cs, const char *chrom, int *n)
+{
+	struct chrom_range key, *r;
+
+	if (cs->big != NULL)
+		return big_chrom_chains(cs->big, chrom, n);
+	key.chrom = chrom;
+	r = bsearch(&key, cs->range, cs->nrange, sizeof(struct chrom_range), cmp_range);
+	*n = r != NULL ? (int)(r->hi - r->lo) : 0;
+	return r != NULL ? &cs->chain[r->lo] : NULL;
+}
+
+/* prefetch_chains ------- start reading the pages of a chromosome's chains */
+void prefetch_chains(const struct chain_store *cs, const char *chrom)
+{
+	struct chrom_range key, *r;
+	const char *beg, *end;
+	uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+
+	if (cs == NULL || !cs->mapped)
+		return;
+	key.chrom = chrom;
+	if ((r = bsearch(&key, cs->range, cs->nrange, sizeof(struct chrom_range), cmp_range)) == NULL)
+		return;
+	// the records, and the gap-free blocks after the first of them
+	beg = (const char *)&cs->chain[r->lo];
+	end = (const char *)&cs->chain[r->hi];
+	beg = (const char *)((uintptr_t)beg & ~(page - 1));
+	madvise((void *)beg, end - beg, MADV_WILLNEED);
+	beg = (const char *)&cs->gf[cs->chain[r->lo].gf];
+	end = (const char *)&cs->gf[cs->chain[r->hi-1].gf + cs->chain[r->hi-1].ngf];
+	beg = (const char *)((uintptr_t)beg & ~(page - 1));
+	if (end > beg)
+		madvise((void *)beg, end - beg, MADV_WILLNEED);
+	COUNT(chain_prefetches, 1);
+}
+
+struct page_span {
+	uintptr_t beg, end;
+};
+
+static int cmp_span(const void *a, const void *b)
+{
+	const struct page_span *x = a, *y = b;
+
+	return x->beg < y->beg ? -1 : x->beg > y->beg;
+}
+
+static int cmp_cid(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/* add_span ----------------- the pages of bytes [beg, end) of a mapped store */
+static void add_span(struct page_span *span, int *n, const void *beg, const void *end)
+{
+	uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+
+	if (end <= beg)
+		return;
+	span[*n].beg = (uintptr_t)beg & ~(page - 1);
+	span[(*n)++].end = (uintptr_t)end;
+}
+
+/* prefetch_chain_ids ---------- start reading the pages of some chains only */
+void prefetch_chain_ids(const struct chain_store *cs, const char *chrom, const int *cid, int n)
+{
+	struct page_span *span;
+	const struct chain_rec *c;
+	int *ids, i, m, k;
+
+	// the chains of a bigChain are read here, for their lookups to find
+	if (cs != NULL && cs->big != NULL) {
+		for (i = 0; i < n; i++)
+			if (big_find_chain(cs->big, chrom, cid[i]) != NULL)
+				COUNT(chains_prefetched, 1);
+		return;
+	}
+	if (cs == NULL || !cs->mapped || n == 0)
+		return;
+	ids = ckalloc(n * sizeof(int));
+	memcpy(ids, cid, n * sizeof(int));
+	qsort(ids, n, sizeof(int), cmp_cid);
+	// a record and its gap-free blocks for each chain, in pages merged
+	span = ckalloc(2 * n * sizeof(struct page_span));
+	for (m = i = 0; i < n; i++) {
+		if ((i > 0 && ids[i] == ids[i-1]) || (c = find_chain(cs, chrom, ids[i])) == NULL)
+			continue;
+		add_span(span, &m, c, c + 1);
+		add_span(span, &m, &cs->gf[c->gf], &cs->gf[c->gf + c->ngf]);
+		COUNT(chains_prefetched, 1);
+	}
+	qsort(span, m, sizeof(struct page_span), cmp_span);
+	for (k = 0, i = 1; i <= m; i++) {
+		if (i < m && span[i].beg <= span[k].end) {
+			span[k].end = MAX(span[k].end, span[i].end);
+			continue;
+		}
+		if (k < m)
+			madvise((void *)span[k].beg, span[k].end - span[k].beg, MADV_WILLNEED);
+		k = i;
+	}
+	free(span);
+	free(ids);
+}
@@ -0,0 +1,57 @@
+/* **************************************************************
+ * A chain store holds every chain of one species pair, hashed by
+ * reference chromosome and chain id. It is built once from the
+ * chain directory (split <chr>.chain files or all.chain), saved as
+ * chain.store next to them and memory-mapped by later runs; it is
+ * rebuilt when a chain file is newer. The store of a chain directory
+ * given as a URL is kept in the cache of remote.h, and every store in
+ * $DESCHRAMBLER_CHAINSTORE when it is set. Runs opening a store at the
+ * same time wait for the one that builds it, and the runs of a node
+ * share the pages of the mapped store. A directory with all.bigChain and
+ * all.bigLink rather than chain files is read through their indexes
+ * instead (bigchain.h), the chains of a chromosome as it is looked up.
+ * **************************************************************/
+
+#ifndef _CHAINSTORE_H_
+#define _CHAINSTORE_H_
+
+#include <stdint.h>
+#include "util.h"
+
+struct chain_rec {
+	int32_t cid, fbeg, fend, sbeg, send, slen;
+	uint32_t chrom;		// offset of the reference chromosome name
+	uint32_t schrom;	// and of the other species' one
+	uint32_t gf, ngf;	// first entry in the gap-free block table, count
+	char forient, sorient, pad[2];
+};
+
+// a gap-free block and the gaps after it; roff and soff are where the
+// block starts, relative to the chain start, so a position is found by
+// binary search
+struct chain_gf {
+	int32_t size, fgap, sgap;
+	int32_t roff, soff;
+};
+
+struct chain_store;
+
+struct chain_store *open_chain_store(const char *chaindir);
+void close_chain_store(struct chain_store *cs);
+
+// the first chain cid on reference chromosome chrom; NULL if there is none
+const struct chain_rec *find_chain(const struct chain_store *cs, const char *chrom, int cid);
+const struct chain_gf *chain_blocks(const struct chain_store *cs, const struct chain_rec *c);
+const char *chain_schr(const struct chain_store *cs, const struct chain_rec *c);
+// the chains of reference chromosome chrom, in their file order, and
+// their count in *n; NULL if there are none
+const struct chain_rec *chrom_chains(const struct chain_store *cs, const char *chrom, int *n);
+// starts the reading of the chains of a chromosome in the background, so
+// that a mapped store has them in memory by the time they are looked up
+void prefetch_chains(const struct chain_store *cs, const char *chrom);
+/* the same for the chains cid[0..n-1] of the chromosome only, the ones
+ * its segments use, so that the pages of the many short chains no fill
+ * of the nets kept are not read at all */
+void prefetch_chain_ids(const struct chain_store *cs, const char *chrom, const int *cid, int n);
+
+#endif
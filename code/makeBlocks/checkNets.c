@@ -7,28 +7,32 @@
 
 #include "util.h"
 #include "species.h"
+#include "chromfile.h"
+#include "lines.h"
 
 #define MAXDEP	30
 #define SUFFIX	"raw.segs"
 
-int get_level(char *s) {
-	int i = 0;
-	while (s[i] == ' ')
-		++i;
-	if (i > MAXDEP)
+int get_level(const struct net_line *n) {
+	if (n->depth > MAXDEP)
 		fatalf("MAXDEP = %d not enough", MAXDEP);
-	return i;
+	return n->depth;
 }
 
 int main (int argc, char* argv[]) {
 	FILE *nf, *of;
-	char buf[500], type[20], chrom[50], refchrom[50], netfile[100], outfile[100];
+	char refchrom[50], netdir[500], netfile[500], outfile[100];
 	char gapchrom[MAXDEP][50], gaporient[MAXDEP];
-	int level, fbeg, flen, sbeg, slen, cid, i, j, rs, ss, k;
+	int level, i, j, rs, ss, k, nfiles;
 	int fgapbeg[MAXDEP], fgapend[MAXDEP], sgapbeg[MAXDEP], sgapend[MAXDEP];
 	int val[MAXDEP];
-	char orient;
+	struct line_reader *lr;
+	struct net_line n;
+	struct file_batch *batch;
+	const char *line, **dirs, **chroms;
+	size_t len;
 	
+
 	if (argc != 2)
 		fatal("arg = configure-file");
 
@@ -37,71 +41,92 @@ int main (int argc, char* argv[]) {
 	get_minlen(argv[1]);
 	get_numchr(argv[1]);
 	rs = ref_spe_idx();
+
+	// the net files read ahead in the order they are read
+	dirs = ckalloc((Spe->spesz * Spe->hsachr + 1) * sizeof(char *));
+	chroms = ckalloc((Spe->spesz * Spe->hsachr + 1) * sizeof(char *));
+	for (nfiles = ss = 0; ss < Spe->spesz; ss++) {
+		if (rs == ss)
+			continue;
+		pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[ss], "net");
+		for (k = 1; k <= Spe->hsachr; k++, nfiles++) {
+			if (k < Spe->hsachr)
+				sprintf(refchrom, "chr%d", k);
+			else
+				sprintf(refchrom, "chrX");
+			dirs[nfiles] = (k == 1) ? copy_string(netdir) : dirs[nfiles-1];
+			chroms[nfiles] = copy_string(refchrom);
+		}
+	}
+	batch = batch_chroms(dirs, chroms, nfiles, ".net", 1);
+
 	// generate raw.segs files for each species
-	for (ss = 0; ss < Spesz; ss++) {
+	for (ss = 0; ss < Spe->spesz; ss++) {
 		if (rs == ss)
 			continue;
-		sprintf(outfile, "%s.%s", Spename[ss], SUFFIX);
+		sprintf(outfile, "%s.%s", Spe->spename[ss], SUFFIX);
 		of = ckopen(outfile, "w");
 	
 		// assuming that net files have been splitted.
-		for (k = 1; k <= HSACHR; k++) {
-			if (k < HSACHR)
+		for (k = 1; k <= Spe->hsachr; k++) {
+			if (k < Spe->hsachr)
 				sprintf(refchrom, "chr%d", k);
 			else
 				sprintf(refchrom, "chrX");
 			
-			sprintf(netfile, "%s/%s/%s/net/%s.net", 
-								Netdir, Spename[0], Spename[ss], refchrom);
+			pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[ss], "net");
+			if ((nf = open_chrom(netdir, refchrom, ".net", netfile)) == NULL)
+				fatalf("Cannot open %s.", netfile);
 			fprintf(stderr, "- reading %s\n", netfile);
-			nf = ckopen(netfile, "r");
 
 			for (i = 0; i < MAXDEP; i++)
 				val[i] = 0;
 		
-			while (fgets(buf, 500, nf) != NULL) {
-				if (buf[0] != '#')
+			lr = open_lines(nf, netfile);
+			while ((line = next_line(lr, &len)) != NULL) {
+				if (len == 0 || line[0] != '#')
 					break;
 			}
-			if (sscanf(buf, "net %s %*d", refchrom) != 1)
-				fatalf("cannot parse: %s", buf);
+			if (line == NULL)
+				fatalf("no net line in %s", netfile);
+			if (!parse_net_line(line, len, &n) || n.type != 'n' || n.depth != 0
+				|| !field_copy(&n.chrom, refchrom, sizeof(refchrom)))
+				fatalf("cannot parse: %.*s", (int)len, line);
 			
-			while (fgets(buf, 500, nf)) {
-				if (sscanf(buf, "%s %*s", type) != 1)
-					fatalf("cannot parse: %s", buf);
-				if (same_string(type, "gap")) {
-					level = get_level(buf);
+			while ((line = next_line(lr, &len)) != NULL) {
+				if (!parse_net_line(line, len, &n))
+					fatalf("cannot parse: %.*s", (int)len, line);
+				if (n.type == 'g') {
+					level = get_level(&n);
 					level /= 2;
 					--level;
-					if (sscanf(buf, "%*s %d %d %s %c %d %d %*s",
-						   &(fgapbeg[level]), &(fgapend[level]), 
-						   gapchrom[level], &(gaporient[level]),
-						   &(sgapbeg[level]), &(sgapend[level])) != 6)
-						fatalf("cannot parse: %s", buf);
-					fgapend[level] += fgapbeg[level];
-					sgapend[level] += sgapbeg[level];
+					if (!field_copy(&n.chrom, gapchrom[level], sizeof(gapchrom[level])))
+						fatalf("cannot parse: %.*s", (int)len, line);
+					fgapbeg[level] = n.fbeg;
+					fgapend[level] = n.fbeg + n.flen;
+					gaporient[level] = n.orient;
+					sgapbeg[level] = n.sbeg;
+					sgapend[level] = n.sbeg + n.slen;
 						fprintf(of, "%d %d %d g %s.%s:%d-%d %s.%s:%d-%d %c\n",
 								sgapend[level] - sgapbeg[level],	
 								sgapend[level] - sgapbeg[level],	
-								level, Spename[rs], refchrom,
+								level, Spe->spename[rs], refchrom,
 								fgapbeg[level], fgapend[level],
-								Spename[ss], gapchrom[level],
+								Spe->spename[ss], gapchrom[level],
 								sgapbeg[level], sgapend[level],
 								gaporient[level]);
 				}	 
-				else if (same_string(type, "fill")) {
-					level = get_level(buf);
+				else if (n.type == 'f') {
+					level = get_level(&n);
 					level /= 2;
 					for (i = level; i < MAXDEP; i++)
 						val[i] = 0;
-					if (sscanf(buf, "%*s %d %d %s %c %d %d id %d %*s",
-							   &fbeg, &flen, chrom, &orient, &sbeg, &slen, &cid) != 7)
-						fatalf("cannot parse: %s", buf);
 						val[level] = 1;
-						fprintf(of, "%d %d %d s %s.%s:%d-%d %s.%s:%d-%d %c %d",
-								flen, slen, 
-								level, Spename[rs], refchrom, fbeg, fbeg + flen,
-								Spename[ss], chrom, sbeg, sbeg + slen, orient, cid);
+						fprintf(of, "%d %d %d s %s.%s:%d-%d %s.%.*s:%d-%d %c %d",
+								n.flen, n.slen, 
+								level, Spe->spename[rs], refchrom, n.fbeg, n.fbeg + n.flen,
+								Spe->spename[ss], n.chrom.len, n.chrom.s, n.sbeg, n.sbeg + n.slen,
+								n.orient, n.cid);
 						if (level == 0)
 							fprintf(of, "\n");
 						else {
@@ -117,10 +142,19 @@ int main (int argc, char* argv[]) {
 						}
 				}
 			}
-			fclose(nf);
+			close_lines(lr);
+			ckclose_in(nf);
 		}
 		fclose(of);
 	}	
+	close_file_batch(batch);
+	for (j = 0; j < nfiles; j++) {
+		if (j % Spe->hsachr == 0)
+			free((char *)dirs[j]);
+		free((char *)chroms[j]);
+	}
+	free(dirs);
+	free(chroms);
 	return 0;
 }
 
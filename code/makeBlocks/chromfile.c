@@ -0,0 +1,486 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <string.h>
+#include "chrtab.h"
+#include "chromfile.h"
+#include "manifest.h"
+#include "remote.h"
+
+/* the record header of each kind of file, and the field naming the
+ * reference chromosome: "net chr1 248956422",
+ * "chain 1234 chr1 248956422 + ..." */
+static const struct {
+	const char *ext, *key;
+	int field;
+} Kinds[] = {
+	{".net", "net", 1},
+	{".chain", "chain", 2},
+};
+
+/* consecutive records of one chromosome; all.chain is sorted by score, so
+ * a chromosome is usually spread over many runs */
+struct chrom_run {
+	char *chrom;
+	off_t off, len;
+	bool first;		// the chromosome's first run
+};
+
+struct chrom_index {
+	char *path;				// the whole-genome file
+	int nrun;
+	struct chrom_run *run;	// in file order
+	struct chrom_run **sorted;	// by chromosome, then offset
+	struct chrom_index *next;
+};
+static struct chrom_index *Indexes = NULL;
+static pthread_mutex_t IndexLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void add_run(struct chrom_index *x, int *max, const char *chrom, off_t off, off_t len)
+{
+	if (x->nrun == *max) {
+		*max = *max ? 2 * *max : 1024;
+		x->run = ckrealloc(x->run, *max * sizeof(struct chrom_run));
+	}
+	x->run[x->nrun].chrom = copy_string(chrom);
+	x->run[x->nrun].off = off;
+	x->run[x->nrun].len = len;
+	x->nrun++;
+}
+
+/* scan_file --------------------- find the chromosome runs of a data file */
+static void scan_file(struct chrom_index *x, const char *ext)
+{
+	char *line = NULL, *tok, *save;
+	size_t cap = 0;
+	ssize_t n;
+	off_t off = 0, beg = 0;
+	int k, f, max = 0;
+	char last[500] = "";
+	FILE *fp;
+
+	for (k = 0; !same_string(Kinds[k].ext, ext); )
+		if (++k == (int)(sizeof(Kinds) / sizeof(Kinds[0])))
+			fatalf("no index for %s files", ext);
+
+	fp = ckopen_in(x->path);
+	while ((n = getline(&line, &cap, fp)) > 0) {
+		if (starts(line, Kinds[k].key) && line[strlen(Kinds[k].key)] == ' ') {
+			tok = strtok_r(line, " \t\n", &save);
+			for (f = 0; tok && f < Kinds[k].field; f++)
+				tok = strtok_r(NULL, " \t\n", &save);
+			if (tok == NULL || strlen(tok) >= sizeof(last))
+				fatalf("cannot parse %s at byte %lld", x->path, (long long)off);
+			if (!same_string(tok, last)) {
+				if (last[0] != '\0')
+					add_run(x, &max, last, beg, off - beg);
+				strcpy(last, tok);
+				beg = off;
+			}
+		}
+		off += n;
+	}
+	if (last[0] != '\0')
+		add_run(x, &max, last, beg, off - beg);
+	free(line);
+	ckclose_in(fp);
+}
+
+/* read_index ----------------------------- load an index; 0 if it is unusable */
+static bool read_index(struct chrom_index *x, const char *idxfile)
+{
+	char buf[600], chrom[500];
+	long long off, len;
+	int max = 0;
+	FILE *fp;
+
+	if ((fp = is_url(idxfile) ? open_url(idxfile) : fopen(idxfile, "r")) == NULL)
+		return 0;
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (buf[0] == '#')
+			continue;
+		if (sscanf(buf, "%499s %lld %lld", chrom, &off, &len) != 3) {
+			fclose(fp);
+			return 0;
+		}
+		add_run(x, &max, chrom, off, len);
+	}
+	fclose(fp);
+	return 1;
+}
+
+/* write_index ------------------------- save an index next to its data file */
+static void write_index(struct chrom_index *x, const char *idxfile)
+{
+	char tmpfile[1100];
+	FILE *fp;
+	int i;
+
+	snprintf(tmpfile, sizeof(tmpfile), "%s.%d", idxfile, (int)getpid());
+	if ((fp = fopen(tmpfile, "w")) == NULL) {
+		fprintf(stderr, "- cannot write %s; the index is kept in memory\n", idxfile);
+		return;
+	}
+	fprintf(fp, "# chromosome, byte offset and length of the runs in %s\n", x->path);
+	for (i = 0; i < x->nrun; i++)
+		fprintf(fp, "%s\t%lld\t%lld\n", x->run[i].chrom,
+			(long long)x->run[i].off, (long long)x->run[i].len);
+	if (fclose(fp) != 0 || rename(tmpfile, idxfile) != 0) {
+		fprintf(stderr, "- cannot write %s; the index is kept in memory\n", idxfile);
+		unlink(tmpfile);
+	}
+}
+
+static int cmp_run(const void *a, const void *b)
+{
+	const struct chrom_run *p = *(struct chrom_run * const *)a;
+	const struct chrom_run *q = *(struct chrom_run * const *)b;
+	int c = strcmp(p->chrom, q->chrom);
+
+	if (c != 0)
+		return c;
+	return (p->off > q->off) - (p->off < q->off);
+}
+
+/* file_time ---------------- modification time of a file or URL; 0 if there is none */
+static bool file_time(const char *path, time_t *t)
+{
+	struct stat st;
+
+	if (is_url(path))
+		return url_stat(path, NULL, t);
+	if (stat(path, &st) != 0)
+		return 0;
+	*t = st.st_mtime;
+	return 1;
+}
+
+/* get_index --------------------- index of dir/all<ext>; NULL if there is none */
+static struct chrom_index *get_index(const char *dir, const char *ext)
+{
+	const struct manifest_dir *d = manifest_dir(dir);
+	const struct manifest_file *m = NULL;
+	char path[1000], idxfile[1100];
+	struct chrom_index *x;
+	time_t dt = 0, it;
+	int i, max = 0;
+
+	snprintf(path, sizeof(path), "%s/all%s", dir, ext);
+	if (d != NULL) {
+		// the runs of a listed file are those of its index
+		if ((m = manifest_file(d, path + strlen(dir) + 1)) == NULL) {
+			strcat(path, ".gz");
+			if ((m = manifest_file(d, path + strlen(dir) + 1)) == NULL)
+				return NULL;
+		}
+	} else if (!file_time(path, &dt)) {
+		strcat(path, ".gz");
+		if (!file_time(path, &dt))
+			return NULL;
+	}
+
+	pthread_mutex_lock(&IndexLock);
+	for (x = Indexes; x != NULL; x = x->next)
+		if (same_string(x->path, path))
+			break;
+	if (x == NULL) {
+		x = ckallocz(sizeof(struct chrom_index));
+		x->path = copy_string(path);
+		snprintf(idxfile, sizeof(idxfile), "%s.idx", path);
+		for (i = 0; m != NULL && i < m->nrun; i++)
+			add_run(x, &max, m->run[i].chrom, m->run[i].off, m->run[i].len);
+		// a remote file is indexed in the cache, unless the server has its index
+		if (m == NULL && is_url(path) && !(file_time(idxfile, &it) && it >= dt))
+			url_cache_file(path, "idx", idxfile, sizeof(idxfile));
+		if (m == NULL && (!file_time(idxfile, &it) || it < dt || !read_index(x, idxfile))) {
+			for (i = 0; i < x->nrun; i++)
+				free(x->run[i].chrom);
+			x->nrun = 0;
+			fprintf(stderr, "- indexing %s\n", path);
+			scan_file(x, ext);
+			write_index(x, idxfile);
+		}
+		x->sorted = ckalloc((x->nrun + 1) * sizeof(struct chrom_run *));
+		for (i = 0; i < x->nrun; i++)
+			x->sorted[i] = &x->run[i];
+		qsort(x->sorted, x->nrun, sizeof(struct chrom_run *), cmp_run);
+		for (i = 0; i < x->nrun; i++)
+			x->sorted[i]->first = i == 0
+				|| !same_string(x->sorted[i-1]->chrom, x->sorted[i]->chrom);
+		x->next = Indexes;
+		Indexes = x;
+	}
+	pthread_mutex_unlock(&IndexLock);
+	return x;
+}
+
+/* the runs of one chromosome read as a single stream */
+struct chrom_section {
+	FILE *fp;
+	bool seekable;
+	off_t pos, left;
+	int i, n;
+	struct chrom_run **run;
+};
+
+static ssize_t section_read(void *cookie, char *buf, size_t size)
+{
+	struct chrom_section *s = cookie;
+	struct chrom_run *r;
+	char skip[65536];
+	size_t got = 0, k;
+
+	while (got < size) {
+		if (s->left == 0) {
+			if (s->i == s->n)
+				break;
+			r = s->run[s->i++];
+			if (s->seekable) {
+				if (fseeko(s->fp, r->off, SEEK_SET) != 0)
+					return -1;
+				s->pos = r->off;
+			}
+			// a decompressor pipe can only be read forward
+			while (s->pos < r->off) {
+				k = fread(skip, 1, MIN((off_t)sizeof(skip), r->off - s->pos), s->fp);
+				if (k == 0)
+					return -1;
+				s->pos += k;
+			}
+			s->left = r->len;
+		}
+		k = fread(buf + got, 1, MIN((off_t)(size - got), s->left), s->fp);
+		if (k == 0)
+			break;
+		got += k;
+		s->pos += k;
+		s->left -= k;
+	}
+	return got;
+}
+
+static int section_close(void *cookie)
+{
+	struct chrom_section *s = cookie;
+
+	ckclose_in(s->fp);
+	free(s);
+	return 0;
+}
+
+/* the bytes of a file a batch read ahead (filebatch.h), read as a stream */
+struct batch_stream {
+	char *buf;
+	size_t len, pos;
+};
+
+static ssize_t batch_read(void *cookie, char *buf, size_t size)
+{
+	struct batch_stream *s = cookie;
+	size_t k = MIN(size, s->len - s->pos);
+
+	memcpy(buf, s->buf + s->pos, k);
+	s->pos += k;
+	return k;
+}
+
+static int batch_close(void *cookie)
+{
+	struct batch_stream *s = cookie;
+
+	free(s->buf);
+	free(s);
+	return 0;
+}
+
+/* listed --------- whether a listed dir has name or name.gz; the one it has in name */
+static bool listed(const struct manifest_dir *d, const char *dir, char *name)
+{
+	char *leaf = name + strlen(dir) + 1;
+	size_t len = strlen(name);
+
+	if (manifest_file(d, leaf) != NULL)
+		return 1;
+	if (len + 3 >= 500)
+		return 0;
+	strcpy(name + len, ".gz");
+	if (manifest_file(d, leaf) != NULL)
+		return 1;
+	name[len] = '\0';
+	return 0;
+}
+
+/* open_chrom ------------------------- open the records of one chromosome */
+FILE *open_chrom(const char *dir, const char *chrom, const char *ext, char *name)
+{
+	cookie_io_functions_t io = {section_read, NULL, NULL, section_close};
+	cookie_io_functions_t bio = {batch_read, NULL, NULL, batch_close};
+	const struct manifest_dir *d;
+	struct chrom_index *x;
+	struct chrom_section *s;
+	struct batch_stream *b;
+	char *buf;
+	size_t len;
+	int lo, hi, mid;
+	FILE *fp;
+
+	snprintf(name, 500, "%s/%s%s", dir, chrom, ext);
+	if (!is_url(dir) && (buf = take_batched(name, &len)) != NULL) {
+		b = ckallocz(sizeof(struct batch_stream));
+		b->buf = buf;
+		b->len = len;
+		if ((fp = fopencookie(b, "r", bio)) == NULL)
+			fatalf("Cannot open %s.", name);
+		return fp;
+	}
+	// a server is asked for all<ext> first rather than for every chromosome
+	x = is_url(dir) ? get_index(dir, ext) : NULL;
+	d = x == NULL ? manifest_dir(dir) : NULL;
+	if (x == NULL && (d != NULL ? listed(d, dir, name) : input_exists(name)))
+		return ckopen_in(name);
+	if (x == NULL && (x = get_index(dir, ext)) == NULL)
+		return NULL;
+
+	// first run of chrom
+	for (lo = 0, hi = x->nrun; lo < hi; ) {
+		mid = (lo + hi) / 2;
+		if (strcmp(x->sorted[mid]->chrom, chrom) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (hi = lo; hi < x->nrun && same_string(x->sorted[hi]->chrom, chrom); hi++)
+		;
+	if (hi == lo)
+		return NULL;
+
+	snprintf(name, 500, "%s:%s", x->path, chrom);
+	s = ckallocz(sizeof(struct chrom_section));
+	s->fp = ckopen_in(x->path);
+	s->seekable = fseeko(s->fp, 0, SEEK_CUR) == 0;
+	s->run = x->sorted + lo;
+	s->n = hi - lo;
+	if ((fp = fopencookie(s, "r", io)) == NULL)
+		fatalf("Cannot open %s.", name);
+	return fp;
+}
+
+/* batch_chroms ------------ read ahead the split files open_chrom() is to open */
+struct file_batch *batch_chroms(const char **dirs, const char **chroms, int n,
+	const char *ext, int nthreads)
+{
+	struct file_batch *b;
+	const char **paths = ckalloc((n + 1) * sizeof(char *));
+	char *buf = ckalloc((size_t)(n + 1) * 500), *path;
+	const struct manifest_dir *d = NULL;
+	const struct manifest_file *m;
+	bool split = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		// a whole-genome file is read in sections, not as small files
+		if (i == 0 || !same_string(dirs[i], dirs[i-1])) {
+			split = !is_url(dirs[i]) && get_index(dirs[i], ext) == NULL;
+			d = split ? manifest_dir(dirs[i]) : NULL;
+		}
+		paths[i] = NULL;
+		if (split && chroms[i] != NULL) {
+			path = buf + (size_t)i * 500;
+			snprintf(path, 500, "%s/%s%s", dirs[i], chroms[i], ext);
+			// nor are the files a listing has not, or has too large to batch
+			m = d != NULL ? manifest_file(d, path + strlen(dirs[i]) + 1) : NULL;
+			if (d == NULL || (m != NULL && m->size < BATCH_SMALL))
+				paths[i] = path;
+		}
+	}
+	b = open_file_batch(paths, n, BATCH_DEPTH, nthreads);
+	free(paths);
+	free(buf);
+	return b;
+}
+
+/* chrom_names ------------------ chromosomes of a whole-genome file, in order */
+int chrom_names(const char *dir, const char *ext, const char ***names)
+{
+	struct chrom_index *x;
+	int i, n = 0;
+
+	if ((x = get_index(dir, ext)) == NULL)
+		return -1;
+	*names = ckalloc((x->nrun + 1) * sizeof(char *));
+	for (i = 0; i < x->nrun; i++)
+		if (x->run[i].first)
+			(*names)[n++] = intern_chr(x->run[i].chrom);
+	return n;
+}
+
+/* chrom_runs ------------------ the runs of a whole-genome file, for a listing */
+int chrom_runs(const char *dir, const char *ext, struct manifest_run **runs)
+{
+	struct chrom_index *x;
+	int i;
+
+	if ((x = get_index(dir, ext)) == NULL)
+		return -1;
+	*runs = ckalloc((x->nrun + 1) * sizeof(struct manifest_run));
+	for (i = 0; i < x->nrun; i++) {
+		(*runs)[i].chrom = copy_string(x->run[i].chrom);
+		(*runs)[i].off = x->run[i].off;
+		(*runs)[i].len = x->run[i].len;
+	}
+	return x->nrun;
+}
+
+/* next_file ------------------ the next file of a directory listed or read */
+static char *next_file(const struct manifest_dir *m, int *i, DIR *d, char *buf)
+{
+	struct dirent *ent;
+
+	if (m != NULL) {
+		if (*i == m->nfile)
+			return NULL;
+		snprintf(buf, 300, "%s", m->file[(*i)++].name);
+		return buf;
+	}
+	return (ent = readdir(d)) != NULL ? ent->d_name : NULL;
+}
+
+/* dir_chroms ----------------- chromosomes of a directory of separate files */
+int dir_chroms(const char *dir, const char *ext, const char ***names)
+{
+	const struct manifest_dir *m;
+	DIR *d = NULL;
+	const char *chr;
+	char *file, *token, *seen = NULL, buf[300];
+	int i = 0, n, maxchr = 0, nseen = 0;
+
+	// a URL cannot be listed
+	if ((n = chrom_names(dir, ext, names)) >= 0 || is_url(dir))
+		return n;
+	if ((m = manifest_dir(dir)) == NULL && (d = opendir(dir)) == NULL)
+		return -1;
+	*names = NULL;
+	n = 0;
+	while ((file = next_file(m, &i, d, buf)) != NULL) {
+		token = strtok(basename(file), ".");
+		if (token == NULL)
+			continue;
+		// chr1.net.gz and an index next to it name the same chromosome
+		chr = intern_chr(token);
+		seen = grow_chr_table(seen, &nseen, 1);
+		if (seen[chr_id(chr)])
+			continue;
+		seen[chr_id(chr)] = 1;
+		if (n == maxchr) {
+			maxchr = maxchr ? 2 * maxchr : 1024;
+			*names = ckrealloc(*names, maxchr * sizeof(char *));
+		}
+		(*names)[n++] = chr;
+	}
+	if (d != NULL)
+		closedir(d);
+	free(seen);
+	return n;
+}
@@ -0,0 +1,64 @@
+/* **************************************************************
+ * Per-chromosome access to chain and net files. A directory may
+ * hold one file per reference chromosome (chr1.net, chr2.net, ...)
+ * as written by splitNet/splitChain, or a single whole-genome file
+ * (all.net, all.chain). The whole-genome file gets a sidecar index,
+ * all.net.idx, with the byte ranges of every chromosome; it is built
+ * on first use and rebuilt when the data file is newer. dir may be
+ * a URL (see remote.h), with the index kept in the cache unless the
+ * server has one. With a manifest (manifest.h) the files of a listed
+ * directory and the runs of its whole-genome file are taken from it.
+ * **************************************************************/
+
+#ifndef _CHROMFILE_H_
+#define _CHROMFILE_H_
+
+#include "util.h"
+#include "filebatch.h"
+#include "manifest.h"
+
+/* **************************************************************
+ * Input:		dir			-	directory of the chain or net files
+ * 					chrom		-	reference chromosome
+ * 					ext			-	".net" or ".chain"
+ *
+ * Output:	name		-	what was opened, for messages (500 chars)
+ *
+ * Returns a stream of the chromosome's records, or NULL if neither
+ * dir/<chrom><ext> nor dir/all<ext> has any. Close it with
+ * ckclose_in(). A file a batch has read ahead is read from memory.
+ * **************************************************************/
+FILE *open_chrom(const char *dir, const char *chrom, const char *ext, char *name);
+
+/* **************************************************************
+ * Starts a batch (filebatch.h) reading ahead dirs[i]/<chroms[i]><ext>
+ * for i = 0..n-1, the order they are to be opened in, but in the
+ * directories of a whole-genome file and URLs; a NULL chroms[i] is
+ * skipped. Close it with close_file_batch() once they are read.
+ * **************************************************************/
+struct file_batch *batch_chroms(const char **dirs, const char **chroms, int n,
+	const char *ext, int nthreads);
+
+/* **************************************************************
+ * Lists the chromosomes of dir/all<ext> in file order, as interned
+ * names in an array the caller frees.
+ * Returns their number, or -1 if there is no whole-genome file.
+ * **************************************************************/
+int chrom_names(const char *dir, const char *ext, const char ***names);
+
+/* **************************************************************
+ * The same, or with no whole-genome file the chromosomes of the
+ * files in dir, named by what comes before their first '.', in
+ * directory order. Returns -1 if dir cannot be read; a URL must
+ * have a whole-genome file, as it cannot be listed.
+ * **************************************************************/
+int dir_chroms(const char *dir, const char *ext, const char ***names);
+
+/* **************************************************************
+ * The chromosome runs of dir/all<ext> in file order, for a manifest,
+ * in an array the caller frees with their names.
+ * Returns their number, or -1 if there is no whole-genome file.
+ * **************************************************************/
+int chrom_runs(const char *dir, const char *ext, struct manifest_run **runs);
+
+#endif
@@ -0,0 +1,91 @@
+#include <stddef.h>
+#include <pthread.h>
+#include "util.h"
+#include "chrtab.h"
+
+struct chr_entry {
+	int id;
+	char name[];
+};
+
+static struct chr_entry **Chrnames = NULL;	// open addressing, by name
+static unsigned Chrnamesz = 0;
+static int Chrnamenum = 0;
+static pthread_mutex_t Chrnamelock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned hash_chr(const char *s)
+{
+	unsigned h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h;
+}
+
+static void grow_names(void)
+{
+	struct chr_entry **old = Chrnames;
+	unsigned i, j, oldsz = Chrnamesz;
+
+	Chrnamesz = oldsz ? 2 * oldsz : 1024;
+	Chrnames = ckallocz(Chrnamesz * sizeof(struct chr_entry *));
+	for (i = 0; i < oldsz; i++) {
+		if (old[i] == NULL)
+			continue;
+		for (j = hash_chr(old[i]->name) & (Chrnamesz - 1); Chrnames[j] != NULL;
+				j = (j + 1) & (Chrnamesz - 1))
+			;
+		Chrnames[j] = old[i];
+	}
+	free(old);
+}
+
+/* intern_chr ------------------------------ the one copy of a chromosome name */
+const char *intern_chr(const char *name)
+{
+	struct chr_entry *e;
+	size_t len = strlen(name);
+	unsigned j;
+
+	pthread_mutex_lock(&Chrnamelock);
+	if (2 * ((unsigned)Chrnamenum + 1) > Chrnamesz)
+		grow_names();
+	for (j = hash_chr(name) & (Chrnamesz - 1); Chrnames[j] != NULL; j = (j + 1) & (Chrnamesz - 1))
+		if (same_string(Chrnames[j]->name, name))
+			break;
+	if ((e = Chrnames[j]) == NULL) {
+		e = ckalloc(sizeof(struct chr_entry) + len + 1);
+		e->id = Chrnamenum++;
+		memcpy(e->name, name, len + 1);
+		Chrnames[j] = e;
+	}
+	pthread_mutex_unlock(&Chrnamelock);
+	return e->name;
+}
+
+int chr_id(const char *chr)
+{
+	return ((const struct chr_entry *)(chr - offsetof(struct chr_entry, name)))->id;
+}
+
+int chr_count(void)
+{
+	int n;
+
+	pthread_mutex_lock(&Chrnamelock);
+	n = Chrnamenum;
+	pthread_mutex_unlock(&Chrnamelock);
+	return n;
+}
+
+void *grow_chr_table(void *table, int *size, size_t nmemb)
+{
+	int n = chr_count();
+
+	if (n <= *size)
+		return table;
+	table = ckrealloc(table, n * nmemb);
+	memset((char *)table + *size * nmemb, 0, (n - *size) * nmemb);
+	*size = n;
+	return table;
+}
@@ -0,0 +1,22 @@
+/* **************************************************************
+ * The chromosome and scaffold names seen by a tool. Each distinct
+ * name is stored once: intern_chr() returns that copy, so names can
+ * be compared as pointers, and chr_id() numbers them densely in the
+ * order they were first seen, so per-chromosome tables are plain
+ * arrays that grow with chr_count() rather than fixed-size slots.
+ * **************************************************************/
+
+#ifndef _CHRTAB_H_
+#define _CHRTAB_H_
+
+const char *intern_chr(const char *name);
+
+// id of a name returned by intern_chr(), from 0 to chr_count()-1
+int chr_id(const char *chr);
+int chr_count(void);
+
+/* grows a per-chromosome table of nmemb-sized entries to hold chr_count()
+ * of them; the new entries are zeroed */
+void *grow_chr_table(void *table, int *size, size_t nmemb);
+
+#endif
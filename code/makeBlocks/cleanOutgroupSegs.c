@@ -4,12 +4,66 @@
 
 #include "util.h"
 #include "species.h"
+#include "blockfile.h"
+#include "stages.h"
 
 struct perm_array {
 	int id, sid;
 };
 
-void merge_segs(struct block_list *blkhead, int id, int ss, int start, int terminal) {
+// where a piece of a block is in the order of a species
+struct piece_at {
+	int sid, pos;
+};
+
+// perm[j] = (id, sid), growing perm (zero-filled) to hold it
+static void set_perm(struct perm_array **perm, int *max, int j, int id, int sid) {
+	int n;
+
+	if (j >= *max) {
+		n = MAX(2 * *max, j + 1024);
+		*perm = ckrealloc(*perm, n * sizeof(struct perm_array));
+		memset(*perm + *max, 0, (n - *max) * sizeof(struct perm_array));
+		*max = n;
+	}
+	(*perm)[j].id = id;
+	(*perm)[j].sid = sid;
+}
+
+static int cmp_piece_at(const void *a, const void *b) {
+	const struct piece_at *x = a, *y = b;
+
+	if (x->sid != y->sid)
+		return x->sid - y->sid;
+	return x->pos - y->pos;
+}
+
+/* the pieces of blocks 1..total in perm[1..n-1], those of block id in
+ * at[off[id]..off[id+1]-1] by subid, and for a subid by position */
+static void index_pieces(struct perm_array *perm, int n, int total, int **off,
+						 struct piece_at **at) {
+	int k, id, *next;
+
+	*off = ckallocz(sizeof(int) * (total + 2));
+	for (k = 1; k < n; k++)
+		if ((id = abs(perm[k].id)) >= 1 && id <= total)
+			(*off)[id + 1]++;
+	for (id = 1; id <= total; id++)
+		(*off)[id + 1] += (*off)[id];
+	*at = ckalloc(sizeof(struct piece_at) * ((*off)[total + 1] + 1));
+	next = ckalloc(sizeof(int) * (total + 2));
+	memcpy(next, *off, sizeof(int) * (total + 2));
+	for (k = 1; k < n; k++)
+		if ((id = abs(perm[k].id)) >= 1 && id <= total) {
+			(*at)[next[id]].sid = perm[k].sid;
+			(*at)[next[id]++].pos = k;
+		}
+	for (id = 1; id <= total; id++)
+		qsort(*at + (*off)[id], (*off)[id + 1] - (*off)[id], sizeof(struct piece_at), cmp_piece_at);
+	free(next);
+}
+
+void merge_segs(struct block_list **index, int maxid, int id, int ss, int start, int terminal) {
 	struct block_list *p;
 	struct seg_list *b, *nb;
 	int j;
@@ -17,9 +71,8 @@ void merge_segs(struct block_list *blkhead, int id, int ss, int start, int termi
 	if (terminal < start)
 		fatalf("DIE: start > terminal %d %d", start, terminal);
 	
-	for (p = blkhead; p != NULL; p = p->next) 
-		if (p->id == id)
-			break;
+	if (id < 1 || id > maxid || (p = index[id]) == NULL)
+		fatalf("DIE: no block %d", id);
 	
 	for (b = p->speseg[ss]; b != NULL; b = b->next)
 		if (b->subid == start)
@@ -64,8 +117,8 @@ void remove_tiny_pieces(struct block_list *head) {
 	rs = ref_spe_idx();
 	for (p = head; p != NULL; p = p->next) {
 		reflen = p->speseg[rs]->end - p->speseg[rs]->beg;
-		for (i = 0; i < Spesz; i++) {
-			if (Spetag[i] != 2)
+		for (i = 0; i < Spe->spesz; i++) {
+			if (Spe->spetag[i] != 2)
 				continue;
 			for (sg = p->speseg[i]; sg != NULL; ) {
 				len = sg->end - sg->beg;
@@ -92,114 +145,111 @@ void remove_tiny_pieces(struct block_list *head) {
 	} 
 }
 
-int main(int argc, char* argv[]) {
-	FILE *orthorder;
-	char buf[100000], spe[20];
-	struct block_list *blkhead, *bk;
-	int i, j, num, snum, total, k, start, terminal;
-	int outorder[MAXSPE];
+struct block_list *clean_outgroup_segs(struct block_list *blkhead, FILE *orthorder) {
+	char *buf = NULL, spe[20];
+	size_t cap = 0;
+	struct block_list *bk, **index;
+	int i = -1, j, num, snum, total, k, c, start, terminal, maxid;
+	int outorder[MAXSPE], maxperm[MAXSPE], *off;
 	char *pt;
-	struct seg_list *p;
-	struct perm_array **pmay;
-	
-	if (argc != 4)
-		fatal("args: config.file conserved-segs outgroup-segs-orders");
-
-	get_spename(argv[1]);
-	blkhead = get_block_list(argv[2]);
-	
-	pmay = malloc(sizeof(struct perm_array*) * MAXSPE);
-    	for (i = 0; i < MAXSPE; i++) {
-        	pmay[i] = malloc(sizeof(struct perm_array) * (MAXORDER*10));
-    	}
+	struct perm_array *perm[MAXSPE];
+	struct piece_at *at;
 	
 	for (total = 0, bk = blkhead; bk != NULL; bk = bk->next)
 		++total;
+	index = index_blocks(blkhead, &maxid);
 
-	for (i = 0; i < Spesz; i++) {
-		if (Spetag[i] != 2)
-			continue;
-		outorder[i] = 0;
-		for (j = 0; j < MAXORDER; j++)
-			pmay[i][j].id = pmay[i][j].sid = 0;
-	}
-	
-	orthorder = ckopen(argv[3], "r");
-	while (fgets(buf, 100000, orthorder)) {
+	// perm[i] is the order of species i from 1, chromosomes apart by a 0
+	memset(perm, 0, sizeof(perm));
+	memset(outorder, 0, sizeof(outorder));
+	memset(maxperm, 0, sizeof(maxperm));
+	while (getline(&buf, &cap, orthorder) != -1) {
 		if (buf[0] == '\n' || buf[0] == '#')
 			continue;
 		if (buf[0] == '>') {
-			if (sscanf(buf, ">%s", spe) != 1)
+			if (sscanf(buf, ">%19s", spe) != 1)
 				fatalf("cannot parse: %s", buf);
 			i = spe_idx(spe);
 			continue;
 		}
+		if (i < 0)
+			fatalf("an order before its species: %s", buf);
 		pt = buf;
 		while (sscanf(pt, "%d.%d", &num, &snum) == 2) {
 			j = ++outorder[i];
-			pmay[i][j].id = num;
-			pmay[i][j].sid = snum;
+			set_perm(&perm[i], &maxperm[i], j, num, snum);
 			pt = strchr(pt, ' ');
 			if (pt == NULL || (pt != NULL && *(pt+1) == '$'))
 				break;
 			else
 				pt++;
 		}
-		++outorder[i];
+		set_perm(&perm[i], &maxperm[i], ++outorder[i], 0, 0);
 	}
-	fclose(orthorder);
+	free(buf);
 	
-	for (i = 0; i < Spesz; i++) {
-		if (Spetag[i] != 2)
+	/* each run of the pieces of a block, subids one after the other in
+	 * the order (or back to front, for the block reversed) from the first
+	 * place of a piece on, is one piece */
+	for (i = 0; i < Spe->spesz; i++) {
+		if (Spe->spetag[i] != 2 || outorder[i] == 0)
 			continue;
-		start = terminal = 1;
+		index_pieces(perm[i], outorder[i] + 1, total, &off, &at);
 		for (j = 1; j <= total; j++) {
-			for (;;) {
-				for (k = 0; k <= outorder[i]; k++)
-					if (abs(pmay[i][k].id) == j && pmay[i][k].sid == terminal)
-						break;
-				if (k > outorder[i]) {
-					start = terminal = 1;
+			start = terminal = 1;
+			for (c = off[j]; ; ) {
+				while (c < off[j + 1] && at[c].sid < terminal)
+					c++;
+				if (c == off[j + 1] || at[c].sid != terminal)
 					break;
-				}
-				if ((pmay[i][k].id > 0 && pmay[i][k+1].id == pmay[i][k].id && pmay[i][k+1].sid == terminal + 1)
-					|| (pmay[i][k].id < 0 && pmay[i][k-1].id == pmay[i][k].id && pmay[i][k-1].sid == terminal + 1))
+				k = at[c].pos;
+				if ((perm[i][k].id > 0 && k + 1 < maxperm[i] && perm[i][k+1].id == perm[i][k].id
+						&& perm[i][k+1].sid == terminal + 1)
+					|| (perm[i][k].id < 0 && perm[i][k-1].id == perm[i][k].id
+						&& perm[i][k-1].sid == terminal + 1))
 					terminal++;
 				else {
-					merge_segs(blkhead, j, i, start, terminal);
+					merge_segs(index, maxid, j, i, start, terminal);
 					start = terminal + 1;
 					terminal = start;
 				}
 			}
 		}
+		free(off);
+		free(at);
 	}
 	
+	free(index);
 	remove_tiny_pieces(blkhead);
 
 	assign_states(blkhead);
 	merge_chlist(blkhead);
-	for (bk = blkhead; bk != NULL; bk = bk->next) {
-		printf(">%d\n", bk->id);
-		for (i = 0; i < Spesz; i++) {
-			for (p = bk->speseg[i]; p != NULL; p = p->next) {
-				printf("%s.%s:%d-%d %c [%d] [%d.%d]", 
-						Spename[i], p->chr, p->beg, p->end, p->orient, p->state, p->id, p->subid);
-				if (Spetag[i] == 0){
-					printf("\n");
-					continue;
-				}
-				printf(" {%d", p->chnum);
-				for (j = 0; j < p->chnum; j++)
-					printf(",%d", p->cidlist[j]);
-				printf("}\n");
-			}
-		}
-		printf("\n");
-	}
-	free_block_list(blkhead);
 	
-	for (i = 0; i < MAXSPE; i++) free(pmay[i]);
-    	free(pmay);
+	for (i = 0; i < Spe->spesz; i++)
+		free(perm[i]);
+	
+	return blkhead;
+}
+
+#ifndef NO_MAIN
+int main(int argc, char* argv[]) {
+	FILE *orthorder;
+	struct block_list *blkhead;
+	int binary;
+	
+	binary = binary_blocks_arg(&argc, argv);
+	if (argc != 4)
+		fatal("args: [-bin] config.file conserved-segs outgroup-segs-orders");
+
+	get_spename(argv[1]);
+	blkhead = get_block_list(argv[2]);
+	orthorder = ckopen(argv[3], "r");
+	blkhead = clean_outgroup_segs(blkhead, orthorder);
+	fclose(orthorder);
+
+	write_block_list(stdout, blkhead, BLOCKS_CLEANED, binary);
+	free_block_list(blkhead);
 	
 	return 0;
 }
+#endif
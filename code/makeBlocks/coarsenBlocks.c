@@ -0,0 +1,183 @@
+/* *********************************************************
+ * Building blocks of a coarser resolution out of those of a finer
+ * one, so that a run at several resolutions partitions the genomes
+ * once, at the finest. Blocks that follow each other in every
+ * species are cut apart by the gaps of the nets between them, and by
+ * the fills too short for a coarser resolution that lie in those
+ * gaps: at a resolution no smaller than every gap between them (on
+ * the reference and in each species) the nets have neither, and the
+ * two are one block, the blocks between them on the reference,
+ * shorter than it, gone. Where a species has more than one segment
+ * in the blocks, the two closest on the same chromosome and strand,
+ * in order, are made one and the others kept. A block is kept apart
+ * from the next ones when a species has no such pair, or a segment
+ * in one of them only. The rest of the steps, from the orthology
+ * blocks on, then drop the merged blocks too short for the
+ * resolution, as they would those of its own partitioning.
+ *
+ * With -levels the blocks are not merged but listed, each with the
+ * resolution from which it is merged with one after it, "-" where
+ * it never is.
+ * ********************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "blockfile.h"
+#include "stages.h"
+
+#define KEPT	-1
+
+/* the gap between segment s of a block and t of one after it on the
+ * reference, in the direction of their strand; KEPT for none */
+static int seg_gap(struct seg_list *s, struct seg_list *t) {
+	int gap;
+
+	if (s->chr != t->chr || s->orient != t->orient)
+		return KEPT;
+	gap = s->orient == '-' ? s->beg - t->end : t->beg - s->end;
+	return gap < 0 ? KEPT : gap;
+}
+
+/* the segments of species i in a and b that are one piece from the
+ * resolution returned, the narrowest gap between them, in *sa and *sb;
+ * 0 and NULL where neither block has the species, KEPT where the two
+ * never join */
+static int join_gap(struct block_list *a, struct block_list *b, int i,
+					struct seg_list **sa, struct seg_list **sb) {
+	struct seg_list *s, *t;
+	int gap, best = KEPT;
+
+	*sa = *sb = NULL;
+	if (a->speseg[i] == NULL || b->speseg[i] == NULL)
+		return a->speseg[i] == b->speseg[i] ? 0 : KEPT;
+	for (s = a->speseg[i]; s != NULL; s = s->next)
+		for (t = b->speseg[i]; t != NULL; t = t->next)
+			if ((gap = seg_gap(s, t)) != KEPT && (best == KEPT || gap < best)) {
+				best = gap;
+				*sa = s;
+				*sb = t;
+			}
+	return best;
+}
+
+/* the resolution from which a and b, a block after it on the reference,
+ * are one: the widest gap between them; KEPT if they never are */
+static int boundary_level(struct block_list *a, struct block_list *b) {
+	struct seg_list *s, *t;
+	int i, gap, level = 0;
+
+	for (i = 0; i < Spe->spesz; i++) {
+		if ((gap = join_gap(a, b, i, &s, &t)) == KEPT)
+			return KEPT;
+		if (gap > level)
+			level = gap;
+	}
+	return level;
+}
+
+/* the lowest level of a with the blocks after it, those no further than
+ * limit on the reference; the first block it is merged with at that
+ * level in *to. KEPT and NULL if there is none */
+static int merge_level(struct block_list *a, int limit, struct block_list **to) {
+	struct block_list *q;
+	int rs = ref_spe_idx(), level, best = KEPT;
+
+	*to = NULL;
+	for (q = a->next; q != NULL && q->speseg[rs]->chr == a->speseg[rs]->chr; q = q->next) {
+		if (q->speseg[rs]->beg - a->speseg[rs]->end > limit)
+			break;
+		level = boundary_level(a, q);
+		if (level != KEPT && level <= limit) {
+			*to = q;
+			best = limit = level;
+			// a block further on is no nearer on the reference
+			if (level == q->speseg[rs]->beg - a->speseg[rs]->end)
+				break;
+		}
+	}
+	return best;
+}
+
+/* b taken into a, and the blocks between them dropped: the segments of
+ * a species that join up are one, and the others of b are added to a */
+static void merge_into(struct block_list *a, struct block_list *b) {
+	struct block_list *q;
+	struct seg_list *s, *t, **pt, *last;
+	int i;
+
+	while ((q = a->next) != b) {
+		a->next = q->next;
+		q->next = NULL;
+		free_block_list(q);
+	}
+	for (i = 0; i < Spe->spesz; i++) {
+		if (join_gap(a, b, i, &s, &t) == KEPT || s == NULL)
+			continue;
+		if (s->orient == '-')
+			s->beg = t->beg;
+		else
+			s->end = t->end;
+		for (pt = &b->speseg[i]; *pt != t; pt = &(*pt)->next)
+			;
+		*pt = t->next;
+		t->next = NULL;
+		free_seg_list(t);
+		for (last = a->speseg[i]; last->next != NULL; last = last->next)
+			;
+		last->next = b->speseg[i];
+		b->speseg[i] = NULL;
+	}
+	a->next = b->next;
+	b->next = NULL;
+	free_block_list(b);
+}
+
+struct block_list *coarsen_blocks(struct block_list *blocks, int res) {
+	struct block_list *p, *q;
+
+	for (p = blocks; p != NULL; ) {
+		if (merge_level(p, res, &q) != KEPT)
+			merge_into(p, q);
+		else
+			p = p->next;
+	}
+	return blocks;
+}
+
+#ifndef NO_MAIN
+int main(int argc, char *argv[]) {
+	struct block_list *blocks, *p, *q;
+	struct seg_list *s;
+	int binary, levels = 0, level, n, rs;
+
+	binary = binary_blocks_arg(&argc, argv);
+	if (argc > 1 && same_string(argv[1], "-levels")) {
+		levels = 1;
+		argc--, argv++;
+	}
+	if (argc != 3)
+		fatal("args: [-bin] [-levels] configure-file building-block-list");
+
+	get_spename(argv[1]);
+	get_minlen(argv[1]);
+	blocks = get_block_list(argv[2]);
+	if (levels) {
+		rs = ref_spe_idx();
+		for (n = 1, p = blocks; p != NULL; p = p->next, n++) {
+			s = p->speseg[rs];
+			level = merge_level(p, INT_MAX, &q);
+			if (level == KEPT)
+				printf("%d\t%s:%d-%d\t-\n", n, s->chr, s->beg, s->end);
+			else
+				printf("%d\t%s:%d-%d\t%d\n", n, s->chr, s->beg, s->end, level);
+		}
+	}
+	else {
+		blocks = coarsen_blocks(blocks, Spe->minlen);
+		write_block_list(stdout, blocks, BLOCKS_BUILDING, binary);
+	}
+	if (blocks != NULL)
+		free_block_list(blocks);
+	return 0;
+}
+#endif
@@ -0,0 +1,229 @@
+/* *****************************************************************
+ * compares the adjacencies of a number of runs at once (the
+ * Ancestor.ADJS or Ancestor.joins of reconstructions with other
+ * trees, parameters or builds, over the same blocks), printing two
+ * matrices with a row and a column for each run: the adjacencies two
+ * runs share, and those only one of the two has (the size of a run on
+ * the diagonal of the first, 0 on that of the second)
+ *
+ *   compareAdjs [-threads n] run1/Ancestor.ADJS run2/Ancestor.joins ...
+ *
+ * A line "b1 b2 ..." or "(b1:b2) ..." is the adjacency of the end of
+ * the signed block b1 to the start of b2, 0 a telomere; b1 b2 and -b2
+ * -b1 are the same adjacency. The adjacencies of all the runs go into
+ * one hash, each with the runs that have it; the runs are then bit
+ * columns over the distinct adjacencies, and a pair of runs shares
+ * the popcount of the AND of their columns
+ * ****************************************************************/
+
+#include <stdint.h>
+#include "util.h"
+#include "lines.h"
+#include "workpool.h"
+
+// a distinct adjacency, open addressing; a slot is empty while its a is INT32_MIN
+struct adj {
+	int a, b;
+};
+
+static struct adj *Adjs = NULL;
+static unsigned Adjsz = 0;
+static int Adjnum = 0;
+
+static int Nruns = 0;
+static char **Names = NULL;
+static int *Sizes = NULL;			// distinct adjacencies of a run
+static uint64_t **Cols = NULL;		// of a run, a bit per distinct adjacency
+static int Words = 0;
+static long *Shared = NULL;			// Nruns x Nruns
+
+static unsigned hash_adj(int a, int b) {
+	return ((unsigned)a * 2654435761u) ^ ((unsigned)b * 40503u);
+}
+
+static unsigned find_adj(struct adj *H, unsigned sz, int a, int b) {
+	unsigned k;
+
+	for (k = hash_adj(a, b) & (sz - 1); H[k].a != INT32_MIN; k = (k + 1) & (sz - 1))
+		if (H[k].a == a && H[k].b == b)
+			break;
+	return k;
+}
+
+static void grow_adjs(void) {
+	struct adj *old = Adjs;
+	unsigned k, oldsz = Adjsz;
+
+	Adjsz = oldsz ? 2 * oldsz : 1024;
+	Adjs = ckalloc(Adjsz * sizeof(struct adj));
+	for (k = 0; k < Adjsz; k++)
+		Adjs[k].a = INT32_MIN;
+	for (k = 0; k < oldsz; k++)
+		if (old[k].a != INT32_MIN)
+			Adjs[find_adj(Adjs, Adjsz, old[k].a, old[k].b)] = old[k];
+	free(old);
+}
+
+// adds an adjacency as its reading with the smaller first block
+static struct adj add_adj(int a, int b) {
+	struct adj x;
+	unsigned k;
+
+	if (-b < a || (-b == a && -a < b)) {
+		x.a = -b;
+		x.b = -a;
+	} else {
+		x.a = a;
+		x.b = b;
+	}
+	a = x.a;
+	b = x.b;
+	if (2 * ((unsigned)Adjnum + 1) > Adjsz)
+		grow_adjs();
+	k = find_adj(Adjs, Adjsz, a, b);
+	if (Adjs[k].a == INT32_MIN) {
+		Adjs[k].a = a;
+		Adjs[k].b = b;
+		Adjnum++;
+	}
+	return x;
+}
+
+// the blocks of a line, 0 if it is not an adjacency
+static int read_adj(const char *line, size_t len, int *a, int *b) {
+	struct field f[2];
+	const char *colon;
+
+	if (len > 0 && line[0] == '(') {
+		colon = memchr(line, ':', len);
+		if (colon == NULL)
+			return 0;
+		f[0].s = line + 1;
+		f[0].len = colon - f[0].s;
+		f[1].s = colon + 1;
+		for (f[1].len = 0; f[1].s + f[1].len < line + len && f[1].s[f[1].len] != ')'; f[1].len++)
+			;
+	} else if (split_line(line, len, f, 2) < 2)
+		return 0;
+	return field_int(&f[0], a) && field_int(&f[1], b);
+}
+
+// the adjacencies of each run, until the columns are made (the slots
+// move as the hash grows)
+static struct adj **Runadjs = NULL;
+static int *Nadjs = NULL;
+
+static void read_run(int r) {
+	struct line_reader *lr;
+	const char *line;
+	struct adj *adjs = NULL;
+	size_t len;
+	int a, b, n = 0, max = 0;
+	FILE *fp;
+
+	fp = ckopen_in(Names[r]);
+	lr = open_lines(fp, Names[r]);
+	while ((line = next_line(lr, &len)) != NULL) {
+		if (len == 0 || line[0] == '#' || !read_adj(line, len, &a, &b))
+			continue;
+		if (a == 0 && b == 0)
+			continue;
+		if (n == max) {
+			max = max ? 2 * max : 1024;
+			adjs = ckrealloc(adjs, max * sizeof(struct adj));
+		}
+		adjs[n++] = add_adj(a, b);
+	}
+	close_lines(lr);
+	ckclose_in(fp);
+	Runadjs[r] = adjs;
+	Nadjs[r] = n;
+}
+
+static void count_row(int i, void *arg) {
+	const uint64_t *x = Cols[i], *y;
+	long n;
+	int j, w;
+
+	(void)arg;
+	for (j = i; j < Nruns; j++) {
+		y = Cols[j];
+		for (n = 0, w = 0; w < Words; w++)
+			n += __builtin_popcountll(x[w] & y[w]);
+		Shared[i * Nruns + j] = Shared[j * Nruns + i] = n;
+	}
+}
+
+static void print_matrix(const char *title, int diff) {
+	int i, j;
+	long v;
+
+	printf("# %s\n", title);
+	for (j = 0; j < Nruns; j++)
+		printf("\t%s", Names[j]);
+	putchar('\n');
+	for (i = 0; i < Nruns; i++) {
+		printf("%s", Names[i]);
+		for (j = 0; j < Nruns; j++) {
+			v = Shared[i * Nruns + j];
+			if (diff)
+				v = Sizes[i] + Sizes[j] - 2 * v;
+			printf("\t%ld", v);
+		}
+		putchar('\n');
+	}
+}
+
+int main(int argc, char *argv[]) {
+	struct adj x;
+	unsigned *index;
+	unsigned k;
+	int nthreads = thread_arg(NULL), r, i, n;
+
+	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+		if (same_string(argv[1], "-threads") && argc > 2) {
+			nthreads = thread_arg(argv[2]);
+			argc--, argv++;
+		} else
+			fatalf("unknown option %s", argv[1]);
+	}
+	if (argc < 3)
+		fatal("args: [-threads n] adjacencies1 adjacencies2 ...");
+
+	Nruns = argc - 1;
+	Names = argv + 1;
+	Runadjs = ckallocz(Nruns * sizeof(struct adj *));
+	Nadjs = ckallocz(Nruns * sizeof(int));
+	for (r = 0; r < Nruns; r++)
+		read_run(r);
+
+	// the distinct adjacencies numbered in the order of the hash
+	index = ckalloc(Adjsz * sizeof(unsigned));
+	for (n = 0, k = 0; k < Adjsz; k++)
+		index[k] = (Adjs[k].a != INT32_MIN) ? (unsigned)n++ : 0;
+	Words = (Adjnum + 63) / 64;
+	Cols = ckalloc(Nruns * sizeof(uint64_t *));
+	Sizes = ckallocz(Nruns * sizeof(int));
+	for (r = 0; r < Nruns; r++) {
+		Cols[r] = ckallocz((Words + 1) * sizeof(uint64_t));
+		for (i = 0; i < Nadjs[r]; i++) {
+			x = Runadjs[r][i];
+			n = index[find_adj(Adjs, Adjsz, x.a, x.b)];
+			if (!(Cols[r][n >> 6] & (1ULL << (n & 63)))) {
+				Cols[r][n >> 6] |= 1ULL << (n & 63);
+				Sizes[r]++;
+			}
+		}
+		free(Runadjs[r]);
+	}
+	free(index);
+
+	Shared = ckalloc((size_t)Nruns * Nruns * sizeof(long));
+	run_jobs(Nruns, nthreads, count_row, NULL);
+
+	printf("# %d runs, %d distinct adjacencies\n", Nruns, Adjnum);
+	print_matrix("shared adjacencies", 0);
+	print_matrix("adjacencies in one of the two only", 1);
+
+	return 0;
+}
@@ -1,45 +1,54 @@
 #include "util.h"
 #include "species.h"
+#include "numfmt.h"
 
-static void print_block(int t, struct block_list *b, int id) {
+// "%s.%s:%d-%d %c [%d]\n" of a segment of block id
+static void print_seg(int t, const char *chr, int beg, int end, char orient, int id) {
+	struct text_buf b;
+
+	text_begin(&b, stdout);
+	text_str(&b, Spe->spename[t]);
+	text_char(&b, '.');
+	text_str(&b, chr);
+	text_char(&b, ':');
+	text_int(&b, beg);
+	text_char(&b, '-');
+	text_int(&b, end);
+	text_char(&b, ' ');
+	text_char(&b, orient);
+	text_mem(&b, " [", 2);
+	text_int(&b, id);
+	text_mem(&b, "]\n", 2);
+	text_flush(&b);
+}
+
+static void print_block(int t, struct block_list **index, int maxid, int id) {
 	struct block_list *p;
 	struct seg_list *s, *pr, *r, *q;
 	int orient;
 	
 	orient = (id > 0) ? 1 : 0;
 
-	for (p = b; p != NULL; p = p->next) {
-		if (p->id == abs(id)) {
-			if (t == ref_spe_idx()) {
-				printf("%s.%s:%d-%d", 
-					Spename[t],  p->speseg[t]->chr, 
-					p->speseg[t]->beg, p->speseg[t]->end);
-				if (orient == 1)
-					printf(" + [%d]\n", p->id);
-				else
-					printf(" - [%d]\n", p->id);
-			}
-			else {
-				if (orient  == 0) {
-					pr = NULL;
-					r = p->speseg[t];
-					while (r != NULL) {
-						q = r->next;
-						r->next = pr;
-						pr = r;
-						r = q;
-					}
-					p->speseg[t] = pr;
-				}
-				for (s = p->speseg[t]; s != NULL; s = s->next) {
-					printf("%s.%s:%d-%d", Spename[t], s->chr, s->beg, s->end);
-					if (orient == 1)
-						printf(" %c [%d]\n", s->orient, p->id);
-					else
-						printf(" %c [%d]\n", ORT(s->orient), p->id);
-				}
+	if (abs(id) > maxid || (p = index[abs(id)]) == NULL)
+		return;
+	if (t == ref_spe_idx()) {
+		print_seg(t, p->speseg[t]->chr, p->speseg[t]->beg, p->speseg[t]->end,
+			orient == 1 ? '+' : '-', p->id);
+	}
+	else {
+		if (orient  == 0) {
+			pr = NULL;
+			r = p->speseg[t];
+			while (r != NULL) {
+				q = r->next;
+				r->next = pr;
+				pr = r;
+				r = q;
 			}
-			break;
+			p->speseg[t] = pr;
+		}
+		for (s = p->speseg[t]; s != NULL; s = s->next) {
+			print_seg(t, s->chr, s->beg, s->end, orient == 1 ? s->orient : ORT(s->orient), p->id);
 		}
 	}
 }
@@ -48,8 +57,8 @@ int main (int argc, char* argv[]) {
 	FILE *racfile;
 	char buf[50000];
 	char *pt;
-	struct block_list *blist;
-	int num, i, count = 0, prev = -1;
+	struct block_list *blist, **index;
+	int num, i, count = 0, prev = -1, maxid;
 	int val[MAXORDER];
 	
 	if (argc != 4)
@@ -58,6 +67,7 @@ int main (int argc, char* argv[]) {
 	get_spename(argv[1]);
 	
 	blist = get_block_list(argv[3]);
+	index = index_blocks(blist, &maxid);
 	
 	racfile = ckopen(argv[2], "r");
 	
@@ -68,8 +78,8 @@ int main (int argc, char* argv[]) {
 		if (buf[0] == '\n' || buf[0] == '#' || buf[0] == '>')
 			continue;
 		printf("#%d\n\n", ++count);
-		for (i = 0; i < Spesz; i++) {
-			if (Spetag[i] == 2)
+		for (i = 0; i < Spe->spesz; i++) {
+			if (Spe->spetag[i] == 2)
 				continue;
 			pt = buf;
 			while (sscanf(pt, "%d", &num) == 1) {
@@ -77,7 +87,7 @@ int main (int argc, char* argv[]) {
 					fprintf(stderr, "cannot happen: %d [%d]\n", num, count);
 				else
 					val[abs(num)] = 1;
-				print_block(i, blist, num);
+				print_block(i, index, maxid, num);
 				pt = strchr(pt, ' ');
 				if (pt != NULL)
 					pt++;
@@ -94,6 +104,7 @@ int main (int argc, char* argv[]) {
 
 	fprintf(stderr, "- Totally %d APCFs\n", count);
 	fclose(racfile);
+	free(index);
 	free_block_list(blist);
 	return 0;
 }
@@ -1,12 +1,19 @@
 /* *****************************************************************
- * 1) create Genome file to be used in inferring CARs.
- * 2) generate species.joins files.
+ * 1) create Genome file to be used in inferring CARs, and Genomes.db
+ *    with the same orders (genomedb.h).
+ * 2) generate species.joins files, and Joins.db with the joins of
+ *    all of them (joindb.h).
  * ****************************************************************/
 
 #include "util.h"
 #include "species.h"
+#include "orders.h"
+#include "stages.h"
+#include "joindb.h"
+#include "genomedb.h"
 
-void print_join(FILE *fp, int l, char ol, int r, char or) {
+static void print_join(FILE *fp, struct join_db_writer *db, int spe,
+		int l, char ol, int r, char or) {
 	if (l == r)
 		return;
 	if (ol == '-')
@@ -15,132 +22,97 @@ void print_join(FILE *fp, int l, char ol, int r, char or) {
 	if (or == '-')
 		r = -r;
 	fprintf(fp, "\t%*d\n", 5, r);
+	add_join(db, spe, l, r);
 }
 
-int main(int argc, char* argv[]) {
+void create_genome_file(struct block_list *blkhead, FILE *out) {
 	FILE *jfp;
-	int i, j, count;
+	struct join_db_writer *db;
+	struct genome_db_writer *gdb;
+	int i, j, k, count;
 	char buf[500];
-	struct seg_list ***head;
-	struct seg_list *pp, *p, *q, *sg;
-	struct block_list *blkhead, *bk;
-	int total[MAXSPE];
-	
-	if (argc != 3)
-		fatal("arg: config.file block-list");
+	struct spe_order *o;
+	struct order_seg *p, *q;
+	struct block_list *bk;
 
-	head = malloc(sizeof(struct seg_list**) * MAXSPE);
-	for (j = 0; j < MAXSPE; j++) {
-		total[j] = 0;
-		head[j] = malloc(sizeof(struct seg_list*) * MAXCHR);
-		for (i = 0; i < MAXCHR; i++)
-			head[j][i] = NULL;
-	}
-	get_spename(argv[1]);
-	blkhead = get_block_list(argv[2]);
-
-	for (bk = blkhead; bk != NULL; bk = bk->next) {
-		for (i = 0; i < Spesz; i++) {
-			for (sg = bk->speseg[i]; sg != NULL; sg = sg->next) {
-				for (j = 0; j < total[i]; j++)
-					if (same_string((head[i][j])->chr, sg->chr))
-						break;
-				q = (struct seg_list *)ckalloc(sizeof(struct seg_list));
-				q->cidlist = NULL;
-				q->next = NULL;
-				q->id = sg->id;
-				q->subid = sg->subid;
-				q->beg = sg->beg;
-				q->end = sg->end;
-				q->orient = sg->orient;
-				q->state = sg->state;
-				strcpy(q->chr, sg->chr);
-	
-				if (j == total[i]) {
-					head[i][j] = q;
-					++total[i];
-				}
-				else {
-					pp = NULL;
-					for (p = head[i][j]; p != NULL; p = p->next) {
-						if ((pp == NULL && q->beg < p->beg)
-								|| (pp != NULL && q->beg < p->beg && q->beg > pp->beg))
-							break;
-						pp = p;
-					}
-					if (pp == NULL) {
-						q->next = p;
-						head[i][j] = q;
-					}
-					else {
-						q->next = pp->next;
-						pp->next = q;
-					}
-				}
-			}
-		}
-	}
-	
-	for (i = 0; i < Spesz; i++) {
-		if (Spetag[i] == 2)
+	o = make_orders(blkhead, ORDER_ALL, 0);
+	gdb = open_genome_db_writer();
+	for (i = 0; i < Spe->spesz; i++) {
+		if (Spe->spetag[i] == 2)
 			continue;
-		printf(">%s\t%d\n", Spename[i], total[i]);
-		for (j = 0; j < total[i]; j++) {
-			printf("# %s\n", head[i][j]->chr);
-			for (p = head[i][j]; p != NULL; p = p->next) {
+		fprintf(out, ">%s\t%d\n", Spe->spename[i], o[i].nchr);
+		add_genome(gdb, Spe->spename[i]);
+		for (j = 0; j < o[i].nchr; j++) {
+			fprintf(out, "# %s\n", o[i].chr[j]);
+			add_genome_chrom(gdb, o[i].chr[j]);
+			for (k = o[i].first[j]; k < o[i].first[j+1]; k++) {
+				p = &o[i].seg[k];
 				if (p->orient == '+')
-					printf("%d ", p->id);
+					fprintf(out, "%d ", p->id);
 				else
-					printf("-%d ", p->id);
+					fprintf(out, "-%d ", p->id);
+				add_genome_block(gdb, p->orient == '+' ? p->id : -p->id);
 			}
-			printf("$\n");
+			fprintf(out, "$\n");
 		}
-		printf("\n");
+		fprintf(out, "\n");
 	}
+	write_genome_db(gdb, GENOMEDB_FILE);
 	
 	for (count = 0, bk = blkhead; bk != NULL; bk = bk->next)
 		++count;
 
-	for (i = 0; i < Spesz; i++) {
-		sprintf(buf, "%s.joins", Spename[i]);
+	db = open_join_db_writer();
+	for (i = 0; i < Spe->spesz; i++) {
+		sprintf(buf, "%s.joins", Spe->spename[i]);
 		jfp = ckopen(buf, "w");
 		fprintf(jfp, "#%d\n", count);
-		for (j = 0; j < total[i]; j++) {
-			p = head[i][j];
-			if (p == NULL)
-				continue;
-			if (Spetag[i] != 2)
+		for (j = 0; j < o[i].nchr; j++) {
+			p = &o[i].seg[o[i].first[j]];
+			if (Spe->spetag[i] != 2)
 				if ((p->state == FIRST && p->orient == '+') || p->state == BOTH
 						|| (p->state == LAST && p->orient == '-'))
-					print_join(jfp, 0, '+', p->id, p->orient);
-			for (; p->next != NULL; p = p->next) {
-				q = p->next;
+					print_join(jfp, db, i, 0, '+', p->id, p->orient);
+			for (k = o[i].first[j]; k + 1 < o[i].first[j+1]; k++) {
+				p = &o[i].seg[k];
+				q = p + 1;
 				if (((p->state == FIRST && p->orient == '-') || (p->state == LAST && p->orient == '+'))
 						&& ((q->state == FIRST && q->orient == '+') || (q->state == LAST && q->orient == '-')))
-					print_join(jfp, p->id, p->orient, q->id, q->orient);
+					print_join(jfp, db, i, p->id, p->orient, q->id, q->orient);
 				if (p->state == BOTH && ((q->state == FIRST && q->orient == '+')
 					||(q->state == LAST && q->orient == '-')))
-					print_join(jfp, p->id, p->orient, q->id, q->orient);
+					print_join(jfp, db, i, p->id, p->orient, q->id, q->orient);
 				if (((p->state == FIRST && p->orient == '-') || (p->state == LAST && p->orient == '+'))
 						&& q->state == BOTH)
-					print_join(jfp, p->id, p->orient, q->id, q->orient);
+					print_join(jfp, db, i, p->id, p->orient, q->id, q->orient);
 				if (p->state == BOTH && q->state == BOTH)
-					print_join(jfp, p->id, p->orient, q->id, q->orient);
+					print_join(jfp, db, i, p->id, p->orient, q->id, q->orient);
 			}
-			if (Spetag[i] != 2)
+			p = &o[i].seg[o[i].first[j+1] - 1];
+			if (Spe->spetag[i] != 2)
 				if (p->state == BOTH || (p->state == LAST && p->orient == '+')
 						|| (p->state == FIRST && p->orient == '-'))
-					print_join(jfp, p->id, p->orient, 0, '+');
+					print_join(jfp, db, i, p->id, p->orient, 0, '+');
 		}
 		fclose(jfp);
 	}
+	write_join_db(db, JOINDB_FILE, Spe->spename, Spe->spesz);
 
-	for (i = 0; i < Spesz; i++) {
-		for (j = 0; j < total[i]; j++)
-			free_seg_list(head[i][j]);
-	}
+	free_orders(o);
+}
+
+#ifndef NO_MAIN
+int main(int argc, char* argv[]) {
+	struct block_list *blkhead;
 	
+	if (argc != 3)
+		fatal("arg: config.file block-list");
+
+	get_spename(argv[1]);
+	blkhead = get_block_list(argv[2]);
+	create_genome_file(blkhead, stdout);
 	free_block_list(blkhead);
 
 	return 0;
 }
+#endif
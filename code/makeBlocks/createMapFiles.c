@@ -0,0 +1,184 @@
+/* *****************************************************************
+ * Writes the mapping files of the APCFs, as script/create_mapfile.pl
+ * did: for every species of the config file, <outdir>/APCF_<spc>.map
+ * gives each block of Ancestor.APCF its place in the APCF and the
+ * segments of the species it stands for.
+ *
+ * With -species, only the files of the species listed are written;
+ * that of another can be made alone later, from the same inputs.
+ *
+ * A block takes the length of its first segment in the first species
+ * that has it. The conserved segments are read once, with
+ * get_block_list(), which numbers them in file order as makeBlocks
+ * writes them; the species files are then written on a pool of
+ * threads (see workpool.h).
+ * *****************************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "workpool.h"
+#include "numfmt.h"
+#include <sys/stat.h>
+
+#define OUTBUF (1 << 20)
+
+// a block of an APCF, at [astart, aend] on it
+struct apcf_block {
+	int apcf, bid;
+	long astart, aend;
+};
+
+static struct apcf_block *Blocks;
+static int Nblock;
+static struct block_list **Index;
+static int Maxid;
+static char *Outdir;
+static int *Wanted, Nwanted;	// the species written
+
+static struct block_list *find_block(int bid) {
+	bid = abs(bid);
+	return bid > Maxid ? NULL : Index[bid];
+}
+
+static void add_block(int apcf, int bid, long astart, long aend) {
+	static int cap = 0;
+
+	if (Nblock == cap) {
+		cap = cap ? 2 * cap : 1024;
+		Blocks = ckrealloc(Blocks, cap * sizeof(struct apcf_block));
+	}
+	Blocks[Nblock].apcf = apcf;
+	Blocks[Nblock].bid = bid;
+	Blocks[Nblock].astart = astart;
+	Blocks[Nblock].aend = aend;
+	++Nblock;
+}
+
+// the blocks of the APCFs, in order
+static void read_apcfs(char *fname) {
+	FILE *fp;
+	char *line = NULL, *tok, *next;
+	size_t cap = 0;
+	struct block_list *b;
+	long astart, aend;
+	int apcf = 0, bid, i;
+
+	fp = ckopen(fname, "r");
+	while (getline(&line, &cap, fp) != -1) {
+		if (line[0] == '>')
+			continue;
+		if (sscanf(line, "# APCF %d", &apcf) == 1)
+			continue;
+		astart = aend = 0;
+		// the last one is the '$'
+		tok = strtok(line, " \t\n");
+		while (tok != NULL) {
+			next = strtok(NULL, " \t\n");
+			if (next == NULL)
+				break;
+			bid = atoi(tok);
+			if ((b = find_block(bid)) != NULL)
+				for (i = 0; i < Spe->spesz; i++)
+					if (b->speseg[i] != NULL) {
+						aend = astart + (b->speseg[i]->end - b->speseg[i]->beg);
+						break;
+					}
+			add_block(apcf, bid, astart, aend);
+			astart = aend;
+			tok = next;
+		}
+	}
+	free(line);
+	fclose(fp);
+}
+
+static void print_segs(struct text_buf *t, int s, struct seg_list *sg, int reverse) {
+	if (sg == NULL)
+		return;
+	if (reverse)
+		print_segs(t, s, sg->next, reverse);
+	// "%s.%s:%d-%d %c\n"
+	text_str(t, Spe->spename[s]);
+	text_char(t, '.');
+	text_str(t, sg->chr);
+	text_char(t, ':');
+	text_int(t, sg->beg);
+	text_char(t, '-');
+	text_int(t, sg->end);
+	text_char(t, ' ');
+	text_char(t, reverse ? (sg->orient == '-' ? '+' : '-') : sg->orient);
+	text_char(t, '\n');
+	if (!reverse)
+		print_segs(t, s, sg->next, reverse);
+}
+
+static void write_map(int w, void *arg) {
+	int k, s = Wanted[w];
+	char fname[1000], *buf;
+	struct block_list *b;
+	struct text_buf t;
+	FILE *fp;
+
+	sprintf(fname, "%s/APCF_%s.map", Outdir, Spe->spename[s]);
+	fp = ckopen(fname, "w");
+	buf = ckalloc(OUTBUF);
+	setvbuf(fp, buf, _IOFBF, OUTBUF);
+	text_begin(&t, fp);
+	for (k = 0; k < Nblock; k++) {
+		if ((b = find_block(Blocks[k].bid)) == NULL || b->speseg[s] == NULL)
+			continue;
+		// ">%d\nAPCF.%d:%ld-%ld +\n"
+		text_char(&t, '>');
+		text_int(&t, k + 1);
+		text_mem(&t, "\nAPCF.", 6);
+		text_int(&t, Blocks[k].apcf);
+		text_char(&t, ':');
+		text_int(&t, Blocks[k].astart);
+		text_char(&t, '-');
+		text_int(&t, Blocks[k].aend);
+		text_mem(&t, " +\n", 3);
+		print_segs(&t, s, b->speseg[s], Blocks[k].bid < 0);
+		text_char(&t, '\n');
+	}
+	text_flush(&t);
+	if (fclose(fp) != 0)
+		fatalf("cannot write %s", fname);
+	free(buf);
+	(void)arg;
+}
+
+int main(int argc, char *argv[]) {
+	struct block_list *blist;
+	char *only = NULL;
+	int s;
+
+	if (argc > 2 && same_string(argv[1], "-species")) {
+		only = argv[2];
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc != 5)
+		fatal("args: [-species spc,...] config.file conserved-segs-file apcf-file output-dir");
+
+	get_spename(argv[1]);
+	if (only != NULL)
+		set_only_species(only);
+	Wanted = ckalloc(Spe->spesz * sizeof(int));
+	for (Nwanted = s = 0; s < Spe->spesz; s++)
+		if (only_species(s))
+			Wanted[Nwanted++] = s;
+	blist = get_block_list(argv[2]);
+	Index = index_blocks(blist, &Maxid);
+	read_apcfs(argv[3]);
+	Outdir = argv[4];
+	if (mkdir(Outdir, 0777) != 0 && errno != EEXIST)
+		fatalf("cannot create %s", Outdir);
+
+	run_jobs(Nwanted, default_threads(), write_map, NULL);
+
+	free(Wanted);
+	free(Blocks);
+	free(Index);
+	free_block_list(blist);
+	return 0;
+}
@@ -0,0 +1,34 @@
+/* *****************************************************************
+ * print a binary block list as the text its writer would have made,
+ * or a binary segment stream (raw.segs, processed.segs) as its text
+ * ****************************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "blockfile.h"
+#include "segstream.h"
+
+int main(int argc, char *argv[]) {
+	struct block_list *head;
+	enum block_style style;
+	FILE *fp;
+
+	if (argc != 3)
+		fatal("args: config.file block-list|segments");
+
+	get_spename(argv[1]);
+	if (is_seg_file(argv[2])) {
+		fp = ckopen(argv[2], "r");
+		dump_seg_stream(fp, argv[2], stdout);
+		fclose(fp);
+		return 0;
+	}
+	if (!is_block_file(argv[2]))
+		fatalf("%s is not a binary block list", argv[2]);
+	head = read_block_file(argv[2], &style);
+	write_block_list(stdout, head, style, 0);
+	if (head != NULL)
+		free_block_list(head);
+
+	return 0;
+}
@@ -0,0 +1,258 @@
+/* *****************************************************************
+ * Estimates the breakpoint distance between the reference and each
+ * other species, as the syntenic fragments of the pair less the
+ * chromosomes (or scaffolds) of the species; estparJC.pl reads it.
+ * Every pair goes through the steps of "make pair" from the segments
+ * of grabbing data, with the other species left out of the config
+ * and an outgroup taken as a descendant. The segments are read once,
+ * from the *.processed.segs files when all of them are in the working
+ * directory, else from the nets, and the pairs run on the threads, each
+ * on a config of its own cut down to the pair (see species.h).
+ *
+ * Prints "#species\tnum" and a line per species, the ingroups first,
+ * in the order of the config file; with -species only for those.
+ * ****************************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "blockfile.h"
+#include "orders.h"
+#include "stages.h"
+#include "workpool.h"
+
+// a species' processed segments in memory, or its file when buf is NULL
+struct segtext {
+	char *buf;
+	size_t len;
+};
+
+static FILE *open_text(struct segtext *t) {
+	FILE *fp;
+
+	if (t->len == 0)
+		return ckopen("/dev/null", "r");
+	if ((fp = fmemopen(t->buf, t->len, "r")) == NULL)
+		fatal("fmemopen failed");
+	return fp;
+}
+
+static int have_processed_segs(int rs) {
+	char fname[200];
+	int ss;
+
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (ss == rs || !only_species(ss))
+			continue;
+		sprintf(fname, "%s.processed.segs", Spe->spename[ss]);
+		if (access(fname, R_OK) != 0)
+			return 0;
+	}
+	return 1;
+}
+
+// grabbing data, the processed segments kept in memory
+static void grab_data(struct segtext *segs, int rs, int nthreads) {
+	FILE **raw, **processed;
+	char **rawbuf;
+	size_t *rawlen;
+	int ss;
+
+	raw = ckallocz(Spe->spesz * sizeof(FILE *));
+	processed = ckallocz(Spe->spesz * sizeof(FILE *));
+	rawbuf = ckallocz(Spe->spesz * sizeof(char *));
+	rawlen = ckallocz(Spe->spesz * sizeof(size_t));
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (ss == rs)
+			continue;
+		if ((raw[ss] = open_memstream(&rawbuf[ss], &rawlen[ss])) == NULL
+				|| (processed[ss] = open_memstream(&segs[ss].buf, &segs[ss].len)) == NULL)
+			fatal("open_memstream failed");
+	}
+	if (read_nets(raw, nthreads) < 0)
+		fatal("cannot read the nets");
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (ss == rs)
+			continue;
+		fclose(raw[ss]);
+		raw[ss] = open_text(&(struct segtext){rawbuf[ss], rawlen[ss]});
+	}
+	get_segments(raw, processed, nthreads);
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (ss == rs)
+			continue;
+		fclose(raw[ss]);
+		free(rawbuf[ss]);
+		fclose(processed[ss]);
+	}
+	free(raw);
+	free(processed);
+	free(rawbuf);
+	free(rawlen);
+}
+
+// the config of "make pair" for the reference and species tar
+static struct spe_config *pair_config(const struct spe_config *c, int rs, int tar) {
+	struct spe_config *p = copy_spe_config(c);
+	int i, n;
+
+	for (i = n = p->chrassmz = 0; i < c->spesz; i++) {
+		if (i != rs && i != tar)
+			continue;
+		strcpy(p->spename[n], c->spename[i]);
+		p->spetag[n] = (i == tar) ? 1 : 0;
+		p->spechrassm[n] = c->spechrassm[i];
+		if (p->spechrassm[n] > p->chrassmz)
+			p->chrassmz = p->spechrassm[n];
+		n++;
+	}
+	p->spesz = n;
+	return p;
+}
+
+static FILE *open_order(char **buf, size_t *len) {
+	FILE *fp;
+
+	*buf = NULL;
+	*len = 0;
+	if ((fp = open_memstream(buf, len)) == NULL)
+		fatal("open_memstream failed");
+	return fp;
+}
+
+static FILE *reopen_order(FILE *fp, char *buf, size_t len) {
+	fclose(fp);
+	return open_text(&(struct segtext){buf, len});
+}
+
+/* the steps of "make pair" for the reference and species tar, as in
+ * makeBlocks -pair; the distance as estimate_bpdist4.pl took it from
+ * Genomes.Order: the largest id to end a reference chromosome, signed
+ * by its orientation, less the chromosomes of tar */
+static int pair_distance(struct segtext *segs, int rs, int tar) {
+	FILE *processed[2], *fp;
+	struct block_list *blocks;
+	struct spe_order *o;
+	struct order_seg *p;
+	char *buf;
+	size_t len;
+	int i, j, id, maxid;
+
+	for (i = 0; i < 2; i++)
+		processed[i] = NULL;
+	if (segs[tar].buf != NULL)
+		processed[rs < tar] = open_text(&segs[tar]);
+
+	blocks = partition_genomes(processed, 1);
+	if (processed[rs < tar] != NULL)
+		fclose(processed[rs < tar]);
+	reread_block_list(blocks, BLOCKS_BUILDING);
+	blocks = make_orthology_blocks_pair(blocks);
+	reread_block_list(blocks, BLOCKS_ORTHOLOGY);
+
+	fp = open_order(&buf, &len);
+	ortho_blocks_to_orders(blocks, fp);
+	fp = reopen_order(fp, buf, len);
+	blocks = make_conserved_segments(blocks, fp);
+	fclose(fp);
+	free(buf);
+	reread_block_list(blocks, BLOCKS_CONSERVED);
+
+	fp = open_order(&buf, &len);
+	outgroup_segs_to_orders(blocks, fp);
+	fp = reopen_order(fp, buf, len);
+	blocks = clean_outgroup_segs(blocks, fp);
+	fclose(fp);
+	free(buf);
+	reread_block_list(blocks, BLOCKS_CLEANED);
+	reread_block_list(blocks, BLOCKS_PLAIN);
+
+	o = make_orders(blocks, ORDER_ALL, 0);
+	i = (rs < tar) ? 0 : 1;
+	for (maxid = j = 0; j < o[i].nchr; j++) {
+		p = &o[i].seg[o[i].first[j+1] - 1];
+		id = (p->orient == '-') ? -p->id : p->id;
+		if (id > maxid)
+			maxid = id;
+	}
+	maxid -= o[1 - i].nchr;
+	free_orders(o);
+	if (blocks != NULL)
+		free_block_list(blocks);
+	return maxid;
+}
+
+struct pairs {
+	struct spe_config *config;
+	struct segtext *segs;
+	int rs, *tars, *dist;
+};
+
+static void pair_job(int k, void *arg) {
+	struct pairs *pr = arg;
+	struct spe_config *c;
+	int tar = pr->tars[k];
+
+	c = pair_config(pr->config, pr->rs, tar);
+	use_spe_config(c);
+	pr->dist[tar] = pair_distance(pr->segs, pr->rs, tar);
+	use_spe_config(NULL);
+	free(c);
+}
+
+int main(int argc, char *argv[]) {
+	struct segtext *segs;
+	struct pairs pr;
+	char *only = NULL;
+	int *dist, *tars;
+	int nthreads, ntars, rs, ss, k;
+
+	if (argc > 2 && same_string(argv[1], "-species")) {
+		only = argv[2];
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc != 2 && argc != 3)
+		fatal("args: [-species spc,...] config.file [threads]");
+	nthreads = thread_arg(argc == 3 ? argv[2] : NULL);
+
+	get_spename(argv[1]);
+	if (only != NULL)
+		set_only_species(only);
+	get_netdir(argv[1]);
+	get_chaindir(argv[1]);
+	get_minlen(argv[1]);
+	get_subset(argv[1]);
+	rs = ref_spe_idx();
+
+	segs = ckallocz(Spe->spesz * sizeof(struct segtext));
+	if (!have_processed_segs(rs))
+		grab_data(segs, rs, nthreads);
+
+	// the ingroups, then the outgroups
+	tars = ckalloc(Spe->spesz * sizeof(int));
+	for (ntars = ss = 0; ss < Spe->spesz; ss++)
+		if (Spe->spetag[ss] == 1 && only_species(ss))
+			tars[ntars++] = ss;
+	for (ss = 0; ss < Spe->spesz; ss++)
+		if (Spe->spetag[ss] == 2 && only_species(ss))
+			tars[ntars++] = ss;
+
+	dist = ckalloc(Spe->spesz * sizeof(int));
+	pr.config = Spe;
+	pr.segs = segs;
+	pr.rs = rs;
+	pr.tars = tars;
+	pr.dist = dist;
+	run_jobs(ntars, nthreads, pair_job, &pr);
+
+	printf("#species\tnum\n");
+	for (k = 0; k < ntars; k++)
+		printf("%s\t%d\n", Spe->spename[tars[k]], dist[tars[k]]);
+
+	for (ss = 0; ss < Spe->spesz; ss++)
+		free(segs[ss].buf);
+	free(segs);
+	free(tars);
+	free(dist);
+	return 0;
+}
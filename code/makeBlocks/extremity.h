@@ -0,0 +1,64 @@
+/* **************************************************************
+ * The one encoding of block ends and adjacencies for the indexes and
+ * binary formats that the tools and the scripts share. A block end is
+ * signed as in the .joins files and the orders: b is block b read
+ * forward, -b backward, and 0 a chromosome end (a telomere). Its
+ * extremity id is 2*b for b, 2*b+1 for -b and END_TEL for 0, so the
+ * ends of the blocks 1..n index a dense array of END_IDS(n) entries.
+ * An adjacency x y is the 64-bit pair of the ids, x's in the high
+ * half; adj_canon() gives x y and its other reading -y -x one key.
+ * lib/perl/DschIndex.pm has the same, end_id(), adj_key() and the
+ * rest, for the scripts. Nothing here uses the rest of makeBlocks.
+ * **************************************************************/
+
+#ifndef _EXTREMITY_H_
+#define _EXTREMITY_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define END_TEL		0	// the id of a chromosome end; 1 is no end
+#define END_IDS(n)	(2 * (n) + 2)	// the ids of the ends of blocks 1..n
+
+static inline uint32_t end_id(int x)
+{
+	return (x == 0) ? END_TEL : (x > 0) ? 2 * (uint32_t)x : 2 * (uint32_t)-x + 1;
+}
+
+// the signed block end of an id
+static inline int id_end(uint32_t e)
+{
+	return (e < 2) ? 0 : (e & 1) ? -(int)(e >> 1) : (int)(e >> 1);
+}
+
+static inline uint64_t adj_key(int x, int y)
+{
+	return (uint64_t)end_id(x) << 32 | end_id(y);
+}
+
+static inline int adj_first(uint64_t k)
+{
+	return id_end((uint32_t)(k >> 32));
+}
+
+static inline int adj_second(uint64_t k)
+{
+	return id_end((uint32_t)k);
+}
+
+// the key of x y and -y -x, the smaller of theirs
+static inline uint64_t adj_canon(int x, int y)
+{
+	uint64_t a = adj_key(x, y), b = adj_key(-y, -x);
+
+	return (a < b) ? a : b;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
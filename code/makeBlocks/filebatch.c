@@ -0,0 +1,445 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "filebatch.h"
+#include "trace.h"
+
+#define RING_DEPTH	64	// files in flight on the ring
+
+enum {BF_WAIT, BF_BUSY, BF_READY, BF_TAKEN};
+enum {OP_OPEN, OP_READ, OP_CLOSE};
+
+struct batch_file {
+	char *path;			// NULL to skip
+	char *buf;			// once READY, NULL if left to the reader
+	size_t len;
+	int state, op, fd;
+	bool failed;
+};
+
+struct file_batch {
+	struct batch_file *f;
+	int n, depth;
+	int next;			// the next file to read
+	int want;			// the last file asked for
+	bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int *slot;			// open addressing over the paths, -1 empty
+	unsigned nslot;
+	pthread_t *threads;
+	int nthreads;
+	struct file_batch *nextb;
+};
+
+static struct file_batch *Batches = NULL;
+static pthread_mutex_t BatchLock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned hash_path(const char *s)
+{
+	unsigned h = 2166136261u;
+
+	for (; *s; s++)
+		h = (h ^ (unsigned char)*s) * 16777619u;
+	return h;
+}
+
+/* claim ------------- the next file to read; -1 at the end, or if it may not yet */
+static int claim(struct file_batch *b, bool wait)
+{
+	int i;
+
+	pthread_mutex_lock(&b->lock);
+	for (;;) {
+		while (b->next < b->n && b->f[b->next].path == NULL) {
+			b->f[b->next].state = BF_READY;
+			b->next++;
+		}
+		if (b->stop || b->next >= b->n) {
+			i = -1;
+			break;
+		}
+		if (b->next < b->want + b->depth) {
+			i = b->next++;
+			b->f[i].state = BF_BUSY;
+			break;
+		}
+		if (!wait) {
+			i = -1;
+			break;
+		}
+		pthread_cond_wait(&b->cond, &b->lock);
+	}
+	if (i < 0)
+		pthread_cond_broadcast(&b->cond);
+	pthread_mutex_unlock(&b->lock);
+	return i;
+}
+
+/* finish ------------ hand a file to its reader; a compressed one is left to it */
+static void finish(struct file_batch *b, int i, char *buf, size_t len)
+{
+	const unsigned char *m = (const unsigned char *)buf;
+
+	if (buf != NULL && len >= 2 && ((m[0] == 0x1f && m[1] == 0x8b)
+			|| (len >= 4 && m[0] == 0x28 && m[1] == 0xb5 && m[2] == 0x2f && m[3] == 0xfd))) {
+		free(buf);
+		buf = NULL;
+	}
+	if (buf != NULL) {
+		buf = ckrealloc(buf, len + 1);
+		COUNT(batch_files, 1);
+	} else
+		COUNT(batch_misses, 1);
+	pthread_mutex_lock(&b->lock);
+	b->f[i].buf = buf;
+	b->f[i].len = len;
+	b->f[i].state = BF_READY;
+	pthread_cond_broadcast(&b->cond);
+	pthread_mutex_unlock(&b->lock);
+}
+
+/* read_small --------------- the bytes of a file of at most BATCH_SMALL; NULL if not */
+static char *read_small(const char *path, size_t *len)
+{
+	char *buf;
+	ssize_t k;
+	int fd;
+
+	*len = 0;
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return NULL;
+	buf = ckalloc(BATCH_SMALL);
+	while ((k = read(fd, buf + *len, BATCH_SMALL - *len)) > 0)
+		if ((*len += k) == BATCH_SMALL)
+			break;
+	close(fd);
+	if (k < 0 || *len == BATCH_SMALL) {
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+static void *pool_reader(void *arg)
+{
+	struct file_batch *b = arg;
+	size_t len;
+	char *buf;
+	int i;
+
+	while ((i = claim(b, 1)) >= 0) {
+		buf = read_small(b->f[i].path, &len);
+		finish(b, i, buf, len);
+	}
+	return NULL;
+}
+
+/* the ring of a batch, set up without liburing */
+struct ring {
+	int fd;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq, *cq;
+	size_t sqlen, cqlen, sqeslen;
+	unsigned queued;
+	struct file_batch *b;
+};
+
+static void ring_free(struct ring *r)
+{
+	if (r->sqes != NULL && r->sqes != MAP_FAILED)
+		munmap(r->sqes, r->sqeslen);
+	if (r->cq != NULL && r->cq != MAP_FAILED && r->cq != r->sq)
+		munmap(r->cq, r->cqlen);
+	if (r->sq != NULL && r->sq != MAP_FAILED)
+		munmap(r->sq, r->sqlen);
+	close(r->fd);
+}
+
+/* ring_init -------- a ring with opens, reads and closes; 0 if the kernel has none */
+static bool ring_init(struct ring *r, unsigned entries)
+{
+	struct io_uring_params p;
+	struct io_uring_probe *probe;
+	size_t plen = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+	const char *env = getenv("DESCHRAMBLER_URING");
+	bool ok;
+
+	memset(r, 0, sizeof(*r));
+	memset(&p, 0, sizeof(p));
+	if ((env != NULL && same_string(env, "0"))
+		|| (r->fd = syscall(__NR_io_uring_setup, entries, &p)) < 0)
+		return 0;
+	probe = ckallocz(plen);
+	ok = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) >= 0
+		&& probe->last_op >= IORING_OP_CLOSE && probe->last_op >= IORING_OP_READ
+		&& (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+		&& (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+		&& (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+	if (!ok) {
+		close(r->fd);
+		return 0;
+	}
+	r->sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->sqlen = r->cqlen = MAX(r->sqlen, r->cqlen);
+	r->sq = mmap(NULL, r->sqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		r->fd, IORING_OFF_SQ_RING);
+	r->cq = (p.features & IORING_FEAT_SINGLE_MMAP) ? r->sq : mmap(NULL, r->cqlen,
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	r->sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		r->fd, IORING_OFF_SQES);
+	if (r->sq == MAP_FAILED || r->cq == MAP_FAILED || r->sqes == MAP_FAILED) {
+		ring_free(r);
+		return 0;
+	}
+	r->sq_tail = (unsigned *)((char *)r->sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *)((char *)r->sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)((char *)r->sq + p.sq_off.array);
+	r->cq_head = (unsigned *)((char *)r->cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)((char *)r->cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *)((char *)r->cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)((char *)r->cq + p.cq_off.cqes);
+	return 1;
+}
+
+/* queue_op ---------------------------- the next operation on file i of b */
+static void queue_op(struct ring *r, struct file_batch *b, int i, int op, size_t off)
+{
+	struct batch_file *f = &b->f[i];
+	unsigned tail = *r->sq_tail, k = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[k];
+
+	memset(sqe, 0, sizeof(*sqe));
+	f->op = op;
+	switch (op) {
+	case OP_OPEN:
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)f->path;
+		sqe->open_flags = O_RDONLY | O_CLOEXEC;
+		break;
+	case OP_READ:
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = f->fd;
+		sqe->addr = (uintptr_t)(f->buf + off);
+		sqe->len = BATCH_SMALL - off;
+		sqe->off = off;
+		break;
+	default:
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = f->fd;
+		break;
+	}
+	sqe->user_data = i;
+	r->sq_array[k] = k;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->queued++;
+}
+
+/* done_op ------------- what follows an operation; 1 once the file is finished */
+static bool done_op(struct ring *r, struct file_batch *b, int i, int res)
+{
+	struct batch_file *f = &b->f[i];
+
+	switch (f->op) {
+	case OP_OPEN:
+		if (res < 0) {
+			finish(b, i, NULL, 0);
+			return 1;
+		}
+		f->fd = res;
+		f->buf = ckalloc(BATCH_SMALL);
+		f->len = 0;
+		queue_op(r, b, i, OP_READ, 0);
+		return 0;
+	case OP_READ:
+		// a short read is read on from where it stopped, up to the end
+		if (res > 0 && (f->len += res) < BATCH_SMALL)
+			queue_op(r, b, i, OP_READ, f->len);
+		else {
+			f->failed = res < 0 || f->len == BATCH_SMALL;
+			queue_op(r, b, i, OP_CLOSE, 0);
+		}
+		return 0;
+	default:
+		if (f->failed) {
+			free(f->buf);
+			f->buf = NULL;
+		}
+		finish(b, i, f->buf, f->len);
+		return 1;
+	}
+}
+
+/* ring_reader ---------------- keep RING_DEPTH files of the batch in flight */
+static void ring_reader(struct file_batch *b, struct ring *r)
+{
+	struct io_uring_cqe *cqe;
+	unsigned head, tail;
+	int i, inflight = 0;
+
+	for (;;) {
+		while (inflight < RING_DEPTH && (i = claim(b, inflight == 0)) >= 0) {
+			queue_op(r, b, i, OP_OPEN, 0);
+			inflight++;
+		}
+		if (inflight == 0)
+			break;
+		if (syscall(__NR_io_uring_enter, r->fd, r->queued, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+			if (errno == EINTR)
+				continue;
+			fatalf("io_uring_enter: %s", strerror(errno));
+		}
+		r->queued = 0;
+		head = *r->cq_head;
+		tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			cqe = &r->cqes[head & *r->cq_mask];
+			if (done_op(r, b, (int)cqe->user_data, cqe->res))
+				inflight--;
+		}
+		__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+static void *ring_thread(void *arg)
+{
+	struct ring *r = arg;
+
+	ring_reader(r->b, r);
+	ring_free(r);
+	free(r);
+	return NULL;
+}
+
+/* open_file_batch -------------------------- start reading the files ahead */
+struct file_batch *open_file_batch(const char **paths, int n, int depth, int nthreads)
+{
+	struct file_batch *b = ckallocz(sizeof(struct file_batch));
+	struct ring *r;
+	unsigned k;
+	int i;
+
+	b->n = n;
+	b->depth = MAX(depth, 1);
+	b->f = ckallocz((n + 1) * sizeof(struct batch_file));
+	for (b->nslot = 1024; b->nslot < 2 * (unsigned)n; b->nslot *= 2)
+		;
+	b->slot = ckalloc(b->nslot * sizeof(int));
+	memset(b->slot, 0xff, b->nslot * sizeof(int));
+	for (i = 0; i < n; i++) {
+		if (paths[i] == NULL)
+			continue;
+		b->f[i].path = copy_string(paths[i]);
+		for (k = hash_path(paths[i]) & (b->nslot - 1); b->slot[k] >= 0; k = (k + 1) & (b->nslot - 1))
+			;
+		b->slot[k] = i;
+	}
+	pthread_mutex_init(&b->lock, NULL);
+	pthread_cond_init(&b->cond, NULL);
+
+	r = ckalloc(sizeof(struct ring));
+	if (ring_init(r, RING_DEPTH)) {
+		r->b = b;
+		b->threads = ckalloc(sizeof(pthread_t));
+		if (pthread_create(&b->threads[0], NULL, ring_thread, r) != 0)
+			fatal("cannot create thread");
+		b->nthreads = 1;
+	} else {
+		free(r);
+		// a reader of the pool waits on the file system, not on a processor
+		nthreads = MIN(4 * MAX(nthreads, 2), RING_DEPTH);
+		b->threads = ckalloc(nthreads * sizeof(pthread_t));
+		for (b->nthreads = 0; b->nthreads < nthreads; b->nthreads++)
+			if (pthread_create(&b->threads[b->nthreads], NULL, pool_reader, b) != 0)
+				fatal("cannot create thread");
+	}
+
+	pthread_mutex_lock(&BatchLock);
+	b->nextb = Batches;
+	Batches = b;
+	pthread_mutex_unlock(&BatchLock);
+	return b;
+}
+
+/* close_file_batch ------------------------ stop the readers and free the rest */
+void close_file_batch(struct file_batch *b)
+{
+	struct file_batch **bp;
+	int i;
+
+	pthread_mutex_lock(&BatchLock);
+	for (bp = &Batches; *bp != b; bp = &(*bp)->nextb)
+		;
+	*bp = b->nextb;
+	pthread_mutex_unlock(&BatchLock);
+
+	pthread_mutex_lock(&b->lock);
+	b->stop = 1;
+	pthread_cond_broadcast(&b->cond);
+	pthread_mutex_unlock(&b->lock);
+	for (i = 0; i < b->nthreads; i++)
+		pthread_join(b->threads[i], NULL);
+	for (i = 0; i < b->n; i++) {
+		free(b->f[i].path);
+		if (b->f[i].state == BF_READY)
+			free(b->f[i].buf);
+	}
+	pthread_mutex_destroy(&b->lock);
+	pthread_cond_destroy(&b->cond);
+	free(b->threads);
+	free(b->slot);
+	free(b->f);
+	free(b);
+}
+
+/* take_batched ------------------- the bytes of a file of a batch, once read */
+char *take_batched(const char *path, size_t *len)
+{
+	struct file_batch *b;
+	struct batch_file *f;
+	char *buf = NULL;
+	unsigned k;
+	int i;
+
+	pthread_mutex_lock(&BatchLock);
+	for (b = Batches; b != NULL; b = b->nextb) {
+		for (k = hash_path(path) & (b->nslot - 1); (i = b->slot[k]) >= 0; k = (k + 1) & (b->nslot - 1))
+			if (same_string(b->f[i].path, path))
+				break;
+		if (i >= 0)
+			break;
+	}
+	pthread_mutex_unlock(&BatchLock);
+	if (b == NULL)
+		return NULL;
+
+	f = &b->f[i];
+	pthread_mutex_lock(&b->lock);
+	if (i > b->want) {
+		b->want = i;
+		pthread_cond_broadcast(&b->cond);
+	}
+	while (f->state != BF_READY && f->state != BF_TAKEN && !(b->stop && f->state == BF_WAIT))
+		pthread_cond_wait(&b->cond, &b->lock);
+	if (f->state == BF_READY) {
+		buf = f->buf;
+		*len = f->len;
+		f->state = BF_TAKEN;
+	}
+	pthread_mutex_unlock(&b->lock);
+	return buf;
+}
@@ -0,0 +1,45 @@
+/* **************************************************************
+ * Reading many small files ahead of their readers. A directory of
+ * scaffold-level nets or chains holds tens of thousands of files of
+ * a few kilobytes each, and opening and reading them one after the
+ * other leaves a network file system idle between the requests.
+ * A batch is given the paths a tool is about to open in that order
+ * and reads them on a thread of its own, keeping many opens and
+ * reads in flight at once through io_uring, or where the kernel has
+ * none (or DESCHRAMBLER_URING=0) on a pool of threads. A reader then
+ * takes the bytes of a file instead of opening it: open_chrom() does
+ * so for every path of a batch. A file is read whole only up to
+ * BATCH_SMALL bytes; one that is larger, compressed, missing or
+ * unreadable is left to the reader, which opens it as before.
+ * **************************************************************/
+
+#ifndef _FILEBATCH_H_
+#define _FILEBATCH_H_
+
+#include "util.h"
+
+#define BATCH_SMALL	(256 << 10)
+// files read ahead of the last one asked for
+#define BATCH_DEPTH	1024
+
+struct file_batch;
+
+/* **************************************************************
+ * Starts reading paths[0..n-1], of which a NULL one is skipped, in
+ * that order and at most depth files beyond the last one asked
+ * for; nthreads is the size of the pool without io_uring. The
+ * paths are copied.
+ * **************************************************************/
+struct file_batch *open_file_batch(const char **paths, int n, int depth, int nthreads);
+
+// stops the reading and frees the files no reader took
+void close_file_batch(struct file_batch *b);
+
+/* **************************************************************
+ * The bytes of path if it is in an open batch, once they are read;
+ * the caller frees them. NULL for a path of no batch, one taken
+ * already, or one the batch could not read whole.
+ * **************************************************************/
+char *take_batched(const char *path, size_t *len);
+
+#endif
@@ -0,0 +1,473 @@
+/* *****************************************************************
+ * The steps around join_splits that only need the blocks of the
+ * APCFs, in one tool:
+ *
+ *   finishApcfs -missing config.file conserved-segs-file apcf-file
+ *     copies the APCFs and adds every block of the reference none of
+ *     them has, as an APCF of its own (script/add_missing_blocks.pl).
+ *
+ *   finishApcfs -split config.file SF-dir apcf-file out-apcf-file splits-file [threads]
+ *     splits the APCFs at their weak adjacencies, those no ingroup has
+ *     or one ingroup and no outgroup, from the Joins.db of the SFs, and
+ *     writes the adjacencies split to splits-file
+ *     (script/split_weak_joins.pl).
+ *
+ *   finishApcfs config.file conserved-segs-file SF-dir apcf-file joins-file
+ *     prints the APCFs longest first, by the reference length of their
+ *     blocks (script/sort_apcfs.pl), and writes the species and score
+ *     of every adjacency of them to joins-file as it goes
+ *     (script/ext_join_info.pl), from the Joins.db and
+ *     block_consscores.txt of the SFs.
+ *
+ * The reference is the species of the config file with tag 0. The
+ * conserved segments are read with get_block_list(), text or binary,
+ * which numbers them in file order as makeBlocks writes them.
+ * *****************************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "joindb.h"
+#include "workpool.h"
+#include <stdint.h>
+
+// an APCF line, with the reference length of its blocks
+struct apcf {
+	char *line;
+	long long len;
+	int seq;
+};
+
+// block_consscores.txt: score text by adjacency, open addressing
+struct score_slot {
+	uint64_t key;
+	char *score;	// NULL while empty
+};
+
+static struct score_slot *Scores;
+static uint64_t Nslot;
+
+static inline uint64_t pair_key(int a, int b) {
+	return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+}
+
+static uint64_t slot_of(uint64_t key) {
+	uint64_t h = key * 0x9e3779b97f4a7c15ULL;
+	uint64_t i = (h >> 17) & (Nslot - 1);
+
+	while (Scores[i].score != NULL && Scores[i].key != key)
+		i = (i + 1) & (Nslot - 1);
+	return i;
+}
+
+static void set_score(int a, int b, char *score) {
+	uint64_t i = slot_of(pair_key(a, b));
+
+	Scores[i].key = pair_key(a, b);
+	Scores[i].score = score;
+}
+
+static const char *get_score(int a, int b) {
+	return Scores[slot_of(pair_key(a, b))].score;
+}
+
+// the later of two lines of the same adjacency wins, as in a perl hash
+static void read_scores(char *fname) {
+	FILE *fp;
+	char *line = NULL, *t1, *t2, *t3;
+	size_t cap = 0;
+	long n = 0;
+	int a, b;
+
+	fp = ckopen(fname, "r");
+	while (getline(&line, &cap, fp) != -1)
+		++n;
+	for (Nslot = 1024; Nslot < 4 * (uint64_t)n; Nslot *= 2)
+		;
+	Scores = ckallocz(Nslot * sizeof(struct score_slot));
+	rewind(fp);
+	while (getline(&line, &cap, fp) != -1) {
+		if ((t1 = strtok(line, " \t\n")) == NULL || (t2 = strtok(NULL, " \t\n")) == NULL)
+			continue;
+		if ((t3 = strtok(NULL, " \t\n")) == NULL)
+			t3 = "";
+		a = atoi(t1);
+		b = atoi(t2);
+		t3 = copy_string(t3);
+		set_score(a, b, t3);
+		set_score(-b, -a, t3);
+	}
+	free(line);
+	fclose(fp);
+}
+
+static int ref_idx(void) {
+	int i;
+
+	for (i = 0; i < Spe->spesz; i++)
+		if (Spe->spetag[i] == 0)
+			return i;
+	fatal("no reference species in the config file");
+}
+
+// the blocks of a line, without its '$'; the line is left as it was
+static int line_blocks(const char *line, int **bids, int *cap) {
+	const char *p = line;
+	char *end;
+	int n = 0;
+	long v;
+
+	for (;;) {
+		while (isspace((unsigned char)*p))
+			++p;
+		if (*p == '\0')
+			break;
+		v = strtol(p, &end, 10);
+		if (end == p) {
+			// a token that is not a number counts as block 0
+			while (*end != '\0' && !isspace((unsigned char)*end))
+				++end;
+			v = 0;
+		}
+		if (n == *cap) {
+			*cap = *cap ? 2 * *cap : 256;
+			*bids = ckrealloc(*bids, *cap * sizeof(int));
+		}
+		(*bids)[n++] = (int)v;
+		p = end;
+	}
+	return n > 0 ? n - 1 : 0;
+}
+
+static void add_missing(char *seg_f, char *apcf_f) {
+	struct block_list *blist, *b;
+	uint64_t *used;
+	char *line = NULL;
+	size_t cap = 0;
+	int *bids = NULL, bcap = 0, nblock = 0, apcfid = 0, ref, id, n, i;
+	FILE *fp;
+
+	ref = ref_idx();
+	blist = get_block_list(seg_f);
+	for (b = blist; b != NULL; b = b->next)
+		if (b->speseg[ref] != NULL && b->id > nblock)
+			nblock = b->id;
+	used = ckallocz((nblock / 64 + 1) * sizeof(uint64_t));
+
+	fp = ckopen(apcf_f, "r");
+	while (getline(&line, &cap, fp) != -1) {
+		fputs(line, stdout);
+		if (line[strlen(line) - 1] != '\n')
+			putchar('\n');
+		if (line[0] == '>')
+			continue;
+		if (line[0] == '#') {
+			if (sscanf(line, "# APCF %d", &id) == 1 && id > apcfid)
+				apcfid = id;
+			continue;
+		}
+		n = line_blocks(line, &bids, &bcap);
+		for (i = 0; i < n; i++)
+			if (abs(bids[i]) <= nblock)
+				used[abs(bids[i]) / 64] |= (uint64_t)1 << (abs(bids[i]) % 64);
+	}
+	fclose(fp);
+
+	for (id = 1; id <= nblock; id++)
+		if (!(used[id / 64] >> (id % 64) & 1))
+			printf("# APCF %d\n%d $\n", ++apcfid, id);
+
+	free(line);
+	free(bids);
+	free(used);
+	free_block_list(blist);
+}
+
+static int apcf_cmp(const void *a, const void *b) {
+	const struct apcf *p = a, *q = b;
+
+	if (p->len != q->len)
+		return p->len > q->len ? -1 : 1;
+	// in the order they were read
+	return p->seq - q->seq;
+}
+
+// the Joins.db of the SFs, and the masks of the ingroups and outgroups
+static struct join_db *open_masks(char *sf_dir, uint64_t *inmask, uint64_t *outmask) {
+	struct join_db *db;
+	char fname[1000];
+	int s, k;
+
+	sprintf(fname, "%s/%s", sf_dir, JOINDB_FILE);
+	db = open_join_db(fname);
+	*inmask = *outmask = 0;
+	for (s = 0; s < Spe->spesz; s++) {
+		if ((k = join_db_spe(db, Spe->spename[s])) < 0)
+			fatalf("no joins for %s in %s", Spe->spename[s], fname);
+		if (k != s)
+			fatalf("%s: the species are not those of the config file", fname);
+		if (Spe->spetag[s] == 2)
+			*outmask |= (uint64_t)1 << s;
+		else
+			*inmask |= (uint64_t)1 << s;
+	}
+	return db;
+}
+
+static void print_joins(FILE *fp, struct join_db *db, uint64_t inmask, uint64_t outmask,
+		int *bids, int n) {
+	const char *score;
+	uint64_t m;
+	int i, s, first;
+
+	for (i = 0; i + 1 < n; i++) {
+		m = join_mask(db, bids[i], bids[i+1]);
+		score = get_score(bids[i], bids[i+1]);
+		fprintf(fp, "(%d:%d)\t%s\t%d\t%d\t", bids[i], bids[i+1], score ? score : "",
+			__builtin_popcountll(m & inmask), __builtin_popcountll(m & outmask));
+		for (first = 1, s = 0; s < Spe->spesz; s++)
+			if ((m & inmask) >> s & 1) {
+				fprintf(fp, "%s%s", first ? "" : ",", Spe->spename[s]);
+				first = 0;
+			}
+		fputc('\t', fp);
+		for (first = 1, s = 0; s < Spe->spesz; s++)
+			if ((m & outmask) >> s & 1) {
+				fprintf(fp, "%s%s", first ? "" : ",", Spe->spename[s]);
+				first = 0;
+			}
+		fputc('\n', fp);
+	}
+}
+
+static void sort_apcfs(char *seg_f, char *sf_dir, char *apcf_f, char *joins_f) {
+	struct block_list *blist, *b;
+	struct apcf *apcfs = NULL;
+	struct seg_list *sg;
+	struct join_db *db;
+	long long *len;
+	char *line = NULL, *top = NULL, fname[1000];
+	size_t cap = 0, l;
+	int *bids = NULL, bcap = 0, maxid, napcf = 0, acap = 0, ref, n, i, k, bi;
+	uint64_t inmask = 0, outmask = 0;
+	FILE *fp, *jfp;
+
+	// a block is as long as the last of its reference segments
+	ref = ref_idx();
+	blist = get_block_list(seg_f);
+	for (maxid = 0, b = blist; b != NULL; b = b->next)
+		maxid = MAX(maxid, b->id);
+	len = ckallocz((maxid + 1) * sizeof(long long));
+	for (b = blist; b != NULL; b = b->next)
+		for (sg = b->speseg[ref]; sg != NULL; sg = sg->next)
+			len[b->id] = sg->end - sg->beg;
+
+	fp = ckopen(apcf_f, "r");
+	while (getline(&line, &cap, fp) != -1) {
+		if ((l = strlen(line)) > 0 && line[l-1] == '\n')
+			line[--l] = '\0';
+		if (line[0] == '#')
+			continue;
+		if (line[0] == '>') {
+			free(top);
+			top = copy_string(line);
+			continue;
+		}
+		if (napcf == acap) {
+			acap = acap ? 2 * acap : 1024;
+			apcfs = ckrealloc(apcfs, acap * sizeof(struct apcf));
+		}
+		apcfs[napcf].line = copy_string(line);
+		apcfs[napcf].len = 0;
+		apcfs[napcf].seq = napcf;
+		n = line_blocks(line, &bids, &bcap);
+		for (i = 0; i < n; i++)
+			if ((bi = abs(bids[i])) <= maxid)
+				apcfs[napcf].len += len[bi];
+		++napcf;
+	}
+	fclose(fp);
+	qsort(apcfs, napcf, sizeof(struct apcf), apcf_cmp);
+
+	db = open_masks(sf_dir, &inmask, &outmask);
+	sprintf(fname, "%s/block_consscores.txt", sf_dir);
+	read_scores(fname);
+
+	jfp = ckopen(joins_f, "w");
+	printf("%s\n", top ? top : "");
+	for (k = 0; k < napcf; k++) {
+		printf("# APCF %d\n%s\n", k + 1, apcfs[k].line);
+		n = line_blocks(apcfs[k].line, &bids, &bcap);
+		print_joins(jfp, db, inmask, outmask, bids, n);
+		free(apcfs[k].line);
+	}
+	if (fclose(jfp) != 0)
+		fatalf("cannot write %s", joins_f);
+
+	close_join_db(db);
+	free(apcfs);
+	free(top);
+	free(line);
+	free(bids);
+	free(len);
+	free_block_list(blist);
+}
+
+// an APCF line of split_weak, in fields as split(/\s+/) makes them, and
+// the fields after which it is split; a '>' line has no fields
+struct weak_line {
+	char *line, *copy;
+	char **tok;
+	int ntok, nsplit;
+	int *split, *incnt, *outcnt;
+};
+
+struct weak_arg {
+	struct weak_line *lines;
+	struct join_db *db;
+	uint64_t inmask, outmask;
+};
+
+// the fields of a line in place, with the empty first one of a line that
+// starts with a blank and without the last one (its '$')
+static void weak_fields(struct weak_line *w) {
+	char *p = w->copy;
+	int cap = 0;
+
+	w->ntok = 0;
+	while (*p != '\0') {
+		if (w->ntok == cap) {
+			cap = cap ? 2 * cap : 64;
+			w->tok = ckrealloc(w->tok, cap * sizeof(char *));
+		}
+		w->tok[w->ntok++] = p;
+		while (*p != '\0' && !isspace((unsigned char)*p))
+			++p;
+		if (*p == '\0')
+			break;
+		*p++ = '\0';
+		while (isspace((unsigned char)*p))
+			++p;
+	}
+	// a line of blanks has no fields at all
+	if (w->ntok == 1 && w->tok[0][0] == '\0')
+		w->ntok = 0;
+	if (w->ntok > 0)
+		w->ntok--;
+}
+
+static void weak_lines(long lo, long hi, void *arg) {
+	struct weak_arg *a = arg;
+	struct weak_line *w;
+	uint64_t m;
+	int i, in, out, cap;
+	long k;
+
+	for (k = lo; k < hi; k++) {
+		w = &a->lines[k];
+		if (w->line[0] == '>')
+			continue;
+		w->copy = copy_string(w->line);
+		weak_fields(w);
+		for (cap = 0, i = 0; i + 1 < w->ntok; i++) {
+			m = join_mask(a->db, atoi(w->tok[i]), atoi(w->tok[i+1]));
+			in = __builtin_popcountll(m & a->inmask);
+			out = __builtin_popcountll(m & a->outmask);
+			if (in > 1 || (in == 1 && out > 0))
+				continue;
+			if (w->nsplit == cap) {
+				cap = cap ? 2 * cap : 16;
+				w->split = ckrealloc(w->split, cap * sizeof(int));
+				w->incnt = ckrealloc(w->incnt, cap * sizeof(int));
+				w->outcnt = ckrealloc(w->outcnt, cap * sizeof(int));
+			}
+			w->split[w->nsplit] = i + 1;
+			w->incnt[w->nsplit] = in;
+			w->outcnt[w->nsplit++] = out;
+		}
+	}
+}
+
+/* script/split_weak_joins.pl: splits the APCFs at every adjacency no
+ * ingroup has, or only one ingroup and no outgroup, writing the pieces
+ * numbered anew to out_f and the adjacencies split to split_f. The lines
+ * are worked on by the threads and written in order */
+static void split_weak(char *sf_dir, char *apcf_f, char *out_f, char *split_f, int nthreads) {
+	struct weak_line *lines = NULL, *w;
+	struct weak_arg a;
+	char *line = NULL;
+	size_t cap = 0, l;
+	int nline = 0, lcap = 0, newid = 1, i, j, psp;
+	FILE *fp, *out, *sp;
+
+	fp = ckopen(apcf_f, "r");
+	while (getline(&line, &cap, fp) != -1) {
+		if ((l = strlen(line)) > 0 && line[l-1] == '\n')
+			line[--l] = '\0';
+		if (line[0] == '#')
+			continue;
+		if (nline == lcap) {
+			lcap = lcap ? 2 * lcap : 1024;
+			lines = ckrealloc(lines, lcap * sizeof(struct weak_line));
+		}
+		memset(&lines[nline], 0, sizeof(struct weak_line));
+		lines[nline++].line = copy_string(line);
+	}
+	fclose(fp);
+	free(line);
+
+	a.lines = lines;
+	a.db = open_masks(sf_dir, &a.inmask, &a.outmask);
+	parallel_for(nline, 256, nthreads, weak_lines, &a);
+
+	out = ckopen(out_f, "w");
+	sp = ckopen(split_f, "w");
+	fprintf(sp, "#bid1\tbid2\tingroup_cnt\toutgroup_cnt\n");
+	for (i = 0; i < nline; i++) {
+		w = &lines[i];
+		if (w->line[0] == '>')
+			fprintf(out, "%s\n", w->line);
+		else if (w->nsplit == 0)
+			fprintf(out, "# APCF %d\n%s\n", newid++, w->line);
+		else {
+			for (j = 0; j < w->nsplit; j++)
+				fprintf(sp, "%s\t%s\t%d\t%d\n", w->tok[w->split[j]-1], w->tok[w->split[j]],
+					w->incnt[j], w->outcnt[j]);
+			for (psp = 0, j = 0; j <= w->nsplit; j++) {
+				fprintf(out, "# APCF %d\n", newid++);
+				for (; psp < (j < w->nsplit ? w->split[j] : w->ntok); psp++)
+					fprintf(out, "%s ", w->tok[psp]);
+				fprintf(out, "$\n");
+			}
+		}
+		free(w->line);
+		free(w->copy);
+		free(w->tok);
+		free(w->split);
+		free(w->incnt);
+		free(w->outcnt);
+	}
+	if (fclose(out) != 0)
+		fatalf("cannot write %s", out_f);
+	if (fclose(sp) != 0)
+		fatalf("cannot write %s", split_f);
+
+	close_join_db(a.db);
+	free(lines);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc == 5 && strcmp(argv[1], "-missing") == 0) {
+		get_spename(argv[2]);
+		add_missing(argv[3], argv[4]);
+	} else if ((argc == 7 || argc == 8) && strcmp(argv[1], "-split") == 0) {
+		get_spename(argv[2]);
+		split_weak(argv[3], argv[4], argv[5], argv[6], thread_arg(argc == 8 ? argv[7] : NULL));
+	} else if (argc == 6) {
+		get_spename(argv[1]);
+		sort_apcfs(argv[2], argv[3], argv[4], argv[5]);
+	} else
+		fatal("args: -missing config.file conserved-segs-file apcf-file\n"
+			"      -split config.file SF-dir apcf-file out-apcf-file splits-file [threads]\n"
+			"      config.file conserved-segs-file SF-dir apcf-file joins-file");
+	return 0;
+}
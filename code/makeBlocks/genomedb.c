@@ -0,0 +1,167 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "genomedb.h"
+
+static const char Magic[8] = "DSCHGO1";
+
+struct genomedb_header {
+	char magic[8];
+	int32_t ngenome, nchrom, norder, namelen;
+};
+
+struct genome_db_writer {
+	int32_t *gfirst, *cfirst, *order;
+	int ngenome, nchrom, norder, maxgenome, maxchrom, maxorder;
+	char *names;			// the genome names, kept apart from
+	char *chroms;			// the chromosome names until written
+	size_t namelen, chromlen, maxname, maxchromlen;
+};
+
+struct genome_db_writer *open_genome_db_writer(void) {
+	return ckallocz(sizeof(struct genome_db_writer));
+}
+
+static void add_name(char **buf, size_t *len, size_t *max, const char *name) {
+	size_t n = strlen(name) + 1;
+
+	if (*len + n > *max) {
+		*max = MAX(2 * *max, *len + n + 1024);
+		*buf = ckrealloc(*buf, *max);
+	}
+	memcpy(*buf + *len, name, n);
+	*len += n;
+}
+
+void add_genome(struct genome_db_writer *w, const char *name) {
+	if (w->ngenome + 1 >= w->maxgenome) {
+		w->maxgenome = w->maxgenome ? 2 * w->maxgenome : 16;
+		w->gfirst = ckrealloc(w->gfirst, w->maxgenome * sizeof(int32_t));
+	}
+	w->gfirst[w->ngenome++] = w->nchrom;
+	add_name(&w->names, &w->namelen, &w->maxname, name);
+}
+
+void add_genome_chrom(struct genome_db_writer *w, const char *name) {
+	if (w->ngenome == 0)
+		fatal("add_genome_chrom: no genome");
+	if (w->nchrom + 1 >= w->maxchrom) {
+		w->maxchrom = w->maxchrom ? 2 * w->maxchrom : 256;
+		w->cfirst = ckrealloc(w->cfirst, w->maxchrom * sizeof(int32_t));
+	}
+	w->cfirst[w->nchrom++] = w->norder;
+	add_name(&w->chroms, &w->chromlen, &w->maxchromlen, name);
+}
+
+void add_genome_block(struct genome_db_writer *w, int id) {
+	if (w->nchrom == 0)
+		fatal("add_genome_block: no chromosome");
+	if (w->norder == w->maxorder) {
+		w->maxorder = w->maxorder ? 2 * w->maxorder : 4096;
+		w->order = ckrealloc(w->order, w->maxorder * sizeof(int32_t));
+	}
+	w->order[w->norder++] = id;
+}
+
+void write_genome_db(struct genome_db_writer *w, const char *fname) {
+	struct genomedb_header h;
+	int32_t end;
+	FILE *fp;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, Magic, sizeof(Magic));
+	h.ngenome = w->ngenome;
+	h.nchrom = w->nchrom;
+	h.norder = w->norder;
+	h.namelen = w->namelen + w->chromlen;
+
+	fp = ckopen(fname, "w");
+	fwrite(&h, sizeof(h), 1, fp);
+	fwrite(w->gfirst, sizeof(int32_t), w->ngenome, fp);
+	end = w->nchrom;
+	fwrite(&end, sizeof(int32_t), 1, fp);
+	fwrite(w->cfirst, sizeof(int32_t), w->nchrom, fp);
+	end = w->norder;
+	fwrite(&end, sizeof(int32_t), 1, fp);
+	fwrite(w->order, sizeof(int32_t), w->norder, fp);
+	fwrite(w->names, 1, w->namelen, fp);
+	fwrite(w->chroms, 1, w->chromlen, fp);
+	if (fclose(fp) != 0)
+		fatalf("cannot write %s", fname);
+
+	free(w->gfirst);
+	free(w->cfirst);
+	free(w->order);
+	free(w->names);
+	free(w->chroms);
+	free(w);
+}
+
+struct genome_db *open_genome_db(const char *fname) {
+	const struct genomedb_header *h;
+	struct genome_db *db;
+	struct stat st;
+	uint64_t need;
+	const char *p;
+	int fd, i;
+
+	if ((fd = open(fname, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct genomedb_header)) {
+		close(fd);
+		return NULL;
+	}
+	db = ckallocz(sizeof(struct genome_db));
+	db->size = st.st_size;
+	db->image = mmap(NULL, db->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (db->image == MAP_FAILED)
+		fatalf("cannot map %s", fname);
+
+	h = (const struct genomedb_header *)db->image;
+	if (memcmp(h->magic, Magic, sizeof(Magic)) != 0) {
+		munmap(db->image, db->size);
+		free(db);
+		return NULL;
+	}
+	need = sizeof(*h) + ((uint64_t)h->ngenome + h->nchrom + h->norder + 2) * sizeof(int32_t)
+		+ h->namelen;
+	if (h->ngenome < 0 || h->nchrom < 0 || h->norder < 0 || need != (uint64_t)st.st_size
+		|| (h->namelen > 0 && db->image[st.st_size-1] != '\0'))
+		fatalf("%s: truncated or damaged genome database", fname);
+	db->ngenome = h->ngenome;
+	db->nchrom = h->nchrom;
+	db->norder = h->norder;
+	db->gfirst = (const int32_t *)(h + 1);
+	db->cfirst = db->gfirst + h->ngenome + 1;
+	db->order = db->cfirst + h->nchrom + 1;
+	if (db->gfirst[db->ngenome] != db->nchrom || db->cfirst[db->nchrom] != db->norder)
+		fatalf("%s: damaged genome database", fname);
+
+	db->name = ckalloc((h->ngenome + h->nchrom + 1) * sizeof(char *));
+	db->chrom = db->name + h->ngenome;
+	p = (const char *)(db->order + h->norder);
+	for (i = 0; i < h->ngenome + h->nchrom; i++) {
+		if (p >= db->image + db->size)
+			fatalf("%s: damaged genome database", fname);
+		db->name[i] = p;
+		p += strlen(p) + 1;
+	}
+	return db;
+}
+
+void close_genome_db(struct genome_db *db) {
+	munmap(db->image, db->size);
+	free(db->name);
+	free(db);
+}
+
+int genome_db_spe(const struct genome_db *db, const char *name) {
+	int i;
+
+	for (i = 0; i < db->ngenome; i++)
+		if (strcmp(db->name[i], name) == 0)
+			return i;
+	return -1;
+}
@@ -0,0 +1,62 @@
+/* **************************************************************
+ * The genome orders of Genomes.Order in one binary file, Genomes.db,
+ * written by createGenomeFile next to it: the genomes in the order
+ * of the text, the chromosomes of each, and the signed block ids of
+ * each chromosome, all in one array.
+ *
+ *   header (magic "DSCHGO1", genomes, chromosomes, block ids, names)
+ *   first chromosome of genome g at gfirst[g], int32[genomes + 1]
+ *   first block id of chromosome c at cfirst[c], int32[chromosomes + 1]
+ *   block ids, int32[block ids]
+ *   genome names, then chromosome names, each ending with '\0'
+ *
+ * The file is read through mmap; script/GenomeDB.pm reads the same
+ * layout.
+ * **************************************************************/
+
+#ifndef _GENOMEDB_H_
+#define _GENOMEDB_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GENOMEDB_FILE "Genomes.db"
+
+struct genome_db_writer;
+
+struct genome_db_writer *open_genome_db_writer(void);
+// starts the next genome, then the next chromosome of it
+void add_genome(struct genome_db_writer *w, const char *name);
+void add_genome_chrom(struct genome_db_writer *w, const char *name);
+// the next block id of the chromosome, negative if reversed
+void add_genome_block(struct genome_db_writer *w, int id);
+// writes the genomes and frees the writer
+void write_genome_db(struct genome_db_writer *w, const char *fname);
+
+struct genome_db {
+	int ngenome, nchrom, norder;
+	const char **name;		// the genomes
+	const char **chrom;		// the chromosomes of all the genomes
+	const int32_t *gfirst;	// first chromosome of a genome
+	const int32_t *cfirst;	// first block id of a chromosome
+	const int32_t *order;
+	char *image;
+	size_t size;
+};
+
+// NULL if fname cannot be opened or holds something else; a damaged
+// database is fatal
+struct genome_db *open_genome_db(const char *fname);
+void close_genome_db(struct genome_db *db);
+
+// index of the first genome of that name, -1 if there is none
+int genome_db_spe(const struct genome_db *db, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
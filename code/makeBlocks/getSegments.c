@@ -1,201 +1,144 @@
 /* *************************************************************
  * This program reads raw.segs generated by readNets. It then
  * segments them into pieces that will be used in partionGenomes
- * procedure.
+ * procedure (segprocess.h). The lines below a level-0 fill only
+ * break the segments of that fill, so those before it are written
+ * out and freed as it starts: a species holds one fill's segments
+ * at a time, and the species are processed on threads of their own.
+ * readNets -fused does the same as it reads the nets.
  * ************************************************************/
 
 #include "util.h"
 #include "species.h"
+#include "stages.h"
+#include "segcache.h"
+#include "segstream.h"
+#include "segprocess.h"
+#include "workpool.h"
+#include <sys/stat.h>
 
 #define SUFFIX	"raw.segs"
 #define SUFFIX2	"processed.segs"
 
-struct my_seg_list {
-	char fchr[50], schr[50];
-	int fbeg, fend, sbeg, send;
-	int cid;
-	char orient;
-	struct my_seg_list *next;
+/* the raw.segs of species ss are those cached: read_nets() gave the
+ * stream, or the file is the size of the cached one. Those of a
+ * multiple alignment (mafsegs.h) are not cached */
+static int raw_cached(FILE **raw, int ss, const char *segfile) {
+	off_t size = Spe->maf[0] != '\0' ? -1 : seg_cache_size(ss, seg_cache_kind(SEGS_RAW, Binary_segs));
+	struct stat st;
+
+	if (size < 0)
+		return 0;
+	return raw[ss] != NULL || (stat(segfile, &st) == 0 && st.st_size == size);
+}
+
+struct species_jobs {
+	FILE **raw, **processed;
+	int ss[MAXSPE];
 };
 
-void free_my_seg_list(struct my_seg_list *sgl) {
-	struct my_seg_list *p, *q;
-	p = sgl;
-	for (;;) {
-		q = p->next;
-		free(p);
-		if (q == NULL)
-			break;
-		else
-			p = q;
-	}
+static void species_job(int k, void *arg) {
+	struct species_jobs *j = arg;
+
+	get_species_segments(j->raw, j->processed, j->ss[k]);
 }
 
-int main(int argc, char* argv[]) {
-	FILE *pf, *of;
-	char buf[500], prev[50], fub[500], segfile[200], outfile[200];
-	char gapchrom[50], fchrom[50], schrom[50];
-	struct my_seg_list *slist, *plast, *p, *r, *q, *prp;
-	int level, tobreak, fgapbeg, fgapend, sgapbeg, sgapend, b1, e1, b2, e2, rs, ss;
-	char type, gaporient, ori;
+// the species share nothing but the config, so each is one job
+void get_segments(FILE **raw, FILE **processed, int nthreads) {
+	struct species_jobs j;
+	int rs = ref_spe_idx(), ss, n = 0;
 
-	if (argc != 2)
-		fatal("arg: configure-file");
+	j.raw = raw;
+	j.processed = processed;
+	for (ss = 1; ss < Spe->spesz; ss++)
+		if (ss != rs && only_species(ss))
+			j.ss[n++] = ss;
+	run_jobs(n, nthreads, species_job, &j);
+}
+
+void get_species_segments(FILE **raw, FILE **processed, int ss) {
+	FILE *pf, *of;
+	char segfile[200], outfile[200];
+	const char *kind = seg_cache_kind(SEGS_PROCESSED, Binary_segs);
+	struct seg_processor *sp;
+	struct seg_reader *sr;
+	struct seg_writer *out, *cache = NULL;
+	struct seg_line s;
+	struct seg_entry e;
+	int cached, rs;
 
-	get_spename(argv[1]);
 	rs = ref_spe_idx();
-	
-	for (ss = 1; ss < Spesz; ss++) {
-		if (ss == rs)
-			continue;
-		slist = p = plast = r = prp = NULL;
-		prev[0] = '\0';
-		tobreak = 0;
-		sprintf(segfile, "%s.%s", Spename[ss], SUFFIX);
-		fprintf(stderr, "- processing %s\n", segfile);
-		pf = ckopen(segfile, "r");
-		sprintf(outfile, "%s.%s", Spename[ss], SUFFIX2);
-		of = ckopen(outfile, "w");
-	
-		while (fgets(buf, 500, pf)) {
-			sscanf(buf, "%d %c %*s", &level, &type);
-			if (level == 0 && type == 's') {
-				// no need to break and insert, just append to the list
-				p = (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list));
-				p->next = NULL;
-				if (sscanf(buf, "%*d %*c %*[^.].%[^:]:%d-%d %*[^.].%[^:]:%d-%d %c %d",
-						   p->fchr, &(p->fbeg), &(p->fend),
-						   p->schr, &(p->sbeg), &(p->send), 
-						   &(p->orient), &(p->cid))  != 8)
-					fatalf("cannot parse: %s", buf);
-				if (slist == NULL)
-					slist = plast = p;
-				else {
-					while (plast->next != NULL)
-						plast = plast->next;
-					plast->next = p;
-					plast = p;
-				}
-			} 
-			else {
-				// see how to break
-				if (type == 's') {
-					p = (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list));
-					if (sscanf(buf, "%*d s %*[^.].%[^:]:%d-%d %*[^.].%[^:]:%d-%d %c %d %[^\n]",
-							   p->fchr, &(p->fbeg), &(p->fend),
-							   p->schr, &(p->sbeg), &(p->send), &(p->orient), &(p->cid), fub) != 9)
-						fatalf("cannot parse: %s", buf);
-					if (!same_string(fub, "[NP]") && 
-						sscanf(fub, "[%d %d %s %d %d %c]", 
-									&fgapbeg, &fgapend, gapchrom,
-									&sgapbeg, &sgapend, &gaporient) != 6)
-						fatalf("cannot parse: %s", buf);
-					// look for the position to insert the seg
-					tobreak = 0;
-					for (q = plast, prp = NULL; q != NULL; q = q->next) {
-						if (same_string(p->fchr, q->fchr) 
-								&& p->fbeg >= q->fbeg && p->fend <= q->fend) {
-							tobreak = 1;
-							break;
-						}
-						if (prp != NULL && same_string(p->fchr, q->fchr)
-								&& p->fbeg >= prp->fend && p->fend <= q->fbeg) {
-							tobreak = 0;
-							break;
-						}
-						prp = q;
-					}
-					if (tobreak == 1) {
-						// q -> p -> r
-						r = (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list));
-						p->next = r;
-						r->next = q->next;
-						q->next = p;
-						r->fend = q->fend;
-						q->fend = fgapbeg;
-						r->fbeg = fgapend;
-						strcpy(r->fchr, q->fchr);
-						strcpy(r->schr, q->schr);
-						r->cid = q->cid;
-						r->orient = q->orient;
-						if (q->orient == '+') {
-							r->send = q->send;
-							q->send = sgapbeg;
-							r->sbeg = sgapend;
-						} 
-						else {
-							r->sbeg = q->sbeg;
-							q->sbeg = sgapend;
-							r->send = sgapbeg;
-						}
-					} 
-					else { // tobreak == 0
-						if (prp) {
-							p->next = prp->next;
-							prp->next = p;
-						}
-						else {
-							prp = p;
-						}
-					}	
-				}
-				else { // type == 'g'
-					tobreak = 0;
-					if (sscanf(buf, "%*d g %*[^.].%[^:]:%d-%d %*[^.].%[^:]:%d-%d %c",
-								fchrom, &b1, &e1, schrom, &b2, &e2, &ori) != 7)
-						fatalf("cannot parse: %s", buf);
-					for (q = plast, prp = NULL; q != NULL; q = q->next) {
-						if (same_string(fchrom, q->fchr) && b1 >= q->fbeg && e1 <= q->fend) {
-							tobreak = 1;
-							break;
-						}
-						if (prp != NULL && same_string(fchrom, q->fchr)
-								&& b1 >= prp->fend && e1 <= q->fbeg ) {
-							tobreak = 0;
-							break;
-						}
-						prp = q;
-					}
-					if (tobreak == 1 && same_string(q->schr, schrom)) {
-						// q -> r
-						r = (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list)); 
-						r->next = q->next;
-						q->next = r;
-						r->fend = q->fend; 
-						q->fend = b1; 
-						r->fbeg = e1; 
-						strcpy(r->fchr, q->fchr); 
-						strcpy(r->schr, q->schr); 
-						r->orient = q->orient; 
-						r->cid = q->cid;
-						if (q->orient == '+') { 
-							r->send = q->send;
-							q->send = b2; 
-							r->sbeg = e2; 
-						}
-						else { 
-							r->sbeg = q->sbeg;
-							q->sbeg = e2;
-							r->send = b2;
-						} 
-					}
-				}
-			}
-		}
-	
-		fclose(pf);
-
-		for (p = slist; p != NULL; p = p->next) {
-			if (!same_string(p->fchr, prev))
-				fprintf(of, "#\n");
-			strcpy(prev, p->fchr);
-			fprintf(of, "%s.%s:%d-%d %s.%s:%d-%d %c %d\n",
-				   Spename[rs], p->fchr, p->fbeg, p->fend,
-				   Spename[ss], p->schr, p->sbeg, p->send, p->orient, p->cid);
+	sprintf(segfile, "%s.%s", Spe->spename[ss], SUFFIX);
+	sprintf(outfile, "%s.%s", Spe->spename[ss], SUFFIX2);
+	of = (processed[ss] != NULL) ? processed[ss] : ckopen_out(outfile);
+	// the segments made from the cached raw.segs are cached with them
+	cached = raw_cached(raw, ss, segfile);
+	if (cached && seg_cache_copy(ss, kind, of)) {
+		if (of != processed[ss])
+			ckclose_out(of);
+		return;
+	}
+	fprintf(stderr, "- processing %s\n", segfile);
+	pf = (raw[ss] != NULL) ? raw[ss] : ckopen_in(segfile);
+	sr = open_seg_reader(pf, SEGS_RAW, segfile);
+	out = open_seg_writer(of, SEGS_PROCESSED, rs, ss, Binary_segs);
+	if (cached && seg_cache_begin(ss, kind, &e))
+		cache = open_seg_writer(e.fp, SEGS_PROCESSED, rs, ss, Binary_segs);
+	sp = open_seg_processor(out, cache);
+
+	while (read_seg_line(sr, &s))
+		process_seg_line(sp, &s);
+	close_seg_reader(sr);
+	if (pf != raw[ss])
+		ckclose_in(pf);
+
+	close_seg_processor(sp);
+	close_seg_writer(out);
+	if (cache != NULL) {
+		close_seg_writer(cache);
+		seg_cache_end(&e, 1);
+	}
+
+	if (of != processed[ss])
+		ckclose_out(of);
+}
+
+#ifndef NO_MAIN
+int main(int argc, char* argv[]) {
+	FILE **raw, **processed;
+	char *only = NULL;
+	int nthreads;
+
+	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+		if (same_string(argv[1], "-text"))
+			Binary_segs = 0;
+		else if (same_string(argv[1], "-species") && argc > 2) {
+			only = argv[2];
+			argc--;
+			argv++;
 		}
+		else
+			break;
+	}
+	if (argc != 2 && argc != 3)
+		fatal("arg: [-text] [-species spc,...] configure-file [threads]");
+	nthreads = thread_arg(argc == 3 ? argv[2] : NULL);
 
-		free_my_seg_list(slist);
+	get_spename(argv[1]);
+	if (only != NULL)
+		set_only_species(only);
+	// the cache of the segments is keyed by the nets they are made from
+	if (getenv("DESCHRAMBLER_SEGCACHE") != NULL) {
+		get_netdir(argv[1]);
+		get_minlen(argv[1]);
+		get_subset(argv[1]);
 	}
+	raw = ckallocz(Spe->spesz * sizeof(FILE *));
+	processed = ckallocz(Spe->spesz * sizeof(FILE *));
+	get_segments(raw, processed, nthreads);
+	free(raw);
+	free(processed);
 	
 	return 0;
 }
+#endif
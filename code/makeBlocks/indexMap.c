@@ -0,0 +1,259 @@
+/* *****************************************************************
+ * Compresses an APCF mapping file (APCF_<spc>.map or .merged.map)
+ * into <file>.gz with an index, <file>.gz.idx, for finding the
+ * records of a region of an ancestor without reading all of them:
+ *
+ *   indexMap map-file
+ *   indexMap -q map-file.gz APCF.3:1000000-2000000 [region ...]
+ *
+ * The .gz is in the BGZF form of bgzip, a series of gzip members of
+ * 64 KB at most, so gzip -dc and zcat read it whole. A record (the
+ * ">id" line and those up to the next one) is never split between
+ * members. The index has a line for every run of records of an APCF
+ * within one member: the APCF, the first and last ancestral position
+ * of the run, its virtual offset (the offset of its member in the
+ * file times 65536, plus its offset within the member, as in tabix)
+ * and the number of records. A query reads the index and inflates
+ * only the members of the runs that overlap the region; a region of
+ * only an APCF name gives all its records.
+ * *****************************************************************/
+
+#include "util.h"
+#include <stdint.h>
+#include <zlib.h>
+
+#define BLOCK_DATA	0xff00		// the data of a member, as bgzip takes it
+#define BLOCK_MAX	65536
+#define HEADER		18
+#define FOOTER		8
+
+struct run {
+	char apcf[100];
+	long beg, end;
+	uint64_t voff;
+	int n;
+};
+
+/* the empty member bgzip ends a file with */
+static const unsigned char Eof[28] = {
+	0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 0x06, 0, 0x42, 0x43, 0x02, 0,
+	0x1b, 0, 0x03, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static void put16(unsigned char *p, unsigned v) {
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+	put16(p, v & 0xffff);
+	put16(p + 2, v >> 16);
+}
+
+/* deflate one member of len bytes of data to fp; returns its size */
+static size_t write_member(FILE *fp, const char *data, size_t len) {
+	unsigned char out[BLOCK_MAX];
+	z_stream z;
+	int level, ret;
+	size_t size;
+
+	// data that does not shrink enough is stored
+	for (level = Z_DEFAULT_COMPRESSION; ; level = Z_NO_COMPRESSION) {
+		memset(&z, 0, sizeof(z));
+		if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			fatal("deflateInit2 failed");
+		z.next_in = (unsigned char *)data;
+		z.avail_in = len;
+		z.next_out = out + HEADER;
+		z.avail_out = BLOCK_MAX - HEADER - FOOTER;
+		ret = deflate(&z, Z_FINISH);
+		size = HEADER + z.total_out + FOOTER;
+		deflateEnd(&z);
+		if (ret == Z_STREAM_END)
+			break;
+		if (level == Z_NO_COMPRESSION)
+			fatal("cannot compress a block");
+	}
+	memcpy(out, Eof, HEADER);
+	put16(out + 16, size - 1);
+	put32(out + size - 8, crc32(crc32(0, NULL, 0), (const unsigned char *)data, len));
+	put32(out + size - 4, len);
+	if (fwrite(out, 1, size, fp) != size)
+		fatal("cannot write the compressed file");
+	return size;
+}
+
+/* record_apcf -- the APCF and the positions of a record, from "APCF.3:100-200 +" */
+static int record_apcf(const char *rec, size_t len, char *apcf, long *beg, long *end) {
+	const char *p = memchr(rec, '\n', len), *q;
+	char line[300];
+
+	// sscanf() would take the length of all the data after the line
+	if (rec[0] != '>' || p == NULL)
+		return 0;
+	p++;
+	q = memchr(p, '\n', rec + len - p);
+	len = MIN((size_t)((q ? q : rec + len) - p), sizeof(line) - 1);
+	memcpy(line, p, len);
+	line[len] = '\0';
+	return sscanf(line, "%99[^:]:%ld-%ld", apcf, beg, end) == 3;
+}
+
+/* the length of the record at off, up to the next '>' line or the end */
+static size_t record_len(const char *data, size_t off, size_t size) {
+	const char *p = data + off, *end = data + size;
+
+	while ((p = memchr(p, '\n', end - p)) != NULL && ++p < end)
+		if (*p == '>')
+			return p - data - off;
+	return size - off;
+}
+
+static void put_run(FILE *idx, struct run *r) {
+	if (r->n > 0)
+		fprintf(idx, "%s\t%ld\t%ld\t%llu\t%d\n", r->apcf, r->beg, r->end,
+			(unsigned long long)r->voff, r->n);
+	r->n = 0;
+}
+
+static char *read_file(const char *name, size_t *len) {
+	FILE *fp = ckopen(name, "r");
+	size_t cap = 1 << 20, k;
+	char *buf = ckalloc(cap);
+
+	*len = 0;
+	while ((k = fread(buf + *len, 1, cap - *len, fp)) > 0)
+		if ((*len += k) == cap)
+			buf = ckrealloc(buf, cap *= 2);
+	if (ferror(fp))
+		fatalf("cannot read %s", name);
+	fclose(fp);
+	return buf;
+}
+
+static void compress_map(const char *mapfile) {
+	char gzfile[600], idxfile[700], apcf[100];
+	char *data, *block = ckalloc(BLOCK_DATA);
+	size_t size, used = 0, off, len;
+	uint64_t coff = 0;
+	struct run r;
+	long beg, end;
+	FILE *gz, *idx;
+
+	snprintf(gzfile, sizeof(gzfile), "%s.gz", mapfile);
+	snprintf(idxfile, sizeof(idxfile), "%s.idx", gzfile);
+	data = read_file(mapfile, &size);
+	gz = ckopen(gzfile, "w");
+	idx = ckopen(idxfile, "w");
+	fprintf(idx, "# APCF, first and last position, virtual offset and records of the runs in %s\n",
+		gzfile);
+	r.n = 0;
+
+	// a record runs from a '>' line to the next one
+	for (off = 0; off < size; off += len) {
+		len = record_len(data, off, size);
+		if (len > BLOCK_DATA)
+			fatalf("a record of %s is longer than a block", mapfile);
+		if (used + len > BLOCK_DATA) {
+			put_run(idx, &r);
+			coff += write_member(gz, block, used);
+			used = 0;
+		}
+		if (record_apcf(data + off, len, apcf, &beg, &end)) {
+			if (r.n > 0 && !same_string(r.apcf, apcf))
+				put_run(idx, &r);
+			if (r.n == 0) {
+				strcpy(r.apcf, apcf);
+				r.beg = beg;
+				r.end = end;
+				r.voff = (coff << 16) | used;
+			}
+			r.beg = MIN(r.beg, beg);
+			r.end = MAX(r.end, end);
+			r.n++;
+		}
+		memcpy(block + used, data + off, len);
+		used += len;
+	}
+	put_run(idx, &r);
+	if (used > 0)
+		write_member(gz, block, used);
+	if (fwrite(Eof, 1, sizeof(Eof), gz) != sizeof(Eof) || fclose(gz) != 0 || fclose(idx) != 0)
+		fatalf("cannot write %s", gzfile);
+	free(data);
+	free(block);
+}
+
+/* read_member ---------- inflate the member at byte off; returns its data length */
+static size_t read_member(FILE *fp, uint64_t off, char *data) {
+	unsigned char in[BLOCK_MAX];
+	size_t size;
+	z_stream z;
+
+	if (fseeko(fp, off, SEEK_SET) != 0 || fread(in, 1, HEADER, fp) != HEADER
+			|| in[0] != 0x1f || in[1] != 0x8b || in[12] != 'B' || in[13] != 'C')
+		fatal("not a BGZF block at the offset of the index");
+	size = (in[16] | in[17] << 8) + 1;
+	if (size < HEADER + FOOTER || fread(in + HEADER, 1, size - HEADER, fp) != size - HEADER)
+		fatal("truncated BGZF block");
+	memset(&z, 0, sizeof(z));
+	if (inflateInit2(&z, -15) != Z_OK)
+		fatal("inflateInit2 failed");
+	z.next_in = in + HEADER;
+	z.avail_in = size - HEADER - FOOTER;
+	z.next_out = (unsigned char *)data;
+	z.avail_out = BLOCK_MAX;
+	if (inflate(&z, Z_FINISH) != Z_STREAM_END)
+		fatal("corrupt BGZF block");
+	size = z.total_out;
+	inflateEnd(&z);
+	return size;
+}
+
+/* query ---------------- print the records of the map overlapping a region */
+static void query(const char *gzfile, const char *region) {
+	char idxfile[700], line[300], want[100], apcf[100], *data = ckalloc(BLOCK_MAX);
+	long qbeg = 0, qend = LONG_MAX, beg, end;
+	unsigned long long voff;
+	uint64_t last = UINT64_MAX;
+	size_t size = 0, off, len;
+	int n, k;
+	FILE *idx, *gz;
+
+	if (sscanf(region, "%99[^:]:%ld-%ld", want, &qbeg, &qend) == 1)
+		qbeg = 0, qend = LONG_MAX;
+	snprintf(idxfile, sizeof(idxfile), "%s.idx", gzfile);
+	idx = ckopen(idxfile, "r");
+	gz = ckopen(gzfile, "r");
+	while (fgets(line, sizeof(line), idx)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%99s %ld %ld %llu %d", apcf, &beg, &end, &voff, &n) != 5)
+			fatalf("cannot parse %s: %s", idxfile, line);
+		if (!same_string(apcf, want) || end <= qbeg || beg >= qend)
+			continue;
+		if (voff >> 16 != last)
+			size = read_member(gz, (last = voff >> 16), data);
+		for (off = voff & 0xffff, k = 0; k < n && off < size; k++, off += len) {
+			len = record_len(data, off, size);
+			if (record_apcf(data + off, len, apcf, &beg, &end) && end > qbeg && beg < qend)
+				fwrite(data + off, 1, len, stdout);
+		}
+	}
+	fclose(idx);
+	fclose(gz);
+	free(data);
+}
+
+int main(int argc, char *argv[]) {
+	int i;
+
+	if (argc == 2 && argv[1][0] != '-')
+		compress_map(argv[1]);
+	else if (argc >= 4 && same_string(argv[1], "-q"))
+		for (i = 3; i < argc; i++)
+			query(argv[2], argv[i]);
+	else
+		fatal("args: map-file, or -q map-file.gz region ... (APCF.3:1000-2000, or APCF.3)");
+	return 0;
+}
@@ -0,0 +1,167 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "joindb.h"
+
+static const char Magic[8] = "DSCHJN1";
+
+struct joindb_header {
+	char magic[8];
+	int32_t nspe, maxid, njoin, namelen;
+};
+
+struct join_entry {
+	int32_t x, y;
+	uint64_t mask;
+};
+
+struct join_db_writer {
+	struct join_entry *e;
+	int n, max, maxid;
+};
+
+struct join_db_writer *open_join_db_writer(void) {
+	return ckallocz(sizeof(struct join_db_writer));
+}
+
+static void add_entry(struct join_db_writer *w, int spe, int x, int y) {
+	if (w->n == w->max) {
+		w->max = w->max ? 2 * w->max : 1024;
+		w->e = ckrealloc(w->e, w->max * sizeof(struct join_entry));
+	}
+	w->e[w->n].x = x;
+	w->e[w->n].y = y;
+	w->e[w->n].mask = (uint64_t)1 << spe;
+	++w->n;
+	w->maxid = MAX(w->maxid, MAX(abs(x), abs(y)));
+}
+
+void add_join(struct join_db_writer *w, int spe, int l, int r) {
+	if (spe >= 64)
+		fatal("the join database holds 64 species at most");
+	add_entry(w, spe, l, r);
+	add_entry(w, spe, -r, -l);
+}
+
+static int entry_cmp(const void *a, const void *b) {
+	const struct join_entry *p = a, *q = b;
+
+	if (p->x != q->x)
+		return p->x < q->x ? -1 : 1;
+	if (p->y != q->y)
+		return p->y < q->y ? -1 : 1;
+	return 0;
+}
+
+void write_join_db(struct join_db_writer *w, const char *fname, char names[][100], int nspe) {
+	struct joindb_header h;
+	int32_t *offset, *partner;
+	uint64_t *mask;
+	int i, n, x;
+	FILE *fp;
+
+	qsort(w->e, w->n, sizeof(struct join_entry), entry_cmp);
+	// one entry per join, with the species of all its copies
+	for (i = n = 0; i < w->n; i++) {
+		if (n > 0 && w->e[n-1].x == w->e[i].x && w->e[n-1].y == w->e[i].y)
+			w->e[n-1].mask |= w->e[i].mask;
+		else
+			w->e[n++] = w->e[i];
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, Magic, sizeof(Magic));
+	h.nspe = nspe;
+	h.maxid = w->maxid;
+	h.njoin = n;
+	for (i = 0; i < nspe; i++)
+		h.namelen += strlen(names[i]) + 1;
+
+	mask = ckalloc((n + 1) * sizeof(uint64_t));
+	partner = ckalloc((n + 1) * sizeof(int32_t));
+	offset = ckalloc((2 * h.maxid + 2) * sizeof(int32_t));
+	for (i = 0, x = -h.maxid; x <= h.maxid + 1; x++) {
+		offset[x + h.maxid] = i;
+		for ( ; i < n && w->e[i].x == x; i++) {
+			mask[i] = w->e[i].mask;
+			partner[i] = w->e[i].y;
+		}
+	}
+
+	fp = ckopen(fname, "w");
+	fwrite(&h, sizeof(h), 1, fp);
+	fwrite(mask, sizeof(uint64_t), n, fp);
+	fwrite(offset, sizeof(int32_t), 2 * h.maxid + 2, fp);
+	fwrite(partner, sizeof(int32_t), n, fp);
+	for (i = 0; i < nspe; i++)
+		fwrite(names[i], 1, strlen(names[i]) + 1, fp);
+	if (fclose(fp) != 0)
+		fatalf("cannot write %s", fname);
+
+	free(mask);
+	free(partner);
+	free(offset);
+	free(w->e);
+	free(w);
+}
+
+struct join_db *open_join_db(const char *fname) {
+	const struct joindb_header *h;
+	struct join_db *db;
+	struct stat st;
+	uint64_t need;
+	const char *p;
+	int fd, i;
+
+	if ((fd = open(fname, O_RDONLY)) < 0 || fstat(fd, &st) != 0)
+		fatalf("Cannot open %s.", fname);
+	if ((size_t)st.st_size < sizeof(struct joindb_header))
+		fatalf("%s: not a join database", fname);
+	db = ckallocz(sizeof(struct join_db));
+	db->size = st.st_size;
+	db->image = mmap(NULL, db->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (db->image == MAP_FAILED)
+		fatalf("cannot map %s", fname);
+
+	h = (const struct joindb_header *)db->image;
+	if (memcmp(h->magic, Magic, sizeof(Magic)) != 0)
+		fatalf("%s: not a join database, or written by another version", fname);
+	need = sizeof(*h) + (uint64_t)h->njoin * (sizeof(uint64_t) + sizeof(int32_t))
+		+ (2 * (uint64_t)h->maxid + 2) * sizeof(int32_t) + h->namelen;
+	if (h->nspe < 0 || h->maxid < 0 || h->njoin < 0 || need != (uint64_t)st.st_size
+		|| (h->namelen > 0 && db->image[st.st_size-1] != '\0'))
+		fatalf("%s: truncated or damaged join database", fname);
+	db->nspe = h->nspe;
+	db->maxid = h->maxid;
+	db->njoin = h->njoin;
+	db->mask = (const uint64_t *)(h + 1);
+	db->offset = (const int32_t *)(db->mask + h->njoin);
+	db->partner = db->offset + 2 * h->maxid + 2;
+
+	db->name = ckalloc((h->nspe + 1) * sizeof(char *));
+	p = (const char *)(db->partner + h->njoin);
+	for (i = 0; i < h->nspe; i++) {
+		if (p >= db->image + db->size)
+			fatalf("%s: damaged join database", fname);
+		db->name[i] = p;
+		p += strlen(p) + 1;
+	}
+	return db;
+}
+
+void close_join_db(struct join_db *db) {
+	munmap(db->image, db->size);
+	free(db->name);
+	free(db);
+}
+
+int join_db_spe(const struct join_db *db, const char *name) {
+	int i;
+
+	for (i = 0; i < db->nspe; i++)
+		if (strcmp(db->name[i], name) == 0)
+			return i;
+	return -1;
+}
@@ -0,0 +1,86 @@
+/* **************************************************************
+ * The joins of all the species in one file, Joins.db, written by
+ * createGenomeFile next to the <species>.joins files it is made
+ * from. For every signed block end x (0 for a chromosome end) it
+ * keeps the ends y joined to it and, for each, the species that
+ * have the join as a bit mask, bit i standing for the i-th species
+ * of the config file. A join l r is kept as x = l, y = r and as
+ * x = -r, y = -l, so it is found from either side.
+ *
+ *   header (magic "DSCHJN1", species, largest block id, joins)
+ *   masks, uint64[joins]
+ *   first join of x at offsets[x + maxid], int32[2*maxid + 2]
+ *   partners, int32[joins], sorted for each x
+ *   species names, each ending with '\0'
+ *
+ * The file is read through mmap; script/JoinDB.pm reads the same
+ * layout.
+ * **************************************************************/
+
+#ifndef _JOINDB_H_
+#define _JOINDB_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JOINDB_FILE "Joins.db"
+
+struct join_db_writer;
+
+struct join_db_writer *open_join_db_writer(void);
+// a join of species spe, with the signs of the .joins files
+void add_join(struct join_db_writer *w, int spe, int l, int r);
+// writes the joins of the species names[0..nspe-1] and frees the writer
+void write_join_db(struct join_db_writer *w, const char *fname, char names[][100], int nspe);
+
+struct join_db {
+	int nspe, maxid, njoin;
+	const char **name;		// the species, in config order
+	const uint64_t *mask;
+	const int32_t *offset;
+	const int32_t *partner;
+	char *image;
+	size_t size;
+};
+
+struct join_db *open_join_db(const char *fname);
+void close_join_db(struct join_db *db);
+
+// index of a species of the database, -1 if it is not there
+int join_db_spe(const struct join_db *db, const char *name);
+
+// the species that have the join x y
+static inline uint64_t join_mask(const struct join_db *db, int x, int y) {
+	int32_t k, end;
+
+	if (x < -db->maxid || x > db->maxid)
+		return 0;
+	end = db->offset[x + db->maxid + 1];
+	for (k = db->offset[x + db->maxid]; k < end && db->partner[k] <= y; k++)
+		if (db->partner[k] == y)
+			return db->mask[k];
+	return 0;
+}
+
+// the species that join x to a block, not to a chromosome end
+static inline uint64_t end_mask(const struct join_db *db, int x) {
+	int32_t k, end;
+	uint64_t m = 0;
+
+	if (x < -db->maxid || x > db->maxid)
+		return 0;
+	end = db->offset[x + db->maxid + 1];
+	for (k = db->offset[x + db->maxid]; k < end; k++)
+		if (db->partner[k] != 0)
+			m |= db->mask[k];
+	return m;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,472 @@
+/* *****************************************************************
+ * Lifts coordinates between the species and the APCFs by their
+ * mapping files, APCF_<spc>.merged.map (or .map, or the .gz of
+ * indexMap):
+ *
+ *   liftApcf [-spc name] map-file ... < queries
+ *   liftApcf [-spc name] -serve port map-file ...
+ *   liftApcf [-spc name] -bed regions.bed map-file ...
+ *
+ * A query is a region, "spc2.chr5:1000-2000", "APCF.3:1000-2000",
+ * "name:pos" or "name beg end", on a chromosome of a species (with
+ * its species name, as in the maps) or on an APCF. Each piece of it
+ * that a mapping covers is printed as a line, the query, the region
+ * on the other side and the orientation, tab-separated, and the
+ * answer to the query ends with an empty line. A place within a
+ * mapping is scaled by the lengths of its two sides, which differ
+ * where the merged map spans its gaps. -spc keeps the species of
+ * that name only, and names the species of chromosomes given
+ * without one.
+ *
+ * The maps are read once into per-name interval indexes, sorted
+ * arrays searched as implicit trees as in segindex.c. -serve answers
+ * the queries of every connection to the port (on the loopback
+ * address), each on a thread of its own. -bed lifts the regions of a
+ * BED file, sorted and swept along the sorted mappings of each name;
+ * the columns after the third are kept, and a strand in the sixth is
+ * turned over with the mapping.
+ *
+ * Coordinates are 0-based starts and exclusive ends, as in the maps.
+ * *****************************************************************/
+
+#include "util.h"
+#include <stdint.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// one side of a mapping, on an APCF or a species' chromosome
+struct side {
+	int name;
+	long beg, end;
+};
+
+struct mapping {
+	struct side s[2];	// the APCF, then the species
+	int same;			// the two sides have the same orientation
+};
+
+// a side in the index of its name; sorted by lo
+struct ival {
+	long lo, hi, maxhi;
+	struct mapping *m;
+	int w;				// which side of m
+};
+
+static char **Names;	// sorted, after the maps are read
+static int Nname;
+static struct mapping *Maps;
+static int Nmap;
+static struct ival *Ivals;
+static int *First;		// the ivals of name i are Ivals[First[i]..First[i+1])
+static const char *Spc = NULL;
+
+static int cmp_name(const void *a, const void *b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// the id of a name, or -1
+static int name_id(const char *name) {
+	char **p = bsearch(&name, Names, Nname, sizeof(char *), cmp_name);
+
+	return p ? (int)(p - Names) : -1;
+}
+
+// species chromosome names are "spc.chr"; an APCF's is "APCF.<id>"
+static int of_spc(const char *name) {
+	size_t n;
+
+	if (Spc == NULL)
+		return 1;
+	n = strlen(Spc);
+	return strncmp(name, Spc, n) == 0 && name[n] == '.';
+}
+
+static int parse_side(const char *s, char *name, long *beg, long *end, char *orient) {
+	return sscanf(s, "%499[^:]:%ld-%ld %c", name, beg, end, orient) == 4;
+}
+
+/* read_maps ------------------------------ the mappings of the map files */
+static void read_maps(char **files, int nfile) {
+	char buf[1100], name[2][500], orient[2], **raw = NULL;
+	long beg[2], end[2];
+	int f, k, i, max = 0, maxraw = 0, nraw = 0;
+	FILE *fp;
+
+	for (f = 0; f < nfile; f++) {
+		fp = ckopen_in(files[f]);
+		while (fgets(buf, sizeof(buf), fp)) {
+			if (buf[0] != '>')
+				continue;
+			for (k = 0; k < 2; k++)
+				if (!fgets(buf, sizeof(buf), fp)
+						|| !parse_side(buf, name[k], &beg[k], &end[k], &orient[k]))
+					fatalf("cannot parse %s: %s", files[f], buf);
+			if (!of_spc(name[1]))
+				continue;
+			if (Nmap == max) {
+				max = max ? 2 * max : 4096;
+				Maps = ckrealloc(Maps, max * sizeof(struct mapping));
+			}
+			for (k = 0; k < 2; k++) {
+				if (nraw + 2 > maxraw) {
+					maxraw = maxraw ? 2 * maxraw : 8192;
+					raw = ckrealloc(raw, maxraw * sizeof(char *));
+				}
+				// the name ids are set once the names are sorted
+				raw[nraw] = copy_string(name[k]);
+				Maps[Nmap].s[k].name = nraw++;
+				Maps[Nmap].s[k].beg = MIN(beg[k], end[k]);
+				Maps[Nmap].s[k].end = MAX(beg[k], end[k]);
+			}
+			Maps[Nmap].same = orient[0] == orient[1];
+			Nmap++;
+		}
+		ckclose_in(fp);
+	}
+
+	// distinct names, sorted
+	Names = ckalloc((nraw + 1) * sizeof(char *));
+	memcpy(Names, raw, nraw * sizeof(char *));
+	qsort(Names, nraw, sizeof(char *), cmp_name);
+	for (i = Nname = 0; i < nraw; i++)
+		if (Nname == 0 || !same_string(Names[Nname-1], Names[i]))
+			Names[Nname++] = Names[i];
+	for (i = 0; i < Nmap; i++)
+		for (k = 0; k < 2; k++)
+			Maps[i].s[k].name = name_id(raw[Maps[i].s[k].name]);
+	// the duplicates are not among Names
+	for (i = 0; i < nraw; i++)
+		if (name_id(raw[i]) < 0 || Names[name_id(raw[i])] != raw[i])
+			free(raw[i]);
+	free(raw);
+}
+
+static int cmp_ival(const void *a, const void *b) {
+	const struct ival *x = a, *y = b;
+	int c = x->m->s[x->w].name - y->m->s[y->w].name;
+
+	if (c != 0)
+		return c;
+	return (x->lo > y->lo) - (x->lo < y->lo);
+}
+
+static long set_maxhi(struct ival *e, int l, int r) {
+	int m = (l + r) / 2;
+	long h;
+
+	if (l >= r)
+		return -1;
+	h = e[m].hi;
+	h = MAX(h, set_maxhi(e, l, m));
+	h = MAX(h, set_maxhi(e, m + 1, r));
+	return e[m].maxhi = h;
+}
+
+static void build_index(void) {
+	int i, k, n = 0;
+
+	Ivals = ckalloc((2 * Nmap + 1) * sizeof(struct ival));
+	for (i = 0; i < Nmap; i++)
+		for (k = 0; k < 2; k++) {
+			Ivals[n].lo = Maps[i].s[k].beg;
+			Ivals[n].hi = Maps[i].s[k].end;
+			Ivals[n].m = &Maps[i];
+			Ivals[n].w = k;
+			n++;
+		}
+	qsort(Ivals, n, sizeof(struct ival), cmp_ival);
+	First = ckallocz((Nname + 1) * sizeof(int));
+	for (i = 0; i < n; i++)
+		First[Ivals[i].m->s[Ivals[i].w].name + 1]++;
+	for (i = 0; i < Nname; i++)
+		First[i+1] += First[i];
+	for (i = 0; i < Nname; i++)
+		set_maxhi(Ivals, First[i], First[i+1]);
+}
+
+/* lift -------- the part of [beg, end) on side w of m, on the other side */
+static void lift(const struct ival *v, long beg, long end, long *tbeg, long *tend) {
+	const struct side *s = &v->m->s[v->w], *t = &v->m->s[1 - v->w];
+	double scale = (double)(t->end - t->beg) / MAX(s->end - s->beg, 1);
+
+	beg = MAX(beg, s->beg);
+	end = MIN(end, s->end);
+	if (v->m->same) {
+		*tbeg = t->beg + (long)((beg - s->beg) * scale + 0.5);
+		*tend = t->beg + (long)((end - s->beg) * scale + 0.5);
+	} else {
+		*tbeg = t->beg + (long)((s->end - end) * scale + 0.5);
+		*tend = t->beg + (long)((s->end - beg) * scale + 0.5);
+	}
+	// a piece is never lifted to nothing
+	if (*tend <= *tbeg) {
+		*tend = MIN(*tbeg + 1, t->end);
+		*tbeg = *tend - 1;
+	}
+}
+
+typedef void (*hit_fn)(const struct ival *v, void *arg);
+
+/* stab --------------- calls fn for the ivals in [l, r) that meet [beg, end) */
+static void stab(int l, int r, long beg, long end, hit_fn fn, void *arg) {
+	int m;
+
+	while (l < r) {
+		m = (l + r) / 2;
+		if (Ivals[m].maxhi <= beg)
+			return;
+		stab(l, m, beg, end, fn, arg);
+		if (Ivals[m].lo >= end)
+			return;
+		if (Ivals[m].hi > beg)
+			fn(&Ivals[m], arg);
+		l = m + 1;
+	}
+}
+
+// a query and where its answer goes
+struct answer {
+	FILE *out;
+	const char *query;
+	long beg, end;
+};
+
+static void print_hit(const struct ival *v, void *arg) {
+	struct answer *a = arg;
+	const struct side *t = &v->m->s[1 - v->w];
+	long tb, te;
+
+	lift(v, a->beg, a->end, &tb, &te);
+	fprintf(a->out, "%s\t%s:%ld-%ld\t%c\n", a->query, Names[t->name], tb, te,
+		v->m->same ? '+' : '-');
+}
+
+/* parse_query --- "name:beg-end", "name:pos" or "name beg end"; 0 if it is not one */
+static int parse_query(const char *q, char *name, long *beg, long *end) {
+	char full[500];
+
+	if (sscanf(q, "%499[^: \t]:%ld-%ld", name, beg, end) != 3
+			&& sscanf(q, "%499s %ld %ld", name, beg, end) != 3) {
+		if (sscanf(q, "%499[^: \t]:%ld", name, beg) != 2)
+			return 0;
+		*end = *beg + 1;
+	}
+	if (*end < *beg) {
+		long t = *beg;
+		*beg = *end;
+		*end = t;
+	}
+	// a chromosome of the species of -spc may be given without its name
+	if (Spc != NULL && name_id(name) < 0) {
+		snprintf(full, sizeof(full), "%s.%s", Spc, name);
+		if (name_id(full) >= 0)
+			strcpy(name, full);
+	}
+	return 1;
+}
+
+/* answer_queries ---------- the answers to the queries read from in, to out */
+static void answer_queries(FILE *in, FILE *out) {
+	char *line = NULL, name[500];
+	size_t cap = 0;
+	ssize_t n;
+	struct answer a;
+	int id;
+
+	while ((n = getline(&line, &cap, in)) > 0) {
+		while (n > 0 && (line[n-1] == '\n' || line[n-1] == '\r'))
+			line[--n] = '\0';
+		if (n == 0)
+			continue;
+		a.out = out;
+		a.query = line;
+		if (!parse_query(line, name, &a.beg, &a.end))
+			fprintf(out, "%s\tcannot parse\n", line);
+		else if ((id = name_id(name)) >= 0)
+			stab(First[id], First[id+1], a.beg, a.end, print_hit, &a);
+		fprintf(out, "\n");
+		fflush(out);
+	}
+	free(line);
+}
+
+static void *serve_client(void *arg) {
+	int fd = (int)(intptr_t)arg;
+	FILE *in = fdopen(fd, "r"), *out = fdopen(dup(fd), "w");
+
+	if (in != NULL && out != NULL)
+		answer_queries(in, out);
+	if (in != NULL)
+		fclose(in);
+	if (out != NULL)
+		fclose(out);
+	return NULL;
+}
+
+/* serve ------------------- answer the connections to port, each on a thread */
+static void serve(int port) {
+	struct sockaddr_in addr;
+	pthread_t t;
+	int s, c, on = 1;
+
+	// a client that goes away only ends its own thread
+	signal(SIGPIPE, SIG_IGN);
+	if ((s = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		fatalf("cannot create a socket: %s", strerror(errno));
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(s, 64) != 0)
+		fatalf("cannot listen on port %d: %s", port, strerror(errno));
+	fprintf(stderr, "- answering on port %d\n", port);
+	for (;;) {
+		if ((c = accept(s, NULL, NULL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			fatalf("accept failed: %s", strerror(errno));
+		}
+		if (pthread_create(&t, NULL, serve_client, (void *)(intptr_t)c) != 0)
+			fatal("cannot create thread");
+		pthread_detach(t);
+	}
+}
+
+// a region of a BED file
+struct region {
+	int name;
+	long beg, end;
+	char *rest;			// the columns after the third, or ""
+	int lifted;
+};
+
+static int cmp_region(const void *a, const void *b) {
+	const struct region *x = a, *y = b;
+
+	if (x->name != y->name)
+		return x->name - y->name;
+	return (x->beg > y->beg) - (x->beg < y->beg);
+}
+
+static void print_bed(const struct region *r, const struct ival *v) {
+	const struct side *t = &v->m->s[1 - v->w];
+	char *p;
+	long tb, te;
+	int col;
+
+	lift(v, r->beg, r->end, &tb, &te);
+	printf("%s\t%ld\t%ld", Names[t->name], tb, te);
+	// the strand is the sixth column, the third of the rest
+	for (p = r->rest, col = 3; *p; p++) {
+		if (*p == '\t' || *p == ' ')
+			col++;
+		else if (col == 6 && (p[-1] == '\t' || p[-1] == ' ') && (*p == '+' || *p == '-')
+				&& (p[1] == '\0' || p[1] == '\t' || p[1] == ' ') && !v->m->same) {
+			putchar(*p == '+' ? '-' : '+');
+			continue;
+		}
+		putchar(*p);
+	}
+	putchar('\n');
+}
+
+/* lift_bed --------- lift the regions of a BED file, sorted and swept */
+static void lift_bed(const char *bedfile) {
+	char *line = NULL, name[500], full[600], *p;
+	size_t cap = 0;
+	ssize_t n;
+	struct region *r = NULL;
+	int nr = 0, max = 0, i, j, k, m, hi, nact, lost = 0, *act;
+	FILE *fp = ckopen_in(bedfile);
+
+	while ((n = getline(&line, &cap, fp)) > 0) {
+		while (n > 0 && (line[n-1] == '\n' || line[n-1] == '\r'))
+			line[--n] = '\0';
+		if (n == 0 || line[0] == '#' || starts(line, "track") || starts(line, "browser"))
+			continue;
+		if (nr == max) {
+			max = max ? 2 * max : 4096;
+			r = ckrealloc(r, max * sizeof(struct region));
+		}
+		if (sscanf(line, "%499s %ld %ld", name, &r[nr].beg, &r[nr].end) != 3)
+			fatalf("cannot parse %s: %s", bedfile, line);
+		if ((r[nr].name = name_id(name)) < 0 && Spc != NULL) {
+			snprintf(full, sizeof(full), "%s.%s", Spc, name);
+			r[nr].name = name_id(full);
+		}
+		for (p = line, k = 0; *p && k < 3; p++)
+			if (*p == '\t' || *p == ' ')
+				k++;
+		r[nr].rest = copy_string(k == 3 ? p - 1 : "");
+		r[nr].lifted = 0;
+		nr++;
+	}
+	free(line);
+	ckclose_in(fp);
+
+	qsort(r, nr, sizeof(struct region), cmp_region);
+	act = ckalloc((2 * Nmap + 1) * sizeof(int));
+	for (i = 0; i < nr; i = hi) {
+		for (hi = i; hi < nr && r[hi].name == r[i].name; hi++)
+			;
+		if (r[i].name < 0)
+			continue;
+		// the mappings that begin before a region ends join the active ones,
+		// and leave them when a region begins after their end
+		j = First[r[i].name];
+		nact = 0;
+		for (; i < hi; i++) {
+			for (; j < First[r[i].name + 1] && Ivals[j].lo < r[i].end; j++)
+				act[nact++] = j;
+			for (k = m = 0; k < nact; k++)
+				if (Ivals[act[k]].hi > r[i].beg)
+					act[m++] = act[k];
+			nact = m;
+			for (k = 0; k < nact; k++)
+				if (Ivals[act[k]].lo < r[i].end) {
+					print_bed(&r[i], &Ivals[act[k]]);
+					r[i].lifted = 1;
+				}
+		}
+	}
+	for (i = 0; i < nr; i++) {
+		lost += !r[i].lifted;
+		free(r[i].rest);
+	}
+	if (lost > 0)
+		fprintf(stderr, "- %d of %d regions not lifted\n", lost, nr);
+	free(act);
+	free(r);
+}
+
+int main(int argc, char *argv[]) {
+	const char *bed = NULL;
+	int port = 0;
+
+	argv0 = "liftApcf";
+	for (; argc > 2 && argv[1][0] == '-'; argc -= 2, argv += 2)
+		if (same_string(argv[1], "-spc"))
+			Spc = argv[2];
+		else if (same_string(argv[1], "-serve"))
+			port = atoi(argv[2]);
+		else if (same_string(argv[1], "-bed"))
+			bed = argv[2];
+		else
+			break;
+	if (argc < 2 || argv[1][0] == '-')
+		fatal("args: [-spc name] [-serve port | -bed regions.bed] map-file ...");
+
+	read_maps(argv + 1, argc - 1);
+	build_index();
+	if (bed != NULL)
+		lift_bed(bed);
+	else if (port > 0)
+		serve(port);
+	else
+		answer_queries(stdin, stdout);
+	return 0;
+}
@@ -0,0 +1,125 @@
+/* *****************************************************************
+ * liftByChain - lifts the regions of a BED file from the reference
+ * to another species of a run by the chains of their pair, as
+ * liftOver does, with the chain store partitionGenomes builds and
+ * maps (chainstore.h), so that the chains are parsed once for both:
+ *
+ *   liftByChain [-minMatch f] [-unmapped file] configure-file species regions.bed [threads]
+ *
+ * A region goes by the first chain, in the order of the chain files
+ * (the best score first), whose gap-free blocks hold -minMatch of
+ * its bases (0.95 by default), to the span of the bases they hold;
+ * see lift_queries() of base.h. The lifted regions are printed in
+ * the order of the input, with the columns after the third kept and
+ * a strand in the sixth turned over where the chain is on the other
+ * strand. The regions not lifted are written to the -unmapped file
+ * as liftOver does, after a line "#Deleted in new" (no chain holds
+ * any of the region) or "#Partially deleted in new".
+ * *****************************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "base.h"
+#include "workpool.h"
+#include <stdlib.h>
+
+// a region of the BED file
+struct region {
+	char *line;			// as read
+	char *rest;			// the columns after the third, or ""
+};
+
+static void print_lifted(FILE *fp, const struct lift_query *q, const struct region *r) {
+	char *p;
+	int col;
+
+	fprintf(fp, "%s\t%d\t%d", q->schr, q->sbeg, q->send);
+	// the strand is the sixth column, the third of the rest
+	for (p = r->rest, col = 3; *p; p++) {
+		if (*p == '\t' || *p == ' ')
+			col++;
+		else if (col == 6 && (p[-1] == '\t' || p[-1] == ' ') && (*p == '+' || *p == '-')
+				&& (p[1] == '\0' || p[1] == '\t' || p[1] == ' ') && q->orient == '-') {
+			putc(*p == '+' ? '-' : '+', fp);
+			continue;
+		}
+		putc(*p, fp);
+	}
+	putc('\n', fp);
+}
+
+int main(int argc, char *argv[]) {
+	const char *unmapped = NULL;
+	double min_match = 0.95;
+	char *line = NULL, name[500], *p;
+	struct lift_query *q = NULL;
+	struct region *r = NULL;
+	long nr = 0, max = 0, i, lifted;
+	int rs, ss, k, nthreads;
+	size_t cap = 0;
+	ssize_t n;
+	FILE *fp, *un = NULL;
+
+	argv0 = "liftByChain";
+	for (; argc > 2 && argv[1][0] == '-'; argc -= 2, argv += 2)
+		if (same_string(argv[1], "-minMatch"))
+			min_match = atof(argv[2]);
+		else if (same_string(argv[1], "-unmapped"))
+			unmapped = argv[2];
+		else
+			break;
+	if (argc != 4 && argc != 5)
+		fatal("args: [-minMatch f] [-unmapped file] configure-file species regions.bed [threads]");
+	nthreads = thread_arg(argc == 5 ? argv[4] : NULL);
+
+	get_spename(argv[1]);
+	get_chaindir(argv[1]);
+	rs = ref_spe_idx();
+	if ((ss = spe_idx(argv[2])) == rs)
+		fatalf("%s is the reference", argv[2]);
+	load_chain_space(rs, ss);
+
+	fp = ckopen_in(argv[3]);
+	while ((n = getline(&line, &cap, fp)) > 0) {
+		while (n > 0 && (line[n-1] == '\n' || line[n-1] == '\r'))
+			line[--n] = '\0';
+		if (n == 0 || line[0] == '#' || starts(line, "track") || starts(line, "browser"))
+			continue;
+		if (nr == max) {
+			max = max ? 2 * max : 4096;
+			q = ckrealloc(q, max * sizeof(struct lift_query));
+			r = ckrealloc(r, max * sizeof(struct region));
+		}
+		if (sscanf(line, "%499s %d %d", name, &q[nr].beg, &q[nr].end) != 3)
+			fatalf("cannot parse %s: %s", argv[3], line);
+		q[nr].chrom = intern_chr(name);
+		r[nr].line = copy_string(line);
+		for (p = r[nr].line, k = 0; *p && k < 3; p++)
+			if (*p == '\t' || *p == ' ')
+				k++;
+		r[nr].rest = k == 3 ? p - 1 : "";
+		nr++;
+	}
+	free(line);
+	ckclose_in(fp);
+
+	lifted = lift_queries(Spe->chains[ss], q, nr, min_match, nthreads);
+	if (unmapped != NULL)
+		un = ckopen(unmapped, "w");
+	for (i = 0; i < nr; i++) {
+		if (q[i].schr != NULL)
+			print_lifted(stdout, &q[i], &r[i]);
+		else if (un != NULL)
+			fprintf(un, "#%s in new\n%s\n", q[i].matched > 0 ? "Partially deleted" : "Deleted",
+				r[i].line);
+		free(r[i].line);
+	}
+	if (un != NULL)
+		fclose(un);
+	if (lifted < nr)
+		fprintf(stderr, "- %ld of %ld regions not lifted\n", nr - lifted, nr);
+	free_chain_space(ss);
+	free(q);
+	free(r);
+	return 0;
+}
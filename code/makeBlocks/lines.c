@@ -0,0 +1,230 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lines.h"
+
+#define CHUNK	(1 << 20)
+
+struct line_reader {
+	FILE *fp;
+	char *name;
+	char *map;			// the mapped file, or NULL
+	size_t maplen;
+	const char *p, *end;	// what is left of the mapping or the buffer
+	char *buf;
+	size_t size;
+	bool eof;
+};
+
+struct line_reader *open_lines(FILE *fp, const char *name)
+{
+	struct line_reader *r = ckallocz(sizeof(struct line_reader));
+	struct stat st;
+	off_t pos;
+	int fd;
+
+	r->fp = fp;
+	r->name = copy_string(name);
+	fd = fileno(fp);
+	if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+		&& (pos = ftello(fp)) >= 0 && pos <= st.st_size) {
+		r->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (r->map == MAP_FAILED)
+			r->map = NULL;
+		else {
+			r->maplen = st.st_size;
+			madvise(r->map, r->maplen, MADV_SEQUENTIAL);
+			r->p = r->map + pos;
+			r->end = r->map + r->maplen;
+			return r;
+		}
+	}
+	r->size = CHUNK;
+	r->p = r->end = r->buf = ckalloc(r->size);
+	return r;
+}
+
+void close_lines(struct line_reader *r)
+{
+	if (r->map)
+		munmap(r->map, r->maplen);
+	free(r->buf);
+	free(r->name);
+	free(r);
+}
+
+/* fill_buffer ------------ read more of the stream after what is left to read */
+static void fill_buffer(struct line_reader *r)
+{
+	size_t left = r->end - r->p, n;
+
+	memmove(r->buf, r->p, left);
+	// a line longer than the buffer makes it grow
+	if (left == r->size) {
+		r->size *= 2;
+		r->buf = ckrealloc(r->buf, r->size);
+	}
+	n = fread(r->buf + left, 1, r->size - left, r->fp);
+	if (n == 0) {
+		if (ferror(r->fp))
+			fatalf("Cannot read %s.", r->name);
+		r->eof = 1;
+	}
+	r->p = r->buf;
+	r->end = r->buf + left + n;
+}
+
+const char *next_line(struct line_reader *r, size_t *len)
+{
+	const char *line, *nl;
+	size_t from = 0;
+
+	for (;;) {
+		if ((nl = memchr(r->p + from, '\n', r->end - r->p - from)) != NULL)
+			break;
+		if (r->map || r->eof) {
+			// the last line may have no newline
+			if (r->p == r->end)
+				return NULL;
+			nl = r->end;
+			break;
+		}
+		from = r->end - r->p;
+		fill_buffer(r);
+	}
+	line = r->p;
+	*len = nl - line;
+	r->p = nl < r->end ? nl + 1 : nl;
+	return line;
+}
+
+struct line_reader *open_text_lines(const char *text, size_t len, const char *name)
+{
+	struct line_reader *r = ckallocz(sizeof(struct line_reader));
+
+	r->name = copy_string(name);
+	r->p = text;
+	r->end = text + len;
+	r->eof = 1;
+	return r;
+}
+
+const char *take_mapped_lines(struct line_reader *r, size_t *len)
+{
+	const char *text = r->p;
+
+	if (r->map == NULL)
+		return NULL;
+	*len = r->end - r->p;
+	r->p = r->end;
+	return text;
+}
+
+int cut_lines(const char *text, size_t len, const char *key, size_t size, size_t **cut)
+{
+	size_t klen = strlen(key), pos = 0, next;
+	const char *p;
+	int n = 0, max = 16;
+
+	*cut = ckalloc(max * sizeof(size_t));
+	(*cut)[n++] = 0;
+	while (size > 0 && len - pos > size) {
+		// the first line starting with key after where the piece is full
+		next = pos + size;
+		for (p = text + next - 1; (p = memchr(p, '\n', text + len - p)) != NULL; p++)
+			if ((size_t)(text + len - (p + 1)) >= klen && memcmp(p + 1, key, klen) == 0)
+				break;
+		if (p == NULL)
+			break;
+		pos = p + 1 - text;
+		if (n + 1 == max) {
+			max *= 2;
+			*cut = ckrealloc(*cut, max * sizeof(size_t));
+		}
+		(*cut)[n++] = pos;
+	}
+	(*cut)[n] = len;
+	return n;
+}
+
+int split_line(const char *line, size_t len, struct field *f, int max)
+{
+	const char *p = line, *end = line + len;
+	int n = 0;
+
+	while (n < max) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		if (p == end)
+			break;
+		f[n].s = p;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+			p++;
+		f[n].len = p - f[n].s;
+		n++;
+	}
+	return n;
+}
+
+bool field_is(const struct field *f, const char *s)
+{
+	return (size_t)f->len == strlen(s) && memcmp(f->s, s, f->len) == 0;
+}
+
+bool field_int(const struct field *f, int *v)
+{
+	const char *p = f->s, *end = f->s + f->len;
+	long long x = 0;
+	bool neg = 0;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+	if (p == end)
+		return 0;
+	for (; p < end; p++) {
+		if (*p < '0' || *p > '9' || x > INT_MAX)
+			return 0;
+		x = 10 * x + (*p - '0');
+	}
+	if (x > (long long)INT_MAX + neg)
+		return 0;
+	*v = neg ? -x : x;
+	return 1;
+}
+
+bool field_copy(const struct field *f, char *buf, size_t size)
+{
+	if ((size_t)f->len >= size)
+		return 0;
+	memcpy(buf, f->s, f->len);
+	buf[f->len] = '\0';
+	return 1;
+}
+
+bool parse_net_line(const char *line, size_t len, struct net_line *n)
+{
+	struct field f[9];
+	int nf = split_line(line, len, f, 9);
+
+	if (nf == 0)
+		return 0;
+	n->depth = f[0].s - line;
+	n->type = 0;
+	if (field_is(&f[0], "net")) {
+		if (nf < 2)
+			return 0;
+		n->type = 'n';
+		n->chrom = f[1];
+		if (nf < 3 || !field_int(&f[2], &n->flen))
+			n->flen = -1;
+	} else if (field_is(&f[0], "gap") || field_is(&f[0], "fill")) {
+		n->type = f[0].s[0];
+		if (nf < 7 || !field_int(&f[1], &n->fbeg) || !field_int(&f[2], &n->flen)
+			|| !field_int(&f[5], &n->sbeg) || !field_int(&f[6], &n->slen))
+			return 0;
+		n->chrom = f[3];
+		n->orient = f[4].s[0];
+		if (n->type == 'f' && (nf < 9 || !field_is(&f[7], "id") || !field_int(&f[8], &n->cid)))
+			return 0;
+	}
+	return 1;
+}
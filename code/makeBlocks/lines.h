@@ -0,0 +1,88 @@
+/* **************************************************************
+ * Line-at-a-time reading of the chain and net files without a
+ * copy or a line-length limit. A plain file is memory-mapped; any
+ * other stream (a chromosome of a whole-genome file, a decompressor
+ * pipe, a URL) is read in large chunks. A line is handed out where
+ * it is, with its length and without its newline, and is split into
+ * fields in place; numbers are parsed by hand rather than with
+ * sscanf, which the net and chain readers spent most of their time in.
+ * **************************************************************/
+
+#ifndef _LINES_H_
+#define _LINES_H_
+
+#include "util.h"
+
+struct line_reader;
+
+// a blank-separated field of a line; not NUL-terminated
+struct field {
+	const char *s;
+	int len;
+};
+
+/* **************************************************************
+ * Reads the lines of fp from where it is; name is for messages.
+ * The stream is not closed with the reader.
+ * **************************************************************/
+struct line_reader *open_lines(FILE *fp, const char *name);
+void close_lines(struct line_reader *r);
+
+/* **************************************************************
+ * The next line and its length, without the newline, or NULL at
+ * the end. It is valid until the next call.
+ * **************************************************************/
+const char *next_line(struct line_reader *r, size_t *len);
+
+/* **************************************************************
+ * The lines of len bytes at text, read as those of a stream; the
+ * text is not copied and stays the caller's.
+ * **************************************************************/
+struct line_reader *open_text_lines(const char *text, size_t len, const char *name);
+
+/* **************************************************************
+ * For a file parsed on several threads: what is left of a mapped
+ * file, in *len bytes, after which next_line() has nothing more to
+ * give; NULL (and nothing taken) for a stream read in chunks. The
+ * bytes stay valid until the reader is closed.
+ * **************************************************************/
+const char *take_mapped_lines(struct line_reader *r, size_t *len);
+
+/* **************************************************************
+ * Cuts text[0..len) into pieces of about size bytes that begin
+ * with a line starting with key (" fill" for a top-level fill of a
+ * net, "chain"), but for the first. Piece k is (*cut)[k] up to
+ * (*cut)[k+1]; returns the number of pieces. Free *cut after.
+ * **************************************************************/
+int cut_lines(const char *text, size_t len, const char *key, size_t size, size_t **cut);
+
+/* **************************************************************
+ * Splits a line at blanks into its first max fields at most.
+ * Returns the number of fields found.
+ * **************************************************************/
+int split_line(const char *line, size_t len, struct field *f, int max);
+
+bool field_is(const struct field *f, const char *s);
+bool field_int(const struct field *f, int *v);
+
+// copies a field as a string; 0 if it does not fit in size chars
+bool field_copy(const struct field *f, char *buf, size_t size);
+
+/* **************************************************************
+ * A line of a net file: "net chr1 248956422", or a gap or fill
+ *   gap fbeg flen chrom orient sbeg slen ...
+ *   fill fbeg flen chrom orient sbeg slen id cid ...
+ * indented by depth blanks.
+ * **************************************************************/
+struct net_line {
+	char type;			// 'n', 'g' or 'f'; 0 for anything else
+	int depth;
+	int fbeg, flen, sbeg, slen, cid;	// flen of a net its size, -1 if not given
+	char orient;
+	struct field chrom;	// of a gap or fill, or the net's chromosome
+};
+
+// 0 if the line has no fields or a net, gap or fill line cannot be parsed
+bool parse_net_line(const char *line, size_t len, struct net_line *n);
+
+#endif
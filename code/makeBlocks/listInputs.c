@@ -0,0 +1,48 @@
+/* *****************************************************************
+ * listInputs - the manifest of the net and chain directories of a
+ * run (manifest.h), written once so that the tools, with
+ * DESCHRAMBLER_MANIFEST naming it, find their inputs without reading
+ * the directories. A URL is left out, as it cannot be listed; so is
+ * a directory that does not exist, for the tools to report.
+ * The whole-genome files are indexed first if they are not.
+ * *****************************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "manifest.h"
+#include "remote.h"
+#include <stdlib.h>
+
+int main(int argc, char *argv[]) {
+	char dir[1000], tmpfile[600];
+	int rs, ss, k, ndir = 0;
+	FILE *fp;
+
+	if (argc != 3)
+		fatal("args: configure-file manifest-file");
+	// the directories as they are now, not as an old manifest has them
+	unsetenv("DESCHRAMBLER_MANIFEST");
+
+	get_spename(argv[1]);
+	get_netdir(argv[1]);
+	get_chaindir(argv[1]);
+	rs = ref_spe_idx();
+
+	snprintf(tmpfile, sizeof(tmpfile), "%s.%d", argv[2], (int)getpid());
+	fp = ckopen(tmpfile, "w");
+	fprintf(fp, "# net and chain directories of %s\n", argv[1]);
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (ss == rs)
+			continue;
+		for (k = 0; k < 2; k++) {
+			pair_dir(dir, sizeof(dir), k == 0 ? Spe->netdir : Spe->chaindir,
+				Spe->spename[0], Spe->spename[ss], k == 0 ? "net" : "chain");
+			if (!is_url(dir) && write_manifest_dir(fp, dir))
+				ndir++;
+		}
+	}
+	if (fclose(fp) != 0 || rename(tmpfile, argv[2]) != 0)
+		fatalf("Cannot write %s.", argv[2]);
+	fprintf(stderr, "- %d directories listed in %s\n", ndir, argv[2]);
+	return 0;
+}
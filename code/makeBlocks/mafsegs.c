@@ -0,0 +1,441 @@
+#include <sys/stat.h>
+#include "util.h"
+#include "species.h"
+#include "chrtab.h"
+#include "lines.h"
+#include "segprocess.h"
+#include "mafsegs.h"
+
+#define SUFFIX	"raw.segs"
+#define SUFFIX2	"processed.segs"
+
+// a row of a block, "s src start size strand srcSize text"; ss -1 for
+// one of a species not in the config
+struct maf_row {
+	int ss;
+	const char *chr;
+	int start, size, srcsize;
+	char strand;
+	char *text;
+	int len, max;
+};
+
+// a gap-free run of a row against the reference, r forward on the
+// reference and q on the strand of the row
+struct maf_run {
+	int r, q, len;
+};
+
+// the chain a species is making
+struct maf_chain {
+	const char *qchr;
+	char strand;
+	int qsize;
+	int rbeg, rend, qbeg, qend;		// qbeg and qend on the strand
+	struct maf_run *blk;
+	int nblk, maxblk;
+};
+
+struct maf_species {
+	struct maf_chain c;
+	int open, ncid;
+	struct seg_line *segs;
+	int nseg, maxseg;
+	FILE *fp;					// the chain file of the chromosome
+	char file[1000], tmp[1100];
+};
+
+struct maf_state {
+	struct maf_species sp[MAXSPE];
+	const char *chr;			// the reference chromosome being read
+	int size, end;				// its size, and the end of its last block
+	const char **chroms;		// those read, and their sizes
+	int *sizes, nchrom, maxchrom;
+	struct maf_run *run;
+	int maxrun;
+	long nblock;
+};
+
+/* make_dirs -------------------------------- create a directory and its parents */
+static void make_dirs(const char *dir)
+{
+	char path[1000], *p;
+
+	snprintf(path, sizeof(path), "%s", dir);
+	for (p = path + 1; *p; p++)
+		if (*p == '/') {
+			*p = '\0';
+			mkdir(path, 0777);
+			*p = '/';
+		}
+	if (mkdir(path, 0777) != 0 && errno != EEXIST)
+		fatalf("Cannot create %s: %s", path, strerror(errno));
+}
+
+static void add_seg(struct maf_species *p, const struct seg_line *s)
+{
+	if (p->nseg == p->maxseg) {
+		p->maxseg = p->maxseg ? 2 * p->maxseg : 1024;
+		p->segs = ckrealloc(p->segs, p->maxseg * sizeof(struct seg_line));
+	}
+	p->segs[p->nseg++] = *s;
+}
+
+/* chain_file ---------- the chain file of species ss and the chromosome read */
+static FILE *chain_file(struct maf_state *st, int ss)
+{
+	struct maf_species *p = &st->sp[ss];
+	char dir[800];
+
+	if (p->fp != NULL)
+		return p->fp;
+	pair_dir(dir, sizeof(dir), Spe->chaindir, Spe->spename[0], Spe->spename[ss], "chain");
+	make_dirs(dir);
+	snprintf(p->file, sizeof(p->file), "%s/%s.chain", dir, st->chr);
+	snprintf(p->tmp, sizeof(p->tmp), "%s/%s.chain.%d", dir, st->chr, (int)getpid());
+	return p->fp = ckopen(p->tmp, "w");
+}
+
+/* close_chain ------ write the chain of species ss, and its fill and gaps */
+static void close_chain(struct maf_state *st, int ss)
+{
+	struct maf_species *p = &st->sp[ss];
+	struct maf_chain *c = &p->c;
+	const struct maf_run *b, *n;
+	struct seg_line s;
+	long score = 0;
+	int i, cid;
+	FILE *fp;
+
+	if (!p->open)
+		return;
+	p->open = 0;
+	cid = ++p->ncid;
+	for (i = 0; i < c->nblk; i++)
+		score += c->blk[i].len;
+	fp = chain_file(st, ss);
+	fprintf(fp, "chain %ld %s %d + %d %d %s %d %c %d %d %d\n", score, st->chr, st->size,
+		c->rbeg, c->rend, c->qchr, c->qsize, c->strand, c->qbeg, c->qend, cid);
+	for (i = 0; i < c->nblk; i++) {
+		b = &c->blk[i];
+		if (i + 1 < c->nblk)
+			fprintf(fp, "%d\t%d\t%d\n", b->len, b[1].r - b->r - b->len, b[1].q - b->q - b->len);
+		else
+			fprintf(fp, "%d\n\n", b->len);
+	}
+
+	// the fill of level 0, in forward coordinates as in a net
+	memset(&s, 0, sizeof(s));
+	s.type = 's';
+	s.fchr = st->chr;
+	s.fbeg = c->rbeg;
+	s.fend = c->rend;
+	s.schr = c->qchr;
+	s.sbeg = c->strand == '+' ? c->qbeg : c->qsize - c->qend;
+	s.send = c->strand == '+' ? c->qend : c->qsize - c->qbeg;
+	s.orient = c->strand;
+	s.cid = cid;
+	if (s.fend - s.fbeg <= Spe->minlen && s.send - s.sbeg <= Spe->minlen)
+		return;
+	add_seg(p, &s);
+	// and its gaps that readNets would keep
+	s.type = 'g';
+	for (i = 0; i + 1 < c->nblk; i++) {
+		b = &c->blk[i];
+		n = b + 1;
+		if (n->q - b->q - b->len <= Spe->minlen)
+			continue;
+		s.fbeg = b->r + b->len;
+		s.fend = n->r;
+		s.sbeg = c->strand == '+' ? b->q + b->len : c->qsize - n->q;
+		s.send = c->strand == '+' ? n->q : c->qsize - b->q - b->len;
+		add_seg(p, &s);
+	}
+}
+
+/* add_run ---------- a run of species ss goes on its chain or starts a new one */
+static void add_run(struct maf_state *st, int ss, const struct maf_row *row, const char *qchr,
+					char strand, const struct maf_run *run)
+{
+	struct maf_species *p = &st->sp[ss];
+	struct maf_chain *c = &p->c;
+
+	if (p->open && c->qchr == qchr && c->strand == strand && run->r >= c->rend && run->q >= c->qend) {
+		if (run->r == c->rend && run->q == c->qend)
+			c->blk[c->nblk - 1].len += run->len;
+		else {
+			if (c->nblk == c->maxblk) {
+				c->maxblk = 2 * c->maxblk;
+				c->blk = ckrealloc(c->blk, c->maxblk * sizeof(struct maf_run));
+			}
+			c->blk[c->nblk++] = *run;
+		}
+		c->rend = run->r + run->len;
+		c->qend = run->q + run->len;
+		return;
+	}
+	close_chain(st, ss);
+	p->open = 1;
+	c->qchr = qchr;
+	c->strand = strand;
+	c->qsize = row->srcsize;
+	c->rbeg = run->r;
+	c->qbeg = run->q;
+	c->rend = run->r + run->len;
+	c->qend = run->q + run->len;
+	if (c->maxblk == 0) {
+		c->maxblk = 256;
+		c->blk = ckalloc(c->maxblk * sizeof(struct maf_run));
+	}
+	c->blk[0] = *run;
+	c->nblk = 1;
+}
+
+/* new_chrom -------- the chains of the last chromosome done; chr NULL at the end */
+static void new_chrom(struct maf_state *st, const char *chr, int size)
+{
+	struct maf_species *p;
+	int ss;
+
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		close_chain(st, ss);
+		p = &st->sp[ss];
+		if (p->fp == NULL)
+			continue;
+		if (fclose(p->fp) != 0 || rename(p->tmp, p->file) != 0)
+			fatalf("Cannot write %s.", p->file);
+		p->fp = NULL;
+	}
+	if ((st->chr = chr) == NULL)
+		return;
+	if (st->nchrom == st->maxchrom) {
+		st->maxchrom = st->maxchrom ? 2 * st->maxchrom : 256;
+		st->chroms = ckrealloc(st->chroms, st->maxchrom * sizeof(char *));
+		st->sizes = ckrealloc(st->sizes, st->maxchrom * sizeof(int));
+	}
+	st->chroms[st->nchrom] = chr;
+	st->sizes[st->nchrom++] = size;
+	st->size = size;
+	st->end = 0;
+}
+
+/* add_block ------------ the runs of each species of a block against the reference */
+static void add_block(struct maf_state *st, const struct maf_row *rows, int nrow, const char *maf)
+{
+	const struct maf_row *ref = NULL, *row;
+	char seen[MAXSPE], strand;
+	int i, k, n, rbeg, r, q, a, b;
+	struct maf_run t;
+
+	for (k = 0; k < nrow && ref == NULL; k++)
+		if (rows[k].ss == 0)
+			ref = &rows[k];
+	if (ref == NULL)
+		return;
+	if (ref->chr != st->chr)
+		new_chrom(st, ref->chr, ref->srcsize);
+	rbeg = ref->strand == '+' ? ref->start : ref->srcsize - ref->start - ref->size;
+	if (rbeg < st->end)
+		fatalf("%s: the blocks of %s are not in the order of their positions", maf, ref->chr);
+	st->end = rbeg + ref->size;
+	st->nblock++;
+	if (st->maxrun < ref->len) {
+		st->maxrun = ref->len;
+		st->run = ckrealloc(st->run, st->maxrun * sizeof(struct maf_run));
+	}
+
+	memset(seen, 0, sizeof(seen));
+	seen[0] = 1;
+	for (k = 0; k < nrow; k++) {
+		row = &rows[k];
+		if (row->ss < 0 || seen[row->ss])
+			continue;
+		seen[row->ss] = 1;
+		if (row->len != ref->len)
+			fatalf("%s: rows of different lengths in a block of %s", maf, ref->chr);
+		// the columns where both have a base
+		r = ref->start;
+		q = row->start;
+		for (i = 0, n = 0; i < ref->len; i++) {
+			a = ref->text[i] != '-';
+			b = row->text[i] != '-';
+			if (a && b) {
+				if (n > 0 && st->run[n-1].r + st->run[n-1].len == r && st->run[n-1].q + st->run[n-1].len == q)
+					st->run[n-1].len++;
+				else {
+					st->run[n].r = r;
+					st->run[n].q = q;
+					st->run[n++].len = 1;
+				}
+			}
+			r += a;
+			q += b;
+		}
+		strand = row->strand;
+		// a reference on its - strand turned over, the runs with it
+		if (ref->strand == '-') {
+			strand = row->strand == '+' ? '-' : '+';
+			for (i = 0; i < n; i++) {
+				st->run[i].r = ref->srcsize - st->run[i].r - st->run[i].len;
+				st->run[i].q = row->srcsize - st->run[i].q - st->run[i].len;
+			}
+			for (i = 0; i < n / 2; i++) {
+				t = st->run[i];
+				st->run[i] = st->run[n-1-i];
+				st->run[n-1-i] = t;
+			}
+		}
+		for (i = 0; i < n; i++)
+			add_run(st, row->ss, row, row->chr, strand, &st->run[i]);
+	}
+}
+
+/* maf_species ---------- the species of a src "species.chrom", and its chrom */
+static int maf_species(const struct field *src, const char **chr)
+{
+	char name[500];
+	int ss, n;
+
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		n = strlen(Spe->spename[ss]);
+		if (src->len > n + 1 && src->s[n] == '.' && strncmp(src->s, Spe->spename[ss], n) == 0)
+			break;
+	}
+	if (ss == Spe->spesz || (ss != 0 && !only_species(ss)))
+		return -1;
+	if (src->len - n - 1 >= (int)sizeof(name))
+		fatalf("chromosome name too long: %.*s", src->len, src->s);
+	memcpy(name, src->s + n + 1, src->len - n - 1);
+	name[src->len - n - 1] = '\0';
+	*chr = intern_chr(name);
+	return ss;
+}
+
+static int cmp_ptr(const void *a, const void *b)
+{
+	const char *x = *(const char * const *)a, *y = *(const char * const *)b;
+
+	return (x > y) - (x < y);
+}
+
+int read_maf_each(FILE **out, int fused, void (*done)(int ss, void *arg), void *arg)
+{
+	struct maf_state *st;
+	struct maf_row *rows = NULL, *row;
+	struct line_reader *lr;
+	struct field f[8];
+	struct seg_writer *w;
+	struct seg_processor *sp;
+	struct maf_species *p;
+	const char *line, **kept;
+	char outfile[500];
+	int nrow = 0, maxrow = 0, inblock = 0, nf, nkept, i, ss, rs = ref_spe_idx();
+	size_t len;
+	FILE *fp, *of;
+
+	if (!input_exists(Spe->maf)) {
+		fprintf(stderr, "Error - Could not open the MAF %s\n", Spe->maf);
+		return -1;
+	}
+	fprintf(stderr, "- reading %s\n", Spe->maf);
+	st = ckallocz(sizeof(struct maf_state));
+	fp = ckopen_in(Spe->maf);
+	lr = open_lines(fp, Spe->maf);
+	for (;;) {
+		line = next_line(lr, &len);
+		// a block ends at a blank line, the next block or the end
+		if (inblock && (line == NULL || len == 0 || line[0] == 'a')) {
+			add_block(st, rows, nrow, Spe->maf);
+			inblock = 0;
+		}
+		if (line == NULL)
+			break;
+		if (len == 0 || line[0] == '#')
+			continue;
+		if (line[0] == 'a' && (len == 1 || line[1] == ' ' || line[1] == '\t')) {
+			inblock = 1;
+			nrow = 0;
+			continue;
+		}
+		if (!inblock || line[0] != 's' || (len > 1 && line[1] != ' ' && line[1] != '\t'))
+			continue;
+		if (nrow == maxrow) {
+			maxrow = maxrow ? 2 * maxrow : 64;
+			rows = ckrealloc(rows, maxrow * sizeof(struct maf_row));
+			memset(rows + nrow, 0, (maxrow - nrow) * sizeof(struct maf_row));
+		}
+		row = &rows[nrow];
+		if ((nf = split_line(line, len, f, 8)) != 7 || !field_int(&f[2], &row->start)
+			|| !field_int(&f[3], &row->size) || f[4].len != 1 || !field_int(&f[5], &row->srcsize))
+			fatalf("cannot parse: %.*s", (int)len, line);
+		if ((row->ss = maf_species(&f[1], &row->chr)) < 0)
+			continue;
+		row->strand = f[4].s[0];
+		if (row->max <= f[6].len) {
+			row->max = f[6].len + 1;
+			row->text = ckrealloc(row->text, row->max);
+		}
+		memcpy(row->text, f[6].s, f[6].len);
+		row->len = f[6].len;
+		nrow++;
+	}
+	new_chrom(st, NULL, 0);
+	close_lines(lr);
+	ckclose_in(fp);
+	for (i = 0; i < maxrow; i++)
+		free(rows[i].text);
+	free(rows);
+
+	// one chromosome comes in one run of blocks
+	kept = ckalloc((st->nchrom + 1) * sizeof(char *));
+	memcpy(kept, st->chroms, st->nchrom * sizeof(char *));
+	qsort(kept, st->nchrom, sizeof(char *), cmp_ptr);
+	for (i = 1; i < st->nchrom; i++)
+		if (kept[i] == kept[i-1])
+			fatalf("%s: the blocks of %s are not all together", Spe->maf, kept[i]);
+	// the chromosomes of >subset, less those >skipshort leaves out
+	for (i = nkept = 0; i < st->nchrom; i++)
+		if (!short_chrom(st->sizes[i]))
+			kept[nkept++] = st->chroms[i];
+	nkept = subset_chroms(kept, nkept);
+	qsort(kept, nkept, sizeof(char *), cmp_ptr);
+	fprintf(stderr, "- %ld blocks of %d reference chromosomes, %d of them used\n",
+		st->nblock, st->nchrom, nkept);
+
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (rs == ss || !only_species(ss))
+			continue;
+		p = &st->sp[ss];
+		sprintf(outfile, "%s.%s", Spe->spename[ss], fused ? SUFFIX2 : SUFFIX);
+		of = (out[ss] != NULL) ? out[ss] : ckopen_out(outfile);
+		w = open_seg_writer(of, fused ? SEGS_PROCESSED : SEGS_RAW, rs, ss, Binary_segs);
+		sp = fused ? open_seg_processor(w, NULL) : NULL;
+		for (i = 0; i < p->nseg; i++) {
+			if (bsearch(&p->segs[i].fchr, kept, nkept, sizeof(char *), cmp_ptr) == NULL)
+				continue;
+			if (sp != NULL)
+				process_seg_line(sp, &p->segs[i]);
+			else
+				write_seg_line(w, &p->segs[i]);
+		}
+		if (sp != NULL)
+			close_seg_processor(sp);
+		close_seg_writer(w);
+		if (ferror(of))
+			fatalf("cannot write %s", outfile);
+		if (of != out[ss])
+			ckclose_out(of);
+		free(p->segs);
+		p->segs = NULL;
+		if (done != NULL)
+			done(ss, arg);
+	}
+	for (ss = 0; ss < Spe->spesz; ss++)
+		free(st->sp[ss].c.blk);
+	free(kept);
+	free(st->chroms);
+	free(st->sizes);
+	free(st->run);
+	free(st);
+	return 0;
+}
@@ -0,0 +1,40 @@
+/* **************************************************************
+ * The segments of every species pair made in one pass over a
+ * multiple alignment, for the alignments that come as one MAF (from
+ * hal2maf --refGenome of a Cactus HAL, say) rather than as pairwise
+ * chains and nets. A config file names the MAF in a section of its
+ * own, which readNets, and so makeBlocks, then read instead of the
+ * nets:
+ *
+ *   >maf
+ *   /data/cactus/all.maf.gz
+ *
+ * The blocks are those of the first species of the config, the
+ * reference of the nets, in the order of its positions, a chromosome
+ * after another; its first row in a block is the reference, and the
+ * first row of each other species the one aligned to it. The gap-free
+ * runs of a species are chained while they stay on one chromosome and
+ * strand and go forward on both; each chain is a fill of level 0 and
+ * its gaps longer than MINLEN on the other species the gaps of level
+ * 0 of raw.segs, so there are no nested fills. The chains are written
+ * as <chaindir>/<ref>/<species>/chain/<chromosome>.chain, for the
+ * chain stores that mapbase() lifts through (chainstore.h) to find
+ * them as they find any other. The segment cache (segcache.h), keyed
+ * by the nets, is not used.
+ * **************************************************************/
+
+#ifndef _MAFSEGS_H_
+#define _MAFSEGS_H_
+
+#include "segstream.h"
+
+/* **************************************************************
+ * Reads the MAF of the config (Spe->maf) and writes the raw.segs of
+ * each species, or with fused the processed.segs getSegments makes
+ * of them (segprocess.h), to out[ss] as read_nets_each() does,
+ * calling done(ss, arg) as each is complete. Returns -1 if there is
+ * no such MAF.
+ * **************************************************************/
+int read_maf_each(FILE **out, int fused, void (*done)(int ss, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,437 @@
+/* *****************************************************************
+ * Runs the steps of Makefile.SFs, from grabbing data to Genomes.Order,
+ * in one process. The segments, block lists and orders go from one
+ * step to the next in memory; with -keep they are also written to the
+ * intermediate files the makefile makes, to look at or to run a
+ * single step again. The species are partitioned one by one as their
+ * segments are grabbed from the nets, on a thread of its own that stays
+ * a few species ahead. With -pair the steps of "make pair" are run and
+ * the tree file is not needed. With -common the steps stop at
+ * _Conserved.Segments, the last file that does not depend on the target
+ * ancestor, for "make ancestor" to finish with each tree; no tree file
+ * is needed either. -counters prints the counters of trace.h at the
+ * end, in a build with make TRACE=1. The segments are kept as binary
+ * streams (segstream.h), those of -keep -text as text. Without -keep
+ * the nets are read as readNets -fused reads them, straight to the
+ * processed segments, and no raw.segs are made.
+ *
+ * A run at several resolutions partitions the genomes once: -blocks
+ * writes the Building.Blocks (binary) of the finest one, and -from
+ * file starts another from them, merged for its own resolution by
+ * coarsen_blocks() instead of grabbing data and partitioning again.
+ * Likewise for other outgroups with the same descendents: -descendents
+ * file writes the building blocks of the descendents alone (binary), as
+ * they are before the outgroups are added to them, and -outgroups file
+ * starts from those, grabbing the data of the outgroups only.
+ *
+ * -approx and -approxCheck are those of partitionGenomes: the breaks of
+ * the segments interpolated within them, without reading the chains,
+ * or lifted through the chains and compared with the interpolation.
+ * ****************************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "blockfile.h"
+#include "newick.h"
+#include "stages.h"
+#include "segstream.h"
+#include "workpool.h"
+#include "trace.h"
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <pthread.h>
+
+// a text one step writes and the next one reads
+struct pass {
+	char *buf;
+	size_t len;
+	FILE *fp;
+};
+
+static int Keep = 0;
+
+// the species grabbed not yet partitioned, at most QUEUED of them
+#define QUEUED 2
+
+struct grab {
+	FILE **raw, **processed;
+	struct pass *rawp, *procp;
+	int nthreads, failed;
+	int ready[MAXSPE], head, tail, done;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static FILE *open_pass(struct pass *p, const char *fname) {
+	p->buf = NULL;
+	p->len = 0;
+	if (Keep)
+		p->fp = ckopen(fname, "w");
+	else if ((p->fp = open_memstream(&p->buf, &p->len)) == NULL)
+		fatal("open_memstream failed");
+	return p->fp;
+}
+
+// ends the writing; the text is read from its beginning
+static FILE *reopen_pass(struct pass *p, const char *fname) {
+	fclose(p->fp);
+	if (Keep)
+		p->fp = ckopen(fname, "r");
+	else if (p->len == 0)
+		p->fp = ckopen("/dev/null", "r");
+	else if ((p->fp = fmemopen(p->buf, p->len, "r")) == NULL)
+		fatal("fmemopen failed");
+	return p->fp;
+}
+
+static void close_pass(struct pass *p) {
+	fclose(p->fp);
+	free(p->buf);
+	p->buf = NULL;
+}
+
+// a list as the next step would read it from the file of the makefile
+static struct block_list *pass_blocks(struct block_list *head, enum block_style style,
+									  const char *fname) {
+	FILE *fp;
+
+	if (Keep) {
+		fp = ckopen(fname, "w");
+		write_block_list(fp, head, style, 1);
+		fclose(fp);
+	}
+	reread_block_list(head, style);
+	return head;
+}
+
+static void write_plain(struct block_list *head, const char *fname) {
+	FILE *fp = ckopen(fname, "w");
+
+	write_block_list(fp, head, BLOCKS_PLAIN, 0);
+	fclose(fp);
+}
+
+// bytes read and written by the process, from /proc/self/io; -1 without it
+static void self_io(long long *rd, long long *wr) {
+	char key[32];
+	long long v;
+	FILE *fp;
+
+	*rd = *wr = -1;
+	if ((fp = fopen("/proc/self/io", "r")) == NULL)
+		return;
+	while (fscanf(fp, "%31[^:]: %lld\n", key, &v) == 2) {
+		if (same_string(key, "rchar"))
+			*rd = v;
+		else if (same_string(key, "wchar"))
+			*wr = v;
+	}
+	fclose(fp);
+}
+
+static double seconds(const struct timeval *tv) {
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/* with DESCHRAMBLER_STEPS naming a file, the wall and CPU time, the peak
+ * memory so far and the I/O of each step are appended to it as a line of
+ * JSON, for the run report of DESCHRAMBLER.pl. step(name) ends the step
+ * before and begins the next; step(NULL) ends the last. The memory of
+ * trace.h is reported at the end of each step too. */
+static void step(const char *name) {
+	static const char *last = NULL, *ended = NULL;
+	static struct timeval t0;
+	static struct rusage r0;
+	static long long rd0, wr0;
+	const char *file = getenv("DESCHRAMBLER_STEPS");
+	struct timeval t;
+	struct rusage r;
+	long long rd, wr;
+	FILE *fp;
+
+	if (ended != NULL)
+		trace_memory_report(ended);
+	ended = name;
+	if (file == NULL || *file == '\0')
+		return;
+	gettimeofday(&t, NULL);
+	getrusage(RUSAGE_SELF, &r);
+	self_io(&rd, &wr);
+	if (last != NULL && (fp = fopen(file, "a")) != NULL) {
+		fprintf(fp, "{\"step\": \"%s\", \"wall\": %.3f, \"user\": %.3f, \"sys\": %.3f, "
+			"\"maxrss_kb\": %ld, \"read\": %lld, \"written\": %lld}\n", last,
+			seconds(&t) - seconds(&t0), seconds(&r.ru_utime) - seconds(&r0.ru_utime),
+			seconds(&r.ru_stime) - seconds(&r0.ru_stime), r.ru_maxrss,
+			rd < 0 ? -1 : rd - rd0, wr < 0 ? -1 : wr - wr0);
+		fclose(fp);
+	}
+	last = name;
+	t0 = t;
+	r0 = r;
+	rd0 = rd;
+	wr0 = wr;
+}
+
+// the raw.segs of species ss are read: its segments, queued for partitioning
+static void grabbed(int ss, void *arg) {
+	struct grab *g = arg;
+
+	if (Fused_segs)
+		g->processed[ss] = reopen_pass(&g->procp[ss], NULL);
+	else if (!Keep)
+		g->raw[ss] = reopen_pass(&g->rawp[ss], NULL);
+	if (!Fused_segs)
+		get_species_segments(g->raw, g->processed, ss);
+	if (!Fused_segs && !Keep) {
+		close_pass(&g->rawp[ss]);
+		g->processed[ss] = reopen_pass(&g->procp[ss], NULL);
+	}
+	pthread_mutex_lock(&g->lock);
+	while (g->tail - g->head >= QUEUED)
+		pthread_cond_wait(&g->cond, &g->lock);
+	g->ready[g->tail++] = ss;
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->lock);
+}
+
+static void *grab_data(void *arg) {
+	struct grab *g = arg;
+	int failed = read_nets_each(Fused_segs ? g->processed : g->raw, g->nthreads,
+								grabbed, g) < 0;
+
+	pthread_mutex_lock(&g->lock);
+	g->failed = failed;
+	g->done = 1;
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->lock);
+	return NULL;
+}
+
+// the next species grabbed, or -1 when they are all done
+static int next_grabbed(struct grab *g) {
+	int ss = -1;
+
+	pthread_mutex_lock(&g->lock);
+	while (g->head == g->tail && !g->done)
+		pthread_cond_wait(&g->cond, &g->lock);
+	if (g->head < g->tail) {
+		ss = g->ready[g->head++];
+		pthread_cond_broadcast(&g->cond);
+	}
+	pthread_mutex_unlock(&g->lock);
+	return ss;
+}
+
+/* STEPS 1 and 2; with -keep the steps use the files of the working
+ * directory. With start, a block list of the descendents written with
+ * save, only the outgroups are grabbed and added to those blocks; with
+ * save, the blocks of the descendents are written to it before the
+ * outgroups are added */
+static struct block_list *grab_and_partition(int nthreads, const char *start,
+											 const char *save) {
+	FILE **raw, **processed, *fp;
+	struct pass *rawp, *procp;
+	struct grab g;
+	pthread_t grabber;
+	struct block_list *blocks;
+	char only[MAXSPE * 101] = "";
+	int rs = ref_spe_idx(), ss;
+
+	if (start != NULL) {
+		for (ss = 0; ss < Spe->spesz; ss++)
+			if (Spe->spetag[ss] == 2)
+				sprintf(only + strlen(only), "%s%s", only[0] ? "," : "", Spe->spename[ss]);
+		set_only_species(only);
+	}
+	step("grab data, partition genomes");
+	printf("=========== grabbing data from pairwise nets ===========\n");
+	printf("======= partitioning genomes into building blocks ======\n");
+	fflush(stdout);
+	raw = ckallocz(Spe->spesz * sizeof(FILE *));
+	processed = ckallocz(Spe->spesz * sizeof(FILE *));
+	rawp = ckallocz(Spe->spesz * sizeof(struct pass));
+	procp = ckallocz(Spe->spesz * sizeof(struct pass));
+	// the raw.segs are only made to be kept
+	Fused_segs = !Keep;
+	for (ss = 0; ss < Spe->spesz && !Keep; ss++) {
+		if (ss == rs)
+			continue;
+		processed[ss] = open_pass(&procp[ss], NULL);
+	}
+	memset(&g, 0, sizeof(g));
+	g.raw = raw;
+	g.processed = processed;
+	g.rawp = rawp;
+	g.procp = procp;
+	g.nthreads = nthreads;
+	pthread_mutex_init(&g.lock, NULL);
+	pthread_cond_init(&g.cond, NULL);
+	if (pthread_create(&grabber, NULL, grab_data, &g) != 0)
+		fatal("cannot create thread");
+	if (start != NULL) {
+		blocks = get_block_list((char *)start);
+		begin_outgroup_partition(blocks);
+		if (blocks != NULL)
+			free_block_list(blocks);
+	}
+	else
+		begin_partition();
+	while ((ss = next_grabbed(&g)) >= 0) {
+		partition_species(ss, processed[ss], nthreads);
+		if (!Keep)
+			close_pass(&procp[ss]);
+	}
+	pthread_join(grabber, NULL);
+	if (g.failed)
+		fatal("cannot read the nets");
+	if (save != NULL) {
+		blocks = descendent_blocks();
+		fp = ckopen(save, "w");
+		write_block_list(fp, blocks, BLOCKS_BUILDING, 1);
+		fclose(fp);
+		if (blocks != NULL)
+			free_block_list(blocks);
+	}
+	blocks = end_partition(nthreads);
+	pthread_mutex_destroy(&g.lock);
+	pthread_cond_destroy(&g.cond);
+	free(raw);
+	free(processed);
+	free(rawp);
+	free(procp);
+	return blocks;
+}
+
+int main(int argc, char *argv[]) {
+	FILE *fp;
+	struct pass order;
+	struct block_list *blocks;
+	struct newick_tree *tree = NULL;
+	char err[512], *from = NULL, *descendents = NULL, *outgroups = NULL;
+	int pair = 0, common = 0, counters = 0, save = 0, nargs, nthreads;
+
+	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+		if (same_string(argv[1], "-pair"))
+			pair = 1;
+		else if (same_string(argv[1], "-common"))
+			common = 1;
+		else if (same_string(argv[1], "-keep"))
+			Keep = 1;
+		else if (same_string(argv[1], "-counters"))
+			counters = 1;
+		else if (same_string(argv[1], "-text"))
+			Binary_segs = 0;
+		else if (same_string(argv[1], "-blocks"))
+			save = 1;
+		else if (same_string(argv[1], "-approx"))
+			Approx_lift = 1;
+		else if (same_string(argv[1], "-approxCheck"))
+			Approx_lift = 2;
+		else if (same_string(argv[1], "-from") && argc > 2) {
+			from = argv[2];
+			argc--, argv++;
+		}
+		else if (same_string(argv[1], "-descendents") && argc > 2) {
+			descendents = argv[2];
+			argc--, argv++;
+		}
+		else if (same_string(argv[1], "-outgroups") && argc > 2) {
+			outgroups = argv[2];
+			argc--, argv++;
+		}
+		else
+			break;
+	}
+	if (pair && common)
+		fatal("-pair and -common do not go together");
+	if (from != NULL && save)
+		fatal("-from and -blocks do not go together");
+	if ((descendents != NULL) + (outgroups != NULL) + (from != NULL) > 1)
+		fatal("-descendents, -outgroups and -from do not go together");
+	nargs = (pair || common) ? 2 : 3;
+	if (argc != nargs && argc != nargs + 1)
+		fatal("args: [-keep [-text]] [-counters] [-blocks] [-approx] [start] config.file tree-file [threads]\n"
+			  "      -pair [-keep [-text]] [-counters] [-blocks] [-approx] [start] config.file [threads]\n"
+			  "      -common [-keep [-text]] [-counters] [-blocks] [-approx] [start] config.file [threads]\n"
+			  "start: -from building-blocks | -descendents blocks-file | -outgroups blocks-file\n"
+			  "-approx: or -approxCheck");
+	nthreads = thread_arg(argc > nargs ? argv[nargs] : NULL);
+
+	get_spename(argv[1]);
+	if (nargs == 3 && (tree = newick_read(argv[2], err, sizeof(err))) == NULL)
+		fatalf("%s: %s", argv[2], err);
+	get_netdir(argv[1]);
+	get_chaindir(argv[1]);
+	get_minlen(argv[1]);
+	get_subset(argv[1]);
+	if (from != NULL) {
+		step("coarsen blocks");
+		printf("====== merging building blocks for resolution %d ======\n", Spe->minlen);
+		fflush(stdout);
+		blocks = coarsen_blocks(get_block_list(from), Spe->minlen);
+	}
+	else
+		blocks = grab_and_partition(nthreads, outgroups, descendents);
+	blocks = pass_blocks(blocks, BLOCKS_BUILDING, "Building.Blocks");
+	if (save && !Keep) {
+		fp = ckopen("Building.Blocks", "w");
+		write_block_list(fp, blocks, BLOCKS_BUILDING, 1);
+		fclose(fp);
+	}
+
+	// STEP 3
+	step("orthology blocks");
+	printf(pair ? "=============== making orthology blocks pair ================\n"
+				: "=============== making orthology blocks ================\n");
+	fflush(stdout);
+	blocks = pair ? make_orthology_blocks_pair(blocks) : make_orthology_blocks(blocks, nthreads);
+	blocks = pass_blocks(blocks, BLOCKS_ORTHOLOGY, "_orthology.blocks.bin");
+	write_plain(blocks, "Orthology.Blocks");
+
+	// STEP 4
+	step("conserved segments");
+	printf(pair ? "=== merging orthology blocks into conserved segments pair ===\n"
+				: "=== merging orthology blocks into conserved segments ===\n");
+	fflush(stdout);
+	ortho_blocks_to_orders(blocks, open_pass(&order, "_order.DS"));
+	blocks = make_conserved_segments(blocks, reopen_pass(&order, "_order.DS"));
+	close_pass(&order);
+	blocks = pass_blocks(blocks, BLOCKS_CONSERVED, "_conserved.segments.bin");
+	outgroup_segs_to_orders(blocks, open_pass(&order, "_order.OG"));
+	blocks = clean_outgroup_segs(blocks, reopen_pass(&order, "_order.OG"));
+	close_pass(&order);
+	blocks = pass_blocks(blocks, BLOCKS_CLEANED, "_conserved.segments.bin2");
+	if (pair) {
+		write_plain(blocks, "Conserved.Segments");
+		reread_block_list(blocks, BLOCKS_PLAIN);
+	}
+	else {
+		write_plain(blocks, "_Conserved.Segments");
+		if (!common) {
+			reread_block_list(blocks, BLOCKS_PLAIN);
+			blocks = make_target_cs(blocks, tree);
+			write_plain(blocks, "Conserved.Segments");
+			reread_block_list(blocks, BLOCKS_PLAIN);
+			newick_free(tree);
+		}
+	}
+
+	// STEP 5
+	if (!common) {
+		step("genome file");
+		printf("======== creating input files for inferring CARs ========\n");
+		fflush(stdout);
+		fp = ckopen("Genomes.Order", "w");
+		create_genome_file(blocks, fp);
+		fclose(fp);
+	}
+	step(NULL);
+	if (counters) {
+		trace_counters(stderr);
+		trace_memory(stderr, "at exit");
+	}
+
+	if (blocks != NULL)
+		free_block_list(blocks);
+	return 0;
+}
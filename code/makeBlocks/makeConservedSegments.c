@@ -1,20 +1,22 @@
 #include "util.h"
 #include "species.h"
+#include "blockfile.h"
+#include "stages.h"
 
-void merge_blocks(struct block_list *blkhead, int start, int terminal) {
+// index[] comes from index_blocks(); the blocks merged into start leave it
+void merge_blocks(struct block_list **index, int maxid, int start, int terminal) {
 	struct block_list *p, *q;
-	struct seg_list *b;
+	struct seg_list *b, *tail[MAXSPE];
 	int i, j;
 	if (terminal < start)
 		fatalf("DIE: start >terminal %d %d", start, terminal);
 	
-	for (p = blkhead; p != NULL; p = p->next) 
-		if (p->id == start)
-			break;
+	if (start < 1 || start > maxid || (p = index[start]) == NULL)
+		fatalf("DIE: no block %d", start);
 	
 	if (start == terminal) {
-		for (i = 0; i < Spesz; i++) {
-			if (Spetag[i] == 1) {
+		for (i = 0; i < Spe->spesz; i++) {
+			if (Spe->spetag[i] == 1) {
 				b = p->speseg[i];
 				if (b != NULL) {
 					b->chnum = 1;
@@ -27,17 +29,17 @@ void merge_blocks(struct block_list *blkhead, int start, int terminal) {
 	}
 
 	for (q = p; q != NULL && q->id <= terminal; q = q->next) {
-		for (i = 0; i < Spesz; i++) {
-			if (Spetag[i] == 2)
+		for (i = 0; i < Spe->spesz; i++) {
+			if (Spe->spetag[i] == 2)
 				continue;
 			if (q->speseg[i]->next != NULL)
 				fatalf("DIE: illegal block %d", q->id);
 		}
 	}
 
-	for (i = 0; i < Spesz; i++) {
+	for (i = 0; i < Spe->spesz; i++) {
 		q = p;
-		if (Spetag[i] == 1) {
+		if (Spe->spetag[i] == 1) {
 			b = q->speseg[i];
 			b->chnum = terminal - start + 1;
 			b->cidlist = (int *)ckalloc(sizeof(int) * b->chnum);
@@ -49,65 +51,77 @@ void merge_blocks(struct block_list *blkhead, int start, int terminal) {
 		}
 	}
 
+	// the outgroup segments of the blocks merged go after those of p, each
+	// list walked once
+	for (i = 0; i < Spe->spesz; i++)
+		for (tail[i] = p->speseg[i]; tail[i] != NULL && tail[i]->next != NULL; )
+			tail[i] = tail[i]->next;
 	q = p->next;
 	while (q != NULL && q->id <= terminal) {
 		p->next = q->next;
 		q->next = NULL;
-		for (i = 0; i < Spesz; i++) {
-			if (Spetag[i] == 2)
+		for (i = 0; i < Spe->spesz; i++) {
+			if (Spe->spetag[i] == 2)
 				continue;
 			p->speseg[i]->beg = MIN(p->speseg[i]->beg, q->speseg[i]->beg);
 			p->speseg[i]->end = MAX(p->speseg[i]->end, q->speseg[i]->end);
 		}
-		for (i = 0; i < Spesz; i++) {
-			if (Spetag[i] != 2)
+		for (i = 0; i < Spe->spesz; i++) {
+			if (Spe->spetag[i] != 2)
+				continue;
+			if (q->speseg[i] == NULL)
 				continue;
 			if (p->speseg[i] == NULL)
 				p->speseg[i] = q->speseg[i];
-			else {
-				for (b = p->speseg[i]; b->next != NULL; b = b->next)
-					;
-				b->next = q->speseg[i];
-			}
+			else
+				tail[i]->next = q->speseg[i];
+			for (tail[i] = q->speseg[i]; tail[i]->next != NULL; )
+				tail[i] = tail[i]->next;
 		}
-		for (i = 0; i < Spesz; i++)
+		for (i = 0; i < Spe->spesz; i++)
 			q->speseg[i] = NULL;
+		if (q->id >= 1 && q->id <= maxid && index[q->id] == q)
+			index[q->id] = NULL;
 		free_block_list(q);
 		q = p->next;
 	}
 }
 
-int main(int argc, char* argv[]) {
-	FILE *orthorder;
+// perm[j] = num, growing perm (zero-filled) to hold it
+static void set_perm(int **perm, int *max, int j, int num) {
+	int n;
+
+	if (j >= *max) {
+		n = MAX(2 * *max, j + 1024);
+		*perm = ckrealloc(*perm, n * sizeof(int));
+		memset(*perm + *max, 0, (n - *max) * sizeof(int));
+		*max = n;
+	}
+	(*perm)[j] = num;
+}
+
+struct block_list *make_conserved_segments(struct block_list *blkhead, FILE *orthorder) {
 	char buf[50000], spe[20];
-	struct block_list *blkhead, *blklast, *s;
-	int i, j, rs, num, total, k, terminal, count, **perm;
+	struct block_list *s;
+	int i, j, rs, num, total, k, terminal, count, **perm, **where, *maxperm;
 	int status[MAXSPE];
 	char *pt;
-	struct seg_list *p;
 	
-	if (argc != 4)
-		fatal("args: config.file orthology-blocks orthology-orders");
-
-	blkhead = blklast = s = NULL;
+	s = NULL;
 	total = count = 0;
-	get_spename(argv[1]);
 	rs = ref_spe_idx();
-	blkhead = get_block_list(argv[2]);
 	
 	for (s = blkhead; s != NULL; s = s->next)
 		++total;
 		
-	perm = malloc(sizeof(int*) * MAXSPE);
-	for (i = 0; i < Spesz; i++) {
-		perm[i] = malloc(sizeof(int) * MAXORDER);
-		if (Spetag[i] == 2)
-			continue;
-		for (j = 0; j < MAXORDER; j++)
-			perm[i][j] = 0;
-	}
+	// perm[i] is the order of species i, chromosomes apart by a 0;
+	// where[i][id] is the first position of block id in it, 0 if none
+	perm = ckallocz(sizeof(int*) * Spe->spesz);
+	where = ckalloc(sizeof(int*) * Spe->spesz);
+	maxperm = ckallocz(sizeof(int) * Spe->spesz);
+	for (i = 0; i < Spe->spesz; i++)
+		where[i] = ckallocz(sizeof(int) * (total + 2));
 
-	orthorder = ckopen(argv[3], "r");
 	while (fgets(buf, 50000, orthorder)) {
 		if (buf[0] == '\n' || buf[0] == '#')
 			continue;
@@ -120,7 +134,9 @@ int main(int argc, char* argv[]) {
 		}
 		pt = buf;
 		while (sscanf(pt, "%d", &num) == 1) {
-			perm[i][j] = num;
+			set_perm(&perm[i], &maxperm[i], j, num);
+			if (abs(num) <= total && where[i][abs(num)] == 0)
+				where[i][abs(num)] = j;
 			j++;
 			pt = strchr(pt, ' ');
 			if (pt == NULL || (pt != NULL && *(pt+1) == '$'))
@@ -130,24 +146,20 @@ int main(int argc, char* argv[]) {
 		}
 		j++;
 	}
-	fclose(orthorder);
 
 	terminal = 1;
 	while (terminal <= total) {
-		for (i = 0; i < Spesz; i++)
+		for (i = 0; i < Spe->spesz; i++)
 			status[i] = 0;
-		for (i = 0; i < Spesz; i++) {
-			if (Spetag[i] == 2)
+		for (i = 0; i < Spe->spesz; i++) {
+			if (Spe->spetag[i] == 2 || (k = where[i][terminal]) == 0)
 				continue;
-			for (k = 0; k < MAXORDER; k++)
-				if (abs(perm[i][k]) == terminal)
-					break;
-			if ((perm[i][k] > 0 && perm[i][k+1] == terminal + 1)
+			if ((perm[i][k] > 0 && k + 1 < maxperm[i] && perm[i][k+1] == terminal + 1)
 				|| (perm[i][k] < 0 && perm[i][k-1] == -terminal - 1))
 				status[i] = 1;
 		}
-		for (i = 0; i < Spesz; i++) {
-			if (i == rs || Spetag[i] == 2)
+		for (i = 0; i < Spe->spesz; i++) {
+			if (i == rs || Spe->spetag[i] == 2)
 				continue;
 			status[rs] = status[rs] & status[i];
 		}
@@ -157,31 +169,37 @@ int main(int argc, char* argv[]) {
 	assign_states(blkhead);
 	assign_orders(blkhead);
 
-	for (s = blkhead; s != NULL; s = s->next) {
-		printf(">%d\n", s->id);
-		for (i = 0; i < Spesz; i++) {
-			for (p = s->speseg[i]; p != NULL; p = p->next) {
-				printf("%s.%s:%d-%d %c [%d]", Spename[i], p->chr,
-						p->beg, p->end, p->orient, p->state);
-				if (Spetag[i] == 0) {
-					printf("\n");
-					continue;
-				}
-				else if (Spetag[i] == 1) {
-					printf(" {%d", p->chnum);
-					for (j = 0; j < p->chnum; j++)
-						printf(",%d", p->cidlist[j]);
-					printf("}\n");
-				}
-				else {
-					printf(" (%d)\n", p->chid);
-				}
-			}
-		}
-		printf("\n");
+	for (i = 0; i < Spe->spesz; i++) {
+		free(perm[i]);
+		free(where[i]);
 	}
+	free(perm);
+	free(where);
+	free(maxperm);
+
+	return blkhead;
+}
+
+#ifndef NO_MAIN
+int main(int argc, char* argv[]) {
+	FILE *orthorder;
+	struct block_list *blkhead;
+	int binary;
+	
+	binary = binary_blocks_arg(&argc, argv);
+	if (argc != 4)
+		fatal("args: [-bin] config.file orthology-blocks orthology-orders");
+
+	get_spename(argv[1]);
+	blkhead = get_block_list(argv[2]);
+	orthorder = ckopen(argv[3], "r");
+	blkhead = make_conserved_segments(blkhead, orthorder);
+	fclose(orthorder);
+
+	write_block_list(stdout, blkhead, BLOCKS_CONSERVED, binary);
 	
 	free_block_list(blkhead);
 
 	return 0;
 }
+#endif
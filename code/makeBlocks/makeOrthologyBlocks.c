@@ -3,14 +3,35 @@
  * there is one piece of genomic sequence from descendant species.
  * In addition, it contains zero or multiple pieces from outgroup 
  * species. 
+ *
+ * Built with -DPAIR_STEPS it is makeOrthologyBlocks.pair, the steps of
+ * "make pair" (estimateBpDist): the reference and one other species,
+ * whose segment a block then cannot do without. The species count is
+ * fixed at two there, so the loops over the species unroll and the
+ * records of the duplicate sweep hold two segments.
  * ****************************************************************/
 
+#include <stdint.h>
 #include "util.h"
 #include "species.h"
+#include "segindex.h"
+#include "workpool.h"
+#include "blockfile.h"
+#include "stages.h"
+#include "trace.h"
 
-static int rs;
+#ifdef PAIR_STEPS
+#define NSPE		2
+#define SPAN_SPE	2
+#else
+#define PAIR_STEPS	0
+#define NSPE		(Spe->spesz)
+#define SPAN_SPE	MAXSPE
+#endif
 
-int random_piece(struct seg_list *sg) {
+static __thread int rs;	// of the thread making the blocks
+
+static int random_piece(struct seg_list *sg) {
 	char buf[500];
 	int ru = 0;
 
@@ -24,41 +45,18 @@ int random_piece(struct seg_list *sg) {
 	return ru;
 }
 
-int illegal_block(struct block_list *blk) {
-    struct block_list *p;
-    int i, len, illegal, numinspc, totalinspc;
+static int illegal_block(struct block_list *blk) {
+	int i, len;
 
-    illegal = 0;
-    p = blk;
-    len = p->speseg[rs]->end - p->speseg[rs]->beg;
-    if (len < MINLEN) {
-        illegal = 1;
-	}
-    
-	for (i = 0; i < Spesz; i++) {
-        if (Spetag[i] == 1 && p->speseg[i] != NULL
-                && p->speseg[i]->end - p->speseg[i]->beg < len * MINDESSEG) {
+	len = blk->speseg[rs]->end - blk->speseg[rs]->beg;
+	for (i = 0; i < NSPE; i++)
+		if (Spe->spetag[i] == 1 && (blk->speseg[i] == NULL ? PAIR_STEPS
+				: blk->speseg[i]->end - blk->speseg[i]->beg < len * MINDESSEG))
 			return 1;
-		}
-    }
-
-	numinspc = 0;
-	totalinspc = 0;
-    for (i = 0; i < Spesz; i++) {
-		if (Spetag[i] == 0 || Spetag[i] == 1) totalinspc++;
-
-        if (Spetag[i] == 1 && (p->speseg[i] == NULL
-                || p->speseg[i]->end - p->speseg[i]->beg < len * MINDESSEG)) {
-			continue;
-		}
-
-		if (Spetag[i] == 0 || Spetag[i] == 1) numinspc++;
-    }
-    
-	return illegal;
+	return len < Spe->minlen;
 }
 
-void trim(struct block_list **blockhead) {
+static void trim(struct block_list **blockhead) {
 	struct block_list *p, *q;
 	q = NULL;
 	for (p = *blockhead; p != NULL;) {
@@ -85,8 +83,17 @@ void trim(struct block_list **blockhead) {
 	}
 }
 
-int overlap(struct seg_list *x, struct seg_list *y) {
-	int ovlp;
+/* a segment of a block as check_dup() compares it: the segments of the
+ * ingroup species of every block sit side by side, and a bit of the
+ * block's mask tells which are there */
+struct span_seg {
+	const char *chr;
+	int beg, end;
+};
+
+#define MASKWORDS	((SPAN_SPE + 63) / 64)
+
+static int overlap(const struct span_seg *x, const struct span_seg *y) {
 	int b1, e1, b2, e2, len1, len2;
 	b1 = x->beg;
 	e1 = x->end;
@@ -94,74 +101,164 @@ int overlap(struct seg_list *x, struct seg_list *y) {
 	e2 = y->end;
 	len1 = e1 - b1;
 	len2 = e2 - b2;
-	if (same_string(x->chr, y->chr) &&
+	return x->chr == y->chr &&
 			((b1 >= b2 && e1 <= e2) || (b1 <= b2 && e1 >= e2)
 				|| (b1 < b2 && e1 > b2 && e1 - b2 > MINOVL * MIN(len1, len2))
-				|| (b1 < e2 && e1 > e2 && e2 - b1 > MINOVL * MIN(len1, len2)) ))
-		ovlp = 1;
-	else
-		ovlp = 0;
-	return ovlp;
+				|| (b1 < e2 && e1 > e2 && e2 - b1 > MINOVL * MIN(len1, len2)));
 }
 
-int contain_all(struct block_list *blst) {
-	int i;
-	for (i = 0; i < Spesz; i++)
-		if (Spetag[i] == 1 && blst->speseg[i] == NULL)
-			break;
-	return (i == Spesz) ? 1 : 0;
-}
+struct messy_query {
+	struct seg_list *sg;
+	int idx;
+};
 
-int messy_piece(struct seg_list *sg, struct block_list *blk, int idx) {
-	struct block_list *b;
-	struct seg_list *p;
-	int b1, e1, b2, e2, len1, len2, messy;
+/* whether the segment of species idx leading block b swallows most of sg */
+static int messy_block(struct block_list *b, void *arg) {
+	struct messy_query *m = arg;
+	struct seg_list *p, *sg = m->sg;
+	int b1, e1, b2, e2, len1, len2;
 	b1 = sg->beg;
 	e1 = sg->end;
 	len1 = e1 - b1;
-	messy = 0;
-	for (b = blk; b != NULL; b = b->next) {
-		if ((p = b->speseg[idx]) != NULL ) { 
-			if (p == sg) 
-				continue;
-			b2 = p->beg;
-			e2 = p->end;
-			len2 = e2 - b2;
-			if (same_string(p->chr, sg->chr) &&
-					((b1 >= b2 && e1 <= e2)
-				|| (b1 <= b2 && e1 <= e2 && e1 > b2 && b2 - b1 < AFEW * len1 && len1 <= len2)
-				|| (b1 >= b2 && e1 >= e2 && b1 < e2 && e1 - e2 < AFEW * len1 && len1 <= len2))) { 
-				messy = 1;
-				break;
-			}
+	if ((p = b->speseg[m->idx]) == NULL || p == sg)
+		return 0;
+	b2 = p->beg;
+	e2 = p->end;
+	len2 = e2 - b2;
+	return (p->chr == sg->chr &&
+			((b1 >= b2 && e1 <= e2)
+		|| (b1 <= b2 && e1 <= e2 && e1 > b2 && b2 - b1 < AFEW * len1 && len1 <= len2)
+		|| (b1 >= b2 && e1 >= e2 && b1 < e2 && e1 - e2 < AFEW * len1 && len1 <= len2)));
+}
+
+/* any such segment overlaps sg, so only the blocks with a segment of
+ * species idx that meets sg are checked */
+static int messy_piece(struct seg_list *sg, struct seg_index *x, int idx) {
+	struct messy_query m;
+	int messy;
+	m.sg = sg;
+	m.idx = idx;
+	messy = stab_seg_index(x, sg->chr, sg->beg, sg->end, messy_block, &m);
+	COUNT(messy_piece_calls, 1);
+	COUNT(messy_pieces, messy != 0);
+	TRACE_POINT2(messy_piece, idx, messy);
+	return messy;
+}
+
+/* a block's reference segment, for the sweep in clean_up(), and its
+ * ingroup segments */
+struct ref_span {
+	struct block_list *blk;
+	int chr, lo, hi, rank;
+	const struct span_seg *seg;		// by the ingroup species' rank
+	uint64_t has[MASKWORDS];
+};
+
+static int cmp_ref_span(const void *a, const void *b) {
+	const struct ref_span *x = a, *y = b;
+	if (x->chr != y->chr)
+		return x->chr - y->chr;
+	if (x->lo != y->lo)
+		return (x->lo < y->lo) ? -1 : 1;
+	return x->rank - y->rank;
+}
+
+/* flags the shorter of two blocks whose segments all overlap, of the
+ * ingroup species both have (x comes first in the list) */
+static void check_dup(const struct ref_span *x, const struct ref_span *y) {
+	struct block_list *p = x->blk, *q = y->blk;
+	uint64_t both;
+	int w, k, lenp, lenq;
+
+	for (w = 0; w < MASKWORDS; w++)
+		for (both = x->has[w] & y->has[w]; both != 0; both &= both - 1) {
+			k = 64 * w + __builtin_ctzll(both);
+			if (!overlap(&x->seg[k], &y->seg[k]))
+				return;
+		}
+	lenp = p->speseg[rs]->end - p->speseg[rs]->beg;
+	lenq = q->speseg[rs]->end - q->speseg[rs]->beg;
+	if (lenp < lenq)
+		p->isdup = 1;
+	else
+		q->isdup = 1;
+}
+
+/* the checks below only compare segments on one chromosome, so the
+ * work is cut into shards that share no block and each runs whole on
+ * one thread; the blocks come out as a single thread would leave them */
+
+struct dup_sweep {
+	struct ref_span *span, **active;
+	int *first;		// shard k sweeps span[first[k]..first[k+1])
+};
+
+/* two blocks can only be duplicates if their reference segments
+ * overlap, so the reference segments of a chromosome are swept in
+ * order and just the pairs that meet are tested */
+static void sweep_dups(int shard, void *arg) {
+	struct dup_sweep *d = arg;
+	struct ref_span *span = d->span, **active = d->active + d->first[shard];
+	int i, j, k, nactive;
+
+	for (i = d->first[shard], nactive = 0; i < d->first[shard+1]; i++) {
+		for (j = k = 0; j < nactive; j++)
+			if (active[j]->hi >= span[i].lo)
+				active[k++] = active[j];
+		nactive = k;
+		for (j = 0; j < nactive; j++) {
+			if (active[j]->rank < span[i].rank)
+				check_dup(active[j], &span[i]);
+			else
+				check_dup(&span[i], active[j]);
 		}
+		active[nactive++] = &span[i];
 	}
-	return messy;
 }
 
-void clean_up(struct block_list **head) {
+static void clean_up(struct block_list **head, int nthreads) {
 	struct block_list *p, *q;
-	int i, lenp, lenq, stotal, ovtotal;
-	for (p = *head; p != NULL; p = p->next) {
-		for (q = p->next; q != NULL; q = q->next) {
-			stotal = 0;
-			ovtotal = 0;
-			for (i = 0; i < Spesz; i++) {
-				if ((Spetag[i] == 0 || Spetag[i] == 1) && p->speseg[i] != NULL && q->speseg[i] != NULL) {
-					stotal++;
-					if (overlap(p->speseg[i], q->speseg[i])) ovtotal++;
-				}
-			}
-			lenp = p->speseg[rs]->end - p->speseg[rs]->beg;
-			lenq = q->speseg[rs]->end - q->speseg[rs]->beg;
-			if (stotal == ovtotal) {
-				if (lenp < lenq)
-					p->isdup = 1;
-				else
-					q->isdup = 1;
-			}
+	struct dup_sweep d;
+	struct span_seg *seg, *t;
+	int i, j, k, n, nin, nshard, in[SPAN_SPE];
+	
+	for (nin = i = 0; i < NSPE; i++)
+		if (Spe->spetag[i] == 0 || Spe->spetag[i] == 1)
+			in[nin++] = i;
+	/* every block has a reference segment; a shard is a reference
+	 * chromosome */
+	for (n = 0, p = *head; p != NULL; p = p->next)
+		++n;
+	d.span = ckallocz((n + 1) * sizeof(struct ref_span));
+	d.active = ckalloc((n + 1) * sizeof(struct ref_span *));
+	d.first = ckalloc((n + 2) * sizeof(int));
+	seg = ckalloc(((size_t)n * nin + 1) * sizeof(struct span_seg));
+	for (i = 0, p = *head; p != NULL; p = p->next, i++) {
+		d.span[i].blk = p;
+		d.span[i].chr = chr_id(p->speseg[rs]->chr);
+		d.span[i].lo = MIN(p->speseg[rs]->beg, p->speseg[rs]->end);
+		d.span[i].hi = MAX(p->speseg[rs]->beg, p->speseg[rs]->end);
+		d.span[i].rank = i;
+		d.span[i].seg = t = seg + (size_t)i * nin;
+		for (k = 0; k < nin; k++) {
+			if (p->speseg[j = in[k]] == NULL)
+				continue;
+			t[k].chr = p->speseg[j]->chr;
+			t[k].beg = p->speseg[j]->beg;
+			t[k].end = p->speseg[j]->end;
+			d.span[i].has[k / 64] |= (uint64_t)1 << (k % 64);
 		}
 	}
+	qsort(d.span, n, sizeof(struct ref_span), cmp_ref_span);
+	for (i = nshard = 0; i < n; i++)
+		if (i == 0 || d.span[i].chr != d.span[i-1].chr)
+			d.first[nshard++] = i;
+	d.first[nshard] = n;
+	run_jobs(nshard, nthreads, sweep_dups, &d);
+	free(seg);
+	free(d.active);
+	free(d.span);
+	free(d.first);
 	
 	q = NULL;
 	for (p = *head; p != NULL;) {
@@ -188,68 +285,198 @@ void clean_up(struct block_list **head) {
 	}
 }
 
-void clean_up_again(struct block_list *head) {
+/* removing a segment from a block, or keeping it, only depends on the
+ * first segments of the same species that other blocks have on its
+ * chromosome. The chromosomes of a species are grouped so that all the
+ * segments of the species in a block fall into one group, and a shard
+ * is the blocks with segments in one group, in list order */
+struct messy_shard {
+	int spe, nblk;
+	struct block_list **blk;
+};
+
+struct messy_work {
+	struct block_list *head;
+	struct seg_index **index;
+	struct messy_shard *shard;
+	int *order;
+};
+
+static void index_species(int job, void *arg) {
+	struct messy_work *w = arg;
+	if (job != rs)
+		w->index[job] = build_seg_index(w->head, job);
+}
+
+static void clean_shard(int job, void *arg) {
+	struct messy_work *w = arg;
+	struct messy_shard *sh = &w->shard[w->order[job]];
 	struct block_list *p;
-	struct seg_list *sg, *tg;
-	int i;
-	for (p = head; p != NULL; p = p->next) {
-		for (i = 0; i < Spesz; i++) {
-			if (i == rs)
-				continue;
-			for (sg = p->speseg[i]; sg != NULL; ) {
-				if ((Spechrassm[i] == 1 && random_piece(sg)) || messy_piece(sg, head, i)) {
-					if (sg == p->speseg[i]) {
-						p->speseg[i] = sg->next;
-						free(sg);
-						tg = sg = p->speseg[i];
-					}
-					else {
-						tg->next = sg->next;
-						free(sg);
-						sg = tg->next;
-					}
+	struct seg_list *sg, *tg = NULL;
+	int k, i = sh->spe;
+
+	for (k = 0; k < sh->nblk; k++) {
+		p = sh->blk[k];
+		for (sg = p->speseg[i]; sg != NULL; ) {
+			if ((Spe->spechrassm[i] == 1 && random_piece(sg)) || messy_piece(sg, w->index[i], i)) {
+				if (sg == p->speseg[i]) {
+					p->speseg[i] = sg->next;
+					free(sg);
+					tg = sg = p->speseg[i];
 				}
 				else {
-					tg = sg;
-					sg = sg->next;
+					tg->next = sg->next;
+					free(sg);
+					sg = tg->next;
 				}
 			}
+			else {
+				tg = sg;
+				sg = sg->next;
+			}
 		}
 	}
 }
 
-int main(int argc, char *argv[]) {
-	int i;
+static int find_group(int *parent, int c) {
+	while (parent[c] != c)
+		c = parent[c] = parent[parent[c]];
+	return c;
+}
+
+static __thread struct messy_shard *cmp_shards;
+
+// biggest shards first
+static int cmp_shard_size(const void *a, const void *b) {
+	const struct messy_shard *x = &cmp_shards[*(const int *)a], *y = &cmp_shards[*(const int *)b];
+	if (x->nblk != y->nblk)
+		return y->nblk - x->nblk;
+	return *(const int *)a - *(const int *)b;
+}
+
+static void clean_up_again(struct block_list *head, int nthreads) {
+	struct block_list *p;
 	struct seg_list *sg;
-	struct block_list *commonblocklist, *blist;
+	struct messy_work w;
+	struct messy_shard *sh;
+	int *parent, *shardof, i, c, k, nchr, nshard = 0, maxshard = 0;
+
+	w.head = head;
+	w.index = ckallocz(NSPE * sizeof(struct seg_index *));
+	w.shard = NULL;
+	run_jobs(NSPE, nthreads, index_species, &w);
+
+	nchr = chr_count();
+	parent = ckalloc((nchr + 1) * sizeof(int));
+	shardof = ckalloc((nchr + 1) * sizeof(int));
+	for (i = 0; i < NSPE; i++) {
+		if (i == rs)
+			continue;
+		for (c = 0; c < nchr; c++) {
+			parent[c] = c;
+			shardof[c] = -1;
+		}
+		for (p = head; p != NULL; p = p->next)
+			for (sg = p->speseg[i]; sg != NULL; sg = sg->next)
+				parent[find_group(parent, chr_id(sg->chr))] = find_group(parent, chr_id(p->speseg[i]->chr));
+		for (p = head; p != NULL; p = p->next) {
+			if (p->speseg[i] == NULL)
+				continue;
+			c = find_group(parent, chr_id(p->speseg[i]->chr));
+			if (shardof[c] < 0) {
+				if (nshard == maxshard) {
+					maxshard = maxshard ? 2 * maxshard : 64;
+					w.shard = ckrealloc(w.shard, maxshard * sizeof(struct messy_shard));
+				}
+				shardof[c] = nshard;
+				w.shard[nshard].spe = i;
+				w.shard[nshard].nblk = 0;
+				w.shard[nshard].blk = NULL;
+				nshard++;
+			}
+			w.shard[shardof[c]].nblk++;
+		}
+		for (k = nshard - 1; k >= 0 && w.shard[k].spe == i; k--) {
+			w.shard[k].blk = ckalloc(w.shard[k].nblk * sizeof(struct block_list *));
+			w.shard[k].nblk = 0;
+		}
+		for (p = head; p != NULL; p = p->next)
+			if (p->speseg[i] != NULL) {
+				sh = &w.shard[shardof[find_group(parent, chr_id(p->speseg[i]->chr))]];
+				sh->blk[sh->nblk++] = p;
+			}
+	}
+	free(parent);
+	free(shardof);
+
+	w.order = ckalloc((nshard + 1) * sizeof(int));
+	for (k = 0; k < nshard; k++)
+		w.order[k] = k;
+	cmp_shards = w.shard;
+	qsort(w.order, nshard, sizeof(int), cmp_shard_size);
+	run_jobs(nshard, nthreads, clean_shard, &w);
+
+	for (k = 0; k < nshard; k++)
+		free(w.shard[k].blk);
+	free(w.shard);
+	free(w.order);
+	for (i = 0; i < NSPE; i++)
+		free_seg_index(w.index[i]);
+	free(w.index);
+}
+
+#if PAIR_STEPS
+// one thread each, as estimateBpDist runs the pairs side by side
+struct block_list *make_orthology_blocks_pair(struct block_list *blocks) {
+	const int nthreads = 1;
+
+	if (Spe->spesz != NSPE)
+		fatalf("a species pair is made from %d species, not %d", NSPE, Spe->spesz);
+#else
+struct block_list *make_orthology_blocks(struct block_list *blocks, int nthreads) {
+#endif
+	rs = ref_spe_idx();
+
+	clean_up(&blocks, nthreads);
+	clean_up_again(blocks, nthreads);
+	trim(&blocks);
+
+	assign_states(blocks);
+	assign_orders(blocks);
+
+	return blocks;
+}
+
+#ifndef NO_MAIN
+int main(int argc, char *argv[]) {
+	int binary, nthreads;
+	struct block_list *commonblocklist;
 	
+	binary = binary_blocks_arg(&argc, argv);
+#if PAIR_STEPS
 	if (argc != 3)
-		fatal("args: configure-file building-block-list");
+		fatal("args: [-bin] configure-file building-block-list");
+	nthreads = 1;
+#else
+	if (argc != 3 && argc != 4)
+		fatal("args: [-bin] configure-file building-block-list [threads]");
+	nthreads = thread_arg(argc == 4 ? argv[3] : NULL);
+#endif
+	Block_threads = nthreads;
 
 	get_spename(argv[1]);
 	get_minlen(argv[1]);
-	rs = ref_spe_idx();
-
-	commonblocklist = get_block_list(argv[2]);
-	
-	clean_up(&commonblocklist);
-	clean_up_again(commonblocklist);
-	trim(&commonblocklist);
 
-	assign_states(commonblocklist);
-	assign_orders(commonblocklist);
+#if PAIR_STEPS
+	commonblocklist = make_orthology_blocks_pair(get_block_list(argv[2]));
+#else
+	commonblocklist = make_orthology_blocks(get_block_list(argv[2]), nthreads);
+#endif
 	
-	for (blist = commonblocklist; blist != NULL; blist = blist->next) {
-		printf(">%d\n", blist->id);
-		for (i = 0; i < Spesz; i++) {
-			for (sg = blist->speseg[i]; sg != NULL; sg = sg->next) 
-				printf("%s.%s:%d-%d %c [%d] (%d)\n", 
-						Spename[i], sg->chr, sg->beg, sg->end, sg->orient, sg->state, sg->chid);
-		}
-		printf("\n");
-	}
+	write_block_list(stdout, commonblocklist, BLOCKS_ORTHOLOGY, binary);
 
 	free_block_list(commonblocklist);
 
 	return 0;
 }
+#endif
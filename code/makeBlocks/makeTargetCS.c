@@ -0,0 +1,109 @@
+/* *********************************************************
+ * keep the conserved segments the target ancestor ('@' in the
+ * tree) has: a block is in a leaf's genome if the species has a
+ * segment of it, and in the ancestor if the small parsimony of
+ * the tree puts it there whichever state the root takes.
+ * Fitch's up pass gives a node the intersection of the sets of
+ * its children, or their union when that is empty; going down,
+ * a node with one state in its set takes it, and the others take
+ * their parent's. The blocks kept are numbered again from 1.
+ * ********************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "blockfile.h"
+#include "newick.h"
+#include "stages.h"
+
+#define HAS0 0x1
+#define HAS1 0x2
+
+struct block_list *make_target_cs(struct block_list *blocks, struct newick_tree *tree) {
+	struct block_list *b, *next, *head = NULL, *last = NULL;
+	struct newick_node *n, *target;
+	int *leaf_spe, *path, npath, i, k, id = 0, root, state, keep;
+	unsigned char *set;
+
+	target = tree->marked ? tree->marked : tree->root;
+	leaf_spe = ckalloc(tree->nnode * sizeof(int));
+	set = ckalloc(tree->nnode);
+	for (i = 0; i < tree->nnode; i++) {
+		n = tree->node[i];
+		if (n->nchild != 0 && n->nchild != 2)
+			fatalf("node %s has %d children; the tree must be binary", n->name, n->nchild);
+		if (n->nchild == 0)
+			leaf_spe[i] = spe_idx(n->name);
+	}
+	// the nodes below the root down to the target
+	path = ckalloc(tree->nnode * sizeof(int));
+	for (npath = 0, n = target; n != tree->root; n = n->parent)
+		path[npath++] = n->id;
+	root = tree->root->id;
+
+	for (b = blocks; b != NULL; b = next) {
+		next = b->next;
+		// a child comes after its parent in the tree string
+		for (i = tree->nnode - 1; i >= 0; i--) {
+			n = tree->node[i];
+			if (n->nchild == 0)
+				set[i] = (b->speseg[leaf_spe[i]] != NULL) ? HAS1 : HAS0;
+			else {
+				set[i] = set[n->child[0]->id] & set[n->child[1]->id];
+				if (set[i] == 0)
+					set[i] = set[n->child[0]->id] | set[n->child[1]->id];
+			}
+		}
+		keep = 1;
+		for (state = 0; state <= 1; state++) {
+			if (!(set[root] & (state ? HAS1 : HAS0)))
+				continue;
+			for (i = state, k = npath - 1; k >= 0; k--)
+				if (set[path[k]] == HAS0 || set[path[k]] == HAS1)
+					i = (set[path[k]] == HAS1);
+			if (i != 1)
+				keep = 0;
+		}
+
+		b->next = NULL;
+		if (!keep) {
+			free_block_list(b);
+			continue;
+		}
+		b->id = ++id;
+		if (head == NULL)
+			head = last = b;
+		else {
+			last->next = b;
+			last = b;
+		}
+	}
+
+	free(leaf_spe);
+	free(set);
+	free(path);
+	return head;
+}
+
+#ifndef NO_MAIN
+int main(int argc, char* argv[]) {
+	struct block_list *blkhead;
+	struct newick_tree *tree;
+	char err[512];
+
+	if (argc != 4)
+		fatal("args: config.file tree-file conserved-segs");
+
+	get_spename(argv[1]);
+	if ((tree = newick_read(argv[2], err, sizeof(err))) == NULL)
+		fatalf("%s: %s", argv[2], err);
+	blkhead = get_block_list(argv[3]);
+	blkhead = make_target_cs(blkhead, tree);
+
+	write_block_list(stdout, blkhead, BLOCKS_PLAIN, 0);
+	if (blkhead != NULL)
+		free_block_list(blkhead);
+	newick_free(tree);
+
+	return 0;
+}
+#endif
@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <limits.h>
+#include <string.h>
+#include "manifest.h"
+#include "chromfile.h"
+#include "remote.h"
+
+/* a directory as a tool names it, and its listing (NULL for none) */
+struct dir_name {
+	char *name;
+	const struct manifest_dir *dir;
+	struct dir_name *next;
+};
+
+static struct manifest_dir *Dirs = NULL;
+static struct dir_name *Names = NULL;
+static bool Loaded = 0;
+static pthread_mutex_t ManifestLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int cmp_file(const void *a, const void *b)
+{
+	return strcmp((*(struct manifest_file * const *)a)->name,
+		(*(struct manifest_file * const *)b)->name);
+}
+
+static void *grow(void *p, int n, int *max, size_t size)
+{
+	if (n < *max)
+		return p;
+	*max = *max ? 2 * *max : 64;
+	return ckrealloc(p, *max * size);
+}
+
+static void sort_files(struct manifest_dir *d)
+{
+	int i;
+
+	d->sorted = ckalloc((d->nfile + 1) * sizeof(struct manifest_file *));
+	for (i = 0; i < d->nfile; i++)
+		d->sorted[i] = &d->file[i];
+	qsort(d->sorted, d->nfile, sizeof(struct manifest_file *), cmp_file);
+}
+
+/* load_manifest ------------------ read the file DESCHRAMBLER_MANIFEST names */
+static void load_manifest(void)
+{
+	const char *file = getenv("DESCHRAMBLER_MANIFEST");
+	char *line = NULL, *f[4], *save;
+	struct manifest_dir *d = NULL;
+	struct manifest_file *m = NULL;
+	int k, maxfile = 0, maxrun = 0, lineno = 0;
+	size_t cap = 0;
+	ssize_t n;
+	FILE *fp;
+
+	if (file == NULL || *file == '\0')
+		return;
+	fp = ckopen(file, "r");
+	while ((n = getline(&line, &cap, fp)) > 0) {
+		lineno++;
+		if (line[0] == '#')
+			continue;
+		if (line[n-1] == '\n')
+			line[n-1] = '\0';
+		f[0] = strtok_r(line, "\t", &save);
+		for (k = 1; k < 4 && f[k-1] != NULL; k++)
+			f[k] = strtok_r(NULL, k == 3 || (k == 2 && same_string(f[0], "dir")) ? "" : "\t", &save);
+		if (f[0] != NULL && same_string(f[0], "dir") && f[1] && f[2]) {
+			if (d != NULL)
+				sort_files(d);
+			d = ckallocz(sizeof(struct manifest_dir));
+			d->mtime = atoll(f[1]);
+			d->path = copy_string(f[2]);
+			d->next = Dirs;
+			Dirs = d;
+			m = NULL;
+			maxfile = 0;
+		} else if (f[0] != NULL && same_string(f[0], "file") && d && f[1] && f[2] && f[3]) {
+			d->file = grow(d->file, d->nfile, &maxfile, sizeof(struct manifest_file));
+			m = &d->file[d->nfile++];
+			m->name = copy_string(f[3]);
+			m->size = atoll(f[1]);
+			m->mtime = atoll(f[2]);
+			m->nrun = 0;
+			m->run = NULL;
+			maxrun = 0;
+		} else if (f[0] != NULL && same_string(f[0], "run") && m && f[1] && f[2] && f[3]) {
+			m->run = grow(m->run, m->nrun, &maxrun, sizeof(struct manifest_run));
+			m->run[m->nrun].chrom = copy_string(f[3]);
+			m->run[m->nrun].off = atoll(f[1]);
+			m->run[m->nrun].len = atoll(f[2]);
+			m->nrun++;
+		} else
+			fatalf("%s line %d: cannot parse the manifest", file, lineno);
+	}
+	if (d != NULL)
+		sort_files(d);
+	free(line);
+	fclose(fp);
+}
+
+/* manifest_dir --------------------------------- the listing of a directory */
+const struct manifest_dir *manifest_dir(const char *dir)
+{
+	const struct manifest_dir *found = NULL;
+	struct manifest_dir *d;
+	struct dir_name *x;
+	char real[PATH_MAX];
+	struct stat st;
+
+	if (is_url(dir))
+		return NULL;
+	pthread_mutex_lock(&ManifestLock);
+	if (!Loaded) {
+		load_manifest();
+		Loaded = 1;
+	}
+	for (x = Names; x != NULL; x = x->next)
+		if (same_string(x->name, dir))
+			break;
+	if (x == NULL) {
+		if (Dirs != NULL && realpath(dir, real) != NULL && stat(real, &st) == 0)
+			for (d = Dirs; d != NULL; d = d->next)
+				if (same_string(d->path, real)) {
+					if (d->mtime == st.st_mtime)
+						found = d;
+					else
+						fprintf(stderr, "- %s changed since the manifest; reading it\n", dir);
+					break;
+				}
+		x = ckalloc(sizeof(struct dir_name));
+		x->name = copy_string(dir);
+		x->dir = found;
+		x->next = Names;
+		Names = x;
+	}
+	pthread_mutex_unlock(&ManifestLock);
+	return x->dir;
+}
+
+/* manifest_file ------------------------ a file of a directory listed */
+const struct manifest_file *manifest_file(const struct manifest_dir *d, const char *name)
+{
+	int lo = 0, hi = d->nfile, mid, c;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if ((c = strcmp(d->sorted[mid]->name, name)) == 0)
+			return d->sorted[mid];
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+/* write_manifest_dir ------------------- list a directory for the manifest */
+bool write_manifest_dir(FILE *fp, const char *dir)
+{
+	const char *exts[] = {".net", ".chain"};
+	char real[PATH_MAX], path[PATH_MAX + 300], name[300];
+	struct manifest_run *run;
+	struct dirent *ent;
+	struct stat st;
+	int i, k, n;
+	DIR *dp;
+
+	// indexed first, for the time of the directory to be that with the indexes
+	for (k = 0; k < 2; k++)
+		if ((n = chrom_runs(dir, exts[k], &run)) >= 0) {
+			for (i = 0; i < n; i++)
+				free(run[i].chrom);
+			free(run);
+		}
+	if (realpath(dir, real) == NULL || stat(real, &st) != 0 || (dp = opendir(real)) == NULL)
+		return 0;
+	fprintf(fp, "dir\t%lld\t%s\n", (long long)st.st_mtime, real);
+	while ((ent = readdir(dp)) != NULL) {
+		if (same_string(ent->d_name, ".") || same_string(ent->d_name, ".."))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", real, ent->d_name);
+		if (stat(path, &st) != 0)
+			continue;
+		fprintf(fp, "file\t%lld\t%lld\t%s\n", (long long)st.st_size,
+			(long long)st.st_mtime, ent->d_name);
+		for (k = 0; k < 2; k++) {
+			snprintf(name, sizeof(name), "all%s", exts[k]);
+			if (!same_string(ent->d_name, name) && !same_string(ent->d_name, strcat(name, ".gz")))
+				continue;
+			if ((n = chrom_runs(real, exts[k], &run)) < 0)
+				continue;
+			for (i = 0; i < n; i++) {
+				fprintf(fp, "run\t%lld\t%lld\t%s\n", (long long)run[i].off,
+					(long long)run[i].len, run[i].chrom);
+				free(run[i].chrom);
+			}
+			free(run);
+		}
+	}
+	closedir(dp);
+	return 1;
+}
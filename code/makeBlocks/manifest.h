@@ -0,0 +1,66 @@
+/* **************************************************************
+ * The listing of the net and chain directories of a run, made once
+ * by listInputs, from which the tools find their inputs without
+ * reading the directories. On a parallel file system a directory of
+ * scaffold-level nets holds tens of thousands of files, and the
+ * readdir() of every tool over it and the access() of every
+ * chromosome a species has no net of cost more than the reading.
+ * With DESCHRAMBLER_MANIFEST naming the file, open_chrom(),
+ * dir_chroms(), the chain store and the segment cache take the files
+ * of a listed directory, their sizes and times and the chromosome
+ * runs of a whole-genome file (the all.net.idx of chromfile.h) from
+ * it. A directory is looked at once, for its time: one whose time is
+ * not the listed one has had files added or taken out since, and is
+ * read as without the manifest. The fields are tab-separated, the
+ * name last:
+ *
+ *   dir	<mtime>	<real path>
+ *   file	<size>	<mtime>	<name>		(in directory order)
+ *   run	<offset>	<length>	<chromosome>	(of the file before)
+ * **************************************************************/
+
+#ifndef _MANIFEST_H_
+#define _MANIFEST_H_
+
+#include <sys/types.h>
+#include <time.h>
+#include "util.h"
+
+struct manifest_run {
+	char *chrom;
+	off_t off, len;
+};
+
+struct manifest_file {
+	char *name;
+	off_t size;
+	time_t mtime;
+	int nrun;
+	struct manifest_run *run;	// of a whole-genome file, in file order
+};
+
+struct manifest_dir {
+	char *path;
+	time_t mtime;
+	int nfile;
+	struct manifest_file *file;		// in directory order
+	struct manifest_file **sorted;	// by name
+	struct manifest_dir *next;
+};
+
+/* **************************************************************
+ * The listing of dir; NULL with no manifest, for a URL, or for a
+ * directory it does not list or that has changed since.
+ * **************************************************************/
+const struct manifest_dir *manifest_dir(const char *dir);
+
+// the file of a listed directory, NULL if it has none of that name
+const struct manifest_file *manifest_file(const struct manifest_dir *d, const char *name);
+
+/* **************************************************************
+ * Writes the listing of dir to fp, with the chromosome runs of its
+ * whole-genome files; 0 if dir cannot be read.
+ * **************************************************************/
+bool write_manifest_dir(FILE *fp, const char *dir);
+
+#endif
@@ -0,0 +1,50 @@
+/* *****************************************************************
+ * join the binary block lists of the jobs of a sharded run (as
+ * partitionGenomes -shard writes them, numbered from 1 each) in the
+ * order given, numbering the blocks on from one list to the next, into
+ * the list a single run would have written, states and orders assigned
+ * again over the whole of it
+ * ****************************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "blockfile.h"
+
+int main(int argc, char *argv[]) {
+	struct block_list *head = NULL, *tail = NULL, *list, *p;
+	enum block_style style = BLOCKS_BUILDING, s;
+	int binary, i, base = 0, last = 0;
+
+	binary = binary_blocks_arg(&argc, argv);
+	if (argc < 3)
+		fatal("args: [-bin] config.file block-list...");
+
+	get_spename(argv[1]);
+	for (i = 2; i < argc; i++) {
+		if (!is_block_file(argv[i]))
+			fatalf("%s is not a binary block list", argv[i]);
+		list = read_block_file(argv[i], &s);
+		if (i > 2 && s != style)
+			fatalf("%s is not of the style of %s", argv[i], argv[2]);
+		style = s;
+		for (p = list; p != NULL; p = p->next) {
+			p->id += base;
+			last = p->id;
+		}
+		base = last;
+		if (list == NULL)
+			continue;
+		if (head == NULL)
+			head = list;
+		else
+			tail->next = list;
+		for (tail = list; tail->next != NULL; tail = tail->next)
+			;
+	}
+	reread_block_list(head, style);
+	write_block_list(stdout, head, style, binary);
+	if (head != NULL)
+		free_block_list(head);
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include "newick.h"
+
+struct parser {
+	const char *p;
+	struct newick_tree *t;
+	int cap, unnamed;
+	char *err;
+	int errsz, failed;
+};
+
+static void parse_error(struct parser *ps, const char *fmt, ...) {
+	va_list ap;
+
+	if (ps->failed)
+		return;
+	ps->failed = 1;
+	va_start(ap, fmt);
+	vsnprintf(ps->err, ps->errsz, fmt, ap);
+	va_end(ap);
+}
+
+static int is_sep(char c) {
+	return c == ',' || c == '(' || c == ')' || c == ';' || c == ':' || c == '\0';
+}
+
+static struct newick_node *new_node(struct parser *ps, struct newick_node *parent) {
+	struct newick_node *n = calloc(1, sizeof(struct newick_node));
+	struct newick_tree *t = ps->t;
+
+	if (t->nnode == ps->cap) {
+		ps->cap = ps->cap ? 2 * ps->cap : 64;
+		t->node = realloc(t->node, ps->cap * sizeof(struct newick_node *));
+	}
+	n->id = t->nnode;
+	t->node[t->nnode++] = n;
+	n->parent = parent;
+	if (parent != NULL) {
+		parent->child = realloc(parent->child, (parent->nchild + 1) * sizeof(struct newick_node *));
+		parent->child[parent->nchild++] = n;
+	}
+	return n;
+}
+
+// the name and branch length after a node
+static void parse_label(struct parser *ps, struct newick_node *n, int internal) {
+	const char *q;
+	char *end;
+	int len;
+
+	if (internal && *ps->p == '@') {
+		if (ps->t->marked == NULL)
+			ps->t->marked = n;
+		ps->p++;
+	}
+	for (q = ps->p; !is_sep(*q); q++)
+		;
+	len = q - ps->p;
+	n->name = malloc(len > 0 ? len + 1 : 24);
+	if (len > 0) {
+		memcpy(n->name, ps->p, len);
+		n->name[len] = '\0';
+	} else
+		sprintf(n->name, "IN%d", ++ps->unnamed);
+	ps->p = q;
+
+	if (*ps->p == ':') {
+		ps->p++;
+		n->dist = strtod(ps->p, &end);
+		if (end == ps->p)
+			parse_error(ps, "cannot parse the branch length at %.20s", ps->p);
+		for (ps->p = end; !is_sep(*ps->p); ps->p++)
+			;
+	}
+}
+
+static void parse_node(struct parser *ps, struct newick_node *parent) {
+	struct newick_node *n = new_node(ps, parent);
+
+	if (*ps->p != '(') {
+		parse_label(ps, n, 0);
+		return;
+	}
+	do {
+		ps->p++;
+		parse_node(ps, n);
+		if (ps->failed)
+			return;
+	} while (*ps->p == ',');
+	if (*ps->p != ')') {
+		parse_error(ps, "unbalanced tree at %.20s", ps->p);
+		return;
+	}
+	ps->p++;
+	parse_label(ps, n, 1);
+}
+
+struct newick_tree *newick_parse(const char *s, char *err, int errsz) {
+	struct parser ps;
+	char *buf, *q;
+
+	// white space is not part of a name
+	buf = malloc(strlen(s) + 1);
+	for (q = buf; *s != '\0'; s++)
+		if (!isspace((unsigned char)*s))
+			*q++ = *s;
+	*q = '\0';
+
+	memset(&ps, 0, sizeof(ps));
+	ps.p = buf;
+	ps.t = calloc(1, sizeof(struct newick_tree));
+	ps.err = err;
+	ps.errsz = errsz;
+	if (*ps.p == '\0' || *ps.p == ';')
+		parse_error(&ps, "empty tree");
+	else {
+		parse_node(&ps, NULL);
+		if (*ps.p != ';' && *ps.p != '\0')
+			parse_error(&ps, "unexpected '%c' at %.20s", *ps.p, ps.p);
+	}
+	free(buf);
+	if (ps.failed) {
+		newick_free(ps.t);
+		return NULL;
+	}
+	ps.t->root = ps.t->node[0];
+	return ps.t;
+}
+
+struct newick_tree *newick_read(const char *fname, char *err, int errsz) {
+	struct newick_tree *t;
+	char *s = NULL, line[4096];
+	size_t len = 0, l;
+	FILE *fp;
+
+	if ((fp = fopen(fname, "r")) == NULL) {
+		snprintf(err, errsz, "cannot open %s", fname);
+		return NULL;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		l = strlen(line);
+		s = realloc(s, len + l + 1);
+		memcpy(s + len, line, l + 1);
+		len += l;
+		if (strchr(line, ';') != NULL)
+			break;
+	}
+	fclose(fp);
+	t = newick_parse(s ? s : "", err, errsz);
+	free(s);
+	return t;
+}
+
+void newick_free(struct newick_tree *t) {
+	int i;
+
+	if (t == NULL)
+		return;
+	for (i = 0; i < t->nnode; i++) {
+		free(t->node[i]->child);
+		free(t->node[i]->name);
+		free(t->node[i]);
+	}
+	free(t->node);
+	free(t);
+}
+
+struct newick_node *newick_find(const struct newick_tree *t, const char *name) {
+	int i;
+
+	for (i = 0; i < t->nnode; i++)
+		if (strcmp(t->node[i]->name, name) == 0)
+			return t->node[i];
+	return NULL;
+}
+
+int newick_below(const struct newick_node *n, const struct newick_node *anc) {
+	for ( ; n != NULL; n = n->parent)
+		if (n == anc)
+			return 1;
+	return 0;
+}
+
+struct newick_node *newick_lca(struct newick_node *a, struct newick_node *b) {
+	for ( ; a != NULL; a = a->parent)
+		if (newick_below(b, a))
+			return a;
+	return NULL;
+}
+
+double newick_distance(struct newick_node *a, struct newick_node *b) {
+	struct newick_node *lca = newick_lca(a, b), *n;
+	double d = 0;
+
+	for (n = a; n != lca; n = n->parent)
+		d += n->dist;
+	for (n = b; n != lca; n = n->parent)
+		d += n->dist;
+	return d;
+}
+
+void newick_write(FILE *fp, const struct newick_node *n) {
+	int i;
+
+	if (n->nchild > 0) {
+		fputc('(', fp);
+		for (i = 0; i < n->nchild; i++) {
+			if (i > 0)
+				fputc(',', fp);
+			newick_write(fp, n->child[i]);
+			fprintf(fp, ":%.15g", n->child[i]->dist);
+		}
+		fputc(')', fp);
+	}
+	fputs(n->name, fp);
+}
@@ -0,0 +1,59 @@
+/* **************************************************************
+ * Newick trees, as the tree file of a run gives them: a node may
+ * have any number of children, a name and a branch length. An
+ * internal node written as ")@name" is the marked ancestor to
+ * reconstruct; nodes with no name are called IN1, IN2, ... in the
+ * order they are read, as inferAdjProb names them.
+ *
+ * The parser needs nothing but libc, so that inferAdjProb and the
+ * makeBlocks tools share it; newickTool runs it from the shell.
+ * **************************************************************/
+
+#ifndef _NEWICK_H_
+#define _NEWICK_H_
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct newick_node {
+	struct newick_node *parent;
+	struct newick_node **child;
+	int nchild;
+	char *name;
+	double dist;		// the branch above, 0 if none is given
+	int id;				// 0.. in the order of the tree string
+};
+
+struct newick_tree {
+	struct newick_node *root;
+	struct newick_node *marked;	// the '@' node, NULL if none
+	struct newick_node **node;	// by id
+	int nnode;
+};
+
+/* NULL on an error, with a message in err; the tree ends at the first
+ * ';', or with the string */
+struct newick_tree *newick_parse(const char *s, char *err, int errsz);
+// the lines of the file, up to the first ';'
+struct newick_tree *newick_read(const char *fname, char *err, int errsz);
+void newick_free(struct newick_tree *t);
+
+// the first node of the name in id order, NULL if none
+struct newick_node *newick_find(const struct newick_tree *t, const char *name);
+struct newick_node *newick_lca(struct newick_node *a, struct newick_node *b);
+/* the branch lengths on the path from a to b, summed from a up to
+ * their common ancestor and then from b up to it */
+double newick_distance(struct newick_node *a, struct newick_node *b);
+// whether n is anc or below it
+int newick_below(const struct newick_node *n, const struct newick_node *anc);
+// the subtree of n as a newick string, with its branch lengths
+void newick_write(FILE *fp, const struct newick_node *n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
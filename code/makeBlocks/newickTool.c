@@ -0,0 +1,127 @@
+/* *****************************************************************
+ * The tree arithmetic of the scripts, on the newick parser of
+ * newick.h:
+ *
+ *   newickTool dist tree-file node1 node2
+ *     the branch lengths between two nodes
+ *   newickTool subtree tree-file [node]
+ *     the subtree of a node as a newick string
+ *   newickTool leaves tree-file [node]
+ *     the leaves below a node, one per line, in tree order
+ *   newickTool jc tree-file num-blocks target-species bpdist-file
+ *     the JC parameter of script/estparJC.pl: the mean over the
+ *     species of bpdist-file with breakpoints of
+ *       -log(1 - (2n-1)d / ((2n-2)n)) / (2n-1) / t
+ *     for d breakpoints at distance t from the target in the tree
+ *
+ * A node is named as in the tree; '@' is the marked ancestor, which
+ * the node arguments default to (the root if there is none).
+ * *****************************************************************/
+
+#include "util.h"
+#include "newick.h"
+
+static struct newick_tree *read_tree(char *fname) {
+	struct newick_tree *t;
+	char err[512];
+
+	if ((t = newick_read(fname, err, sizeof(err))) == NULL)
+		fatalf("%s: %s", fname, err);
+	return t;
+}
+
+static struct newick_node *find_node(struct newick_tree *t, char *name) {
+	struct newick_node *n;
+
+	if (name == NULL || strcmp(name, "@") == 0)
+		return t->marked ? t->marked : t->root;
+	if ((n = newick_find(t, name)) == NULL)
+		fatalf("no node %s in the tree", name);
+	return n;
+}
+
+static void print_leaves(struct newick_node *n) {
+	int i;
+
+	if (n->nchild == 0)
+		printf("%s\n", n->name);
+	for (i = 0; i < n->nchild; i++)
+		print_leaves(n->child[i]);
+}
+
+struct bpdist {
+	char name[100];
+	double d;
+};
+
+static int bpdist_cmp(const void *a, const void *b) {
+	return strcmp(((const struct bpdist *)a)->name, ((const struct bpdist *)b)->name);
+}
+
+// estparJC.pl: the species in name order, the last line of each counting
+static double estimate_jc(struct newick_tree *t, double n, char *target, char *bdist_f) {
+	struct bpdist *bd = NULL;
+	struct newick_node *tar = find_node(t, target);
+	char buf[500], name[100];
+	double d, cmp, a, sum = 0;
+	int nbd = 0, max = 0, i, cnt = 0;
+	FILE *fp;
+
+	fp = ckopen(bdist_f, "r");
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (buf[0] == '#' || sscanf(buf, "%99s %lf", name, &d) != 2 || d == 0)
+			continue;
+		for (i = 0; i < nbd && strcmp(bd[i].name, name) != 0; i++)
+			;
+		if (i == nbd) {
+			if (nbd == max) {
+				max = max ? 2 * max : 16;
+				bd = ckrealloc(bd, max * sizeof(struct bpdist));
+			}
+			strcpy(bd[nbd++].name, name);
+		}
+		bd[i].d = d;
+	}
+	fclose(fp);
+	qsort(bd, nbd, sizeof(struct bpdist), bpdist_cmp);
+
+	for (i = 0; i < nbd; i++) {
+		cmp = 1 - ((2*n-1)*bd[i].d)/((2*n-2)*n);
+		if (cmp <= 0.0)
+			continue;
+		a = -1/(2*n-1) * log(cmp);
+		d = newick_distance(find_node(t, bd[i].name), tar);
+		if (d == 0)
+			fatalf("%s is at no distance from %s", bd[i].name, target);
+		a /= d;
+		sum += a;
+		cnt++;
+	}
+	free(bd);
+	return cnt > 0 ? sum/cnt : 0.0001;
+}
+
+int main(int argc, char *argv[]) {
+	struct newick_tree *t;
+
+	if (argc >= 3 && argc <= 4 && strcmp(argv[1], "subtree") == 0) {
+		t = read_tree(argv[2]);
+		newick_write(stdout, find_node(t, argc == 4 ? argv[3] : NULL));
+		printf(";\n");
+	} else if (argc >= 3 && argc <= 4 && strcmp(argv[1], "leaves") == 0) {
+		t = read_tree(argv[2]);
+		print_leaves(find_node(t, argc == 4 ? argv[3] : NULL));
+	} else if (argc == 5 && strcmp(argv[1], "dist") == 0) {
+		t = read_tree(argv[2]);
+		printf("%.15g\n", newick_distance(find_node(t, argv[3]), find_node(t, argv[4])));
+	} else if (argc == 6 && strcmp(argv[1], "jc") == 0) {
+		t = read_tree(argv[2]);
+		printf("%.15g\n", estimate_jc(t, atof(argv[3]), argv[4], argv[5]));
+	} else
+		fatal("args: dist tree-file node1 node2\n"
+			"      subtree tree-file [node]\n"
+			"      leaves tree-file [node]\n"
+			"      jc tree-file num-blocks target-species bpdist-file");
+	newick_free(t);
+	return 0;
+}
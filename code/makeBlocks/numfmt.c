@@ -0,0 +1,124 @@
+#include <math.h>
+#include <stdint.h>
+#include "numfmt.h"
+
+static const char Digits2[201] =
+	"00010203040506070809101112131415161718192021222324"
+	"25262728293031323334353637383940414243444546474849"
+	"50515253545556575859606162636465666768697071727374"
+	"75767778798081828384858687888990919293949596979899";
+
+// the powers of ten that a long double holds exactly (5^27 < 2^64)
+#define EXACT_POW	27
+
+static const long double Pow10[EXACT_POW + 1] = {
+	1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L,
+	1e7L, 1e8L, 1e9L, 1e10L, 1e11L, 1e12L, 1e13L,
+	1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L,
+	1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L,
+};
+
+/* fmt_uint -------------------------------- the digits of v, two at a time */
+static char *fmt_uint(char *p, unsigned long v)
+{
+	char tmp[FMT_INT_MAX], *t = tmp + sizeof(tmp);
+	unsigned r;
+
+	while (v >= 100) {
+		r = v % 100;
+		v /= 100;
+		t -= 2;
+		memcpy(t, Digits2 + 2 * r, 2);
+	}
+	if (v >= 10) {
+		t -= 2;
+		memcpy(t, Digits2 + 2 * v, 2);
+	} else
+		*--t = '0' + v;
+	memcpy(p, t, tmp + sizeof(tmp) - t);
+	return p + (tmp + sizeof(tmp) - t);
+}
+
+char *fmt_int(char *p, long v)
+{
+	if (v < 0) {
+		*p++ = '-';
+		return fmt_uint(p, -(unsigned long)v);
+	}
+	return fmt_uint(p, v);
+}
+
+/* scale10 ----------------------------------------------- v times 10^k */
+/* in steps of exact powers, each rounded once in the 64 bits of a long
+ * double, so that even 10^-320 leaves it within 1e-17 of the true value */
+static long double scale10(double v, int k)
+{
+	long double x = v;
+
+	for (; k > EXACT_POW; k -= EXACT_POW)
+		x *= Pow10[EXACT_POW];
+	for (; k < -EXACT_POW; k += EXACT_POW)
+		x /= Pow10[EXACT_POW];
+	return k >= 0 ? x * Pow10[k] : x / Pow10[-k];
+}
+
+/* fmt_exp ----------------------------------------------- v as "%e" does */
+/* the seven digits are v scaled into [1e6, 1e7) and rounded; a value that
+ * comes within 1e-6 of halfway, where the error of scaling could decide,
+ * is left to snprintf(), which rounds the exact binary value */
+char *fmt_exp(char *p, double v)
+{
+	long double s, f;
+	unsigned long m;
+	double a = fabs(v);
+	char *q = p;
+	int e;
+
+	if (!isfinite(v))
+		return p + snprintf(p, FMT_EXP_MAX, "%e", v);
+	if (signbit(v))
+		*q++ = '-';
+	if (a == 0) {
+		memcpy(q, "0.000000e+00", 12);
+		return q + 12;
+	}
+	e = (int)floor(log10(a));
+	s = scale10(a, 6 - e);
+	if (s < 1e6L)
+		s = scale10(a, 6 - --e);
+	else if (s >= 1e7L)
+		s = scale10(a, 6 - ++e);
+	m = (unsigned long)s;
+	f = s - m;
+	if (fabsl(f - 0.5L) < 1e-6L)
+		return p + snprintf(p, FMT_EXP_MAX, "%e", v);
+	if (f > 0.5L)
+		m++;
+	if (m >= 10000000) {
+		m /= 10;
+		e++;
+	}
+	q[0] = '0' + m / 1000000;
+	q[1] = '.';
+	m %= 1000000;
+	memcpy(q + 2, Digits2 + 2 * (m / 10000), 2);
+	memcpy(q + 4, Digits2 + 2 * (m / 100 % 100), 2);
+	memcpy(q + 6, Digits2 + 2 * (m % 100), 2);
+	q[8] = 'e';
+	q[9] = e < 0 ? '-' : '+';
+	e = e < 0 ? -e : e;
+	if (e >= 100) {
+		q[10] = '0' + e / 100;
+		memcpy(q + 11, Digits2 + 2 * (e % 100), 2);
+		return q + 13;
+	}
+	memcpy(q + 10, Digits2 + 2 * e, 2);
+	return q + 12;
+}
+
+void text_flush(struct text_buf *t)
+{
+	if (t->p > t->data)
+		fwrite(t->data, 1, t->p - t->data, t->fp);
+	t->p = t->data;
+}
@@ -0,0 +1,89 @@
+/* **************************************************************
+ * Numbers formatted for the large text writers (the block lists,
+ * the mapping files, adjacencies.prob, the APCFs) without printf:
+ * fmt_int() writes an integer two digits at a time, and fmt_exp()
+ * a double exactly as printf's "%e" does, so that the files and
+ * their readers are the same as before. A text_buf gathers a line
+ * or more on the stack and hands it to its stream in one fwrite().
+ * Nothing here uses the rest of makeBlocks, so code/ links it too.
+ * **************************************************************/
+
+#ifndef _NUMFMT_H_
+#define _NUMFMT_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FMT_INT_MAX	21	// the most chars fmt_int() writes
+#define FMT_EXP_MAX	24	// and fmt_exp()
+
+// write v at p, without a '\0'; return the end
+char *fmt_int(char *p, long v);
+char *fmt_exp(char *p, double v);
+
+#define TEXT_BUF	8192
+
+struct text_buf {
+	FILE *fp;
+	char *p;
+	char data[TEXT_BUF];
+};
+
+// write out what t holds; errors are left in the stream for fclose()
+void text_flush(struct text_buf *t);
+
+static inline void text_begin(struct text_buf *t, FILE *fp)
+{
+	t->fp = fp;
+	t->p = t->data;
+}
+
+// room for n more chars, n at most TEXT_BUF
+static inline char *text_room(struct text_buf *t, size_t n)
+{
+	if ((size_t)(t->data + TEXT_BUF - t->p) < n)
+		text_flush(t);
+	return t->p;
+}
+
+static inline void text_mem(struct text_buf *t, const char *s, size_t len)
+{
+	if (len > TEXT_BUF) {
+		text_flush(t);
+		fwrite(s, 1, len, t->fp);
+		return;
+	}
+	memcpy(text_room(t, len), s, len);
+	t->p += len;
+}
+
+static inline void text_str(struct text_buf *t, const char *s)
+{
+	text_mem(t, s, strlen(s));
+}
+
+static inline void text_char(struct text_buf *t, char c)
+{
+	*text_room(t, 1) = c;
+	t->p++;
+}
+
+static inline void text_int(struct text_buf *t, long v)
+{
+	t->p = fmt_int(text_room(t, FMT_INT_MAX), v);
+}
+
+static inline void text_exp(struct text_buf *t, double v)
+{
+	t->p = fmt_exp(text_room(t, FMT_EXP_MAX), v);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+#include "util.h"
+#include "orders.h"
+
+static int wanted(enum order_species which, int spe)
+{
+	switch (which) {
+	case ORDER_INGROUPS:
+		return Spe->spetag[spe] != 2;
+	case ORDER_OUTGROUPS:
+		return Spe->spetag[spe] == 2;
+	default:
+		return 1;
+	}
+}
+
+static int cmp_order_seg(const void *a, const void *b)
+{
+	const struct order_seg *x = a, *y = b;
+
+	if (x->chr != y->chr)
+		return x->chr - y->chr;
+	if (x->beg != y->beg)
+		return (x->beg > y->beg) - (x->beg < y->beg);
+	return x->seq - y->seq;
+}
+
+static int cmp_seq(const void *a, const void *b)
+{
+	return ((const struct order_seg *)a)->seq - ((const struct order_seg *)b)->seq;
+}
+
+/* the list insertion the tools did, for the n segments of a chromosome
+ * with tied begs; s is in the order the segments came */
+static void insert_in_turn(struct order_seg *s, int n)
+{
+	struct order_seg *t = ckalloc(n * sizeof(struct order_seg));
+	int *next = ckalloc(n * sizeof(int));
+	int head = -1, k, p, pp;
+
+	for (k = 0; k < n; k++) {
+		pp = -1;
+		for (p = head; p >= 0; p = next[p]) {
+			if ((pp < 0 && s[k].beg < s[p].beg)
+					|| (pp >= 0 && s[k].beg < s[p].beg && s[k].beg > s[pp].beg))
+				break;
+			pp = p;
+		}
+		if (pp < 0) {
+			next[k] = head;
+			head = k;
+		}
+		else {
+			next[k] = next[pp];
+			next[pp] = k;
+		}
+	}
+	for (k = 0, p = head; p >= 0; p = next[p])
+		t[k++] = s[p];
+	memcpy(s, t, n * sizeof(struct order_seg));
+	free(next);
+	free(t);
+}
+
+static void make_order(struct spe_order *o, struct block_list *head, int spe, int first_only)
+{
+	struct block_list *bk;
+	struct seg_list *sg;
+	int *slot, c, j, k, n = 0, maxchr = 0;
+
+	for (bk = head; bk != NULL; bk = bk->next)
+		for (sg = bk->speseg[spe]; sg != NULL; sg = first_only ? NULL : sg->next)
+			n++;
+	o->seg = ckalloc((n + 1) * sizeof(struct order_seg));
+	slot = ckallocz((chr_count() + 1) * sizeof(int));
+
+	// slot maps a chromosome id to 1 + its index in the order
+	for (bk = head; bk != NULL; bk = bk->next)
+		for (sg = bk->speseg[spe]; sg != NULL; sg = first_only ? NULL : sg->next) {
+			c = chr_id(sg->chr);
+			if (slot[c] == 0) {
+				if (o->nchr == maxchr) {
+					maxchr = maxchr ? 2 * maxchr : 64;
+					o->chr = ckrealloc(o->chr, maxchr * sizeof(char *));
+				}
+				o->chr[o->nchr] = sg->chr;
+				slot[c] = ++o->nchr;
+			}
+			o->seg[o->nseg].id = sg->id;
+			o->seg[o->nseg].subid = sg->subid;
+			o->seg[o->nseg].beg = sg->beg;
+			o->seg[o->nseg].seq = o->nseg;
+			o->seg[o->nseg].chr = slot[c] - 1;
+			o->seg[o->nseg].orient = sg->orient;
+			o->seg[o->nseg].state = sg->state;
+			o->nseg++;
+		}
+	free(slot);
+	if (o->nseg > 0)
+		qsort(o->seg, o->nseg, sizeof(struct order_seg), cmp_order_seg);
+
+	o->first = ckallocz((o->nchr + 1) * sizeof(int));
+	for (k = 0; k < o->nseg; k++)
+		o->first[o->seg[k].chr + 1]++;
+	for (j = 0; j < o->nchr; j++)
+		o->first[j+1] += o->first[j];
+	for (j = 0; j < o->nchr; j++) {
+		for (k = o->first[j] + 1; k < o->first[j+1]; k++)
+			if (o->seg[k].beg == o->seg[k-1].beg)
+				break;
+		if (k < o->first[j+1]) {
+			n = o->first[j+1] - o->first[j];
+			qsort(o->seg + o->first[j], n, sizeof(struct order_seg), cmp_seq);
+			insert_in_turn(o->seg + o->first[j], n);
+		}
+	}
+}
+
+struct spe_order *make_orders(struct block_list *head, enum order_species which, int first_only)
+{
+	struct spe_order *o = ckallocz(Spe->spesz * sizeof(struct spe_order));
+	int i;
+
+	for (i = 0; i < Spe->spesz; i++) {
+		if (wanted(which, i))
+			make_order(&o[i], head, i, first_only);
+		else
+			o[i].first = ckallocz(sizeof(int));
+	}
+	return o;
+}
+
+void free_orders(struct spe_order *o)
+{
+	int i;
+
+	for (i = 0; i < Spe->spesz; i++) {
+		free(o[i].chr);
+		free(o[i].first);
+		free(o[i].seg);
+	}
+	free(o);
+}
@@ -0,0 +1,39 @@
+/* **************************************************************
+ * The order of a block list along the genome of each species, as
+ * printed by orthoBlocksToOrders, outgroupSegsToOrders and
+ * createGenomeFile: the segments of a species grouped by chromosome,
+ * chromosomes in order of first use, each sorted by beg. The tools
+ * used to insert every segment into a sorted linked list; a segment
+ * whose beg was already on its chromosome went to the end of the
+ * list, and chromosomes with such ties are still built that way so
+ * the orders do not change.
+ * **************************************************************/
+
+#ifndef _ORDERS_H_
+#define _ORDERS_H_
+
+#include "species.h"
+
+struct order_seg {
+	int id, subid, beg, seq;
+	int chr;		// index of its chromosome in the species order
+	char orient;
+	enum segstate state;
+};
+
+struct spe_order {
+	int nchr, nseg;
+	const char **chr;	// chr[j], j < nchr
+	int *first;			// chromosome j holds seg[first[j]..first[j+1])
+	struct order_seg *seg;
+};
+
+// which species get an order
+enum order_species {ORDER_INGROUPS, ORDER_OUTGROUPS, ORDER_ALL};
+
+/* Spesz orders, empty for the species not asked for; first_only takes
+ * a block's first segment of a species only */
+struct spe_order *make_orders(struct block_list *head, enum order_species which, int first_only);
+void free_orders(struct spe_order *o);
+
+#endif
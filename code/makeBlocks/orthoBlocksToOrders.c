@@ -4,93 +4,47 @@
 
 #include "util.h"
 #include "species.h"
+#include "orders.h"
+#include "stages.h"
 
-int main(int argc, char* argv[]) {
-	int i, j;
-	struct seg_list ***head;
-	struct seg_list *pp, *p, *q, *sg;
-	struct block_list *blkhead, *bk;
-	int total[MAXSPE];
-	
-	if (argc != 3)
-		fatal("arg: config.file block-list");
-	
-	head = malloc(sizeof(struct seg_list**) * MAXSPE);
-	for (j = 0; j < MAXSPE; j++) {
-		total[j] = 0;
-		head[j] = malloc(sizeof(struct seg_list*) * MAXCHR);
-		for (i = 0; i < MAXCHR; i++)
-			head[j][i] = NULL;
-	}
-	get_spename(argv[1]);
-	blkhead = get_block_list(argv[2]);
-	
-	for (bk = blkhead; bk != NULL; bk = bk->next) {
-		for (i = 0; i < Spesz; i++) {
-			if (Spetag[i] == 2)
-				continue;
-			sg = bk->speseg[i];
-			if (sg == NULL) continue;
-			for (j = 0; j < total[i]; j++) 
-				if (same_string((head[i][j])->chr, sg->chr))
-					break;
-				
-			q = (struct seg_list *)ckalloc(sizeof(struct seg_list));
-			q->cidlist = NULL;
-			q->next = NULL;
-			q->id = sg->id;
-			q->beg = sg->beg;
-			q->end = sg->end;
-			q->orient = sg->orient;
-			strcpy(q->chr, sg->chr);
-	
-			if (j == total[i]) {
-				head[i][j] = q;
-				++total[i];
-			}
-			else {
-				pp = NULL;
-				for (p = head[i][j]; p != NULL; p = p->next) {
-					if ((pp == NULL && q->beg < p->beg)
-							|| (pp != NULL && q->beg < p->beg && q->beg > pp->beg))
-						break;
-					pp = p;
-				}
-				if (pp == NULL) {
-					q->next = p;
-					head[i][j] = q;
-				}
-				else {
-					q->next = pp->next;
-					pp->next = q;
-				}
-			}
-		}
-	}
-	
-	for (i = 0; i < Spesz; i++) {
-		if (Spetag[i] == 2)
+void ortho_blocks_to_orders(struct block_list *blkhead, FILE *out) {
+	int i, j, k;
+	struct spe_order *o;
+	struct order_seg *p;
+
+	o = make_orders(blkhead, ORDER_INGROUPS, 1);
+	for (i = 0; i < Spe->spesz; i++) {
+		if (Spe->spetag[i] == 2)
 			continue;
-		printf(">%s\n", Spename[i]);
-		for (j = 0; j < total[i]; j++) {
-			printf("# %s\n", head[i][j]->chr);
-			for (p = head[i][j]; p != NULL; p = p->next) {
+		fprintf(out, ">%s\n", Spe->spename[i]);
+		for (j = 0; j < o[i].nchr; j++) {
+			fprintf(out, "# %s\n", o[i].chr[j]);
+			for (k = o[i].first[j]; k < o[i].first[j+1]; k++) {
+				p = &o[i].seg[k];
 				if (p->orient == '+')
-					printf("%d ", p->id);
+					fprintf(out, "%d ", p->id);
 				else
-					printf("-%d ", p->id);
+					fprintf(out, "-%d ", p->id);
 			}
-			printf("$\n");
+			fprintf(out, "$\n");
 		}
-		printf("\n");
+		fprintf(out, "\n");
 	}
+	free_orders(o);
+}
 
-	for (i = 0; i < Spesz; i++) {
-		for (j = 0; j < total[i]; j++)
-			free_seg_list(head[i][j]);
-	}
+#ifndef NO_MAIN
+int main(int argc, char* argv[]) {
+	struct block_list *blkhead;
 	
-	free_block_list(blkhead);
+	if (argc != 3)
+		fatal("arg: config.file block-list");
 	
+	get_spename(argv[1]);
+	blkhead = get_block_list(argv[2]);
+	ortho_blocks_to_orders(blkhead, stdout);
+	free_block_list(blkhead);
+
 	return 0;
 }
+#endif
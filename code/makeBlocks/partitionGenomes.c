@@ -1,13 +1,51 @@
 /* ****************************************************************
  *	partition the genomes into blocks using one species as reference
+ *
+ *	With -stream the processed.segs are not loaded whole: a first pass
+ *	finds the lines of each reference chromosome, and the chromosomes
+ *	are then read back, partitioned and written out a few at a time
+ *	(as many as there are threads), so that memory is bounded by the
+ *	largest of them. The blocks are the same; with -bin the compact
+ *	tables of the output are still kept until the end. -shard k/n
+ *	(implying -stream) writes the k-th of n runs of chromosomes of about
+ *	as many segments, for the jobs of a cluster; mergeBlocks joins them
+ *	into the Building.Blocks of a single run.
+ *
+ *	With -union the chromosomes of many segments are cut again where no
+ *	segment of any species spans, so that the threads share the work of
+ *	a large chromosome as well; the blocks are the same.
+ *
+ *	With -approx the breaks of the segments are not lifted through the
+ *	chains, which are not read at all, but interpolated linearly along
+ *	the segment, between its ends in the net; each such position is off
+ *	by at most the difference of the lengths of its two sides (where
+ *	the gaps of the alignment are in one species at a time), and the
+ *	largest and mean of these bounds are reported. -approxCheck lifts
+ *	through the chains as usual and reports how far the interpolation
+ *	is from them, and how many positions are beyond their bounds.
+ *
+ *	With -checkpoint dir the blocks of each shard are written to dir as
+ *	it is done, with its log, under a digest of what they are made from
+ *	(the segments of the shard, the species, the chain directory and
+ *	-approx). A run started again after a failure takes the shards it
+ *	finds there instead of building them, and the output is the same;
+ *	the files go when the run ends.
  * ***************************************************************/
 
+#include <sys/stat.h>
 #include "util.h"
 #include "base.h"
 #include "species.h"
+#include "blockfile.h"
+#include "chainstore.h"
+#include "stages.h"
+#include "segstream.h"
+#include "workpool.h"
+#include "progress.h"
+#include "trace.h"
 
 struct my_seg_list {
-	char fchrom[50], schrom[50];
+	const char *fchrom, *schrom;	// interned
 	int  fbeg, fend, sbeg, send;
 	char orient;
 	int cid;
@@ -15,33 +53,59 @@ struct my_seg_list {
 };
 
 struct my_block_list {
-	char refchrom[50];
+	const char *refchrom;	// interned; NULL until the first segment
 	int  refbeg, refend;
-	struct my_seg_list *speseg[MAXSPE];
+	// the last segment of species tailidx, that fill_block_out() appends to
+	// without walking the list; -1 while there is none
+	int tailidx;
+	struct my_seg_list *tail;
 	struct my_block_list *next;
+	struct my_seg_list *speseg[];	// Spesz entries
 };
 
-struct my_seg_list *get_my_seglist(char *filename) {
-	FILE *fp;
-	char buf[500];
+// the segments and blocks of the stage come out of arenas: the input
+// segments out of one, and what a shard makes out of its own, set here
+// by the thread building it. They all go when the stage is done
+static __thread struct arena *Nodes;
+
+struct my_seg_list *new_my_seg() {
+	return MEM_AS(seg_list, arena_alloc(Nodes, sizeof(struct my_seg_list)));
+}
+
+// a segment of processed.segs (segstream.h)
+static struct my_seg_list *my_seg(const struct seg_line *s, const char *filename) {
+	struct my_seg_list *p = new_my_seg();
+
+	if (s->fbeg > s->fend || s->sbeg > s->send)
+		fatalf("%s: cannot parse\n %s.%s:%d-%d\n", filename,
+			   Spe->spename[ref_spe_idx()], s->fchr, s->fbeg, s->fend);
+	p->next = NULL;
+	p->fchrom = s->fchr;
+	p->fbeg = s->fbeg;
+	p->fend = s->fend;
+	p->schrom = s->schr;
+	p->sbeg = s->sbeg;
+	p->send = s->send;
+	p->orient = s->orient;
+	p->cid = s->cid;
+	return p;
+}
+
+struct my_seg_list *get_my_seglist(FILE *stream, char *filename) {
+	FILE *fp = stream;
 	struct my_seg_list *sg, *last, *p;
+	struct seg_reader *r;
+	struct seg_line s;
 
 	sg = last = NULL;
-	fp = ckopen(filename, "r");
+	if (stream == NULL)
+		fp = ckopen_in(filename);
 
 	fprintf(stderr, "- getting segments from %s\n", filename);
 	
-	while (fgets(buf, 500, fp)) {
-		if (buf[0] == '#')
-			continue;
-		p = (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list));
-		p->next = NULL;
-		if (sscanf(buf, "%*[^.].%[^:]:%d-%d %*[^.].%[^:]:%d-%d %c %d",
-				p->fchrom, &(p->fbeg), &(p->fend),
-				p->schrom, &(p->sbeg), &(p->send), &(p->orient), &(p->cid)) != 8)
-			fatalf("%s: cannot parse\n %s\n", filename, buf);
-		if (p->fbeg > p->fend || p->sbeg > p->send)
-			fatalf("%s: cannot parse\n %s\n", filename, buf);
+	r = open_seg_reader(fp, SEGS_PROCESSED, filename);
+	while (read_seg_line(r, &s)) {
+		p = my_seg(&s, filename);
 		if (sg == NULL)
 			sg = last = p;
 		else {
@@ -49,23 +113,147 @@ struct my_seg_list *get_my_seglist(char *filename) {
 			last = p;
 		}
 	} 
-	fclose(fp);
+	close_seg_reader(r);
+	if (fp != stream)
+		ckclose_in(fp);
 	return sg;
 } 
 
 struct my_block_list *my_allocate_newblock() {
 	struct my_block_list *newblock;
 	int i;
-	newblock = (struct my_block_list *)ckalloc(sizeof(struct my_block_list));
+	newblock = MEM_AS(block_list, arena_alloc(Nodes, sizeof(struct my_block_list)
+							+ Spe->spesz * sizeof(struct my_seg_list *)));
 	newblock->next = NULL;
-	for (i = 0; i < Spesz; i++)
+	for (i = 0; i < Spe->spesz; i++)
 		newblock->speseg[i] = NULL;
 	newblock->refbeg = MAXNUM;
 	newblock->refend = 0;
-	newblock->refchrom[0] = '\0';
+	newblock->refchrom = NULL;
+	newblock->tailidx = -1;
+	newblock->tail = NULL;
 	return newblock;
 }
 
+/* the blocks of each reference chromosome in list order, so that
+ * find_insert_position() can jump over the blocks that end before a
+ * segment instead of walking them */
+struct chrom_blocks {
+	const char *chrom;
+	struct my_block_list **blk;
+	int n, max;
+};
+// per thread, as each thread builds the blocks of its own chromosomes
+static __thread struct chrom_blocks *Chromblocks = NULL;
+static __thread int Nchromblocks = 0, Maxchromblocks = 0;
+// cleared if the blocks of a chromosome are not one sorted run of the
+// list; the plain walk is used from then on
+static __thread int Blockindex = 1;
+
+void reset_block_index() {
+	int i;
+	
+	for (i = 0; i < Nchromblocks; i++)
+		free(Chromblocks[i].blk);
+	free(Chromblocks);
+	Chromblocks = NULL;
+	Nchromblocks = Maxchromblocks = 0;
+	Blockindex = 1;
+}
+
+struct chrom_blocks *chrom_blocks(const char *chrom, int create) {
+	int lo = 0, hi = Nchromblocks, mid, c;
+	
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		c = strcmp(Chromblocks[mid].chrom, chrom);
+		if (c == 0)
+			return &Chromblocks[mid];
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!create)
+		return NULL;
+	if (Nchromblocks == Maxchromblocks) {
+		Maxchromblocks = Maxchromblocks ? 2 * Maxchromblocks : 64;
+		Chromblocks = ckrealloc(Chromblocks, Maxchromblocks * sizeof(struct chrom_blocks));
+	}
+	memmove(&Chromblocks[lo+1], &Chromblocks[lo], (Nchromblocks - lo) * sizeof(struct chrom_blocks));
+	Nchromblocks++;
+	Chromblocks[lo].chrom = chrom;
+	Chromblocks[lo].blk = NULL;
+	Chromblocks[lo].n = Chromblocks[lo].max = 0;
+	return &Chromblocks[lo];
+}
+
+// index of blk among the blocks of its chromosome; -1 if it is not there
+int block_rank(struct chrom_blocks *cb, struct my_block_list *blk) {
+	int lo = 0, hi = cb->n, mid;
+	
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cb->blk[mid]->refbeg < blk->refbeg)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < cb->n && cb->blk[lo]->refbeg == blk->refbeg; lo++)
+		if (cb->blk[lo] == blk)
+			return lo;
+	Blockindex = 0;
+	return -1;
+}
+
+// records that blk has been linked into the list between prv and nxt
+void index_block(struct my_block_list *blk, struct my_block_list *prv, struct my_block_list *nxt) {
+	struct chrom_blocks *cb;
+	int pos;
+	
+	if (!Blockindex)
+		return;
+	cb = chrom_blocks(blk->refchrom, 1);
+	if (prv != NULL && prv->refchrom == blk->refchrom)
+		pos = block_rank(cb, prv) + 1;
+	else if (nxt != NULL && nxt->refchrom == blk->refchrom)
+		pos = block_rank(cb, nxt);
+	else
+		pos = cb->n == 0 ? 0 : -1;
+	if (pos < 0 || (pos > 0 && cb->blk[pos-1]->refbeg > blk->refbeg)
+			|| (pos < cb->n && cb->blk[pos]->refbeg < blk->refbeg)) {
+		Blockindex = 0;
+		return;
+	}
+	if (cb->n == cb->max) {
+		cb->max = cb->max ? 2 * cb->max : 1024;
+		cb->blk = ckrealloc(cb->blk, cb->max * sizeof(struct my_block_list *));
+	}
+	memmove(&cb->blk[pos+1], &cb->blk[pos], (cb->n - pos) * sizeof(struct my_block_list *));
+	cb->blk[pos] = blk;
+	cb->n++;
+}
+
+/* the blocks of sg's chromosome before the last one starting at or before
+ * sg->fbeg neither hold nor border sg; returns that last one if p is
+ * before it */
+struct my_block_list *skip_blocks_before(struct my_block_list *p, struct my_seg_list *sg) {
+	struct chrom_blocks *cb;
+	int i, lo, hi, mid;
+	
+	if (!Blockindex || sg->fbeg >= sg->fend
+			|| (cb = chrom_blocks(p->refchrom, 0)) == NULL || (i = block_rank(cb, p)) < 0)
+		return p;
+	for (lo = i, hi = cb->n; lo < hi; ) {
+		mid = (lo + hi) / 2;
+		if (cb->blk[mid]->refbeg <= sg->fbeg)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo - 1 > i ? cb->blk[lo-1] : p;
+}
+
 void find_insert_position(struct my_seg_list *sg, struct my_block_list *blockhead, 
 								struct my_block_list *last, struct my_block_list **prv, 
 								struct my_block_list **nxt, struct my_block_list **fst,
@@ -79,20 +267,22 @@ void find_insert_position(struct my_seg_list *sg, struct my_block_list *blockhea
 	// nxt == NULL if insertion pos is after tail.
 
 	struct my_block_list *p, *pp;
+	long walked = 0;
 	*prv = *nxt = *fst = *lst = NULL;
 	pp = NULL;
 	if (last != NULL)
 		p = last;
 	else 
 		p = blockhead;
-	for (; p != NULL; p = p->next) {
-		if (!same_string(p->refchrom, sg->fchrom) && p->next != NULL 
-				&& same_string(p->next->refchrom, sg->fchrom))
+	for (; p != NULL; p = p->next, walked++) {
+		if (p->refchrom != sg->fchrom && p->next != NULL 
+				&& p->next->refchrom == sg->fchrom)
 			pp = p;
-		else if (same_string(p->refchrom, sg->fchrom)) {
-			if ((p->next != NULL && same_string(p->next->refchrom, sg->fchrom) 
+		else if (p->refchrom == sg->fchrom) {
+			p = skip_blocks_before(p, sg);
+			if ((p->next != NULL && p->next->refchrom == sg->fchrom 
 					&& p->refend <= sg->fbeg && sg->fend <= p->next->refbeg)
-				|| ((p->next == NULL || !same_string(p->next->refchrom, sg->fchrom))
+				|| ((p->next == NULL || p->next->refchrom != sg->fchrom)
 					&& p->refend <= sg->fbeg)) {
 				// no break, insert between prv and nxt, nxt == prv->next
 				*prv = p;
@@ -117,7 +307,7 @@ void find_insert_position(struct my_seg_list *sg, struct my_block_list *blockhea
 				*prv = pp;
 				*fst = p;
 			}
-			else if ((p->next != NULL && same_string(p->next->refchrom, sg->fchrom)
+			else if ((p->next != NULL && p->next->refchrom == sg->fchrom
 						&& p->refend <= sg->fbeg && sg->fbeg < p->next->refbeg)) {
 				*prv = p;
 				*fst = p->next;
@@ -128,9 +318,9 @@ void find_insert_position(struct my_seg_list *sg, struct my_block_list *blockhea
 				*lst = *nxt = p;
 				break;
 			}
-			else if ((p->next != NULL && same_string(p->next->refchrom, sg->fchrom)
+			else if ((p->next != NULL && p->next->refchrom == sg->fchrom
 						&& p->refend < sg->fend && sg->fend <= p->next->refbeg)
-					|| ((p->next == NULL || !same_string(p->next->refchrom, sg->fchrom))
+					|| ((p->next == NULL || p->next->refchrom != sg->fchrom)
 						&& p->refend < sg->fend)) {
 				*lst = p;
 				*nxt = p->next;
@@ -138,85 +328,199 @@ void find_insert_position(struct my_seg_list *sg, struct my_block_list *blockhea
 			}
 		}
 	}
+	COUNT(insert_position_calls, 1);
+	COUNT(insert_position_walked, walked);
+	TRACE_POINT1(insert_position, walked);
 }
 
-void fill_block(struct my_block_list *blck, int idx, struct my_seg_list *sg) {
-	struct my_seg_list *newsg;
-	
-	if (blck->refchrom[0] == '\0')
-		strcpy(blck->refchrom, sg->fchrom);
-	else if (!same_string(blck->refchrom, sg->fchrom))
+// sg itself becomes the segment of species idx in blck
+void move_seg(struct my_block_list *blck, int idx, struct my_seg_list *sg) {
+	if (blck->refchrom == NULL)
+		blck->refchrom = sg->fchrom;
+	else if (blck->refchrom != sg->fchrom)
 			fatalf("CHROM DISAGREE: %s %s", blck->refchrom, sg->fchrom);
 	
 	blck->refbeg = MIN(blck->refbeg, sg->fbeg);
 	blck->refend = MAX(blck->refend, sg->fend);
+	blck->speseg[idx] = sg;
+}
 
-	newsg = (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list));
+void fill_block(struct my_block_list *blck, int idx, struct my_seg_list *sg) {
+	struct my_seg_list *newsg = new_my_seg();
+
+	*newsg = *sg;
 	newsg->next = NULL;
-	strcpy(newsg->fchrom, sg->fchrom);
-	strcpy(newsg->schrom, sg->schrom);
-	newsg->fbeg = sg->fbeg;
-	newsg->fend = sg->fend;
-	newsg->sbeg = sg->sbeg;
-	newsg->send = sg->send;
-	newsg->orient = sg->orient;
-	newsg->cid = sg->cid;
-	
-	blck->speseg[idx] = newsg;
+	move_seg(blck, idx, newsg);
 }
 
 void fill_block_out(struct my_block_list *blck, int idx, struct my_seg_list *sg) {
-	struct my_seg_list *newsg, *p;
+	struct my_seg_list *newsg;
 	
-	newsg = (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list));
+	newsg = new_my_seg();
+	*newsg = *sg;
 	newsg->next = NULL;
-	strcpy(newsg->fchrom, sg->fchrom);
-	strcpy(newsg->schrom, sg->schrom);
-	newsg->fbeg = sg->fbeg;
-	newsg->fend = sg->fend;
-	newsg->sbeg = sg->sbeg;
-	newsg->send = sg->send;
-	newsg->orient = sg->orient;
-	newsg->cid = sg->cid;
 	
 	if (blck->speseg[idx] == NULL)
 		blck->speseg[idx] = newsg;
 	else {
-		for (p = blck->speseg[idx]; p->next != NULL; p = p->next)
-			;
-		p->next = newsg;
+		if (blck->tailidx != idx)
+			for (blck->tail = blck->speseg[idx]; blck->tail->next != NULL; )
+				blck->tail = blck->tail->next;
+		blck->tail->next = newsg;
 	}
+	blck->tailidx = idx;
+	blck->tail = newsg;
 }
 
-void break_segment_position(struct my_seg_list *sg, int pos, int idx) {
+/* cuts sg at a position already lifted through its chain: q[0] is the
+ * left side of the break, q[1] the right one */
+void break_segment_lifted(struct my_seg_list *sg, struct map_query *q, int idx) {
 	struct my_seg_list *newsg;
-	int lnewpos, rnewpos;
 	
-	newsg = (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list));
+	if (!q[0].ok || !q[1].ok)
+		fatalf("wrong ref position: %d %s %s %d %s %s %c", sg->cid, Spe->spename[0], sg->fchrom,
+						q[0].rpos, Spe->spename[idx], sg->schrom, sg->orient);
+	newsg = new_my_seg();
 	newsg->next = sg->next;
 	sg->next = newsg;
-	strcpy(newsg->fchrom, sg->fchrom);
-	strcpy(newsg->schrom, sg->schrom);
+	newsg->fchrom = sg->fchrom;
+	newsg->schrom = sg->schrom;
 	newsg->fend = sg->fend;
 	newsg->orient = sg->orient;
 	newsg->cid = sg->cid;
 	
 	if (sg->orient == '+') {
 		newsg->send = sg->send;
-		mapbase(sg->cid, Spename[0], sg->fchrom, pos, Spename[idx], sg->schrom, 
-						sg->orient,"left", &(sg->send), &(lnewpos));
-		mapbase(sg->cid, Spename[0], sg->fchrom, pos, Spename[idx], sg->schrom, 
-						sg->orient, "right", &(newsg->sbeg), &(rnewpos));
+		sg->send = q[0].spos;
+		newsg->sbeg = q[1].spos;
 	}
 	else {
 		newsg->sbeg = sg->sbeg;
-		mapbase(sg->cid, Spename[0], sg->fchrom, pos, Spename[idx], sg->schrom, 
-						sg->orient, "left", &(sg->sbeg), &(lnewpos));
-		mapbase(sg->cid, Spename[0], sg->fchrom, pos, Spename[idx], sg->schrom, 
-						sg->orient, "right", &(newsg->send), &(rnewpos));
+		sg->sbeg = q[0].spos;
+		newsg->send = q[1].spos;
+	}
+	sg->fend = q[0].newrpos;
+	newsg->fbeg = q[1].newrpos;
+}
+
+int Approx_lift = 0;
+
+// the positions lifted by interpolation, the sum and largest of their
+// bounds, and with -approxCheck of their errors and those beyond the bound
+static long Approx_n, Approx_bound, Approx_maxbound;
+static long Approx_err, Approx_maxerr, Approx_over;
+
+static void add_max(long *max, long v) {
+	long m = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (v > m && !__atomic_compare_exchange_n(max, &m, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/* lift_in_segment ------------- positions of sg interpolated along it, and
+ * their bound: the difference of its lengths, and 1 for the rounding */
+static long lift_in_segment(const struct my_seg_list *sg, struct map_query *q, int n) {
+	long rlen = sg->fend - sg->fbeg, slen = sg->send - sg->sbeg, off;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		off = rlen > 0 ? ((long)(q[i].rpos - sg->fbeg) * slen + rlen / 2) / rlen : 0;
+		q[i].spos = sg->orient == '+' ? sg->sbeg + off : sg->send - off;
+		q[i].newrpos = q[i].rpos;
+		q[i].ok = 1;
+	}
+	return labs(slen - rlen) + 1;
+}
+
+/* lift_breaks ---- the positions q of sg in species idx, through the chain
+ * or, with -approx, within the segment */
+static void lift_breaks(struct my_seg_list *sg, int idx, struct map_query *q, int n) {
+	struct map_query *a;
+	long bound, err, sum = 0, over = 0, max = 0;
+	int i;
+
+	if (Approx_lift != 1)
+		mapbase_many(sg->cid, Spe->spename[0], sg->fchrom, Spe->spename[idx], sg->schrom, sg->orient, q, n);
+	if (Approx_lift == 0 || n == 0)
+		return;
+	a = Approx_lift == 1 ? q : ckalloc(n * sizeof(struct map_query));
+	if (a != q)
+		memcpy(a, q, n * sizeof(struct map_query));
+	bound = lift_in_segment(sg, a, n);
+	__atomic_fetch_add(&Approx_n, n, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&Approx_bound, n * bound, __ATOMIC_RELAXED);
+	add_max(&Approx_maxbound, bound);
+	if (a == q)
+		return;
+	for (i = 0; i < n; i++) {
+		err = MAX(labs((long)a[i].spos - q[i].spos), labs((long)a[i].newrpos - q[i].newrpos));
+		sum += err;
+		max = MAX(max, err);
+		over += err > bound;
 	}
-	sg->fend = lnewpos;
-	newsg->fbeg = rnewpos;
+	__atomic_fetch_add(&Approx_err, sum, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&Approx_over, over, __ATOMIC_RELAXED);
+	add_max(&Approx_maxerr, max);
+	free(a);
+}
+
+// the errors of the positions lifted by interpolation
+static void report_approx(void) {
+	if (Approx_lift == 0 || Approx_n == 0)
+		return;
+	fprintf(stderr, "- %ld positions lifted within their segments, off by at most %ld bp (%.1f bp on average)\n",
+		Approx_n, Approx_maxbound, (double)Approx_bound / Approx_n);
+	if (Approx_lift == 2)
+		fprintf(stderr, "- from the chains: %ld bp at most, %.1f bp on average, %ld beyond their bound\n",
+			Approx_maxerr, (double)Approx_err / Approx_n, Approx_over);
+	Approx_n = Approx_bound = Approx_maxbound = Approx_err = Approx_maxerr = Approx_over = 0;
+}
+
+// the chains of a species pair, not read with -approx
+static void load_chains(int rs, int ss) {
+	if (Approx_lift != 1)
+		load_chain_space(rs, ss);
+}
+
+void break_segment_position(struct my_seg_list *sg, int pos, int idx) {
+	struct map_query q[2];
+	
+	q[0].rpos = q[1].rpos = pos;
+	q[0].right = 0;
+	q[1].right = 1;
+	lift_breaks(sg, idx, q, 2);
+	break_segment_lifted(sg, q, idx);
+}
+
+/* breaks sg in the gaps between the blocks fst..lst and fills each block
+ * before lst with its piece; returns the piece left for lst. The break
+ * positions do not depend on the cuts, so they are all lifted through the
+ * chain in one sweep first */
+struct my_seg_list *break_segment_blocks(struct my_seg_list *sg, struct my_block_list *fst,
+						struct my_block_list *lst, int idx,
+						void (*fill)(struct my_block_list *, int, struct my_seg_list *)) {
+	struct my_block_list *p;
+	struct map_query *q;
+	int n, k;
+	
+	for (n = 0, p = fst; p != lst; p = p->next)
+		++n;
+	q = (struct map_query *)ckalloc((2*n + 1) * sizeof(struct map_query));
+	for (k = 0, p = fst; p != lst; p = p->next, k += 2) {
+		q[k].rpos = q[k+1].rpos = (p->refend + p->next->refbeg) / 2;
+		q[k].right = 0;
+		q[k+1].right = 1;
+	}
+	lift_breaks(sg, idx, q, 2*n);
+	for (k = 0, p = fst; p != lst; p = p->next, k += 2) {
+		if (q[k].rpos <= sg->fbeg)
+			continue;
+		break_segment_lifted(sg, &q[k], idx);
+		fill(p, idx, sg);
+		sg = sg->next;
+	}
+	free(q);
+	return sg;
 }
 
 void break_block_position(struct my_block_list *blk, int pos) {
@@ -224,60 +528,72 @@ void break_block_position(struct my_block_list *blk, int pos) {
 	struct my_block_list *newblk;
 	struct my_seg_list *sg;
 	
+	COUNT(block_breaks, 1);
+	TRACE_POINT1(block_break, pos);
 	newblk = my_allocate_newblock();
-	strcpy(newblk->refchrom, blk->refchrom);
+	newblk->refchrom = blk->refchrom;
 	newblk->refbeg = pos;
 	newblk->refend = blk->refend;
 	blk->refend = pos;
+	blk->tailidx = -1;
 	
 	rs = ref_spe_idx();
-	for (i = 0; i < Spesz; i++) {
+	for (i = 0; i < Spe->spesz; i++) {
 		if (i == rs)
 			continue;
 		sg = blk->speseg[i];
 		if (sg == NULL)
 			continue;
+		// the piece after pos moves to newblk as it is
 		if (pos <= sg->fbeg) {
-			fill_block(newblk, i, sg);
 			blk->speseg[i] = NULL;
-			free(sg);
+			sg->next = NULL;
+			move_seg(newblk, i, sg);
 		}
 		else if (pos >= sg->fend) {
 			continue;
 		}
 		else {
 			break_segment_position(sg, pos, i);
-			fill_block(newblk, i, sg->next);
 			sg = sg->next;
 			blk->speseg[i]->next = NULL;
-			free(sg);
+			sg->next = NULL;
+			move_seg(newblk, i, sg);
 		}
 	}
 	newblk->next = blk->next;
 	blk->next = newblk;
+	index_block(newblk, blk, newblk->next);
 }
 
-void add_descendent_segs(struct my_block_list **blkhead, int idx, struct my_seg_list *sglist) {
+static void count_segs(int n);
+
+void add_descendent_segs(struct my_block_list **blkhead, int idx, struct my_seg_list *sglist, FILE *log) {
 	struct my_seg_list *sg;
 	struct my_block_list *blocklist, *lastblock, *newblock, *last;
 	struct my_block_list *prv, *nxt, *fst, *lst;
-	int pos, count;
-	char prevchr[50];
+	int pos, count, n = 0;
+	const char *prevchr;
 	
-	prevchr[0] = '\0';
+	prevchr = NULL;
 	blocklist = lastblock = NULL;
 	if (*blkhead == NULL) {
 		for (sg = sglist; sg != NULL; sg = sg->next) {
-			if (!same_string(prevchr, sg->fchrom)) {
-				fprintf(stderr, "\n  in ref %s ", sg->fchrom);
-				strcpy(prevchr, sg->fchrom);
+			if (prevchr != sg->fchrom) {
+				fprintf(log, "\n  in ref %s ", sg->fchrom);
+				prevchr = sg->fchrom;
 				count = 0;
 			}
 			++count;
 			if (count%5 == 0)
-				fprintf(stderr, ".");
+				fprintf(log, ".");
+			if (++n == 1024) {
+				count_segs(n);
+				n = 0;
+			}
 			newblock = my_allocate_newblock();
 			fill_block(newblock, idx, sg);
+			index_block(newblock, lastblock, NULL);
 			if (blocklist == NULL)
 				blocklist = lastblock = newblock;
 			else {
@@ -290,14 +606,18 @@ void add_descendent_segs(struct my_block_list **blkhead, int idx, struct my_seg_
 	else {
 		last = NULL;
 	 	for (sg = sglist; sg != NULL; sg = sg->next) {
-			if (!same_string(prevchr, sg->fchrom)) {
-				fprintf(stderr, "\n  in ref %s ", sg->fchrom);
-				strcpy(prevchr, sg->fchrom);
+			if (prevchr != sg->fchrom) {
+				fprintf(log, "\n  in ref %s ", sg->fchrom);
+				prevchr = sg->fchrom;
 				count = 0;
 			}
 			++count;
 			if (count%5 == 0)
-				fprintf(stderr, ".");
+				fprintf(log, ".");
+			if (++n == 1024) {
+				count_segs(n);
+				n = 0;
+			}
 			find_insert_position(sg, *blkhead, last, &prv, &nxt, &fst, &lst);
 			last = prv;
 			if (fst == NULL && lst == NULL) { 
@@ -307,13 +627,17 @@ void add_descendent_segs(struct my_block_list **blkhead, int idx, struct my_seg_
 				if (prv != NULL && nxt != NULL && nxt == prv->next) {
 					newblock->next = prv->next;
 					prv->next = newblock;
+					index_block(newblock, prv, newblock->next);
 				}
 				else if (prv == NULL) {
 					newblock->next = *blkhead;
 					*blkhead = newblock;
+					index_block(newblock, NULL, newblock->next);
 				}
-				else if (nxt == NULL) 
+				else if (nxt == NULL) {
 					prv->next = newblock;
+					index_block(newblock, prv, NULL);
+				}
 			}
 			else if (fst == lst) {
 				if (fst->speseg[idx] == NULL) {
@@ -334,38 +658,36 @@ void add_descendent_segs(struct my_block_list **blkhead, int idx, struct my_seg_
 					break_block_position(fst, pos);
 					fst = fst->next;
 				}
-				for (; fst != lst; fst = fst->next) {
-					pos = (fst->refend + fst->next->refbeg) / 2;
-					if (pos <= sg->fbeg)
-						continue;
-					break_segment_position(sg, pos, idx);
-					fill_block(fst, idx, sg);
-					sg = sg->next;
-				}
-				fill_block(fst, idx, sg);
+				sg = break_segment_blocks(sg, fst, lst, idx, fill_block);
+				fill_block(lst, idx, sg);
 			}
 		}
 	}
-	fprintf(stderr, "\n");
+	count_segs(n);
+	fprintf(log, "\n");
 }
 
-void add_outgroup_segs(struct my_block_list *head, int idx, struct my_seg_list *sglist) {
+void add_outgroup_segs(struct my_block_list *head, int idx, struct my_seg_list *sglist, FILE *log) {
 	struct my_seg_list *sg;
 	struct my_block_list *prv, *nxt, *fst, *lst, *last;
-	int pos, count;
-	char prevchr[50];
+	int count, n = 0;
+	const char *prevchr;
 	
 	last = NULL;
-	prevchr[0] = '\0';
+	prevchr = NULL;
 	for (sg = sglist; sg != NULL; sg = sg->next) {
-		if (!same_string(prevchr, sg->fchrom)) {
-			fprintf(stderr, "\n  in ref %s ", sg->fchrom);
-			strcpy(prevchr, sg->fchrom);
+		if (prevchr != sg->fchrom) {
+			fprintf(log, "\n  in ref %s ", sg->fchrom);
+			prevchr = sg->fchrom;
 			count = 0;
 		}
 		++count;
 		if (count%5 == 0)
-			fprintf(stderr, ".");
+			fprintf(log, ".");
+		if (++n == 1024) {
+			count_segs(n);
+			n = 0;
+		}
 		find_insert_position(sg, head, last, &prv, &nxt, &fst, &lst);
 		last = prv;
 		if (fst == NULL && lst == NULL)
@@ -376,129 +698,1191 @@ void add_outgroup_segs(struct my_block_list *head, int idx, struct my_seg_list *
 			if (fst == NULL || lst == NULL) {
 				continue;
 			}
-			for (; fst != lst; fst = fst->next) {
-				pos = (fst->refend + fst->next->refbeg) / 2;
-				if (pos <= sg->fbeg)
-					continue;
-				break_segment_position(sg, pos, idx);
-				fill_block_out(fst, idx, sg);
-				sg = sg->next;
-			}
-			fill_block_out(fst, idx, sg);
+			sg = break_segment_blocks(sg, fst, lst, idx, fill_block_out);
+			fill_block_out(lst, idx, sg);
 		}
 	}
-	fprintf(stderr, "\n");
+	count_segs(n);
+	fprintf(log, "\n");
 }
 
-void free_my_seg_list(struct my_seg_list *sg) {
-	struct my_seg_list *p, *q;
-	p = sg;
-	for (;;) {
-		q = p->next;
-		free(p);
-		if (q == NULL)
-			break;
+/* blocks never span reference chromosomes, so each chromosome is a shard
+ * with its own segments and block list, built on its own thread */
+struct shard {
+	const char *chrom;
+	struct my_seg_list **segs, **tail;	// per species
+	int nseg;
+	struct my_block_list *blocks;
+	struct arena *nodes;
+	struct seg_run **run;		// streamed: where its lines are in each input
+	int *nrun, *maxrun;
+	FILE *log;					// piped: its log and block index, kept
+	char *logbuf;				// from one species to the next
+	size_t loglen;
+	struct chrom_blocks *index;
+	int nindex, maxindex, indexed;
+	int **cid, *ncid;			// the chains of its segments, per species
+	struct arena **spenodes;	// of the outgroups added at the same time
+	uint64_t digest;			// -checkpoint: of its segments, before they are added
+};
+
+// the segments of one reference chromosome in a species' input
+struct seg_run {
+	const char *chrom;
+	off_t off;
+	int nseg;
+};
+
+/* the state of one partition, set by the thread running it; the jobs it
+ * hands to other threads get it, and its config, as their argument */
+struct partition {
+	struct spe_config *spe;
+	struct shard *shards;
+	int *shardidx;	// shard indices sorted by name
+	int nshards, maxshards, builder, *shardorder;
+	struct job_output *shardlogs;	// the log of each shard being built
+	int firstshard;				// the shard of the first log
+	int njobs;					// of the run_jobs() going on, in shardorder
+	int nthreads;				// it runs them on
+	// piped, below
+	struct arena *input;
+	struct my_seg_list *outgroupsegs[MAXSPE];
+	int pipedspe;	// the species the jobs add; -1 for the outgroups
+	struct progress *progress;	// of the run_jobs() going on
+	char what[200];
+};
+static __thread struct partition *Part;
+
+// the segments added, for the progress of the jobs
+static void count_segs(int n) {
+	progress_add(Part->progress, 0, n);
+}
+
+// reports on the jobs of the shards in shardorder, of nseg segments
+static void start_progress(long nseg) {
+	Part->progress = progress_start(Part->what, "shards", Part->njobs, "segments", nseg);
+}
+
+static void end_progress(void) {
+	progress_end(Part->progress);
+	Part->progress = NULL;
+}
+
+static void new_partition(void) {
+	Part = ckallocz(sizeof(struct partition));
+	Part->spe = Spe;
+	strcpy(Part->what, "partitionGenomes");
+}
+
+// a job of the partition arg on this thread
+static void join_partition(void *arg) {
+	Part = arg;
+	Spe = Part->spe;
+}
+
+// a new shard at the end of the partition, without segments
+static struct shard *add_shard(const char *chrom) {
+	struct shard *sh;
+
+	if (Part->nshards == Part->maxshards) {
+		Part->maxshards = Part->maxshards ? 2 * Part->maxshards : 64;
+		Part->shards = ckrealloc(Part->shards, Part->maxshards * sizeof(struct shard));
+		Part->shardidx = ckrealloc(Part->shardidx, Part->maxshards * sizeof(int));
+	}
+	sh = &Part->shards[Part->nshards++];
+	memset(sh, 0, sizeof(struct shard));
+	sh->chrom = chrom;
+	sh->segs = ckallocz(Spe->spesz * sizeof(struct my_seg_list *));
+	sh->tail = ckallocz(Spe->spesz * sizeof(struct my_seg_list *));
+	sh->run = ckallocz(Spe->spesz * sizeof(struct seg_run *));
+	sh->nrun = ckallocz(Spe->spesz * sizeof(int));
+	sh->maxrun = ckallocz(Spe->spesz * sizeof(int));
+	sh->nodes = new_arena(0);
+	sh->indexed = 1;
+	return sh;
+}
+
+struct shard *find_shard(const char *chrom) {
+	int lo = 0, hi = Part->nshards, mid, c;
+	
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		c = strcmp(Part->shards[Part->shardidx[mid]].chrom, chrom);
+		if (c == 0)
+			return &Part->shards[Part->shardidx[mid]];
+		if (c < 0)
+			lo = mid + 1;
 		else
-			p = q;
+			hi = mid;
 	}
+	add_shard(chrom);
+	memmove(&Part->shardidx[lo+1], &Part->shardidx[lo], (Part->nshards - 1 - lo) * sizeof(int));
+	Part->shardidx[lo] = Part->nshards - 1;
+	return &Part->shards[Part->nshards - 1];
 }
 
-void free_my_block_list(struct my_block_list *blk) {
-	struct my_block_list *p, *q;
-	int i;
-	p = blk;
+// moves the segments of a species into the shards of their chromosomes
+void split_segs(int ss, struct my_seg_list *sglist) {
+	struct my_seg_list *sg, *next;
+	struct shard *sh = NULL;
+	
+	for (sg = sglist; sg != NULL; sg = next) {
+		next = sg->next;
+		sg->next = NULL;
+		if (sh == NULL || sh->chrom != sg->fchrom)
+			sh = find_shard(sg->fchrom);
+		if (sh->segs[ss] == NULL)
+			sh->segs[ss] = sg;
+		else
+			sh->tail[ss]->next = sg;
+		sh->tail[ss] = sg;
+		sh->nseg++;
+	}
+}
+
+/* -union: a chromosome is cut again where no segment of any species
+ * spans, at the union of the boundaries of the species, and each piece
+ * is a shard of its own. The pieces make the blocks of the whole: a
+ * piece holds segments of the builder, as the later species only add to
+ * blocks it started, and the segments of each species come in order of
+ * position, so that find_insert_position() finds the same places in a
+ * piece as in the chromosome */
+int Union_pieces = 0;
+
+// where the pieces of at least target segments of sh start; 0 if it is
+// kept whole
+static int union_cuts(struct shard *sh, int target, int **cut) {
+	struct my_seg_list *head[MAXSPE], *sg;
+	int ss, best, n = 0, max = 0, count = 0, builder = 0, lastbeg, maxend = 0;
+
+	*cut = NULL;
+	if (sh->segs[Part->builder] == NULL || sh->nseg < 2 * target)
+		return 0;
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		head[ss] = sh->segs[ss];
+		for (sg = sh->segs[ss]; sg != NULL && sg->next != NULL; sg = sg->next)
+			if (sg->next->fbeg < sg->fbeg)
+				return 0;
+	}
+	lastbeg = sh->tail[Part->builder]->fbeg;
+	// the segments of the species merged by position
 	for (;;) {
-		q = p->next;
-		for (i = 0; i < Spesz; i++)
-			if (p->speseg[i] != NULL)
-				free_my_seg_list(p->speseg[i]);
-		free(p);
-		if (q == NULL)
+		for (best = -1, ss = 0; ss < Spe->spesz; ss++)
+			if (head[ss] != NULL && (best < 0 || head[ss]->fbeg < head[best]->fbeg))
+				best = ss;
+		if (best < 0)
 			break;
-		else
-			p = q;
+		sg = head[best];
+		head[best] = sg->next;
+		if (count >= target && builder && sg->fbeg > maxend && sg->fbeg <= lastbeg) {
+			if (n == max) {
+				max = max ? 2 * max : 16;
+				*cut = ckrealloc(*cut, max * sizeof(int));
+			}
+			(*cut)[n++] = sg->fbeg;
+			count = builder = 0;
+		}
+		count++;
+		maxend = MAX(maxend, MAX(sg->fbeg, sg->fend));
+		if (best == Part->builder)
+			builder = 1;
 	}
+	return n;
 }
 
-int main(int argc, char *argv[]) {
-	int ss, rs;
-	char segfile[200];
-	struct my_seg_list *spesegs[MAXSPE], *sg;
-	struct my_block_list *commonblocklist, *blk;
-	
-	if (argc != 2)
-		fatal("args: configure-file");
-	
-	get_spename(argv[1]);
-	get_chaindir(argv[1]);
-	get_minlen(argv[1]);	
-	rs = ref_spe_idx();
-	
-	// read processed seg files
-	for (ss = 0; ss < Spesz; ss++) {
-		if (rs == ss)
+// the shards with those of more than 2*target segments cut into pieces
+static void split_shards(int target) {
+	struct shard *old = Part->shards, *sh;
+	struct my_seg_list *sg, *next;
+	int nold = Part->nshards, k, i, ss, first, ncut, *cut;
+
+	Part->shards = NULL;
+	Part->nshards = Part->maxshards = 0;
+	free(Part->shardidx);
+	Part->shardidx = NULL;
+	for (k = 0; k < nold; k++) {
+		if ((ncut = union_cuts(&old[k], target, &cut)) == 0) {
+			sh = add_shard(old[k].chrom);
+			free_arena(sh->nodes);
+			free(sh->segs);
+			free(sh->tail);
+			free(sh->run);
+			free(sh->nrun);
+			free(sh->maxrun);
+			*sh = old[k];
 			continue;
-		sprintf(segfile, "%s.processed.segs", Spename[ss]);
-		spesegs[ss] = get_my_seglist(segfile);
+		}
+		first = Part->nshards;
+		for (i = 0; i <= ncut; i++)
+			add_shard(old[k].chrom);
+		for (ss = 0; ss < Spe->spesz; ss++)
+			for (i = 0, sg = old[k].segs[ss]; sg != NULL; sg = next) {
+				next = sg->next;
+				sg->next = NULL;
+				while (i < ncut && sg->fbeg >= cut[i])
+					i++;
+				sh = &Part->shards[first + i];
+				if (sh->segs[ss] == NULL)
+					sh->segs[ss] = sg;
+				else
+					sh->tail[ss]->next = sg;
+				sh->tail[ss] = sg;
+				sh->nseg++;
+			}
+		free_arena(old[k].nodes);
+		for (ss = 0; ss < Spe->spesz; ss++)
+			free(old[k].run[ss]);
+		free(old[k].segs);
+		free(old[k].tail);
+		free(old[k].run);
+		free(old[k].nrun);
+		free(old[k].maxrun);
+		free(cut);
+	}
+	free(old);
+}
+
+/* adds the pieces of species ss to a shard; only the first descendent
+ * with segments starts blocks, later descendents and the outgroups add
+ * to the blocks of its chromosomes */
+static void add_shard_species(struct shard *sh, int ss, FILE *log) {
+	if (Spe->spetag[ss] == 1 && (ss == Part->builder || sh->blocks != NULL)) {
+		fprintf(log, "- adding descendent %s", Spe->spename[ss]);
+		add_descendent_segs(&sh->blocks, ss, sh->segs[ss], log);
 	}
+	else if (Spe->spetag[ss] == 2 && sh->blocks != NULL) {
+		fprintf(log, "- adding outgroup %s", Spe->spename[ss]);
+		add_outgroup_segs(sh->blocks, ss, sh->segs[ss], log);
+	}
+}
+
+/* the outgroups of a shard at the same time, each on its own thread, own
+ * arena and own log: an outgroup only fills its own segments of the
+ * blocks and cuts its own segments, and the blocks no longer change, so
+ * they share the block index of the thread building the shard */
+struct outgroup_jobs {
+	struct partition *part;
+	struct shard *sh;
+	int spe[MAXSPE];
+	struct job_output *logs;
+	struct chrom_blocks *index;
+	int nindex, indexed;
+};
+
+static void outgroup_job(int k, void *arg) {
+	struct outgroup_jobs *o = arg;
 
-	commonblocklist = NULL;
-	// add pieces from descendents
-	for (ss = 0; ss < Spesz; ss++) {
-		if (Spetag[ss] == 1) {
-			fprintf(stderr, "- adding descendent %s", Spename[ss]);
-			add_descendent_segs(&commonblocklist, ss, spesegs[ss]);
+	join_partition(o->part);
+	Nodes = o->sh->spenodes[o->spe[k]] = new_arena(0);
+	Chromblocks = o->index;
+	Nchromblocks = Maxchromblocks = o->nindex;
+	Blockindex = o->indexed;
+	add_shard_species(o->sh, o->spe[k], job_stream(o->logs, k));
+	Chromblocks = NULL;
+	Nchromblocks = Maxchromblocks = 0;
+	Nodes = NULL;
+}
+
+// the threads each job of the partition leaves over for its outgroups
+static int outgroup_threads(void) {
+	return Part->njobs >= Part->nthreads ? 1 : Part->nthreads / MAX(Part->njobs, 1);
+}
+
+static void add_outgroups(struct shard *sh, FILE *log) {
+	struct outgroup_jobs o;
+	int ss, n = 0, nthreads = outgroup_threads();
+
+	for (ss = 0; ss < Spe->spesz; ss++)
+		if (Spe->spetag[ss] == 2)
+			o.spe[n++] = ss;
+	if (n < 2 || nthreads < 2 || sh->blocks == NULL) {
+		for (ss = 0; ss < n; ss++)
+			add_shard_species(sh, o.spe[ss], log);
+		return;
+	}
+	o.part = Part;
+	o.sh = sh;
+	o.logs = open_job_output(n);
+	o.index = Chromblocks;
+	o.nindex = Nchromblocks;
+	o.indexed = Blockindex;
+	sh->spenodes = arena_alloc(sh->nodes, Spe->spesz * sizeof(struct arena *));
+	memset(sh->spenodes, 0, Spe->spesz * sizeof(struct arena *));
+	run_jobs(n, nthreads, outgroup_job, &o);
+	close_job_output(o.logs, log);
+	// this thread may have run some of them
+	Part = o.part;
+	Nodes = sh->nodes;
+	Chromblocks = o.index;
+	Nchromblocks = o.nindex;
+	Blockindex = o.indexed;
+}
+
+// the arenas of a shard's blocks and segments
+static void free_shard_nodes(struct shard *sh) {
+	int ss;
+
+	if (sh->spenodes != NULL)
+		for (ss = 0; ss < Spe->spesz; ss++)
+			free_arena(sh->spenodes[ss]);
+	free_arena(sh->nodes);
+	sh->spenodes = NULL;
+	sh->nodes = NULL;
+}
+
+void build_shard(struct shard *sh, FILE *log) {
+	int ss;
+	
+	Nodes = sh->nodes;
+	reset_block_index();
+	// the descendents, then the outgroups
+	for (ss = 0; ss < Spe->spesz; ss++)
+		if (Spe->spetag[ss] == 1)
+			add_shard_species(sh, ss, log);
+	add_outgroups(sh, log);
+	reset_block_index();
+}
+
+/* notes the chains the segments of the species of the jobs (as for
+ * prefetch_jobs()) use in each shard, before the jobs change them */
+static void note_chains(int spe) {
+	struct my_seg_list *sg;
+	struct shard *sh;
+	int k, ss, n;
+
+	for (k = 0; k < Part->njobs; k++) {
+		sh = &Part->shards[Part->shardorder[k]];
+		if (sh->cid == NULL) {
+			sh->cid = arena_alloc(sh->nodes, Spe->spesz * sizeof(int *));
+			sh->ncid = arena_alloc(sh->nodes, Spe->spesz * sizeof(int));
+			memset(sh->ncid, 0, Spe->spesz * sizeof(int));
+		}
+		for (ss = 0; ss < Spe->spesz; ss++) {
+			if (!(spe == -1 || spe == ss || (spe == -2 && Spe->spetag[ss] == 2)))
+				continue;
+			for (n = 0, sg = sh->segs[ss]; sg != NULL; sg = sg->next)
+				n++;
+			sh->cid[ss] = arena_alloc(sh->nodes, (n + 1) * sizeof(int));
+			for (n = 0, sg = sh->segs[ss]; sg != NULL; sg = sg->next)
+				if (n == 0 || sg->cid != sh->cid[ss][n-1])
+					sh->cid[ss][n++] = sg->cid;
+			sh->ncid[ss] = n;
 		}
 	}
-	// add pieces from outgroups
-	for (ss = 0; ss < Spesz; ss++) {
-		if (Spetag[ss] == 2) {
-			fprintf(stderr, "- adding outgroup %s", Spename[ss]);
-			add_outgroup_segs(commonblocklist, ss, spesegs[ss]);
+}
+
+/* starts reading the chains a species' segments in a shard use, as
+ * note_chains() found them: only those, most of the chains of a
+ * chromosome being too short for any fill kept */
+static void prefetch_shard(struct shard *sh, int ss) {
+	if (Spe->chains[ss] != NULL && sh->ncid != NULL && sh->ncid[ss] > 0)
+		prefetch_chain_ids(Spe->chains[ss], sh->chrom, sh->cid[ss], sh->ncid[ss]);
+}
+
+/* starts reading the chains of the shards of jobs k and k+1 of the
+ * species the jobs add (-1 all, -2 the outgroups), so that the next
+ * chromosome of the store is in memory by the time a thread takes it */
+static void prefetch_jobs(int k, int spe) {
+	int j, ss;
+
+	for (j = k; j <= k + 1 && j < Part->njobs; j++)
+		for (ss = 0; ss < Spe->spesz; ss++)
+			if (spe == -1 || spe == ss || (spe == -2 && Spe->spetag[ss] == 2))
+				prefetch_shard(&Part->shards[Part->shardorder[j]], ss);
+}
+
+const char *Shard_checkpoints = NULL;
+
+static int write_my_blocks(struct block_writer *w, struct my_block_list *head, int id);
+
+static uint64_t hash_add(uint64_t h, const void *p, size_t n) {
+	const unsigned char *s = p;
+
+	while (n-- > 0)
+		h = (h ^ *s++) * 1099511628211ULL;
+	return h;
+}
+
+static uint64_t hash_str(uint64_t h, const char *s) {
+	return hash_add(h, s, strlen(s) + 1);
+}
+
+/* shard_digest ------------------- digest of what the blocks of a shard are
+ * made from: its segments, the species, the chains and the lifting */
+static uint64_t shard_digest(struct shard *sh) {
+	uint64_t h = 14695981039346656037ULL;
+	struct my_seg_list *sg;
+	int ss, v[6];
+
+	h = hash_str(h, sh->chrom);
+	h = hash_str(h, Spe->chaindir);
+	h = hash_add(h, &Approx_lift, sizeof(Approx_lift));
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		h = hash_str(h, Spe->spename[ss]);
+		h = hash_add(h, &Spe->spetag[ss], sizeof(int));
+		for (sg = sh->segs[ss]; sg != NULL; sg = sg->next) {
+			v[0] = sg->fbeg;
+			v[1] = sg->fend;
+			v[2] = sg->sbeg;
+			v[3] = sg->send;
+			v[4] = sg->orient;
+			v[5] = sg->cid;
+			h = hash_add(h, v, sizeof(v));
+			h = hash_str(h, sg->schrom);
 		}
+		h = hash_str(h, "");
 	}
-	for (ss = 0; ss < Spesz; ss++) {
-		if (ss == rs)
-			continue;
+	return h;
+}
+
+// the file of a shard in the -checkpoint directory; ext "blocks" or "log"
+static void shard_checkpoint(struct shard *sh, const char *ext, char *path, int size) {
+	snprintf(path, size, "%s/%s.%016llx.%s", Shard_checkpoints, sh->chrom,
+		(unsigned long long)sh->digest, ext);
+}
+
+// the blocks of a shard from the block file they were saved in
+static struct my_block_list *my_blocks(struct block_list *blocks) {
+	struct my_block_list *head = NULL, *last = NULL, *blk;
+	struct my_seg_list *sg, *stail;
+	struct block_list *b;
+	struct seg_list *p;
+	int rs = ref_spe_idx(), ss;
+
+	for (b = blocks; b != NULL; b = b->next) {
+		blk = my_allocate_newblock();
+		p = b->speseg[rs];
+		blk->refchrom = intern_chr(p->chr);
+		blk->refbeg = p->beg;
+		blk->refend = p->end;
+		for (ss = 0; ss < Spe->spesz; ss++) {
+			if (ss == rs)
+				continue;
+			for (stail = NULL, p = b->speseg[ss]; p != NULL; p = p->next, stail = sg) {
+				sg = new_my_seg();
+				memset(sg, 0, sizeof(struct my_seg_list));
+				sg->fchrom = blk->refchrom;
+				sg->schrom = intern_chr(p->chr);
+				sg->sbeg = p->beg;
+				sg->send = p->end;
+				sg->orient = p->orient;
+				sg->cid = p->chid;
+				if (stail == NULL)
+					blk->speseg[ss] = sg;
+				else
+					stail->next = sg;
+			}
+		}
+		if (last == NULL)
+			head = blk;
 		else
-			free_chain_space(ss);
+			last->next = blk;
+		last = blk;
 	}
-	
-	// sanity check
-	for (blk = commonblocklist; blk->next != NULL; blk = blk->next) {
+	return head;
+}
+
+/* load_checkpoint ------- the blocks and log of a shard done by a run before;
+ * 0 if it has none */
+static bool load_checkpoint(struct shard *sh, FILE *log) {
+	char path[1000], buf[65536];
+	struct block_list *blocks;
+	size_t n;
+	FILE *fp;
+
+	shard_checkpoint(sh, "blocks", path, sizeof(path));
+	if (access(path, R_OK) != 0)
+		return 0;
+	blocks = read_block_file(path, NULL);
+	Nodes = sh->nodes;
+	sh->blocks = my_blocks(blocks);
+	Nodes = NULL;
+	if (blocks != NULL)
+		free_block_list(blocks);
+	shard_checkpoint(sh, "log", path, sizeof(path));
+	if ((fp = fopen(path, "r")) != NULL) {
+		while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+			fwrite(buf, 1, n, log);
+		fclose(fp);
+	}
+	return 1;
+}
+
+// files are written under a temporary name, so that they are whole or not there
+static FILE *open_checkpoint(struct shard *sh, const char *ext, char *path, char *tmp) {
+	shard_checkpoint(sh, ext, path, 1000);
+	snprintf(tmp, 1100, "%s.%d", path, (int)getpid());
+	return ckopen(tmp, "w");
+}
+
+static void close_checkpoint(FILE *fp, const char *path, const char *tmp) {
+	if (fclose(fp) != 0 || rename(tmp, path) != 0)
+		fatalf("cannot write %s", path);
+}
+
+// the log first: with the blocks there the shard is done
+static void save_checkpoint(struct shard *sh, const char *log, size_t len) {
+	char path[1000], tmp[1100];
+	struct block_writer *w;
+	FILE *fp;
+
+	fp = open_checkpoint(sh, "log", path, tmp);
+	fwrite(log, 1, len, fp);
+	close_checkpoint(fp, path, tmp);
+	fp = open_checkpoint(sh, "blocks", path, tmp);
+	w = open_block_writer(fp, BLOCKS_BUILDING, 1);
+	write_my_blocks(w, sh->blocks, 0);
+	close_block_writer(w);
+	close_checkpoint(fp, path, tmp);
+}
+
+// the checkpoints of the shards once the blocks are written
+static void remove_checkpoints(int lo, int hi) {
+	char path[1000];
+	int k;
+
+	for (k = lo; k < hi && Shard_checkpoints != NULL; k++) {
+		shard_checkpoint(&Part->shards[k], "blocks", path, sizeof(path));
+		unlink(path);
+		shard_checkpoint(&Part->shards[k], "log", path, sizeof(path));
+		unlink(path);
+	}
+}
+
+void shard_job(int k, void *arg) {
+	struct shard *sh;
+	FILE *log, *fp;
+	char *buf = NULL;
+	size_t len = 0;
+
+	join_partition(arg);
+	sh = &Part->shards[Part->shardorder[k]];
+	log = job_stream(Part->shardlogs, Part->shardorder[k] - Part->firstshard);
+	if (Shard_checkpoints != NULL)
+		sh->digest = shard_digest(sh);
+	if (Shard_checkpoints == NULL) {
+		prefetch_jobs(k, -1);
+		build_shard(sh, log);
+	} else if (load_checkpoint(sh, log))
+		count_segs(sh->nseg);
+	else {
+		prefetch_jobs(k, -1);
+		if ((fp = open_memstream(&buf, &len)) == NULL)
+			fatal("open_memstream failed");
+		build_shard(sh, fp);
+		fclose(fp);
+		fwrite(buf, 1, len, log);
+		save_checkpoint(sh, buf, len);
+		free(buf);
+	}
+	progress_add(Part->progress, 1, 0);
+}
+
+// biggest shards first
+int cmp_shard_size(const void *a, const void *b) {
+	const struct shard *x = &Part->shards[*(const int *)a], *y = &Part->shards[*(const int *)b];
+	if (x->nseg != y->nseg)
+		return y->nseg - x->nseg;
+	return *(const int *)a - *(const int *)b;
+}
+
+// sanity check
+static void check_blocks(struct my_block_list *head) {
+	struct my_block_list *blk;
+	int rs = ref_spe_idx();
+
+	for (blk = head; blk != NULL && blk->next != NULL; blk = blk->next) {
 		if (blk->refbeg >= blk->refend)
 			fatalf("end >= beg: %s.%s:%d-%d", 
-							Spename[rs], blk->refchrom, blk->refbeg, blk->refend);
-		if (same_string(blk->refchrom, blk->next->refchrom)) {
+							Spe->spename[rs], blk->refchrom, blk->refbeg, blk->refend);
+		if (blk->refchrom == blk->next->refchrom) {
 			if (blk->refend > blk->next->refbeg) {
 				fatalf("out of order:\n%s.%s:%d-%d %s.%s:%d-%d",
-							Spename[rs], blk->refchrom, blk->refbeg, blk->refend,
-							Spename[rs], blk->next->refchrom, blk->next->refbeg, blk->next->refend);
+							Spe->spename[rs], blk->refchrom, blk->refbeg, blk->refend,
+							Spe->spename[rs], blk->next->refchrom, blk->next->refbeg, blk->next->refend);
 			}
 		}
 	}
-	
-	// print building blocks
-	for (blk = commonblocklist; blk != NULL; blk = blk->next) {
-		printf(">\n");
-		printf("%s.%s:%d-%d +\n", 
-						Spename[rs], blk->refchrom, blk->refbeg, blk->refend);
-		for (ss = 0; ss < Spesz; ss++) {
+}
+
+// the building blocks, as partitionGenomes prints them, numbered after id;
+// returns the last number
+static int write_my_blocks(struct block_writer *w, struct my_block_list *head, int id) {
+	struct my_block_list *blk;
+	struct my_seg_list *sg;
+	struct seg_list out;
+	int rs = ref_spe_idx(), ss;
+
+	memset(&out, 0, sizeof(out));
+	for (blk = head; blk != NULL; blk = blk->next) {
+		write_block(w, ++id);
+		out.chr = blk->refchrom;
+		out.beg = blk->refbeg;
+		out.end = blk->refend;
+		out.orient = '+';
+		out.chid = 0;
+		write_seg(w, rs, &out);
+		for (ss = 0; ss < Spe->spesz; ss++) {
 			if (rs == ss)
 				continue;
-			for (sg = blk->speseg[ss]; sg != NULL; sg = sg->next) 
-				printf("%s.%s:%d-%d %c (%d)\n",Spename[ss], sg->schrom, sg->sbeg, sg->send, sg->orient, sg->cid);
+			for (sg = blk->speseg[ss]; sg != NULL; sg = sg->next) {
+				out.chr = sg->schrom;
+				out.beg = sg->sbeg;
+				out.end = sg->send;
+				out.orient = sg->orient;
+				out.chid = sg->cid;
+				write_seg(w, ss, &out);
+			}
 		}
-		printf("\n");
 	}
+	return id;
+}
+
+static void free_partition(void) {
+	int k, ss;
+
+	report_approx();
+
+	for (k = 0; k < Part->nshards; k++) {
+		free_shard_nodes(&Part->shards[k]);
+		for (ss = 0; ss < Spe->spesz; ss++)
+			free(Part->shards[k].run[ss]);
+		free(Part->shards[k].segs);
+		free(Part->shards[k].tail);
+		free(Part->shards[k].run);
+		free(Part->shards[k].nrun);
+		free(Part->shards[k].maxrun);
+	}
+	free(Part->shards);
+	free(Part->shardidx);
+	free(Part->shardorder);
+	free(Part);
+	Part = NULL;
+}
+
+// the blocks of the shards, in order, as partitionGenomes writes them;
+// the shards, the partition and the chains go
+static struct block_list *shard_blocks(void) {
+	struct my_block_list *commonblocklist, *last;
+	struct block_writer *w;
+	struct block_list *blocks;
+	int rs = ref_spe_idx(), ss, k;
+
+	commonblocklist = last = NULL;
+	for (k = 0; k < Part->nshards; k++) {
+		if (Part->shards[k].blocks == NULL)
+			continue;
+		if (last == NULL)
+			commonblocklist = Part->shards[k].blocks;
+		else
+			last->next = Part->shards[k].blocks;
+		for (last = Part->shards[k].blocks; last->next != NULL; last = last->next)
+			;
+	}
+	for (ss = 0; ss < Spe->spesz; ss++)
+		if (ss != rs)
+			free_chain_space(ss);
+	
+	check_blocks(commonblocklist);
+	w = open_block_writer(NULL, BLOCKS_BUILDING, 0);
+	write_my_blocks(w, commonblocklist, 0);
+	blocks = close_block_writer(w);
 	
-	for (ss = 0; ss < Spesz; ss++) {
+	free_partition();
+	return blocks;
+}
+
+struct block_list *partition_genomes(FILE **processed, int nthreads) {
+	int ss, rs, k;
+	long total;
+	char segfile[200];
+	struct my_seg_list *spesegs[MAXSPE];
+	struct block_list *blocks;
+	struct arena *input;
+	
+	rs = ref_spe_idx();
+	new_partition();
+	
+	// read processed seg files
+	Nodes = input = new_arena(0);
+	for (ss = 0; ss < Spe->spesz; ss++) {
 		if (rs == ss)
 			continue;
-		free_my_seg_list(spesegs[ss]);
+		sprintf(segfile, "%s.processed.segs", Spe->spename[ss]);
+		spesegs[ss] = get_my_seglist(processed[ss], segfile);
+	}
+
+	// the first descendent with segments lays out the blocks, so its
+	// chromosomes come first and give the output order
+	for (Part->builder = 0; Part->builder < Spe->spesz; Part->builder++)
+		if (Spe->spetag[Part->builder] == 1 && spesegs[Part->builder] != NULL)
+			break;
+	if (Part->builder < Spe->spesz)
+		split_segs(Part->builder, spesegs[Part->builder]);
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (ss != rs && ss != Part->builder)
+			split_segs(ss, spesegs[ss]);
+		if (ss != rs)
+			load_chains(rs, ss);
+	}
+	if (Union_pieces && nthreads > 1) {
+		for (total = k = 0; k < Part->nshards; k++)
+			total += Part->shards[k].nseg;
+		split_shards(MAX(total / (4 * nthreads), 1000));
 	}
+
+	Part->shardorder = ckalloc((Part->nshards + 1) * sizeof(int));
+	for (k = 0; k < Part->nshards; k++)
+		Part->shardorder[k] = k;
+	qsort(Part->shardorder, Part->nshards, sizeof(int), cmp_shard_size);
+	Part->shardlogs = open_job_output(Part->nshards);
+	Part->firstshard = 0;
+	Part->njobs = Part->nshards;
+	note_chains(-1);
+	for (total = k = 0; k < Part->nshards; k++)
+		total += Part->shards[k].nseg;
+	start_progress(total);
+	Part->nthreads = nthreads;
+	run_jobs(Part->nshards, nthreads, shard_job, Part);
+	end_progress();
+	Nodes = NULL;
+	close_job_output(Part->shardlogs, stderr);
+	remove_checkpoints(0, Part->nshards);
+
+	blocks = shard_blocks();
+	free_arena(input);
 	
-	free_my_block_list(commonblocklist);
+	return blocks;
+}
+
+/* piped: the species come one at a time, in species order, as each one's
+ * processed.segs is ready (see makeBlocks). A descendent is added to all
+ * the shards on the threads as it comes; the outgroups wait for the
+ * last descendent. The blocks and the log are those of partition_genomes() */
+
+// the block index a shard keeps between the species, made the one of
+// this thread, and given back
+static void use_shard_index(struct shard *sh) {
+	Nodes = sh->nodes;
+	Chromblocks = sh->index;
+	Nchromblocks = sh->nindex;
+	Maxchromblocks = sh->maxindex;
+	Blockindex = sh->indexed;
+}
+
+static void keep_shard_index(struct shard *sh) {
+	sh->index = Chromblocks;
+	sh->nindex = Nchromblocks;
+	sh->maxindex = Maxchromblocks;
+	sh->indexed = Blockindex;
+	Chromblocks = NULL;
+	Nchromblocks = Maxchromblocks = 0;
+	Nodes = NULL;
+}
+
+static void piped_job(int k, void *arg) {
+	struct shard *sh;
+
+	join_partition(arg);
+	sh = &Part->shards[Part->shardorder[k]];
+	prefetch_jobs(k, Part->pipedspe >= 0 ? Part->pipedspe : -2);
+	if (sh->log == NULL && (sh->log = open_memstream(&sh->logbuf, &sh->loglen)) == NULL)
+		fatal("open_memstream failed");
+	use_shard_index(sh);
+	if (Part->pipedspe >= 0)
+		add_shard_species(sh, Part->pipedspe, sh->log);
+	else {
+		add_outgroups(sh, sh->log);
+		reset_block_index();
+	}
+	keep_shard_index(sh);
+	progress_add(Part->progress, 1, 0);
+}
+
+// adds species ss (-1: the outgroups) to every shard, biggest first
+static void piped_pass(int ss, int nthreads) {
+	struct my_seg_list *sg;
+	long nseg = 0;
+	int k, i;
+
+	Part->pipedspe = ss;
+	Part->shardorder = ckrealloc(Part->shardorder, (Part->nshards + 1) * sizeof(int));
+	for (k = 0; k < Part->nshards; k++)
+		Part->shardorder[k] = k;
+	qsort(Part->shardorder, Part->nshards, sizeof(int), cmp_shard_size);
+	Part->njobs = Part->nshards;
+	note_chains(ss >= 0 ? ss : -2);
+	for (k = 0; k < Part->nshards; k++)
+		for (i = 0; i < Spe->spesz; i++)
+			if (i == ss || (ss < 0 && Spe->spetag[i] == 2))
+				for (sg = Part->shards[k].segs[i]; sg != NULL; sg = sg->next)
+					nseg++;
+	snprintf(Part->what, sizeof(Part->what), "partitionGenomes, %s",
+		ss >= 0 ? Spe->spename[ss] : "the outgroups");
+	start_progress(nseg);
+	Part->nthreads = nthreads;
+	run_jobs(Part->nshards, nthreads, piped_job, Part);
+	end_progress();
+}
+
+void begin_partition(void) {
+	new_partition();
+	Part->input = new_arena(0);
+	Part->builder = Spe->spesz;
+}
+
+void partition_species(int ss, FILE *processed, int nthreads) {
+	char segfile[200];
+	struct my_seg_list *segs;
+	int rs = ref_spe_idx();
+
+	if (ss == rs)
+		return;
+	sprintf(segfile, "%s.processed.segs", Spe->spename[ss]);
+	Nodes = Part->input;
+	segs = get_my_seglist(processed, segfile);
+	Nodes = NULL;
+	load_chains(rs, ss);
+	if (Spe->spetag[ss] == 2) {
+		Part->outgroupsegs[ss] = segs;
+		return;
+	}
+	if (Part->builder == Spe->spesz && segs != NULL)
+		Part->builder = ss;
+	// a descendent before the first with segments adds nothing
+	if (Part->builder == Spe->spesz)
+		return;
+	split_segs(ss, segs);
+	piped_pass(ss, nthreads);
+}
+
+/* the outgroups fill the blocks of the descendents and cut their own
+ * segments at the gaps between them, but never cut a block or start one:
+ * the blocks of the descendents alone, once they are all added, make the
+ * same blocks with any outgroups added to them */
+struct block_list *descendent_blocks(void) {
+	struct block_writer *w;
+	int k, id = 0;
+
+	w = open_block_writer(NULL, BLOCKS_BUILDING, 0);
+	for (k = 0; k < Part->nshards; k++) {
+		check_blocks(Part->shards[k].blocks);
+		id = write_my_blocks(w, Part->shards[k].blocks, id);
+	}
+	return close_block_writer(w);
+}
+
+void begin_outgroup_partition(struct block_list *blocks) {
+	struct block_list *b;
+	struct my_block_list *blk, *last = NULL;
+	struct my_seg_list *sg, **pt;
+	struct seg_list *s;
+	struct shard *sh = NULL;
+	int rs = ref_spe_idx(), ss;
+
+	begin_partition();
+	for (b = blocks; b != NULL; b = b->next) {
+		if ((s = b->speseg[rs]) == NULL)
+			fatalf("block %d has no segment of %s", b->id, Spe->spename[rs]);
+		if (sh == NULL || sh->chrom != s->chr) {
+			if (sh != NULL)
+				keep_shard_index(sh);
+			sh = find_shard(s->chr);
+			use_shard_index(sh);
+			for (last = sh->blocks; last != NULL && last->next != NULL; last = last->next)
+				;
+		}
+		blk = my_allocate_newblock();
+		blk->refchrom = s->chr;
+		blk->refbeg = s->beg;
+		blk->refend = s->end;
+		for (ss = 0; ss < Spe->spesz; ss++) {
+			if (ss == rs)
+				continue;
+			// only the side of the species is written; the reference
+			// side, never looked at again, is that of the block
+			for (pt = &blk->speseg[ss], s = b->speseg[ss]; s != NULL; s = s->next) {
+				sg = new_my_seg();
+				sg->fchrom = blk->refchrom;
+				sg->fbeg = blk->refbeg;
+				sg->fend = blk->refend;
+				sg->schrom = s->chr;
+				sg->sbeg = s->beg;
+				sg->send = s->end;
+				sg->orient = s->orient;
+				sg->cid = s->chid;
+				sg->next = NULL;
+				*pt = sg;
+				pt = &sg->next;
+			}
+		}
+		if (last == NULL)
+			sh->blocks = blk;
+		else
+			last->next = blk;
+		index_block(blk, last, NULL);
+		last = blk;
+	}
+	if (sh != NULL)
+		keep_shard_index(sh);
+}
+
+struct block_list *end_partition(int nthreads) {
+	struct block_list *blocks;
+	struct arena *input;
+	int ss, k;
+
+	for (ss = 0; ss < Spe->spesz; ss++)
+		if (Spe->spetag[ss] == 2)
+			split_segs(ss, Part->outgroupsegs[ss]);
+	piped_pass(-1, nthreads);
+	for (k = 0; k < Part->nshards; k++) {
+		if (Part->shards[k].log == NULL)
+			continue;
+		fclose(Part->shards[k].log);
+		fwrite(Part->shards[k].logbuf, 1, Part->shards[k].loglen, stderr);
+		free(Part->shards[k].logbuf);
+	}
+	input = Part->input;
+	blocks = shard_blocks();
+	free_arena(input);
+	return blocks;
+}
+
+/* seekable_input ---------- an input that can be read again by chromosome */
+/* (one that cannot seek, as a compressed file, is spilled to a temporary
+ * file first and closed) */
+static FILE *seekable_input(FILE *fp, char *filename) {
+	char buf[65536];
+	size_t n;
+	FILE *tmp;
+
+	if (fseeko(fp, 0, SEEK_CUR) == 0)
+		return fp;
+	if ((tmp = tmpfile()) == NULL)
+		fatalf("cannot spill %s: %s", filename, strerror(errno));
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		if (fwrite(buf, 1, n, tmp) != n)
+			fatalf("cannot spill %s: %s", filename, strerror(errno));
+	ckclose_in(fp);
+	rewind(tmp);
+	return tmp;
+}
+
+/* index_segs ----------- the runs of segments of each reference chromosome */
+static struct seg_run *index_segs(struct seg_reader *sr, char *filename, int *nrun) {
+	struct seg_run *run = NULL, *r;
+	struct seg_line s;
+	off_t off;
+	int max = 0;
+
+	fprintf(stderr, "- indexing segments of %s\n", filename);
+	*nrun = 0;
+	for (off = seg_tell(sr); read_seg_line(sr, &s); off = seg_tell(sr)) {
+		// a run of one chromosome takes in the comments within it
+		if (*nrun == 0 || run[*nrun-1].chrom != s.fchr) {
+			if (*nrun == max) {
+				max = max ? 2 * max : 256;
+				run = ckrealloc(run, max * sizeof(struct seg_run));
+			}
+			r = &run[(*nrun)++];
+			r->chrom = s.fchr;
+			r->off = off;
+			r->nseg = 0;
+		}
+		run[*nrun-1].nseg++;
+	}
+	return run;
+}
+
+// hands the runs of a species to the shards of their chromosomes
+static void split_runs(int ss, struct seg_run *run, int nrun) {
+	struct shard *sh = NULL;
+	int i;
+
+	for (i = 0; i < nrun; i++) {
+		if (sh == NULL || sh->chrom != run[i].chrom)
+			sh = find_shard(run[i].chrom);
+		if (sh->nrun[ss] == sh->maxrun[ss]) {
+			sh->maxrun[ss] = sh->maxrun[ss] ? 2 * sh->maxrun[ss] : 4;
+			sh->run[ss] = ckrealloc(sh->run[ss], sh->maxrun[ss] * sizeof(struct seg_run));
+		}
+		sh->run[ss][sh->nrun[ss]++] = run[i];
+		sh->nseg += run[i].nseg;
+	}
+}
+
+/* reads the segments of a shard back from the inputs; a binary one
+ * names its chromosomes once, to the reader that indexed it */
+static void load_shard(struct shard *sh, struct seg_reader **in, char (*segfile)[200]) {
+	struct my_seg_list *p;
+	struct seg_run *r;
+	struct seg_line s;
+	int ss, i, k;
+
+	Nodes = sh->nodes;
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		for (i = 0; i < sh->nrun[ss]; i++) {
+			r = &sh->run[ss][i];
+			seg_seek(in[ss], r->off);
+			for (k = 0; k < r->nseg; k++) {
+				if (!read_seg_line(in[ss], &s))
+					fatalf("cannot read %s", segfile[ss]);
+				p = my_seg(&s, segfile[ss]);
+				if (sh->segs[ss] == NULL)
+					sh->segs[ss] = p;
+				else
+					sh->tail[ss]->next = p;
+				sh->tail[ss] = p;
+			}
+		}
+	}
+	Nodes = NULL;
+}
+
+void partition_genomes_streamed(FILE **processed, int nthreads, int shard, int nshards,
+								struct block_writer *w) {
+	int ss, rs, k, first, n, lo, hi, id = 0, nrun[MAXSPE];
+	long total, before;
+	char segfile[MAXSPE][200];
+	struct seg_run *run[MAXSPE];
+	struct seg_reader *rd[MAXSPE];
+	FILE *in[MAXSPE];
+
+	rs = ref_spe_idx();
+	new_partition();
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (rs == ss)
+			continue;
+		sprintf(segfile[ss], "%s.processed.segs", Spe->spename[ss]);
+		in[ss] = processed[ss] ? processed[ss] : ckopen_in(segfile[ss]);
+		in[ss] = seekable_input(in[ss], segfile[ss]);
+		rd[ss] = open_seg_reader(in[ss], SEGS_PROCESSED, segfile[ss]);
+		run[ss] = index_segs(rd[ss], segfile[ss], &nrun[ss]);
+	}
+
+	// the shards in the order of partition_genomes()
+	for (Part->builder = 0; Part->builder < Spe->spesz; Part->builder++)
+		if (Spe->spetag[Part->builder] == 1 && Part->builder != rs && nrun[Part->builder] > 0)
+			break;
+	if (Part->builder < Spe->spesz)
+		split_runs(Part->builder, run[Part->builder], nrun[Part->builder]);
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (ss != rs && ss != Part->builder)
+			split_runs(ss, run[ss], nrun[ss]);
+		if (ss != rs) {
+			free(run[ss]);
+			load_chains(rs, ss);
+		}
+	}
+
+	// the run of shards of this job, cut by the segments before them
+	for (total = k = 0; k < Part->nshards; k++)
+		total += Part->shards[k].nseg;
+	for (lo = hi = before = k = 0; k < Part->nshards; before += Part->shards[k++].nseg) {
+		if (before * nshards < total * shard)
+			lo = k + 1;
+		if (before * nshards < total * (shard + 1) || shard == nshards - 1)
+			hi = k + 1;
+	}
+
+	// as many shards at a time as there are threads, written out in order
+	// and freed before the next ones are read
+	Part->shardorder = ckalloc((Part->nshards + 1) * sizeof(int));
+	Part->njobs = hi - lo;
+	for (before = 0, k = lo; k < hi; k++)
+		before += Part->shards[k].nseg;
+	start_progress(before);
+	for (first = lo; first < hi; first += n) {
+		n = MIN(nthreads, hi - first);
+		for (k = 0; k < n; k++) {
+			load_shard(&Part->shards[first + k], rd, segfile);
+			Part->shardorder[k] = first + k;
+		}
+		qsort(Part->shardorder, n, sizeof(int), cmp_shard_size);
+		Part->shardlogs = open_job_output(n);
+		Part->firstshard = first;
+		Part->njobs = n;
+		note_chains(-1);
+		Part->nthreads = nthreads;
+		run_jobs(n, nthreads, shard_job, Part);
+		Nodes = NULL;
+		close_job_output(Part->shardlogs, stderr);
+		for (k = first; k < first + n; k++) {
+			check_blocks(Part->shards[k].blocks);
+			id = write_my_blocks(w, Part->shards[k].blocks, id);
+			free_shard_nodes(&Part->shards[k]);
+		}
+	}
+	end_progress();
+	remove_checkpoints(lo, hi);
+
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (ss == rs)
+			continue;
+		free_chain_space(ss);
+		close_seg_reader(rd[ss]);
+		if (in[ss] != processed[ss])
+			fclose(in[ss]);
+	}
+	free_partition();
+}
+
+#ifndef NO_MAIN
+int main(int argc, char *argv[]) {
+	int nthreads, binary, streamed = 0, shard = 1, nshards = 1;
+	FILE **processed;
+	struct block_list *blocks;
+	struct block_writer *w;
+	
+	binary = binary_blocks_arg(&argc, argv);
+	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+		if (same_string(argv[1], "-stream"))
+			streamed = 1;
+		else if (same_string(argv[1], "-union"))
+			Union_pieces = 1;
+		else if (same_string(argv[1], "-approx"))
+			Approx_lift = 1;
+		else if (same_string(argv[1], "-approxCheck"))
+			Approx_lift = 2;
+		else if (same_string(argv[1], "-checkpoint") && argc > 2) {
+			Shard_checkpoints = argv[2];
+			argc--;
+			argv++;
+		}
+		else if (same_string(argv[1], "-shard") && argc > 2
+				&& sscanf(argv[2], "%d/%d", &shard, &nshards) == 2
+				&& shard >= 1 && shard <= nshards) {
+			streamed = 1;
+			argc--;
+			argv++;
+		}
+		else
+			break;
+	}
+	if (argc != 2 && argc != 3)
+		fatal("args: [-bin] [-stream] [-shard k/n] [-union] [-approx | -approxCheck] [-checkpoint dir] configure-file [threads]");
+	nthreads = thread_arg(argc == 3 ? argv[2] : NULL);
+	Block_threads = nthreads;
+	if (Shard_checkpoints != NULL && mkdir(Shard_checkpoints, 0777) != 0 && errno != EEXIST)
+		fatalf("cannot make %s", Shard_checkpoints);
+	
+	get_spename(argv[1]);
+	get_chaindir(argv[1]);
+	get_minlen(argv[1]);	
+
+	processed = ckallocz(Spe->spesz * sizeof(FILE *));
+	if (streamed) {
+		w = open_block_writer(stdout, BLOCKS_BUILDING, binary);
+		partition_genomes_streamed(processed, nthreads, shard - 1, nshards, w);
+		close_block_writer(w);
+	} else {
+		blocks = partition_genomes(processed, nthreads);
+		write_block_list(stdout, blocks, BLOCKS_BUILDING, binary);
+		free_block_list(blocks);
+	}
+	free(processed);
 	
 	return 0;
 }
+#endif
@@ -0,0 +1,114 @@
+/* *****************************************************************
+ * Reads files into the page cache ahead of the stage that needs them,
+ * for the driver to run while the stage before it runs (start_prefetch()
+ * of script/Stages.pm): each file given, and each under a directory
+ * given, in that order, through posix_fadvise(WILLNEED). Only the pages
+ * that are not cached already count, and no more of them than half the
+ * free memory holds (and -mb MB, if given), so that the running stage
+ * keeps its pages; the rest is read when it is needed, as before.
+ *
+ *   prefetchFiles [-mb n] file|dir ...
+ * ****************************************************************/
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+
+// the most asked for at once
+#define PIECE	(4 << 20)
+
+static long long Budget;	// bytes it may still read
+
+/* free_bytes --------------------- MemFree of /proc/meminfo, 0 if unknown */
+static long long free_bytes(void)
+{
+	char line[200];
+	long long kb = 0;
+	FILE *fp;
+
+	if ((fp = fopen("/proc/meminfo", "r")) == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), fp) != NULL)
+		if (sscanf(line, "MemFree: %lld kB", &kb) == 1)
+			break;
+	fclose(fp);
+	return 1024 * kb;
+}
+
+/* prefetch ------------ ask for the pages of a file that are not cached */
+/* WILLNEED reads no more than the readahead window of the device at a
+ * time, so the runs of missing pages are asked for in pieces */
+static void prefetch(const char *path)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	size_t i, k, npage;
+	unsigned char *vec;
+	struct stat st;
+	void *p;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0
+		|| (p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return;
+	}
+	npage = (st.st_size + page - 1) / page;
+	vec = ckalloc(npage);
+	if (mincore(p, st.st_size, vec) != 0)
+		memset(vec, 0, npage);
+	munmap(p, st.st_size);
+	for (i = 0; i < npage && Budget > 0; i = k) {
+		if (vec[i] & 1) {
+			k = i + 1;
+			continue;
+		}
+		for (k = i + 1; k < npage && !(vec[k] & 1) && (k - i) * page < PIECE
+			&& (long long)(k - i) * page < Budget; k++)
+			;
+		posix_fadvise(fd, (off_t)i * page, (off_t)(k - i) * page, POSIX_FADV_WILLNEED);
+		Budget -= (long long)(k - i) * page;
+	}
+	free(vec);
+	close(fd);
+}
+
+static int prefetch_entry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+	(void)st;
+	(void)ftw;
+	if (type == FTW_F)
+		prefetch(path);
+	return Budget <= 0;
+}
+
+int main(int argc, char *argv[])
+{
+	long long mb = -1;
+	struct stat st;
+	int i;
+
+	if (argc > 2 && same_string(argv[1], "-mb")) {
+		mb = atoll(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc < 2)
+		fatal("args: [-mb n] file|dir ...");
+	Budget = free_bytes() / 2;
+	if (mb >= 0)
+		Budget = MIN(Budget, mb << 20);
+	for (i = 1; i < argc && Budget > 0; i++) {
+		if (stat(argv[i], &st) != 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			nftw(argv[i], prefetch_entry, 16, FTW_PHYS);
+		else
+			prefetch(argv[i]);
+	}
+	return 0;
+}
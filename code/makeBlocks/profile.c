@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <limits.h>
+#include <link.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "profile.h"
+
+// the stacks, the link maps and the timer are those of Linux and glibc
+#ifdef __linux__
+
+#define SLAB	4096	// samples in a slab
+#define DEPTH	64		// the frames kept of a stack
+#define SKIP	2		// the frames of the handler and of the signal
+#define MODULES	64
+
+// a stack, leaf first; n is 0 while the handler writes it
+struct sample {
+	int n;
+	void *pc[DEPTH];
+};
+
+// the samples of a stack
+struct stack {
+	struct stack *next;
+	unsigned hash;
+	long count;
+	int n;
+	void *pc[];
+};
+
+static struct sample *Slab[2];
+static int Cur, Fill[2];	// the slab the handler fills, the samples taken of each
+static long Dropped, Samples;
+static sem_t Full;
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stack **Table;
+static unsigned Nbucket, Nstack;
+static char *Path;			// the file to write, NULL when not sampling
+static pid_t Pid;
+
+static void on_prof(int sig)
+{
+	void *pc[DEPTH + SKIP];
+	struct sample *x;
+	int s, i, n, save = errno;
+
+	(void)sig;
+	s = __atomic_load_n(&Cur, __ATOMIC_ACQUIRE);
+	i = __atomic_fetch_add(&Fill[s], 1, __ATOMIC_ACQ_REL);
+	if (i >= SLAB) {
+		__atomic_fetch_add(&Dropped, 1, __ATOMIC_RELAXED);
+		errno = save;
+		return;
+	}
+	x = Slab[s] + i;
+	n = backtrace(pc, DEPTH + SKIP) - SKIP;
+	if (n > 0)
+		memcpy(x->pc, pc + SKIP, n * sizeof(void *));
+	__atomic_store_n(&x->n, n > 0 ? n : -1, __ATOMIC_RELEASE);
+	// the last of the slab: the other one takes the next, once it is added up
+	if (i == SLAB - 1) {
+		if (__atomic_load_n(&Fill[1 - s], __ATOMIC_ACQUIRE) == 0)
+			__atomic_store_n(&Cur, 1 - s, __ATOMIC_RELEASE);
+		sem_post(&Full);
+	}
+	errno = save;
+}
+
+static unsigned hash_stack(void **pc, int n)
+{
+	unsigned long h = 14695981039346656037UL;
+	int k;
+
+	for (k = 0; k < n; k++)
+		h = (h ^ (unsigned long)pc[k]) * 1099511628211UL;
+	return (unsigned)(h ^ (h >> 32));
+}
+
+static void grow_table(void)
+{
+	unsigned nb = Nbucket ? 2 * Nbucket : 1024, k;
+	struct stack **t = calloc(nb, sizeof(struct stack *)), *st, *next;
+
+	if (t == NULL)
+		return;
+	for (k = 0; k < Nbucket; k++)
+		for (st = Table[k]; st != NULL; st = next) {
+			next = st->next;
+			st->next = t[st->hash & (nb - 1)];
+			t[st->hash & (nb - 1)] = st;
+		}
+	free(Table);
+	Table = t;
+	Nbucket = nb;
+}
+
+static void add_stack(void **pc, int n)
+{
+	unsigned h = hash_stack(pc, n);
+	struct stack *st;
+
+	if (Nstack >= Nbucket)
+		grow_table();
+	if (Table == NULL)
+		return;
+	for (st = Table[h & (Nbucket - 1)]; st != NULL; st = st->next)
+		if (st->hash == h && st->n == n && memcmp(st->pc, pc, n * sizeof(void *)) == 0) {
+			st->count++;
+			return;
+		}
+	if ((st = malloc(sizeof(struct stack) + n * sizeof(void *))) == NULL)
+		return;
+	st->hash = h;
+	st->count = 1;
+	st->n = n;
+	memcpy(st->pc, pc, n * sizeof(void *));
+	st->next = Table[h & (Nbucket - 1)];
+	Table[h & (Nbucket - 1)] = st;
+	Nstack++;
+}
+
+/* add_slab ------------ add up the samples of a slab the handler left */
+static void add_slab(int s)
+{
+	int n = __atomic_load_n(&Fill[s], __ATOMIC_ACQUIRE), i, k;
+	struct sample *x;
+
+	if (n > SLAB)
+		n = SLAB;
+	for (i = 0; i < n; i++) {
+		x = Slab[s] + i;
+		// a handler on another thread may still be at it
+		while ((k = __atomic_load_n(&x->n, __ATOMIC_ACQUIRE)) == 0)
+			sched_yield();
+		if (k > 0)
+			add_stack(x->pc, k);
+		x->n = 0;
+		Samples++;
+	}
+	__atomic_store_n(&Fill[s], 0, __ATOMIC_RELEASE);
+}
+
+/* add_full ---- add up the slabs left, turning the handler to an empty one */
+static void add_full(void)
+{
+	int k, s;
+
+	// a handler that took a slab as it was turned from leaves one sample in it
+	for (k = 0; k < 2; k++) {
+		s = __atomic_load_n(&Cur, __ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&Fill[s], __ATOMIC_ACQUIRE) >= SLAB
+			&& __atomic_load_n(&Fill[1 - s], __ATOMIC_ACQUIRE) == 0) {
+			__atomic_store_n(&Cur, 1 - s, __ATOMIC_RELEASE);
+			s = 1 - s;
+		}
+		if (__atomic_load_n(&Fill[1 - s], __ATOMIC_ACQUIRE) > 0)
+			add_slab(1 - s);
+	}
+}
+
+static void *adder(void *arg)
+{
+	sigset_t set;
+
+	(void)arg;
+	sigemptyset(&set);
+	sigaddset(&set, SIGPROF);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	for (;;) {
+		while (sem_wait(&Full) != 0 && errno == EINTR)
+			;
+		pthread_mutex_lock(&Lock);
+		add_full();
+		pthread_mutex_unlock(&Lock);
+	}
+	return NULL;
+}
+
+// the module of an address and its index in mod, adding it; -1 for none
+static int module_of(uintptr_t a, struct link_map **mod, int *nmod)
+{
+	struct link_map *lm = NULL;
+	Dl_info info;
+	int m;
+
+	if (dladdr1((void *)a, &info, (void **)&lm, RTLD_DL_LINKMAP) == 0 || lm == NULL)
+		return -1;
+	for (m = 0; m < *nmod && mod[m] != lm; m++)
+		;
+	if (m == *nmod) {
+		if (m == MODULES)
+			return -1;
+		mod[(*nmod)++] = lm;
+	}
+	return m;
+}
+
+/* write_stacks ------- the modules, then the stacks root first, a return
+ * address taken back into its call */
+static void write_stacks(FILE *fp)
+{
+	struct link_map *mod[MODULES];
+	char exe[PATH_MAX];
+	struct stack *st;
+	uintptr_t a;
+	unsigned k;
+	ssize_t len;
+	int nmod = 0, i, m, pass;
+
+	if ((len = readlink("/proc/self/exe", exe, sizeof(exe) - 1)) < 0)
+		len = 0;
+	exe[len] = '\0';
+	fprintf(fp, "# profile %s %d %d %ld %ld\n", program_invocation_short_name, (int)Pid,
+		PROFILE_HZ, Samples, Dropped);
+	for (pass = 0; pass < 2; pass++) {
+		for (k = 0; k < Nbucket; k++)
+			for (st = Table[k]; st != NULL; st = st->next) {
+				if (pass == 1)
+					fprintf(fp, "%ld", st->count);
+				for (i = st->n - 1; i >= 0; i--) {
+					a = (uintptr_t)st->pc[i] - (i > 0);
+					m = module_of(a, mod, &nmod);
+					if (pass == 0)
+						continue;
+					if (m < 0)
+						fprintf(fp, " 0:%lx", (unsigned long)a);
+					else
+						fprintf(fp, " %d:%lx", m + 1, (unsigned long)(a - mod[m]->l_addr));
+				}
+				if (pass == 1)
+					fprintf(fp, "\n");
+			}
+		if (pass == 0)
+			for (m = 0; m < nmod; m++)
+				fprintf(fp, "@%d %s\n", m + 1, mod[m]->l_name[0] ? mod[m]->l_name : exe);
+	}
+}
+
+void profile_stop(void)
+{
+	struct itimerval off;
+	char tmp[PATH_MAX + 10];
+	FILE *fp;
+	int s;
+
+	if (Path == NULL || getpid() != Pid)
+		return;
+	memset(&off, 0, sizeof(off));
+	setitimer(ITIMER_PROF, &off, NULL);
+	pthread_mutex_lock(&Lock);
+	for (s = 0; s < 2; s++)
+		add_slab(s);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", Path);
+	if ((fp = fopen(tmp, "w")) != NULL) {
+		write_stacks(fp);
+		if (fclose(fp) == 0)
+			rename(tmp, Path);
+		else
+			unlink(tmp);
+	}
+	free(Path);
+	Path = NULL;
+	pthread_mutex_unlock(&Lock);
+}
+
+__attribute__((constructor))
+static void profile_start(void)
+{
+	const char *dir = getenv("DESCHRAMBLER_PROFILE"), *stage = getenv("DESCHRAMBLER_STAGE");
+	struct itimerval it;
+	struct sigaction sa;
+	pthread_t thread;
+	void *pc[4];
+	char *p;
+	int s;
+
+	if (dir == NULL || *dir == '\0')
+		return;
+	if (stage == NULL || *stage == '\0')
+		stage = program_invocation_short_name;
+	for (s = 0; s < 2; s++)
+		if ((Slab[s] = mmap(NULL, SLAB * sizeof(struct sample), PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+			return;
+	Pid = getpid();
+	if ((Path = malloc(strlen(dir) + strlen(stage) + 40)) == NULL)
+		return;
+	sprintf(Path, "%s/%s.%d.stacks", dir, stage, (int)Pid);
+	for (p = Path + strlen(dir) + 1; *p != '\0'; p++)
+		if (*p == '/' || *p == ' ')
+			*p = '_';
+	// the first backtrace() loads what it unwinds with, which a handler may not
+	backtrace(pc, 4);
+	sem_init(&Full, 0, 0);
+	if (pthread_create(&thread, NULL, adder, NULL) != 0) {
+		free(Path);
+		Path = NULL;
+		return;
+	}
+	pthread_detach(thread);
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_prof;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGPROF, &sa, NULL);
+	it.it_interval.tv_sec = 0;
+	it.it_interval.tv_usec = 1000000 / PROFILE_HZ;
+	it.it_value = it.it_interval;
+	setitimer(ITIMER_PROF, &it, NULL);
+	atexit(profile_stop);
+}
+
+#else
+
+void profile_stop(void)
+{
+}
+
+#endif
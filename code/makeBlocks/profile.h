@@ -0,0 +1,44 @@
+/* **************************************************************
+ * A sampling profiler built into the tools, for the profile of a stage
+ * on a host where perf is not allowed. With DESCHRAMBLER_PROFILE naming
+ * a directory, a tool linked with profile.o samples the stacks of its
+ * threads PROFILE_HZ times a second of the CPU time they take (the
+ * SIGPROF of ITIMER_PROF), from before main() on. The handler only
+ * copies the stack into one of two slabs; a thread of its own adds the
+ * full slab up by stack while the other fills. At exit the stacks are
+ * written to <dir>/<stage>.<pid>.stacks, the stage being
+ * DESCHRAMBLER_STAGE (which DESCHRAMBLER.pl sets) or the tool, as
+ *
+ *   # profile <tool> <pid> <hz> <samples> <dropped>
+ *   @1 /path/of/the/tool
+ *   @2 /lib/x86_64-linux-gnu/libc.so.6
+ *   37 1:4a0f2 1:3b3bf 2:8e77f
+ *
+ * a line of each module and then of each stack, with its samples and
+ * its frames, root first, as a module and an address in it for
+ * addr2line. script/profile_stacks.pl names the frames and folds the
+ * stacks for flamegraph.pl. A tool killed by a signal writes none.
+ * With the variable unset no signal or thread is set up. Like
+ * progress.h it uses none of the rest of makeBlocks, for code/.
+ * **************************************************************/
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#define PROFILE_HZ	97	// not a divisor of the common timer rates
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* **************************************************************
+ * Writes the stacks sampled so far and stops sampling, for a tool
+ * about to leave without exit(); exit() does it otherwise.
+ * **************************************************************/
+void profile_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "progress.h"
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// h:mm:ss
+static char *hms(double sec, char *buf)
+{
+	long s = sec < 0 ? 0 : (long)(sec + 0.5);
+
+	sprintf(buf, "%ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60);
+	return buf;
+}
+
+// v with what OpenMetrics escapes in a label escaped, at most n bytes
+static char *label(const char *v, char *buf, int n)
+{
+	int k = 0;
+
+	for (; v != NULL && *v != '\0' && k < n - 3; v++) {
+		if (*v == '"' || *v == '\\' || *v == '\n')
+			buf[k++] = '\\';
+		buf[k++] = *v == '\n' ? 'n' : *v;
+	}
+	buf[k] = '\0';
+	return buf;
+}
+
+/* write_metrics -------------- the counts as an OpenMetrics text file, for
+ * the textfile collector of node_exporter */
+static void write_metrics(struct progress *p, long done, long items, double elapsed, double eta)
+{
+	char tmpfile[1100], tool[200], stage[200], unit[100], what[100];
+	FILE *fp;
+
+	snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", p->metrics);
+	if ((fp = fopen(tmpfile, "w")) == NULL)
+		return;
+	label(p->tool, tool, sizeof(tool));
+	label(getenv("DESCHRAMBLER_STAGE"), stage, sizeof(stage));
+	label(p->unit, unit, sizeof(unit));
+	fprintf(fp, "# TYPE deschrambler_progress_units counter\n"
+		"# HELP deschrambler_progress_units Units of work done.\n"
+		"deschrambler_progress_units_total{tool=\"%s\",stage=\"%s\",unit=\"%s\",pid=\"%d\"} %ld\n",
+		tool, stage, unit, (int)getpid(), done);
+	if (p->total > 0)
+		fprintf(fp, "# TYPE deschrambler_progress_units_todo gauge\n"
+			"# HELP deschrambler_progress_units_todo Units of work in all.\n"
+			"deschrambler_progress_units_todo{tool=\"%s\",stage=\"%s\",unit=\"%s\",pid=\"%d\"} %ld\n",
+			tool, stage, unit, (int)getpid(), p->total);
+	if (p->items != NULL) {
+		label(p->items, what, sizeof(what));
+		fprintf(fp, "# TYPE deschrambler_progress_items counter\n"
+			"# HELP deschrambler_progress_items Items the units done stood for.\n"
+			"deschrambler_progress_items_total{tool=\"%s\",stage=\"%s\",item=\"%s\",pid=\"%d\"} %ld\n",
+			tool, stage, what, (int)getpid(), items);
+		if (p->items_total > 0)
+			fprintf(fp, "# TYPE deschrambler_progress_items_todo gauge\n"
+				"# HELP deschrambler_progress_items_todo Items in all.\n"
+				"deschrambler_progress_items_todo{tool=\"%s\",stage=\"%s\",item=\"%s\",pid=\"%d\"} %ld\n",
+				tool, stage, what, (int)getpid(), p->items_total);
+	}
+	fprintf(fp, "# TYPE deschrambler_progress_elapsed_seconds gauge\n"
+		"deschrambler_progress_elapsed_seconds{tool=\"%s\",stage=\"%s\",pid=\"%d\"} %.1f\n",
+		tool, stage, (int)getpid(), elapsed);
+	if (eta >= 0)
+		fprintf(fp, "# TYPE deschrambler_progress_left_seconds gauge\n"
+			"deschrambler_progress_left_seconds{tool=\"%s\",stage=\"%s\",pid=\"%d\"} %.1f\n",
+			tool, stage, (int)getpid(), eta);
+	fprintf(fp, "# EOF\n");
+	if (fclose(fp) != 0 || rename(tmpfile, p->metrics) != 0)
+		unlink(tmpfile);
+}
+
+/* report ---------------------- the counts on stderr and in the status file */
+static void report(struct progress *p, const char *state, int print)
+{
+	long done = __atomic_load_n(&p->done, __ATOMIC_RELAXED);
+	long items = __atomic_load_n(&p->items_done, __ATOMIC_RELAXED);
+	double elapsed = now() - p->start, rate, eta = -1;
+	char line[500], e1[40], e2[40], tmpfile[1100];
+	int n;
+	FILE *fp;
+
+	// the rate of the items, or of the units where there are none
+	rate = elapsed > 0 ? (p->items != NULL ? items : done) / elapsed : 0;
+	if (rate > 0 && p->items != NULL && p->items_total > 0)
+		eta = (p->items_total - items) / rate;
+	else if (done > 0 && p->total > 0)
+		eta = (p->total - done) * elapsed / done;
+
+	if (print) {
+		n = snprintf(line, sizeof(line), "- %s: %ld", p->tool, done);
+		if (p->total > 0)
+			n += snprintf(line + n, sizeof(line) - n, " of %ld", p->total);
+		n += snprintf(line + n, sizeof(line) - n, " %s", p->unit);
+		if (p->total > 0)
+			n += snprintf(line + n, sizeof(line) - n, " (%.1f%%)", 100.0 * done / p->total);
+		if (p->items != NULL)
+			n += snprintf(line + n, sizeof(line) - n, ", %ld %s (%.0f/s)", items, p->items, rate);
+		n += snprintf(line + n, sizeof(line) - n, ", %s elapsed", hms(elapsed, e1));
+		if (eta >= 0 && strcmp(state, "done") != 0)
+			snprintf(line + n, sizeof(line) - n, ", %s left", hms(eta, e2));
+		fprintf(stderr, "%s\n", line);
+		p->printed = 1;
+	}
+
+	if (p->metrics != NULL && strcmp(state, "done") != 0)
+		write_metrics(p, done, items, elapsed, eta);
+	if (p->status == NULL)
+		return;
+	snprintf(tmpfile, sizeof(tmpfile), "%s.%d", p->status, (int)getpid());
+	if ((fp = fopen(tmpfile, "w")) == NULL)
+		return;
+	fprintf(fp, "{\"tool\":\"%s\",\"state\":\"%s\",\"unit\":\"%s\",\"done\":%ld,\"total\":%ld",
+		p->tool, state, p->unit, done, p->total);
+	if (p->items != NULL)
+		fprintf(fp, ",\"items\":\"%s\",\"items_done\":%ld,\"items_total\":%ld",
+			p->items, items, p->items_total);
+	fprintf(fp, ",\"rate\":%.1f,\"elapsed\":%.1f", rate, elapsed);
+	if (eta >= 0)
+		fprintf(fp, ",\"eta\":%.1f", strcmp(state, "done") == 0 ? 0.0 : eta);
+	fprintf(fp, ",\"pid\":%d}\n", (int)getpid());
+	if (fclose(fp) != 0 || rename(tmpfile, p->status) != 0)
+		unlink(tmpfile);
+}
+
+static void *reporter(void *arg)
+{
+	struct progress *p = arg;
+	struct timespec until;
+	long line = p->interval >= 1 ? (long)p->interval : p->interval > 0 ? 1 : 0;
+	long tick = line > 0 ? line : 60, t = 0, next = line;
+
+	// with no lines on stderr the status file is rewritten once a minute,
+	// the metrics at least every METRICS_INTERVAL seconds
+	if (p->metrics != NULL && tick > METRICS_INTERVAL)
+		tick = METRICS_INTERVAL;
+	pthread_mutex_lock(&p->lock);
+	clock_gettime(CLOCK_REALTIME, &until);
+	while (!p->stop) {
+		until.tv_sec += tick;
+		while (!p->stop && pthread_cond_timedwait(&p->cond, &p->lock, &until) == 0)
+			;
+		if (p->stop)
+			break;
+		t += tick;
+		if (line > 0 && t >= next) {
+			report(p, "running", 1);
+			next += line;
+		} else
+			report(p, "running", 0);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+struct progress *progress_start(const char *tool, const char *unit, long total,
+	const char *items, long items_total)
+{
+	const char *s = getenv("DESCHRAMBLER_PROGRESS"), *status = getenv("DESCHRAMBLER_STATUS");
+	const char *metrics = getenv("DESCHRAMBLER_METRICS");
+	double interval = (s != NULL && *s != '\0') ? atof(s) : 60;
+	static int seq = 0;
+	struct progress *p;
+	char file[1100];
+
+	if (status != NULL && *status == '\0')
+		status = NULL;
+	if (metrics != NULL && *metrics == '\0')
+		metrics = NULL;
+	if (interval <= 0 && status == NULL && metrics == NULL)
+		return NULL;
+	if ((p = calloc(1, sizeof(struct progress))) == NULL)
+		return NULL;
+	p->tool = tool;
+	p->unit = unit;
+	p->total = total;
+	p->items = items;
+	p->items_total = items_total;
+	p->status = status != NULL ? strdup(status) : NULL;
+	if (metrics != NULL) {
+		snprintf(file, sizeof(file), "%s/deschrambler.%d.%d.prom", metrics, (int)getpid(),
+			__atomic_add_fetch(&seq, 1, __ATOMIC_RELAXED));
+		p->metrics = strdup(file);
+	}
+	p->interval = interval;
+	p->start = now();
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	report(p, "running", 0);
+	if (pthread_create(&p->thread, NULL, reporter, p) != 0) {
+		if (p->metrics != NULL)
+			unlink(p->metrics);
+		free(p->metrics);
+		free(p->status);
+		free(p);
+		return NULL;
+	}
+	return p;
+}
+
+void progress_end(struct progress *p)
+{
+	if (p == NULL)
+		return;
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_signal(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	pthread_join(p->thread, NULL);
+	report(p, "done", p->printed);
+	// a stage done is no longer reported
+	if (p->metrics != NULL)
+		unlink(p->metrics);
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->cond);
+	free(p->metrics);
+	free(p->status);
+	free(p);
+}
@@ -0,0 +1,85 @@
+/* **************************************************************
+ * The progress of a long stage, for telling a slow job from a stuck
+ * one: the units done out of those to do (columns of inferAdjProb,
+ * shards of partitionGenomes, a shard being a chromosome or a piece
+ * of one), the items of work they stand for (candidates, segments)
+ * with their rate, and the time left at that rate. A thread of its
+ * own wakes every DESCHRAMBLER_PROGRESS seconds (60 unless set; 0
+ * for never) and prints a line on stderr, and rewrites the file
+ * DESCHRAMBLER_STATUS names, if it names one, with a line of JSON of
+ * the same for the driver or a monitor to poll:
+ *
+ *   {"tool":"inferAdjProb","state":"running","unit":"columns","done":120,
+ *    "total":5000,"items":"candidates","items_done":81200,"items_total":3377000,
+ *    "rate":5310.2,"elapsed":15.3,"eta":620.4,"pid":4242}
+ *
+ * and with "state":"done" when the stage ends. With DESCHRAMBLER_METRICS
+ * naming a directory, the same counts are kept in it as an OpenMetrics
+ * text file, deschrambler.<pid>.<n>.prom, for the textfile collector of
+ * node_exporter: deschrambler_progress_units_total and _items_total with
+ * their totals to do (_todo), the time taken and left, labelled with
+ * the tool, the stage (DESCHRAMBLER_STAGE, which DESCHRAMBLER.pl sets)
+ * and the pid. It is rewritten at least every METRICS_INTERVAL seconds,
+ * and removed when the stage ends. The workers only add
+ * to two counters (relaxed atomics), so nothing of it is on their
+ * paths; with none of the variables set no thread is started and
+ * progress_start() returns NULL, which progress_add() takes. Like
+ * workpool.h it uses none of the rest of makeBlocks, for code/.
+ * **************************************************************/
+
+#ifndef _PROGRESS_H_
+#define _PROGRESS_H_
+
+#include <pthread.h>
+
+#define METRICS_INTERVAL 15
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct progress {
+	const char *tool, *unit, *items;
+	long total, items_total;
+	long done, items_done;		// added to by the workers
+	double start, interval;
+	char *status;				// the status file, NULL for none
+	char *metrics;				// the metrics file, NULL for none
+	int stop, printed;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/* **************************************************************
+ * Starts reporting on total units of unit (0 for not known) standing
+ * for items_total items of items (0 for not known; with no items,
+ * items is NULL). The time left is of the items where their total is
+ * known, of the units otherwise.
+ * Returns NULL when there is nothing to report to.
+ * **************************************************************/
+struct progress *progress_start(const char *tool, const char *unit, long total,
+	const char *items, long items_total);
+
+// units and items done, from any thread
+static inline void progress_add(struct progress *p, long done, long items)
+{
+	if (p == NULL)
+		return;
+	if (done != 0)
+		__atomic_fetch_add(&p->done, done, __ATOMIC_RELAXED);
+	if (items != 0)
+		__atomic_fetch_add(&p->items_done, items, __ATOMIC_RELAXED);
+}
+
+/* **************************************************************
+ * Stops the reporting and frees p: the status file is left with the
+ * last counts as done, and stderr has a last line if it had any.
+ * **************************************************************/
+void progress_end(struct progress *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
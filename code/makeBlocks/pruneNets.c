@@ -0,0 +1,157 @@
+/* *****************************************************************
+ * Writes the nets of the config file with only what readNets can use
+ * at its MINLEN (the fills and gaps longer than it, and the ones they
+ * are nested in), one all.net per species pair:
+ *
+ *     <outdir>/<reference>/<species>/net/all.net
+ *
+ * readNets on these nets, for MINLEN or any larger one, writes the
+ * same raw.segs as on the nets themselves; DESCHRAMBLER.pl reads the
+ * nets once this way for the finest of its RESOLUTIONS.
+ * *****************************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "chromfile.h"
+#include "lines.h"
+#include <sys/stat.h>
+#include <errno.h>
+
+#define MAXDEP	30
+
+// a line not written yet, until something nested in it is
+struct pending {
+	int depth, written;
+	char *line;
+	size_t len, max;
+};
+
+static void make_dirs(char *path) {
+	char *p;
+
+	for (p = strchr(path + 1, '/'); ; p = strchr(p + 1, '/')) {
+		if (p != NULL)
+			*p = '\0';
+		if (mkdir(path, 0777) != 0 && errno != EEXIST)
+			fatalf("cannot create %s", path);
+		if (p == NULL)
+			break;
+		*p = '/';
+	}
+}
+
+static int get_depth(const struct net_line *n) {
+	if (n->depth > MAXDEP)
+		fatalf("MAXDEP = %d not enough", MAXDEP);
+	return n->depth;
+}
+
+// whether readNets prints the fill or gap line
+static int long_enough(const struct net_line *n) {
+	if (n->type == 'g')
+		return n->slen > Spe->minlen;
+	return n->flen > Spe->minlen || n->slen > Spe->minlen;
+}
+
+/* the net of one chromosome; returns 0 if it has no net line, after
+ * which readNets reads nothing more of the species */
+static int prune_net(FILE *nf, const char *netfile, FILE *of, const char *chr) {
+	static struct pending stack[MAXDEP + 2];
+	struct line_reader *lr = open_lines(nf, netfile);
+	struct net_line net;
+	const char *line;
+	size_t len;
+	int n = 0, depth, k;
+
+	while ((line = next_line(lr, &len)) != NULL) {
+		if (len == 0 || line[0] != '#')
+			break;
+	}
+	if (line == NULL) {
+		fprintf(of, "net %s 0\n", chr);
+		close_lines(lr);
+		return 0;
+	}
+	fwrite(line, 1, len, of);
+	putc('\n', of);
+	if (parse_net_line(line, len, &net) && net.type == 'n' && short_chrom(net.flen)) {
+		close_lines(lr);
+		return 1;
+	}
+
+	while ((line = next_line(lr, &len)) != NULL) {
+		if (!parse_net_line(line, len, &net))
+			fatalf("cannot parse: %.*s", (int)len, line);
+		if (net.type != 'g' && net.type != 'f')
+			continue;
+		depth = get_depth(&net);
+		while (n > 0 && stack[n-1].depth >= depth)
+			--n;
+		stack[n].depth = depth;
+		stack[n].written = 0;
+		if (len > stack[n].max) {
+			stack[n].max = 2 * len;
+			stack[n].line = ckrealloc(stack[n].line, stack[n].max);
+		}
+		memcpy(stack[n].line, line, len);
+		stack[n].len = len;
+		++n;
+		if (!long_enough(&net))
+			continue;
+		for (k = 0; k < n; k++)
+			if (!stack[k].written) {
+				fwrite(stack[k].line, 1, stack[k].len, of);
+				putc('\n', of);
+				stack[k].written = 1;
+			}
+	}
+	close_lines(lr);
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	FILE *nf, *of;
+	char netdir[500], outfile[500], netfile[500];
+	const char **chrname;
+	int rs, ss, ci, chrcnt, stopped;
+
+	if (argc != 3)
+		fatal("args: config.file output-dir");
+
+	get_spename(argv[1]);
+	get_netdir(argv[1]);
+	get_minlen(argv[1]);
+	get_subset(argv[1]);
+	rs = ref_spe_idx();
+
+	// the reference chromosomes, as readNets lists them
+	pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[1], "net");
+	if ((chrcnt = dir_chroms(netdir, ".net", &chrname)) < 0)
+		fatalf("cannot open net dir %s", netdir);
+	chrcnt = subset_chroms(chrname, chrcnt);
+
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (ss == rs)
+			continue;
+		// with room left for the file name
+		pair_dir(outfile, sizeof(outfile) - strlen("/all.net"), argv[2], Spe->spename[0], Spe->spename[ss],
+			"net");
+		make_dirs(outfile);
+		strcat(outfile, "/all.net");
+		of = ckopen(outfile, "w");
+		pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[ss], "net");
+		// every chromosome gets a net line, so that the list stays the same
+		for (stopped = ci = 0; ci < chrcnt; ci++) {
+			if (stopped || (nf = open_chrom(netdir, chrname[ci], ".net", netfile)) == NULL) {
+				fprintf(of, "net %s 0\n", chrname[ci]);
+				continue;
+			}
+			fprintf(stderr, "- pruning %s\n", netfile);
+			stopped = !prune_net(nf, netfile, of, chrname[ci]);
+			ckclose_in(nf);
+		}
+		fclose(of);
+	}
+	free(chrname);
+	return 0;
+}
@@ -2,159 +2,464 @@
  * Nets files can be downloaded directly from UCSC Genome Browser:
  * 		http://hgdownload.cse.ucsc.edu/downloads.html
  * This program retains large pieces longer than a certain 
- * length for further analysis.
+ * length for further analysis. With -fused the pieces go on to be
+ * broken as getSegments breaks them (segprocess.h) as they are read,
+ * and processed.segs is written instead of raw.segs. A config file
+ * with a >maf has the segments made from that multiple alignment
+ * instead (mafsegs.h), and no nets are read.
  * *****************************************************************/
 
 #include "util.h"
 #include "species.h"
-#include <dirent.h>
+#include "chromfile.h"
+#include "lines.h"
+#include "stages.h"
+#include "segcache.h"
+#include "segstream.h"
+#include "segprocess.h"
+#include "mafsegs.h"
+#include "chrtab.h"
+#include "workpool.h"
 #include <string.h>
-#include <libgen.h>
+#include <pthread.h>
 
 #define MAXDEP	30
 #define SUFFIX	"raw.segs"
+#define SUFFIX2	"processed.segs"
+// a mapped net file larger than this is parsed in pieces of about this size
+#define NET_PIECE	(16 << 20)
 
-int get_level(char *s) {
-	int i = 0;
-	while (s[i] == ' ')
-		++i;
-	if (i > MAXDEP)
+int Fused_segs = 0;
+
+static int get_level(const struct net_line *n) {
+	if (n->depth > MAXDEP)
 		fatalf("MAXDEP = %d not enough", MAXDEP);
-	return i;
+	return n->depth;
 }
 
-int main (int argc, char* argv[]) {
-	FILE *nf, *of;
-	char buf[500], type[20], chrom[50], refchrom[50], netfile[500], outfile[500], netdir[500];
-	char gapchrom[MAXDEP][50], gaporient[MAXDEP];
-	int level, fbeg, flen, sbeg, slen, cid, i, j, rs, ss;
+// one (species, reference chromosome) net file; its raw.segs are kept
+// in memory so that files can be parsed in any order and written out
+// in the original one
+struct net_task {
+	int ss, ci;
+	struct seg_line *segs;
+	int nseg, maxseg;
+	int stop;	// the file had no net line: nothing after it is read
+	int done;
+};
+
+static const char **Chrname;
+static struct net_task *Tasks;
+static int Ntasks, Next = 0, Written = 0, Window, Threads;
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Cond = PTHREAD_COND_INITIALIZER;
+
+static void add_seg(struct net_task *t, const struct seg_line *s) {
+	if (t->nseg == t->maxseg) {
+		t->maxseg = t->maxseg ? 2 * t->maxseg : 256;
+		t->segs = ckrealloc(t->segs, t->maxseg * sizeof(struct seg_line));
+	}
+	t->segs[t->nseg++] = *s;
+}
+
+static void add_cached_seg(const struct seg_line *s, void *arg) {
+	add_seg(arg, s);
+}
+
+static void parse_net(struct net_task *t);
+
+/* the segments of a chromosome, from the cache when its nets are the
+ * same as when they were cached (segcache.h) */
+static void read_net(struct net_task *t) {
+	char key[SEG_KEYLEN + 1];
+	bool keyed = seg_chrom_key(t->ss, Chrname[t->ci], key);
+
+	if (keyed && seg_chrom_load(t->ss, key, add_cached_seg, t)) {
+		fprintf(stderr, "- %s of %s unchanged, from the cache\n", Chrname[t->ci], Spe->spename[t->ss]);
+		return;
+	}
+	parse_net(t);
+	if (keyed && !t->stop)
+		seg_chrom_save(t->ss, key, t->segs, t->nseg);
+}
+
+/* parse_fills ------------------- the segments of the gap and fill lines */
+static void parse_fills(struct net_task *t, struct line_reader *lr, const char *fchr) {
+	char chrom[256], qchrom[256];
+	char gaporient[MAXDEP];
+	const char *gapchrom[MAXDEP], *qchr = NULL;
+	int level, i, j;
 	int fgapbeg[MAXDEP], fgapend[MAXDEP], sgapbeg[MAXDEP], sgapend[MAXDEP];
 	int val[MAXDEP];
-	char orient;
-
-	DIR *dir;
-    struct dirent *ent;
-    char chrname[MAXCHR][100];
-    char* token;
-    char* fname;
-    int chrcnt = 0;
-    int ci;
+	struct net_line n;
+	struct seg_line s;
+	const char *line;
+	size_t len;
+
+	memset(&s, 0, sizeof(s));
+	for (i = 0; i < MAXDEP; i++)
+		val[i] = 0;
+	s.fchr = fchr;
+	qchrom[0] = '\0';
+	
+	while ((line = next_line(lr, &len)) != NULL) {
+		if (!parse_net_line(line, len, &n))
+			fatalf("cannot parse: %.*s", (int)len, line);
+		if (n.type == 'g') {
+			level = get_level(&n);
+			level /= 2;
+			--level;
+			if (!field_copy(&n.chrom, chrom, sizeof(chrom)))
+				fatalf("cannot parse: %.*s", (int)len, line);
+			gapchrom[level] = intern_chr(chrom);
+			fgapbeg[level] = n.fbeg;
+			fgapend[level] = n.fbeg + n.flen;
+			gaporient[level] = n.orient;
+			sgapbeg[level] = n.sbeg;
+			sgapend[level] = n.sbeg + n.slen;
+			if (sgapend[level] - sgapbeg[level] > Spe->minlen) {
+				s.type = 'g';
+				s.level = level;
+				s.fbeg = fgapbeg[level];
+				s.fend = fgapend[level];
+				s.schr = gapchrom[level];
+				s.sbeg = sgapbeg[level];
+				s.send = sgapend[level];
+				s.orient = gaporient[level];
+				s.gchr = NULL;
+				add_seg(t, &s);
+			}
+		}	 
+		else if (n.type == 'f') {
+			level = get_level(&n);
+			level /= 2;
+			for (i = level; i < MAXDEP; i++)
+				val[i] = 0;
+			if (n.flen > Spe->minlen || n.slen > Spe->minlen) {
+				val[level] = 1;
+				// the fills of a net mostly stay on the chromosome of the last one
+				if (qchr == NULL || (size_t)n.chrom.len >= sizeof(qchrom)
+						|| strncmp(qchrom, n.chrom.s, n.chrom.len) != 0 || qchrom[n.chrom.len] != '\0') {
+					if (!field_copy(&n.chrom, qchrom, sizeof(qchrom)))
+						fatalf("cannot parse: %.*s", (int)len, line);
+					qchr = intern_chr(qchrom);
+				}
+				s.schr = qchr;
+				s.type = 's';
+				s.level = level;
+				s.fbeg = n.fbeg;
+				s.fend = n.fbeg + n.flen;
+				s.sbeg = n.sbeg;
+				s.send = n.sbeg + n.slen;
+				s.orient = n.orient;
+				s.cid = n.cid;
+				s.gchr = NULL;
+				// a fill below level 0 fills the gap of the nearest fill above it
+				for (j = level-1; j >= 0; j--)
+					if (val[j] == 1)
+						break;
+				if (j >= 0) {
+					s.gfbeg = fgapbeg[j];
+					s.gfend = fgapend[j];
+					s.gchr = gapchrom[j];
+					s.gsbeg = sgapbeg[j];
+					s.gsend = sgapend[j];
+					s.gorient = gaporient[j];
+				}
+				add_seg(t, &s);
+			}
+		}
+	}
+}
+
+// the pieces of a net file parsed on the threads, each into its own task
+struct piece_jobs {
+	struct net_task *t;
+	const char *text, *fchr, *name;
+	size_t *cut;
+};
+
+static void piece_job(int k, void *arg) {
+	struct piece_jobs *pj = arg;
+	struct line_reader *lr = open_text_lines(pj->text + pj->cut[k], pj->cut[k+1] - pj->cut[k], pj->name);
+
+	parse_fills(&pj->t[k], lr, pj->fchr);
+	close_lines(lr);
+}
+
+static void parse_net(struct net_task *t) {
+	FILE *nf;
+	char refchrom[50], netdir[500], netfile[500];
+	int i, k, np, ss = t->ss;
+	struct line_reader *lr, *piece;
+	struct net_task *pieces;
+	struct piece_jobs pj;
+	struct net_line n;
+	const char *line, *text, *fchr;
+	size_t len, *cut = NULL;
+
+	sprintf(refchrom, "%s", Chrname[t->ci]);
+
+	pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[ss], "net");
+	if ((nf = open_chrom(netdir, refchrom, ".net", netfile)) == NULL) {
+		fprintf(stderr, "- skip %s (file not exists)\n", netfile);
+		return;
+	}
 	
-	if (argc != 2)
-		fatal("arg = configure-file");
+	fprintf(stderr, "- reading %s\n", netfile);
 
-	get_spename(argv[1]);
-	get_netdir(argv[1]);
-	get_minlen(argv[1]);
-	rs = ref_spe_idx();
-printf("MINLEN=%d\n", MINLEN); 
-
-	// get list of reference chromosomes
-    sprintf(netdir, "%s/%s/%s/net", Netdir, Spename[0], Spename[1]);
-    if ((dir = opendir (netdir)) != NULL) {
-        while ((ent = readdir(dir)) != NULL) {
-            fname = basename(ent->d_name);
-            token = strtok(fname, ".");
-            if (token == NULL) continue;
-            strcpy(chrname[chrcnt], token);
-            chrcnt++;
-        }
-        closedir(dir);
-    } else {
+	lr = open_lines(nf, netfile);
+	while ((line = next_line(lr, &len)) != NULL) {
+		if (len == 0 || line[0] != '#')
+			break;
+	}
+	if (line == NULL) {
+		t->stop = 1;
+		close_lines(lr);
+		ckclose_in(nf);
+		return;
+	}
+
+	if (!parse_net_line(line, len, &n) || n.type != 'n' || n.depth != 0
+		|| !field_copy(&n.chrom, refchrom, sizeof(refchrom)))
+		fatalf("cannot parse: %.*s", (int)len, line);
+	// a scaffold shorter than the resolution makes no block that is kept
+	if (short_chrom(n.flen)) {
+		close_lines(lr);
+		ckclose_in(nf);
+		return;
+	}
+	fchr = intern_chr(refchrom);
+	// a large file that is mapped is parsed a piece at a time on the
+	// threads, cut at the top-level fills, which depend on nothing before
+	if ((text = take_mapped_lines(lr, &len)) != NULL
+		&& (np = cut_lines(text, len, " fill", NET_PIECE, &cut)) > 1) {
+		fprintf(stderr, "- %s in %d pieces\n", netfile, np);
+		pieces = ckallocz(np * sizeof(struct net_task));
+		pj.t = pieces;
+		pj.text = text;
+		pj.cut = cut;
+		pj.fchr = fchr;
+		pj.name = netfile;
+		run_jobs(np, MIN(np, Threads), piece_job, &pj);
+		for (k = 0; k < np; k++) {
+			for (i = 0; i < pieces[k].nseg; i++)
+				add_seg(t, &pieces[k].segs[i]);
+			free(pieces[k].segs);
+		}
+		free(pieces);
+	} else if (text != NULL) {
+		piece = open_text_lines(text, len, netfile);
+		parse_fills(t, piece, fchr);
+		close_lines(piece);
+	} else
+		parse_fills(t, lr, fchr);
+	free(cut);
+	close_lines(lr);
+	ckclose_in(nf);
+}
+
+// takes tasks in order, staying at most Window tasks ahead of the writer
+static void *net_worker(void *arg) {
+	struct net_task *t;
+	(void)arg;
+	for (;;) {
+		pthread_mutex_lock(&Lock);
+		while (Next < Ntasks && Next >= Written + Window)
+			pthread_cond_wait(&Cond, &Lock);
+		if (Next >= Ntasks) {
+			pthread_mutex_unlock(&Lock);
+			return NULL;
+		}
+		t = &Tasks[Next++];
+		pthread_mutex_unlock(&Lock);
+
+		read_net(t);
+
+		pthread_mutex_lock(&Lock);
+		t->done = 1;
+		pthread_cond_broadcast(&Cond);
+		pthread_mutex_unlock(&Lock);
+	}
+}
+
+int read_nets(FILE **raw, int nthreads) {
+	return read_nets_each(raw, nthreads, NULL, NULL);
+}
+
+int read_nets_each(FILE **raw, int nthreads, void (*done)(int ss, void *arg), void *arg) {
+	FILE *of = NULL;
+	char outfile[500], netdir[500];
+	int rs = ref_spe_idx(), ss, i, k, stopped = 0;
+	enum seg_kind out = Fused_segs ? SEGS_PROCESSED : SEGS_RAW;
+	const char *kind = seg_cache_kind(out, Binary_segs);
+	bool *cached;
+	struct seg_entry e;
+	struct seg_writer *w, *ew;
+	struct seg_processor *sp;
+	struct file_batch *batch;
+	const char **dirs, **chroms;
+	char **netdirs;
+	pthread_t *threads;
+
+    int chrcnt;
+    int ci;
+
+	if (Spe->maf[0] != '\0')
+		return read_maf_each(raw, Fused_segs, done, arg);
+
+	// get list of reference chromosomes, from all.net if there is one
+    pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[1], "net");
+    if ((chrcnt = dir_chroms(netdir, ".net", &Chrname)) < 0) {
         fprintf(stderr, "Error - Could not open net dir %s\n", netdir);
-        return 0;
+        return -1;
     }
+    chrcnt = subset_chroms(Chrname, chrcnt);
 
-	// generate raw.segs files for each species
-	for (ss = 0; ss < Spesz; ss++) {
-		if (rs == ss)
+	// one task per (species, chromosome), parsed on a pool of threads,
+	// but for the species whose segments are in the cache
+	cached = ckallocz(Spe->spesz * sizeof(bool));
+	Tasks = ckallocz((Spe->spesz * chrcnt + 1) * sizeof(struct net_task));
+	Ntasks = Next = Written = 0;
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (rs == ss || !only_species(ss) || (cached[ss] = seg_cache_size(ss, kind) >= 0))
 			continue;
-		sprintf(outfile, "%s.%s", Spename[ss], SUFFIX);
-		of = ckopen(outfile, "w");
-	
 		for (ci = 0; ci < chrcnt; ci++) {
+			Tasks[Ntasks].ss = ss;
+			Tasks[Ntasks].ci = ci;
+			Ntasks++;
+		}
+	}
+	// their net files read ahead in the order of the tasks
+	netdirs = ckallocz(Spe->spesz * sizeof(char *));
+	dirs = ckalloc((Ntasks + 1) * sizeof(char *));
+	chroms = ckalloc((Ntasks + 1) * sizeof(char *));
+	for (i = 0; i < Ntasks; i++) {
+		ss = Tasks[i].ss;
+		if (netdirs[ss] == NULL) {
+			pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[ss], "net");
+			netdirs[ss] = copy_string(netdir);
+		}
+		dirs[i] = netdirs[ss];
+		chroms[i] = Chrname[Tasks[i].ci];
+	}
+	batch = batch_chroms(dirs, chroms, Ntasks, ".net", nthreads);
+	Window = 4 * nthreads;
+	Threads = nthreads;
+	threads = ckalloc(nthreads * sizeof(pthread_t));
+	for (k = 0; k < nthreads; k++)
+		if (pthread_create(&threads[k], NULL, net_worker, NULL) != 0)
+			fatal("cannot create thread");
 
-			sprintf(refchrom, "%s", chrname[ci]);
-
-			sprintf(netfile, "%s/%s/%s/net/%s.net", 
-								Netdir, Spename[0], Spename[ss], refchrom);
-			
-			if (access(netfile, F_OK) == -1) {
-                		fprintf(stderr, "- skip %s (file not exists)\n", netfile);
-                		continue;
-           		}
-			
-			fprintf(stderr, "- reading %s\n", netfile);
-			nf = ckopen(netfile, "r");
-
-			for (i = 0; i < MAXDEP; i++)
-				val[i] = 0;
-		
-			while (fgets(buf, 500, nf) != NULL) {
-				if (buf[0] != '#')
-					break;
-			}
-			if (feof(nf)) break;
-
-			if (sscanf(buf, "net %s %*d", refchrom) != 1)
-				fatalf("cannot parse: %s", buf);
-			
-			while (fgets(buf, 500, nf)) {
-				if (sscanf(buf, "%s %*s", type) != 1)
-					fatalf("cannot parse: %s", buf);
-				if (same_string(type, "gap")) {
-					level = get_level(buf);
-					level /= 2;
-					--level;
-					if (sscanf(buf, "%*s %d %d %s %c %d %d %*s",
-						   &(fgapbeg[level]), &(fgapend[level]), 
-						   gapchrom[level], &(gaporient[level]),
-						   &(sgapbeg[level]), &(sgapend[level])) != 6)
-						fatalf("cannot parse: %s", buf);
-					fgapend[level] += fgapbeg[level];
-					sgapend[level] += sgapbeg[level];
-					if (sgapend[level] - sgapbeg[level] > MINLEN) {
-						fprintf(of, "%d g %s.%s:%d-%d %s.%s:%d-%d %c\n",
-								level, Spename[rs], refchrom,
-								fgapbeg[level], fgapend[level],
-								Spename[ss], gapchrom[level],
-								sgapbeg[level], sgapend[level],
-								gaporient[level]);
-					}
-				}	 
-				else if (same_string(type, "fill")) {
-					level = get_level(buf);
-					level /= 2;
-					for (i = level; i < MAXDEP; i++)
-						val[i] = 0;
-					if (sscanf(buf, "%*s %d %d %s %c %d %d id %d %*s",
-							   &fbeg, &flen, chrom, &orient, &sbeg, &slen, &cid) != 7)
-						fatalf("cannot parse: %s", buf);
-					if (flen > MINLEN || slen > MINLEN) {
-						val[level] = 1;
-						fprintf(of, "%d s %s.%s:%d-%d %s.%s:%d-%d %c %d",
-								level, Spename[rs], refchrom, fbeg, fbeg + flen,
-								Spename[ss], chrom, sbeg, sbeg + slen, orient, cid);
-						if (level == 0)
-							fprintf(of, "\n");
-						else {
-							for (j = level-1; j >= 0; j--)
-								if (val[j] == 1)
-									break;
-							if (j < 0)
-								fprintf(of, " [NP]\n");
-							else
-								fprintf(of, " [%d %d %s %d %d %c]\n",
-											fgapbeg[j], fgapend[j], gapchrom[j],
-											sgapbeg[j], sgapend[j], gaporient[j]);
-						}
-					}
+	// generate raw.segs files for each species, in the original order
+	for (ss = 0; ss < Spe->spesz; ss++) {
+		if (rs == ss || !only_species(ss))
+			continue;
+		sprintf(outfile, "%s.%s", Spe->spename[ss], Fused_segs ? SUFFIX2 : SUFFIX);
+		of = (raw[ss] != NULL) ? raw[ss] : ckopen_out(outfile);
+		if (cached[ss]) {
+			if (!seg_cache_copy(ss, kind, of))
+				fatalf("cannot read the cached %s", outfile);
+			if (of != raw[ss])
+				ckclose_out(of);
+			if (done != NULL)
+				done(ss, arg);
+			continue;
+		}
+		seg_cache_begin(ss, kind, &e);
+		w = open_seg_writer(of, out, rs, ss, Binary_segs);
+		ew = (e.fp != NULL) ? open_seg_writer(e.fp, out, rs, ss, Binary_segs) : NULL;
+		sp = Fused_segs ? open_seg_processor(w, ew) : NULL;
+		stopped = 0;
+		for (ci = 0; ci < chrcnt; ci++) {
+			struct net_task *t = &Tasks[Written];
+			pthread_mutex_lock(&Lock);
+			while (!t->done)
+				pthread_cond_wait(&Cond, &Lock);
+			pthread_mutex_unlock(&Lock);
+			if (t->stop)
+				stopped = 1;
+			for (i = 0; i < t->nseg && !stopped; i++) {
+				if (sp != NULL)
+					process_seg_line(sp, &t->segs[i]);
+				else {
+					write_seg_line(w, &t->segs[i]);
+					if (ew != NULL)
+						write_seg_line(ew, &t->segs[i]);
 				}
 			}
-			fclose(nf);
+			free(t->segs);
+			t->segs = NULL;
+			pthread_mutex_lock(&Lock);
+			Written++;
+			pthread_cond_broadcast(&Cond);
+			pthread_mutex_unlock(&Lock);
 		}
-		fclose(of);
+		if (sp != NULL)
+			close_seg_processor(sp);
+		close_seg_writer(w);
+		if (ew != NULL)
+			close_seg_writer(ew);
+		if (ferror(of))
+			fatalf("cannot write %s", outfile);
+		seg_cache_end(&e, 1);
+		if (of != raw[ss])
+			ckclose_out(of);
+		if (done != NULL)
+			done(ss, arg);
 	}	
+	for (k = 0; k < nthreads; k++)
+		pthread_join(threads[k], NULL);
+	close_file_batch(batch);
+	for (ss = 0; ss < Spe->spesz; ss++)
+		free(netdirs[ss]);
+	free(netdirs);
+	free(dirs);
+	free(chroms);
+	free(threads);
+	free(Tasks);
+	free(cached);
+	free(Chrname);
 	return 0;
 }
 
+#ifndef NO_MAIN
+int main (int argc, char* argv[]) {
+	FILE **raw;
+	char *only = NULL;
+	int nthreads;
+
+	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+		if (same_string(argv[1], "-text"))
+			Binary_segs = 0;
+		else if (same_string(argv[1], "-fused"))
+			Fused_segs = 1;
+		else if (same_string(argv[1], "-species") && argc > 2) {
+			only = argv[2];
+			argc--;
+			argv++;
+		}
+		else
+			break;
+	}
+	if (argc != 2 && argc != 3)
+		fatal("arg = [-text] [-fused] [-species spc,...] configure-file [threads]");
+	nthreads = thread_arg(argc == 3 ? argv[2] : NULL);
+
+	get_spename(argv[1]);
+	if (only != NULL)
+		set_only_species(only);
+	get_netdir(argv[1]);
+	// the chains of a multiple alignment are written for the later steps
+	if (Spe->maf[0] != '\0')
+		get_chaindir(argv[1]);
+	get_minlen(argv[1]);
+	get_subset(argv[1]);
+printf("MINLEN=%d\n", Spe->minlen); 
+
+	raw = ckallocz(Spe->spesz * sizeof(FILE *));
+	read_nets(raw, nthreads);
+	free(raw);
+	return 0;
+}
+#endif
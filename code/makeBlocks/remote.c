@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include "remote.h"
+
+#define BLOCK		(1 << 20)
+#define READ_AHEAD	16		// missing blocks fetched by one request, at most
+
+/* what the server said of a URL, asked once per run */
+struct url_info {
+	char *url;
+	char *http;				// the URL curl is given
+	bool exists;
+	off_t size;
+	time_t mtime;
+	char blockdir[1000];	// the blocks of this version of the file
+	struct url_info *next;
+};
+static struct url_info *Urls = NULL;
+static pthread_mutex_t UrlLock = PTHREAD_MUTEX_INITIALIZER;
+
+struct url_stream {
+	struct url_info *u;
+	off_t pos;
+	off_t blk;				// the block in buf, or -1
+	size_t len;
+	char *buf;
+};
+
+bool is_url(const char *name)
+{
+	const char *p = name;
+
+	while (isalnum((unsigned char)*p) || *p == '+' || *p == '-' || *p == '.')
+		p++;
+	return p > name && starts(p, "://");
+}
+
+static uint64_t hash_string(const char *s)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	for (; *s; s++)
+		h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+	return h;
+}
+
+/* make_dirs -------------------------------- create a directory and its parents */
+static void make_dirs(const char *dir)
+{
+	char path[1000], *p;
+
+	snprintf(path, sizeof(path), "%s", dir);
+	for (p = path + 1; *p; p++)
+		if (*p == '/') {
+			*p = '\0';
+			mkdir(path, 0777);
+			*p = '/';
+		}
+	if (mkdir(path, 0777) != 0 && errno != EEXIST)
+		fatalf("Cannot create %s: %s", path, strerror(errno));
+}
+
+/* cache_dir ------------------ the directory in the cache of a URL's files */
+static void cache_dir(const char *url, char *dir, size_t size)
+{
+	char *env = getenv("DESCHRAMBLER_CACHE"), *home = getenv("HOME");
+	const char *base = strrchr(url, '/');
+
+	base = (base && base[1]) ? base + 1 : "dir";
+	if (env && *env)
+		snprintf(dir, size, "%s/%016llx-%.80s", env, (unsigned long long)hash_string(url), base);
+	else if (home && *home)
+		snprintf(dir, size, "%s/.cache/deschrambler/%016llx-%.80s", home,
+			(unsigned long long)hash_string(url), base);
+	else
+		snprintf(dir, size, "/tmp/deschrambler-cache/%016llx-%.80s",
+			(unsigned long long)hash_string(url), base);
+}
+
+void url_cache_file(const char *url, const char *name, char *path, size_t size)
+{
+	char dir[1000];
+
+	cache_dir(url, dir, sizeof(dir));
+	make_dirs(dir);
+	snprintf(path, size, "%s/%s", dir, name);
+}
+
+/* http_url ------------------------ the http(s) URL of an object-store URL */
+static char *http_url(const char *url)
+{
+	char buf[2000], *ep = getenv("S3_ENDPOINT");
+
+	if (starts(url, "s3://"))
+		snprintf(buf, sizeof(buf), "%s/%s", (ep && *ep) ? ep : "https://s3.amazonaws.com", url + 5);
+	else if (starts(url, "gs://"))
+		snprintf(buf, sizeof(buf), "https://storage.googleapis.com/%s", url + 5);
+	else
+		snprintf(buf, sizeof(buf), "%s", url);
+	return copy_string(buf);
+}
+
+/* run_curl --------------- run curl on a URL with its output to fd; 0 if it fails */
+static bool run_curl(const char *args[], const char *url, int fd)
+{
+	char cmd[500], *argv[40], *env = getenv("CURL"), *t, *save;
+	int n = 0, status;
+	pid_t pid;
+
+	snprintf(cmd, sizeof(cmd), "%s", (env && *env) ? env : "curl");
+	for (t = strtok_r(cmd, " \t", &save); t && n < 30; t = strtok_r(NULL, " \t", &save))
+		argv[n++] = t;
+	argv[n++] = "-sfL";
+	while (*args && n < 38)
+		argv[n++] = (char *)*args++;
+	argv[n++] = (char *)url;
+	argv[n] = NULL;
+
+	if ((pid = fork()) < 0)
+		fatalf("Cannot run %s: %s", argv[0], strerror(errno));
+	if (pid == 0) {
+		dup2(fd, STDOUT_FILENO);
+		execvp(argv[0], argv);
+		fprintf(stderr, "Cannot run %s: %s\n", argv[0], strerror(errno));
+		_exit(127);
+	}
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status))
+		return 0;
+	if (WEXITSTATUS(status) == 127)
+		fatalf("Cannot run %s.", argv[0]);
+	return WEXITSTATUS(status) == 0;
+}
+
+/* ask_server ----------------- size, date and ETag of a URL from a HEAD request */
+static void ask_server(struct url_info *u)
+{
+	const char *args[] = {"-I", NULL};
+	char line[2000], etag[500] = "", version[1100];
+	struct tm tm;
+	FILE *fp;
+
+	u->exists = 0;
+	u->size = -1;
+	u->mtime = 0;
+	if ((fp = tmpfile()) == NULL)
+		fatalf("Cannot ask for %s: %s", u->url, strerror(errno));
+	if (!run_curl(args, u->http, fileno(fp))) {
+		fclose(fp);
+		return;
+	}
+	rewind(fp);
+	// after a redirect the last response is the file's
+	while (fgets(line, sizeof(line), fp)) {
+		if (starts(line, "HTTP/")) {
+			u->size = -1;
+			u->mtime = 0;
+			etag[0] = '\0';
+		} else if (strncasecmp(line, "content-length:", 15) == 0)
+			u->size = atoll(line + 15);
+		else if (strncasecmp(line, "etag:", 5) == 0)
+			sscanf(line + 5, " %499[^\r\n]", etag);
+		else if (strncasecmp(line, "last-modified:", 14) == 0) {
+			memset(&tm, 0, sizeof(tm));
+			if (strptime(line + 14, " %a, %d %b %Y %H:%M:%S", &tm) != NULL)
+				u->mtime = timegm(&tm);
+		}
+	}
+	fclose(fp);
+	if (u->size < 0)
+		fatalf("%s: the server does not give its size", u->url);
+	u->exists = 1;
+
+	snprintf(version, sizeof(version), "%lld %lld %s", (long long)u->size, (long long)u->mtime, etag);
+	snprintf(line, sizeof(line), "blocks.%016llx", (unsigned long long)hash_string(version));
+	url_cache_file(u->url, line, u->blockdir, sizeof(u->blockdir));
+	make_dirs(u->blockdir);
+}
+
+static struct url_info *get_info(const char *url)
+{
+	struct url_info *u;
+
+	pthread_mutex_lock(&UrlLock);
+	for (u = Urls; u != NULL; u = u->next)
+		if (same_string(u->url, url))
+			break;
+	if (u == NULL) {
+		u = ckallocz(sizeof(struct url_info));
+		u->url = copy_string(url);
+		u->http = http_url(url);
+		ask_server(u);
+		u->next = Urls;
+		Urls = u;
+	}
+	pthread_mutex_unlock(&UrlLock);
+	return u;
+}
+
+bool url_stat(const char *url, off_t *size, time_t *mtime)
+{
+	struct url_info *u = get_info(url);
+
+	if (size)
+		*size = u->size;
+	if (mtime)
+		*mtime = u->mtime;
+	return u->exists;
+}
+
+static size_t block_len(struct url_info *u, off_t b)
+{
+	return MIN((off_t)BLOCK, u->size - b * BLOCK);
+}
+
+/* read_block ------------------------- a block from the cache; 0 if it is not */
+static bool read_block(struct url_info *u, off_t b, char *buf)
+{
+	char path[1100];
+	size_t len = block_len(u, b);
+	FILE *fp;
+	bool ok;
+
+	snprintf(path, sizeof(path), "%s/%lld", u->blockdir, (long long)b);
+	if ((fp = fopen(path, "r")) == NULL)
+		return 0;
+	ok = fread(buf, 1, len, fp) == len && getc(fp) == EOF;
+	fclose(fp);
+	return ok;
+}
+
+/* fetch_blocks -------- get block b and the missing ones after it into the cache */
+static void fetch_blocks(struct url_info *u, off_t b)
+{
+	char path[1100], tmp[1200], range[100];
+	const char *args[] = {"-r", range, NULL};
+	off_t k, n, lo, hi;
+	char *buf;
+	struct stat st;
+	FILE *fp, *out;
+
+	for (n = 1; n < READ_AHEAD && (b + n) * BLOCK < u->size; n++) {
+		snprintf(path, sizeof(path), "%s/%lld", u->blockdir, (long long)(b + n));
+		if (access(path, F_OK) == 0)
+			break;
+	}
+	lo = b * BLOCK;
+	hi = MIN((b + n) * BLOCK, u->size);
+	snprintf(range, sizeof(range), "%lld-%lld", (long long)lo, (long long)hi - 1);
+	if ((fp = tmpfile()) == NULL)
+		fatalf("Cannot read %s: %s", u->url, strerror(errno));
+	if (!run_curl(args, u->http, fileno(fp)))
+		fatalf("Cannot read %s (bytes %s).", u->url, range);
+	// a server that ignores the range sends the whole file
+	if (fstat(fileno(fp), &st) != 0 || st.st_size != hi - lo)
+		fatalf("Cannot read %s: the server does not take range requests", u->url);
+	rewind(fp);
+
+	buf = ckalloc(BLOCK);
+	for (k = b; k < b + n; k++) {
+		if (fread(buf, 1, block_len(u, k), fp) != block_len(u, k))
+			fatalf("Cannot read %s (bytes %s).", u->url, range);
+		// written whole and then renamed, so that runs sharing the cache
+		// never see part of a block
+		snprintf(path, sizeof(path), "%s/%lld", u->blockdir, (long long)k);
+		snprintf(tmp, sizeof(tmp), "%s.%d.%lx", path, (int)getpid(), (unsigned long)pthread_self());
+		if ((out = fopen(tmp, "w")) == NULL)
+			fatalf("Cannot write %s: %s", tmp, strerror(errno));
+		if (fwrite(buf, 1, block_len(u, k), out) != block_len(u, k) || fclose(out) != 0
+			|| rename(tmp, path) != 0) {
+			unlink(tmp);
+			fatalf("Cannot write %s: %s", path, strerror(errno));
+		}
+	}
+	free(buf);
+	fclose(fp);
+}
+
+static ssize_t url_read(void *cookie, char *buf, size_t size)
+{
+	struct url_stream *s = cookie;
+	size_t got = 0, k, off;
+	off_t b;
+
+	while (got < size && s->pos < s->u->size) {
+		b = s->pos / BLOCK;
+		if (b != s->blk) {
+			if (!read_block(s->u, b, s->buf)) {
+				fetch_blocks(s->u, b);
+				if (!read_block(s->u, b, s->buf))
+					fatalf("Cannot read %s.", s->u->url);
+			}
+			s->blk = b;
+			s->len = block_len(s->u, b);
+		}
+		off = s->pos - b * BLOCK;
+		k = MIN(size - got, s->len - off);
+		memcpy(buf + got, s->buf + off, k);
+		got += k;
+		s->pos += k;
+	}
+	return got;
+}
+
+static int url_seek(void *cookie, off64_t *off, int whence)
+{
+	struct url_stream *s = cookie;
+	off_t base = whence == SEEK_SET ? 0 : whence == SEEK_CUR ? s->pos : s->u->size;
+
+	if (base + *off < 0)
+		return -1;
+	s->pos = *off = base + *off;
+	return 0;
+}
+
+static int url_close(void *cookie)
+{
+	struct url_stream *s = cookie;
+
+	free(s->buf);
+	free(s);
+	return 0;
+}
+
+FILE *open_url(const char *url)
+{
+	cookie_io_functions_t io = {url_read, NULL, url_seek, url_close};
+	struct url_info *u = get_info(url);
+	struct url_stream *s;
+	FILE *fp;
+
+	if (!u->exists)
+		return NULL;
+	s = ckallocz(sizeof(struct url_stream));
+	s->u = u;
+	s->blk = -1;
+	s->buf = ckalloc(BLOCK);
+	if ((fp = fopencookie(s, "r", io)) == NULL)
+		fatalf("Cannot open %s.", url);
+	return fp;
+}
@@ -0,0 +1,43 @@
+/* **************************************************************
+ * Chain and net files read from a URL instead of a local path:
+ * http(s)://, or an object store as s3://bucket/key (S3_ENDPOINT
+ * names a server other than Amazon's) or gs://bucket/key. A file is
+ * fetched by range requests made with curl (CURL in the environment
+ * sets the command) in blocks of a megabyte, only those read, and
+ * the blocks are kept in a cache shared by every run:
+ * $DESCHRAMBLER_CACHE, or ~/.cache/deschrambler. The blocks of a
+ * file are fetched again when its size, date or ETag on the server
+ * change. What the tools make from a remote file, the index of an
+ * all.net or a chain.store, is kept in the cache as well.
+ * **************************************************************/
+
+#ifndef _REMOTE_H_
+#define _REMOTE_H_
+
+#include <sys/types.h>
+#include <time.h>
+#include "util.h"
+
+// does name look like scheme://...
+bool is_url(const char *name);
+
+/* **************************************************************
+ * The size and modification time (0 if the server gives none) of
+ * a URL; either may be NULL. Returns 0 if there is no such file.
+ * The server is asked once per run.
+ * **************************************************************/
+bool url_stat(const char *url, off_t *size, time_t *mtime);
+
+/* **************************************************************
+ * A seekable stream of a URL read through the cache, or NULL if
+ * there is no such file. Close it with fclose().
+ * **************************************************************/
+FILE *open_url(const char *url);
+
+/* **************************************************************
+ * The path (size chars) in the cache of a local file called name
+ * made from url; its directory is created.
+ * **************************************************************/
+void url_cache_file(const char *url, const char *name, char *path, size_t size);
+
+#endif
@@ -0,0 +1,464 @@
+/* *****************************************************************
+ * scanInputs - a look at the inputs of a run before it is started.
+ * The nets and chains of every species are read once, on a pool of
+ * threads, and the report gives their counts, the scaffolds and the
+ * fill/gap depth of the nets, the syntenic fragments to expect at
+ * each resolution, and the peak memory and time partitionGenomes,
+ * inferAdjProb and deschrambler should take on them.
+ *
+ * The predictions are the sizes of the structures those tools build
+ * (the chain store, the segments and blocks of partitionGenomes, the
+ * leaf sets, candidate index and likelihoods of inferAdjProb) and
+ * per-item times measured on simulated sets; they are estimates to
+ * choose a resolution and a queue by, not promises.
+ * *****************************************************************/
+
+#include "util.h"
+#include "species.h"
+#include "chromfile.h"
+#include "chainstore.h"
+#include "lines.h"
+#include "workpool.h"
+#include <string.h>
+
+#define MAXDEP	30
+#define MAXRES	20
+
+// partitionGenomes: a segment (struct my_seg_list) and a block without
+// its per-species pointers, and about how much getSegments adds to the
+// segments readNets keeps
+#define SEG_BYTES	48
+#define BLOCK_BYTES	40
+#define SEG_SPLIT	1.2
+#define PG_SEG_SEC	5e-6
+
+// inferAdjProb: distinct candidate predecessors per column beyond the
+// first, per further leaf, as simulated sets give; real data with many
+// scaffolds come higher, up to one per leaf
+#define DISAGREE	0.17
+#define IA_SETS_SEC	3.4e-8		// per leaf and extremity (initSets)
+#define IA_COL_SEC	3.1e-9		// per candidate and tree node (getPredecessor)
+#define IA_OUT_SEC	3.1e-7		// per candidate (the posteriors and scores)
+#define IA_OVERHEAD	1.3			// the allocator and the genome lists
+
+// deschrambler, per adjacency score read
+#define DS_EDGE_BYTES	263
+#define DS_EDGE_SEC		2.3e-6
+
+#define MB(x)	((x) / (1 << 20))
+
+// a fill of a net, at level (depth / 2)
+struct fill {
+	int beg, end, span, level;
+	int sbeg, send;
+	const char *schrom;
+	char orient;
+};
+
+// one (species, reference chromosome): its net and chain file
+struct scan_task {
+	int ss;
+	const char *chrom;
+	bool nonet, nochain;
+	long nets, fills, gaps, chains, gapfree;
+	long level_fills[MAXDEP], level_gaps[MAXDEP];
+	int maxdepth;
+	struct fill *fill;
+	int nfill, maxfill;
+	const char **scaf;	// the query sequences, as met
+	int nscaf, maxscaf;
+};
+
+static struct scan_task *Tasks;
+static int Ntasks;
+
+static void add_fill(struct scan_task *t, const struct net_line *n) {
+	if (t->nfill == t->maxfill) {
+		t->maxfill = t->maxfill ? 2 * t->maxfill : 1024;
+		t->fill = ckrealloc(t->fill, t->maxfill * sizeof(struct fill));
+	}
+	t->fill[t->nfill].beg = n->fbeg;
+	t->fill[t->nfill].end = n->fbeg + n->flen;
+	t->fill[t->nfill].span = MAX(n->flen, n->slen);
+	t->fill[t->nfill].level = n->depth / 2;
+	t->fill[t->nfill].sbeg = n->sbeg;
+	t->fill[t->nfill].send = n->sbeg + n->slen;
+	t->fill[t->nfill].schrom = t->scaf[t->nscaf - 1];
+	t->fill[t->nfill].orient = n->orient;
+	t->nfill++;
+}
+
+static void add_scaffold(struct scan_task *t, const struct field *f) {
+	char name[500];
+
+	if (t->nscaf > 0 && field_is(f, t->scaf[t->nscaf - 1]))
+		return;
+	if (!field_copy(f, name, sizeof(name)))
+		fatalf("sequence name too long: %.*s", f->len, f->s);
+	if (t->nscaf == t->maxscaf) {
+		t->maxscaf = t->maxscaf ? 2 * t->maxscaf : 64;
+		t->scaf = ckrealloc(t->scaf, t->maxscaf * sizeof(const char *));
+	}
+	t->scaf[t->nscaf++] = intern_chr(name);
+}
+
+static void scan_net(struct scan_task *t) {
+	char dir[500], name[500];
+	struct line_reader *lr;
+	struct net_line n;
+	const char *line;
+	size_t len;
+	FILE *fp;
+
+	pair_dir(dir, sizeof(dir), Spe->netdir, Spe->spename[0], Spe->spename[t->ss], "net");
+	if ((fp = open_chrom(dir, t->chrom, ".net", name)) == NULL) {
+		t->nonet = 1;
+		return;
+	}
+	lr = open_lines(fp, name);
+	while ((line = next_line(lr, &len)) != NULL) {
+		if (len == 0 || line[0] == '#')
+			continue;
+		if (!parse_net_line(line, len, &n))
+			fatalf("%s: cannot parse: %.*s", name, (int)len, line);
+		if (n.type == 'n') {
+			t->nets++;
+			continue;
+		}
+		if (n.type != 'f' && n.type != 'g')
+			continue;
+		if (n.depth / 2 >= MAXDEP)
+			fatalf("%s: nets deeper than %d levels", name, MAXDEP);
+		t->maxdepth = MAX(t->maxdepth, n.depth / 2 + 1);
+		if (n.type == 'g') {
+			t->gaps++;
+			t->level_gaps[n.depth / 2]++;
+			continue;
+		}
+		t->fills++;
+		t->level_fills[n.depth / 2]++;
+		add_scaffold(t, &n.chrom);
+		add_fill(t, &n);
+	}
+	close_lines(lr);
+	ckclose_in(fp);
+}
+
+// the chains and their gap-free blocks, which make the chain store
+static void scan_chain(struct scan_task *t) {
+	char dir[500], name[500];
+	struct line_reader *lr;
+	const char *line;
+	size_t len;
+	FILE *fp;
+
+	pair_dir(dir, sizeof(dir), Spe->chaindir, Spe->spename[0], Spe->spename[t->ss], "chain");
+	if ((fp = open_chrom(dir, t->chrom, ".chain", name)) == NULL) {
+		t->nochain = 1;
+		return;
+	}
+	lr = open_lines(fp, name);
+	while ((line = next_line(lr, &len)) != NULL) {
+		if (len == 0 || line[0] == '#')
+			continue;
+		if (len > 6 && strncmp(line, "chain ", 6) == 0)
+			t->chains++;
+		else
+			t->gapfree++;
+	}
+	close_lines(lr);
+	ckclose_in(fp);
+}
+
+static void scan_job(int k, void *arg) {
+	(void)arg;
+	scan_net(&Tasks[k]);
+	scan_chain(&Tasks[k]);
+}
+
+static int cmp_point(const void *a, const void *b) {
+	int p = *(const int *)a, q = *(const int *)b;
+
+	return (p > q) - (p < q);
+}
+
+static int cmp_fill(const void *a, const void *b) {
+	const struct fill *p = a, *q = b;
+
+	return (p->beg > q->beg) - (p->beg < q->beg);
+}
+
+/* the fills of a species on one chromosome kept at a resolution, sorted by
+ * start, with the furthest end so far, so that whether a position is in
+ * one of them is a binary search */
+struct cover {
+	struct fill *f;
+	int *reach;
+	int n;
+};
+
+static void make_cover(struct cover *c, const struct scan_task *t, int res) {
+	int i;
+
+	c->f = ckalloc((t->nfill + 1) * sizeof(struct fill));
+	c->reach = ckalloc((t->nfill + 1) * sizeof(int));
+	for (c->n = i = 0; i < t->nfill; i++)
+		if (t->fill[i].span > res)
+			c->f[c->n++] = t->fill[i];
+	qsort(c->f, c->n, sizeof(struct fill), cmp_fill);
+	for (i = 0; i < c->n; i++)
+		c->reach[i] = (i > 0) ? MAX(c->reach[i-1], c->f[i].end) : c->f[i].end;
+}
+
+static bool covered(const struct cover *c, int pos) {
+	int lo = 0, hi = c->n;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (c->f[mid].beg <= pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo > 0 && c->reach[lo - 1] > pos;
+}
+
+// two top-level fills in a row that go on along the same sequence
+static bool collinear(const struct fill *a, const struct fill *b) {
+	if (a->schrom != b->schrom || a->orient != b->orient)
+		return 0;
+	return (a->orient == '+') ? b->sbeg >= a->send : b->send <= a->sbeg;
+}
+
+// a fill nested in a gap of a top-level one that only fills the gap in
+static bool in_gap(const struct fill *top, const struct fill *f) {
+	return top->schrom == f->schrom && top->orient == f->orient
+		&& f->sbeg >= top->sbeg && f->send <= top->send;
+}
+
+/* the breakpoints of a species on one chromosome at a resolution: both
+ * ends of a kept fill nested in a gap of another, unless it only fills
+ * the gap in, and the join of two top-level ones that do not go on along
+ * the same sequence */
+static int breakpoints(struct cover *c, int *pt) {
+	const struct fill *prev = NULL;
+	int i, n = 0;
+
+	for (i = 0; i < c->n; i++) {
+		if (c->f[i].level > 0) {
+			if (prev != NULL && in_gap(prev, &c->f[i]))
+				continue;
+			pt[n++] = c->f[i].beg;
+			pt[n++] = c->f[i].end;
+			continue;
+		}
+		if (prev != NULL && !collinear(prev, &c->f[i]))
+			pt[n++] = (prev->end + c->f[i].beg) / 2;
+		prev = &c->f[i];
+	}
+	return n;
+}
+
+/* the pieces a chromosome is cut into at a resolution: the breakpoints of
+ * the descendant species (an outgroup only fills the blocks in), those
+ * closer than the resolution taken as one, within the stretch they cover. A piece at least that long
+ * held by every descendant species is expected to become a syntenic
+ * fragment; *pieces counts them all */
+static long expect_fragments(struct scan_task **t, int nt, int res, long *pieces) {
+	struct cover *c;
+	int *pt, npt = 0, i, k, m, lo = MAXNUM, hi = 0;
+	long frag = 0;
+	bool all;
+
+	for (k = 0; k < nt; k++)
+		npt += 2 * t[k]->nfill;
+	pt = ckalloc((npt + 3) * sizeof(int));
+	c = ckallocz((nt + 1) * sizeof(struct cover));
+	for (npt = k = 0; k < nt; k++) {
+		if (Spe->spetag[t[k]->ss] != 1)
+			continue;
+		make_cover(&c[k], t[k], res);
+		npt += breakpoints(&c[k], pt + npt);
+		if (c[k].n > 0) {
+			lo = MIN(lo, c[k].f[0].beg);
+			hi = MAX(hi, c[k].reach[c[k].n - 1]);
+		}
+	}
+	if (lo < hi) {
+		pt[npt++] = lo;
+		pt[npt++] = hi;
+	}
+	qsort(pt, npt, sizeof(int), cmp_point);
+	for (m = i = 0; i < npt; i++)
+		if (pt[i] >= lo && pt[i] <= hi && (m == 0 || pt[i] - pt[m-1] >= res))
+			pt[m++] = pt[i];
+	for (i = 1; i < m; i++) {
+		(*pieces)++;
+		for (all = 1, k = 0; k < nt && all; k++)
+			if (Spe->spetag[t[k]->ss] == 1)
+				all = covered(&c[k], (pt[i-1] + pt[i]) / 2);
+		frag += all;
+	}
+	for (k = 0; k < nt; k++) {
+		free(c[k].f);
+		free(c[k].reach);
+	}
+	free(c);
+	free(pt);
+	return frag;
+}
+
+static void report_species(int ss) {
+	long nets = 0, fills = 0, gaps = 0, chains = 0, gapfree = 0, lf[MAXDEP], lg[MAXDEP];
+	int k, l, depth = 0, nscaf = 0, nseen = 0, nonet = 0, nofile = 0;
+	char *seen = NULL;
+
+	memset(lf, 0, sizeof(lf));
+	memset(lg, 0, sizeof(lg));
+	for (k = 0; k < Ntasks; k++) {
+		struct scan_task *t = &Tasks[k];
+		if (t->ss != ss)
+			continue;
+		nets += t->nets;
+		fills += t->fills;
+		gaps += t->gaps;
+		chains += t->chains;
+		gapfree += t->gapfree;
+		nonet += t->nonet;
+		nofile += t->nochain;
+		depth = MAX(depth, t->maxdepth);
+		for (l = 0; l < MAXDEP; l++) {
+			lf[l] += t->level_fills[l];
+			lg[l] += t->level_gaps[l];
+		}
+		seen = grow_chr_table(seen, &nseen, 1);
+		for (l = 0; l < t->nscaf; l++)
+			if (!seen[chr_id(t->scaf[l])]) {
+				seen[chr_id(t->scaf[l])] = 1;
+				nscaf++;
+			}
+	}
+	free(seen);
+	printf("%s (%s)\n", Spe->spename[ss], Spe->spetag[ss] == 1 ? "descendent" : "outgroup");
+	printf("  nets %ld, fills %ld, gaps %ld, on %d scaffolds",
+		nets, fills, gaps, nscaf);
+	if (nonet > 0)
+		printf("; %d chromosomes without a net", nonet);
+	printf("\n  chains %ld, gap-free blocks %ld", chains, gapfree);
+	if (nofile > 0)
+		printf("; %d chromosomes without chains", nofile);
+	printf("\n  depth %d:", depth);
+	for (l = 0; l < depth; l++)
+		printf(" %ld/%ld", lf[l], lg[l]);
+	printf(" (fills/gaps by level)\n");
+}
+
+/* the predictions at one resolution; frag and pieces are those of
+ * expect_fragments(), segs the fills kept */
+static void report_resolution(int res, long frag, long pieces, long segs, double store, int nthreads) {
+	double T = frag, N = 2 * T + 2, leaves = Spe->spesz, nodes = 2 * leaves, n, nmax;
+	double pg_mem, pg_sec, ia_mem, ia_sec, ds_mem, ds_sec;
+
+	n = N * (1 + DISAGREE * (leaves - 1));
+	nmax = N * leaves;
+	pg_mem = store + segs * SEG_SPLIT * SEG_BYTES + pieces * (BLOCK_BYTES + Spe->spesz * sizeof(void *));
+	pg_sec = segs * SEG_SPLIT * PG_SEG_SEC / nthreads;
+	// the leaf sets, the genomes, the candidate index, the normalisers, the
+	// output records and the likelihoods, as inferAdjProb -memLimit counts
+	ia_mem = IA_OVERHEAD * (leaves * N * (sizeof(int) + sizeof(void *) + 1) + leaves * T * sizeof(int)
+		+ (2 * (N + 1) + 4 * n) * sizeof(int) + 4 * N * sizeof(double) + N
+		+ n * 24 + n * sizeof(double));
+	ia_sec = leaves * N * IA_SETS_SEC + n * nodes * IA_COL_SEC / nthreads + n * IA_OUT_SEC;
+	ds_mem = n / 2 * DS_EDGE_BYTES;
+	ds_sec = n / 2 * DS_EDGE_SEC;
+	printf("resolution %d\n", res);
+	printf("  segments kept %ld, blocks to partition about %ld\n", segs, pieces);
+	printf("  syntenic fragments about %ld, candidate adjacencies about %.0f (at most %.0f)\n",
+		frag, n, nmax);
+	printf("  partitionGenomes  %8.1f MB %10.1f s\n", MB(pg_mem), pg_sec);
+	printf("  inferAdjProb      %8.1f MB %10.1f s\n", MB(ia_mem), ia_sec);
+	printf("  deschrambler      %8.1f MB %10.1f s\n", MB(ds_mem), ds_sec);
+}
+
+int main(int argc, char *argv[]) {
+	int res[MAXRES], nres = 0, nthreads, nchr, ss, rs, k, c, r, nt;
+	const char **chrom;
+	char netdir[500], *p;
+	struct scan_task **t;
+	long chains, gapfree, frag, pieces, segs;
+	double store;
+
+	if (argc > 2 && same_string(argv[1], "-res")) {
+		for (p = strtok(argv[2], ","); p && nres < MAXRES; p = strtok(NULL, ","))
+			if ((res[nres++] = atoi(p)) <= 0)
+				fatalf("bad resolution %s", p);
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc != 2 && argc != 3)
+		fatal("args: [-res resolution,...] configure-file [threads]");
+	nthreads = thread_arg(argc == 3 ? argv[2] : NULL);
+
+	get_spename(argv[1]);
+	get_netdir(argv[1]);
+	get_chaindir(argv[1]);
+	get_subset(argv[1]);
+	if (nres == 0) {
+		get_minlen(argv[1]);
+		res[nres++] = Spe->minlen;
+	}
+	rs = ref_spe_idx();
+
+	pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[rs == 0 ? 1 : 0], "net");
+	if ((nchr = dir_chroms(netdir, ".net", &chrom)) < 0)
+		fatalf("Could not open net dir %s", netdir);
+	nchr = subset_chroms(chrom, nchr);
+	Tasks = ckallocz((Spe->spesz * nchr + 1) * sizeof(struct scan_task));
+	for (Ntasks = ss = 0; ss < Spe->spesz; ss++) {
+		if (ss == rs)
+			continue;
+		for (c = 0; c < nchr; c++) {
+			Tasks[Ntasks].ss = ss;
+			Tasks[Ntasks].chrom = chrom[c];
+			Ntasks++;
+		}
+	}
+	run_jobs(Ntasks, nthreads, scan_job, NULL);
+
+	printf("%d species, %d reference chromosomes\n", Spe->spesz, nchr);
+	chains = gapfree = 0;
+	for (ss = 0; ss < Spe->spesz; ss++)
+		if (ss != rs)
+			report_species(ss);
+	for (k = 0; k < Ntasks; k++) {
+		chains += Tasks[k].chains;
+		gapfree += Tasks[k].gapfree;
+	}
+	store = chains * sizeof(struct chain_rec) + gapfree * sizeof(struct chain_gf);
+	printf("chain stores %.1f MB\n", MB(store));
+
+	// the tasks of a chromosome, one per species
+	t = ckalloc((Spe->spesz + 1) * sizeof(struct scan_task *));
+	for (r = 0; r < nres; r++) {
+		frag = pieces = segs = 0;
+		for (c = 0; c < nchr; c++) {
+			for (nt = k = 0; k < Ntasks; k++)
+				if (Tasks[k].chrom == chrom[c])
+					t[nt++] = &Tasks[k];
+			frag += expect_fragments(t, nt, res[r], &pieces);
+		}
+		for (k = 0; k < Ntasks; k++)
+			for (c = 0; c < Tasks[k].nfill; c++)
+				segs += Tasks[k].fill[c].span > res[r];
+		report_resolution(res[r], frag, pieces, segs, store, nthreads);
+	}
+
+	for (k = 0; k < Ntasks; k++) {
+		free(Tasks[k].fill);
+		free(Tasks[k].scaf);
+	}
+	free(t);
+	free(Tasks);
+	free(chrom);
+	return 0;
+}
@@ -0,0 +1,385 @@
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "species.h"
+#include "chromfile.h"
+#include "remote.h"
+#include "segcache.h"
+#include "segstream.h"
+#include <pthread.h>
+
+#define KEYLEN	SEG_KEYLEN
+
+// two 64-bit FNV-1a hashes of the same bytes, from different seeds
+struct digest {
+	uint64_t a, b;
+};
+
+static void digest_init(struct digest *d)
+{
+	d->a = 14695981039346656037ULL;
+	d->b = 0x6a09e667f3bcc908ULL;
+}
+
+static void digest_add(struct digest *d, const void *p, size_t n)
+{
+	const unsigned char *s = p;
+	uint64_t a = d->a, b = d->b;
+
+	for (; n > 0; n--, s++) {
+		a = (a ^ *s) * 1099511628211ULL;
+		b = (b ^ *s) * 0x100000001b3ULL + (b >> 29);
+	}
+	d->a = a;
+	d->b = b;
+}
+
+// a string and its terminating NUL, so that "ab","c" and "a","bc" differ
+static void digest_str(struct digest *d, const char *s)
+{
+	digest_add(d, s, strlen(s) + 1);
+}
+
+static void digest_hex(const struct digest *d, char *hex)
+{
+	snprintf(hex, KEYLEN + 1, "%016llx%016llx", (unsigned long long)d->a,
+		(unsigned long long)d->b);
+}
+
+static const char *cache_root(void)
+{
+	const char *dir = getenv("DESCHRAMBLER_SEGCACHE");
+
+	return (dir && *dir) ? dir : NULL;
+}
+
+/* make_dirs -------------------------------- create a directory and its parents */
+static void make_dirs(const char *dir)
+{
+	char path[1000], *p;
+
+	snprintf(path, sizeof(path), "%s", dir);
+	for (p = path + 1; *p; p++)
+		if (*p == '/') {
+			*p = '\0';
+			mkdir(path, 0777);
+			*p = '/';
+		}
+	if (mkdir(path, 0777) != 0 && errno != EEXIST)
+		fatalf("Cannot create %s: %s", path, strerror(errno));
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* dir_listing ---------- digest of the names, sizes and times of a net dir's files */
+static bool dir_listing(const char *dir, struct digest *d)
+{
+	char path[1100], **names = NULL;
+	const char *ext[] = {"all.net", "all.net.gz"};
+	const struct manifest_dir *md;
+	struct dirent *ent;
+	struct stat st;
+	off_t size;
+	time_t t;
+	int i, n = 0, max = 0;
+	DIR *dp;
+
+	if (is_url(dir)) {
+		for (i = 0; i < 2; i++) {
+			snprintf(path, sizeof(path), "%s/%s", dir, ext[i]);
+			if (url_stat(path, &size, &t)) {
+				snprintf(path, sizeof(path), "%s %lld %lld", ext[i], (long long)size, (long long)t);
+				digest_str(d, path);
+				return 1;
+			}
+		}
+		return 0;
+	}
+	// a listed directory is digested from the listing, as it would be read
+	if ((md = manifest_dir(dir)) != NULL) {
+		for (i = 0; i < md->nfile; i++)
+			if (md->sorted[i]->name[0] != '.' && strstr(md->sorted[i]->name, ".idx") == NULL) {
+				snprintf(path, sizeof(path), "%s %lld %lld", md->sorted[i]->name,
+					(long long)md->sorted[i]->size, (long long)md->sorted[i]->mtime);
+				digest_str(d, path);
+			}
+		return 1;
+	}
+	if ((dp = opendir(dir)) == NULL)
+		return 0;
+	while ((ent = readdir(dp)) != NULL) {
+		// the indexes are written next to the nets the first time they are read
+		if (ent->d_name[0] == '.' || strstr(ent->d_name, ".idx") != NULL)
+			continue;
+		if (n == max) {
+			max = max ? 2 * max : 256;
+			names = ckrealloc(names, max * sizeof(char *));
+		}
+		names[n++] = copy_string(ent->d_name);
+	}
+	closedir(dp);
+	qsort(names, n, sizeof(char *), cmp_str);
+	for (i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		if (stat(path, &st) == 0) {
+			snprintf(path, sizeof(path), "%s %lld %lld", names[i],
+				(long long)st.st_size, (long long)st.st_mtime);
+			digest_str(d, path);
+		}
+		free(names[i]);
+	}
+	free(names);
+	return 1;
+}
+
+/* net_digest --------------- digest of the nets of the chromosomes in a net dir */
+static void net_digest(const char *dir, const char **chroms, int n, struct digest *d)
+{
+	char name[500], memo[1100], tmp[1200], buf[65536];
+	struct digest listing;
+	unsigned long long a, b;
+	size_t k;
+	FILE *fp;
+	int i, got;
+
+	// the digest of the same files and chromosomes is looked up first
+	digest_init(&listing);
+	digest_str(&listing, dir);
+	for (i = 0; i < n; i++)
+		digest_str(&listing, chroms[i]);
+	memo[0] = '\0';
+	if (dir_listing(dir, &listing)) {
+		digest_hex(&listing, name);
+		snprintf(memo, sizeof(memo), "%s/nets", cache_root());
+		make_dirs(memo);
+		snprintf(memo, sizeof(memo), "%s/nets/%s", cache_root(), name);
+		if ((fp = fopen(memo, "r")) != NULL) {
+			got = fscanf(fp, "%16llx%16llx", &a, &b);
+			fclose(fp);
+			if (got == 2) {
+				d->a = a;
+				d->b = b;
+				return;
+			}
+		}
+	}
+
+	fprintf(stderr, "- digesting the nets in %s\n", dir);
+	digest_init(d);
+	for (i = 0; i < n; i++) {
+		digest_str(d, chroms[i]);
+		if ((fp = open_chrom(dir, chroms[i], ".net", name)) == NULL) {
+			digest_str(d, "-");
+			continue;
+		}
+		while ((k = fread(buf, 1, sizeof(buf), fp)) > 0)
+			digest_add(d, buf, k);
+		ckclose_in(fp);
+		digest_str(d, "+");
+	}
+	if (memo[0] == '\0')
+		return;
+	snprintf(tmp, sizeof(tmp), "%s.%d", memo, (int)getpid());
+	if ((fp = fopen(tmp, "w")) == NULL)
+		return;
+	digest_hex(d, name);
+	fprintf(fp, "%s\n", name);
+	if (fclose(fp) != 0 || rename(tmp, memo) != 0)
+		unlink(tmp);
+}
+
+/* species_key ------------ the key of the segments of species ss; 0 if no cache */
+static bool species_key(int ss, char *key)
+{
+	static char Keys[MAXSPE][KEYLEN + 1];
+	static bool Tried[MAXSPE], Have[MAXSPE];
+	static const char **Chroms = NULL;
+	static int Nchrom = -1;
+	static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+	char netdir[1000], num[20];
+	struct digest d, nets;
+	int rs = ref_spe_idx();
+
+	if (cache_root() == NULL || Spe->netdir[0] == '\0' || ss < 0 || ss >= MAXSPE)
+		return 0;
+	if (!Tried[ss]) {
+		Tried[ss] = 1;
+		// the chromosomes read_nets() reads, in its order, found by the
+		// first of the species' threads
+		pthread_mutex_lock(&Lock);
+		if (Nchrom < 0) {
+			pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[1], "net");
+			if ((Nchrom = dir_chroms(netdir, ".net", &Chroms)) >= 0)
+				Nchrom = subset_chroms(Chroms, Nchrom);
+		}
+		pthread_mutex_unlock(&Lock);
+		if (Nchrom < 0)
+			return 0;
+		pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[ss], "net");
+		net_digest(netdir, Chroms, Nchrom, &nets);
+		digest_init(&d);
+		digest_str(&d, Spe->spename[0]);
+		digest_str(&d, Spe->spename[rs]);
+		digest_str(&d, Spe->spename[ss]);
+		sprintf(num, "%d", Spe->minlen);
+		digest_str(&d, num);
+		// the chromosomes a chrom.sizes leaves out are gone from Chroms
+		if (Spe->skipshort[0] != '\0')
+			digest_str(&d, "skipshort");
+		digest_add(&d, &nets.a, sizeof(nets.a));
+		digest_add(&d, &nets.b, sizeof(nets.b));
+		digest_hex(&d, Keys[ss]);
+		Have[ss] = 1;
+	}
+	if (!Have[ss])
+		return 0;
+	strcpy(key, Keys[ss]);
+	return 1;
+}
+
+/* entry_path ------------------- the path of the cached kind of species ss */
+static bool entry_path(int ss, const char *kind, char *path, size_t size)
+{
+	char key[KEYLEN + 1];
+
+	if (!species_key(ss, key))
+		return 0;
+	snprintf(path, size, "%s/%s-%s", cache_root(), Spe->spename[ref_spe_idx()], Spe->spename[ss]);
+	make_dirs(path);
+	snprintf(path, size, "%s/%s-%s/%s.%s", cache_root(), Spe->spename[ref_spe_idx()],
+		Spe->spename[ss], key, kind);
+	return 1;
+}
+
+off_t seg_cache_size(int ss, const char *kind)
+{
+	char path[1000];
+	struct stat st;
+
+	if (!entry_path(ss, kind, path, sizeof(path)) || stat(path, &st) != 0)
+		return -1;
+	return st.st_size;
+}
+
+bool seg_cache_copy(int ss, const char *kind, FILE *out)
+{
+	char path[1000], buf[65536];
+	size_t k;
+	FILE *fp;
+
+	if (!entry_path(ss, kind, path, sizeof(path)) || (fp = fopen(path, "r")) == NULL)
+		return 0;
+	fprintf(stderr, "- copying %s\n", path);
+	while ((k = fread(buf, 1, sizeof(buf), fp)) > 0)
+		if (fwrite(buf, 1, k, out) != k)
+			fatalf("cannot write the %s of %s", kind, Spe->spename[ss]);
+	if (ferror(fp))
+		fatalf("cannot read %s", path);
+	fclose(fp);
+	return 1;
+}
+
+bool seg_cache_begin(int ss, const char *kind, struct seg_entry *e)
+{
+	e->fp = NULL;
+	if (!entry_path(ss, kind, e->path, sizeof(e->path)))
+		return 0;
+	snprintf(e->tmp, sizeof(e->tmp), "%s.%d", e->path, (int)getpid());
+	if ((e->fp = fopen(e->tmp, "w")) == NULL) {
+		fprintf(stderr, "- cannot write %s; the segments are not cached\n", e->tmp);
+		return 0;
+	}
+	return 1;
+}
+
+void seg_cache_end(struct seg_entry *e, bool keep)
+{
+	if (e->fp == NULL)
+		return;
+	if (fclose(e->fp) != 0 || !keep || rename(e->tmp, e->path) != 0) {
+		if (keep)
+			fprintf(stderr, "- cannot write %s; the segments are not cached\n", e->path);
+		unlink(e->tmp);
+	}
+	e->fp = NULL;
+}
+
+/* chrom_path ------------ the path of the cached segments of a chromosome */
+static void chrom_path(int ss, const char *key, char *path, size_t size)
+{
+	const char *ref = Spe->spename[ref_spe_idx()];
+
+	snprintf(path, size, "%s/%s-%s/chroms", cache_root(), ref, Spe->spename[ss]);
+	make_dirs(path);
+	snprintf(path, size, "%s/%s-%s/chroms/%s.raw.segs", cache_root(), ref, Spe->spename[ss], key);
+}
+
+bool seg_chrom_key(int ss, const char *chrom, char *key)
+{
+	char netdir[1000], name[500], num[20], buf[65536];
+	struct digest d;
+	size_t k;
+	FILE *fp;
+
+	if (cache_root() == NULL || Spe->netdir[0] == '\0')
+		return 0;
+	pair_dir(netdir, sizeof(netdir), Spe->netdir, Spe->spename[0], Spe->spename[ss], "net");
+	if ((fp = open_chrom(netdir, chrom, ".net", name)) == NULL)
+		return 0;
+	digest_init(&d);
+	digest_str(&d, Spe->spename[0]);
+	digest_str(&d, Spe->spename[ref_spe_idx()]);
+	digest_str(&d, Spe->spename[ss]);
+	sprintf(num, "%d", Spe->minlen);
+	digest_str(&d, num);
+	digest_str(&d, Spe->skipshort[0] != '\0' ? "skipshort" : "");
+	digest_str(&d, chrom);
+	while ((k = fread(buf, 1, sizeof(buf), fp)) > 0)
+		digest_add(&d, buf, k);
+	ckclose_in(fp);
+	digest_hex(&d, key);
+	return 1;
+}
+
+bool seg_chrom_load(int ss, const char *key, void (*add)(const struct seg_line *s, void *arg),
+	void *arg)
+{
+	char path[1000];
+	struct seg_reader *r;
+	struct seg_line s;
+	FILE *fp;
+
+	chrom_path(ss, key, path, sizeof(path));
+	if ((fp = fopen(path, "r")) == NULL)
+		return 0;
+	r = open_seg_reader(fp, SEGS_RAW, path);
+	while (read_seg_line(r, &s))
+		add(&s, arg);
+	close_seg_reader(r);
+	fclose(fp);
+	return 1;
+}
+
+void seg_chrom_save(int ss, const char *key, const struct seg_line *segs, int n)
+{
+	char path[1000], tmp[1100];
+	struct seg_writer *w;
+	FILE *fp;
+	int i;
+
+	chrom_path(ss, key, path, sizeof(path));
+	// the key is of the chromosome's name too, so no other thread has it
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	if ((fp = fopen(tmp, "w")) == NULL)
+		return;
+	w = open_seg_writer(fp, SEGS_RAW, ref_spe_idx(), ss, 1);
+	for (i = 0; i < n; i++)
+		write_seg_line(w, &segs[i]);
+	close_seg_writer(w);
+	if (fclose(fp) != 0 || rename(tmp, path) != 0)
+		unlink(tmp);
+}
@@ -0,0 +1,66 @@
+/* **************************************************************
+ * A cache of the raw.segs and processed.segs of each species pair,
+ * shared by every project that reads the same nets. It is used when
+ * $DESCHRAMBLER_SEGCACHE names its directory. An entry is keyed by a
+ * digest of what the segments are made from: the reference and
+ * species names, MINLEN and the contents of the nets of the
+ * chromosomes read (those of a subset only, with one). The digest of
+ * a net directory is remembered by the names, sizes and times of its
+ * files, so a directory is read for it once. The segments of a pair
+ * already in the cache are copied instead of made; those made are
+ * written to it, under a temporary name until they are complete.
+ *
+ * The segments of a pair not in the cache whole are kept by
+ * chromosome as well, keyed by the same names and MINLEN and the
+ * bytes of the chromosome's nets: after an assembly update, which
+ * changes the nets of some chromosomes, only those are parsed again,
+ * and the raw.segs made of the rest are the same bytes as before.
+ * **************************************************************/
+
+#ifndef _SEGCACHE_H_
+#define _SEGCACHE_H_
+
+#include <sys/types.h>
+#include "util.h"
+#include "segstream.h"
+
+#define SEG_KEYLEN	32
+
+// a file being written to the cache
+struct seg_entry {
+	FILE *fp;
+	char path[1000], tmp[1100];
+};
+
+/* **************************************************************
+ * The size of the cached kind ("raw.segs" or "processed.segs") of
+ * species ss, or -1 if it is not cached or there is no cache.
+ * **************************************************************/
+off_t seg_cache_size(int ss, const char *kind);
+
+// copies the cached kind of species ss to out; 0 if it is not cached
+bool seg_cache_copy(int ss, const char *kind, FILE *out);
+
+/* **************************************************************
+ * Starts writing the kind of species ss to the cache; 0 if there is
+ * no cache. seg_cache_end() puts the file in place if keep is set
+ * and removes it otherwise.
+ * **************************************************************/
+bool seg_cache_begin(int ss, const char *kind, struct seg_entry *e);
+void seg_cache_end(struct seg_entry *e, bool keep);
+
+/* **************************************************************
+ * The key of the segments of chromosome chrom of species ss, from
+ * the bytes of its nets, in key (SEG_KEYLEN + 1 chars); 0 if there
+ * is no cache or no nets of it. Safe from several threads.
+ * **************************************************************/
+bool seg_chrom_key(int ss, const char *chrom, char *key);
+
+// calls add(s, arg) for each segment cached under key; 0 if none is
+bool seg_chrom_load(int ss, const char *key, void (*add)(const struct seg_line *s, void *arg),
+	void *arg);
+
+// caches the n segments of a chromosome under key
+void seg_chrom_save(int ss, const char *key, const struct seg_line *segs, int n);
+
+#endif
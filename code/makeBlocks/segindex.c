@@ -0,0 +1,110 @@
+#include "util.h"
+#include "segindex.h"
+
+struct seg_entry {
+	int lo, hi;
+	int maxhi;		// largest hi in the subtree rooted here
+	int chr;
+	struct block_list *blk;
+};
+
+/* the entries of a chromosome are sorted by lo; the middle entry of any
+ * range [l, r) is the root of the implicit search tree over that range */
+struct seg_index {
+	int n, nchr;
+	struct seg_entry *e;
+	int *first;		// entries of chromosome id c are e[first[c]..first[c+1])
+};
+
+static int cmp_entry(const void *a, const void *b)
+{
+	const struct seg_entry *x = a, *y = b;
+
+	if (x->chr != y->chr)
+		return x->chr - y->chr;
+	return (x->lo > y->lo) - (x->lo < y->lo);
+}
+
+static int set_maxhi(struct seg_entry *e, int l, int r)
+{
+	int m = (l + r) / 2, h;
+
+	if (l >= r)
+		return -1;
+	h = e[m].hi;
+	h = MAX(h, set_maxhi(e, l, m));
+	h = MAX(h, set_maxhi(e, m + 1, r));
+	return e[m].maxhi = h;
+}
+
+struct seg_index *build_seg_index(struct block_list *head, int idx)
+{
+	struct seg_index *x = ckallocz(sizeof(struct seg_index));
+	struct block_list *b;
+	struct seg_list *sg;
+	int i, c, max = 0;
+
+	for (b = head; b != NULL; b = b->next)
+		for (sg = b->speseg[idx]; sg != NULL; sg = sg->next) {
+			if (x->n == max) {
+				max = max ? 2 * max : 1024;
+				x->e = ckrealloc(x->e, max * sizeof(struct seg_entry));
+			}
+			x->e[x->n].lo = MIN(sg->beg, sg->end);
+			x->e[x->n].hi = MAX(sg->beg, sg->end);
+			x->e[x->n].chr = chr_id(sg->chr);
+			x->e[x->n].blk = b;
+			x->n++;
+		}
+	if (x->n > 0)
+		qsort(x->e, x->n, sizeof(struct seg_entry), cmp_entry);
+
+	x->nchr = chr_count();
+	x->first = ckallocz((x->nchr + 1) * sizeof(int));
+	for (i = 0; i < x->n; i++)
+		x->first[x->e[i].chr + 1]++;
+	for (c = 0; c < x->nchr; c++)
+		x->first[c+1] += x->first[c];
+	for (c = 0; c < x->nchr; c++)
+		set_maxhi(x->e, x->first[c], x->first[c+1]);
+	return x;
+}
+
+void free_seg_index(struct seg_index *x)
+{
+	if (x == NULL)
+		return;
+	free(x->e);
+	free(x->first);
+	free(x);
+}
+
+static int stab(const struct seg_entry *e, int l, int r, int beg, int end,
+				int (*fn)(struct block_list *blk, void *arg), void *arg)
+{
+	int m, v;
+
+	while (l < r) {
+		m = (l + r) / 2;
+		if (e[m].maxhi < beg)
+			return 0;
+		if ((v = stab(e, l, m, beg, end, fn, arg)) != 0)
+			return v;
+		if (e[m].lo > end)
+			return 0;
+		if (e[m].hi >= beg && (v = fn(e[m].blk, arg)) != 0)
+			return v;
+		l = m + 1;
+	}
+	return 0;
+}
+
+int stab_seg_index(const struct seg_index *x, const char *chr, int beg, int end,
+				int (*fn)(struct block_list *blk, void *arg), void *arg)
+{
+	int c = chr_id(chr);
+
+	if (c >= x->nchr)
+		return 0;
+	return stab(x->e, x->first[c], x->first[c+1], MIN(beg, end), MAX(beg, end), fn, arg);
+}
@@ -0,0 +1,29 @@
+/* **************************************************************
+ * An interval index over the segments of one species in a block
+ * list. It is built once, and each query reports the blocks holding
+ * a segment on a chromosome that meets a given range, instead of
+ * walking the whole list. Segments are indexed by their coordinates
+ * when the index is built; segments removed from the blocks later
+ * are still reported, so callers check the block's current segments.
+ * **************************************************************/
+
+#ifndef _SEGINDEX_H_
+#define _SEGINDEX_H_
+
+#include "species.h"
+
+struct seg_index;
+
+struct seg_index *build_seg_index(struct block_list *head, int idx);
+void free_seg_index(struct seg_index *x);
+
+/* **************************************************************
+ * Calls fn(blk, arg) for the block of every indexed segment on chr
+ * that meets [beg, end] (inclusive). A block may be reported more
+ * than once. Stops and returns the first nonzero value fn returns;
+ * returns 0 otherwise.
+ * **************************************************************/
+int stab_seg_index(const struct seg_index *x, const char *chr, int beg, int end,
+				int (*fn)(struct block_list *blk, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,320 @@
+#include "util.h"
+#include "segprocess.h"
+#include "trace.h"
+
+// the chromosomes are interned (chrtab.h): the same name is the same pointer
+struct my_seg_list {
+	const char *fchr, *schr;
+	int fbeg, fend, sbeg, send;
+	int cid;
+	char orient;
+	struct my_seg_list *next;
+	struct my_seg_list *left, *right;	// in the tree of the window
+	int size;
+	unsigned pri;
+};
+
+/* the lines under a level-0 fill only break the segments from that fill
+ * on, the window. While its segments are in order (one chromosome, each
+ * ending where or before the next begins) they are also kept in a treap
+ * keyed by position in the list, so a nested piece is placed by a
+ * descent rather than a scan; a piece that breaks the order turns the
+ * window back to the scan until the next level-0 fill */
+struct window {
+	struct my_seg_list *first, *root;
+	int n, ordered;
+	unsigned seed;
+};
+
+static int tree_size(struct my_seg_list *t) {
+	return (t == NULL) ? 0 : t->size;
+}
+
+static struct my_seg_list *tree_merge(struct my_seg_list *l, struct my_seg_list *r) {
+	if (l == NULL)
+		return r;
+	if (r == NULL)
+		return l;
+	if (l->pri > r->pri) {
+		l->right = tree_merge(l->right, r);
+		l->size = tree_size(l->left) + tree_size(l->right) + 1;
+		return l;
+	}
+	r->left = tree_merge(l, r->left);
+	r->size = tree_size(r->left) + tree_size(r->right) + 1;
+	return r;
+}
+
+// the first k segments go to l, the others to r
+static void tree_split(struct my_seg_list *t, int k, struct my_seg_list **l, struct my_seg_list **r) {
+	if (t == NULL) {
+		*l = *r = NULL;
+		return;
+	}
+	if (tree_size(t->left) < k) {
+		tree_split(t->right, k - tree_size(t->left) - 1, &(t->right), r);
+		*l = t;
+	}
+	else {
+		tree_split(t->left, k, l, &(t->left));
+		*r = t;
+	}
+	t->size = tree_size(t->left) + tree_size(t->right) + 1;
+}
+
+static void window_insert(struct window *w, struct my_seg_list *p, int k) {
+	struct my_seg_list *l, *r;
+
+	w->seed = w->seed * 1103515245 + 12345;
+	p->pri = w->seed;
+	p->left = p->right = NULL;
+	p->size = 1;
+	tree_split(w->root, k, &l, &r);
+	w->root = tree_merge(tree_merge(l, p), r);
+	w->n++;
+}
+
+static void window_start(struct window *w, struct my_seg_list *p) {
+	w->first = p;
+	w->root = NULL;
+	w->n = 0;
+	w->ordered = (p->fbeg <= p->fend);
+	window_insert(w, p, 0);
+}
+
+static struct my_seg_list *window_at(struct window *w, int k) {
+	struct my_seg_list *t = w->root;
+
+	while (tree_size(t->left) != k) {
+		if (tree_size(t->left) > k)
+			t = t->left;
+		else {
+			k -= tree_size(t->left) + 1;
+			t = t->right;
+		}
+	}
+	return t;
+}
+
+// the number of segments before the first whose end (or beg) is >= x (> x if strict)
+static int window_count(struct window *w, int end, int x, int strict) {
+	struct my_seg_list *t = w->root;
+	int k = 0, v;
+
+	while (t != NULL) {
+		v = end ? t->fend : t->fbeg;
+		if (v > x || (!strict && v == x))
+			t = t->left;
+		else {
+			k += tree_size(t->left) + 1;
+			t = t->right;
+		}
+	}
+	return k;
+}
+
+// x and the segment after it, y, keep the window in order
+static int in_order(struct my_seg_list *x, struct my_seg_list *y) {
+	return x->fbeg <= x->fend
+		&& (y == NULL || (x->fchr == y->fchr && x->fend <= y->fbeg));
+}
+
+/* the first segment q of the window, in list order, that contains
+ * [beg, end] (returns 1), or that follows a gap holding it (returns 0,
+ * prp is the segment before q). Without either, q is NULL and prp is
+ * the last segment. k is the position of q, or where a piece goes
+ * after prp */
+static int find_insert(struct window *w, const char *chr, int beg, int end,
+					   struct my_seg_list **qq, struct my_seg_list **pprp, int *k) {
+	struct my_seg_list *q, *prp;
+	int in, gap;
+
+	if (w->first != NULL && w->ordered) {
+		// the segments of an ordered window are sorted by both ends
+		in = gap = w->n;
+		if (chr == w->first->fchr) {
+			if ((in = window_count(w, 1, end, 0)) >= window_count(w, 0, beg, 1))
+				in = w->n;
+			gap = MAX(1, window_count(w, 0, end, 0));
+			if (gap > window_count(w, 1, beg, 1) || gap >= w->n)
+				gap = w->n;
+		}
+		*k = MIN(in, gap);
+		*qq = (*k < w->n) ? window_at(w, *k) : NULL;
+		*pprp = (*k > 0) ? window_at(w, *k - 1) : NULL;
+		return (in < w->n && in <= gap);
+	}
+	for (q = w->first, prp = NULL; q != NULL; q = q->next) {
+		if (chr == q->fchr && beg >= q->fbeg && end <= q->fend)
+			break;
+		if (prp != NULL && chr == q->fchr
+				&& beg >= prp->fend && end <= q->fbeg) {
+			*qq = q;
+			*pprp = prp;
+			return 0;
+		}
+		prp = q;
+	}
+	*qq = q;
+	*pprp = prp;
+	return (q != NULL);
+}
+
+/* writes the segments of the list to the writers, out and the cache's
+ * if not NULL, and frees them */
+static void write_segs(struct seg_writer *out, struct seg_writer *cache, struct my_seg_list *slist) {
+	struct my_seg_list *p, *next;
+	struct seg_line s;
+
+	memset(&s, 0, sizeof(s));
+	s.type = 's';
+	for (p = slist; p != NULL; p = next) {
+		next = p->next;
+		s.fchr = p->fchr;
+		s.fbeg = p->fbeg;
+		s.fend = p->fend;
+		s.schr = p->schr;
+		s.sbeg = p->sbeg;
+		s.send = p->send;
+		s.orient = p->orient;
+		s.cid = p->cid;
+		write_seg_line(out, &s);
+		if (cache != NULL)
+			write_seg_line(cache, &s);
+		free(p);
+	}
+}
+
+struct seg_processor {
+	struct seg_writer *out, *cache;
+	struct my_seg_list *slist;
+	struct window w;
+	// the last gap above a nested fill
+	int fgapbeg, fgapend, sgapbeg, sgapend;
+};
+
+struct seg_processor *open_seg_processor(struct seg_writer *out, struct seg_writer *cache) {
+	struct seg_processor *sp = ckallocz(sizeof(struct seg_processor));
+
+	sp->out = out;
+	sp->cache = cache;
+	return sp;
+}
+
+void close_seg_processor(struct seg_processor *sp) {
+	write_segs(sp->out, sp->cache, sp->slist);
+	free(sp);
+}
+
+static struct my_seg_list *new_seg(const struct seg_line *s) {
+	struct my_seg_list *p = MEM_AS(seg_list, (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list)));
+
+	p->next = NULL;
+	p->fchr = s->fchr;
+	p->fbeg = s->fbeg;
+	p->fend = s->fend;
+	p->schr = s->schr;
+	p->sbeg = s->sbeg;
+	p->send = s->send;
+	p->orient = s->orient;
+	p->cid = s->cid;
+	return p;
+}
+
+void process_seg_line(struct seg_processor *sp, const struct seg_line *s) {
+	struct my_seg_list *p, *r, *q, *prp;
+	struct window *w = &sp->w;
+	int tobreak, k;
+
+	if (s->level == 0 && s->type == 's') {
+		// no need to break and insert, just append to the list
+		p = new_seg(s);
+		// the segments so far are done
+		write_segs(sp->out, sp->cache, sp->slist);
+		sp->slist = p;
+		window_start(w, p);
+	}
+	else if (s->type == 's') {
+		// see how to break
+		p = new_seg(s);
+		// a piece with no gap above it ([NP]) breaks at the last gap read
+		if (s->gchr != NULL) {
+			sp->fgapbeg = s->gfbeg;
+			sp->fgapend = s->gfend;
+			sp->sgapbeg = s->gsbeg;
+			sp->sgapend = s->gsend;
+		}
+		// look for the position to insert the seg
+		tobreak = find_insert(w, p->fchr, p->fbeg, p->fend, &q, &prp, &k);
+		if (tobreak == 1) {
+			// q -> p -> r
+			r = MEM_AS(seg_list, (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list)));
+			p->next = r;
+			r->next = q->next;
+			q->next = p;
+			r->fend = q->fend;
+			q->fend = sp->fgapbeg;
+			r->fbeg = sp->fgapend;
+			r->fchr = q->fchr;
+			r->schr = q->schr;
+			r->cid = q->cid;
+			r->orient = q->orient;
+			if (q->orient == '+') {
+				r->send = q->send;
+				q->send = sp->sgapbeg;
+				r->sbeg = sp->sgapend;
+			} 
+			else {
+				r->sbeg = q->sbeg;
+				q->sbeg = sp->sgapend;
+				r->send = sp->sgapbeg;
+			}
+			if (w->ordered) {
+				window_insert(w, p, k + 1);
+				window_insert(w, r, k + 2);
+				w->ordered = in_order(q, p) && in_order(p, r) && in_order(r, r->next);
+			}
+		}
+		else if (prp) {
+			p->next = prp->next;
+			prp->next = p;
+			if (w->ordered) {
+				window_insert(w, p, k);
+				w->ordered = in_order(prp, p) && in_order(p, p->next);
+			}
+		}
+		else
+			// before any fill of level 0: there is nothing to put it in
+			free(p);
+	}
+	else { // type == 'g'
+		tobreak = find_insert(w, s->fchr, s->fbeg, s->fend, &q, &prp, &k);
+		if (tobreak == 1 && q->schr == s->schr) {
+			// q -> r
+			r = MEM_AS(seg_list, (struct my_seg_list *)ckalloc(sizeof(struct my_seg_list))); 
+			r->next = q->next;
+			q->next = r;
+			r->fend = q->fend; 
+			q->fend = s->fbeg;
+			r->fbeg = s->fend;
+			r->fchr = q->fchr;
+			r->schr = q->schr;
+			r->orient = q->orient; 
+			r->cid = q->cid;
+			if (q->orient == '+') { 
+				r->send = q->send;
+				q->send = s->sbeg;
+				r->sbeg = s->send;
+			}
+			else { 
+				r->sbeg = q->sbeg;
+				q->sbeg = s->send;
+				r->send = s->sbeg;
+			} 
+			if (w->ordered) {
+				window_insert(w, r, k + 1);
+				w->ordered = in_order(q, r) && in_order(r, r->next);
+			}
+		}
+	}
+}
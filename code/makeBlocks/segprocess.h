@@ -0,0 +1,28 @@
+/* **************************************************************
+ * The making of processed.segs out of the lines of raw.segs, the
+ * step of getSegments: the fills of a net, nested fills and gaps
+ * break the fills they are under, and what is left of each is a
+ * segment. A processor takes the lines of a species in the order
+ * readNets writes them and writes the segments as each level-0 fill
+ * starts, so it is fed by a raw.segs stream (getSegments) or by the
+ * net reader itself (readNets -fused), which then writes no raw.segs.
+ * **************************************************************/
+
+#ifndef _SEGPROCESS_H_
+#define _SEGPROCESS_H_
+
+#include "segstream.h"
+
+struct seg_processor;
+
+/* starts writing the segments to out and, if it is not NULL, to
+ * cache as well; the writers stay open */
+struct seg_processor *open_seg_processor(struct seg_writer *out, struct seg_writer *cache);
+
+// the next line of raw.segs
+void process_seg_line(struct seg_processor *p, const struct seg_line *s);
+
+// writes the segments left and frees p
+void close_seg_processor(struct seg_processor *p);
+
+#endif
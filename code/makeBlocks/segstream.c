@@ -0,0 +1,420 @@
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "species.h"
+#include "chrtab.h"
+#include "segstream.h"
+
+int Binary_segs = 1;
+
+/* the first byte is not text, so a reader tells the forms apart by it
+ * alone and puts it back (one byte is all ungetc() is sure to take) */
+static const char Magic[8] = "\x89" "DSCHSG\n";
+
+struct seg_header {
+	char magic[8];
+	int32_t kind, rs, ss;
+};
+
+// type 's' a fill, 'f' a fill below level 0 followed by its gap,
+// 'g' a gap, 'n' the name of the id fchr, of level chars, padded to 4
+struct sg_rec {
+	char type, orient, gorient, pad;
+	int32_t level, fchr, fbeg, fend, schr, sbeg, send, cid;
+};
+
+struct sg_gap {
+	int32_t gchr, gfbeg, gfend, gsbeg, gsend;
+};
+
+const char *seg_cache_kind(enum seg_kind kind, int binary)
+{
+	if (kind == SEGS_RAW)
+		return binary ? "raw.segs.bin" : "raw.segs";
+	return binary ? "processed.segs.bin" : "processed.segs";
+}
+
+/* writing ------------------------------------------------------------- */
+
+struct seg_writer {
+	FILE *fp;
+	enum seg_kind kind;
+	int rs, ss, binary;
+	int *ids;			// chr_id() -> 1 + the id in the stream, 0 if not named yet
+	int nids, named;
+	const char *prev;		// the reference chromosome of the last text line
+};
+
+struct seg_writer *open_seg_writer(FILE *fp, enum seg_kind kind, int rs, int ss, int binary)
+{
+	struct seg_writer *w = ckallocz(sizeof(struct seg_writer));
+	struct seg_header h;
+
+	w->fp = fp;
+	w->kind = kind;
+	w->rs = rs;
+	w->ss = ss;
+	w->binary = binary;
+	if (binary) {
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, Magic, sizeof(Magic));
+		h.kind = kind;
+		h.rs = rs;
+		h.ss = ss;
+		if (fwrite(&h, sizeof(h), 1, fp) != 1)
+			fatal("cannot write a segment stream");
+	}
+	return w;
+}
+
+void close_seg_writer(struct seg_writer *w)
+{
+	free(w->ids);
+	free(w);
+}
+
+// the id of chr in the stream, named first if the stream has not named it yet
+static int32_t name_id(struct seg_writer *w, const char *chr)
+{
+	static const char zero[4];
+	struct sg_rec r;
+	int k = chr_id(chr), len;
+
+	if (k >= w->nids)
+		w->ids = grow_chr_table(w->ids, &w->nids, sizeof(int));
+	if (w->ids[k] == 0) {
+		w->ids[k] = ++w->named;
+		len = strlen(chr);
+		memset(&r, 0, sizeof(r));
+		r.type = 'n';
+		r.level = len;
+		r.fchr = w->ids[k] - 1;
+		if (fwrite(&r, sizeof(r), 1, w->fp) != 1 || fwrite(chr, 1, len, w->fp) != (size_t)len
+			|| fwrite(zero, 1, (4 - len % 4) % 4, w->fp) != (size_t)(4 - len % 4) % 4)
+			fatal("cannot write a segment stream");
+	}
+	return w->ids[k] - 1;
+}
+
+static void write_binary(struct seg_writer *w, const struct seg_line *s)
+{
+	struct sg_rec r;
+	struct sg_gap g;
+
+	memset(&r, 0, sizeof(r));
+	r.fchr = name_id(w, s->fchr);
+	r.schr = name_id(w, s->schr);
+	g.gchr = (s->type == 's' && s->level > 0 && s->gchr != NULL) ? name_id(w, s->gchr) : -1;
+	r.type = (g.gchr >= 0) ? 'f' : s->type;
+	r.orient = s->orient;
+	r.gorient = (g.gchr >= 0) ? s->gorient : 0;
+	r.level = s->level;
+	r.fbeg = s->fbeg;
+	r.fend = s->fend;
+	r.sbeg = s->sbeg;
+	r.send = s->send;
+	r.cid = s->cid;
+	g.gfbeg = s->gfbeg;
+	g.gfend = s->gfend;
+	g.gsbeg = s->gsbeg;
+	g.gsend = s->gsend;
+	if (fwrite(&r, sizeof(r), 1, w->fp) != 1
+		|| (g.gchr >= 0 && fwrite(&g, sizeof(g), 1, w->fp) != 1))
+		fatal("cannot write a segment stream");
+}
+
+void write_seg_line(struct seg_writer *w, const struct seg_line *s)
+{
+	const char *ref = Spe->spename[w->rs], *spe = Spe->spename[w->ss];
+	FILE *fp = w->fp;
+
+	if (w->binary) {
+		write_binary(w, s);
+		return;
+	}
+	if (w->kind == SEGS_PROCESSED) {
+		if (s->fchr != w->prev)
+			fprintf(fp, "#\n");
+		w->prev = s->fchr;
+		fprintf(fp, "%s.%s:%d-%d %s.%s:%d-%d %c %d\n", ref, s->fchr, s->fbeg, s->fend,
+				spe, s->schr, s->sbeg, s->send, s->orient, s->cid);
+		return;
+	}
+	if (s->type == 'g') {
+		fprintf(fp, "%d g %s.%s:%d-%d %s.%s:%d-%d %c\n", s->level, ref, s->fchr,
+				s->fbeg, s->fend, spe, s->schr, s->sbeg, s->send, s->orient);
+		return;
+	}
+	fprintf(fp, "%d s %s.%s:%d-%d %s.%s:%d-%d %c %d", s->level, ref, s->fchr, s->fbeg,
+			s->fend, spe, s->schr, s->sbeg, s->send, s->orient, s->cid);
+	if (s->level == 0)
+		fprintf(fp, "\n");
+	else if (s->gchr == NULL)
+		fprintf(fp, " [NP]\n");
+	else
+		fprintf(fp, " [%d %d %s %d %d %c]\n", s->gfbeg, s->gfend, s->gchr,
+				s->gsbeg, s->gsend, s->gorient);
+}
+
+/* reading ------------------------------------------------------------- */
+
+struct seg_reader {
+	FILE *fp;
+	char *name;
+	enum seg_kind kind;
+	int binary, rs, ss;
+	off_t off;			// of the next line or record
+	char *line;			// of a text stream
+	size_t cap;
+	const char *map;	// a binary stream in a plain file, mapped
+	size_t maplen;
+	const char **chr;	// id -> interned name, of a binary stream
+	int nchr;
+};
+
+struct seg_reader *open_seg_reader(FILE *fp, enum seg_kind kind, const char *name)
+{
+	struct seg_reader *r = ckallocz(sizeof(struct seg_reader));
+	struct seg_header h;
+	struct stat st;
+	int c, fd;
+
+	r->fp = fp;
+	r->name = copy_string(name);
+	r->kind = kind;
+	if ((r->off = ftello(fp)) < 0)
+		r->off = 0;
+	if ((c = getc(fp)) != (unsigned char)Magic[0]) {
+		if (c != EOF)
+			ungetc(c, fp);
+		return r;
+	}
+	h.magic[0] = c;
+	if (fread(h.magic + 1, sizeof(h) - 1, 1, fp) != 1
+		|| memcmp(h.magic, Magic, sizeof(Magic)) != 0)
+		fatalf("%s: not a segment stream", name);
+	if (h.kind != (int32_t)kind)
+		fatalf("%s: not a stream of %s", name, seg_cache_kind(kind, 0));
+	r->binary = 1;
+	r->rs = h.rs;
+	r->ss = h.ss;
+	r->off += sizeof(h);
+	fd = fileno(fp);
+	if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= r->off) {
+		r->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (r->map == MAP_FAILED)
+			r->map = NULL;
+		else
+			r->maplen = st.st_size;
+	}
+	return r;
+}
+
+void close_seg_reader(struct seg_reader *r)
+{
+	if (r->map)
+		munmap((void *)r->map, r->maplen);
+	free(r->chr);
+	free(r->line);
+	free(r->name);
+	free(r);
+}
+
+off_t seg_tell(struct seg_reader *r)
+{
+	return r->off;
+}
+
+void seg_seek(struct seg_reader *r, off_t off)
+{
+	if (r->map == NULL && fseeko(r->fp, off, SEEK_SET) != 0)
+		fatalf("cannot read %s", r->name);
+	r->off = off;
+}
+
+// the next n bytes of a binary stream, NULL at its end
+static const void *take(struct seg_reader *r, size_t n, void *buf)
+{
+	const void *p;
+	size_t got;
+
+	if (r->map != NULL) {
+		if ((size_t)r->off + n > r->maplen) {
+			if ((size_t)r->off != r->maplen)
+				fatalf("%s: truncated", r->name);
+			return NULL;
+		}
+		p = r->map + r->off;
+	} else {
+		if ((got = fread(buf, 1, n, r->fp)) != n) {
+			if (got != 0)
+				fatalf("%s: truncated", r->name);
+			return NULL;
+		}
+		p = buf;
+	}
+	r->off += n;
+	return p;
+}
+
+static const char *id_chr(struct seg_reader *r, int32_t id)
+{
+	if (id < 0 || id >= r->nchr || r->chr[id] == NULL)
+		fatalf("%s: chromosome %d has no name", r->name, id);
+	return r->chr[id];
+}
+
+static int read_binary(struct seg_reader *r, struct seg_line *s)
+{
+	const struct sg_rec *p;
+	const struct sg_gap *g;
+	struct sg_rec rec;
+	struct sg_gap gap;
+	char buf[1024];
+	const char *name;
+	int id, len;
+
+	while ((p = take(r, sizeof(rec), &rec)) != NULL && p->type == 'n') {
+		id = p->fchr;
+		len = p->level;
+		if (len <= 0 || len + 4 > (int)sizeof(buf) || id < 0)
+			fatalf("%s: bad chromosome name", r->name);
+		if ((name = take(r, (len + 3) / 4 * 4, buf)) == NULL)
+			fatalf("%s: truncated", r->name);
+		if (id >= r->nchr) {
+			r->chr = ckrealloc(r->chr, (id + 256) * sizeof(char *));
+			memset(r->chr + r->nchr, 0, (id + 256 - r->nchr) * sizeof(char *));
+			r->nchr = id + 256;
+		}
+		memmove(buf, name, len);
+		buf[len] = '\0';
+		r->chr[id] = intern_chr(buf);
+	}
+	if (p == NULL)
+		return 0;
+	s->type = (p->type == 'f') ? 's' : p->type;
+	s->orient = p->orient;
+	s->level = p->level;
+	s->fchr = id_chr(r, p->fchr);
+	s->schr = id_chr(r, p->schr);
+	s->fbeg = p->fbeg;
+	s->fend = p->fend;
+	s->sbeg = p->sbeg;
+	s->send = p->send;
+	s->cid = p->cid;
+	s->gchr = NULL;
+	if (p->type != 'f')
+		return 1;
+	s->gorient = p->gorient;
+	if ((g = take(r, sizeof(gap), &gap)) == NULL)
+		fatalf("%s: truncated", r->name);
+	s->gchr = id_chr(r, g->gchr);
+	s->gfbeg = g->gfbeg;
+	s->gfend = g->gfend;
+	s->gsbeg = g->gsbeg;
+	s->gsend = g->gsend;
+	return 1;
+}
+
+/* a line of raw.segs, as getSegments parsed them: a fill of level 0 is
+ * read up to its chain id, one below with the gap it fills or [NP] */
+static void parse_raw(struct seg_reader *r, const char *line, struct seg_line *s)
+{
+	char fchr[256], schr[256], gchr[256];
+	int n = 0;
+
+	if (sscanf(line, "%d %c", &s->level, &s->type) != 2)
+		fatalf("cannot parse: %s", line);
+	s->gchr = NULL;
+	s->cid = 0;
+	if (s->type == 'g') {
+		if (sscanf(line, "%*d g %*[^.].%255[^:]:%d-%d %*[^.].%255[^:]:%d-%d %c",
+				fchr, &s->fbeg, &s->fend, schr, &s->sbeg, &s->send, &s->orient) != 7)
+			fatalf("cannot parse: %s", line);
+	} else if (s->type != 's' || sscanf(line, "%*d s %*[^.].%255[^:]:%d-%d %*[^.].%255[^:]:%d-%d %c %d%n",
+				fchr, &s->fbeg, &s->fend, schr, &s->sbeg, &s->send, &s->orient, &s->cid, &n) != 8)
+		fatalf("cannot parse: %s", line);
+	else if (s->level != 0) {
+		line += n;
+		while (*line == ' ')
+			line++;
+		if (strncmp(line, "[NP]", 4) != 0) {
+			if (sscanf(line, "[%d %d %255s %d %d %c]", &s->gfbeg, &s->gfend, gchr,
+					&s->gsbeg, &s->gsend, &s->gorient) != 6)
+				fatalf("cannot parse: %s", line);
+			s->gchr = intern_chr(gchr);
+		}
+	}
+	s->fchr = intern_chr(fchr);
+	s->schr = intern_chr(schr);
+	(void)r;
+}
+
+// a line of processed.segs: "spc1.chr1:100-200 spc2.chr5:300-400 + 17"
+static void parse_processed(struct seg_reader *r, const char *line, struct seg_line *s)
+{
+	char fchr[256], schr[256];
+
+	if (sscanf(line, "%*[^.].%255[^:]:%d-%d %*[^.].%255[^:]:%d-%d %c %d",
+			fchr, &s->fbeg, &s->fend, schr, &s->sbeg, &s->send, &s->orient, &s->cid) != 8)
+		fatalf("%s: cannot parse\n %s\n", r->name, line);
+	s->type = 's';
+	s->level = 0;
+	s->gchr = NULL;
+	s->fchr = intern_chr(fchr);
+	s->schr = intern_chr(schr);
+}
+
+int read_seg_line(struct seg_reader *r, struct seg_line *s)
+{
+	ssize_t n;
+
+	if (r->binary)
+		return read_binary(r, s);
+	while ((n = getline(&r->line, &r->cap, r->fp)) > 0) {
+		r->off += n;
+		if (r->kind == SEGS_PROCESSED && r->line[0] == '#')
+			continue;
+		if (r->kind == SEGS_RAW)
+			parse_raw(r, r->line, s);
+		else
+			parse_processed(r, r->line, s);
+		return 1;
+	}
+	return 0;
+}
+
+int is_seg_file(const char *fname)
+{
+	char magic[sizeof(Magic)];
+	FILE *fp;
+	int yes;
+
+	if ((fp = fopen(fname, "r")) == NULL)
+		return 0;
+	yes = fread(magic, 1, sizeof(magic), fp) == sizeof(magic)
+		&& memcmp(magic, Magic, sizeof(Magic)) == 0;
+	fclose(fp);
+	return yes;
+}
+
+void dump_seg_stream(FILE *fp, const char *name, FILE *out)
+{
+	struct seg_header h;
+	struct seg_reader *r;
+	struct seg_writer *w;
+	struct seg_line s;
+
+	if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, Magic, sizeof(Magic)) != 0)
+		fatalf("%s is not a binary segment stream", name);
+	if (h.rs < 0 || h.rs >= Spe->spesz || h.ss < 0 || h.ss >= Spe->spesz)
+		fatalf("%s is not of the species of the config file", name);
+	rewind(fp);
+	r = open_seg_reader(fp, h.kind, name);
+	w = open_seg_writer(out, h.kind, h.rs, h.ss, 0);
+	while (read_seg_line(r, &s))
+		write_seg_line(w, &s);
+	close_seg_writer(w);
+	close_seg_reader(r);
+}
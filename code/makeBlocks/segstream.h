@@ -0,0 +1,82 @@
+/* **************************************************************
+ * The segment streams of a species passed from readNets to
+ * getSegments (raw.segs) and from getSegments to partitionGenomes
+ * (processed.segs). A stream is written either as text lines
+ *
+ *   raw.segs        level s spc1.chr1:b-e spc2.chr5:b-e o cid [gap]
+ *                   level g spc1.chr1:b-e spc2.chr5:b-e o
+ *   processed.segs  spc1.chr1:b-e spc2.chr5:b-e o cid
+ *
+ * or in a binary form read back without parsing:
+ *
+ *   header (magic "\x89DSCHSG\n", the kind, the reference and species)
+ *   records of 4-byte fields: a fill, a nested fill and the gap it
+ *   fills, a gap, or the name of a chromosome id before its first use
+ *
+ * The ids are numbered by the stream in the order the names come, so
+ * that the same segments make the same bytes whatever the threads did
+ * to chrtab.h. A reader tells the two forms apart by the first byte,
+ * so it reads either from a pipe too; a binary stream in a plain file
+ * is read through mmap. dumpBlocks prints a binary stream as its text.
+ * **************************************************************/
+
+#ifndef _SEGSTREAM_H_
+#define _SEGSTREAM_H_
+
+#include <sys/types.h>
+#include "util.h"
+
+enum seg_kind {
+	SEGS_RAW = 0,		// readNets
+	SEGS_PROCESSED		// getSegments
+};
+
+// a line of a stream; chromosomes are interned (chrtab.h)
+struct seg_line {
+	char type;			// 's' a fill, 'g' a gap
+	char orient;
+	int level;			// in the net, 0 in processed.segs
+	const char *fchr, *schr;
+	int fbeg, fend, sbeg, send, cid;
+	// the gap a fill below level 0 fills, gchr NULL for none ([NP])
+	const char *gchr;
+	int gfbeg, gfend, gsbeg, gsend;
+	char gorient;
+};
+
+// the streams readNets and getSegments write are binary, text with
+// their -text (and that of makeBlocks) to look at
+extern int Binary_segs;
+
+// the name of a stream in the segment cache, by its kind and form
+const char *seg_cache_kind(enum seg_kind kind, int binary);
+
+struct seg_writer;
+
+/* starts a stream on fp of the segments of species ss against the
+ * reference rs, with its header if binary */
+struct seg_writer *open_seg_writer(FILE *fp, enum seg_kind kind, int rs, int ss, int binary);
+void write_seg_line(struct seg_writer *w, const struct seg_line *s);
+// frees the writer; the stream stays open
+void close_seg_writer(struct seg_writer *w);
+
+struct seg_reader;
+
+/* reads the segments of fp from where it is, text of the kind or
+ * binary; name is for messages. The stream is not closed with the
+ * reader */
+struct seg_reader *open_seg_reader(FILE *fp, enum seg_kind kind, const char *name);
+// the next segment, 0 at the end
+int read_seg_line(struct seg_reader *r, struct seg_line *s);
+// where the next segment starts, to read it again from there with seg_seek()
+off_t seg_tell(struct seg_reader *r);
+void seg_seek(struct seg_reader *r, off_t off);
+void close_seg_reader(struct seg_reader *r);
+
+// whether fname holds a binary segment stream
+int is_seg_file(const char *fname);
+
+// prints a binary stream of fp as its text to out
+void dump_seg_stream(FILE *fp, const char *name, FILE *out);
+
+#endif
@@ -1,34 +1,40 @@
+#include <math.h>
 #include "util.h"
 #include "species.h"
+#include "blockfile.h"
+#include "trace.h"
 
-int Spesz = 0;
-int Spetag[MAXSPE];
-int Chrassmz = 0;
-int Spechrassm[MAXSPE];
-char Spename[MAXSPE][100] = {"\0"};
-char Treestr[500] = "\0";
-char Treestr2[500] = "\0";
-char Netdir[500] = "\0";
-char Chaindir[500] = "\0";
-int MINLEN = 0;
-int HSACHR = 0;
-
-int spe_idx(char *sname) {
+static struct spe_config Mainconfig;
+__thread struct spe_config *Spe = &Mainconfig;
+
+struct spe_config *copy_spe_config(const struct spe_config *c) {
+	struct spe_config *copy = ckalloc(sizeof(struct spe_config));
+
+	*copy = *c;
+	memset(copy->chains, 0, sizeof(copy->chains));
+	return copy;
+}
+
+void use_spe_config(struct spe_config *c) {
+	Spe = (c != NULL) ? c : &Mainconfig;
+}
+
+int spe_idx(const char *sname) {
 	int i;
-	for (i = 0; i < Spesz; i++)
-		if (same_string(Spename[i], sname))
+	for (i = 0; i < Spe->spesz; i++)
+		if (same_string(Spe->spename[i], sname))
 			break;
-	if (i == Spesz)
+	if (i == Spe->spesz)
 		fatalf("unkonwn species %s", sname);
 	return i;
 }
 
 int ref_spe_idx() {
 	int i;
-	for (i = 0; i < Spesz; i++)
-		if (Spetag[i] == 0)
+	for (i = 0; i < Spe->spesz; i++)
+		if (Spe->spetag[i] == 0)
 			break;
-	if (i == Spesz)
+	if (i == Spe->spesz)
 		fatal("ref species not specified");
 	return i;
 }
@@ -36,14 +42,33 @@ int ref_spe_idx() {
 // JK
 int des_spe_idx() {
 	int i;
-	for (i = 0; i < Spesz; i++)
-		if (Spetag[i] == 1)
+	for (i = 0; i < Spe->spesz; i++)
+		if (Spe->spetag[i] == 1)
 			break;
-	if (i == Spesz)
+	if (i == Spe->spesz)
 		fatal("des species not specified");
 	return i;
 }
 
+static bool Only[MAXSPE];
+static int Limited = 0;
+
+void set_only_species(const char *list) {
+	char buf[500], *tok;
+
+	if (strlen(list) >= sizeof(buf))
+		fatalf("too long a species list: %s", list);
+	strcpy(buf, list);
+	memset(Only, 0, sizeof(Only));
+	for (tok = strtok(buf, ","); tok; tok = strtok(NULL, ","))
+		Only[spe_idx(tok)] = 1;
+	Limited = 1;
+}
+
+int only_species(int ss) {
+	return !Limited || Only[ss];
+}
+
 void get_spename(char *configfile) {
 	FILE *fp;
 	char buf[500], sn[20];
@@ -61,22 +86,22 @@ void get_spename(char *configfile) {
 					break;
 				if (sscanf(buf, "%s %d %d", sn, &tag, &chrassm) != 3)
 					fatalf("cannot parse species %s", buf);
-				strcpy(Spename[Spesz], sn);
-				Spetag[Spesz] = tag;
+				strcpy(Spe->spename[Spe->spesz], sn);
+				Spe->spetag[Spe->spesz] = tag;
 
-				Spechrassm[Spesz] = chrassm;
-				if (chrassm > Chrassmz) Chrassmz = chrassm;
-				++Spesz;
+				Spe->spechrassm[Spe->spesz] = chrassm;
+				if (chrassm > Spe->chrassmz) Spe->chrassmz = chrassm;
+				++Spe->spesz;
 			}
 		}
 		if (die == 1)
 			break;
 	}
 	fclose(fp);
-	if (Spesz > MAXSPE)
-		fatalf("MAXSPE %d too small (%d)", MAXSPE, Spesz);
-	for (i = r = 0; i < Spesz; i++)
-		if (Spetag[i] == 0)
+	if (Spe->spesz > MAXSPE)
+		fatalf("MAXSPE %d too small (%d)", MAXSPE, Spe->spesz);
+	for (i = r = 0; i < Spe->spesz; i++)
+		if (Spe->spetag[i] == 0)
 			++r;
 	if (r == 0)
 		fatal("ref species not specified");
@@ -91,13 +116,13 @@ void get_treestr(char *configfile) {
 	fp = ckopen(configfile, "r");
 	while(fgets(buf, 500, fp)) {
 		if (buf[0] == '>' && strstr(buf, "tree") != NULL) {
-			if (fgets(buf, 500, fp) && sscanf(buf, "%s", Treestr) != 1)
+			if (fgets(buf, 500, fp) && sscanf(buf, "%s", Spe->treestr) != 1)
 				fatalf("missing tree string in config file.");
 			break;
 		}
 	}
 	fclose(fp);
-	if (Treestr[0] == '\0')
+	if (Spe->treestr[0] == '\0')
 		fatalf("missing tree string in config file.");
 }
 
@@ -108,13 +133,13 @@ void get_treestr2(char *configfile) {
 	fp = ckopen(configfile, "r");
 	while(fgets(buf, 500, fp)) {
 		if (buf[0] == '>' && strstr(buf, "tree2") != NULL) {
-			if (fgets(buf, 500, fp) && sscanf(buf, "%s", Treestr2) != 1)
+			if (fgets(buf, 500, fp) && sscanf(buf, "%s", Spe->treestr2) != 1)
 				fatalf("missing tree string in config file.");
 			break;
 		}
 	}
 	fclose(fp);
-	if (Treestr2[0] == '\0')
+	if (Spe->treestr2[0] == '\0')
 		fatalf("missing tree string in config file.");
 }
 
@@ -125,16 +150,32 @@ void get_netdir(char *configfile) {
 	fp = ckopen(configfile, "r");
 	while(fgets(buf, 500, fp)) {
 		if (buf[0] == '>' && strstr(buf, "netdir") != NULL) {
-			if (fgets(buf, 500, fp) && sscanf(buf, "%s", Netdir) != 1)
+			if (fgets(buf, 500, fp) && sscanf(buf, "%s", Spe->netdir) != 1)
 				fatalf("missing netdir string in config file.");
 			break;
 		}
 	}
 	fclose(fp);
-	if (Netdir[0] == '\0')
+	get_maf(configfile);
+	if (Spe->netdir[0] == '\0' && Spe->maf[0] == '\0')
 		fatalf("missing netdir string in config file.");
 }
 
+void get_maf(char *configfile) {
+	FILE *fp;
+	char buf[500];
+
+	fp = ckopen(configfile, "r");
+	while(fgets(buf, 500, fp)) {
+		if (buf[0] == '>' && strncmp(buf + 1, "maf", 3) == 0 && isspace((unsigned char)buf[4])) {
+			if (fgets(buf, 500, fp) && sscanf(buf, "%499s", Spe->maf) != 1)
+				fatalf("missing maf string in config file.");
+			break;
+		}
+	}
+	fclose(fp);
+}
+
 void get_minlen(char *configfile) {
 	FILE *fp;
 	char buf[500];
@@ -142,13 +183,13 @@ void get_minlen(char *configfile) {
 	fp = ckopen(configfile, "r");
 	while(fgets(buf, 500, fp)) {
 		if (buf[0] == '>' && strstr(buf, "resolution") != NULL) {
-			if (fgets(buf, 500, fp) && sscanf(buf, "%d", &MINLEN) != 1)
+			if (fgets(buf, 500, fp) && sscanf(buf, "%d", &Spe->minlen) != 1)
 				fatalf("missing resolution string in config file.");
 			break;
 		}
 	}
 	fclose(fp);
-	if (MINLEN == 0)
+	if (Spe->minlen == 0)
 		fatalf("missing resolution string in config file.");
 }
 
@@ -159,13 +200,13 @@ void get_numchr(char *configfile) {
 	fp = ckopen(configfile, "r");
 	while(fgets(buf, 500, fp)) {
 		if (buf[0] == '>' && strstr(buf, "numchr") != NULL) {
-			if (fgets(buf, 500, fp) && sscanf(buf, "%d", &HSACHR) != 1)
+			if (fgets(buf, 500, fp) && sscanf(buf, "%d", &Spe->hsachr) != 1)
 				fatalf("missing numchr string in config file.");
 			break;
 		}
 	}
 	fclose(fp);
-	if (HSACHR == 0)
+	if (Spe->hsachr == 0)
 		fatalf("missing numchr string in config file.");
 }
 
@@ -178,16 +219,118 @@ void get_chaindir(char *configfile) {
 		if (buf[0] == '#' || buf[0] == '\n')
 			continue;
 		if (buf[0] == '>' && strstr(buf, "chaindir") != NULL) {
-			if (fgets(buf, 500, fp) && sscanf(buf, "%s", Chaindir) != 1)
+			if (fgets(buf, 500, fp) && sscanf(buf, "%s", Spe->chaindir) != 1)
 				fatalf("missing chaindir string in config file.");
 			break;
 		}
 	}
 	fclose(fp);
-	if (Chaindir[0] == '\0')
+	if (Spe->chaindir[0] == '\0')
 		fatalf("missing chaindir string in config file.");
 }
 
+/* the optional >subset: reference chromosomes (chr1,chr2) or a fraction
+ * of them; and >skipshort, "yes" to skip the reference chromosomes
+ * shorter than the resolution by the sizes of their net lines, or a
+ * chrom.sizes file to leave them out by before any net is opened */
+void get_subset(char *configfile) {
+	FILE *fp;
+	char buf[500];
+
+	fp = ckopen(configfile, "r");
+	while(fgets(buf, 500, fp)) {
+		if (buf[0] == '>' && strstr(buf, "subset") != NULL) {
+			if (fgets(buf, 500, fp) && sscanf(buf, "%499s", Spe->subset) != 1)
+				fatalf("missing subset string in config file.");
+		}
+		else if (buf[0] == '>' && strstr(buf, "skipshort") != NULL) {
+			if (fgets(buf, 500, fp) && sscanf(buf, "%499s", Spe->skipshort) != 1)
+				fatalf("missing skipshort string in config file.");
+		}
+	}
+	fclose(fp);
+}
+
+static int cmp_name(const void *a, const void *b) {
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/* a block on a reference chromosome shorter than the resolution is
+ * dropped by makeOrthologyBlocks in any case */
+int short_chrom(int size) {
+	return Spe->skipshort[0] != '\0' && size >= 0 && size < Spe->minlen;
+}
+
+// drops the chromosomes the chrom.sizes of >skipshort has too short
+static int skip_short_chroms(const char **names, int n) {
+	FILE *fp;
+	char buf[500], name[500];
+	int size, i, m = 0, nshort = 0, max = 0;
+	char **shorts = NULL;
+
+	if (Spe->skipshort[0] == '\0' || same_string(Spe->skipshort, "yes"))
+		return n;
+	fp = ckopen(Spe->skipshort, "r");
+	while (fgets(buf, 500, fp)) {
+		if (buf[0] == '#' || sscanf(buf, "%499s %d", name, &size) != 2 || !short_chrom(size))
+			continue;
+		if (nshort == max) {
+			max = max ? 2 * max : 1024;
+			shorts = ckrealloc(shorts, max * sizeof(char *));
+		}
+		shorts[nshort++] = copy_string(name);
+	}
+	fclose(fp);
+	if (nshort > 0)
+		qsort(shorts, nshort, sizeof(char *), cmp_name);
+	for (i = 0; i < n; i++)
+		if (nshort == 0 || bsearch(&names[i], shorts, nshort, sizeof(char *), cmp_name) == NULL)
+			names[m++] = names[i];
+	for (i = 0; i < nshort; i++)
+		free(shorts[i]);
+	free(shorts);
+	return m;
+}
+
+/* keep the chromosomes of the subset among n names, in their order. A
+ * fraction keeps that share of them (one at least), the first by name
+ * so that every tool and run takes the same ones whatever the order a
+ * directory lists them in. Returns how many are left. */
+int subset_chroms(const char **names, int n) {
+	char list[500], *tok, *end, *last = NULL;
+	const char **sorted;
+	double f;
+	int i, k, m = 0;
+
+	if (Spe->subset[0] == '\0')
+		return skip_short_chroms(names, n);
+	f = strtod(Spe->subset, &end);
+	if (*end == '\0' && f > 0 && f <= 1) {
+		sorted = ckalloc((n + 1) * sizeof(char *));
+		memcpy(sorted, names, n * sizeof(char *));
+		qsort(sorted, n, sizeof(char *), cmp_name);
+		k = (int)ceil(f * n);
+		last = (k > 0) ? copy_string(sorted[k-1]) : NULL;
+		free(sorted);
+		for (i = 0; i < n; i++)
+			if (last != NULL && strcmp(names[i], last) <= 0)
+				names[m++] = names[i];
+		free(last);
+		return skip_short_chroms(names, m);
+	}
+	for (i = 0; i < n; i++) {
+		strcpy(list, Spe->subset);
+		for (tok = strtok(list, ","); tok; tok = strtok(NULL, ","))
+			if (same_string(tok, names[i]))
+				break;
+		if (tok != NULL)
+			names[m++] = names[i];
+	}
+	if (m == 0)
+		fatalf("no chromosome of the subset %s", Spe->subset);
+	return skip_short_chroms(names, m);
+}
+
 void free_seg_list(struct seg_list *sg) {
 	struct seg_list *p, *q;
 	p = sg;
@@ -209,7 +352,7 @@ void free_block_list(struct block_list *blk) {
 	p = blk;
 	for (;;) {
 		q = p->next;
-		for (i = 0; i < Spesz; i++)
+		for (i = 0; i < Spe->spesz; i++)
 			if (p->speseg[i] != NULL)
 				free_seg_list(p->speseg[i]);
 		free(p);
@@ -223,23 +366,42 @@ void free_block_list(struct block_list *blk) {
 struct block_list *allocate_newblock() {
 	struct block_list *nb;
 	int i;
-	nb = (struct block_list *)ckalloc(sizeof(struct block_list));
+	nb = MEM_AS(block_list, (struct block_list *)ckalloc(sizeof(struct block_list) + Spe->spesz * sizeof(struct seg_list *)));
 	nb->next = NULL;
-	for (i = 0; i < Spesz; i++)
+	for (i = 0; i < Spe->spesz; i++)
 		nb->speseg[i] = NULL;
 	nb->isdup = nb->id = 0;
 	return nb;
 }
 
+struct block_list **index_blocks(struct block_list *head, int *maxid) {
+	struct block_list *blk, **index;
+	int n = 0;
+	for (blk = head; blk != NULL; blk = blk->next)
+		n = MAX(n, blk->id);
+	index = (struct block_list **)ckallocz((n + 1) * sizeof(struct block_list *));
+	for (blk = head; blk != NULL; blk = blk->next)
+		if (blk->id > 0 && index[blk->id] == NULL)
+			index[blk->id] = blk;
+	*maxid = n;
+	return index;
+}
+
 struct block_list *get_block_list(char *fname) {
 	FILE *fp;
-	char buf[5000], spe[50];
+	char buf[5000], spe[50], chr[50];
 	int idx, num, st, mid, sid, cid, cnum, i, j;
 	char *pt;
 	struct block_list *blist, *nb, *last;
-	struct seg_list *p, *q;
+	struct seg_list *p, *tail[MAXSPE];
 	
 	blist = nb = last = NULL; 
+	if (is_block_file(fname)) {
+		blist = read_block_file(fname, NULL);
+		assign_states(blist);
+		assign_orders(blist);
+		return blist;
+	}
 	fp = ckopen(fname, "r");
 	while(fgets(buf, 5000, fp)) {
 		if (buf[0] == '\n' || buf[0] == '#')
@@ -256,13 +418,15 @@ struct block_list *get_block_list(char *fname) {
 				nb->id = num;
 			continue;
 		}
-		p = (struct seg_list *)ckalloc(sizeof(struct seg_list));
+		p = MEM_AS(seg_list, (struct seg_list *)ckalloc(sizeof(struct seg_list)));
+		p->chid = 0;
 		p->chnum = 0;
 		p->cidlist = NULL;
 		p->next = NULL;
 		if (sscanf(buf, "%[^.].%[^:]:%d-%d %c",
-					spe, p->chr, &(p->beg), &(p->end), &(p->orient)) != 5)
+					spe, chr, &(p->beg), &(p->end), &(p->orient)) != 5)
 			fatalf("%s", buf);
+		p->chr = intern_chr(chr);
 		if ((pt = strchr(buf, '[')) != NULL) {
 			if (sscanf(pt, "[%d]", &st) != 1)
 				fatalf("cannot parse: %s", buf);
@@ -306,11 +470,9 @@ struct block_list *get_block_list(char *fname) {
 		idx = spe_idx(spe);
 		if (nb->speseg[idx] == NULL)
 			nb->speseg[idx] = p;
-		else {
-			for (q = nb->speseg[idx]; q->next != NULL; q = q->next)
-					;
-			q->next = p;
-		}
+		else
+			tail[idx]->next = p;
+		tail[idx] = p;
 	}
 	fclose(fp);
 	assign_states(blist);
@@ -324,7 +486,7 @@ void assign_states(struct block_list *head) {
 	int i;
 	
 	for (blk = head; blk != NULL; blk = blk->next) {
-		for (i = 0; i < Spesz; i++) {
+		for (i = 0; i < Spe->spesz; i++) {
 			if (blk->speseg[i] != NULL) {
 				blk->speseg[i]->state = FIRST;
 				for (sg = blk->speseg[i]->next; sg != NULL && sg->next != NULL; sg = sg->next)
@@ -344,7 +506,7 @@ void assign_orders(struct block_list *head) {
 	int id, subid, i;
 	for (id = 0, blk = head; blk != NULL; blk = blk->next) {
 		blk->id = ++id;
-		for (i = 0; i < Spesz; i++) {
+		for (i = 0; i < Spe->spesz; i++) {
 			subid = 0;
 			for (sg = blk->speseg[i]; sg != NULL; sg = sg->next) {
 				sg->id = blk->id;
@@ -360,8 +522,8 @@ void merge_chlist(struct block_list *head) {
 	int buf[5000], j, prev, i, k;
 	
 	for (blk = head; blk != NULL; blk = blk->next) {
-		for (i = 0; i < Spesz; i++) {
-			if (Spetag[i] == 0)
+		for (i = 0; i < Spe->spesz; i++) {
+			if (Spe->spetag[i] == 0)
 				continue;
 			for (sg = blk->speseg[i]; sg != NULL; sg = sg->next) {
 				prev = j = 0;
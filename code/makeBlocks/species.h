@@ -5,8 +5,9 @@
 #ifndef _SPE_H_
 #define _SPE_H_
 
+#include "chrtab.h"
+
 #define MAXSPE		100		
-#define MAXCHR		50000	
 #define MAXORDER	900000	
 
 #define MINOVL		0.4
@@ -22,7 +23,7 @@ enum segstate {FIRST = 0, LAST, BOTH, MIDDLE};
 struct seg_list {
 	int id, beg, end, subid, chid, chnum;
 	int *cidlist;
-	char chr[50];
+	const char *chr;	// interned, so one name is one pointer
 	char orient;
 	enum segstate state;
 	struct seg_list *next;
@@ -31,35 +32,75 @@ struct seg_list {
 struct block_list {
 	int id, isdup;
 	int left, right;
-	struct seg_list *speseg[MAXSPE];
 	struct block_list *next;
+	struct seg_list *speseg[];	// Spesz entries
 };
 
-extern int Spesz;	
-extern char Spename[MAXSPE][100];	
-extern int Spetag[MAXSPE];	
-extern int Chrassmz;	 
-extern int Spechrassm[MAXSPE]; 
-extern char Treestr[500];	
-extern char Treestr2[500];
-extern char Netdir[500];	
-extern char Chaindir[500];	
-extern int MINLEN;
-extern int HSACHR;
+struct chain_store;
+
+/* what the get_* functions read from a config file, and the chains of
+ * base.c opened for it. Spe is the config of the calling thread: every
+ * thread starts with the one the get_* functions fill, and one can run
+ * the steps on a config of its own (estimateBpDist runs each species pair
+ * so) after use_spe_config(). The threads a step starts take the main
+ * one, but for those of partition_genomes(), which take the config of the
+ * thread that runs it. */
+struct spe_config {
+	int spesz;
+	char spename[MAXSPE][100];
+	int spetag[MAXSPE];
+	int chrassmz;
+	int spechrassm[MAXSPE];
+	char treestr[500];
+	char treestr2[500];
+	char netdir[500];
+	char chaindir[500];
+	char maf[500];		// the multiple alignment read instead of the nets, if any
+	char subset[500];
+	char skipshort[500];
+	int minlen;
+	int hsachr;
+	struct chain_store *chains[MAXSPE];
+};
+
+extern __thread struct spe_config *Spe;
+
+// a copy of the config with no chains open (partition_genomes() closes
+// those it opens), to free() when done
+struct spe_config *copy_spe_config(const struct spe_config *c);
+// c the config of the calling thread; NULL the main one again
+void use_spe_config(struct spe_config *c);
 
-int spe_idx(char *sname);	
+int spe_idx(const char *sname);	
 int ref_spe_idx();  
 int des_spe_idx();	
+/* limits readNets, getSegments and estimateBpDist to the species of a
+ * comma-separated list (-species), for a cluster job per species pair;
+ * the files of each are those of a run on all of them */
+void set_only_species(const char *list);
+// whether species ss of the config is done: all of them until set
+int only_species(int ss);
 void get_spename(char *configfile);	
 void get_treestr(char *configfile);	
 void get_treestr2(char *configfile);
 void get_chaindir(char *configfile);	
 void get_netdir(char *configfile);	
+// the optional >maf (mafsegs.h); get_netdir() reads it, and needs no
+// >netdir with it
+void get_maf(char *configfile);
 void get_minlen(char *configfile);	
 void get_numchr(char *configfile);	
+void get_subset(char *configfile);
+/* the chromosomes of >subset among n names, kept in place, but for those
+ * the >skipshort sizes make shorter than the resolution; how many */
+int subset_chroms(const char **names, int n);
+// whether a reference chromosome of this size is skipped by >skipshort
+int short_chrom(int size);
 
 struct block_list *get_block_list(char *block_file);
 struct block_list *allocate_newblock();
+// index[id] is the first block with that id, for ids 1..*maxid; NULL where none
+struct block_list **index_blocks(struct block_list *head, int *maxid);
 void assign_states(struct block_list *blk);
 void assign_orders(struct block_list *blk);
 void merge_chlist(struct block_list *blk);
@@ -6,34 +6,30 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include "util.h"
+#include "chrtab.h"
+#include "workpool.h"
+#include "splitout.h"
 
 /* -------------------------------------------------------------------------- */
 
-struct cBlock {
-	struct cBlock *next;
-	int size;
-	int dt;
-	int dq;
-};       
+/* the input is read CHUNK bytes at a time; the whole chains of a chunk are
+ * cut into a piece per thread, parsed and formatted on the threads, and
+ * written out in input order */
+#define CHUNK	(32 << 20)
 
-struct chain {
-	struct chain *next;
-	struct cBlock *blockList;
-	double score;
-	char *tName;
-	int tSize;
-	int tStart,tEnd;
-	char *qName;
-	int qSize;
-	char qStrand;
-	int qStart,qEnd;
-	int id;
-};                                                          
-
-struct fd_entry {
-	struct fd_entry *next;
-	char *chrom;
-	FILE *fd;
+/* a chain formatted in the text of its piece */
+struct chain_out {
+	const char *chrom;	/* interned */
+	off_t off, len;
+};
+
+struct piece {
+	const char *beg, *end;
+	char *text;
+	size_t textlen;
+	struct chain_out *out;
+	int nout, maxout;
 };
 
 /* -------------------------------------------------------------------------- */
@@ -41,26 +37,19 @@ struct fd_entry {
 /* program name */
 static char *prog = "splitChain";
 
-/* for line read in from chain file */
-static char line[LINE_MAX];
-static char tName[LINE_MAX];
-static char qName[LINE_MAX];
-
-/* file descriptor list */
-static struct fd_entry *fd_head = NULL;
-static struct fd_entry *fd_tail = NULL;
-
 /* command line options, defaults */
 static struct options {
 	char *in_file;
 	char *out_dir;
 	int out_dir_len;
 	char *suffix;
+	int threads;
 } opt = {
 	"/dev/stdin",
 	NULL,
 	0,
-	".chain"
+	".chain",
+	0
 };
 
 /* -------------------------------------------------------------------------- */
@@ -93,26 +82,8 @@ static FILE *Fopen(const char *filename, const char *mode) {
 	return(p);
 }
 
-/* fgets, check for errors */
-static char *Fgets(char *s, int n, FILE *stream) {
-	char *p;
-
-	if ((p = fgets(s, n, stream)) == NULL) {
-		if (feof(stream) != 0) {
-			return(NULL);
-		} else if (ferror(stream) != 0) {
-			unix_error("fgets failed");
-		} else {
-			fprintf(stderr, "%s: fgets failed really badly\n", prog);
-			exit(EXIT_FAILURE);
-		}
-	}
-
-	return(p);
-}
-
 /* malloc, checking for errors */
-void *Malloc(size_t size) {
+static void *Malloc(size_t size) {
 	void *p;
 
 	if ((p = malloc(size)) == NULL) {
@@ -123,7 +94,7 @@ void *Malloc(size_t size) {
 }
 
 /* fclose, checking for erros */
-void Fclose(FILE *stream) {
+static void Fclose(FILE *stream) {
 	if (fclose(stream) == EOF) {
 		unix_error("fclose failed");
 	}
@@ -134,10 +105,11 @@ void Fclose(FILE *stream) {
 /* print usage information */
 static void usage(int status) {
 	if (status == EXIT_SUCCESS) {
-		printf("Usage: %s [-h] [-i <input file>] -o <output dir>\n", prog);
+		printf("Usage: %s [-h] [-i <input file>] [-t <threads>] -o <output dir>\n", prog);
 		printf("  -h   help\n");
 		printf("  -i   combined chain file to split [defaults to stdin]\n");
 		printf("  -o   directory where the split chains will be placed\n");
+		printf("  -t   threads parsing the chains [defaults to DESCHRAMBLER_THREADS or all]\n");
 	} else {
 		fprintf(stderr, "%s: Try '%s -h' for usage information.\n", prog, prog);
 	}
@@ -151,7 +123,8 @@ static void parse_args(int argc, char **argv) {
 	extern int optopt;
 	int c;
 
-	while((c = getopt(argc, argv, ":hi:o:")) != -1) {
+	opt.threads = thread_arg(NULL);
+	while((c = getopt(argc, argv, ":hi:o:t:")) != -1) {
 		switch(c) {
 		case 'h':
 			usage(EXIT_SUCCESS);
@@ -163,6 +136,9 @@ static void parse_args(int argc, char **argv) {
 			opt.out_dir = Strdup((const char *) optarg);
 			opt.out_dir_len = (int) strlen(opt.out_dir);
 			break;
+		case 't':
+			opt.threads = thread_arg(optarg);
+			break;
 		case ':':
 			fprintf(stderr, "%s: Missing argument for -%c.\n", prog, (char) optopt);
 			usage(EXIT_FAILURE);
@@ -181,185 +157,157 @@ static void parse_args(int argc, char **argv) {
 
 /* -------------------------------------------------------------------------- */
 
-static FILE *get_descriptor(char *chrom) {
-	struct fd_entry *p, *new;
-	char *filename;
-	int filename_len;
+/* the chain ending at the end of the text */
+static void add_chain(struct piece *p, FILE *fp, const char *chrom, off_t off) {
+	struct chain_out *c;
 
-	/* find the matching entry */
-	for (p = fd_head; p != NULL; p = p->next) {
-		if (strcmp(p->chrom, chrom) == 0) {
-			break;
+	if (p->nout == p->maxout) {
+		p->maxout = p->maxout ? 2 * p->maxout : 1024;
+		if ((p->out = realloc(p->out, p->maxout * sizeof(struct chain_out))) == NULL) {
+			unix_error("realloc failed");
 		}
 	}
-
-	/* no match, need to add an entry */
-	if (p == NULL) {
-		/* create the new entry */
-		new = (struct fd_entry *) Malloc(sizeof(struct fd_entry));
-		new->next = NULL;
-		new->chrom = Strdup(chrom);
-
-		/* build the filename */
-		filename_len = opt.out_dir_len + (int) strlen(chrom) + (int) strlen(opt.suffix) + 2;
-		filename = (char *) Malloc (filename_len * sizeof(char));
-
-		strcpy(filename, opt.out_dir);
-		strcat(filename, "/");
-		strcat(filename, chrom);
-		strcat(filename, opt.suffix);
-
-		new->fd = Fopen(filename, "w");
-		free(filename);
-
-		/* add the fd entry */
-		if (fd_head == NULL) {
-			fd_head = new;
-		} else {
-			fd_tail->next = new;
-		}
-
-		fd_tail = new;
-		p = new;
-	}
-
-	return(p->fd);
+	c = &p->out[p->nout++];
+	c->chrom = chrom;
+	c->off = off;
+	c->len = ftello(fp) - off;
 }
 
-/* -------------------------------------------------------------------------- */
+/* parse the chains of a piece and print them to its text, as each line
+ * would be read: comments before a header line, then the data lines up to
+ * a blank line or the end */
+static void format_piece(struct piece *p) {
+	char line[LINE_MAX], tName[LINE_MAX], qName[LINE_MAX], qStrand[2];
+	const char *s, *e, *chrom = NULL;
+	int in_chain = 0, pending = 0, count, size, dt, dq, psize = 0, pdt = 0, pdq = 0;
+	int tSize, tStart, tEnd, qSize, qStart, qEnd, id;
+	double score;
+	size_t len;
+	off_t off = 0;
+	FILE *fp;
 
-/* print a chain */
-static void print_chain(struct chain *c) {
-	struct cBlock *p;
-	FILE *fd;
-
-	fd = get_descriptor(c->tName);
-
-	/* print out the header line */
-	fprintf(fd, "chain %.0f %s %d + %d %d %s %d %c %d %d %d\n",
-				c->score, c->tName, c->tSize, c->tStart,
-				c->tEnd, c->qName, c->qSize, c->qStrand,
-				c->qStart, c->qEnd, c->id);
-
-	/* print out the data lines */
-	for (p = c->blockList; p != NULL; p = p->next) {
-		if (p->next != NULL) {
-			fprintf(fd, "%d\t%d\t%d\n", p->size, p->dt, p->dq);
-		} else {
-			fprintf(fd, "%d\n", p->size);
-		}
+	if ((fp = open_memstream(&p->text, &p->textlen)) == NULL) {
+		unix_error("open_memstream failed");
 	}
-
-	fprintf(fd, "\n");
-}
-
-/* read in the blocks for the argument chain */
-static void read_blocks(struct chain *c, FILE *input) {
-	struct cBlock *new, *tail;
-	int count;
-
-	tail = c->blockList;
-
-	while (1) {
-		if (Fgets(line, LINE_MAX, input) == NULL) {
-			break;
+	for (s = p->beg; s < p->end; s = e) {
+		/* the next line, with its newline */
+		e = memchr(s, '\n', p->end - s);
+		e = (e == NULL) ? p->end : e + 1;
+		len = MIN((size_t) (e - s), sizeof(line) - 1);
+		memcpy(line, s, len);
+		line[len] = '\0';
+
+		if (! in_chain) {
+			if (line[0] == '#') {
+				continue;
+			}
+			if (sscanf(line, "chain %lf %s %d + %d %d %s %d %1[+-] %d %d %d", &score,
+					tName, &tSize, &tStart, &tEnd, qName, &qSize,
+					qStrand, &qStart, &qEnd, &id) != 11) {
+				fprintf(stderr, "%s: Can't parse the following header line:\n", prog);
+				fprintf(stderr, "%s\n", line);
+				exit(EXIT_FAILURE);
+			}
+			chrom = intern_chr(tName);
+			off = ftello(fp);
+			fprintf(fp, "chain %.0f %s %d + %d %d %s %d %c %d %d %d\n",
+						score, tName, tSize, tStart,
+						tEnd, qName, qSize, qStrand[0],
+						qStart, qEnd, id);
+			in_chain = 1;
+			pending = 0;
+			continue;
 		}
 
-		/* allocate a new block */
-		new = (struct cBlock *) Malloc(sizeof(struct cBlock));
-		new->next = NULL;
-
-		count = sscanf(line, "%d %d %d", &new->size, &new->dt, &new->dq);
-
+		count = sscanf(line, "%d %d %d", &size, &dt, &dq);
 		if (count != 1 && count != 3) {
 			if (line[0] == '\n') {
-				free(new);
-				break;
+				/* the last block has its size only */
+				if (pending) {
+					fprintf(fp, "%d\n", psize);
+				}
+				fprintf(fp, "\n");
+				add_chain(p, fp, chrom, off);
+				in_chain = 0;
+				continue;
 			} else {
 				fprintf(stderr, "%s: Can't parse the following data line:\n", prog);
 				fprintf(stderr, "%s\n", line);
 				exit(EXIT_FAILURE);
 			}
 		}
-
-		/* add the block to the list */
-		if (c->blockList == NULL) {
-			c->blockList = new;
-		} else {
-			tail->next = new;
+		if (pending) {
+			fprintf(fp, "%d\t%d\t%d\n", psize, pdt, pdq);
 		}
-		tail = new;
+		psize = size;
+		pdt = dt;
+		pdq = dq;
+		pending = 1;
 	}
-
-}
-
-/* read in the next chain */
-static struct chain *get_next_chain(FILE *input) {
-	struct chain *c;
-
-	/* skip comments in chain file */
-	line[0] = '#';
-	while (line[0] == '#') {
-		if (Fgets(line, LINE_MAX, input) == NULL) {
-			return(NULL);
+	if (in_chain) {
+		if (pending) {
+			fprintf(fp, "%d\n", psize);
 		}
+		fprintf(fp, "\n");
+		add_chain(p, fp, chrom, off);
 	}
-
-	/* allocate a new chain */
-	c = (struct chain *) Malloc(sizeof(struct chain));
-
-	/* read in the chain header line */
-	if (sscanf(line, "chain %lf %s %d + %d %d %s %d %[+-] %d %d %d", &c->score,
-			tName, &c->tSize, &c->tStart, &c->tEnd, qName, &c->qSize,
-			&c->qStrand, &c->qStart, &c->qEnd, &c->id) != 11) {
-		fprintf(stderr, "%s: Can't parse the following header line:\n", prog);
-		fprintf(stderr, "%s\n", line);
-		exit(EXIT_FAILURE);
+	if (fclose(fp) == EOF) {
+		unix_error("fclose failed");
 	}
-
-	/* copy the chromosome names */
-	c->tName = Strdup(tName);
-	c->qName = Strdup(qName);
-
-	/* initialize pointers */
-	c->next = NULL;
-	c->blockList = NULL;
-
-	/* read in the blocks */
-	read_blocks(c, input);
-
-	return(c);
 }
 
-/* free a chain */
-static void free_chain(struct chain **c) {
-	struct chain *p;
-	struct cBlock *q;
-
-	while(*c != NULL) {
-		p = (*c)->next;
-
-		free((*c)->tName);
-		free((*c)->qName);
-
-		/* free up the block list */
-		while((*c)->blockList != NULL) {
-			q = (*c)->blockList->next;
-
-			free((*c)->blockList);
+static void piece_job(int k, void *arg) {
+	format_piece(&((struct piece *) arg)[k]);
+}
 
-			(*c)->blockList = q;
+/* the end of the blank line from s on, or end */
+static const char *next_break(const char *s, const char *end) {
+	for (; s < end && (s = memchr(s, '\n', end - s)) != NULL; s++) {
+		if (s + 1 < end && s[1] == '\n') {
+			return(s + 2);
 		}
+	}
+	return(end);
+}
 
-		free(*c);
-		*c = p;
+/* split whole chains, [buf, buf + len), into the files */
+static void split_text(const char *buf, size_t len, struct split_out *so) {
+	struct piece *piece;
+	struct chain_out *c;
+	const char *s, *end = buf + len;
+	int n, k, i;
+
+	n = MAX(1, MIN(opt.threads, (int) (len / (1 << 20)) + 1));
+	piece = (struct piece *) Malloc(n * sizeof(struct piece));
+	memset(piece, 0, n * sizeof(struct piece));
+	for (k = 0, s = buf; k < n; k++) {
+		piece[k].beg = s;
+		s = (k == n - 1) ? end : next_break(MAX(s, buf + len / n * (k + 1)), end);
+		piece[k].end = s;
+	}
+	run_jobs(n, opt.threads, piece_job, piece);
+
+	for (k = 0; k < n; k++) {
+		for (i = 0; i < piece[k].nout; i++) {
+			c = &piece[k].out[i];
+			if (fwrite(piece[k].text + c->off, 1, c->len, split_file(so, c->chrom))
+					!= (size_t) c->len) {
+				unix_error("fwrite failed");
+			}
+		}
+		free(piece[k].text);
+		free(piece[k].out);
 	}
+	free(piece);
 }
 
 /* split a chain file */
 static void split_chain(void) {
 	FILE *input;
-	struct chain *c;
+	struct split_out *so;
+	char *buf;
+	size_t cap = CHUNK, have = 0, n, cut;
+	int eof = 0;
 
 	input = Fopen(opt.in_file, "r");
 
@@ -369,13 +317,42 @@ static void split_chain(void) {
 			unix_error("mkdir failed");
 		}
 	}
-
-	/* read and print each chain to the appropriate file */
-	while((c = get_next_chain(input)) != NULL) {
-		print_chain(c);
-		free_chain(&c);
+	so = open_split_out(opt.out_dir, opt.suffix);
+
+	/* the chains of each chunk up to its last blank line; the rest is kept
+	 * for the next */
+	buf = (char *) Malloc(cap);
+	while (! eof) {
+		n = fread(buf + have, 1, cap - have, input);
+		have += n;
+		if (n == 0) {
+			if (ferror(input)) {
+				unix_error("fread failed");
+			}
+			eof = 1;
+		} else if (have < cap) {
+			continue;
+		}
+		for (cut = have; cut > 1 && ! eof; cut--) {
+			if (buf[cut - 1] == '\n' && buf[cut - 2] == '\n') {
+				break;
+			}
+		}
+		if (! eof && cut <= 1) {
+			/* a chain longer than the buffer */
+			cap *= 2;
+			if ((buf = realloc(buf, cap)) == NULL) {
+				unix_error("realloc failed");
+			}
+			continue;
+		}
+		split_text(buf, cut, so);
+		memmove(buf, buf + cut, have - cut);
+		have -= cut;
 	}
+	free(buf);
 
+	close_split_out(so);
 	Fclose(input);
 }
 
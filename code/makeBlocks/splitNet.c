@@ -6,9 +6,14 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include "util.h"
+#include "splitout.h"
 
 /* -------------------------------------------------------------------------- */
 
+/* the input is read through a buffer of INBUF bytes */
+#define INBUF	(4 << 20)
+
 /* program name */
 static char *prog = "splitNet";
 
@@ -78,18 +83,8 @@ static char *Fgets(char *s, int n, FILE *stream) {
 }
 
 /* malloc, checking for errors */
-void *Malloc(size_t size) {
-	void *p;
-
-	if ((p = malloc(size)) == NULL) {
-		unix_error("malloc failed");
-	}
-
-	return(p);
-}
-
 /* fclose, checking for erros */
-void Fclose(FILE *stream) {
+static void Fclose(FILE *stream) {
 	if (fclose(stream) == EOF) {
 		unix_error("fclose failed");
 	}
@@ -147,15 +142,15 @@ static void parse_args(int argc, char **argv) {
 
 /* -------------------------------------------------------------------------- */
 
-/* split a net file */
+/* split a net file; the lines after each net line go to the file of its
+ * chromosome, appended to what is there if it came before */
 static void split_net(void) {
 	FILE *input;
-	FILE *output;
-	int filename_len;
-	char *filename;
-	int open = 0;
+	FILE *output = NULL;
+	struct split_out *so;
 
 	input = Fopen(opt.in_file, "r");
+	setvbuf(input, NULL, _IOFBF, INBUF);
 
 	/* make the output directory */
 	if ((mkdir(opt.out_dir, S_IRWXU | S_IRWXG | S_IRWXO) == -1)) {
@@ -163,11 +158,12 @@ static void split_net(void) {
 			unix_error("mkdir failed");
 		}
 	}
+	so = open_split_out(opt.out_dir, opt.suffix);
 
 	/* very simple splitter */
 	while (Fgets(line, LINE_MAX, input) != NULL) {
 		/* find the net line */
-		if (strstr(line, "net") == line) {
+		if (strncmp(line, "net", 3) == 0) {
 			/* get the chrom name */
 			if (sscanf(line, "net %s ", chrom) != 1) {
 				fprintf(stderr, "%s: Can't parse the following line:\n", prog);
@@ -175,38 +171,21 @@ static void split_net(void) {
 				exit(EXIT_FAILURE);
 			}
 
-			/* build the output filename */
-			filename_len = opt.out_dir_len + (int) strlen(chrom) + (int) strlen(opt.suffix) + 2;
-			filename = (char *) Malloc (filename_len * sizeof(char));
-			
-			strcpy(filename, opt.out_dir);
-			strcat(filename, "/");
-			strcat(filename, chrom);
-			strcat(filename, opt.suffix);
-
-			/* close if necessary */
-			if (open) {
-				Fclose(output);
-			}
-
-			output = Fopen(filename, "w");
-			free(filename);
-
-			fprintf(output, "%s", line);
-
-			open = 1;
+			output = split_file(so, chrom);
+			fputs(line, output);
 
 			continue;
 		}
 
-		if (! open) {
+		if (output == NULL) {
 			fprintf(stderr, "Out of synch (didn't find net line?)\n");
 			exit(EXIT_FAILURE);
 		}
 
-		fprintf(output, "%s", line);
+		fputs(line, output);
 	}
 
+	close_split_out(so);
 	Fclose(input);
 }
 
@@ -0,0 +1,122 @@
+#include <sys/resource.h>
+#include "util.h"
+#include "chrtab.h"
+#include "splitout.h"
+
+#define MAXOPEN	256
+#define OUTBUF	(64 * 1024)
+
+struct out_file {
+	const char *chrom;		// interned
+	FILE *fp;
+	struct out_file *newer, *older;	// the open files, by last use
+};
+
+struct split_out {
+	char *dir, *suffix;
+	struct out_file **file;	// by chr_id(); NULL until first written
+	int nfile, nopen, maxopen;
+	struct out_file *newest, *oldest;
+};
+
+static int max_open(void)
+{
+	struct rlimit rl;
+	int n = MAXOPEN;
+
+	// the input, the standard streams and a few to spare
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+			&& (long long)rl.rlim_cur - 16 < n)
+		n = (int)rl.rlim_cur - 16;
+	return MAX(n, 1);
+}
+
+struct split_out *open_split_out(const char *out_dir, const char *suffix)
+{
+	struct split_out *so = ckallocz(sizeof(struct split_out));
+
+	so->dir = copy_string(out_dir);
+	so->suffix = copy_string(suffix);
+	so->maxopen = max_open();
+	return so;
+}
+
+static void unlink_open(struct split_out *so, struct out_file *f)
+{
+	if (f->newer != NULL)
+		f->newer->older = f->older;
+	else
+		so->newest = f->older;
+	if (f->older != NULL)
+		f->older->newer = f->newer;
+	else
+		so->oldest = f->newer;
+	f->newer = f->older = NULL;
+}
+
+static void close_file(struct split_out *so, struct out_file *f)
+{
+	char path[2000];
+
+	unlink_open(so, f);
+	if (fclose(f->fp) != 0) {
+		snprintf(path, sizeof(path), "%s/%s%s", so->dir, f->chrom, so->suffix);
+		fatalf("cannot write %s: %s", path, strerror(errno));
+	}
+	f->fp = NULL;
+	so->nopen--;
+}
+
+/* split_file ------------------------------- the open stream of chrom's file */
+FILE *split_file(struct split_out *so, const char *chrom)
+{
+	struct out_file *f;
+	char path[2000];
+
+	chrom = intern_chr(chrom);
+	so->file = grow_chr_table(so->file, &so->nfile, sizeof(struct out_file *));
+	if ((f = so->file[chr_id(chrom)]) != NULL && f->fp != NULL) {
+		if (so->newest != f) {
+			unlink_open(so, f);
+			f->older = so->newest;
+			so->newest->newer = f;
+			so->newest = f;
+		}
+		return f->fp;
+	}
+	if (so->nopen == so->maxopen)
+		close_file(so, so->oldest);
+	snprintf(path, sizeof(path), "%s/%s%s", so->dir, chrom, so->suffix);
+	if (f == NULL) {
+		f = so->file[chr_id(chrom)] = ckallocz(sizeof(struct out_file));
+		f->chrom = chrom;
+		f->fp = fopen(path, "w");
+	}
+	else
+		f->fp = fopen(path, "a");
+	if (f->fp == NULL)
+		fatalf("cannot open %s: %s", path, strerror(errno));
+	setvbuf(f->fp, NULL, _IOFBF, OUTBUF);
+	f->older = so->newest;
+	if (so->newest != NULL)
+		so->newest->newer = f;
+	else
+		so->oldest = f;
+	so->newest = f;
+	so->nopen++;
+	return f->fp;
+}
+
+void close_split_out(struct split_out *so)
+{
+	int i;
+
+	while (so->oldest != NULL)
+		close_file(so, so->oldest);
+	for (i = 0; i < so->nfile; i++)
+		free(so->file[i]);
+	free(so->file);
+	free(so->dir);
+	free(so->suffix);
+	free(so);
+}
@@ -0,0 +1,26 @@
+/* **************************************************************
+ * The per-chromosome files splitChain and splitNet write, out_dir/
+ * <chrom><suffix>. A file is found by its chromosome's chr_id(), so
+ * each line costs no walk over the files open, and at most a few
+ * hundred are open at once (fewer if the descriptor limit is low):
+ * to open another, the one used longest ago is closed, and opened
+ * again later to append. A file is truncated the first time only,
+ * and written through a large buffer.
+ * **************************************************************/
+
+#ifndef _SPLITOUT_H_
+#define _SPLITOUT_H_
+
+#include "util.h"
+
+struct split_out;
+
+struct split_out *open_split_out(const char *out_dir, const char *suffix);
+
+// the stream of chrom's file, open
+FILE *split_file(struct split_out *so, const char *chrom);
+
+// closes every file
+void close_split_out(struct split_out *so);
+
+#endif
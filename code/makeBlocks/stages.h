@@ -0,0 +1,99 @@
+/* **************************************************************
+ * The steps of Makefile.SFs as functions, for makeBlocks to run
+ * in one process. Each tool's main() reads its arguments and files
+ * and calls its step; makeBlocks links the tools built with
+ * -DNO_MAIN and passes the data from one step to the next in memory.
+ *
+ * The config file is read by the caller (get_spename(), and
+ * get_netdir(), get_chaindir() and get_minlen() where the tool reads
+ * them). Per-species streams are indexed by species; a NULL stream
+ * stands for the species' file in the working directory, as the
+ * tools use. A list is returned as the tool writes it, and given to
+ * the next step as read back (see reread_block_list()). A step that
+ * returns a list makes it out of the one it is given; the others
+ * leave their list to the caller.
+ * **************************************************************/
+
+#ifndef _STAGES_H_
+#define _STAGES_H_
+
+#include "species.h"
+
+// readNets: raw.segs of net pieces longer than MINLEN; -1 without a net dir
+int read_nets(FILE **raw, int nthreads);
+// the same, calling done(ss, arg) as the raw.segs of each species is complete
+int read_nets_each(FILE **raw, int nthreads, void (*done)(int ss, void *arg), void *arg);
+/* set (readNets -fused), read_nets() writes the processed.segs that
+ * getSegments would make of its raw.segs instead, to the same streams */
+extern int Fused_segs;
+
+// getSegments: raw.segs broken into processed.segs
+void get_segments(FILE **raw, FILE **processed, int nthreads);
+void get_species_segments(FILE **raw, FILE **processed, int ss);
+
+// partitionGenomes: building blocks (BLOCKS_BUILDING)
+struct block_list *partition_genomes(FILE **processed, int nthreads);
+/* set (partitionGenomes -union), the chromosomes of partition_genomes() are
+ * cut again where no segment of any species spans, into pieces partitioned
+ * on threads of their own; the blocks are the same */
+extern int Union_pieces;
+/* set (partitionGenomes -approx), the breaks of the segments are
+ * interpolated along them instead of lifted through the chains, which are
+ * not read; 2 (-approxCheck) lifts through the chains and reports how far
+ * the interpolation is from them */
+extern int Approx_lift;
+/* set (partitionGenomes -checkpoint dir), the blocks of each shard are
+ * kept in the directory as it is done, and a run started again takes
+ * those it finds there instead of building them */
+extern const char *Shard_checkpoints;
+/* the same blocks written to w as each reference chromosome is done,
+ * holding the segments of as many chromosomes as there are threads.
+ * The chromosomes are cut in nshards runs of about as many segments,
+ * and those of run shard (from 0) only are written, numbered from 1;
+ * mergeBlocks puts the runs together again */
+struct block_writer;
+void partition_genomes_streamed(FILE **processed, int nthreads, int shard, int nshards,
+								struct block_writer *w);
+/* the same blocks with the species given one at a time, in species order,
+ * each added to the blocks as it comes */
+void begin_partition(void);
+void partition_species(int ss, FILE *processed, int nthreads);
+struct block_list *end_partition(int nthreads);
+/* the blocks of the descendents alone, once partition_species() has
+ * given them all, which end_partition() adds the outgroups to: they are
+ * the same for any outgroups. begin_outgroup_partition() starts a
+ * partition from such blocks instead, for partition_species() to give
+ * the outgroups only */
+struct block_list *descendent_blocks(void);
+void begin_outgroup_partition(struct block_list *blocks);
+
+// coarsenBlocks: the building blocks of a resolution res no finer than theirs,
+// the blocks their gaps alone keep apart merged (BLOCKS_BUILDING)
+struct block_list *coarsen_blocks(struct block_list *blocks, int res);
+
+// makeOrthologyBlocks(.pair): orthology blocks (BLOCKS_ORTHOLOGY)
+struct block_list *make_orthology_blocks(struct block_list *blocks, int nthreads);
+struct block_list *make_orthology_blocks_pair(struct block_list *blocks);
+
+// orthoBlocksToOrders: the block orders of the ingroup species
+void ortho_blocks_to_orders(struct block_list *blocks, FILE *out);
+
+// makeConservedSegments: conserved segments (BLOCKS_CONSERVED)
+struct block_list *make_conserved_segments(struct block_list *blocks, FILE *orders);
+
+// outgroupSegsToOrders: the segment orders of the outgroups
+void outgroup_segs_to_orders(struct block_list *blocks, FILE *out);
+
+// cleanOutgroupSegs: conserved segments with merged outgroup pieces (BLOCKS_CLEANED)
+struct block_list *clean_outgroup_segs(struct block_list *blocks, FILE *orders);
+
+// makeTargetCS: the conserved segments of the tree's '@' ancestor, numbered
+// again (BLOCKS_PLAIN)
+struct newick_tree;
+struct block_list *make_target_cs(struct block_list *blocks, struct newick_tree *tree);
+
+// createGenomeFile: the genome orders, and <species>.joins and Joins.db in the
+// working directory
+void create_genome_file(struct block_list *blocks, FILE *out);
+
+#endif
@@ -0,0 +1,258 @@
+/* **************************************************************
+ * Trace points and counters on the hot paths of the tools, compiled
+ * in by make TRACE=1 (-DDESCHRAMBLER_TRACE) and to nothing otherwise.
+ * TRACE_POINT() is a static probe of provider "deschrambler" where
+ * <sys/sdt.h> is installed (perf probe -x <tool> sdt_deschrambler:*,
+ * or usdt:<tool>:deschrambler:* in bpftrace); COUNT() adds to one of
+ * the counters that makeBlocks, inferAdjProb and deschrambler print
+ * on stderr at exit with -counters. The counters are shared by the
+ * threads and added to without locks (relaxed atomics).
+ *
+ * The memory the tools allocate is counted the same way, by category
+ * of structure: the ckalloc family of util.c, the kent allocators of
+ * inferAdjProb (needMem, AllocVar, ...) and operator new of
+ * deschrambler (its containers) add what they allocate to the
+ * category of the thread, which MEM_ENTER()/MEM_LEAVE() set around
+ * the code that builds a structure, and MEM_AS() around one call;
+ * the threads of run_jobs() take the category of the one that started
+ * them. The bytes are those allocated, with what is freed not taken
+ * back off, which for the structures built once and kept is what they
+ * hold.
+ * They are printed with -counters, at the phases of the tools on the
+ * file DESCHRAMBLER_MEMORY names ("-" for stderr), and there on an
+ * abnormal exit (a non-zero status or a fatal signal), for telling
+ * which structure grew when a run runs out of memory.
+ * **************************************************************/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdio.h>
+
+// the counters, with what each one counts
+#define TRACE_COUNTERS(X) \
+	X(chain_store_builds, "chain stores built from the chain files") \
+	X(chain_store_maps, "chain stores mapped from chain.store") \
+	X(chain_prefetches, "chromosomes of chain stores prefetched") \
+	X(chains_prefetched, "chains prefetched by id, the ones the segments use") \
+	X(big_blocks_read, "data blocks read from bigChain and bigLink files") \
+	X(big_chains_linked, "chains whose blocks were read from a bigLink") \
+	X(batch_files, "small files read ahead by a file batch") \
+	X(batch_misses, "files of a batch left to their readers") \
+	X(mapbase_calls, "mapbase() calls") \
+	X(mapbase_queries, "positions lifted by mapbase()") \
+	X(mapbase_reloads, "mapbase() calls that had to open a chain store") \
+	X(insert_position_calls, "find_insert_position() calls") \
+	X(insert_position_walked, "blocks find_insert_position() walked past") \
+	X(block_breaks, "blocks broken by break_block_position()") \
+	X(messy_piece_calls, "messy_piece() calls") \
+	X(messy_pieces, "segments messy_piece() found messy") \
+	X(ll_rows, "likelihood rows computed") \
+	X(ll_leaf_rows, "leaf rows applied by leafKernel()") \
+	X(ll_memo_hits, "likelihood rows found already computed") \
+	X(edges_tried, "edges insertEdge() tried on a chain") \
+	X(edges_used, "edges rejected as their ends were used") \
+	X(edges_cycle, "edges rejected as closing a cycle") \
+	X(edges_new, "edges starting a chain of their own") \
+	X(list_merges, "chains joined by mergeLists()") \
+	X(forced_components, "components laid out without the greedy pass") \
+	X(forced_edges, "edges of those components")
+
+#define TRACE_ENUM(name, what) TC_##name,
+enum trace_counter { TRACE_COUNTERS(TRACE_ENUM) TC_NUM };
+#undef TRACE_ENUM
+
+#ifdef DESCHRAMBLER_TRACE
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_SDT
+#endif
+#endif
+
+#ifdef TRACE_SDT
+#define TRACE_POINT(name) DTRACE_PROBE(deschrambler, name)
+#define TRACE_POINT1(name, a) DTRACE_PROBE1(deschrambler, name, a)
+#define TRACE_POINT2(name, a, b) DTRACE_PROBE2(deschrambler, name, a, b)
+#else
+#define TRACE_POINT(name) ((void)0)
+#define TRACE_POINT1(name, a) ((void)0)
+#define TRACE_POINT2(name, a, b) ((void)0)
+#endif
+
+// one array for the whole program, whichever of its files include this
+__attribute__((weak)) long Trace_counter[TC_NUM];
+
+#define COUNT(c, n) __atomic_fetch_add(&Trace_counter[TC_##c], (n), __ATOMIC_RELAXED)
+
+#else
+
+#define TRACE_POINT(name) ((void)0)
+#define TRACE_POINT1(name, a) ((void)0)
+#define TRACE_POINT2(name, a, b) ((void)0)
+#define COUNT(c, n) ((void)(n))
+
+#endif
+
+/* trace_counters ------------- print the counters that are not 0 on fp */
+static inline void trace_counters(FILE *fp) {
+#ifdef DESCHRAMBLER_TRACE
+#define TRACE_NAME(name, what) {#name, what},
+	static const struct {
+		const char *name, *what;
+	} c[TC_NUM] = { TRACE_COUNTERS(TRACE_NAME) };
+#undef TRACE_NAME
+	int i;
+
+	for (i = 0; i < TC_NUM; i++)
+		if (Trace_counter[i] != 0)
+			fprintf(fp, "counter %-24s %12ld  %s\n", c[i].name, Trace_counter[i], c[i].what);
+#else
+	fprintf(fp, "- no counters: built without TRACE=1\n");
+#endif
+}
+
+// the categories of memory, with what each one holds
+#define MEM_CATEGORIES(X) \
+	X(other, "not in any of the others") \
+	X(seg_list, "seg_lists and their segments") \
+	X(block_list, "block_lists and their blocks") \
+	X(chains, "chains of the chain stores") \
+	X(genomes, "genomes of inferAdjProb, read") \
+	X(leaf_sets, "per-leaf sets of adjacencies of inferAdjProb") \
+	X(matrix, "values and candidates of the columns of inferAdjProb") \
+	X(ll_memo, "likelihood memo of inferAdjProb") \
+	X(scores, "adjacency scores of deschrambler, read") \
+	X(apcf, "adjacencies and chains of deschrambler")
+
+#define MEM_ENUM(name, what) MC_##name,
+enum mem_category { MEM_CATEGORIES(MEM_ENUM) MC_NUM };
+#undef MEM_ENUM
+
+#ifdef DESCHRAMBLER_TRACE
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bytes and allocations of each category, and the category of a thread
+__attribute__((weak)) long Trace_mem[MC_NUM][2];
+__attribute__((weak)) __thread int Trace_mem_cat;
+
+static inline int mem_enter(int c) {
+	int old = Trace_mem_cat;
+
+	Trace_mem_cat = c;
+	return old;
+}
+
+#define MEM_ENTER(c) mem_enter(MC_##c)
+#define MEM_LEAVE(old) ((void)(Trace_mem_cat = (old)))
+#define MEM_CURRENT() Trace_mem_cat
+#define MEM_SWITCH(c) mem_enter(c)
+#define MEM_AS(c, e) __extension__ ({ int mem_old_ = MEM_ENTER(c); \
+	__typeof__(e) mem_v_ = (e); MEM_LEAVE(mem_old_); mem_v_; })
+#define MEM_COUNT(n) (__atomic_fetch_add(&Trace_mem[Trace_mem_cat][0], (long)(n), __ATOMIC_RELAXED), \
+	(void)__atomic_fetch_add(&Trace_mem[Trace_mem_cat][1], 1, __ATOMIC_RELAXED))
+
+#else
+
+#define MEM_ENTER(c) 0
+#define MEM_LEAVE(old) ((void)(old))
+#define MEM_CURRENT() 0
+#define MEM_SWITCH(c) ((void)(c), 0)
+#define MEM_AS(c, e) (e)
+#define MEM_COUNT(n) ((void)0)
+
+#endif
+
+/* trace_memory ---------- print the memory of each category on fp at when */
+static inline void trace_memory(FILE *fp, const char *when) {
+#ifdef DESCHRAMBLER_TRACE
+#define MEM_NAME(name, what) {#name, what},
+	static const struct {
+		const char *name, *what;
+	} c[MC_NUM] = { MEM_CATEGORIES(MEM_NAME) };
+#undef MEM_NAME
+	struct mallinfo2 mi = mallinfo2();
+	struct rusage ru;
+	int i;
+
+	getrusage(RUSAGE_SELF, &ru);
+	fprintf(fp, "memory %-24s %12.3f MB in use, %12.3f MB peak RSS\n", when,
+		(mi.uordblks + mi.hblkhd) / 1048576.0, ru.ru_maxrss / 1024.0);
+	for (i = 0; i < MC_NUM; i++)
+		if (Trace_mem[i][1] != 0)
+			fprintf(fp, "memory   %-22s %12.3f MB %12ld allocs  %s\n", c[i].name,
+				Trace_mem[i][0] / 1048576.0, Trace_mem[i][1], c[i].what);
+	fflush(fp);
+#else
+	(void)when;
+	fprintf(fp, "- no memory accounting: built without TRACE=1\n");
+#endif
+}
+
+#ifdef DESCHRAMBLER_TRACE
+
+/* trace_memory_report ------- the same on the file DESCHRAMBLER_MEMORY names */
+__attribute__((weak)) void trace_memory_report(const char *when) {
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	const char *f = getenv("DESCHRAMBLER_MEMORY");
+	FILE *fp;
+
+	if (f == NULL || *f == '\0')
+		return;
+	pthread_mutex_lock(&lock);
+	if (strcmp(f, "-") == 0)
+		trace_memory(stderr, when);
+	else if ((fp = fopen(f, "a")) != NULL) {
+		trace_memory(fp, when);
+		fclose(fp);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+__attribute__((weak)) void trace_memory_exit(int status, void *arg) {
+	(void)arg;
+	if (status != 0)
+		trace_memory_report("abnormal exit");
+}
+
+__attribute__((weak)) void trace_memory_signal(int sig) {
+	trace_memory_report(strsignal(sig));
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+// set up in each tool built with TRACE=1, once for all of its files
+__attribute__((weak, constructor)) void trace_memory_init(void) {
+	const char *f = getenv("DESCHRAMBLER_MEMORY");
+
+	if (f == NULL || *f == '\0')
+		return;
+	on_exit(trace_memory_exit, NULL);
+	signal(SIGSEGV, trace_memory_signal);
+	signal(SIGBUS, trace_memory_signal);
+	signal(SIGABRT, trace_memory_signal);
+	signal(SIGFPE, trace_memory_signal);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#else
+
+#define trace_memory_report(when) ((void)(when))
+
+#endif
+
+#endif
@@ -1,8 +1,16 @@
 static const char rcsid[]=
 "$Id: util.c,v 1.1.1.1 2005/08/09 19:13:37 rico Exp $";
 
+#define _GNU_SOURCE	/* pipe2 */
 #include <stdarg.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include "util.h"
+#include "remote.h"
+#include "trace.h"
 
 char *argv0;
 
@@ -44,8 +52,298 @@ FILE *ckopen(const char *name, const char *mode)
 	return fp;
 }
 
-/* ckalloc -------------------------------- allocate space; check for success */
-void *ckalloc(size_t amount)
+/* gzip and zstd input is read through a decompressor child, and output
+ * compressed with DESCHRAMBLER_ZSTD written through a compressor child;
+ * these are the open ones */
+struct unzip_pipe {
+	FILE *fp;
+	pid_t pid;
+	char *name;
+	bool fed;			// the input comes from a URL, through feeder
+	pthread_t feeder;
+	struct unzip_pipe *next;
+};
+static struct unzip_pipe *Unzips = NULL;
+static pthread_mutex_t UnzipLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* in_path ------------------------------------ is prog an executable on PATH */
+static bool in_path(const char *prog)
+{
+	char dir[1000], *path = getenv("PATH"), *p;
+	size_t n;
+
+	while (path && *path) {
+		p = strchr(path, ':');
+		n = p ? (size_t)(p - path) : strlen(path);
+		if (n > 0 && n + strlen(prog) + 2 < sizeof(dir)) {
+			sprintf(dir, "%.*s/%s", (int)n, path, prog);
+			if (access(dir, X_OK) == 0)
+				return 1;
+		}
+		path = p ? p+1 : NULL;
+	}
+	return 0;
+}
+
+/* unzip_argv ------------------- decompressor command line, ending with name */
+/* (with no name the decompressor reads its standard input) */
+/* GUNZIP in the environment sets the command (e.g. "pigz -dc"); otherwise
+ * bgzip decompresses BGZF with several threads, pigz or gzip are fallbacks.
+ * zstd input is read with UNZSTD, or zstd -dc */
+static void unzip_argv(char *cmd, char *argv[], int max, const char *name, bool zstd)
+{
+	char *env = getenv(zstd ? "UNZSTD" : "GUNZIP"), *t, *save;
+	int n = 0;
+
+	if (env && *env)
+		snprintf(cmd, 500, "%s", env);
+	else if (zstd)
+		snprintf(cmd, 500, "zstd -q -dc");
+	else if (in_path("bgzip")) {
+		snprintf(cmd, 500, "bgzip -@ %ld -dc", sysconf(_SC_NPROCESSORS_ONLN));
+	} else if (in_path("pigz"))
+		snprintf(cmd, 500, "pigz -dc");
+	else
+		snprintf(cmd, 500, "gzip -dc");
+	for (t = strtok_r(cmd, " \t", &save); t && n < max-2; t = strtok_r(NULL, " \t", &save))
+		argv[n++] = t;
+	if (name)
+		argv[n++] = (char *)name;
+	argv[n] = NULL;
+}
+
+/* a gzip file from a URL is written to the decompressor by a thread */
+struct feed {
+	FILE *in;
+	int fd;
+};
+
+static void *feed_unzip(void *arg)
+{
+	struct feed *f = arg;
+	char buf[65536];
+	size_t n, k;
+	ssize_t w;
+	sigset_t set;
+
+	// with the reader gone the write fails; SIGPIPE would end the program
+	sigemptyset(&set);
+	sigaddset(&set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	while ((n = fread(buf, 1, sizeof(buf), f->in)) > 0) {
+		for (k = 0; k < n; k += w)
+			if ((w = write(f->fd, buf + k, n - k)) <= 0)
+				break;
+		if (k < n)
+			break;
+	}
+	close(f->fd);
+	fclose(f->in);
+	free(f);
+	return NULL;
+}
+
+/* add_pipe ------------------- remember an open (de)compressor for its close */
+static struct unzip_pipe *add_pipe(FILE *fp, pid_t pid, const char *name)
+{
+	struct unzip_pipe *u = ckallocz(sizeof(struct unzip_pipe));
+
+	u->fp = fp;
+	u->pid = pid;
+	u->name = copy_string(name);
+	pthread_mutex_lock(&UnzipLock);
+	u->next = Unzips;
+	Unzips = u;
+	pthread_mutex_unlock(&UnzipLock);
+	return u;
+}
+
+/* ckopen_in -------------------- open input file, decompressing gzip and zstd */
+/* name may also be given without its .gz suffix; gzip, BGZF and zstd input
+ * is recognised by its magic number, so the suffix itself does not matter.
+ * A URL is read through the cache of remote.h */
+FILE *ckopen_in(const char *name)
+{
+	char gzname[1000], cmd[500], *argv[20];
+	unsigned char magic[4];
+	const char *path = name;
+	struct unzip_pipe *u;
+	struct feed *f = NULL;
+	int fd[2], in[2];
+	bool gz, zstd;
+	size_t n;
+	FILE *fp;
+	pid_t pid;
+
+	if (is_url(name)) {
+		if (!url_stat(name, NULL, NULL)) {
+			snprintf(gzname, sizeof(gzname), "%s.gz", name);
+			if (url_stat(gzname, NULL, NULL))
+				path = gzname;
+		}
+		if ((fp = open_url(path)) == NULL)
+			fatalf("Cannot open %s.", path);
+	} else {
+		if (access(name, F_OK) != 0) {
+			snprintf(gzname, sizeof(gzname), "%s.gz", name);
+			if (access(gzname, F_OK) == 0)
+				path = gzname;
+		}
+		fp = ckopen(path, "r");
+	}
+	n = fread(magic, 1, 4, fp);
+	gz = (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b);
+	zstd = (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f
+		&& magic[3] == 0xfd);
+	if (!gz && !zstd) {
+		rewind(fp);
+		return fp;
+	}
+	if (is_url(path)) {
+		rewind(fp);
+		f = ckalloc(sizeof(struct feed));
+		f->in = fp;
+		if (pipe2(in, O_CLOEXEC) != 0)
+			fatalf("Cannot decompress %s: %s", path, strerror(errno));
+		f->fd = in[1];
+	} else
+		fclose(fp);
+
+	unzip_argv(cmd, argv, 20, f ? NULL : path, zstd);
+	/* close-on-exec, so that children started by other threads do not
+	 * keep this pipe open */
+	if (pipe2(fd, O_CLOEXEC) != 0)
+		fatalf("Cannot decompress %s: %s", path, strerror(errno));
+	if ((pid = fork()) < 0)
+		fatalf("Cannot decompress %s: %s", path, strerror(errno));
+	if (pid == 0) {
+		close(fd[0]);
+		dup2(fd[1], STDOUT_FILENO);
+		close(fd[1]);
+		if (f)
+			dup2(in[0], STDIN_FILENO);
+		signal(SIGPIPE, SIG_DFL);
+		execvp(argv[0], argv);
+		fprintf(stderr, "Cannot run %s: %s\n", argv[0], strerror(errno));
+		_exit(127);
+	}
+	close(fd[1]);
+	if ((fp = fdopen(fd[0], "r")) == NULL)
+		fatalf("Cannot decompress %s: %s", path, strerror(errno));
+	u = add_pipe(fp, pid, path);
+	if (f) {
+		close(in[0]);
+		u->fed = 1;
+		if (pthread_create(&u->feeder, NULL, feed_unzip, f) != 0)
+			fatalf("Cannot decompress %s: %s", path, strerror(errno));
+	}
+	return fp;
+}
+
+/* ckopen_out ------------- open output file, compressed with DESCHRAMBLER_ZSTD */
+/* DESCHRAMBLER_ZSTD in the environment, a zstd level (or "yes" for its
+ * default), writes the file through zstd with all the processors; ZSTD
+ * sets the command instead (e.g. "pzstd -q -c"). The name stays the same
+ * and ckopen_in recognises the zstd frames, so readers need not know */
+FILE *ckopen_out(const char *name)
+{
+	char *level = getenv("DESCHRAMBLER_ZSTD"), *env = getenv("ZSTD");
+	char cmd[500], *argv[20], *t, *save;
+	int fd[2], n = 0;
+	FILE *out, *fp;
+	pid_t pid;
+
+	if (level == NULL || *level == '\0' || same_string(level, "no"))
+		return ckopen(name, "w");
+	if (env && *env)
+		snprintf(cmd, sizeof(cmd), "%s", env);
+	else if (isdigit((unsigned char)*level))
+		snprintf(cmd, sizeof(cmd), "zstd -q -T0 -%s -c", level);
+	else
+		snprintf(cmd, sizeof(cmd), "zstd -q -T0 -c");
+	for (t = strtok_r(cmd, " \t", &save); t && n < 19; t = strtok_r(NULL, " \t", &save))
+		argv[n++] = t;
+	argv[n] = NULL;
+	if (!in_path(argv[0]))
+		fatalf("Cannot compress %s: %s is not on PATH", name, argv[0]);
+
+	out = ckopen(name, "we");
+	if (pipe2(fd, O_CLOEXEC) != 0)
+		fatalf("Cannot compress %s: %s", name, strerror(errno));
+	if ((pid = fork()) < 0)
+		fatalf("Cannot compress %s: %s", name, strerror(errno));
+	if (pid == 0) {
+		dup2(fd[0], STDIN_FILENO);
+		dup2(fileno(out), STDOUT_FILENO);
+		execvp(argv[0], argv);
+		fprintf(stderr, "Cannot run %s: %s\n", argv[0], strerror(errno));
+		_exit(127);
+	}
+	close(fd[0]);
+	fclose(out);
+	if ((fp = fdopen(fd[1], "w")) == NULL)
+		fatalf("Cannot compress %s: %s", name, strerror(errno));
+	add_pipe(fp, pid, name);
+	return fp;
+}
+
+/* close_pipe ----------- close a file and wait for its (de)compressor, if any */
+static void close_pipe(FILE *fp, bool reading)
+{
+	struct unzip_pipe *u, **up;
+	int status;
+
+	pthread_mutex_lock(&UnzipLock);
+	for (up = &Unzips; *up && (*up)->fp != fp; up = &(*up)->next)
+		;
+	u = *up;
+	if (u)
+		*up = u->next;
+	pthread_mutex_unlock(&UnzipLock);
+
+	if (fclose(fp) != 0 && !reading)
+		fatalf("Cannot write %s: %s", u ? u->name : "a file", strerror(errno));
+	if (u == NULL)
+		return;
+	/* a reader that stops early (a chromosome of a whole-genome file) ends
+	 * the decompressor with SIGPIPE */
+	if (waitpid(u->pid, &status, 0) < 0
+		|| (WIFSIGNALED(status) && (!reading || WTERMSIG(status) != SIGPIPE))
+		|| (WIFEXITED(status) && WEXITSTATUS(status) != 0))
+		fatalf("%s %s failed", reading ? "Decompressing" : "Compressing", u->name);
+	if (u->fed)
+		pthread_join(u->feeder, NULL);
+	free(u->name);
+	free(u);
+}
+
+/* ckclose_in ----------------- close a ckopen_in file; check the decompressor */
+void ckclose_in(FILE *fp)
+{
+	close_pipe(fp, 1);
+}
+
+/* ckclose_out ---------------- close a ckopen_out file; check the compressor */
+void ckclose_out(FILE *fp)
+{
+	close_pipe(fp, 0);
+}
+
+/* input_exists ------------------- does name (or name.gz) exist for reading */
+bool input_exists(const char *name)
+{
+	char gzname[1000];
+
+	snprintf(gzname, sizeof(gzname), "%s.gz", name);
+	if (is_url(name))
+		return url_stat(name, NULL, NULL) || url_stat(gzname, NULL, NULL);
+	if (access(name, F_OK) == 0)
+		return 1;
+	return access(gzname, F_OK) == 0;
+}
+
+/* alloc ------------ allocate space; check for success; count it or not */
+static void *alloc(size_t amount, bool count)
 {
 	void *p;
 
@@ -56,9 +354,17 @@ void *ckalloc(size_t amount)
 	if ((p = malloc(amount)) == NULL)
 		fatalf("Ran out of memory trying to allocate %lu.",
 			(unsigned long)amount);
+	if (count)
+		MEM_COUNT(amount);
 	return p;
 }
 
+/* ckalloc -------------------------------- allocate space; check for success */
+void *ckalloc(size_t amount)
+{
+	return alloc(amount, 1);
+}
+
 /* ckallocz -------------------- allocate space; zero fill; check for success */
 void *ckallocz(size_t amount)
 {
@@ -129,9 +435,14 @@ void fatalfr(const char *fmt, ...)
 
 void *ckrealloc(void * p, size_t size)
 {
+#ifdef DESCHRAMBLER_TRACE
+	size_t old = p ? malloc_usable_size(p) : 0;
+#endif
+
 	p = p ? realloc(p, size) : malloc(size);
 	if (!p)
 		fatal("ckrealloc failed");
+	MEM_COUNT(size > old ? size - old : 0);
 	return p;
 }
 
@@ -169,6 +480,16 @@ char *fasta_name(char *line)
 	return t;
 }
 
+/* top/ref/spc/sub into dir, of size bytes: the net or chain directory of
+ * the pair of a reference and another species. A path that does not fit
+ * is fatal, rather than a truncated one opened instead */
+void pair_dir(char *dir, size_t size, const char *top, const char *ref, const char *spc,
+	const char *sub)
+{
+	if ((size_t)snprintf(dir, size, "%s/%s/%s/%s", top, ref, spc, sub) >= size)
+		fatalf("path too long: %s/%s/%s/%s", top, ref, spc, sub);
+}
+
 void do_cmd(const char *fmt, ...) {
 	char buf[10000];
 	va_list ap;
@@ -180,3 +501,62 @@ void do_cmd(const char *fmt, ...) {
 		fatalf("Command '%s' failed", buf);
 	va_end(ap);
 }
+
+/* arena ------------------------------ chunks of memory released all at once */
+/* Nodes that live as long as a stage come out of an arena in the order
+ * they are made, without a malloc each, and the stage frees them with
+ * free_arena() instead of walking its lists. An arena is used by one
+ * thread at a time. */
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size, used;
+	double data[];		// aligned for any node
+};
+
+struct arena {
+	struct arena_chunk *chunk;
+	size_t chunksize;
+};
+
+struct arena *new_arena(size_t chunk)
+{
+	struct arena *a = ckallocz(sizeof(struct arena));
+
+	a->chunksize = chunk > 0 ? chunk : (1 << 20);
+	return a;
+}
+
+void *arena_alloc(struct arena *a, size_t amount)
+{
+	struct arena_chunk *c = a->chunk;
+	size_t size;
+	void *p;
+
+	amount = (amount + sizeof(double) - 1) & ~(sizeof(double) - 1);
+	if (c == NULL || c->used + amount > c->size) {
+		size = MAX(a->chunksize, amount);
+		// the chunks are not counted, what is allocated of them is
+		c = alloc(sizeof(struct arena_chunk) + size, 0);
+		c->size = size;
+		c->used = 0;
+		c->next = a->chunk;
+		a->chunk = c;
+	}
+	p = (char *)c->data + c->used;
+	c->used += amount;
+	MEM_COUNT(amount);
+	return p;
+}
+
+void free_arena(struct arena *a)
+{
+	struct arena_chunk *c, *next;
+
+	if (a == NULL)
+		return;
+	for (c = a->chunk; c != NULL; c = next) {
+		next = c->next;
+		free(c);
+	}
+	free(a);
+}
@@ -29,6 +29,11 @@ void print_argv0(void);
 	void fatalfr(const char *fmt, ...);
 #endif
 FILE *ckopen(const char *name, const char *mode);
+FILE *ckopen_in(const char *name);
+void ckclose_in(FILE *fp);
+FILE *ckopen_out(const char *name);
+void ckclose_out(FILE *fp);
+bool input_exists(const char *name);
 void ckfree(void* p);
 void *ckalloc(size_t amount);
 void *ckallocz(size_t amount);
@@ -41,6 +46,14 @@ char *copy_substring(const char *s, int n);
 unsigned int roundup(unsigned int n, unsigned int m);
 char *fasta_name(char *line);
 void do_cmd(const char *fmt, ...);
+void pair_dir(char *dir, size_t size, const char *top, const char *ref, const char *spc,
+	const char *sub);
+
+/* an arena hands out memory in big chunks and takes it all back at once */
+struct arena;
+struct arena *new_arena(size_t chunk);
+void *arena_alloc(struct arena *a, size_t amount);
+void free_arena(struct arena *a);
 
 #undef MAX
 #define MAX(x,y) ((x) > (y) ? (x) : (y))
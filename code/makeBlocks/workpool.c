@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "workpool.h"
+#include "trace.h"
+
+int default_threads(void)
+{
+	char *s = getenv("DESCHRAMBLER_THREADS");
+	long n;
+
+	if (s != NULL && (n = atol(s)) > 0)
+		return (int)n;
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+int thread_arg(const char *arg)
+{
+	int n;
+
+	if (arg == NULL || *arg == '\0')
+		return default_threads();
+	n = atoi(arg);
+	return n > 0 ? n : 1;
+}
+
+struct pool {
+	int njobs, next;
+	int mem;		// the memory category of trace.h of the caller
+	void (*fn)(int job, void *arg);
+	void *arg;
+};
+
+static void *pool_worker(void *arg)
+{
+	struct pool *pl = arg;
+	int k, mem = MEM_SWITCH(pl->mem);
+
+	while ((k = __atomic_fetch_add(&pl->next, 1, __ATOMIC_RELAXED)) < pl->njobs)
+		pl->fn(k, pl->arg);
+	MEM_LEAVE(mem);
+	return NULL;
+}
+
+void run_jobs(int njobs, int nthreads, void (*fn)(int job, void *arg), void *arg)
+{
+	struct pool pl;
+	pthread_t *threads;
+	int k, n;
+
+	pl.njobs = njobs;
+	pl.next = 0;
+	pl.fn = fn;
+	pl.arg = arg;
+	pl.mem = MEM_CURRENT();
+	if (nthreads > njobs)
+		nthreads = njobs;
+	if (nthreads <= 1) {
+		pool_worker(&pl);
+		return;
+	}
+	// the calling thread is one of them; a thread that cannot be made
+	// leaves its jobs to the others
+	threads = malloc((nthreads - 1) * sizeof(pthread_t));
+	for (n = 0; threads != NULL && n < nthreads - 1; n++)
+		if (pthread_create(&threads[n], NULL, pool_worker, &pl) != 0)
+			break;
+	pool_worker(&pl);
+	for (k = 0; k < n; k++)
+		pthread_join(threads[k], NULL);
+	free(threads);
+}
+
+struct range_job {
+	long n, grain;
+	void (*fn)(long lo, long hi, void *arg);
+	void *arg;
+};
+
+static void range_worker(int job, void *arg)
+{
+	struct range_job *r = arg;
+	long lo = job * r->grain, hi = lo + r->grain;
+
+	r->fn(lo, hi < r->n ? hi : r->n, r->arg);
+}
+
+void parallel_for(long n, long grain, int nthreads,
+				void (*fn)(long lo, long hi, void *arg), void *arg)
+{
+	struct range_job r;
+
+	if (n <= 0)
+		return;
+	if (grain < 1)
+		grain = 1;
+	r.n = n;
+	r.grain = grain;
+	r.fn = fn;
+	r.arg = arg;
+	run_jobs((int)((n + grain - 1) / grain), nthreads, range_worker, &r);
+}
+
+struct job_output {
+	int njobs;
+	FILE **fp;
+	char **buf;
+	size_t *len;
+};
+
+struct job_output *open_job_output(int njobs)
+{
+	struct job_output *out = calloc(1, sizeof(struct job_output));
+
+	out->njobs = njobs;
+	out->fp = calloc(njobs + 1, sizeof(FILE *));
+	out->buf = calloc(njobs + 1, sizeof(char *));
+	out->len = calloc(njobs + 1, sizeof(size_t));
+	return out;
+}
+
+// made on its first use, by the job's own thread
+FILE *job_stream(struct job_output *out, int job)
+{
+	if (out->fp[job] == NULL && (out->fp[job] = open_memstream(&out->buf[job], &out->len[job])) == NULL) {
+		fprintf(stderr, "open_memstream failed\n");
+		exit(1);
+	}
+	return out->fp[job];
+}
+
+// 0, or -1 if fp could not take all of it
+int close_job_output(struct job_output *out, FILE *fp)
+{
+	int k, ret = 0;
+
+	for (k = 0; k < out->njobs; k++) {
+		if (out->fp[k] == NULL)
+			continue;
+		fclose(out->fp[k]);
+		if (fwrite(out->buf[k], 1, out->len[k], fp) != out->len[k])
+			ret = -1;
+		free(out->buf[k]);
+	}
+	free(out->fp);
+	free(out->buf);
+	free(out->len);
+	free(out);
+	return ret;
+}
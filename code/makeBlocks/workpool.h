@@ -0,0 +1,58 @@
+/* **************************************************************
+ * The threads of the tools, all handled the same way.
+ *
+ * A tool takes its number of threads as an argument (the optional
+ * last [threads] of the makeBlocks tools, -threads=N in code/); when
+ * it is not given, the DESCHRAMBLER_THREADS environment variable
+ * gives it, and otherwise every processor online is used. This lets
+ * DESCHRAMBLER.pl share the processors among the steps it runs at
+ * once.
+ *
+ * The work is a number of jobs, handed to the threads one at a time
+ * from a shared counter, so a thread that is done early goes on with
+ * the next job. Jobs that print do so to a stream of their own,
+ * written out in job order once they are all done. Nothing here
+ * uses the rest of makeBlocks, so code/ links it too.
+ *
+ * What a tool writes must not depend on its number of threads: a job
+ * fills only its own part of the results, a sum over the jobs is made
+ * after them in job order, and output goes through open_job_output().
+ * bench/verify.pl -threads checks a tool for it.
+ * **************************************************************/
+
+#ifndef _WORKPOOL_H_
+#define _WORKPOOL_H_
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// DESCHRAMBLER_THREADS if it is a positive number, else the processors online
+int default_threads(void);
+
+// the threads to use for an argument: default_threads() if arg is NULL
+// or empty, else the number it gives, at least 1
+int thread_arg(const char *arg);
+
+// calls fn(job, arg) for job = 0..njobs-1 on up to nthreads threads
+void run_jobs(int njobs, int nthreads, void (*fn)(int job, void *arg), void *arg);
+
+// calls fn(lo, hi, arg) on ranges of about grain indices that cover
+// [0, n), on up to nthreads threads
+void parallel_for(long n, long grain, int nthreads,
+				void (*fn)(long lo, long hi, void *arg), void *arg);
+
+// a stream for each of njobs jobs; close_job_output() writes them to fp
+// in job order and frees them
+struct job_output;
+struct job_output *open_job_output(int njobs);
+FILE *job_stream(struct job_output *out, int job);
+int close_job_output(struct job_output *out, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+// parsimony.h - the small parsimony join_splits.pl runs to tell whether an
+// adjacency is in the '@' ancestor, header-only, for 64 adjacencies at a
+// time. Each adjacency is a 0/1 character (absent/present); a leaf may
+// allow both states when its genome cannot tell. Bit k of a word stands for
+// the k-th adjacency of the batch, so one pass of word operations over the
+// tree does the 64 of them.
+//
+// The up pass is Fitch's: a node gets the intersection of the sets of its
+// (first two) children, or their union when that is empty. The down pass
+// gives each node its own state if its set has one, else its parent's,
+// starting from each state the root allows; the ancestor has the adjacency
+// when every such start gives it state 1.
+//
+//	parsimony::Tree t;
+//	if (!t.read("tree.txt", err)) ...
+//	std::vector<parsimony::Lanes> s(t.size());
+//	s[leaf] = {can0, can1};		// for every leaf
+//	uint64_t there = parsimony::ancestorHas(t, s);
+
+#ifndef PARSIMONY_H
+#define PARSIMONY_H
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace parsimony {
+
+// the tree flattened into arrays indexed by node, with the nodes in
+// postorder for the up pass and the path from the root to '@' for the
+// down pass
+class Tree {
+public:
+	std::vector<int> parent, left, right;	// -1 where there is none
+	std::vector<std::string> name;
+	std::vector<int> post;		// children before parents
+	std::vector<int> path;		// below the root down to the '@' node
+	std::vector<int> leaves;	// in the order of the tree file
+	int root, target;
+
+	Tree() : root(-1), target(-1) {}
+
+	int size() const { return parent.size(); }
+	bool isLeaf(int n) const { return left[n] < 0; }
+
+	// reads a newick tree with an internal node named '@'; the branch
+	// lengths are skipped. Nodes with more than two children only count
+	// their first two in the up pass, as in join_splits.pl.
+	bool read(const char* tree_f, std::string& err)
+	{
+		std::ifstream in(tree_f);
+		if (!in) { err = std::string("cannot open ") + tree_f; return false; }
+		std::string s, line;
+		while (std::getline(in, line)) s += line;
+		s.erase(std::remove_if(s.begin(), s.end(), ::isspace), s.end());
+
+		std::vector<std::vector<int> > child;
+		int cur = -1;
+		size_t p = 0;
+		while (p < s.size() && s[p] != ';') {
+			if (s[p] == ',') { p++; continue; }
+			if (s[p] == '(') {
+				cur = newNode(child, cur);
+				p++;
+				continue;
+			}
+			int node = cur;
+			if (s[p] == ')') {
+				if (cur < 0) { err = std::string("unbalanced tree in ") + tree_f; return false; }
+				cur = parent[cur];
+				p++;
+			} else {
+				node = newNode(child, cur);
+			}
+			size_t q = p;
+			while (q < s.size() && !isSep(s[q])) q++;
+			name[node] = s.substr(p, q - p);
+			p = q;
+			if (p < s.size() && s[p] == ':')
+				for (p++; p < s.size() && !isSep(s[p]); p++) ;
+		}
+		if (size() == 0 || cur >= 0) { err = std::string("cannot parse the tree in ") + tree_f; return false; }
+
+		root = 0;
+		std::vector<int> stack(1, root);
+		while (!stack.empty()) {
+			int n = stack.back();
+			stack.pop_back();
+			post.push_back(n);
+			if (target < 0 && name[n] == "@") target = n;
+			if (child[n].size() == 1) { err = std::string("a node with one child in ") + tree_f; return false; }
+			if (child[n].size() >= 2) {
+				left[n] = child[n][0];
+				right[n] = child[n][1];
+			}
+			for (size_t c = child[n].size(); c > 0; c--) stack.push_back(child[n][c-1]);
+		}
+		for (size_t i = 0; i < post.size(); i++)
+			if (isLeaf(post[i])) leaves.push_back(post[i]);
+		std::reverse(post.begin(), post.end());
+		if (target < 0) { err = std::string("no '@' node in ") + tree_f; return false; }
+		for (int n = target; n != root; n = parent[n]) path.push_back(n);
+		std::reverse(path.begin(), path.end());
+		return true;
+	}
+
+private:
+	static bool isSep(char c)
+	{
+		return c == '(' || c == ')' || c == ',' || c == ':' || c == ';';
+	}
+
+	int newNode(std::vector<std::vector<int> >& child, int par)
+	{
+		int n = size();
+		parent.push_back(par);
+		left.push_back(-1);
+		right.push_back(-1);
+		name.push_back("");
+		child.push_back(std::vector<int>());
+		if (par >= 0) child[par].push_back(n);
+		return n;
+	}
+};
+
+// the states a node allows, for 64 characters: bit k of can0 (can1) is set
+// if state 0 (1) is in the set of character k
+struct Lanes {
+	uint64_t can0, can1;
+};
+
+// fills in the sets of the internal nodes from those of the leaves
+inline void upPass(const Tree& t, std::vector<Lanes>& s)
+{
+	for (size_t i = 0; i < t.post.size(); i++) {
+		int n = t.post[i];
+		if (t.isLeaf(n)) continue;
+		const Lanes& a = s[t.left[n]];
+		const Lanes& b = s[t.right[n]];
+		uint64_t both0 = a.can0 & b.can0, both1 = a.can1 & b.can1;
+		uint64_t meet = both0 | both1;
+		s[n].can0 = both0 | (~meet & (a.can0 | b.can0));
+		s[n].can1 = both1 | (~meet & (a.can1 | b.can1));
+	}
+}
+
+// the characters the '@' node is 1 for whatever state the root takes,
+// the sets being those of upPass()
+inline uint64_t ancestorState(const Tree& t, const std::vector<Lanes>& s)
+{
+	uint64_t from0 = 0, from1 = ~(uint64_t)0;	// the state if the root is 0, 1
+	for (size_t i = 0; i < t.path.size(); i++) {
+		const Lanes& l = s[t.path[i]];
+		uint64_t one = l.can0 ^ l.can1;
+		from0 = (one & l.can1) | (~one & from0);
+		from1 = (one & l.can1) | (~one & from1);
+	}
+	const Lanes& r = s[t.root];
+	return (from0 | ~r.can0) & (from1 | ~r.can1);
+}
+
+// both passes
+inline uint64_t ancestorHas(const Tree& t, std::vector<Lanes>& s)
+{
+	upPass(t, s);
+	return ancestorState(t, s);
+}
+
+} // namespace parsimony
+
+#endif /* PARSIMONY_H */
@@ -0,0 +1,145 @@
+// scoreparse.h - reads "bid1 bid2 score" text files (block_consscores.txt,
+// adjacencies.prob) through mmap. Numbers are converted with from_chars:
+// no locale, no stream state, no allocation per token. Large files are cut
+// at line starts into chunks that are parsed on separate threads; records
+// are assumed to be one per line for that. Like reading with
+// ifstream >> int >> int >> double, parsing stops at the first token that
+// is not a number.
+
+#ifndef SCOREPARSE_H
+#define SCOREPARSE_H
+
+#include <charconv>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct ScoreRec {
+	int bid1, bid2;
+	double score;
+};
+
+// a read-only mapping of a whole file; data is 0 for an empty file
+class MappedFile {
+public:
+	const char* data;
+	size_t size;
+
+	MappedFile() : data(0), size(0) {}
+	~MappedFile() { close(); }
+
+	bool open(const char* path) {
+		close();
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0) { ::close(fd); return false; }
+		size = st.st_size;
+		if (size > 0) {
+			void* p = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED) { ::close(fd); size = 0; return false; }
+			madvise(p, size, MADV_SEQUENTIAL);
+			data = (const char*)p;
+		}
+		::close(fd);
+		return true;
+	}
+
+	void close() {
+		if (data) munmap((void*)data, size);
+		data = 0;
+		size = 0;
+	}
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+inline bool scoreSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// the next number in [*p, end) after any white space; false if there is
+// none or it does not parse
+template <class T>
+bool scoreToken(const char*& p, const char* end, T& val)
+{
+	while (p < end && scoreSpace(*p)) p++;
+	if (p < end && *p == '+') p++;
+	std::from_chars_result r = std::from_chars(p, end, val);
+	if (r.ec != std::errc() || (r.ptr < end && !scoreSpace(*r.ptr))) return false;
+	p = r.ptr;
+	return true;
+}
+
+// appends the records of [p, end) to out; false if it stopped early on
+// something that is not a record
+inline bool parseScoreChunk(const char* p, const char* end, std::vector<ScoreRec>& out)
+{
+	ScoreRec rec;
+	for (;;) {
+		while (p < end && scoreSpace(*p)) p++;
+		if (p == end) return true;
+		if (!scoreToken(p, end, rec.bid1) || !scoreToken(p, end, rec.bid2) ||
+			!scoreToken(p, end, rec.score)) return false;
+		out.push_back(rec);
+	}
+}
+
+// parses [begin, end) on up to nthreads threads, the records coming out
+// in file order
+inline void parseScores(const char* begin, const char* end, std::vector<ScoreRec>& out, int nthreads)
+{
+	const size_t minChunk = 1 << 22;
+	size_t len = end - begin;
+	if (nthreads < 1) nthreads = 1;
+	if ((size_t)nthreads > len / minChunk) nthreads = len / minChunk;
+	if (nthreads <= 1) {
+		parseScoreChunk(begin, end, out);
+		return;
+	}
+
+	std::vector<const char*> cut(nthreads + 1, end);
+	cut[0] = begin;
+	for (int t = 1; t < nthreads; t++) {
+		const char* p = begin + len / nthreads * t;
+		if (p < cut[t-1]) p = cut[t-1];
+		while (p < end && p[-1] != '\n') p++;
+		cut[t] = p;
+	}
+
+	std::vector<std::vector<ScoreRec> > parts(nthreads);
+	std::vector<char> ok(nthreads, 0);
+	std::vector<std::thread> pool;
+	for (int t = 0; t < nthreads; t++) {
+		parts[t].reserve((cut[t+1] - cut[t]) / 16);
+		pool.push_back(std::thread([&, t]() { ok[t] = parseScoreChunk(cut[t], cut[t+1], parts[t]); }));
+	}
+	for (int t = 0; t < nthreads; t++) pool[t].join();
+
+	size_t total = out.size();
+	for (int t = 0; t < nthreads; t++) total += parts[t].size();
+	out.reserve(total);
+	for (int t = 0; t < nthreads; t++) {
+		out.insert(out.end(), parts[t].begin(), parts[t].end());
+		std::vector<ScoreRec>().swap(parts[t]);
+		if (!ok[t]) break;
+	}
+}
+
+// reads a whole score file into out; false if it cannot be opened
+inline bool readScoreFile(const char* path, std::vector<ScoreRec>& out, int nthreads = 1)
+{
+	MappedFile mf;
+	if (!mf.open(path)) return false;
+	parseScores(mf.data, mf.data + mf.size, out, nthreads);
+	return true;
+}
+
+#endif /* SCOREPARSE_H */
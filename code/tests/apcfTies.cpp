@@ -0,0 +1,108 @@
+// apcfTies - pins the order apcf.h takes edges of one weight in: by their
+// signed ends (Edge::operator<), the same on any number of threads. The
+// APCFs of tied scores depend on it, so a change to prepareEdges() that
+// moves them shows up here rather than in the outputs of a run.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "apcf.h"
+
+typedef apcf::Assembler<int, double> Assembler;
+typedef Assembler::Edge Edge;
+
+static int Failed = 0;
+// the hash and the number of the APCFs of "many ties" below
+#define PINNED "8ce40caa0856f5a9 2594\n"
+
+// the blocks of the APCFs as deschrambler writes them, one per line
+static std::string apcfs(Assembler& a)
+{
+	std::ostringstream out;
+	a.forEachApcf(0, [&](const std::list<Edge>& le) {
+		size_t n = 0;
+		for (std::list<Edge>::const_iterator e = le.begin(); e != le.end(); e++, n++) {
+			if (e->bid1 != 0) out << e->bid1 * e->dir1 << " ";
+			if (n + 1 == le.size() && e->bid2 != 0) out << e->bid2 * e->dir2 << " ";
+		}
+		out << "$\n";
+	});
+	return out.str();
+}
+
+static void expect(const char* name, const std::string& got, const std::string& want)
+{
+	if (got == want) return;
+	fprintf(stderr, "apcfTies: %s\n  expected:\n%s  got:\n%s", name, want.c_str(), got.c_str());
+	Failed = 1;
+}
+
+int main()
+{
+	// three edges of one weight out of the end of block 1: 1 -> 2 has the
+	// lowest signed ends and is taken, the others find that end used; a
+	// block left alone is not an APCF here (finishApcfs adds those)
+	{
+		Assembler a;
+		a.add(1, 2, 0.5);
+		a.add(1, -3, 0.5);
+		a.add(1, 4, 0.5);
+		a.add(4, 5, 0.5);
+		a.assemble(std::vector<double>(1, 0.0));
+		expect("ties out of one end", apcfs(a), "1 2 $\n4 5 $\n");
+	}
+
+	// the same, listed the other way round: the order of add() does not count
+	{
+		Assembler a;
+		a.add(4, 5, 0.5);
+		a.add(1, 4, 0.5);
+		a.add(1, -3, 0.5);
+		a.add(1, 2, 0.5);
+		a.assemble(std::vector<double>(1, 0.0));
+		expect("ties listed backward", apcfs(a), "1 2 $\n4 5 $\n");
+	}
+
+	// a heavier edge still comes before the tied ones
+	{
+		Assembler a;
+		a.add(1, 2, 0.5);
+		a.add(1, -3, 0.5);
+		a.add(1, 4, 0.9);
+		a.add(4, 5, 0.5);
+		a.assemble(std::vector<double>(1, 0.0));
+		expect("heavier first", apcfs(a), "1 4 5 $\n");
+	}
+
+	// enough tied edges for the threaded sort (65536 and up), of three
+	// weights: one thread and several give the same APCFs, pinned by their
+	// FNV-1a hash and count
+	{
+		std::string one, many;
+		for (int t = 1; t <= 4; t += 3) {
+			Assembler a;
+			uint32_t x = 1;
+			auto next = [&]() { x = x * 1103515245u + 12345u; return (int)(x >> 8); };
+			for (int k = 0; k < 100000; k++) {
+				int b1 = 1 + next() % 20000, b2 = 1 + next() % 20000;
+				a.add((next() & 1) ? b1 : -b1, (next() & 1) ? b2 : -b2, 0.25 * (1 + next() % 3));
+			}
+			a.assemble(std::vector<double>(1, 0.0), t);
+			(t == 1 ? one : many) = apcfs(a);
+		}
+		expect("threads", many, one);
+		uint64_t h = 14695981039346656037ULL;
+		for (size_t k = 0; k < one.size(); k++) h = (h ^ (unsigned char)one[k]) * 1099511628211ULL;
+		char got[64];
+		snprintf(got, sizeof(got), "%016llx %ld\n", (unsigned long long)h, (long)std::count(one.begin(), one.end(), '\n'));
+		expect("many ties", got, PINNED);
+	}
+
+	if (!Failed) printf("apcfTies: ok\n");
+	return Failed;
+}
@@ -0,0 +1,61 @@
+#!/usr/bin/perl
+
+# epsilonPosteriors.pl - the posteriors inferAdjProb -epsilon keeps are those
+# of the run without it: the skipped candidates still count in the
+# normalisers. On a synthetic set (bench/gen_synthetic.pl, fixed seed) where
+# each epsilon skips a sixth to a third of the candidates, every posterior
+# kept must be within TOLERANCE, the digits adjacencies.prob is written
+# with, of the one of the full run.
+
+use strict;
+use warnings;
+use FindBin qw($Bin);
+use File::Temp qw(tempdir);
+
+my $TOLERANCE = 1e-6;
+my $tool = "$Bin/../inferAdjProb";
+my $dir = tempdir("epsilonPosteriors.XXXXXX", TMPDIR => 1, CLEANUP => 1);
+my $failed = 0;
+
+system("perl $Bin/../../bench/gen_synthetic.pl -out $dir -blocks 1500 -leaves 8 -seed 7 >/dev/null 2>&1") == 0
+	or die "epsilonPosteriors: gen_synthetic.pl failed\n";
+
+# the posteriors of a run, by adjacency
+sub posteriors {
+	my ($opts) = @_;
+	my %p;
+
+	system("cd $dir && $tool $opts spc1 0.005 tree.txt Genomes.Order >/dev/null 2>&1") == 0
+		or die "epsilonPosteriors: inferAdjProb $opts failed\n";
+	open(my $in, "<", "$dir/adjacencies.prob") or die "epsilonPosteriors: $dir/adjacencies.prob: $!\n";
+	while (<$in>) {
+		next if /^#/;
+		chomp;
+		my ($adj, $p) = split /\t/;
+		$p{$adj} = $p;
+	}
+	close($in);
+	return \%p;
+}
+
+my $full = posteriors("");
+foreach my $eps ("1e-5", "1e-3", "1e-2") {
+	my $kept = posteriors("-epsilon=$eps");
+	my ($max, $at) = (0, "");
+
+	foreach my $adj (keys %$kept) {
+		my $d = abs($kept->{$adj} - ($full->{$adj} // 0));
+		($max, $at) = ($d, $adj) if ($d > $max);
+	}
+	if (keys %$kept >= keys %$full) {
+		print STDERR "epsilonPosteriors: -epsilon=$eps skipped nothing\n";
+		$failed = 1;
+	}
+	if ($max > $TOLERANCE) {
+		printf STDERR "epsilonPosteriors: -epsilon=%s moves %s from %g to %g\n",
+			$eps, $at, $full->{$at} // 0, $kept->{$at};
+		$failed = 1;
+	}
+}
+print "epsilonPosteriors: ok\n" unless $failed;
+exit $failed;
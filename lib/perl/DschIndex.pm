@@ -0,0 +1,224 @@
+package DschIndex;
+
+# Lookups in the binary files of a run for the scripts, without reading
+# them into hashes: the join database (Joins.db, code/makeBlocks/joindb.h),
+# a binary block list (code/makeBlocks/blockfile.c) and the adjacency
+# scores (block_consscores.txt, indexed as it is opened). The files are
+# mapped into memory and searched where they lie by the C of
+# DschIndex/DschIndex.xs, which the top-level make builds; where it is not
+# built the same lookups are made in Perl, from the whole file read in.
+#
+#   my $joins = open_joins("$sf_dir/Joins.db");
+#   has_join($joins, $spc, $b1, $b2), $joins->join_mask($b1, $b2)
+#   my $scores = open_scores("$sf_dir/block_consscores.txt");
+#   $scores->score($b1, $b2)
+#   my $blocks = open_blocks("_conserved.segments.bin");
+#   foreach ($blocks->block_coords($bid, $spc)) { my ($chr, $beg, $end, $dir) = @$_; }
+#   $vec[end_id($x)], $seen{adj_canon($x, $y)}, my ($x, $y) = adj_ends($key)
+
+use strict;
+use warnings;
+use Exporter 'import';
+
+our $VERSION = "1.00";
+our @EXPORT = qw(open_joins open_scores open_blocks);
+our @EXPORT_OK = qw(has_join score block_coords end_id id_end adj_key adj_canon adj_ends);
+
+our $XS = eval { require XSLoader; XSLoader::load("DschIndex", $VERSION); 1 } ? 1 : 0;
+
+# open_joins(file), open_scores(file), open_blocks(file): a handle
+sub open_joins { return DschIndex::Joins->new(shift); }
+sub open_scores { return DschIndex::Scores->new(shift); }
+sub open_blocks { return DschIndex::Blocks->new(shift); }
+
+# has_join(joins, spc, end1, end2): whether the species has the join,
+# 0 a chromosome end; $joins->join_partner(spc, end) is the block end
+# joined to a block end, $joins->has_block(spc, bid) whether a block is
+# joined to another
+sub has_join { return shift->has_join(@_); }
+# score(scores, b1, b2): the score of the adjacency as its file gives it
+# (the last of the lines for b1 b2 or -b2 -b1), undef if it has none
+sub score { return shift->score(@_); }
+# block_coords(blocks, bid, spc): the segments of the species in the
+# block, each [chr, beg, end, orient] in the order of the list
+sub block_coords { return shift->block_coords(@_); }
+
+# end_id(x): the extremity id of a block end as code/makeBlocks/extremity.h
+# has it, 2*b for b, 2*b+1 for -b and 0 for a chromosome end, id_end(e) the
+# end of an id; adj_key(x, y) the 64-bit key of an adjacency, adj_canon(x, y)
+# the one key of x y and -y -x, and adj_ends(key) the two ends of a key.
+# The indexes that the tools and the scripts share are keyed by these
+
+sub slurp {
+	my $f = shift;
+	open(my $fh, "<:raw", $f) or die "cannot open $f\n";
+	local $/;
+	my $data = <$fh>;
+	close($fh);
+	return defined($data) ? $data : "";
+}
+
+# the same in Perl, the classes of the handles where the C is not built
+if (!$XS) {
+	@DschIndex::Joins::ISA = ("DschIndex::PP::Joins");
+	@DschIndex::Scores::ISA = ("DschIndex::PP::Scores");
+	@DschIndex::Blocks::ISA = ("DschIndex::PP::Blocks");
+	foreach my $f (qw(end_id id_end adj_key adj_canon adj_ends)) {
+		no strict "refs";
+		*{"DschIndex::$f"} = \&{"DschIndex::PP::$f"};
+	}
+}
+
+package DschIndex::PP;
+
+sub end_id {
+	my $x = shift;
+	return ($x == 0) ? 0 : ($x > 0) ? 2*$x : -2*$x + 1;
+}
+
+sub id_end {
+	my $e = shift;
+	return ($e < 2) ? 0 : ($e & 1) ? -($e >> 1) : ($e >> 1);
+}
+
+sub adj_key { return (end_id($_[0]) << 32) | end_id($_[1]); }
+
+sub adj_canon {
+	my ($x, $y) = @_;
+	my ($a, $b) = (adj_key($x, $y), adj_key(-$y, -$x));
+	return ($a < $b) ? $a : $b;
+}
+
+sub adj_ends {
+	my $k = shift;
+	return (id_end($k >> 32), id_end($k & 0xffffffff));
+}
+
+package DschIndex::PP::Joins;
+
+sub new {
+	my ($class, $f) = @_;
+	my $data = DschIndex::slurp($f);
+	my ($magic, $nspe, $maxid, $njoin, $namelen) = unpack("a8 l4", $data);
+	if (!defined($namelen) || $magic ne "DSCHJN1\0") {
+		die "$f: not a join database, or written by another version\n";
+	}
+	my $offpos = 24 + 8*$njoin;
+	my $partpos = $offpos + 4*(2*$maxid + 2);
+	if (length($data) != $partpos + 4*$njoin + $namelen) {
+		die "$f: truncated or damaged join database\n";
+	}
+	my @names = split(/\0/, substr($data, $partpos + 4*$njoin));
+	my %bit = map { ($names[$_], $_) } (0..$#names);
+	return bless({ data => $data, maxid => $maxid, offpos => $offpos,
+		partpos => $partpos, names => \@names, bit => \%bit }, $class);
+}
+
+# the partners and masks of an end
+sub joins_of {
+	my ($db, $x) = @_;
+	if ($x < -$$db{maxid} || $x > $$db{maxid}) { return (); }
+	my ($k, $end) = unpack("l2", substr($$db{data}, $$db{offpos} + 4*($x + $$db{maxid}), 8));
+	return map { [unpack("l", substr($$db{data}, $$db{partpos} + 4*$_, 4)),
+		unpack("Q", substr($$db{data}, 24 + 8*$_, 8))] } ($k..$end-1);
+}
+
+sub bit {
+	my ($db, $spc) = @_;
+	my $b = $$db{bit}{$spc};
+	if (!defined($b)) { die "$spc is not in the join database\n"; }
+	return $b;
+}
+
+sub join_mask {
+	my ($db, $x, $y) = @_;
+	foreach my $j ($db->joins_of($x)) { if ($$j[0] == $y) { return $$j[1]; } }
+	return 0;
+}
+
+sub has_join {
+	my ($db, $spc, $x, $y) = @_;
+	return ($db->join_mask($x, $y) >> $db->bit($spc)) & 1;
+}
+
+sub join_partner {
+	my ($db, $spc, $x) = @_;
+	my $b = $db->bit($spc);
+	if ($x == 0) { return undef; }
+	foreach my $j ($db->joins_of($x)) {
+		if ($$j[0] != 0 && (($$j[1] >> $b) & 1)) { return $$j[0]; }
+	}
+	return undef;
+}
+
+sub has_block {
+	my ($db, $spc, $id) = @_;
+	return ($id != 0 && (defined($db->join_partner($spc, $id))
+		|| defined($db->join_partner($spc, -$id)))) ? 1 : 0;
+}
+
+sub join_spc { return @{$_[0]{names}}; }
+
+package DschIndex::PP::Scores;
+
+sub new {
+	my ($class, $f) = @_;
+	my %s = ();
+	foreach my $line (split(/\n/, DschIndex::slurp($f))) {
+		my ($b1, $b2, $score) = split(/\s+/, $line);
+		if (!defined($score) || $b1 !~ /^[-+]?\d+$/ || $b2 !~ /^[-+]?\d+$/) { next; }
+		$s{$b1+0}{$b2+0} = $score;
+		$s{-$b2}{-$b1} = $score;
+	}
+	return bless(\%s, $class);
+}
+
+sub score {
+	my ($s, $x, $y) = @_;
+	return defined($$s{$x}) ? $$s{$x}{$y} : undef;
+}
+
+package DschIndex::PP::Blocks;
+
+sub new {
+	my ($class, $f) = @_;
+	my $data = DschIndex::slurp($f);
+	my ($magic, $style, $nspe, $nblock, $nseg, $ncid, $nname, $namelen) = unpack("a8 L7", $data);
+	if (!defined($namelen) || $magic ne "DSCHBL1\0") {
+		die "$f: not a binary block list, or written by another version\n";
+	}
+	my $segpos = 36 + 12*$nblock;
+	my $offpos = $segpos + 36*$nseg + 4*$ncid;
+	my $namepos = $offpos + 4*$nname;
+	if (length($data) != $namepos + $namelen) {
+		die "$f: truncated or damaged block list\n";
+	}
+	my @names = map { unpack("Z*", substr($data, $namepos + $_)) }
+		unpack("L$nname", substr($data, $offpos, 4*$nname));
+	my (%byid, @ids);
+	for (my $i = 0; $i < $nblock; $i++) {
+		my ($id, $seg, $n) = unpack("l L L", substr($data, 36 + 12*$i, 12));
+		push(@ids, $id);
+		if (!defined($byid{$id})) { $byid{$id} = [$seg, $n]; }
+	}
+	return bless({ data => $data, nspe => $nspe, segpos => $segpos, names => \@names,
+		byid => \%byid, ids => \@ids }, $class);
+}
+
+sub block_ids { return @{$_[0]{ids}}; }
+
+sub block_coords {
+	my ($bl, $id, $spc) = @_;
+	my $b = $$bl{byid}{$id};
+	if (!defined($b)) { return (); }
+	my @coords = ();
+	for (my $k = $$b[0]; $k < $$b[0] + $$b[1]; $k++) {
+		my ($beg, $end, $chr, $spe, $orient) =
+			unpack("l2 x16 x4 L S a", substr($$bl{data}, $$bl{segpos} + 36*$k, 36));
+		if ($spe >= $$bl{nspe} || $$bl{names}[$spe] ne $spc) { next; }
+		push(@coords, [$$bl{names}[$chr], $beg, $end, $orient]);
+	}
+	return @coords;
+}
+
+1;
@@ -0,0 +1,560 @@
+/* **************************************************************
+ * The lookups of DschIndex.pm (which see) in C: the join database,
+ * a binary block list and the adjacency scores mapped into memory
+ * and searched where they lie, instead of being read into hashes.
+ * The layouts are those of code/makeBlocks/joindb.h and blockfile.c;
+ * the block end ids and adjacency keys are code/makeBlocks/extremity.h.
+ * **************************************************************/
+
+#define PERL_NO_GET_CONTEXT
+#include "EXTERN.h"
+#include "perl.h"
+#include "XSUB.h"
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "extremity.h"
+
+struct image {
+	char *p;
+	size_t size;
+};
+
+static void map_file(pTHX_ struct image *im, const char *fname)
+{
+	struct stat st;
+	int fd;
+
+	if ((fd = open(fname, O_RDONLY)) < 0 || fstat(fd, &st) != 0)
+		croak("cannot open %s\n", fname);
+	im->size = st.st_size;
+	im->p = NULL;
+	if (im->size > 0) {
+		im->p = mmap(NULL, im->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (im->p == MAP_FAILED) {
+			close(fd);
+			croak("cannot map %s\n", fname);
+		}
+	}
+	close(fd);
+}
+
+static void unmap_file(struct image *im)
+{
+	if (im->p != NULL)
+		munmap(im->p, im->size);
+	im->p = NULL;
+}
+
+/* ------------------------------------------------------------ Joins.db */
+
+struct joindb_header {
+	char magic[8];
+	int32_t nspe, maxid, njoin, namelen;
+};
+
+struct joins {
+	struct image im;
+	int nspe, maxid;
+	const uint64_t *mask;
+	const int32_t *offset, *partner;
+	const char *name[64];
+};
+
+static struct joins *open_joins(pTHX_ const char *fname)
+{
+	const struct joindb_header *h;
+	struct joins *db;
+	const char *p;
+	uint64_t need;
+	int i;
+
+	Newxz(db, 1, struct joins);
+	map_file(aTHX_ &db->im, fname);
+	h = (const struct joindb_header *)db->im.p;
+	if (db->im.size < sizeof(*h) || memcmp(h->magic, "DSCHJN1\0", 8) != 0) {
+		unmap_file(&db->im);
+		Safefree(db);
+		croak("%s: not a join database, or written by another version\n", fname);
+	}
+	need = sizeof(*h) + (uint64_t)h->njoin * (sizeof(uint64_t) + sizeof(int32_t))
+		+ (2 * (uint64_t)h->maxid + 2) * sizeof(int32_t) + h->namelen;
+	if (h->nspe < 0 || h->nspe > 64 || h->maxid < 0 || h->njoin < 0 || need != db->im.size
+		|| (h->namelen > 0 && db->im.p[db->im.size-1] != '\0')) {
+		unmap_file(&db->im);
+		Safefree(db);
+		croak("%s: truncated or damaged join database\n", fname);
+	}
+	db->nspe = h->nspe;
+	db->maxid = h->maxid;
+	db->mask = (const uint64_t *)(h + 1);
+	db->offset = (const int32_t *)(db->mask + h->njoin);
+	db->partner = db->offset + 2 * h->maxid + 2;
+	p = (const char *)(db->partner + h->njoin);
+	for (i = 0; i < db->nspe && p < db->im.p + db->im.size; i++) {
+		db->name[i] = p;
+		p += strlen(p) + 1;
+	}
+	db->nspe = i;
+	return db;
+}
+
+static int joins_bit(pTHX_ const struct joins *db, const char *spc)
+{
+	int i;
+
+	for (i = 0; i < db->nspe; i++)
+		if (strcmp(db->name[i], spc) == 0)
+			return i;
+	croak("%s is not in the join database\n", spc);
+	return -1;
+}
+
+static uint64_t joins_mask(const struct joins *db, int x, int y)
+{
+	int32_t k, end;
+
+	if (x < -db->maxid || x > db->maxid)
+		return 0;
+	for (k = db->offset[x + db->maxid], end = db->offset[x + db->maxid + 1]; k < end; k++) {
+		if (db->partner[k] == y)
+			return db->mask[k];
+		if (db->partner[k] > y)
+			break;
+	}
+	return 0;
+}
+
+// the first block end joined to block end x in the species, 0 for none
+static int joins_partner(const struct joins *db, int bit, int x)
+{
+	int32_t k, end;
+
+	if (x == 0 || x < -db->maxid || x > db->maxid)
+		return 0;
+	for (k = db->offset[x + db->maxid], end = db->offset[x + db->maxid + 1]; k < end; k++)
+		if (db->partner[k] != 0 && ((db->mask[k] >> bit) & 1))
+			return db->partner[k];
+	return 0;
+}
+
+/* ------------------------------------------------------- block lists */
+
+struct blockfile_header {
+	char magic[8];
+	uint32_t style, nspe, nblock, nseg, ncid, nname, namelen;
+};
+
+struct bf_block {
+	int32_t id;
+	uint32_t seg, nseg;
+};
+
+struct bf_seg {
+	int32_t beg, end, id, subid, chid, chnum;
+	uint32_t cid, chr;
+	uint16_t spe;
+	char orient, state;
+};
+
+struct blocks {
+	struct image im;
+	const struct blockfile_header *h;
+	const struct bf_block *blk;
+	const struct bf_seg *seg;
+	const uint32_t *nameoff;
+	const char *names;
+	struct byid {
+		int32_t id;
+		uint32_t blk;
+	} *byid;			// the blocks in the order of their ids
+};
+
+static int byid_cmp(const void *a, const void *b)
+{
+	int32_t x = ((const struct byid *)a)->id, y = ((const struct byid *)b)->id;
+
+	return (x > y) - (x < y);
+}
+
+static struct blocks *open_blocks(pTHX_ const char *fname)
+{
+	const struct blockfile_header *h;
+	struct blocks *bl;
+	uint64_t need;
+	uint32_t i;
+
+	Newxz(bl, 1, struct blocks);
+	map_file(aTHX_ &bl->im, fname);
+	h = (const struct blockfile_header *)bl->im.p;
+	if (bl->im.size < sizeof(*h) || memcmp(h->magic, "DSCHBL1\0", 8) != 0) {
+		unmap_file(&bl->im);
+		Safefree(bl);
+		croak("%s: not a binary block list, or written by another version\n", fname);
+	}
+	need = sizeof(*h) + (uint64_t)h->nblock * sizeof(struct bf_block)
+		+ (uint64_t)h->nseg * sizeof(struct bf_seg) + (uint64_t)h->ncid * sizeof(int32_t)
+		+ (uint64_t)h->nname * sizeof(uint32_t) + h->namelen;
+	if (need != bl->im.size || h->nspe > h->nname || h->namelen == 0
+		|| bl->im.p[bl->im.size-1] != '\0') {
+		unmap_file(&bl->im);
+		Safefree(bl);
+		croak("%s: truncated or damaged block list\n", fname);
+	}
+	bl->h = h;
+	bl->blk = (const struct bf_block *)(h + 1);
+	bl->seg = (const struct bf_seg *)(bl->blk + h->nblock);
+	bl->nameoff = (const uint32_t *)((const int32_t *)(bl->seg + h->nseg) + h->ncid);
+	bl->names = (const char *)(bl->nameoff + h->nname);
+	for (i = 0; i < h->nname; i++)
+		if (bl->nameoff[i] >= h->namelen) {
+			unmap_file(&bl->im);
+			Safefree(bl);
+			croak("%s: damaged block list\n", fname);
+		}
+	for (i = 0; i < h->nblock; i++)
+		if ((uint64_t)bl->blk[i].seg + bl->blk[i].nseg > h->nseg) {
+			unmap_file(&bl->im);
+			Safefree(bl);
+			croak("%s: damaged block list\n", fname);
+		}
+
+	Newx(bl->byid, h->nblock + 1, struct byid);
+	for (i = 0; i < h->nblock; i++) {
+		bl->byid[i].id = bl->blk[i].id;
+		bl->byid[i].blk = i;
+	}
+	qsort(bl->byid, h->nblock, sizeof(struct byid), byid_cmp);
+	return bl;
+}
+
+// the block with the id, NULL if there is none
+static const struct bf_block *find_block(const struct blocks *bl, int id)
+{
+	uint32_t lo = 0, hi = bl->h->nblock, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (bl->byid[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < bl->h->nblock && bl->byid[lo].id == id)
+		return &bl->blk[bl->byid[lo].blk];
+	return NULL;
+}
+
+/* ---------------------------------------------------------------- scores */
+
+// a score of block_consscores.txt, by the adjacency it was given for
+struct score {
+	int32_t a, b;
+	uint32_t line;		// a later line overrides an earlier one
+	uint32_t off, len;	// the text of the score
+};
+
+struct scores {
+	struct image im;
+	struct score *s;
+	size_t n;
+};
+
+static int score_cmp(const void *p, const void *q)
+{
+	const struct score *x = p, *y = q;
+
+	if (x->a != y->a)
+		return (x->a > y->a) - (x->a < y->a);
+	if (x->b != y->b)
+		return (x->b > y->b) - (x->b < y->b);
+	return (x->line > y->line) - (x->line < y->line);
+}
+
+static int is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static struct scores *open_scores(pTHX_ const char *fname)
+{
+	struct scores *sc;
+	const char *p, *end, *eol, *f[3];
+	size_t max = 0, i, n;
+	uint32_t line = 0;
+	long a, b;
+	char *e;
+	int k;
+
+	Newxz(sc, 1, struct scores);
+	map_file(aTHX_ &sc->im, fname);
+	p = sc->im.p;
+	end = p + sc->im.size;
+	for ( ; p < end; p = eol + 1, line++) {
+		if ((eol = memchr(p, '\n', end - p)) == NULL)
+			eol = end;
+		// the first three whitespace separated fields: b1 b2 score
+		for (k = 0; k < 3; k++) {
+			while (p < eol && is_blank(*p))
+				p++;
+			if (p == eol)
+				break;
+			f[k] = p;
+			while (p < eol && !is_blank(*p))
+				p++;
+		}
+		if (k < 3)
+			continue;
+		a = strtol(f[0], &e, 10);
+		if (e == f[0] || !is_blank(*e))
+			continue;
+		b = strtol(f[1], &e, 10);
+		if (e == f[1] || !is_blank(*e))
+			continue;
+		if (sc->n + 2 > max) {
+			max = max ? 2 * max : 1024;
+			Renew(sc->s, max, struct score);
+		}
+		// the adjacency is read from either side
+		sc->s[sc->n].a = a;
+		sc->s[sc->n].b = b;
+		sc->s[sc->n+1].a = -b;
+		sc->s[sc->n+1].b = -a;
+		for (k = 0; k < 2; k++) {
+			sc->s[sc->n+k].line = line;
+			sc->s[sc->n+k].off = f[2] - sc->im.p;
+			sc->s[sc->n+k].len = p - f[2];
+		}
+		sc->n += 2;
+	}
+	if (sc->n > 0)
+		qsort(sc->s, sc->n, sizeof(struct score), score_cmp);
+	// the last score given for each adjacency
+	for (i = n = 0; i < sc->n; i++) {
+		if (n > 0 && sc->s[n-1].a == sc->s[i].a && sc->s[n-1].b == sc->s[i].b)
+			sc->s[n-1] = sc->s[i];
+		else
+			sc->s[n++] = sc->s[i];
+	}
+	sc->n = n;
+	return sc;
+}
+
+static const struct score *find_score(const struct scores *sc, int a, int b)
+{
+	size_t lo = 0, hi = sc->n, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (sc->s[mid].a < a || (sc->s[mid].a == a && sc->s[mid].b < b))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < sc->n && sc->s[lo].a == a && sc->s[lo].b == b)
+		return &sc->s[lo];
+	return NULL;
+}
+
+// the object of a handle of the class
+static void *handle(pTHX_ SV *sv, const char *class)
+{
+	if (!sv_isobject(sv) || !sv_derived_from(sv, class))
+		croak("not a %s\n", class);
+	return INT2PTR(void *, SvIV(SvRV(sv)));
+}
+
+MODULE = DschIndex		PACKAGE = DschIndex::Joins
+
+PROTOTYPES: DISABLE
+
+SV *
+new(class, fname)
+		const char *class
+		const char *fname
+	CODE:
+		RETVAL = sv_setref_pv(newSV(0), class, open_joins(aTHX_ fname));
+	OUTPUT:
+		RETVAL
+
+UV
+join_mask(db, x, y)
+		struct joins *db
+		int x
+		int y
+	CODE:
+		RETVAL = joins_mask(db, x, y);
+	OUTPUT:
+		RETVAL
+
+int
+has_join(db, spc, x, y)
+		struct joins *db
+		const char *spc
+		int x
+		int y
+	CODE:
+		RETVAL = (joins_mask(db, x, y) >> joins_bit(aTHX_ db, spc)) & 1;
+	OUTPUT:
+		RETVAL
+
+SV *
+join_partner(db, spc, x)
+		struct joins *db
+		const char *spc
+		int x
+	PREINIT:
+		int y;
+	CODE:
+		y = joins_partner(db, joins_bit(aTHX_ db, spc), x);
+		RETVAL = (y != 0) ? newSViv(y) : newSV(0);
+	OUTPUT:
+		RETVAL
+
+int
+has_block(db, spc, id)
+		struct joins *db
+		const char *spc
+		int id
+	PREINIT:
+		int bit;
+	CODE:
+		bit = joins_bit(aTHX_ db, spc);
+		RETVAL = id != 0 && (joins_partner(db, bit, id) != 0 || joins_partner(db, bit, -id) != 0);
+	OUTPUT:
+		RETVAL
+
+void
+join_spc(db)
+		struct joins *db
+	PREINIT:
+		int i;
+	PPCODE:
+		EXTEND(SP, db->nspe);
+		for (i = 0; i < db->nspe; i++)
+			PUSHs(sv_2mortal(newSVpv(db->name[i], 0)));
+
+void
+DESTROY(db)
+		struct joins *db
+	CODE:
+		unmap_file(&db->im);
+		Safefree(db);
+
+MODULE = DschIndex		PACKAGE = DschIndex::Blocks
+
+SV *
+new(class, fname)
+		const char *class
+		const char *fname
+	CODE:
+		RETVAL = sv_setref_pv(newSV(0), class, open_blocks(aTHX_ fname));
+	OUTPUT:
+		RETVAL
+
+void
+block_ids(bl)
+		struct blocks *bl
+	PREINIT:
+		uint32_t i;
+	PPCODE:
+		EXTEND(SP, bl->h->nblock);
+		for (i = 0; i < bl->h->nblock; i++)
+			PUSHs(sv_2mortal(newSViv(bl->blk[i].id)));
+
+void
+block_coords(bl, id, spc)
+		struct blocks *bl
+		int id
+		const char *spc
+	PREINIT:
+		const struct bf_block *b;
+		const struct bf_seg *s;
+		uint32_t k;
+		AV *av;
+	PPCODE:
+		b = find_block(bl, id);
+		if (b != NULL)
+			for (k = b->seg; k < b->seg + b->nseg; k++) {
+				s = &bl->seg[k];
+				if (s->spe >= bl->h->nspe || s->chr >= bl->h->nname
+					|| strcmp(bl->names + bl->nameoff[s->spe], spc) != 0)
+					continue;
+				av = newAV();
+				av_push(av, newSVpv(bl->names + bl->nameoff[s->chr], 0));
+				av_push(av, newSViv(s->beg));
+				av_push(av, newSViv(s->end));
+				av_push(av, newSVpvn(&s->orient, 1));
+				XPUSHs(sv_2mortal(newRV_noinc((SV *)av)));
+			}
+
+void
+DESTROY(bl)
+		struct blocks *bl
+	CODE:
+		unmap_file(&bl->im);
+		Safefree(bl->byid);
+		Safefree(bl);
+
+MODULE = DschIndex		PACKAGE = DschIndex::Scores
+
+SV *
+new(class, fname)
+		const char *class
+		const char *fname
+	CODE:
+		RETVAL = sv_setref_pv(newSV(0), class, open_scores(aTHX_ fname));
+	OUTPUT:
+		RETVAL
+
+SV *
+score(sc, a, b)
+		struct scores *sc
+		int a
+		int b
+	PREINIT:
+		const struct score *s;
+	CODE:
+		s = find_score(sc, a, b);
+		RETVAL = (s != NULL) ? newSVpvn(sc->im.p + s->off, s->len) : newSV(0);
+	OUTPUT:
+		RETVAL
+
+void
+DESTROY(sc)
+		struct scores *sc
+	CODE:
+		unmap_file(&sc->im);
+		Safefree(sc->s);
+		Safefree(sc);
+
+MODULE = DschIndex		PACKAGE = DschIndex
+
+UV
+end_id(x)
+		int x
+
+int
+id_end(e)
+		UV e
+
+UV
+adj_key(x, y)
+		int x
+		int y
+
+UV
+adj_canon(x, y)
+		int x
+		int y
+
+void
+adj_ends(k)
+		UV k
+	PPCODE:
+		EXTEND(SP, 2);
+		PUSHs(sv_2mortal(newSViv(adj_first(k))));
+		PUSHs(sv_2mortal(newSViv(adj_second(k))));
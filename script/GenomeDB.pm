@@ -0,0 +1,74 @@
+package GenomeDB;
+
+# Reads the genome orders createGenomeFile writes next to Genomes.Order
+# (Genomes.db; its layout is in code/makeBlocks/genomedb.h): for every
+# genome, its chromosomes and the signed block ids along each. The file
+# is read in one go and the orders unpacked as they are asked for, so
+# the scripts that walk the adjacencies of Genomes.Order need not parse
+# the text.
+
+use strict;
+use warnings;
+use Exporter 'import';
+
+our @EXPORT = qw(read_genomedb genome_names genome_chroms);
+
+# read_genomedb(file): the database
+sub read_genomedb {
+	my $f = shift;
+
+	open(my $fh, "<:raw", $f) or die "cannot open $f\n";
+	local $/;
+	my $data = <$fh>;
+	close($fh);
+
+	my ($magic, $ngenome, $nchrom, $norder, $namelen) = unpack("a8 l4", $data);
+	if (!defined($namelen) || $magic ne "DSCHGO1\0") {
+		die "$f: not a genome database, or written by another version\n";
+	}
+	my $gpos = 24;
+	my $cpos = $gpos + 4*($ngenome + 1);
+	my $opos = $cpos + 4*($nchrom + 1);
+	my $npos = $opos + 4*$norder;
+	if (length($data) != $npos + $namelen) {
+		die "$f: truncated or damaged genome database\n";
+	}
+	my @names = split(/\0/, substr($data, $npos), -1);
+	pop(@names);
+	if (scalar(@names) != $ngenome + $nchrom) {
+		die "$f: truncated or damaged genome database\n";
+	}
+	my %index = ();
+	for (my $i = $ngenome - 1; $i >= 0; $i--) { $index{$names[$i]} = $i; }
+
+	return { data => $data, ngenome => $ngenome,
+		gfirst => [unpack("l" . ($ngenome + 1), substr($data, $gpos))],
+		cfirst => [unpack("l" . ($nchrom + 1), substr($data, $cpos))],
+		opos => $opos, names => [@names[0 .. $ngenome - 1]],
+		chroms => [@names[$ngenome .. $#names]], index => \%index };
+}
+
+# genome_names(db): the genomes, in the order of Genomes.Order
+sub genome_names {
+	my $db = shift;
+	return @{$$db{names}};
+}
+
+# genome_chroms(db, genome): the chromosomes of the (first) genome of that
+# name as [name, block ids...], none if there is no such genome
+sub genome_chroms {
+	my ($db, $spc) = @_;
+	my @chroms = ();
+
+	if (!defined($$db{index}{$spc})) { return @chroms; }
+	my $g = $$db{index}{$spc};
+	my $cfirst = $$db{cfirst};
+	for (my $c = $$db{gfirst}[$g]; $c < $$db{gfirst}[$g+1]; $c++) {
+		my $n = $$cfirst[$c+1] - $$cfirst[$c];
+		my @ids = ($n > 0) ? unpack("l$n", substr($$db{data}, $$db{opos} + 4*$$cfirst[$c], 4*$n)) : ();
+		push(@chroms, [$$db{chroms}[$c], @ids]);
+	}
+	return @chroms;
+}
+
+1;
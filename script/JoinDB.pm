@@ -0,0 +1,81 @@
+package JoinDB;
+
+# Reads the join database createGenomeFile writes next to the species .joins
+# files (Joins.db; its layout is in code/makeBlocks/joindb.h): for every
+# block end, the ends joined to it and, for each, the species that have the
+# join as a bit mask in config order. The file is read in one go and looked
+# up where it lies, as split_weak_joins.pl and ext_join_info.pl ask for the
+# species of a join.
+
+use strict;
+use warnings;
+use Exporter 'import';
+
+our @EXPORT = qw(read_joindb join_mask spc_mask spc_count spc_names);
+
+# read_joindb(file): the database
+sub read_joindb {
+	my $f = shift;
+
+	open(my $fh, "<:raw", $f) or die "cannot open $f\n";
+	local $/;
+	my $data = <$fh>;
+	close($fh);
+
+	my ($magic, $nspe, $maxid, $njoin, $namelen) = unpack("a8 l4", $data);
+	if (!defined($namelen) || $magic ne "DSCHJN1\0") {
+		die "$f: not a join database, or written by another version\n";
+	}
+	my $maskpos = 24;
+	my $offpos = $maskpos + 8*$njoin;
+	my $partpos = $offpos + 4*(2*$maxid + 2);
+	if (length($data) != $partpos + 4*$njoin + $namelen) {
+		die "$f: truncated or damaged join database\n";
+	}
+	my @names = split(/\0/, substr($data, $partpos + 4*$njoin));
+	my %bit = ();
+	for (my $i = 0; $i <= $#names; $i++) { $bit{$names[$i]} = $i; }
+
+	return { data => $data, maxid => $maxid, maskpos => $maskpos,
+		offpos => $offpos, partpos => $partpos, names => \@names, bit => \%bit };
+}
+
+# join_mask(db, end1, end2): the species that have the join
+sub join_mask {
+	my ($db, $x, $y) = @_;
+	my $maxid = $$db{maxid};
+
+	if ($x < -$maxid || $x > $maxid) { return 0; }
+	my ($k, $end) = unpack("l2", substr($$db{data}, $$db{offpos} + 4*($x + $maxid), 8));
+	for ( ; $k < $end; $k++) {
+		my $p = unpack("l", substr($$db{data}, $$db{partpos} + 4*$k, 4));
+		if ($p == $y) { return unpack("Q", substr($$db{data}, $$db{maskpos} + 8*$k, 8)); }
+		if ($p > $y) { last; }
+	}
+	return 0;
+}
+
+# spc_mask(db, species...): the mask of the species
+sub spc_mask {
+	my ($db, @spcs) = @_;
+	my $m = 0;
+	foreach my $spc (@spcs) {
+		my $b = $$db{bit}{$spc};
+		if (!defined($b)) { die "$spc is not in the join database\n"; }
+		$m |= 1 << $b;
+	}
+	return $m;
+}
+
+# spc_count(mask): the number of species in it
+sub spc_count {
+	return unpack("%32b*", pack("Q", shift));
+}
+
+# spc_names(db, mask, species...): those of the species in the mask, in order
+sub spc_names {
+	my ($db, $m, @spcs) = @_;
+	return grep { ($m >> $$db{bit}{$_}) & 1 } @spcs;
+}
+
+1;
@@ -0,0 +1,166 @@
+package MergeMap;
+
+# Merges the consecutive blocks of an APCF mapping file (APCF_<spc>.map)
+# that stay consecutive, on the same chromosome and in the same direction,
+# in the species, as merge_pos3ex.wogaps.pl and merge_pos3ex.ref.wogaps.pl
+# do; and splits the blocks of an outgroup map that have more than one
+# outgroup block, as split_ospc_map.pl does. The map files are read as
+# they go; the order of the species blocks on each chromosome is worked
+# out once, before the merge.
+
+use strict;
+use warnings;
+use List::Util qw(min max);
+use Exporter 'import';
+
+our @EXPORT = qw(merge_map split_map);
+
+# merge_map(ancestor prefix, species prefix, map file, output handle)
+sub merge_map {
+	my ($ref_prefix, $tar_prefix, $src_f, $out) = @_;
+
+	# the rank of each block start on its chromosome; a start that is not
+	# there ranks after all of them
+	my %hs_blockpos = ();
+	open(my $fh, "<", $src_f) or die "cannot open $src_f\n";
+	while(<$fh>) {
+		chomp;
+		if ($_ =~ /$tar_prefix\.(\S+):(\S+)\-(\S+) (\S+)/) {
+			$hs_blockpos{$1}{$2} = $3;
+		}
+	}
+	close($fh);
+	my %hs_rank = ();
+	my %hs_count = ();
+	foreach my $chr (keys %hs_blockpos) {
+		my @starts = sort {$a<=>$b} keys %{$hs_blockpos{$chr}};
+		for (my $i = 0; $i <= $#starts; $i++) {
+			$hs_rank{$chr}{$starts[$i]} = $i;
+		}
+		$hs_count{$chr} = scalar(@starts);
+	}
+	my $ordernum = sub {
+		my ($chr, $start) = @_;
+		my $rank = $hs_rank{$chr}{$start};
+		return defined($rank) ? $rank : $hs_count{$chr};
+	};
+
+	my $segid = 1;
+	my ($prchr, $prstart, $prend, $prdir) = ("", "", "", "");
+	my ($ptchr, $ptstart, $ptend, $ptdir) = ("", "", "", "");
+	my $ptsub_start = -1;
+	my ($ref_chr, $ref_start, $ref_end, $ref_dir);
+	my ($tar_chr, $tar_start, $tar_end, $tar_dir);
+	# prints the merged block so far and starts a new one at the current block
+	my $flush = sub {
+		print $out ">$segid\n";
+		print $out "$ref_prefix.$prchr:$prstart-$prend $prdir\n";
+		print $out "$tar_prefix.$ptchr:$ptstart-$ptend $ptdir\n\n";
+		$segid++;
+		($prchr, $prstart, $prend, $prdir) = ($ref_chr, $ref_start, $ref_end, $ref_dir);
+		($ptchr, $ptstart, $ptend, $ptdir) = ($tar_chr, $tar_start, $tar_end, $tar_dir);
+		$ptsub_start = $ptstart;
+	};
+
+	open($fh, "<", $src_f) or die "cannot open $src_f\n";
+	while(my $line = <$fh>) {
+		if ($line !~ /^>/) { next; }
+		my $ref_line = <$fh>;
+		my $tar_line = <$fh>;
+		chomp($ref_line, $tar_line);
+		$ref_line =~ /$ref_prefix\.(\S+):(\S+)\-(\S+) (\S+)/;
+		($ref_chr, $ref_start, $ref_end, $ref_dir) = ($1, $2, $3, $4);
+		$tar_line =~ /$tar_prefix\.(\S+):(\S+)\-(\S+) (\S+)/;
+		($tar_chr, $tar_start, $tar_end, $tar_dir) = ($1, $2, $3, $4);
+
+		if (length($prchr) == 0) {
+			($prchr, $prstart, $prend, $prdir) = ($ref_chr, $ref_start, $ref_end, $ref_dir);
+			($ptchr, $ptstart, $ptend, $ptdir) = ($tar_chr, $tar_start, $tar_end, $tar_dir);
+			$ptsub_start = $ptstart;
+		} elsif ($prchr ne $ref_chr || $ptchr ne $tar_chr || $ptdir ne $tar_dir) {
+			# the previous chromosome or run ends here
+			$flush->();
+		} elsif (abs($ordernum->($tar_chr, $ptsub_start) - $ordernum->($tar_chr, $tar_start)) != 1) {
+			# not next to each other in the species
+			$flush->();
+		} else {
+			my $pmin = min($ptstart, $ptend, $tar_start, $tar_end);
+			my $pmax = max($ptstart, $ptend, $tar_start, $tar_end);
+			if ($tar_dir eq "+" && $pmin == $ptstart && $pmax == $tar_end) {
+				$ptsub_start = $tar_start;
+				$prend = $ref_end;
+				$ptend = $tar_end;
+			} elsif ($tar_dir ne "+" && $pmin == $tar_start && $pmax == $ptend) {
+				$ptsub_start = $tar_start;
+				$prend = $ref_end;
+				$ptstart = $tar_start;
+			} else {
+				$flush->();
+			}
+		}
+	}
+	close($fh);
+
+	print $out ">$segid\n";
+	print $out "$ref_prefix.$prchr:$prstart-$prend $prdir\n";
+	print $out "$tar_prefix.$ptchr:$ptstart-$ptend $ptdir\n\n";
+}
+
+# split_map(ancestor prefix, map file, output handle): an ancestor block
+# with several outgroup blocks becomes one block per outgroup block, cut
+# in proportion to their lengths
+sub split_map {
+	my ($ancstr, $src_f, $out) = @_;
+
+	my $bid = 1;
+	my ($achr, $astart, $aend, $adir) = ("",-1,-1,"");
+	my @tblocks = ();
+	open(my $fh, "<", $src_f) or die "cannot open $src_f\n";
+	while(<$fh>) {
+		chomp;
+		if ($_ =~ /^>/) { next; }
+		if (length($_) == 0) {
+			if (scalar(@tblocks) == 1) {
+				# only one target block
+				print $out ">$bid\n";
+				print $out "$ancstr.$achr:$astart-$aend $adir\n";
+				print $out "$tblocks[0]\n";
+				print $out "\n";
+				$bid++;
+			} else {
+				# more than one target blocks
+				my $total_alen = $aend - $astart;
+				my $total_tlen = 0;
+				foreach my $tblock (@tblocks) {
+					$tblock =~ /(\S+)\.(\S+):(\S+)\-(\S+) (\S+)/;
+					$total_tlen += $4 - $3;
+				}
+
+				my ($new_astart, $new_aend) = ($astart, -1);
+				for (my $i = 0; $i <= $#tblocks; $i++) {
+					my $tblock = $tblocks[$i];
+					$tblock =~ /(\S+)\.(\S+):(\S+)\-(\S+) (\S+)/;
+					my $tlen = $4 - $3;
+					my $alen = int($total_alen * $tlen / $total_tlen);
+					$new_aend = $new_astart + $alen;
+					if ($i == $#tblocks) { $new_aend = $aend; }
+
+					print $out ">$bid\n";
+					print $out "$ancstr.$achr:$new_astart-$new_aend $adir\n";
+					print $out "$tblock\n";
+					print $out "\n";
+					$bid++;
+					$new_astart = $new_aend;
+				}
+			}
+			@tblocks = ();
+		} elsif ($_ =~ /$ancstr\.(\S+):(\S+)\-(\S+) (\S+)/) {
+			($achr, $astart, $aend, $adir) = ($1,$2,$3,$4);
+		} else {
+			push(@tblocks, $_);
+		}
+	}
+	close($fh);
+}
+
+1;
@@ -0,0 +1,96 @@
+package SpcConfig;
+
+# The config.file of a run, read once and handed to the steps that need
+# its species: ext_spcgroups.pl, create_gfile.pl, estimate_bpdist4.pl and
+# wrap_recon_apcf.pl. The lines are kept as they were read, so that a
+# variant of the file (a species left out, an outgroup taken as an
+# ingroup) is written from them in the same process, line for line as
+# the sed commands the scripts ran before made it.
+
+use strict;
+use warnings;
+use File::Copy;
+use Exporter 'import';
+
+our @EXPORT = qw(read_config config_ingroup config_outgroup write_config
+	write_spcgroups write_genome_file);
+
+# read_config(file): {file, lines => [...], species => [names in file order],
+# tag => {name => tag}}; dies on a species tag other than 0, 1 or 2
+sub read_config {
+	my $f = shift;
+	my %cfg = (file => $f, lines => [], species => [], tag => {});
+
+	open(my $fh, "<", $f) or die "cannot open $f\n";
+	while(<$fh>) {
+		push(@{$cfg{lines}}, $_);
+		chomp;
+		if (length($_) == 0 || $_ =~ /^#/) { next; }
+		if ($_ =~ /^(\S+)\s+(\d)/) {
+			my ($spc, $type) = ($1, $2);
+			if ($type > 2) { die "Parse error: $f\n"; }
+			push(@{$cfg{species}}, $spc);
+			$cfg{tag}{$spc} = $type;
+		}
+	}
+	close($fh);
+	return \%cfg;
+}
+
+sub config_ingroup {
+	my $cfg = shift;
+	return grep { $cfg->{tag}{$_} != 2 } @{$cfg->{species}};
+}
+
+sub config_outgroup {
+	my $cfg = shift;
+	return grep { $cfg->{tag}{$_} == 2 } @{$cfg->{species}};
+}
+
+# write_config(config, file, hide => [species], ingroup => [species]):
+# the config file with the lines of the hidden species commented out and
+# the outgroups given as ingroup tagged 1
+sub write_config {
+	my ($cfg, $f, %opt) = @_;
+
+	open(my $fh, ">", $f) or die "cannot write $f\n";
+	foreach my $line (@{$cfg->{lines}}) {
+		my $l = $line;
+		foreach my $spc (@{$opt{hide} || []}) {
+			$l =~ s/^\Q$spc\E[^\S\n]+/#$spc /;
+		}
+		foreach my $spc (@{$opt{ingroup} || []}) {
+			$l =~ s/\Q$spc\E[^\S\n]+2/$spc 1/;
+		}
+		print $fh $l;
+	}
+	close($fh) or die "cannot write $f\n";
+}
+
+# write_spcgroups(config, dir): dir/ingroup.txt and dir/outgroup.txt
+sub write_spcgroups {
+	my ($cfg, $dir) = @_;
+
+	open(my $fh, ">", "$dir/ingroup.txt") or die "cannot write $dir/ingroup.txt\n";
+	print $fh map { "$_\n" } config_ingroup($cfg);
+	close($fh);
+	open($fh, ">", "$dir/outgroup.txt") or die "cannot write $dir/outgroup.txt\n";
+	print $fh map { "$_\n" } config_outgroup($cfg);
+	close($fh);
+}
+
+# write_genome_file(dir, outgroups): dir/Genomes.Order.new, the genome file
+# with an empty genome (its joins are in the .joins files) for each outgroup
+sub write_genome_file {
+	my ($dir, @outgroup) = @_;
+	my $f = "$dir/Genomes.Order.new";
+
+	copy("$dir/Genomes.Order", $f) or die "cannot copy $dir/Genomes.Order: $!\n";
+	open(my $fh, ">>", $f) or die "cannot write $f\n";
+	foreach my $spc (@outgroup) {
+		print $fh ">$spc 0\n# in .joins file\n\n";
+	}
+	close($fh) or die "cannot write $f\n";
+}
+
+1;
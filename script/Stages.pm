@@ -0,0 +1,505 @@
+package Stages;
+
+# Runs a stage of the pipeline unless it already ran on the same inputs.
+# A stage leaves a manifest next to its outputs: its command (with the
+# parameters), the digests of its tools and of its inputs, and its
+# outputs. When the manifest is unchanged and the outputs are all there
+# the stage is skipped; a stage whose inputs came out the same as before
+# from a stage that ran again is skipped as well. Remove the .stage.*
+# files to run everything again.
+#
+# With DESCHRAMBLER_REPORT naming a file, every command runs under
+# bench/runtime, and a line of JSON is appended to the file for each:
+# its name, command, directory and nesting (a command that a command
+# run here runs is a level deeper), its wall and CPU time, peak memory
+# and bytes read and written, and the steps that makeBlocks and
+# inferAdjProb report of themselves (through DESCHRAMBLER_STEPS). A
+# skipped stage has a line too. DESCHRAMBLER.pl makes run_report.json
+# of them. The name of the command is in DESCHRAMBLER_STAGE for it, for
+# the metrics bench/runtime and the tools write while it runs.
+#
+# With DESCHRAMBLER_BUDGET naming a ledger file (DESCHRAMBLER.pl -batch
+# makes one for the projects it runs together), a stage given a cost
+# waits until its threads, its memory and, for a stage that reads the
+# nets, one of the I/O slots fit in what the stages of all the projects
+# hold, and holds them while it runs. The memory of a tool is what
+# scanInputs predicted for it, passed in DESCHRAMBLER_COSTS.
+#
+# While a stage runs, the files the stage after it reads that are there
+# already (next => [...] of run_stage(), and in run_graph() the inputs of
+# the steps that come after a step) are read into the page cache by
+# code/makeBlocks/prefetchFiles, no more of them than half the free
+# memory holds so that the running stage keeps its pages, and within
+# DESCHRAMBLER_PREFETCH MB if that is a number; "no" reads none.
+#
+# With DESCHRAMBLER_INPROC set (DESCHRAMBLER.pl -batch -inproc), the Perl
+# scripts of the pipeline, run_script() and the steps of run_graph() given
+# a script, run in a fork of the process that runs them, which has the
+# modules they use loaded, rather than in a perl of their own; their
+# lines in the report have no more than the wall time then.
+
+use strict;
+use warnings;
+use Cwd;
+use Cwd 'abs_path';
+use Digest::MD5;
+use File::Basename;
+use File::Find;
+use FindBin ();
+use Fcntl qw(:flock SEEK_SET);
+use JSON::PP;
+use Time::HiRes;
+use Exporter 'import';
+
+our @EXPORT = qw(run_stage run_cmd run_script run_graph config_dirs stage_threads);
+
+my $Runtime = dirname(abs_path(__FILE__))."/../bench/runtime";
+my $Prefetch = dirname(abs_path(__FILE__))."/../code/makeBlocks/prefetchFiles";
+my $Nrec = 0;
+my $Nlease = 0;
+my $Nscript = 0;
+
+# run_stage(manifest file, command, inputs => [...], tools => [...], outputs => [...],
+#           dir => directory to run it in, key => what stands for the command
+#           in the manifest, if not all of it changes the outputs,
+#           cost => {tool => name in DESCHRAMBLER_COSTS, threads => n,
+#                    io => 1 if it reads the nets},
+#           next => files the stage after it reads, read ahead while it runs);
+# returns the output of the command
+sub run_stage {
+	my ($manifest_f, $cmd, %opt) = @_;
+	my $manifest = "cmd\t".(defined($opt{key}) ? $opt{key} : $cmd)."\n";
+	foreach my $f (@{$opt{tools} || []}) {
+		$manifest .= "tool\t$f\t".digest($f)."\n";
+	}
+	foreach my $f (@{$opt{inputs} || []}) {
+		$manifest .= "input\t$f\t".digest($f)."\n";
+	}
+	my $have = 1;
+	foreach my $f (@{$opt{outputs} || []}) {
+		$manifest .= "output\t$f\n";
+		if (!(-e $f)) { $have = 0; }
+	}
+
+	if ($have && -f $manifest_f) {
+		open(my $fh, "<", $manifest_f);
+		local $/;
+		my $old = <$fh>;
+		close($fh);
+		if ($old eq $manifest) {
+			print STDERR "Skipping $cmd (unchanged)\n";
+			skip_record(stage_name($manifest_f), $cmd, $opt{dir});
+			return "";
+		}
+	}
+
+	unlink($manifest_f);
+	# the progress of the long tools (code/makeBlocks/progress.h), for a monitor
+	local $ENV{"DESCHRAMBLER_STATUS"} = abs_path(dirname($manifest_f))."/".basename($manifest_f).".status";
+	my $curdir = getcwd;
+	if (defined($opt{dir})) { chdir($opt{dir}); }
+	my $lease = take_lease(stage_name($manifest_f), $opt{cost});
+	my $prefetch = start_prefetch(@{$opt{next} || []});
+	my $out = eval { run_cmd($cmd, stage_name($manifest_f)) };
+	my $err = $@;
+	end_prefetch($prefetch);
+	give_lease($lease);
+	chdir($curdir);
+	if ($err ne "") { die $err; }
+	open(my $fh, ">", $manifest_f);
+	print $fh $manifest;
+	close($fh);
+	return $out;
+}
+
+# the output of a command; dies if it fails. name is for the run report
+sub run_cmd {
+	my ($cmd, $name) = @_;
+	my $rec = start_record(defined($name) ? $name : cmd_name($cmd), $cmd);
+	local $ENV{"DESCHRAMBLER_STAGE"} = defined($name) ? $name : cmd_name($cmd);
+	my $out;
+	if (defined($rec)) {
+		local $ENV{"DESCHRAMBLER_STEPS"} = $rec->{steps_f};
+		local $ENV{"DESCHRAMBLER_REPORT_LEVEL"} = $rec->{level} + 1;
+		open(my $fh, "-|", $Runtime, "-o", $rec->{stat_f}, "/bin/sh", "-c", $cmd)
+			or die "cannot run $cmd\n";
+		local $/;
+		$out = <$fh>;
+		close($fh);
+	} else {
+		$out = `$cmd`;
+	}
+	my $status = $?;
+	end_record($rec, $status);
+	if ($status != 0) { die "failed ($status): $cmd\n"; }
+	return defined($out) ? $out : "";
+}
+
+# run_script(script, args...): run_cmd() of a Perl script of the pipeline,
+# with DESCHRAMBLER_INPROC in a fork of this process. An empty argument is
+# left out, as the shell leaves it out of the command
+sub run_script {
+	my ($script, @args) = @_;
+	@args = grep { defined($_) && $_ ne "" } @args;
+	my $cmd = join(" ", $script, @args);
+	if (!$ENV{"DESCHRAMBLER_INPROC"}) { return run_cmd($cmd); }
+	my $rec = start_record(cmd_name($cmd), $cmd);
+	my $pid = open(my $fh, "-|");
+	if (!defined($pid)) { die "cannot fork: $!\n"; }
+	if ($pid == 0) {
+		$ENV{"DESCHRAMBLER_STAGE"} = cmd_name($cmd);
+		if (defined($rec)) {
+			$ENV{"DESCHRAMBLER_STEPS"} = $rec->{steps_f};
+			$ENV{"DESCHRAMBLER_REPORT_LEVEL"} = $rec->{level} + 1;
+		}
+		do_script($script, @args);
+	}
+	local $/;
+	my $out = <$fh>;
+	close($fh);
+	my $status = $?;
+	end_record($rec, $status);
+	if ($status != 0) { die "failed ($status): $cmd\n"; }
+	return defined($out) ? $out : "";
+}
+
+# in a child: runs a Perl script as a perl of its own would, in a package
+# of its own so that its subs and globals are not those of the caller, and
+# exits with its status
+sub do_script {
+	my ($script, @args) = @_;
+	my $text;
+	if (open(my $fh, "<", $script)) {
+		local $/;
+		$text = <$fh>;
+		close($fh);
+	}
+	if (!defined($text)) {
+		print STDERR "cannot read $script\n";
+		CORE::exit(127);
+	}
+	@ARGV = @args;
+	$0 = $script;
+	$FindBin::Bin = $FindBin::RealBin = dirname(abs_path($script));
+	$FindBin::Script = $FindBin::RealScript = basename($script);
+	$Nscript++;
+	eval("package Stages::Script$Nscript;\n#line 1 \"$script\"\n$text\n;");
+	if ($@ ne "") {
+		print STDERR $@;
+		CORE::exit(255);
+	}
+	CORE::exit(0);
+}
+
+# run_graph(jobs, {name => ..., cmd => ..., after => [names], reads => [files],
+#                  temps => [files], inputs => [files],
+#                  script => [Perl script, args], stdout => file}, ...)
+# runs the commands, up to jobs at once, each once the ones it comes after
+# are done; dies when one fails, after the running ones finish. The temps
+# of a step, files it reads or writes, are intermediates: each is removed
+# as soon as the last step that reads it is done. The inputs of a step,
+# files it reads that no step makes, are read ahead while the steps it
+# comes after run. With DESCHRAMBLER_INPROC a step given a script runs it
+# (writing to stdout if given) instead of cmd, the same command
+sub run_graph {
+	my ($jobs, @todo) = @_;
+	my %done = ();
+	my %running = ();
+	my %prefetching = ();
+	my $failed = "";
+	my %readers = ();
+	foreach my $step (@todo) { foreach my $f (@{$step->{temps} || []}) { $readers{$f} = 0; } }
+	foreach my $step (@todo) {
+		foreach my $f (@{$step->{reads} || []}) { if (defined($readers{$f})) { $readers{$f}++; } }
+	}
+	if (!defined($jobs) || $jobs !~ /^\d+$/ || $jobs < 1) { $jobs = 1; }
+	while (@todo || %running) {
+		for (my $i = 0; $failed eq "" && $i <= $#todo && scalar(keys %running) < $jobs; ) {
+			my $step = $todo[$i];
+			if (grep { !$done{$_} } @{$step->{after} || []}) { $i++; next; }
+			splice(@todo, $i, 1);
+			my $rec = start_record($step->{name}, $step->{cmd});
+			my $pid = fork();
+			if (!defined($pid)) { die "cannot fork: $!\n"; }
+			if ($pid == 0) {
+				$ENV{"DESCHRAMBLER_STAGE"} = $step->{name};
+				if (defined($rec)) {
+					$ENV{"DESCHRAMBLER_STEPS"} = $rec->{steps_f};
+					$ENV{"DESCHRAMBLER_REPORT_LEVEL"} = $rec->{level} + 1;
+				}
+				if (defined($step->{script}) && $ENV{"DESCHRAMBLER_INPROC"}) {
+					if (defined($step->{stdout}) && !open(STDOUT, ">", $step->{stdout})) {
+						print STDERR "cannot write $step->{stdout}\n";
+						CORE::exit(1);
+					}
+					do_script(@{$step->{script}});
+				}
+				if (defined($rec)) {
+					exec($Runtime, "-o", $rec->{stat_f}, "/bin/sh", "-c", $step->{cmd});
+				}
+				exec("/bin/sh", "-c", $step->{cmd});
+				exit(127);
+			}
+			my @next = grep { my $s = $_; grep { $_ eq $step->{name} } @{$s->{after} || []} } @todo;
+			my $prefetch = start_prefetch(map { @{$_->{inputs} || []} } @next);
+			if (defined($prefetch)) { $prefetching{$prefetch} = 1; }
+			$running{$pid} = [$step, $rec, $prefetch];
+		}
+		if (!%running) {
+			if ($failed ne "") { die "failed: $failed\n"; }
+			die "cannot run: ".join(" ", map { $_->{name} } @todo)."\n";
+		}
+		my $pid = waitpid(-1, 0);
+		# a prefetch that is done is not stopped with its step
+		if (delete $prefetching{$pid}) { next; }
+		my $run = delete $running{$pid};
+		if (!defined($run)) { next; }
+		my $step = $run->[0];
+		my $status = $?;
+		end_record($run->[1], $status);
+		if (defined($run->[2]) && delete $prefetching{$run->[2]}) { end_prefetch($run->[2]); }
+		if ($status != 0) {
+			$failed = $step->{cmd};
+			@todo = ();
+		}
+		$done{$step->{name}} = 1;
+		if ($failed ne "") { next; }
+		foreach my $f (@{$step->{reads} || []}) {
+			if (defined($readers{$f}) && --$readers{$f} == 0) { unlink($f); }
+		}
+		foreach my $f (@{$step->{temps} || []}) {
+			if ($readers{$f} == 0) { unlink($f); }
+		}
+	}
+	if ($failed ne "") { die "failed: $failed\n"; }
+}
+
+# reads the files of the list that are there into the page cache, in a
+# process of its own; returns its pid for end_prefetch(), or undef
+sub start_prefetch {
+	my @files = grep { defined($_) && $_ ne "" && -e $_ } @_;
+	my $mb = defined($ENV{"DESCHRAMBLER_PREFETCH"}) ? $ENV{"DESCHRAMBLER_PREFETCH"} : "";
+	if (!@files || !(-x $Prefetch) || $mb eq "no" || $mb eq "0") { return undef; }
+	my $pid = fork();
+	if (!defined($pid)) { return undef; }
+	if ($pid == 0) {
+		open(STDOUT, ">", "/dev/null");
+		exec($Prefetch, ($mb =~ /^\d+$/ ? ("-mb", $mb) : ()), @files);
+		exit(127);
+	}
+	return $pid;
+}
+
+# stops a prefetch when the stage it ran alongside is done
+sub end_prefetch {
+	my $pid = shift;
+	if (!defined($pid)) { return; }
+	kill("TERM", $pid);
+	waitpid($pid, 0);
+}
+
+# the threads a tool given threads (or "" for its default) runs on
+sub stage_threads {
+	my $threads = shift;
+	if (!defined($threads) || $threads eq "") { $threads = $ENV{"DESCHRAMBLER_THREADS"} || `nproc`; }
+	chomp($threads);
+	return ($threads =~ /^\d+$/ && $threads > 0) ? $threads : 1;
+}
+
+# the cost of a stage as a lease of the ledger, or undef without one
+sub take_lease {
+	my ($name, $cost) = @_;
+	my $ledger = $ENV{"DESCHRAMBLER_BUDGET"};
+	if (!defined($cost) || !defined($ledger) || $ledger eq "") { return undef; }
+	my %mem = map { split(/=/) } split(/,/, $ENV{"DESCHRAMBLER_COSTS"} || "");
+	my $want = { id => "$$.".(++$Nlease), cpus => stage_threads($cost->{threads}),
+		mem => int($mem{$cost->{tool} || ""} || 0), io => $cost->{io} ? 1 : 0, since => time() };
+	my $told = 0;
+	while (!update_ledger($ledger, sub { return grant($want, @_); })) {
+		if (!$told++) {
+			print STDERR "Waiting to run $name ($want->{cpus} threads, $want->{mem} MB".
+				($want->{io} ? ", reading the nets" : "").")\n";
+		}
+		sleep(1);
+	}
+	return $want;
+}
+
+sub give_lease {
+	my $lease = shift;
+	if (!defined($lease)) { return; }
+	update_ledger($ENV{"DESCHRAMBLER_BUDGET"}, sub {
+		my ($budget, $leases, $waits) = @_;
+		@$leases = grep { $_->{id} ne $lease->{id} } @$leases;
+		return 1;
+	});
+}
+
+# whether a lease fits in what the others leave of the budget; one that
+# does not waits in the ledger, and once a stage has waited a minute the
+# ones that came after it wait for it
+sub grant {
+	my ($want, $budget, $leases, $waits) = @_;
+	my %used = (cpus => 0, mem => 0, io => 0);
+	foreach my $l (@$leases) { foreach my $k (keys %used) { $used{$k} += $l->{$k}; } }
+	my $fits = !@$leases || ($used{cpus} + $want->{cpus} <= $budget->{cpus}
+		&& $used{mem} + $want->{mem} <= $budget->{mem} && $used{io} + $want->{io} <= $budget->{io});
+	@$waits = grep { $_->{id} ne $want->{id} } @$waits;
+	if ($fits && !grep { $_->{since} < $want->{since} - 60 } @$waits) {
+		push(@$leases, $want);
+		return 1;
+	}
+	push(@$waits, $want);
+	return 0;
+}
+
+# calls fn(budget, leases, waits) with the ledger locked and writes back
+# what it leaves; the leases and waits of processes gone are dropped.
+# Returns what fn returns
+sub update_ledger {
+	my ($ledger, $fn) = @_;
+	open(my $fh, "+<", $ledger) or die "cannot open the ledger $ledger\n";
+	flock($fh, LOCK_EX) or die "cannot lock $ledger\n";
+	my %budget = ();
+	my (@leases, @waits);
+	while (<$fh>) {
+		my @f = split;
+		if (@f == 4 && $f[0] eq "budget") {
+			@budget{"cpus", "mem", "io"} = @f[1..3];
+		} elsif (@f == 6 && ($f[0] eq "lease" || $f[0] eq "wait")) {
+			my ($pid) = ($f[1] =~ /^(\d+)/);
+			if (!kill(0, $pid)) { next; }
+			my %l = (id => $f[1], cpus => $f[2], mem => $f[3], io => $f[4], since => $f[5]);
+			push(@{$f[0] eq "lease" ? \@leases : \@waits}, \%l);
+		}
+	}
+	if (!defined($budget{io})) { die "$ledger: no budget line\n"; }
+	my $ret = $fn->(\%budget, \@leases, \@waits);
+	seek($fh, 0, SEEK_SET);
+	truncate($fh, 0);
+	print $fh "budget $budget{cpus} $budget{mem} $budget{io}\n";
+	foreach my $l (@leases) { print $fh "lease $l->{id} $l->{cpus} $l->{mem} $l->{io} $l->{since}\n"; }
+	foreach my $l (@waits) { print $fh "wait $l->{id} $l->{cpus} $l->{mem} $l->{io} $l->{since}\n"; }
+	close($fh);
+	return $ret;
+}
+
+# the stage of a manifest, .stage.SFs -> SFs
+sub stage_name {
+	my $f = basename(shift);
+	$f =~ s/^\.stage\.//;
+	return $f;
+}
+
+# the program a command runs, for its name in the report
+sub cmd_name {
+	my ($prog) = (shift =~ /^\s*(\S+)/);
+	return defined($prog) ? basename($prog) : "";
+}
+
+# the temporary files of a command's record, or undef without a report
+sub start_record {
+	my ($name, $cmd) = @_;
+	my $report = $ENV{"DESCHRAMBLER_REPORT"};
+	if (!defined($report) || $report eq "" || !(-x $Runtime)) { return undef; }
+	$Nrec++;
+	my $base = "$report.$$.$Nrec";
+	unlink("$base.stat", "$base.steps");
+	return { name => $name, cmd => $cmd, dir => getcwd, stat_f => "$base.stat",
+		steps_f => "$base.steps", level => $ENV{"DESCHRAMBLER_REPORT_LEVEL"} || 0,
+		start => Time::HiRes::time() };
+}
+
+sub end_record {
+	my ($rec, $status) = @_;
+	if (!defined($rec)) { return; }
+	my %line = (name => $rec->{name}, cmd => $rec->{cmd}, dir => $rec->{dir},
+		level => $rec->{level} + 0, start => sprintf("%.3f", $rec->{start}) + 0,
+		status => $status >> 8);
+	if (open(my $fh, "<", $rec->{stat_f})) {
+		local $/;
+		my $stat = eval { decode_json(<$fh>) };
+		close($fh);
+		if (defined($stat)) {
+			foreach my $k (keys %$stat) { if ($k ne "status") { $line{$k} = $stat->{$k}; } }
+		}
+	}
+	# a script run in a fork has no bench/runtime to measure it
+	if (!defined($line{wall})) { $line{wall} = sprintf("%.3f", Time::HiRes::time() - $rec->{start}) + 0; }
+	if (open(my $fh, "<", $rec->{steps_f})) {
+		my @steps = ();
+		while (<$fh>) {
+			my $s = eval { decode_json($_) };
+			if (defined($s)) { push(@steps, $s); }
+		}
+		close($fh);
+		if (@steps) { $line{steps} = \@steps; }
+	}
+	unlink($rec->{stat_f}, $rec->{steps_f});
+	append_record(\%line);
+}
+
+sub skip_record {
+	my ($name, $cmd, $dir) = @_;
+	my $report = $ENV{"DESCHRAMBLER_REPORT"};
+	if (!defined($report) || $report eq "") { return; }
+	append_record({ name => $name, cmd => $cmd, dir => defined($dir) ? $dir : getcwd,
+		level => ($ENV{"DESCHRAMBLER_REPORT_LEVEL"} || 0) + 0,
+		start => sprintf("%.3f", Time::HiRes::time()) + 0, skipped => JSON::PP::true });
+}
+
+# a line is appended in one write, so processes running at once can share the file
+sub append_record {
+	my $line = JSON::PP->new->canonical->encode(shift)."\n";
+	open(my $fh, ">>", $ENV{"DESCHRAMBLER_REPORT"}) or return;
+	syswrite($fh, $line);
+	close($fh);
+}
+
+# the md5 of a file; for a directory, of the names, sizes and times of the
+# files in it (chain/net directories are too large to read every time),
+# leaving out the indexes and chain stores the tools keep there
+sub digest {
+	my $f = shift;
+	my $md5 = Digest::MD5->new;
+	if (-d $f) {
+		my @files = ();
+		find({ no_chdir => 1, follow => 1, wanted => sub {
+			if (-f $_ && $_ !~ /(\.idx|chain\.store[^\/]*)$/) { push(@files, $_); }
+		} }, $f);
+		foreach my $g (sort @files) {
+			my @st = stat($g);
+			$md5->add("$g\t$st[7]\t$st[9]\n");
+		}
+	} elsif (-f $f) {
+		open(my $fh, "<", $f);
+		binmode($fh);
+		$md5->addfile($fh);
+		close($fh);
+	} else {
+		return "missing";
+	}
+	return $md5->hexdigest;
+}
+
+# the net and chain directories of a config file, or its multiple
+# alignment (>maf), which the chains of the chain directory are made from
+sub config_dirs {
+	my $config_f = shift;
+	my %dirs = ();
+	my $sect = "";
+	open(my $fh, "<", $config_f);
+	while(<$fh>) {
+		chomp;
+		if ($_ =~ /^>(\S+)/) { $sect = $1; next; }
+		if ($_ =~ /^#/ || $_ !~ /\S/) { next; }
+		if (($sect eq "netdir" || $sect eq "chaindir" || $sect eq "maf") && !defined($dirs{$sect})) {
+			($dirs{$sect}) = ($_ =~ /(\S+)/);
+		}
+	}
+	close($fh);
+	if (defined($dirs{maf})) { return ($dirs{maf}); }
+	return grep { defined } ($dirs{netdir}, $dirs{chaindir});
+}
+
+1;
@@ -0,0 +1,117 @@
+#!/usr/bin/perl
+
+# coarse_adjs.pl - the adjacencies a coarser reconstruction fixes for a
+# finer one, for inferAdjProb -coarse. Each fine block is nested, by its
+# span on the reference, in the coarse block holding its middle; the
+# first and last fine blocks of a coarse block, in its orientation, carry
+# its ends. Every such end is printed alone ("x"), and every coarse
+# adjacency with at least min_prob (and no other for either end) as the
+# fine ends it joins ("x y", 0 a chromosome end).
+#
+#   usage: coarse_adjs.pl ref_spc coarse_sf_dir fine_sf_dir min_prob > file
+
+use strict;
+use warnings;
+
+my $ref_spc = shift;
+my $coarse_dir = shift;
+my $fine_dir = shift;
+my $min_prob = shift;
+if (!defined($min_prob)) {
+	die "usage: coarse_adjs.pl ref_spc coarse_sf_dir fine_sf_dir min_prob\n";
+}
+
+my %coarse = read_blocks("$coarse_dir/Conserved.Segments");
+my %fine = read_blocks("$fine_dir/Conserved.Segments");
+
+# the fine blocks of each coarse block, in its orientation and signed
+# by their orientation in it
+my %kids = ();
+my %by_chr = ();
+foreach my $id (keys %coarse) { push(@{$by_chr{$coarse{$id}[0]}}, $id); }
+foreach my $chr (keys %by_chr) {
+	@{$by_chr{$chr}} = sort { $coarse{$a}[1] <=> $coarse{$b}[1] } @{$by_chr{$chr}};
+}
+foreach my $id (sort { $fine{$a}[1] <=> $fine{$b}[1] } keys %fine) {
+	my ($chr, $start, $end, $dir) = @{$fine{$id}};
+	my $c = find_block($by_chr{$chr}, int(($start + $end) / 2));
+	if (!defined($c)) { next; }
+	push(@{$kids{$c}}, ($dir eq $coarse{$c}[3]) ? $id : -$id);
+}
+foreach my $c (keys %kids) {
+	if ($coarse{$c}[3] eq "-") { @{$kids{$c}} = reverse(@{$kids{$c}}); }
+}
+
+# the ends at the coarse boundaries, read as the first of an adjacency
+foreach my $c (sort { $a <=> $b } keys %kids) {
+	print "$kids{$c}[-1]\n";
+	print -$kids{$c}[0], "\n";
+}
+
+# the confident coarse adjacencies, each end in one at most
+my @adjs = ();
+my %uses = ();
+open(F, "$coarse_dir/adjacencies.prob") or die "cannot open $coarse_dir/adjacencies.prob\n";
+while (<F>) {
+	if ($_ =~ /^#/) { next; }
+	my ($x, $y, $p) = split(/\s+/);
+	if (!defined($p) || $p < $min_prob) { next; }
+	push(@adjs, [$x, $y]);
+	if ($x != 0) { $uses{$x}{$y} = 1; }
+	if ($y != 0) { $uses{-$y}{-$x} = 1; }
+}
+close(F);
+foreach my $a (@adjs) {
+	my ($x, $y) = @$a;
+	if (($x != 0 && scalar(keys %{$uses{$x}}) > 1) || ($y != 0 && scalar(keys %{$uses{-$y}}) > 1)) { next; }
+	my $fx = ($x == 0) ? 0 : last_end($x);
+	my $fy = ($y == 0) ? 0 : -last_end(-$y);
+	if (defined($fx) && defined($fy) && ($fx != 0 || $fy != 0)) { print "$fx $fy\n"; }
+}
+
+# the fine block (signed) at the right end of the coarse block x as read
+sub last_end {
+	my $x = shift;
+	my $k = $kids{abs($x)};
+	if (!defined($k)) { return undef; }
+	return ($x > 0) ? $$k[-1] : -$$k[0];
+}
+
+# the block of a sorted list holding pos, if any
+sub find_block {
+	my ($ids, $pos) = @_;
+	if (!defined($ids)) { return undef; }
+	my ($lo, $hi) = (0, $#$ids);
+	while ($lo <= $hi) {
+		my $mid = int(($lo + $hi) / 2);
+		my ($chr, $start, $end) = @{$coarse{$$ids[$mid]}};
+		if ($pos < $start) { $hi = $mid - 1; }
+		elsif ($pos > $end) { $lo = $mid + 1; }
+		else { return $$ids[$mid]; }
+	}
+	return undef;
+}
+
+# the span of every block on the reference: id => [chr, start, end, dir]
+sub read_blocks {
+	my $f = shift;
+	my %blocks = ();
+	my $id = 0;
+	open(F, "$f") or die "cannot open $f\n";
+	while (<F>) {
+		chomp;
+		if ($_ =~ /^>(\d+)/) {
+			$id = $1;
+		} elsif ($id > 0 && $_ =~ /^\Q$ref_spc\E\.(\S+):(\d+)\-(\d+) ([+-])/) {
+			my ($chr, $start, $end, $dir) = ($1, $2, $3, $4);
+			if (!defined($blocks{$id})) {
+				$blocks{$id} = [$chr, $start, $end, $dir];
+			} elsif ($blocks{$id}[0] eq $chr) {
+				if ($start < $blocks{$id}[1]) { $blocks{$id}[1] = $start; }
+				if ($end > $blocks{$id}[2]) { $blocks{$id}[2] = $end; }
+			}
+		}
+	}
+	close(F);
+	return %blocks;
+}
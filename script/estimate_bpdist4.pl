@@ -4,12 +4,24 @@ use strict;
 use warnings;
 use FindBin qw($Bin);
 use Cwd;
+use Cwd 'abs_path';
+use File::Copy;
+use File::Path qw(make_path);
+use lib "$Bin/../lib/perl";
+use lib "$Bin";
+use Parallel::ForkManager;
+use SpcConfig;
+use GenomeDB;
 
 my $inspc_f = shift;
 my $outspc_f = shift;
 my $ref_spc = shift;
 my $data_dir = shift;
 my $out_f = shift;
+my $num_threads = shift;
+if (!defined($num_threads) || $num_threads < 1) { $num_threads = 1; }
+
+my $config = read_config("$data_dir/config.file");
 
 open(F,"$inspc_f");
 my @inspcs = <F>;
@@ -27,57 +39,77 @@ foreach my $ospc (@outspcs) {
 	$hs_outspcs{$ospc} = 1;
 }
 	
-`echo "#species\tnum" >> $out_f`;
-
-my $curdir = getcwd;
+# the pair of each species is made in its own directory, up to $num_threads at once
+my $pm = new Parallel::ForkManager($num_threads);
 foreach my $tar_spc (@inspcs) {
 	if ($tar_spc eq $ref_spc) { next; }
+	$pm->start and next;
 	my $out_dir = "$data_dir/SFs_$tar_spc";
-	`mkdir -p $out_dir`;
-	`cp $data_dir/Makefile $out_dir/`;
-
-	my $sedstr = "sed ";
-	foreach my $spc (@inspcs) {
-		if ($spc eq $ref_spc || $spc eq $tar_spc) { next; }
-		$sedstr .= "-e 's:^$spc"."[[:space:]][[:space:]]*:#$spc :' ";
-	}
+	make_path($out_dir);
 
-	`$sedstr $data_dir/config.file > $out_dir/config.file`;
+	# the config file of the pair: the other species commented out, the
+	# target an ingroup
+	my @hide = grep { $_ ne $ref_spc && $_ ne $tar_spc } @inspcs;
+	my @ingroup = defined($hs_outspcs{$tar_spc}) ? ($tar_spc) : ();
+	write_config($config, "$out_dir/config.file", hide => \@hide, ingroup => \@ingroup);
+	copy("$data_dir/Makefile", "$out_dir/") or die "cannot copy $data_dir/Makefile: $!\n";
 
-	if (defined($hs_outspcs{$tar_spc})) {
-		`sed -e 's:${tar_spc}[[:space:]][[:space:]]*2:$tar_spc 1:' $out_dir/config.file > $out_dir/config.file.new`;
-		`mv $out_dir/config.file.new $out_dir/config.file`;	
+	# the segments of grabbing data are those of the main run, if it kept them
+	my $segs_f = "$tar_spc.processed.segs";
+	if (-f "$data_dir/$segs_f") {
+		my $abs_f = abs_path("$data_dir/$segs_f");
+		unlink("$out_dir/$segs_f");
+		symlink($abs_f, "$out_dir/$segs_f") or die "cannot link $out_dir/$segs_f: $!\n";
+	} elsif (-l "$out_dir/$segs_f") {
+		unlink("$out_dir/$segs_f");
 	}
 
-	`cp $data_dir/Makefile $out_dir/`;
-
 	chdir($out_dir);
-	`make pair`;
-	
-	open(F,"Genomes.Order");
+	if (-f $segs_f) {
+		`make pair.segs`;
+	} else {
+		`make pair`;
+	}
+	$pm->finish;
+}
+$pm->wait_all_children;
+
+open(O,">$out_f");
+print O "#species\tnum\n";
+foreach my $tar_spc (@inspcs) {
+	if ($tar_spc eq $ref_spc) { next; }
 	my $num_tarscf = 0;
 	my $num_sf = 0;
-	my $flag = "";
-	while(<F>) {
-		chomp;
-		if (length($_) == 0 || $_ =~ /^#/) { next; }
-		if ($_ =~ /^>$ref_spc\s+(\d+)/) {
-			$flag = "ref";
-		} elsif ($_ =~ /^>$tar_spc\s+(\d+)/) {
-			$flag = "tar";
-			$num_tarscf = $1;
-		} else {
-			if ($flag eq "ref") {
-				my @ar = split(/\s+/);
-				pop(@ar);
-				my $num = $ar[-1];
-				if ($num > $num_sf) { $num_sf = $num; }	
-			}
+	if (-f "$data_dir/SFs_$tar_spc/Genomes.db") {
+		my $db = read_genomedb("$data_dir/SFs_$tar_spc/Genomes.db");
+		$num_tarscf = scalar(genome_chroms($db, $tar_spc));
+		foreach my $chr (genome_chroms($db, $ref_spc)) {
+			if (scalar(@$chr) > 1 && $$chr[-1] > $num_sf) { $num_sf = $$chr[-1]; }
 		}
-	}	
-	close(F);
-	chdir($curdir);
+	} else {
+		open(F,"$data_dir/SFs_$tar_spc/Genomes.Order");
+		my $flag = "";
+		while(<F>) {
+			chomp;
+			if (length($_) == 0 || $_ =~ /^#/) { next; }
+			if ($_ =~ /^>$ref_spc\s+(\d+)/) {
+				$flag = "ref";
+			} elsif ($_ =~ /^>$tar_spc\s+(\d+)/) {
+				$flag = "tar";
+				$num_tarscf = $1;
+			} else {
+				if ($flag eq "ref") {
+					my @ar = split(/\s+/);
+					pop(@ar);
+					my $num = $ar[-1];
+					if ($num > $num_sf) { $num_sf = $num; }	
+				}
+			}
+		}	
+		close(F);
+	}
 
 	my $dist = $num_sf - $num_tarscf;
-	`echo "$tar_spc\t$dist" >> $out_f`;
+	print O "$tar_spc\t$dist\n";
 }
+close(O);
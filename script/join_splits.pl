@@ -7,6 +7,9 @@ use lib "$Bin/../lib/perl";
 use Bio::TreeIO;
 use Array::Utils qw(:all);
 use List::Util qw(max);
+use lib "$Bin";
+use GenomeDB;
+use DschIndex;
 
 my $min_adj_scr = shift;
 my $tree_f = shift;
@@ -53,41 +56,46 @@ while(<F>) {
 }
 close(F);
 
-# read order file
+# read order file, from Genomes.db if there is one
 my %hs_order = ();
-my $orspc = "";
-open(F,"$order_f");
-while(<F>) {
-	chomp;
-	if (length($_) == 0 || $_ =~ /^#/) { next; }
-
-	if ($_ =~ /^>(\S+)/) {
-		$orspc = $1;
-	} else {
-		my @ar = split(/\s+/);
-		pop(@ar);
-		if (scalar(@ar) >= 2) {
+if (-f "$sf_dir/Genomes.db") {
+	my $db = read_genomedb("$sf_dir/Genomes.db");
+	foreach my $spc (genome_names($db)) {
+		foreach my $chr (genome_chroms($db, $spc)) {
+			my (undef, @ar) = @$chr;
 			for (my $i = 0; $i < $#ar; $i++) {
-				my $bid1 = $ar[$i];	
-				my $bid2 = $ar[$i+1];
-				$hs_order{$orspc}{$bid1} = $bid2;	
-				$hs_order{$orspc}{-1*$bid2} = -1*$bid1;	
+				$hs_order{$spc}{$ar[$i]} = $ar[$i+1];
+				$hs_order{$spc}{-1*$ar[$i+1]} = -1*$ar[$i];
 			}
 		}
 	}
-}
-close(F);
+} else {
+	my $orspc = "";
+	open(F,"$order_f");
+	while(<F>) {
+		chomp;
+		if (length($_) == 0 || $_ =~ /^#/) { next; }
 
-# read adj. scores
-my %hs_adjscores = ();
-open(F,"$adjscore_f");
-while(<F>) {
-	chomp;
-	my ($bid1, $bid2, $score) = split(/\s+/);
-	$hs_adjscores{$bid1}{$bid2} = $score;
-	$hs_adjscores{-1*$bid2}{-1*$bid1} = $score;
+		if ($_ =~ /^>(\S+)/) {
+			$orspc = $1;
+		} else {
+			my @ar = split(/\s+/);
+			pop(@ar);
+			if (scalar(@ar) >= 2) {
+				for (my $i = 0; $i < $#ar; $i++) {
+					my $bid1 = $ar[$i];	
+					my $bid2 = $ar[$i+1];
+					$hs_order{$orspc}{$bid1} = $bid2;	
+					$hs_order{$orspc}{-1*$bid2} = -1*$bid1;	
+				}
+			}
+		}
+	}
+	close(F);
 }
-close(F);
+
+# adj. scores, looked up in the file
+my $scores = open_scores($adjscore_f);
 
 # read tree
 my $treein = new Bio::TreeIO(-format => "newick", -file => "$tree_f");
@@ -122,31 +130,9 @@ close(F);
 
 my @allspcs = (keys %ingrps, keys %outgrps);
 
-# read original join information
-my %hs_leafjoins = ();
-my %hs_leafbids = ();
-foreach my $spc (@allspcs) {
-	my $jf = "$sf_dir/$spc.joins";
-	open(F, "$jf");
-	while(<F>) {
-		chomp;
-		if ($_ =~ /^#/) { next; } 
-		my $str = $_;
-		$str =~ s/^\s+//;
-		$str =~ s/\s+$//;
-		my ($bid1, $bid2) = split(/\s+/, $str);
-
-		if ($bid1 == 0 || $bid2 == 0) { next; }
-
-		my ($rbid1, $rbid2) = (-1*$bid1, -1*$bid2);
-		$hs_leafjoins{$spc}{$bid1} = $bid2;	
-		$hs_leafjoins{$spc}{$rbid2} = $rbid1;	
-
-		$hs_leafbids{$spc}{abs($bid1)} = 1;
-		$hs_leafbids{$spc}{abs($bid2)} = 1;
-	}
-	close(F);
-}
+# original join information, looked up in the join database of the
+# species .joins files
+my $joins = open_joins("$sf_dir/Joins.db");
 
 # read conserved segments
 my %cs_list = ();
@@ -222,16 +208,16 @@ while(1) {
 			my $smax = max($score1, $score2, $score3, $score4);
 		
 			if ($score1 > 0.0 && $score1 == $smax) {
-				my $endscorei = $hs_adjscores{$bi}{0};
-				my $endscorej = $hs_adjscores{0}{$fj};
+				my $endscorei = $scores->score($bi, 0);
+				my $endscorej = $scores->score(0, $fj);
 
 					my $newjoin = "$join_i $join_j";
 					delete $hs_work{$apcfs[$aj]};
 					$hs_work{$apcfs[$ai]} = $newjoin;
 					$changed = 1;
 			} elsif ($score2 > 0.0 && $score2 == $smax) {
-				my $endscorei = $hs_adjscores{$bi}{0};
-				my $endscorej = $hs_adjscores{0}{-1*$bj};
+				my $endscorei = $scores->score($bi, 0);
+				my $endscorej = $scores->score(0, -1*$bj);
 
 					my $newjoin = $join_i;
 
@@ -244,8 +230,8 @@ while(1) {
 					$hs_work{$apcfs[$ai]} = $newjoin;
 					$changed = 1;	
 			} elsif ($score3 > 0.0 && $score3 == $smax) {
-				my $endscorei = $hs_adjscores{-1*$fi}{0};
-				my $endscorej = $hs_adjscores{0}{$fj};
+				my $endscorei = $scores->score(-1*$fi, 0);
+				my $endscorej = $scores->score(0, $fj);
 
 					my $newjoin = $join_j;
 
@@ -259,8 +245,8 @@ while(1) {
 		
 					$changed = 1;	
 			} elsif ($score4 > 0.0 && $score4 == $smax) {
-				my $endscorei = $hs_adjscores{-1*$fi}{0};
-				my $endscorej = $hs_adjscores{0}{-1*$bj};
+				my $endscorei = $scores->score(-1*$fi, 0);
+				my $endscorej = $scores->score(0, -1*$bj);
 
 					my $newjoin = "";
 
@@ -333,26 +319,26 @@ sub check_join {
 	my $bid1 = shift;
 	my $bid2 = shift;
 
-	my $adjscore = $hs_adjscores{$bid1}{$bid2};
+	my $adjscore = $scores->score($bid1, $bid2);
 	if (!defined($adjscore) || $adjscore < $MIN_SCORE || defined($hs_splits{$bid1}{$bid2})) { 
 		return 0.0; 
 	}
 
-	my ($incnt, $injoin) = get_joinspc($bid1, $bid2, \@ingroup, \%hs_leafjoins);
-    my ($outcnt, $outjoin) = get_joinspc($bid1, $bid2, \@outgroup, \%hs_leafjoins);
+	my ($incnt, $injoin) = get_joinspc($bid1, $bid2, \@ingroup);
+    my ($outcnt, $outjoin) = get_joinspc($bid1, $bid2, \@outgroup);
 
 	my %hs_leaf_adjs = ();
 	foreach my $ospc (@allspcs) {
 		my $join_flag = 2;
-		if (!defined($hs_leafbids{$ospc}{abs($bid1)}) || !defined($hs_leafbids{$ospc}{abs($bid2)})) {
+		if (!$joins->has_block($ospc, $bid1) || !$joins->has_block($ospc, $bid2)) {
 			# missing blocks	
 			$join_flag = 2;
-		} elsif (defined($hs_leafjoins{$ospc}{$bid1}) && $hs_leafjoins{$ospc}{$bid1} == $bid2) {
+		} elsif ($bid2 != 0 && $joins->has_join($ospc, $bid1, $bid2)) {
 			$join_flag = 1;
 		} else {
 			if (defined($hs_nonchrspc{$ospc})) {
-				my $tbid1 = $hs_leafjoins{$ospc}{$bid1};
-				my $tbid2 = $hs_leafjoins{$ospc}{-1*$bid2};
+				my $tbid1 = $joins->join_partner($ospc, $bid1);
+				my $tbid2 = $joins->join_partner($ospc, -1*$bid2);
 
 				if (defined($tbid1) && $tbid1 != $bid2) {
 					$join_flag = 0;
@@ -422,11 +408,10 @@ sub get_joinspc {
 	my $kbid1 = shift;
 	my $kbid2 = shift;
     my $rar_spc = shift;
-    my $rhs_join = shift;
 
     my $spcjoin = "";
     foreach my $spc (@$rar_spc) {
-        if (defined($$rhs_join{$spc}{$kbid1}) && $$rhs_join{$spc}{$kbid1} == $kbid2) {
+        if ($kbid2 != 0 && $joins->has_join($spc, $kbid1, $kbid2)) {
             my $spcname = $spc;
             $spcjoin .= "$spcname,";
         }
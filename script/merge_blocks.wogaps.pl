@@ -3,11 +3,20 @@
 use strict;
 use warnings;
 use FindBin qw($Bin);
+use lib "$Bin";
+use MergeMap;
+use lib "$Bin/../lib/perl";
+use Parallel::ForkManager;
 
 my $resolution = shift;
 my $ancspc = shift;
 my $config_f = shift;
 my $data_dir = shift;
+my $jobs = shift;
+# only the species of a comma-separated list, if given
+my $only = shift;
+my %only = ();
+if (defined($only) && $only ne "") { %only = map { $_ => 1 } split(/,/, $only); }
 
 my $refspc = "";
 my @spcs = ();
@@ -18,25 +27,33 @@ while(<F>) {
     if (length($_) == 0 || $_ =~ /^#/) { next; }
     if ($_ =~ /^(\S+)\s+(\d)/) {
 		my ($spc, $type) = ($1, $2);
-        if ($type == 0 || $type == 1) { push(@spcs, $1); }
-        elsif ($type == 2) { push(@ospcs, $1); }
-
-		if ($type == 0) { $refspc = $1; }
+		if ($type == 0) { $refspc = $spc; }
+		if (%only && !$only{$spc}) { next; }
+        if ($type == 0 || $type == 1) { push(@spcs, $spc); }
+        elsif ($type == 2) { push(@ospcs, $spc); }
     }
 }
 close(F);
 
-# ingroup
-foreach my $spc (@spcs) {
-	if ($spc eq $refspc) {
-		`$Bin/merge_pos3ex.ref.wogaps.pl $resolution $ancspc $spc $data_dir/APCF_$spc.map > $data_dir/APCF_$spc.merged.map`;
-	} else {
-		`$Bin/merge_pos3ex.wogaps.pl $resolution $ancspc $spc $data_dir/APCF_$refspc.map $data_dir/APCF_$spc.map > $data_dir/APCF_$spc.merged.map`; 	
+# every species on its own, up to jobs at once
+if (!defined($jobs) || $jobs !~ /^\d+$/ || $jobs < 1) { $jobs = 1; }
+my $pm = new Parallel::ForkManager($jobs);
+my $failed = 0;
+$pm->run_on_finish(sub { my ($pid, $code) = @_; if ($code != 0) { $failed = 1; } });
+foreach my $spc (@spcs, @ospcs) {
+	$pm->start and next;
+	my $map_f = "$data_dir/APCF_$spc.map";
+	if (grep { $_ eq $spc } @ospcs) {
+		# an outgroup is split first
+		open(my $out, ">", "$map_f.split") or die "cannot write $map_f.split\n";
+		split_map($ancspc, $map_f, $out);
+		close($out);
+		$map_f = "$map_f.split";
 	}
+	open(my $out, ">", "$data_dir/APCF_$spc.merged.map") or die "cannot write $data_dir/APCF_$spc.merged.map\n";
+	merge_map($ancspc, $spc, $map_f, $out);
+	close($out);
+	$pm->finish;
 }
-# outgroup
-foreach my $spc (@ospcs) {
-	`$Bin/split_ospc_map.pl APCF $data_dir/APCF_$spc.map > $data_dir/APCF_$spc.map.split`;
-	`$Bin/merge_pos3ex.ref.wogaps.pl $resolution $ancspc $spc $data_dir/APCF_$spc.map.split > $data_dir/APCF_$spc.merged.map`; 	
-}
-
+$pm->wait_all_children;
+if ($failed) { die "failed to merge the blocks of some species\n"; }
@@ -0,0 +1,103 @@
+#!/usr/bin/perl
+
+# profile_stacks.pl - the folded stacks of the stages of a run with
+# PROFILE, for flamegraph.pl: the <stage>.<pid>.stacks the tools wrote
+# in dir (code/makeBlocks/profile.h) with their frames named by the
+# symbols of nm, as dir/<stage>.folded for each stage (its processes
+# added up) and dir/run.folded of them all, each stack under its stage.
+#
+#   usage: profile_stacks.pl dir
+#   then:  flamegraph.pl dir/run.folded > run.svg
+
+use strict;
+use warnings;
+use File::Basename;
+
+my $dir = shift;
+if (!defined($dir) || !(-d $dir)) {
+	die "usage: profile_stacks.pl dir\n";
+}
+
+# the stacks of each stage, their frames as [module path, address]
+my %stacks = ();
+my %addrs = ();
+foreach my $f (sort glob("$dir/*.stacks")) {
+	my $stage = basename($f);
+	$stage =~ s/\.\d+\.stacks$//;
+	my %mod = ();
+	open(F, "<", $f) or die "cannot read $f\n";
+	while (<F>) {
+		chomp;
+		if ($_ =~ /^#/) { next; }
+		if ($_ =~ /^@(\d+) (.*)$/) {
+			$mod{$1} = $2;
+			next;
+		}
+		my ($count, @frames) = split(/ /);
+		my @stack = ();
+		foreach my $fr (@frames) {
+			my ($m, $a) = split(/:/, $fr);
+			my $path = defined($mod{$m}) ? $mod{$m} : "";
+			push(@stack, [$path, $a]);
+			if ($path ne "") { $addrs{$path}{$a} = 1; }
+		}
+		push(@{$stacks{$stage}}, [$count, \@stack]);
+	}
+	close(F);
+}
+if (!%stacks) { exit(0); }
+
+# the function of each address, the symbol of its module holding it (nm;
+# a library without its symbol table has those it exports)
+my %name = ();
+foreach my $path (keys %addrs) {
+	my @list = sort { hex($a) <=> hex($b) } keys %{$addrs{$path}};
+	my @syms = read_syms($path, "");
+	if (!@syms) { @syms = read_syms($path, "-D"); }
+	my $mod = basename($path);
+	my $k = 0;
+	foreach my $a (@list) {
+		my $x = hex($a);
+		while ($k < $#syms && $syms[$k + 1][0] <= $x) { $k++; }
+		my $s = $syms[$k];
+		$name{$path}{$a} = (defined($s) && $s->[0] <= $x && $x < $s->[0] + $s->[1]) ? $s->[2] : "$mod+0x$a";
+	}
+}
+
+my %run = ();
+foreach my $stage (sort keys %stacks) {
+	my %folded = ();
+	foreach my $s (@{$stacks{$stage}}) {
+		my ($count, $stack) = @$s;
+		# flamegraph.pl splits the frames at ';'
+		my $key = join(";", map { my ($p, $a) = @$_; my $n = ($p eq "") ? "0x$a" : $name{$p}{$a}; $n =~ s/;/:/g; $n } @$stack);
+		$folded{$key} += $count;
+	}
+	open(O, ">", "$dir/$stage.folded") or die "cannot write $dir/$stage.folded\n";
+	foreach my $key (sort keys %folded) {
+		print O "$key $folded{$key}\n";
+		$run{"$stage;$key"} += $folded{$key};
+	}
+	close(O);
+}
+open(O, ">", "$dir/run.folded") or die "cannot write $dir/run.folded\n";
+foreach my $key (sort keys %run) { print O "$key $run{$key}\n"; }
+close(O);
+
+# the functions of a module with their sizes, [address, size, name] by address
+sub read_syms {
+	my ($path, $opt) = @_;
+	my @syms = ();
+	my $in;
+	if (!(-f $path) || !open($in, "-|", "nm $opt -C -S --defined-only '$path' 2>/dev/null")) { return (); }
+	while (<$in>) {
+		if ($_ =~ /^([0-9a-f]+) ([0-9a-f]+) [TtWi] (.+)$/) {
+			my ($start, $size, $fn) = (hex($1), hex($2), $3);
+			# without the version of a library symbol, free@@GLIBC_2.2.5
+			$fn =~ s/@@?[\w.]+$//;
+			push(@syms, [$start, $size, $fn]);
+		}
+	}
+	close($in);
+	return sort { $a->[0] <=> $b->[0] } @syms;
+}
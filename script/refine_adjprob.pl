@@ -7,11 +7,35 @@ my $prob_f = shift;
 
 my $max_prob = 0;
 my %hs_probs = ();
-open(F, "$prob_f");
-while(<F>) {
-	chomp;
-	if ($_ =~ /^#/ || length($_) == 0) { next; }
-	my ($bid1, $bid2, $prob) = split(/\s+/);
+open(F, "$prob_f") or die "Unable to open $prob_f\n";
+binmode(F);
+my $magic = "";
+read(F, $magic, 8);
+if ($magic eq "ADJPROB\0") {
+	# binary output of inferAdjProb -binary: int32 version, int32 T, then
+	# (int32, int32, float64) records
+	my $hdr = "";
+	read(F, $hdr, 8) == 8 or die "Truncated header in $prob_f\n";
+	my ($version, $numblocks) = unpack("l l", $hdr);
+	die "Unsupported adjacency file version $version\n" if ($version != 1);
+	my $rec = "";
+	while (read(F, $rec, 16) == 16) {
+		my ($bid1, $bid2, $prob) = unpack("l l d", $rec);
+		add_prob($bid1, $bid2, $prob);
+	}
+} else {
+	seek(F, 0, 0);
+	while(<F>) {
+		chomp;
+		if ($_ =~ /^#/ || length($_) == 0) { next; }
+		my ($bid1, $bid2, $prob) = split(/\s+/);
+		add_prob($bid1, $bid2, $prob);
+	}
+}
+close(F);
+
+sub add_prob {
+	my ($bid1, $bid2, $prob) = @_;
 
 	if ($prob > $max_prob) { $max_prob = $prob; }
 
@@ -28,7 +52,6 @@ while(<F>) {
 		$hs_probs{$bid1}{$bid2} = $prob;	
 	}
 }
-close(F);
 
 # normalization and print out
 foreach my $bid1 (sort {abs($a)<=>abs($b)} keys %hs_probs) {
@@ -0,0 +1,40 @@
+#!/usr/bin/perl
+
+# species_map.pl - the mapping files of species a run with OUTPUT_SPECIES
+# left out, made when they are wanted: APCF_<spc>.map, .merged.map and,
+# for an outgroup, .map.split, from the APCFs and conserved segments of
+# the output directory, as wrap_recon_apcf.pl makes those of the others.
+# With index, they are also compressed and indexed as MAPINDEX=yes does.
+#
+#   usage: species_map.pl out_dir spc[,spc...] [index]
+
+use strict;
+use warnings;
+use FindBin qw($Bin);
+
+my $out_dir = shift;
+my $spcs = shift;
+my $index = shift;
+if (!defined($spcs)) {
+	die "usage: species_map.pl out_dir spc[,spc...] [index]\n";
+}
+
+foreach my $f ("SFs/config.file", "SFs/Conserved.Segments", "Ancestor.APCF") {
+	if (!(-f "$out_dir/$f")) { die "no $out_dir/$f\n"; }
+}
+my $jobs = $ENV{"DESCHRAMBLER_THREADS"} || `nproc`;
+chomp($jobs);
+# merge_blocks.wogaps.pl reads no resolution
+run("$Bin/../code/makeBlocks/createMapFiles -species $spcs $out_dir/SFs/config.file $out_dir/SFs/Conserved.Segments $out_dir/Ancestor.APCF $out_dir/");
+run("$Bin/merge_blocks.wogaps.pl 0 APCF $out_dir/SFs/config.file $out_dir/ $jobs $spcs");
+if (defined($index) && $index eq "index") {
+	foreach my $spc (split(/,/, $spcs)) {
+		run("$Bin/../code/makeBlocks/indexMap $out_dir/APCF_$spc.map");
+		run("$Bin/../code/makeBlocks/indexMap $out_dir/APCF_$spc.merged.map");
+	}
+}
+
+sub run {
+	my $cmd = shift;
+	system($cmd) == 0 or die "failed: $cmd\n";
+}
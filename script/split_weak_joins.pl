@@ -3,6 +3,8 @@
 use strict;
 use warnings;
 use FindBin qw($Bin);
+use lib "$Bin";
+use JoinDB;
 use lib "$Bin/../lib/perl";
 use Bio::TreeIO;
 use Array::Utils qw(:all);
@@ -23,8 +25,9 @@ my @outgroup = ();
 my @allspc = read_spcinfo("$sf_dir/config.file", \@ingroup, \@outgroup);
 
 # read join information
-my %hs_join = ();
-read_joininfo("$sf_dir", \@allspc, \%hs_join);
+my $joindb = read_joindb("$sf_dir/Joins.db");
+my $inmask = spc_mask($joindb, @ingroup);
+my $outmask = spc_mask($joindb, @outgroup);
 
 open(O,">$outjoin_f");
 open(OS, ">$split_f");
@@ -46,18 +49,9 @@ while(<F>) {
             my $bid1 = $ar[$i];
             my $bid2 = $ar[$i+1];
 
-			my $injoin = get_joinspc("$bid1:$bid2", \@ingroup, \%hs_join);
-			my $outjoin = get_joinspc("$bid1:$bid2", \@outgroup, \%hs_join);
-
-			my ($incnt, $outcnt) = (0, 0);
-			if (length($injoin) > 0) {
-				my @artmp = split(/,/, $injoin);
-				$incnt = scalar(@artmp);
-			}
-			if (length($outjoin) > 0) {
-				my @artmp = split(/,/, $outjoin);
-				$outcnt = scalar(@artmp);
-			}
+			my $mask = join_mask($joindb, $bid1, $bid2);
+			my $incnt = spc_count($mask & $inmask);
+			my $outcnt = spc_count($mask & $outmask);
 
 			my $outcntfrac = $outcnt/scalar(@outgroup);
 			my $incntfrac = $incnt / scalar(@ingroup);
@@ -118,48 +112,3 @@ sub read_spcinfo {
     close(F);
     return @allspc;
 }
-
-sub read_joininfo {
-    my $dir = shift;
-    my $rar_allspc = shift;
-    my $rhs_join = shift;
-
-    foreach my $spc (@$rar_allspc) {
-        my $f = "$dir/$spc.joins";                               
-        open(F, "$f");                                           
-        while(<F>) {                                             
-            chomp;                                               
-            if (length($_) == 0 || $_ =~ /^#/) { next; }         
-            my $line = $_;                                       
-            #trimming                                            
-            $line =~ s/^\s+//;                                   
-            $line =~ s/\s+$//;                                   
-                                                                 
-            my ($bid1, $bid2) = split(/\s+/, $line);             
-            my ($rbid1, $rbid2) = (-1*$bid1, -1*$bid2);          
-            $$rhs_join{$spc}{"$bid1:$bid2"} = 1;                 
-            $$rhs_join{$spc}{"$rbid2:$rbid1"} = 1;               
-        }                                                        
-        close(F);                                                
-    }                                                            
-} 
-
-sub get_joinspc {
-    my $key = shift;
-    my $rar_spc = shift;
-    my $rhs_join = shift;
-
-    my $spcjoin = "";
-    foreach my $spc (@$rar_spc) {
-        if (defined($$rhs_join{$spc}{$key})) {
-            my $spcname = $spc;
-            $spcjoin .= "$spcname,";
-        }
-    }
-
-    if (length($spcjoin) == 0) {
-        return "";
-    } else {
-        return substr($spcjoin, 0, length($spcjoin)-1);
-    }                                                            
-}                                            
@@ -4,7 +4,12 @@ use strict;
 use warnings;
 use Cwd;
 use Cwd 'abs_path';
+use File::Path qw(make_path);
+use File::Temp qw(tempdir);
 use FindBin qw($Bin);
+use lib "$Bin";
+use Stages;
+use SpcConfig;
 
 my $tree_f = shift;
 my $resolution = shift;
@@ -12,16 +17,29 @@ my $ref_spc = shift;
 my $min_adj_scr = shift;
 my $src_dir = shift;
 my $out_dir = shift;
+my $num_threads = shift;
+if (!defined($num_threads)) { $num_threads = ""; }
 
 $tree_f = abs_path($tree_f);
-system("mkdir -p $out_dir");
+make_path($out_dir);
 
 # extract outgroup species: ingroup.txt outgroup.txt
-`$Bin/ext_spcgroups.pl $src_dir/config.file $src_dir`;
-
-# estimate breakpoint distance
-if (-f "$src_dir/bpdist.txt") { `rm $src_dir/bpdist.txt`; } 
-`$Bin/estimate_bpdist4.pl $src_dir/ingroup.txt $src_dir/outgroup.txt $ref_spc $src_dir $src_dir/bpdist.txt`;
+my $config = read_config("$src_dir/config.file");
+write_spcgroups($config, $src_dir);
+
+# estimate breakpoint distance; with DESCHRAMBLER_BPDIST, those of the
+# same species, made once for several target ancestors or, by
+# DESCHRAMBLER.pl, while the SFs were made
+my $bpdist_f = $ENV{"DESCHRAMBLER_BPDIST"} || "";
+if ($bpdist_f ne "") {
+	if (!(-e "$src_dir/bpdist.txt") || abs_path($bpdist_f) ne abs_path("$src_dir/bpdist.txt")) { `cp $bpdist_f $src_dir/bpdist.txt`; }
+} else {
+	run_stage("$src_dir/.stage.bpdist", "$Bin/../code/makeBlocks/estimateBpDist config.file $num_threads > bpdist.txt",
+		dir => $src_dir, key => "estimateBpDist config.file",
+		inputs => ["$src_dir/config.file", config_dirs("$src_dir/config.file")],
+		tools => ["$Bin/../code/makeBlocks/estimateBpDist"], outputs => ["$src_dir/bpdist.txt"],
+		cost => {tool => "estimateBpDist", threads => $num_threads, io => 1});
+}
 
 # check tree.txt file
 if (!(-f "$tree_f")) {
@@ -29,51 +47,119 @@ if (!(-f "$tree_f")) {
 	die;
 }
 
-my $tout = `cat $tree_f`;
+open(F,"$tree_f");
+my $tout = do { local $/; <F> };
+close(F);
 print STDERR "TREE $tout\n";
 
-# eatimate JC model parameter
+# eatimate JC model parameter, piped into inferAdjProb: it reads the
+# genomes and indexes the candidates while alpha is estimated
 open(F,"$src_dir/$ref_spc.joins");
 my $tmp = <F>;
 close(F);
 chomp($tmp);
 my $numblocks = substr($tmp, 1);
-my $jkalpha = `$Bin/estparJC.pl $numblocks $ref_spc $tree_f $src_dir/bpdist.txt`;
-chomp($jkalpha);
-print STDERR "Estimate JC parameter: $jkalpha\n";
+my $jc_cmd = "$Bin/../code/makeBlocks/newickTool jc $tree_f $numblocks $ref_spc bpdist.txt";
 
 # create new genome file
-`$Bin/create_gfile.pl $src_dir`;
-
-# compute adjacency probabilities
-my $curdir = getcwd;
-chdir($src_dir);
-
-`$Bin/../code/inferAdjProb $ref_spc $jkalpha $tree_f Genomes.Order`; 
-
-chdir($curdir);
-
-# refine adjacency probabilities
-`$Bin/refine_adjprob.pl $src_dir/adjacencies.prob > $src_dir/block_consscores.txt`;
-
-`$Bin/../code/deschrambler $min_adj_scr $src_dir/block_consscores.txt $out_dir/Ancestor.APCF.partial $out_dir/Ancestor.ADJS`;
-
-`$Bin/add_missing_blocks.pl $src_dir/block_list.txt $out_dir/Ancestor.APCF.partial > $out_dir/Ancestor.APCF.tmp1`;
-
-`$Bin/split_weak_joins.pl $out_dir/Ancestor.APCF.tmp1 $src_dir $out_dir/Ancestor.APCF.tmp2 $out_dir/Ancestor.splits`;
-`$Bin/join_splits.pl $min_adj_scr $tree_f $out_dir/Ancestor.APCF.tmp2 $src_dir $out_dir/Ancestor.splits > $out_dir/Ancestor.APCF.unordered`;
-
-`$Bin/sort_apcfs.pl $ref_spc $out_dir/Ancestor.APCF.unordered $src_dir/Conserved.Segments > $out_dir/Ancestor.APCF`; 
-
-`$Bin/ext_join_info.pl $out_dir/Ancestor.APCF $src_dir/ > $out_dir/Ancestor.joins`; 
-
-`$Bin/../code/makeBlocks/createCarFile $out_dir/SFs/config.file $out_dir/Ancestor.APCF $out_dir/SFs/Conserved.Segments > $out_dir/APCFs`;
-
-# create mapping files
+write_genome_file($src_dir, config_outgroup($config));
+
+# compute adjacency probabilities, and the refined scores from them; the
+# orders are mapped from Genomes.db when createGenomeFile wrote one
+my $genome_f = (-f "$src_dir/Genomes.db") ? "Genomes.db" : "Genomes.Order";
+# with DESCHRAMBLER_COARSE, the SFs of a coarser run, the candidates that
+# contradict its adjacencies of at least DESCHRAMBLER_COARSEPRUNE are dropped
+my $coarse_opt = "";
+my @coarse_inputs = ();
+my $coarse_dir = $ENV{"DESCHRAMBLER_COARSE"} || "";
+if ($coarse_dir ne "" && -f "$coarse_dir/adjacencies.prob") {
+	my $min_prob = $ENV{"DESCHRAMBLER_COARSEPRUNE"} || 0.9;
+	run_cmd("$Bin/coarse_adjs.pl $ref_spc $coarse_dir $src_dir $min_prob > $src_dir/coarse.adjs");
+	$coarse_opt = "-coarse=coarse.adjs ";
+	@coarse_inputs = ("$src_dir/coarse.adjs");
+}
+# with DESCHRAMBLER_PRUNEADJS, the adjacencies below the minimum score are
+# left out of the outputs, their posterior summed in adjacencies.dropped
+my $prune_opt = "";
+my @prune_outputs = ();
+if ($ENV{"DESCHRAMBLER_PRUNEADJS"}) {
+	$prune_opt = "-minProb=$min_adj_scr -dropped=adjacencies.dropped ";
+	@prune_outputs = ("$src_dir/adjacencies.dropped");
+}
+my $adjprob_out = run_stage("$src_dir/.stage.adjprob", "$jc_cmd | $Bin/../code/inferAdjProb -scores=block_consscores.txt $coarse_opt$prune_opt$ref_spc - $tree_f $genome_f",
+	dir => $src_dir, inputs => ["$src_dir/$genome_f", $tree_f, glob("$src_dir/*.joins"), "$src_dir/bpdist.txt", @coarse_inputs],
+	tools => ["$Bin/../code/makeBlocks/newickTool", "$Bin/../code/inferAdjProb"],
+	outputs => ["$src_dir/adjacencies.prob", "$src_dir/block_consscores.txt", @prune_outputs],
+	cost => {tool => "inferAdjProb", threads => ""});
+if ($adjprob_out =~ /^alpha=(\S+)/m) { print STDERR "Estimate JC parameter: $1\n"; }
+
+# with DESCHRAMBLER_SCRATCH, a directory on a local disk, the intermediate
+# APCFs are written there instead of out_dir, each removed once the last
+# step reading it is done
+my $tmp_dir = $out_dir;
+my $scratch = $ENV{"DESCHRAMBLER_SCRATCH"} || "";
+if ($scratch ne "") {
+	make_path($scratch);
+	$tmp_dir = tempdir("recon.XXXXXX", DIR => $scratch, CLEANUP => 1);
+}
+my @temps = map { "$tmp_dir/Ancestor.$_" } ("APCF.partial", "APCF.tmp1", "APCF.tmp2", "splits", "APCF.unordered");
+my ($partial, $tmp1, $tmp2, $splits, $unordered) = @temps;
+if ($scratch eq "") { @temps = (); }
+
+# the APCFs of the last run by component, so that a run on changed scores
+# only assembles the components whose edges changed
+my $desch_args = "$min_adj_scr $src_dir/block_consscores.txt $partial $out_dir/Ancestor.ADJS";
+run_stage("$out_dir/.stage.deschrambler", "$Bin/../code/deschrambler -state $out_dir/.deschrambler.state $desch_args",
+	key => "$Bin/../code/deschrambler $desch_args",
+	inputs => ["$src_dir/block_consscores.txt"], tools => ["$Bin/../code/deschrambler"],
+	outputs => [$partial, "$out_dir/Ancestor.ADJS"], cost => {tool => "deschrambler", threads => 1},
+	next => ["$src_dir/Conserved.Segments"]);
+
+# the rest, each step once its inputs are made
+my $jobs = ($num_threads ne "") ? $num_threads : ($ENV{"DESCHRAMBLER_THREADS"} || `nproc`);
+chomp($jobs);
 my $shortres = int($resolution/1000);
-`$Bin/create_mapfile.pl $src_dir/config.file $src_dir/Conserved.Segments $src_dir/block_consscores.txt $out_dir/Ancestor.APCF $out_dir/Ancestor.ADJS $out_dir/`;
-
-# merge blocks in mapping files
-`$Bin/merge_blocks.wogaps.pl $resolution APCF $out_dir/SFs/config.file $out_dir/`;
-`$Bin/compute_size.pl APCF $out_dir/APCF_$ref_spc.merged.map > $out_dir/APCF_size.txt`;
-
+# with DESCHRAMBLER_OUTPUTSPECIES, the mapping files of those species and
+# the reference alone; script/species_map.pl makes another's when wanted
+my $map_opt = "";
+my $merge_only = "";
+my $out_spcs = $ENV{"DESCHRAMBLER_OUTPUTSPECIES"} || "";
+if ($out_spcs ne "" && $out_spcs ne "all") {
+	my @names = ($ref_spc, grep { $_ ne $ref_spc } split(/\s*,\s*/, $out_spcs));
+	$merge_only = " " . join(",", @names);
+	$map_opt = "-species " . join(",", @names) . " ";
+}
+# with DESCHRAMBLER_JOINBUDGET, the seconds joinSplits may take
+my $join_opt = "";
+if ($ENV{"DESCHRAMBLER_JOINBUDGET"}) { $join_opt = "-budget $ENV{\"DESCHRAMBLER_JOINBUDGET\"} "; }
+my @steps = (
+	{ name => "add_missing", reads => [$partial], temps => \@temps,
+	  cmd => "$Bin/../code/makeBlocks/finishApcfs -missing $src_dir/config.file $src_dir/Conserved.Segments $partial > $tmp1" },
+	{ name => "split_weak", after => ["add_missing"], reads => [$tmp1], inputs => ["$src_dir/Joins.db"],
+	  cmd => "$Bin/../code/makeBlocks/finishApcfs -split $src_dir/config.file $src_dir $tmp1 $tmp2 $splits $jobs" },
+	{ name => "join_splits", after => ["split_weak"], reads => [$tmp2, $splits],
+	  inputs => ["$src_dir/$genome_f", "$src_dir/block_consscores.txt"],
+	  cmd => "$Bin/../code/joinSplits $join_opt$min_adj_scr $tree_f $tmp2 $src_dir $splits > $unordered" },
+	# sorted by length, with the species of every join
+	{ name => "sort_apcfs", after => ["join_splits"], reads => [$unordered],
+	  cmd => "$Bin/../code/makeBlocks/finishApcfs $src_dir/config.file $src_dir/Conserved.Segments $src_dir $unordered $out_dir/Ancestor.joins > $out_dir/Ancestor.APCF" },
+	{ name => "car_file", after => ["sort_apcfs"],
+	  cmd => "$Bin/../code/makeBlocks/createCarFile $out_dir/SFs/config.file $out_dir/Ancestor.APCF $out_dir/SFs/Conserved.Segments > $out_dir/APCFs" },
+	# create mapping files
+	{ name => "mapfile", after => ["sort_apcfs"],
+	  cmd => "$Bin/../code/makeBlocks/createMapFiles $map_opt$src_dir/config.file $src_dir/Conserved.Segments $out_dir/Ancestor.APCF $out_dir/" },
+	# merge blocks in mapping files
+	{ name => "merge_blocks", after => ["mapfile"],
+	  script => ["$Bin/merge_blocks.wogaps.pl", $resolution, "APCF", "$out_dir/SFs/config.file", "$out_dir/", $jobs, split(" ", $merge_only)],
+	  cmd => "$Bin/merge_blocks.wogaps.pl $resolution APCF $out_dir/SFs/config.file $out_dir/ $jobs$merge_only" },
+	{ name => "size", after => ["merge_blocks"],
+	  script => ["$Bin/compute_size.pl", "APCF", "$out_dir/APCF_$ref_spc.merged.map"], stdout => "$out_dir/APCF_size.txt",
+	  cmd => "$Bin/compute_size.pl APCF $out_dir/APCF_$ref_spc.merged.map > $out_dir/APCF_size.txt" });
+# compressed and indexed mapping files, with MAPINDEX; "only" keeps no plain ones
+my $map_index = $ENV{"DESCHRAMBLER_MAPINDEX"} || "";
+if ($map_index ne "" && $map_index ne "no") {
+	my $rm = ($map_index eq "only") ? " && rm -f \$f" : "";
+	push(@steps, { name => "index_maps", after => ["merge_blocks", "size"],
+	  cmd => "for f in $out_dir/APCF_*.map; do $Bin/../code/makeBlocks/indexMap \$f$rm || exit 1; done" });
+}
+run_graph($jobs, @steps);